@@ -36,14 +36,6 @@ DualEdgeTriangulation::~DualEdgeTriangulation()
     }
   }
 
-  //remove all the HalfEdge
-  if ( !mHalfEdge.isEmpty() )
-  {
-    for ( int i = 0; i < mHalfEdge.count(); i++ )
-    {
-      delete mHalfEdge[i];
-    }
-  }
 }
 
 void DualEdgeTriangulation::performConsistencyTest()
@@ -52,8 +44,8 @@ void DualEdgeTriangulation::performConsistencyTest()
 
   for ( int i = 0; i < mHalfEdge.count(); i++ )
   {
-    int a = mHalfEdge[mHalfEdge[i]->getDual()]->getDual();
-    int b = mHalfEdge[mHalfEdge[mHalfEdge[i]->getNext()]->getNext()]->getNext();
+    int a = mHalfEdge[mHalfEdge[i].getDual()].getDual();
+    int b = mHalfEdge[mHalfEdge[mHalfEdge[i].getNext()].getNext()].getNext();
     if ( i != a )
     {
       QgsDebugMsg( "warning, first test failed" );
@@ -153,8 +145,8 @@ int DualEdgeTriangulation::addPoint( Point3D* p )
     {
       unsigned int zedge = insertEdge( -10, -10, -1, false, false );//edge pointing from p to the virtual point
       unsigned int fedge = insertEdge(( int )zedge, ( int )zedge, 0, false, false );//edge pointing from the virtual point to p
-      ( mHalfEdge.at( zedge ) )->setDual(( int )fedge );
-      ( mHalfEdge.at( zedge ) )->setNext(( int )fedge );
+      mHalfEdge[ zedge ].setDual(( int )fedge );
+      mHalfEdge[ zedge ].setNext(( int )fedge );
 
     }
 
@@ -174,12 +166,12 @@ int DualEdgeTriangulation::addPoint( Point3D* p )
       unsigned int tedge = insertEdge(( int )sedge, 0, 0, false, false );//edge pointing from point 1 to point 0
       unsigned int foedge = insertEdge( -10, 4, 1, false, false );//edge pointing from the virtual point to point 1
       unsigned int fiedge = insertEdge(( int )foedge, 1, -1, false, false );//edge pointing from point 2 to the virtual point
-      mHalfEdge.at( sedge )->setDual(( int )tedge );
-      mHalfEdge.at( sedge )->setNext(( int )fiedge );
-      mHalfEdge.at( foedge )->setDual(( int )fiedge );
-      mHalfEdge.at( foedge )->setNext(( int )tedge );
-      mHalfEdge.at( 0 )->setNext(( int )foedge );
-      mHalfEdge.at( 1 )->setNext(( int )sedge );
+      mHalfEdge[ sedge ].setDual(( int )tedge );
+      mHalfEdge[ sedge ].setNext(( int )fiedge );
+      mHalfEdge[ foedge ].setDual(( int )fiedge );
+      mHalfEdge[ foedge ].setNext(( int )tedge );
+      mHalfEdge[ 0 ].setNext(( int )foedge );
+      mHalfEdge[ 1 ].setNext(( int )sedge );
 
       mEdgeInside = 3;
     }
@@ -197,14 +189,14 @@ int DualEdgeTriangulation::addPoint( Point3D* p )
         unsigned int edged = insertEdge( -10, 2, 0, false, false );//edge pointing from point2 to point0
         unsigned int edgee = insertEdge(( int )edged, -10, 2, false, false );//edge pointing from point0 to point2
         unsigned int edgef = insertEdge(( int )edgec, 1, -1, false, false );//edge pointing from point2 to the virtual point
-        mHalfEdge.at( edgea )->setDual(( int )edgeb );
-        mHalfEdge.at( edgea )->setNext(( int )edged );
-        mHalfEdge.at( edgec )->setDual(( int )edgef );
-        mHalfEdge.at( edged )->setDual(( int )edgee );
-        mHalfEdge.at( edgee )->setNext(( int )edgef );
-        mHalfEdge.at( 5 )->setNext(( int )edgec );
-        mHalfEdge.at( 1 )->setNext(( int )edgee );
-        mHalfEdge.at( 2 )->setNext(( int )edgea );
+        mHalfEdge[ edgea ].setDual(( int )edgeb );
+        mHalfEdge[ edgea ].setNext(( int )edged );
+        mHalfEdge[ edgec ].setDual(( int )edgef );
+        mHalfEdge[ edged ].setDual(( int )edgee );
+        mHalfEdge[ edgee ].setNext(( int )edgef );
+        mHalfEdge[ 5 ].setNext(( int )edgec );
+        mHalfEdge[ 1 ].setNext(( int )edgee );
+        mHalfEdge[ 2 ].setNext(( int )edgea );
       }
 
       else if ( number > leftOfTresh )//p is on the right side
@@ -216,14 +208,14 @@ int DualEdgeTriangulation::addPoint( Point3D* p )
         unsigned int edged = insertEdge( -10, 3, 1, false, false );//edge pointing from p2 to p1
         unsigned int edgee = insertEdge(( int )edged, -10, 2, false, false );//edge pointing from p1 to p2
         unsigned int edgef = insertEdge(( int )edgec, 4, -1, false, false );//edge pointing from p2 to the virtual point
-        mHalfEdge.at( edgea )->setDual(( int )edgeb );
-        mHalfEdge.at( edgea )->setNext(( int )edged );
-        mHalfEdge.at( edgec )->setDual(( int )edgef );
-        mHalfEdge.at( edged )->setDual(( int )edgee );
-        mHalfEdge.at( edgee )->setNext(( int )edgef );
-        mHalfEdge.at( 0 )->setNext(( int )edgec );
-        mHalfEdge.at( 4 )->setNext(( int )edgee );
-        mHalfEdge.at( 3 )->setNext(( int )edgea );
+        mHalfEdge[ edgea ].setDual(( int )edgeb );
+        mHalfEdge[ edgea ].setNext(( int )edged );
+        mHalfEdge[ edgec ].setDual(( int )edgef );
+        mHalfEdge[ edged ].setDual(( int )edgee );
+        mHalfEdge[ edgee ].setNext(( int )edgef );
+        mHalfEdge[ 0 ].setNext(( int )edgec );
+        mHalfEdge[ 4 ].setNext(( int )edgee );
+        mHalfEdge[ 3 ].setNext(( int )edgea );
       }
 
       else//p is in a line with p0 and p1
@@ -245,52 +237,52 @@ int DualEdgeTriangulation::addPoint( Point3D* p )
         unsigned int ccwedge = mEdgeOutside;//the last visible edge counterclockwise from mEdgeOutside
 
         //mEdgeOutside is in each case visible
-        mHalfEdge[mHalfEdge[mEdgeOutside]->getNext()]->setPoint( mPointVector.count() - 1 );
+        mHalfEdge[mHalfEdge[mEdgeOutside].getNext()].setPoint( mPointVector.count() - 1 );
 
         //find cwedge and replace the virtual point with the new point when necessary
-        while ( MathUtils::leftOf( mPointVector[( unsigned int ) mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[cwedge]->getNext()]->getDual()]->getNext()]->getPoint()], p, mPointVector[( unsigned int ) mHalfEdge[cwedge]->getPoint()] ) < ( -leftOfTresh ) )
+        while ( MathUtils::leftOf( mPointVector[( unsigned int ) mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[cwedge].getNext()].getDual()].getNext()].getPoint()], p, mPointVector[( unsigned int ) mHalfEdge[cwedge].getPoint()] ) < ( -leftOfTresh ) )
         {
           //set the point number of the necessary edge to the actual point instead of the virtual point
-          mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[cwedge]->getNext()]->getDual()]->getNext()]->getNext()]->setPoint( mPointVector.count() - 1 );
+          mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[cwedge].getNext()].getDual()].getNext()].getNext()].setPoint( mPointVector.count() - 1 );
           //advance cwedge one edge further clockwise
-          cwedge = ( unsigned int )mHalfEdge[mHalfEdge[mHalfEdge[cwedge]->getNext()]->getDual()]->getNext();
+          cwedge = ( unsigned int )mHalfEdge[mHalfEdge[mHalfEdge[cwedge].getNext()].getDual()].getNext();
         }
 
         //build the necessary connections with the virtual point
-        unsigned int edge1 = insertEdge( mHalfEdge[cwedge]->getNext(), -10, mHalfEdge[cwedge]->getPoint(), false, false );//edge pointing from the new point to the last visible point clockwise
-        unsigned int edge2 = insertEdge( mHalfEdge[mHalfEdge[cwedge]->getNext()]->getDual(), -10, -1, false, false );//edge pointing from the last visible point to the virtual point
+        unsigned int edge1 = insertEdge( mHalfEdge[cwedge].getNext(), -10, mHalfEdge[cwedge].getPoint(), false, false );//edge pointing from the new point to the last visible point clockwise
+        unsigned int edge2 = insertEdge( mHalfEdge[mHalfEdge[cwedge].getNext()].getDual(), -10, -1, false, false );//edge pointing from the last visible point to the virtual point
         unsigned int edge3 = insertEdge( -10, edge1, mPointVector.count() - 1, false, false );//edge pointing from the virtual point to new point
 
         //adjust the other pointers
-        mHalfEdge[mHalfEdge[mHalfEdge[cwedge]->getNext()]->getDual()]->setDual( edge2 );
-        mHalfEdge[mHalfEdge[cwedge]->getNext()]->setDual( edge1 );
-        mHalfEdge[edge1]->setNext( edge2 );
-        mHalfEdge[edge2]->setNext( edge3 );
+        mHalfEdge[mHalfEdge[mHalfEdge[cwedge].getNext()].getDual()].setDual( edge2 );
+        mHalfEdge[mHalfEdge[cwedge].getNext()].setDual( edge1 );
+        mHalfEdge[edge1].setNext( edge2 );
+        mHalfEdge[edge2].setNext( edge3 );
 
 
 
         //find ccwedge and replace the virtual point with the new point when necessary
-        while ( MathUtils::leftOf( mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[ccwedge]->getNext()]->getNext()]->getPoint()], mPointVector[mPointVector.count()-1], mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[ccwedge]->getNext()]->getNext()]->getDual()]->getNext()]->getPoint()] ) < ( -leftOfTresh ) )
+        while ( MathUtils::leftOf( mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[ccwedge].getNext()].getNext()].getPoint()], mPointVector[mPointVector.count()-1], mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[ccwedge].getNext()].getNext()].getDual()].getNext()].getPoint()] ) < ( -leftOfTresh ) )
         {
           //set the point number of the necessary edge to the actual point instead of the virtual point
-          mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[ccwedge]->getNext()]->getNext()]->getDual()]->setPoint( mPointVector.count() - 1 );
+          mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[ccwedge].getNext()].getNext()].getDual()].setPoint( mPointVector.count() - 1 );
           //advance ccwedge one edge further counterclockwise
-          ccwedge = mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[ccwedge]->getNext()]->getNext()]->getDual()]->getNext()]->getNext();
+          ccwedge = mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[ccwedge].getNext()].getNext()].getDual()].getNext()].getNext();
         }
 
         //build the necessary connections with the virtual point
-        unsigned int edge4 = insertEdge( mHalfEdge[mHalfEdge[ccwedge]->getNext()]->getNext(), -10, mPointVector.count() - 1, false, false );//points from the last visible point counterclockwise to the new point
+        unsigned int edge4 = insertEdge( mHalfEdge[mHalfEdge[ccwedge].getNext()].getNext(), -10, mPointVector.count() - 1, false, false );//points from the last visible point counterclockwise to the new point
         unsigned int edge5 = insertEdge( edge3, -10, -1, false, false );//points from the new point to the virtual point
-        unsigned int edge6 = insertEdge( mHalfEdge[mHalfEdge[mHalfEdge[ccwedge]->getNext()]->getNext()]->getDual(), edge4, mHalfEdge[mHalfEdge[ccwedge]->getDual()]->getPoint(), false, false );//points from the virtual point to the last visible point counterclockwise
+        unsigned int edge6 = insertEdge( mHalfEdge[mHalfEdge[mHalfEdge[ccwedge].getNext()].getNext()].getDual(), edge4, mHalfEdge[mHalfEdge[ccwedge].getDual()].getPoint(), false, false );//points from the virtual point to the last visible point counterclockwise
 
 
 
         //adjust the other pointers
-        mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[ccwedge]->getNext()]->getNext()]->getDual()]->setDual( edge6 );
-        mHalfEdge[mHalfEdge[mHalfEdge[ccwedge]->getNext()]->getNext()]->setDual( edge4 );
-        mHalfEdge[edge4]->setNext( edge5 );
-        mHalfEdge[edge5]->setNext( edge6 );
-        mHalfEdge[edge3]->setDual( edge5 );
+        mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[ccwedge].getNext()].getNext()].getDual()].setDual( edge6 );
+        mHalfEdge[mHalfEdge[mHalfEdge[ccwedge].getNext()].getNext()].setDual( edge4 );
+        mHalfEdge[edge4].setNext( edge5 );
+        mHalfEdge[edge5].setNext( edge6 );
+        mHalfEdge[edge3].setDual( edge5 );
 
         //now test the HalfEdge at the former convex hull for swappint
         unsigned int index = ccwedge;
@@ -298,7 +290,7 @@ int DualEdgeTriangulation::addPoint( Point3D* p )
         while ( true )
         {
           toswap = index;
-          index = mHalfEdge[mHalfEdge[mHalfEdge[index]->getNext()]->getDual()]->getNext();
+          index = mHalfEdge[mHalfEdge[mHalfEdge[index].getNext()].getDual()].getNext();
           checkSwap( toswap, 0 );
           if ( toswap == cwedge )
           {
@@ -312,25 +304,25 @@ int DualEdgeTriangulation::addPoint( Point3D* p )
 
       else if ( number >= 0 )
       {
-        int nextnumber = mHalfEdge[number]->getNext();
-        int nextnextnumber = mHalfEdge[mHalfEdge[number]->getNext()]->getNext();
+        int nextnumber = mHalfEdge[number].getNext();
+        int nextnextnumber = mHalfEdge[mHalfEdge[number].getNext()].getNext();
 
         //insert 6 new HalfEdges for the connections to the vertices of the triangle
-        unsigned int edge1 = insertEdge( -10, nextnumber, mHalfEdge[number]->getPoint(), false, false );
+        unsigned int edge1 = insertEdge( -10, nextnumber, mHalfEdge[number].getPoint(), false, false );
         unsigned int edge2 = insertEdge(( int )edge1, -10, mPointVector.count() - 1, false, false );
-        unsigned int edge3 = insertEdge( -10, nextnextnumber, mHalfEdge[nextnumber]->getPoint(), false, false );
+        unsigned int edge3 = insertEdge( -10, nextnextnumber, mHalfEdge[nextnumber].getPoint(), false, false );
         unsigned int edge4 = insertEdge(( int )edge3, ( int )edge1, mPointVector.count() - 1, false, false );
-        unsigned int edge5 = insertEdge( -10, number, mHalfEdge[nextnextnumber]->getPoint(), false, false );
+        unsigned int edge5 = insertEdge( -10, number, mHalfEdge[nextnextnumber].getPoint(), false, false );
         unsigned int edge6 = insertEdge(( int )edge5, ( int )edge3, mPointVector.count() - 1, false, false );
 
 
-        mHalfEdge.at( edge1 )->setDual(( int )edge2 );
-        mHalfEdge.at( edge2 )->setNext(( int )edge5 );
-        mHalfEdge.at( edge3 )->setDual(( int )edge4 );
-        mHalfEdge.at( edge5 )->setDual(( int )edge6 );
-        mHalfEdge.at( number )->setNext(( int )edge2 );
-        mHalfEdge.at( nextnumber )->setNext(( int )edge4 );
-        mHalfEdge.at( nextnextnumber )->setNext(( int )edge6 );
+        mHalfEdge[ edge1 ].setDual(( int )edge2 );
+        mHalfEdge[ edge2 ].setNext(( int )edge5 );
+        mHalfEdge[ edge3 ].setDual(( int )edge4 );
+        mHalfEdge[ edge5 ].setDual(( int )edge6 );
+        mHalfEdge[ number ].setNext(( int )edge2 );
+        mHalfEdge[ nextnumber ].setNext(( int )edge4 );
+        mHalfEdge[ nextnextnumber ].setNext(( int )edge6 );
 
         //check, if there are swaps necessary
         checkSwap( number, 0 );
@@ -342,30 +334,30 @@ int DualEdgeTriangulation::addPoint( Point3D* p )
       else if ( number == -20 )
       {
         int edgea = mEdgeWithPoint;
-        int edgeb = mHalfEdge[mEdgeWithPoint]->getDual();
-        int edgec = mHalfEdge[edgea]->getNext();
-        int edged = mHalfEdge[edgec]->getNext();
-        int edgee = mHalfEdge[edgeb]->getNext();
-        int edgef = mHalfEdge[edgee]->getNext();
+        int edgeb = mHalfEdge[mEdgeWithPoint].getDual();
+        int edgec = mHalfEdge[edgea].getNext();
+        int edged = mHalfEdge[edgec].getNext();
+        int edgee = mHalfEdge[edgeb].getNext();
+        int edgef = mHalfEdge[edgee].getNext();
 
         //insert the six new edges
-        int nedge1 = insertEdge( -10, mHalfEdge[edgea]->getNext(), mHalfEdge[edgea]->getPoint(), false, false );
+        int nedge1 = insertEdge( -10, mHalfEdge[edgea].getNext(), mHalfEdge[edgea].getPoint(), false, false );
         int nedge2 = insertEdge( nedge1, -10, mPointVector.count() - 1, false, false );
-        int nedge3 = insertEdge( -10, edged, mHalfEdge[edgec]->getPoint(), false, false );
+        int nedge3 = insertEdge( -10, edged, mHalfEdge[edgec].getPoint(), false, false );
         int nedge4 = insertEdge( nedge3, nedge1, mPointVector.count() - 1, false, false );
-        int nedge5 = insertEdge( -10, edgef, mHalfEdge[edgee]->getPoint(), false, false );
+        int nedge5 = insertEdge( -10, edgef, mHalfEdge[edgee].getPoint(), false, false );
         int nedge6 = insertEdge( nedge5, edgeb, mPointVector.count() - 1, false, false );
 
         //adjust the triangular structure
-        mHalfEdge[nedge1]->setDual( nedge2 );
-        mHalfEdge[nedge2]->setNext( nedge5 );
-        mHalfEdge[nedge3]->setDual( nedge4 );
-        mHalfEdge[nedge5]->setDual( nedge6 );
-        mHalfEdge[edgea]->setPoint( mPointVector.count() - 1 );
-        mHalfEdge[edgea]->setNext( nedge3 );
-        mHalfEdge[edgec]->setNext( nedge4 );
-        mHalfEdge[edgee]->setNext( nedge6 );
-        mHalfEdge[edgef]->setNext( nedge2 );
+        mHalfEdge[nedge1].setDual( nedge2 );
+        mHalfEdge[nedge2].setNext( nedge5 );
+        mHalfEdge[nedge3].setDual( nedge4 );
+        mHalfEdge[nedge5].setDual( nedge6 );
+        mHalfEdge[edgea].setPoint( mPointVector.count() - 1 );
+        mHalfEdge[edgea].setNext( nedge3 );
+        mHalfEdge[edgec].setNext( nedge4 );
+        mHalfEdge[edgee].setNext( nedge6 );
+        mHalfEdge[edgef].setNext( nedge2 );
 
         //swap edges if necessary
         checkSwap( edgec, 0 );
@@ -413,7 +405,7 @@ int DualEdgeTriangulation::baseEdgeOfPoint( int point )
     //first find pointingedge(an edge pointing to p1)
     for ( int i = 0; i < mHalfEdge.count(); i++ )
     {
-      if ( mHalfEdge[i]->getPoint() == point )//we found it
+      if ( mHalfEdge[i].getPoint() == point )//we found it
       {
         return i;
       }
@@ -433,21 +425,21 @@ int DualEdgeTriangulation::baseEdgeOfPoint( int point )
       //qWarning( "******************warning, using the slow method in baseEdgeOfPoint****************************************" );
       for ( int i = 0; i < mHalfEdge.count(); i++ )
       {
-        if ( mHalfEdge[i]->getPoint() == point && mHalfEdge[mHalfEdge[i]->getNext()]->getPoint() != -1 )//we found it
+        if ( mHalfEdge[i].getPoint() == point && mHalfEdge[mHalfEdge[i].getNext()].getPoint() != -1 )//we found it
         {
           return i;
         }
       }
     }
 
-    int frompoint = mHalfEdge[mHalfEdge[actedge]->getDual()]->getPoint();
-    int topoint = mHalfEdge[actedge]->getPoint();
+    int frompoint = mHalfEdge[mHalfEdge[actedge].getDual()].getPoint();
+    int topoint = mHalfEdge[actedge].getPoint();
 
     if ( frompoint == -1 || topoint == -1 )//this would cause a crash. Therefore we use the slow method in this case
     {
       for ( int i = 0; i < mHalfEdge.count(); i++ )
       {
-        if ( mHalfEdge[i]->getPoint() == point && mHalfEdge[mHalfEdge[i]->getNext()]->getPoint() != -1 )//we found it
+        if ( mHalfEdge[i].getPoint() == point && mHalfEdge[mHalfEdge[i].getNext()].getPoint() != -1 )//we found it
         {
           mEdgeInside = i;
           return i;
@@ -455,10 +447,10 @@ int DualEdgeTriangulation::baseEdgeOfPoint( int point )
       }
     }
 
-    double leftofnumber = MathUtils::leftOf( mPointVector[point], mPointVector[mHalfEdge[mHalfEdge[actedge]->getDual()]->getPoint()], mPointVector[mHalfEdge[actedge]->getPoint()] );
+    double leftofnumber = MathUtils::leftOf( mPointVector[point], mPointVector[mHalfEdge[mHalfEdge[actedge].getDual()].getPoint()], mPointVector[mHalfEdge[actedge].getPoint()] );
 
 
-    if ( mHalfEdge[actedge]->getPoint() == point && mHalfEdge[mHalfEdge[actedge]->getNext()]->getPoint() != -1 )//we found the edge
+    if ( mHalfEdge[actedge].getPoint() == point && mHalfEdge[mHalfEdge[actedge].getNext()].getPoint() != -1 )//we found the edge
     {
       mEdgeInside = actedge;
       return actedge;
@@ -466,12 +458,12 @@ int DualEdgeTriangulation::baseEdgeOfPoint( int point )
 
     else if ( leftofnumber <= 0.0 )
     {
-      actedge = mHalfEdge[actedge]->getNext();
+      actedge = mHalfEdge[actedge].getNext();
     }
 
     else
     {
-      actedge = mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[actedge]->getDual()]->getNext()]->getNext()]->getDual();
+      actedge = mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[actedge].getDual()].getNext()].getNext()].getDual();
     }
   }
 }
@@ -493,7 +485,7 @@ int DualEdgeTriangulation::baseEdgeOfTriangle( Point3D* point )
       return -100;
     }
 
-    double leftofvalue = MathUtils::leftOf( point, mPointVector[mHalfEdge[mHalfEdge[actedge]->getDual()]->getPoint()], mPointVector[mHalfEdge[actedge]->getPoint()] );
+    double leftofvalue = MathUtils::leftOf( point, mPointVector[mHalfEdge[mHalfEdge[actedge].getDual()].getPoint()], mPointVector[mHalfEdge[actedge].getPoint()] );
 
     if ( leftofvalue < ( -leftOfTresh ) )//point is on the left side
     {
@@ -509,14 +501,14 @@ int DualEdgeTriangulation::baseEdgeOfTriangle( Point3D* point )
       if ( nulls == 0 )
       {
         //store the numbers of the two endpoints of the line
-        firstendp = mHalfEdge[mHalfEdge[actedge]->getDual()]->getPoint();
-        secendp = mHalfEdge[actedge]->getPoint();
+        firstendp = mHalfEdge[mHalfEdge[actedge].getDual()].getPoint();
+        secendp = mHalfEdge[actedge].getPoint();
       }
       else if ( nulls == 1 )
       {
         //store the numbers of the two endpoints of the line
-        thendp = mHalfEdge[mHalfEdge[actedge]->getDual()]->getPoint();
-        fouendp = mHalfEdge[actedge]->getPoint();
+        thendp = mHalfEdge[mHalfEdge[actedge].getDual()].getPoint();
+        fouendp = mHalfEdge[actedge].getPoint();
       }
       counter += 1;
       mEdgeWithPoint = actedge;
@@ -539,21 +531,21 @@ int DualEdgeTriangulation::baseEdgeOfTriangle( Point3D* point )
 
     else//point is on the right side
     {
-      actedge = mHalfEdge[actedge]->getDual();
+      actedge = mHalfEdge[actedge].getDual();
       counter = 1;
       nulls = 0;
       numinstabs = 0;
     }
 
-    actedge = mHalfEdge[actedge]->getNext();
-    if ( mHalfEdge[actedge]->getPoint() == -1 )//the half edge points to the virtual point
+    actedge = mHalfEdge[actedge].getNext();
+    if ( mHalfEdge[actedge].getPoint() == -1 )//the half edge points to the virtual point
     {
       if ( nulls == 1 )//point is exactly on the convex hull
       {
         return -20;
       }
-      mEdgeOutside = ( unsigned int )mHalfEdge[mHalfEdge[actedge]->getNext()]->getNext();
-      mEdgeInside = mHalfEdge[mHalfEdge[mEdgeOutside]->getDual()]->getNext();
+      mEdgeOutside = ( unsigned int )mHalfEdge[mHalfEdge[actedge].getNext()].getNext();
+      mEdgeInside = mHalfEdge[mHalfEdge[mEdgeOutside].getDual()].getNext();
       return -10;//the point is outside the convex hull
     }
     runs++;
@@ -593,9 +585,9 @@ int DualEdgeTriangulation::baseEdgeOfTriangle( Point3D* point )
   mEdgeInside = actedge;
 
   int nr1, nr2, nr3;
-  nr1 = mHalfEdge[actedge]->getPoint();
-  nr2 = mHalfEdge[mHalfEdge[actedge]->getNext()]->getPoint();
-  nr3 = mHalfEdge[mHalfEdge[mHalfEdge[actedge]->getNext()]->getNext()]->getPoint();
+  nr1 = mHalfEdge[actedge].getPoint();
+  nr2 = mHalfEdge[mHalfEdge[actedge].getNext()].getPoint();
+  nr3 = mHalfEdge[mHalfEdge[mHalfEdge[actedge].getNext()].getNext()].getPoint();
   double x1 = mPointVector[nr1]->getX();
   double y1 = mPointVector[nr1]->getY();
   double x2 = mPointVector[nr2]->getX();
@@ -610,11 +602,11 @@ int DualEdgeTriangulation::baseEdgeOfTriangle( Point3D* point )
   }
   else if ( x2 < x1 && x2 < x3 )
   {
-    return mHalfEdge[actedge]->getNext();
+    return mHalfEdge[actedge].getNext();
   }
   else if ( x3 < x1 && x3 < x2 )
   {
-    return mHalfEdge[mHalfEdge[actedge]->getNext()]->getNext();
+    return mHalfEdge[mHalfEdge[actedge].getNext()].getNext();
   }
   //in case two x-coordinates are the same, the edge pointing to the point with the lower y-coordinate is returned
   else if ( x1 == x2 )
@@ -625,18 +617,18 @@ int DualEdgeTriangulation::baseEdgeOfTriangle( Point3D* point )
     }
     else if ( y2 < y1 )
     {
-      return mHalfEdge[actedge]->getNext();
+      return mHalfEdge[actedge].getNext();
     }
   }
   else if ( x2 == x3 )
   {
     if ( y2 < y3 )
     {
-      return mHalfEdge[actedge]->getNext();
+      return mHalfEdge[actedge].getNext();
     }
     else if ( y3 < y2 )
     {
-      return mHalfEdge[mHalfEdge[actedge]->getNext()]->getNext();
+      return mHalfEdge[mHalfEdge[actedge].getNext()].getNext();
     }
   }
   else if ( x1 == x3 )
@@ -647,7 +639,7 @@ int DualEdgeTriangulation::baseEdgeOfTriangle( Point3D* point )
     }
     else if ( y3 < y1 )
     {
-      return mHalfEdge[mHalfEdge[actedge]->getNext()]->getNext();
+      return mHalfEdge[mHalfEdge[actedge].getNext()].getNext();
     }
   }
   return -100;//this means a bug happened
@@ -687,10 +679,10 @@ bool DualEdgeTriangulation::checkSwap( unsigned int edge, unsigned int recursive
 {
   if ( swapPossible( edge ) )
   {
-    Point3D* pta = mPointVector[mHalfEdge[edge]->getPoint()];
-    Point3D* ptb = mPointVector[mHalfEdge[mHalfEdge[edge]->getNext()]->getPoint()];
-    Point3D* ptc = mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[edge]->getNext()]->getNext()]->getPoint()];
-    Point3D* ptd = mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[edge]->getDual()]->getNext()]->getPoint()];
+    Point3D* pta = mPointVector[mHalfEdge[edge].getPoint()];
+    Point3D* ptb = mPointVector[mHalfEdge[mHalfEdge[edge].getNext()].getPoint()];
+    Point3D* ptc = mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[edge].getNext()].getNext()].getPoint()];
+    Point3D* ptd = mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[edge].getDual()].getNext()].getPoint()];
     if ( MathUtils::inCircle( ptd, pta, ptb, ptc ) && recursiveDeep < 100 )//empty circle criterion violated
     {
       doSwap( edge, recursiveDeep );//swap the edge (recursive)
@@ -703,37 +695,37 @@ bool DualEdgeTriangulation::checkSwap( unsigned int edge, unsigned int recursive
 void DualEdgeTriangulation::doOnlySwap( unsigned int edge )
 {
   unsigned int edge1 = edge;
-  unsigned int edge2 = mHalfEdge[edge]->getDual();
-  unsigned int edge3 = mHalfEdge[edge]->getNext();
-  unsigned int edge4 = mHalfEdge[mHalfEdge[edge]->getNext()]->getNext();
-  unsigned int edge5 = mHalfEdge[mHalfEdge[edge]->getDual()]->getNext();
-  unsigned int edge6 = mHalfEdge[mHalfEdge[mHalfEdge[edge]->getDual()]->getNext()]->getNext();
-  mHalfEdge[edge1]->setNext( edge4 );//set the necessary nexts
-  mHalfEdge[edge2]->setNext( edge6 );
-  mHalfEdge[edge3]->setNext( edge2 );
-  mHalfEdge[edge4]->setNext( edge5 );
-  mHalfEdge[edge5]->setNext( edge1 );
-  mHalfEdge[edge6]->setNext( edge3 );
-  mHalfEdge[edge1]->setPoint( mHalfEdge[edge3]->getPoint() );//change the points to which edge1 and edge2 point
-  mHalfEdge[edge2]->setPoint( mHalfEdge[edge5]->getPoint() );
+  unsigned int edge2 = mHalfEdge[edge].getDual();
+  unsigned int edge3 = mHalfEdge[edge].getNext();
+  unsigned int edge4 = mHalfEdge[mHalfEdge[edge].getNext()].getNext();
+  unsigned int edge5 = mHalfEdge[mHalfEdge[edge].getDual()].getNext();
+  unsigned int edge6 = mHalfEdge[mHalfEdge[mHalfEdge[edge].getDual()].getNext()].getNext();
+  mHalfEdge[edge1].setNext( edge4 );//set the necessary nexts
+  mHalfEdge[edge2].setNext( edge6 );
+  mHalfEdge[edge3].setNext( edge2 );
+  mHalfEdge[edge4].setNext( edge5 );
+  mHalfEdge[edge5].setNext( edge1 );
+  mHalfEdge[edge6].setNext( edge3 );
+  mHalfEdge[edge1].setPoint( mHalfEdge[edge3].getPoint() );//change the points to which edge1 and edge2 point
+  mHalfEdge[edge2].setPoint( mHalfEdge[edge5].getPoint() );
 }
 
 void DualEdgeTriangulation::doSwap( unsigned int edge, unsigned int recursiveDeep )
 {
   unsigned int edge1 = edge;
-  unsigned int edge2 = mHalfEdge[edge]->getDual();
-  unsigned int edge3 = mHalfEdge[edge]->getNext();
-  unsigned int edge4 = mHalfEdge[mHalfEdge[edge]->getNext()]->getNext();
-  unsigned int edge5 = mHalfEdge[mHalfEdge[edge]->getDual()]->getNext();
-  unsigned int edge6 = mHalfEdge[mHalfEdge[mHalfEdge[edge]->getDual()]->getNext()]->getNext();
-  mHalfEdge[edge1]->setNext( edge4 );//set the necessary nexts
-  mHalfEdge[edge2]->setNext( edge6 );
-  mHalfEdge[edge3]->setNext( edge2 );
-  mHalfEdge[edge4]->setNext( edge5 );
-  mHalfEdge[edge5]->setNext( edge1 );
-  mHalfEdge[edge6]->setNext( edge3 );
-  mHalfEdge[edge1]->setPoint( mHalfEdge[edge3]->getPoint() );//change the points to which edge1 and edge2 point
-  mHalfEdge[edge2]->setPoint( mHalfEdge[edge5]->getPoint() );
+  unsigned int edge2 = mHalfEdge[edge].getDual();
+  unsigned int edge3 = mHalfEdge[edge].getNext();
+  unsigned int edge4 = mHalfEdge[mHalfEdge[edge].getNext()].getNext();
+  unsigned int edge5 = mHalfEdge[mHalfEdge[edge].getDual()].getNext();
+  unsigned int edge6 = mHalfEdge[mHalfEdge[mHalfEdge[edge].getDual()].getNext()].getNext();
+  mHalfEdge[edge1].setNext( edge4 );//set the necessary nexts
+  mHalfEdge[edge2].setNext( edge6 );
+  mHalfEdge[edge3].setNext( edge2 );
+  mHalfEdge[edge4].setNext( edge5 );
+  mHalfEdge[edge5].setNext( edge1 );
+  mHalfEdge[edge6].setNext( edge3 );
+  mHalfEdge[edge1].setPoint( mHalfEdge[edge3].getPoint() );//change the points to which edge1 and edge2 point
+  mHalfEdge[edge2].setPoint( mHalfEdge[edge5].getPoint() );
   recursiveDeep++;
   checkSwap( edge3, recursiveDeep );
   checkSwap( edge6, recursiveDeep );
@@ -766,24 +758,24 @@ void DualEdgeTriangulation::draw( QPainter* p, double xlowleft, double ylowleft,
     double lowerborder = -( height * ( xupright - xlowleft ) / width - yupright );//real world coordinates of the lower widget border. This is useful to know because of the HalfEdge bounding box test
     for ( unsigned int i = 0; i < mHalfEdge.count() - 1; i++ )
     {
-      if ( mHalfEdge[i]->getPoint() == -1 || mHalfEdge[mHalfEdge[i]->getDual()]->getPoint() == -1 )
+      if ( mHalfEdge[i].getPoint() == -1 || mHalfEdge[mHalfEdge[i].getDual()].getPoint() == -1 )
         {continue;}
 
       //check, if the edge belongs to a flat triangle, remove this later
       if ( !control2[i] )
       {
         double p1, p2, p3;
-        if ( mHalfEdge[i]->getPoint() != -1 && mHalfEdge[mHalfEdge[i]->getNext()]->getPoint() != -1 && mHalfEdge[mHalfEdge[mHalfEdge[i]->getNext()]->getNext()]->getPoint() != -1 )
+        if ( mHalfEdge[i].getPoint() != -1 && mHalfEdge[mHalfEdge[i].getNext()].getPoint() != -1 && mHalfEdge[mHalfEdge[mHalfEdge[i].getNext()].getNext()].getPoint() != -1 )
         {
-          p1 = mPointVector[mHalfEdge[i]->getPoint()]->getZ();
-          p2 = mPointVector[mHalfEdge[mHalfEdge[i]->getNext()]->getPoint()]->getZ();
-          p3 = mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[i]->getNext()]->getNext()]->getPoint()]->getZ();
-          if ( p1 == p2 && p2 == p3 && halfEdgeBBoxTest( i, xlowleft, lowerborder, xupright, yupright ) && halfEdgeBBoxTest( mHalfEdge[i]->getNext(), xlowleft, lowerborder, xupright, yupright ) && halfEdgeBBoxTest( mHalfEdge[mHalfEdge[i]->getNext()]->getNext(), xlowleft, lowerborder, xupright, yupright ) )//draw the triangle
+          p1 = mPointVector[mHalfEdge[i].getPoint()]->getZ();
+          p2 = mPointVector[mHalfEdge[mHalfEdge[i].getNext()].getPoint()]->getZ();
+          p3 = mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[i].getNext()].getNext()].getPoint()]->getZ();
+          if ( p1 == p2 && p2 == p3 && halfEdgeBBoxTest( i, xlowleft, lowerborder, xupright, yupright ) && halfEdgeBBoxTest( mHalfEdge[i].getNext(), xlowleft, lowerborder, xupright, yupright ) && halfEdgeBBoxTest( mHalfEdge[mHalfEdge[i].getNext()].getNext(), xlowleft, lowerborder, xupright, yupright ) )//draw the triangle
           {
             QPointArray pa( 3 );
-            pa.setPoint( 0, ( mPointVector[mHalfEdge[i]->getPoint()]->getX() - xlowleft ) / ( xupright - xlowleft )*width, ( yupright - mPointVector[mHalfEdge[i]->getPoint()]->getY() ) / ( xupright - xlowleft )*width );
-            pa.setPoint( 1, ( mPointVector[mHalfEdge[mHalfEdge[i]->getNext()]->getPoint()]->getX() - xlowleft ) / ( xupright - xlowleft )*width, ( yupright - mPointVector[mHalfEdge[mHalfEdge[i]->getNext()]->getPoint()]->getY() ) / ( xupright - xlowleft )*width );
-            pa.setPoint( 2, ( mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[i]->getNext()]->getNext()]->getPoint()]->getX() - xlowleft ) / ( xupright - xlowleft )*width, ( yupright - mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[i]->getNext()]->getNext()]->getPoint()]->getY() ) / ( xupright - xlowleft )*width );
+            pa.setPoint( 0, ( mPointVector[mHalfEdge[i].getPoint()]->getX() - xlowleft ) / ( xupright - xlowleft )*width, ( yupright - mPointVector[mHalfEdge[i].getPoint()]->getY() ) / ( xupright - xlowleft )*width );
+            pa.setPoint( 1, ( mPointVector[mHalfEdge[mHalfEdge[i].getNext()].getPoint()]->getX() - xlowleft ) / ( xupright - xlowleft )*width, ( yupright - mPointVector[mHalfEdge[mHalfEdge[i].getNext()].getPoint()]->getY() ) / ( xupright - xlowleft )*width );
+            pa.setPoint( 2, ( mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[i].getNext()].getNext()].getPoint()]->getX() - xlowleft ) / ( xupright - xlowleft )*width, ( yupright - mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[i].getNext()].getNext()].getPoint()]->getY() ) / ( xupright - xlowleft )*width );
             QColor c( 255, 0, 0 );
             p->setBrush( c );
             p->drawPolygon( pa );
@@ -791,8 +783,8 @@ void DualEdgeTriangulation::draw( QPainter* p, double xlowleft, double ylowleft,
         }
 
         control2[i] = true;
-        control2[mHalfEdge[i]->getNext()] = true;
-        control2[mHalfEdge[mHalfEdge[i]->getNext()]->getNext()] = true;
+        control2[mHalfEdge[i].getNext()] = true;
+        control2[mHalfEdge[mHalfEdge[i].getNext()].getNext()] = true;
       }//end of the section, which has to be removed later
 
       if ( control[i] )//check, if edge has already been drawn
@@ -801,19 +793,19 @@ void DualEdgeTriangulation::draw( QPainter* p, double xlowleft, double ylowleft,
       //draw the edge;
       if ( halfEdgeBBoxTest( i, xlowleft, lowerborder, xupright, yupright ) )//only draw the halfedge if its bounding box intersects the painted area
       {
-        if ( mHalfEdge[i]->getBreak() )//change the color it the edge is a breakline
+        if ( mHalfEdge[i].getBreak() )//change the color it the edge is a breakline
         {
           p->setPen( mBreakEdgeColor );
         }
-        else if ( mHalfEdge[i]->getForced() )//change the color if the edge is forced
+        else if ( mHalfEdge[i].getForced() )//change the color if the edge is forced
         {
           p->setPen( mForcedEdgeColor );
         }
 
 
-        p->drawLine(( mPointVector[mHalfEdge[i]->getPoint()]->getX() - xlowleft ) / ( xupright - xlowleft )*width, ( yupright - mPointVector[mHalfEdge[i]->getPoint()]->getY() ) / ( xupright - xlowleft )*width, ( mPointVector[mHalfEdge[mHalfEdge[i]->getDual()]->getPoint()]->getX() - xlowleft ) / ( xupright - xlowleft )*width, ( yupright - mPointVector[mHalfEdge[mHalfEdge[i]->getDual()]->getPoint()]->getY() ) / ( xupright - xlowleft )*width );
+        p->drawLine(( mPointVector[mHalfEdge[i].getPoint()]->getX() - xlowleft ) / ( xupright - xlowleft )*width, ( yupright - mPointVector[mHalfEdge[i].getPoint()]->getY() ) / ( xupright - xlowleft )*width, ( mPointVector[mHalfEdge[mHalfEdge[i].getDual()].getPoint()]->getX() - xlowleft ) / ( xupright - xlowleft )*width, ( yupright - mPointVector[mHalfEdge[mHalfEdge[i].getDual()].getPoint()]->getY() ) / ( xupright - xlowleft )*width );
 
-        if ( mHalfEdge[i]->getForced() )
+        if ( mHalfEdge[i].getForced() )
         {
           p->setPen( mEdgeColor );
         }
@@ -821,7 +813,7 @@ void DualEdgeTriangulation::draw( QPainter* p, double xlowleft, double ylowleft,
 
       }
       control[i] = true;
-      control[mHalfEdge[i]->getDual()] = true;
+      control[mHalfEdge[i].getDual()] = true;
     }
   }
   else
@@ -829,24 +821,24 @@ void DualEdgeTriangulation::draw( QPainter* p, double xlowleft, double ylowleft,
     double rightborder = width * ( yupright - ylowleft ) / height + xlowleft;//real world coordinates of the right widget border. This is useful to know because of the HalfEdge bounding box test
     for ( unsigned int i = 0; i < mHalfEdge.count() - 1; i++ )
     {
-      if ( mHalfEdge[i]->getPoint() == -1 || mHalfEdge[mHalfEdge[i]->getDual()]->getPoint() == -1 )
+      if ( mHalfEdge[i].getPoint() == -1 || mHalfEdge[mHalfEdge[i].getDual()].getPoint() == -1 )
         {continue;}
 
       //check, if the edge belongs to a flat triangle, remove this section later
       if ( !control2[i] )
       {
         double p1, p2, p3;
-        if ( mHalfEdge[i]->getPoint() != -1 && mHalfEdge[mHalfEdge[i]->getNext()]->getPoint() != -1 && mHalfEdge[mHalfEdge[mHalfEdge[i]->getNext()]->getNext()]->getPoint() != -1 )
+        if ( mHalfEdge[i].getPoint() != -1 && mHalfEdge[mHalfEdge[i].getNext()].getPoint() != -1 && mHalfEdge[mHalfEdge[mHalfEdge[i].getNext()].getNext()].getPoint() != -1 )
         {
-          p1 = mPointVector[mHalfEdge[i]->getPoint()]->getZ();
-          p2 = mPointVector[mHalfEdge[mHalfEdge[i]->getNext()]->getPoint()]->getZ();
-          p3 = mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[i]->getNext()]->getNext()]->getPoint()]->getZ();
-          if ( p1 == p2 && p2 == p3 && halfEdgeBBoxTest( i, xlowleft, ylowleft, rightborder, yupright ) && halfEdgeBBoxTest( mHalfEdge[i]->getNext(), xlowleft, ylowleft, rightborder, yupright ) && halfEdgeBBoxTest( mHalfEdge[mHalfEdge[i]->getNext()]->getNext(), xlowleft, ylowleft, rightborder, yupright ) )//draw the triangle
+          p1 = mPointVector[mHalfEdge[i].getPoint()]->getZ();
+          p2 = mPointVector[mHalfEdge[mHalfEdge[i].getNext()].getPoint()]->getZ();
+          p3 = mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[i].getNext()].getNext()].getPoint()]->getZ();
+          if ( p1 == p2 && p2 == p3 && halfEdgeBBoxTest( i, xlowleft, ylowleft, rightborder, yupright ) && halfEdgeBBoxTest( mHalfEdge[i].getNext(), xlowleft, ylowleft, rightborder, yupright ) && halfEdgeBBoxTest( mHalfEdge[mHalfEdge[i].getNext()].getNext(), xlowleft, ylowleft, rightborder, yupright ) )//draw the triangle
           {
             QPointArray pa( 3 );
-            pa.setPoint( 0, ( mPointVector[mHalfEdge[i]->getPoint()]->getX() - xlowleft ) / ( yupright - ylowleft )*height, ( yupright - mPointVector[mHalfEdge[i]->getPoint()]->getY() ) / ( yupright - ylowleft )*height );
-            pa.setPoint( 1, ( mPointVector[mHalfEdge[mHalfEdge[i]->getNext()]->getPoint()]->getX() - xlowleft ) / ( yupright - ylowleft )*height, ( yupright - mPointVector[mHalfEdge[mHalfEdge[i]->getNext()]->getPoint()]->getY() ) / ( yupright - ylowleft )*height );
-            pa.setPoint( 2, ( mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[i]->getNext()]->getNext()]->getPoint()]->getX() - xlowleft ) / ( yupright - ylowleft )*height, ( yupright - mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[i]->getNext()]->getNext()]->getPoint()]->getY() ) / ( yupright - ylowleft )*height );
+            pa.setPoint( 0, ( mPointVector[mHalfEdge[i].getPoint()]->getX() - xlowleft ) / ( yupright - ylowleft )*height, ( yupright - mPointVector[mHalfEdge[i].getPoint()]->getY() ) / ( yupright - ylowleft )*height );
+            pa.setPoint( 1, ( mPointVector[mHalfEdge[mHalfEdge[i].getNext()].getPoint()]->getX() - xlowleft ) / ( yupright - ylowleft )*height, ( yupright - mPointVector[mHalfEdge[mHalfEdge[i].getNext()].getPoint()]->getY() ) / ( yupright - ylowleft )*height );
+            pa.setPoint( 2, ( mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[i].getNext()].getNext()].getPoint()]->getX() - xlowleft ) / ( yupright - ylowleft )*height, ( yupright - mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[i].getNext()].getNext()].getPoint()]->getY() ) / ( yupright - ylowleft )*height );
             QColor c( 255, 0, 0 );
             p->setBrush( c );
             p->drawPolygon( pa );
@@ -854,8 +846,8 @@ void DualEdgeTriangulation::draw( QPainter* p, double xlowleft, double ylowleft,
         }
 
         control2[i] = true;
-        control2[mHalfEdge[i]->getNext()] = true;
-        control2[mHalfEdge[mHalfEdge[i]->getNext()]->getNext()] = true;
+        control2[mHalfEdge[i].getNext()] = true;
+        control2[mHalfEdge[mHalfEdge[i].getNext()].getNext()] = true;
       }//end of the section, which has to be removed later
 
 
@@ -865,25 +857,25 @@ void DualEdgeTriangulation::draw( QPainter* p, double xlowleft, double ylowleft,
       //draw the edge
       if ( halfEdgeBBoxTest( i, xlowleft, ylowleft, rightborder, yupright ) )//only draw the edge if its bounding box intersects with the painted area
       {
-        if ( mHalfEdge[i]->getBreak() )//change the color if the edge is a breakline
+        if ( mHalfEdge[i].getBreak() )//change the color if the edge is a breakline
         {
           p->setPen( mBreakEdgeColor );
         }
-        else if ( mHalfEdge[i]->getForced() )//change the color if the edge is forced
+        else if ( mHalfEdge[i].getForced() )//change the color if the edge is forced
         {
           p->setPen( mForcedEdgeColor );
         }
 
-        p->drawLine(( mPointVector[mHalfEdge[i]->getPoint()]->getX() - xlowleft ) / ( yupright - ylowleft )*height, ( yupright - mPointVector[mHalfEdge[i]->getPoint()]->getY() ) / ( yupright - ylowleft )*height, ( mPointVector[mHalfEdge[mHalfEdge[i]->getDual()]->getPoint()]->getX() - xlowleft ) / ( yupright - ylowleft )*height, ( yupright - mPointVector[mHalfEdge[mHalfEdge[i]->getDual()]->getPoint()]->getY() ) / ( yupright - ylowleft )*height );
+        p->drawLine(( mPointVector[mHalfEdge[i].getPoint()]->getX() - xlowleft ) / ( yupright - ylowleft )*height, ( yupright - mPointVector[mHalfEdge[i].getPoint()]->getY() ) / ( yupright - ylowleft )*height, ( mPointVector[mHalfEdge[mHalfEdge[i].getDual()].getPoint()]->getX() - xlowleft ) / ( yupright - ylowleft )*height, ( yupright - mPointVector[mHalfEdge[mHalfEdge[i].getDual()].getPoint()]->getY() ) / ( yupright - ylowleft )*height );
 
-        if ( mHalfEdge[i]->getForced() )
+        if ( mHalfEdge[i].getForced() )
         {
           p->setPen( mEdgeColor );
         }
 
       }
       control[i] = true;
-      control[mHalfEdge[i]->getDual()] = true;
+      control[mHalfEdge[i].getDual()] = true;
     }
   }
 
@@ -904,14 +896,14 @@ int DualEdgeTriangulation::getOppositePoint( int p1, int p2 )
   int edge, nextedge;
   do
   {
-    edge = mHalfEdge[nextnextedge]->getDual();
-    if ( mHalfEdge[edge]->getPoint() == p1 )
+    edge = mHalfEdge[nextnextedge].getDual();
+    if ( mHalfEdge[edge].getPoint() == p1 )
     {
       theedge = nextnextedge;
       break;
     }//we found the edge
-    nextedge = mHalfEdge[edge]->getNext();
-    nextnextedge = mHalfEdge[nextedge]->getNext();
+    nextedge = mHalfEdge[edge].getNext();
+    nextnextedge = mHalfEdge[nextedge].getNext();
   }
   while ( nextnextedge != firstedge );
 
@@ -922,7 +914,7 @@ int DualEdgeTriangulation::getOppositePoint( int p1, int p2 )
   }
 
   //finally find the opposite point
-  return mHalfEdge[mHalfEdge[mHalfEdge[theedge]->getDual()]->getNext()]->getPoint();
+  return mHalfEdge[mHalfEdge[mHalfEdge[theedge].getDual()].getNext()].getPoint();
 
 }
 
@@ -941,13 +933,13 @@ QList<int>* DualEdgeTriangulation::getSurroundingTriangles( int pointno )
   int edge, nextedge, nextnextedge;
   do
   {
-    edge = mHalfEdge[actedge]->getDual();
-    vlist->append( mHalfEdge[edge]->getPoint() );//add the number of the endpoint of the first edge to the value list
-    nextedge = mHalfEdge[edge]->getNext();
-    vlist->append( mHalfEdge[nextedge]->getPoint() );//add the number of the endpoint of the second edge to the value list
-    nextnextedge = mHalfEdge[nextedge]->getNext();
-    vlist->append( mHalfEdge[nextnextedge]->getPoint() );//add the number of endpoint of the third edge to the value list
-    if ( mHalfEdge[nextnextedge]->getBreak() )//add, whether the third edge is a breakline or not
+    edge = mHalfEdge[actedge].getDual();
+    vlist->append( mHalfEdge[edge].getPoint() );//add the number of the endpoint of the first edge to the value list
+    nextedge = mHalfEdge[edge].getNext();
+    vlist->append( mHalfEdge[nextedge].getPoint() );//add the number of the endpoint of the second edge to the value list
+    nextnextedge = mHalfEdge[nextedge].getNext();
+    vlist->append( mHalfEdge[nextnextedge].getPoint() );//add the number of endpoint of the third edge to the value list
+    if ( mHalfEdge[nextnextedge].getBreak() )//add, whether the third edge is a breakline or not
     {
       vlist->append( -10 );
     }
@@ -982,9 +974,9 @@ bool DualEdgeTriangulation::getTriangle( double x, double y, Point3D* p1, int* n
 
     else if ( edge >= 0 )//the point is inside the convex hull
     {
-      int ptnr1 = mHalfEdge[edge]->getPoint();
-      int ptnr2 = mHalfEdge[mHalfEdge[edge]->getNext()]->getPoint();
-      int ptnr3 = mHalfEdge[mHalfEdge[mHalfEdge[edge]->getNext()]->getNext()]->getPoint();
+      int ptnr1 = mHalfEdge[edge].getPoint();
+      int ptnr2 = mHalfEdge[mHalfEdge[edge].getNext()].getPoint();
+      int ptnr3 = mHalfEdge[mHalfEdge[mHalfEdge[edge].getNext()].getNext()].getPoint();
       p1->setX( mPointVector[ptnr1]->getX() );
       p1->setY( mPointVector[ptnr1]->getY() );
       p1->setZ( mPointVector[ptnr1]->getZ() );
@@ -1001,9 +993,9 @@ bool DualEdgeTriangulation::getTriangle( double x, double y, Point3D* p1, int* n
     }
     else if ( edge == -20 )//the point is exactly on an edge
     {
-      int ptnr1 = mHalfEdge[mEdgeWithPoint]->getPoint();
-      int ptnr2 = mHalfEdge[mHalfEdge[mEdgeWithPoint]->getNext()]->getPoint();
-      int ptnr3 = mHalfEdge[mHalfEdge[mHalfEdge[mEdgeWithPoint]->getNext()]->getNext()]->getPoint();
+      int ptnr1 = mHalfEdge[mEdgeWithPoint].getPoint();
+      int ptnr2 = mHalfEdge[mHalfEdge[mEdgeWithPoint].getNext()].getPoint();
+      int ptnr3 = mHalfEdge[mHalfEdge[mHalfEdge[mEdgeWithPoint].getNext()].getNext()].getPoint();
       if ( ptnr1 == -1 || ptnr2 == -1 || ptnr3 == -1 )
       {
         return false;
@@ -1025,11 +1017,11 @@ bool DualEdgeTriangulation::getTriangle( double x, double y, Point3D* p1, int* n
     else if ( edge == -25 )//x and y are the coordinates of an existing point
     {
       int edge1 = baseEdgeOfPoint( mTwiceInsPoint );
-      int edge2 = mHalfEdge[edge1]->getNext();
-      int edge3 = mHalfEdge[edge2]->getNext();
-      int ptnr1 = mHalfEdge[edge1]->getPoint();
-      int ptnr2 = mHalfEdge[edge2]->getPoint();
-      int ptnr3 = mHalfEdge[edge3]->getPoint();
+      int edge2 = mHalfEdge[edge1].getNext();
+      int edge3 = mHalfEdge[edge2].getNext();
+      int ptnr1 = mHalfEdge[edge1].getPoint();
+      int ptnr2 = mHalfEdge[edge2].getPoint();
+      int ptnr3 = mHalfEdge[edge3].getPoint();
       p1->setX( mPointVector[ptnr1]->getX() );
       p1->setY( mPointVector[ptnr1]->getY() );
       p1->setZ( mPointVector[ptnr1]->getZ() );
@@ -1046,9 +1038,9 @@ bool DualEdgeTriangulation::getTriangle( double x, double y, Point3D* p1, int* n
     }
     else if ( edge == -5 )//numerical problems in 'baseEdgeOfTriangle'
     {
-      int ptnr1 = mHalfEdge[mUnstableEdge]->getPoint();
-      int ptnr2 = mHalfEdge[mHalfEdge[mUnstableEdge]->getNext()]->getPoint();
-      int ptnr3 = mHalfEdge[mHalfEdge[mHalfEdge[mUnstableEdge]->getNext()]->getNext()]->getPoint();
+      int ptnr1 = mHalfEdge[mUnstableEdge].getPoint();
+      int ptnr2 = mHalfEdge[mHalfEdge[mUnstableEdge].getNext()].getPoint();
+      int ptnr3 = mHalfEdge[mHalfEdge[mHalfEdge[mUnstableEdge].getNext()].getNext()].getPoint();
       if ( ptnr1 == -1 || ptnr2 == -1 || ptnr3 == -1 )
       {
         return false;
@@ -1099,9 +1091,9 @@ bool DualEdgeTriangulation::getTriangle( double x, double y, Point3D* p1, Point3
     }
     else if ( edge >= 0 )//the point is inside the convex hull
     {
-      int ptnr1 = mHalfEdge[edge]->getPoint();
-      int ptnr2 = mHalfEdge[mHalfEdge[edge]->getNext()]->getPoint();
-      int ptnr3 = mHalfEdge[mHalfEdge[mHalfEdge[edge]->getNext()]->getNext()]->getPoint();
+      int ptnr1 = mHalfEdge[edge].getPoint();
+      int ptnr2 = mHalfEdge[mHalfEdge[edge].getNext()].getPoint();
+      int ptnr3 = mHalfEdge[mHalfEdge[mHalfEdge[edge].getNext()].getNext()].getPoint();
       p1->setX( mPointVector[ptnr1]->getX() );
       p1->setY( mPointVector[ptnr1]->getY() );
       p1->setZ( mPointVector[ptnr1]->getZ() );
@@ -1115,9 +1107,9 @@ bool DualEdgeTriangulation::getTriangle( double x, double y, Point3D* p1, Point3
     }
     else if ( edge == -20 )//the point is exactly on an edge
     {
-      int ptnr1 = mHalfEdge[mEdgeWithPoint]->getPoint();
-      int ptnr2 = mHalfEdge[mHalfEdge[mEdgeWithPoint]->getNext()]->getPoint();
-      int ptnr3 = mHalfEdge[mHalfEdge[mHalfEdge[mEdgeWithPoint]->getNext()]->getNext()]->getPoint();
+      int ptnr1 = mHalfEdge[mEdgeWithPoint].getPoint();
+      int ptnr2 = mHalfEdge[mHalfEdge[mEdgeWithPoint].getNext()].getPoint();
+      int ptnr3 = mHalfEdge[mHalfEdge[mHalfEdge[mEdgeWithPoint].getNext()].getNext()].getPoint();
       if ( ptnr1 == -1 || ptnr2 == -1 || ptnr3 == -1 )
       {
         return false;
@@ -1136,11 +1128,11 @@ bool DualEdgeTriangulation::getTriangle( double x, double y, Point3D* p1, Point3
     else if ( edge == -25 )//x and y are the coordinates of an existing point
     {
       int edge1 = baseEdgeOfPoint( mTwiceInsPoint );
-      int edge2 = mHalfEdge[edge1]->getNext();
-      int edge3 = mHalfEdge[edge2]->getNext();
-      int ptnr1 = mHalfEdge[edge1]->getPoint();
-      int ptnr2 = mHalfEdge[edge2]->getPoint();
-      int ptnr3 = mHalfEdge[edge3]->getPoint();
+      int edge2 = mHalfEdge[edge1].getNext();
+      int edge3 = mHalfEdge[edge2].getNext();
+      int ptnr1 = mHalfEdge[edge1].getPoint();
+      int ptnr2 = mHalfEdge[edge2].getPoint();
+      int ptnr3 = mHalfEdge[edge3].getPoint();
       if ( ptnr1 == -1 || ptnr2 == -1 || ptnr3 == -1 )
       {
         return false;
@@ -1158,9 +1150,9 @@ bool DualEdgeTriangulation::getTriangle( double x, double y, Point3D* p1, Point3
     }
     else if ( edge == -5 )//numerical problems in 'baseEdgeOfTriangle'
     {
-      int ptnr1 = mHalfEdge[mUnstableEdge]->getPoint();
-      int ptnr2 = mHalfEdge[mHalfEdge[mUnstableEdge]->getNext()]->getPoint();
-      int ptnr3 = mHalfEdge[mHalfEdge[mHalfEdge[mUnstableEdge]->getNext()]->getNext()]->getPoint();
+      int ptnr1 = mHalfEdge[mUnstableEdge].getPoint();
+      int ptnr2 = mHalfEdge[mHalfEdge[mUnstableEdge].getNext()].getPoint();
+      int ptnr3 = mHalfEdge[mHalfEdge[mHalfEdge[mUnstableEdge].getNext()].getNext()].getPoint();
       if ( ptnr1 == -1 || ptnr2 == -1 || ptnr3 == -1 )
       {
         return false;
@@ -1192,8 +1184,7 @@ bool DualEdgeTriangulation::getTriangle( double x, double y, Point3D* p1, Point3
 
 unsigned int DualEdgeTriangulation::insertEdge( int dual, int next, int point, bool mbreak, bool forced )
 {
-  HalfEdge* edge = new HalfEdge( dual, next, point, mbreak, forced );
-  mHalfEdge.append( edge );
+  mHalfEdge.append( HalfEdge( dual, next, point, mbreak, forced ) );
   return mHalfEdge.count() - 1;
 
 }
@@ -1219,7 +1210,7 @@ int DualEdgeTriangulation::insertForcedSegment( int p1, int p2, bool breakline )
   }
 
   //go around p1 and find out, if the segment already exists and if not, which is the first cutted edge
-  int actedge = mHalfEdge[pointingedge]->getDual();
+  int actedge = mHalfEdge[pointingedge].getDual();
   //number to prevent endless loops
   int control = 0;
 
@@ -1232,48 +1223,48 @@ int DualEdgeTriangulation::insertForcedSegment( int p1, int p2, bool breakline )
       return -100;//return an error code
     }
 
-    if ( mHalfEdge[actedge]->getPoint() == -1 )//actedge points to the virtual point
+    if ( mHalfEdge[actedge].getPoint() == -1 )//actedge points to the virtual point
     {
-      actedge = mHalfEdge[mHalfEdge[mHalfEdge[actedge]->getNext()]->getNext()]->getDual();
+      actedge = mHalfEdge[mHalfEdge[mHalfEdge[actedge].getNext()].getNext()].getDual();
       continue;
     }
 
     //test, if actedge is already the forced edge
-    if ( mHalfEdge[actedge]->getPoint() == p2 )
+    if ( mHalfEdge[actedge].getPoint() == p2 )
     {
-      mHalfEdge[actedge]->setForced( true );
-      mHalfEdge[actedge]->setBreak( breakline );
-      mHalfEdge[mHalfEdge[actedge]->getDual()]->setForced( true );
-      mHalfEdge[mHalfEdge[actedge]->getDual()]->setBreak( breakline );
+      mHalfEdge[actedge].setForced( true );
+      mHalfEdge[actedge].setBreak( breakline );
+      mHalfEdge[mHalfEdge[actedge].getDual()].setForced( true );
+      mHalfEdge[mHalfEdge[actedge].getDual()].setBreak( breakline );
       return actedge;
     }
 
     //test, if the forced segment is a multiple of actedge and if the direction is the same
-    else if ( /*lines are parallel*/( mPointVector[p2]->getY() - mPointVector[p1]->getY() ) / ( mPointVector[mHalfEdge[actedge]->getPoint()]->getY() - mPointVector[p1]->getY() ) == ( mPointVector[p2]->getX() - mPointVector[p1]->getX() ) / ( mPointVector[mHalfEdge[actedge]->getPoint()]->getX() - mPointVector[p1]->getX() ) && (( mPointVector[p2]->getY() - mPointVector[p1]->getY() ) >= 0 ) == (( mPointVector[mHalfEdge[actedge]->getPoint()]->getY() - mPointVector[p1]->getY() ) > 0 ) && (( mPointVector[p2]->getX() - mPointVector[p1]->getX() ) >= 0 ) == (( mPointVector[mHalfEdge[actedge]->getPoint()]->getX() - mPointVector[p1]->getX() ) > 0 ) )
+    else if ( /*lines are parallel*/( mPointVector[p2]->getY() - mPointVector[p1]->getY() ) / ( mPointVector[mHalfEdge[actedge].getPoint()]->getY() - mPointVector[p1]->getY() ) == ( mPointVector[p2]->getX() - mPointVector[p1]->getX() ) / ( mPointVector[mHalfEdge[actedge].getPoint()]->getX() - mPointVector[p1]->getX() ) && (( mPointVector[p2]->getY() - mPointVector[p1]->getY() ) >= 0 ) == (( mPointVector[mHalfEdge[actedge].getPoint()]->getY() - mPointVector[p1]->getY() ) > 0 ) && (( mPointVector[p2]->getX() - mPointVector[p1]->getX() ) >= 0 ) == (( mPointVector[mHalfEdge[actedge].getPoint()]->getX() - mPointVector[p1]->getX() ) > 0 ) )
     {
       //mark actedge and Dual(actedge) as forced, reset p1 and start the method from the beginning
-      mHalfEdge[actedge]->setForced( true );
-      mHalfEdge[actedge]->setBreak( breakline );
-      mHalfEdge[mHalfEdge[actedge]->getDual()]->setForced( true );
-      mHalfEdge[mHalfEdge[actedge]->getDual()]->setBreak( breakline );
-      int a = insertForcedSegment( mHalfEdge[actedge]->getPoint(), p2, breakline );
+      mHalfEdge[actedge].setForced( true );
+      mHalfEdge[actedge].setBreak( breakline );
+      mHalfEdge[mHalfEdge[actedge].getDual()].setForced( true );
+      mHalfEdge[mHalfEdge[actedge].getDual()].setBreak( breakline );
+      int a = insertForcedSegment( mHalfEdge[actedge].getPoint(), p2, breakline );
       return a;
     }
 
     //test, if the forced segment intersects Next(actedge)
-    if ( mHalfEdge[mHalfEdge[actedge]->getNext()]->getPoint() == -1 )//intersection with line to the virtual point makes no sense
+    if ( mHalfEdge[mHalfEdge[actedge].getNext()].getPoint() == -1 )//intersection with line to the virtual point makes no sense
     {
-      actedge = mHalfEdge[mHalfEdge[mHalfEdge[actedge]->getNext()]->getNext()]->getDual();
+      actedge = mHalfEdge[mHalfEdge[mHalfEdge[actedge].getNext()].getNext()].getDual();
       continue;
     }
-    else if ( MathUtils::lineIntersection( mPointVector[p1], mPointVector[p2], mPointVector[mHalfEdge[mHalfEdge[actedge]->getNext()]->getPoint()], mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[actedge]->getNext()]->getDual()]->getPoint()] ) )
+    else if ( MathUtils::lineIntersection( mPointVector[p1], mPointVector[p2], mPointVector[mHalfEdge[mHalfEdge[actedge].getNext()].getPoint()], mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[actedge].getNext()].getDual()].getPoint()] ) )
     {
-      if ( mHalfEdge[mHalfEdge[actedge]->getNext()]->getForced() && mForcedCrossBehaviour == Triangulation::SnappingType_VERTICE )//if the crossed edge is a forced edge, we have to snap the forced line to the next node
+      if ( mHalfEdge[mHalfEdge[actedge].getNext()].getForced() && mForcedCrossBehaviour == Triangulation::SnappingType_VERTICE )//if the crossed edge is a forced edge, we have to snap the forced line to the next node
       {
         Point3D crosspoint;
         int p3, p4;
-        p3 = mHalfEdge[mHalfEdge[actedge]->getNext()]->getPoint();
-        p4 = mHalfEdge[mHalfEdge[mHalfEdge[actedge]->getNext()]->getDual()]->getPoint();
+        p3 = mHalfEdge[mHalfEdge[actedge].getNext()].getPoint();
+        p4 = mHalfEdge[mHalfEdge[mHalfEdge[actedge].getNext()].getDual()].getPoint();
         MathUtils::lineIntersection( mPointVector[p1], mPointVector[p2], mPointVector[p3], mPointVector[p4], &crosspoint );
         double dista = sqrt(( crosspoint.getX() - mPointVector[p3]->getX() ) * ( crosspoint.getX() - mPointVector[p3]->getX() ) + ( crosspoint.getY() - mPointVector[p3]->getY() ) * ( crosspoint.getY() - mPointVector[p3]->getY() ) );
         double distb = sqrt(( crosspoint.getX() - mPointVector[p4]->getX() ) * ( crosspoint.getX() - mPointVector[p4]->getX() ) + ( crosspoint.getY() - mPointVector[p4]->getY() ) * ( crosspoint.getY() - mPointVector[p4]->getY() ) );
@@ -1290,12 +1281,12 @@ int DualEdgeTriangulation::insertForcedSegment( int p1, int p2, bool breakline )
           return e;
         }
       }
-      else if ( mHalfEdge[mHalfEdge[actedge]->getNext()]->getForced() && mForcedCrossBehaviour == Triangulation::INSERT_VERTICE )//if the crossed edge is a forced edge, we have to insert a new vertice on this edge
+      else if ( mHalfEdge[mHalfEdge[actedge].getNext()].getForced() && mForcedCrossBehaviour == Triangulation::INSERT_VERTICE )//if the crossed edge is a forced edge, we have to insert a new vertice on this edge
       {
         Point3D crosspoint;
         int p3, p4;
-        p3 = mHalfEdge[mHalfEdge[actedge]->getNext()]->getPoint();
-        p4 = mHalfEdge[mHalfEdge[mHalfEdge[actedge]->getNext()]->getDual()]->getPoint();
+        p3 = mHalfEdge[mHalfEdge[actedge].getNext()].getPoint();
+        p4 = mHalfEdge[mHalfEdge[mHalfEdge[actedge].getNext()].getDual()].getPoint();
         MathUtils::lineIntersection( mPointVector[p1], mPointVector[p2], mPointVector[p3], mPointVector[p4], &crosspoint );
         double distpart = sqrt(( crosspoint.getX() - mPointVector[p4]->getX() ) * ( crosspoint.getX() - mPointVector[p4]->getX() ) + ( crosspoint.getY() - mPointVector[p4]->getY() ) * ( crosspoint.getY() - mPointVector[p4]->getY() ) );
         double disttot = sqrt(( mPointVector[p3]->getX() - mPointVector[p4]->getX() ) * ( mPointVector[p3]->getX() - mPointVector[p4]->getX() ) + ( mPointVector[p3]->getY() - mPointVector[p4]->getY() ) * ( mPointVector[p3]->getY() - mPointVector[p4]->getY() ) );
@@ -1306,20 +1297,20 @@ int DualEdgeTriangulation::insertForcedSegment( int p1, int p2, bool breakline )
           if ( frac == 0 )
           {
             //mark actedge and Dual(actedge) as forced, reset p1 and start the method from the beginning
-            mHalfEdge[actedge]->setForced( true );
-            mHalfEdge[actedge]->setBreak( breakline );
-            mHalfEdge[mHalfEdge[actedge]->getDual()]->setForced( true );
-            mHalfEdge[mHalfEdge[actedge]->getDual()]->setBreak( breakline );
+            mHalfEdge[actedge].setForced( true );
+            mHalfEdge[actedge].setBreak( breakline );
+            mHalfEdge[mHalfEdge[actedge].getDual()].setForced( true );
+            mHalfEdge[mHalfEdge[actedge].getDual()].setBreak( breakline );
             int a = insertForcedSegment( p4, p2, breakline );
             return a;
           }
           else if ( frac == 1 )
           {
             //mark actedge and Dual(actedge) as forced, reset p1 and start the method from the beginning
-            mHalfEdge[actedge]->setForced( true );
-            mHalfEdge[actedge]->setBreak( breakline );
-            mHalfEdge[mHalfEdge[actedge]->getDual()]->setForced( true );
-            mHalfEdge[mHalfEdge[actedge]->getDual()]->setBreak( breakline );
+            mHalfEdge[actedge].setForced( true );
+            mHalfEdge[actedge].setBreak( breakline );
+            mHalfEdge[mHalfEdge[actedge].getDual()].setForced( true );
+            mHalfEdge[mHalfEdge[actedge].getDual()].setBreak( breakline );
             if ( p3 != p2 )
             {
               int a = insertForcedSegment( p3, p2, breakline );
@@ -1336,7 +1327,7 @@ int DualEdgeTriangulation::insertForcedSegment( int p1, int p2, bool breakline )
 
         else
         {
-          int newpoint = splitHalfEdge( mHalfEdge[actedge]->getNext(), frac );
+          int newpoint = splitHalfEdge( mHalfEdge[actedge].getNext(), frac );
           insertForcedSegment( p1, newpoint, breakline );
           int e = insertForcedSegment( newpoint, p2, breakline );
           return e;
@@ -1344,24 +1335,24 @@ int DualEdgeTriangulation::insertForcedSegment( int p1, int p2, bool breakline )
       }
 
       //add the first HalfEdge to the list of crossed edges
-      crossedEdges.append( mHalfEdge[actedge]->getNext() );
+      crossedEdges.append( mHalfEdge[actedge].getNext() );
       break;
     }
-    actedge = mHalfEdge[mHalfEdge[mHalfEdge[actedge]->getNext()]->getNext()]->getDual();
+    actedge = mHalfEdge[mHalfEdge[mHalfEdge[actedge].getNext()].getNext()].getDual();
   }
 
   //we found the first edge, terminated the method or called the method with other points. Lets search for all the other crossed edges
 
   while ( true )//if its an endless loop, something went wrong.
   {
-    if ( MathUtils::lineIntersection( mPointVector[mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getPoint()], mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getNext()]->getPoint()], mPointVector[p1], mPointVector[p2] ) )
+    if ( MathUtils::lineIntersection( mPointVector[mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getPoint()], mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getNext()].getPoint()], mPointVector[p1], mPointVector[p2] ) )
     {
-      if ( mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getNext()]->getForced() && mForcedCrossBehaviour == Triangulation::SnappingType_VERTICE )//if the crossed edge is a forced edge and mForcedCrossBehaviour is SnappingType_VERTICE, we have to snap the forced line to the next node
+      if ( mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getNext()].getForced() && mForcedCrossBehaviour == Triangulation::SnappingType_VERTICE )//if the crossed edge is a forced edge and mForcedCrossBehaviour is SnappingType_VERTICE, we have to snap the forced line to the next node
       {
         Point3D crosspoint;
         int p3, p4;
-        p3 = mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getPoint();
-        p4 = mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getNext()]->getPoint();
+        p3 = mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getPoint();
+        p4 = mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getNext()].getPoint();
         MathUtils::lineIntersection( mPointVector[p1], mPointVector[p2], mPointVector[p3], mPointVector[p4], &crosspoint );
         double dista = sqrt(( crosspoint.getX() - mPointVector[p3]->getX() ) * ( crosspoint.getX() - mPointVector[p3]->getX() ) + ( crosspoint.getY() - mPointVector[p3]->getY() ) * ( crosspoint.getY() - mPointVector[p3]->getY() ) );
         double distb = sqrt(( crosspoint.getX() - mPointVector[p4]->getX() ) * ( crosspoint.getX() - mPointVector[p4]->getX() ) + ( crosspoint.getY() - mPointVector[p4]->getY() ) * ( crosspoint.getY() - mPointVector[p4]->getY() ) );
@@ -1378,12 +1369,12 @@ int DualEdgeTriangulation::insertForcedSegment( int p1, int p2, bool breakline )
           return e;
         }
       }
-      else if ( mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getNext()]->getForced() && mForcedCrossBehaviour == Triangulation::INSERT_VERTICE )//if the crossed edge is a forced edge, we have to insert a new vertice on this edge
+      else if ( mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getNext()].getForced() && mForcedCrossBehaviour == Triangulation::INSERT_VERTICE )//if the crossed edge is a forced edge, we have to insert a new vertice on this edge
       {
         Point3D crosspoint;
         int p3, p4;
-        p3 = mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getPoint();
-        p4 = mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getNext()]->getPoint();
+        p3 = mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getPoint();
+        p4 = mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getNext()].getPoint();
         MathUtils::lineIntersection( mPointVector[p1], mPointVector[p2], mPointVector[p3], mPointVector[p4], &crosspoint );
         double distpart = sqrt(( crosspoint.getX() - mPointVector[p3]->getX() ) * ( crosspoint.getX() - mPointVector[p3]->getX() ) + ( crosspoint.getY() - mPointVector[p3]->getY() ) * ( crosspoint.getY() - mPointVector[p3]->getY() ) );
         double disttot = sqrt(( mPointVector[p3]->getX() - mPointVector[p4]->getX() ) * ( mPointVector[p3]->getX() - mPointVector[p4]->getX() ) + ( mPointVector[p3]->getY() - mPointVector[p4]->getY() ) * ( mPointVector[p3]->getY() - mPointVector[p4]->getY() ) );
@@ -1392,23 +1383,23 @@ int DualEdgeTriangulation::insertForcedSegment( int p1, int p2, bool breakline )
         {
           break;//seems that a roundoff error occurred. We found the endpoint
         }
-        int newpoint = splitHalfEdge( mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getNext(), frac );
+        int newpoint = splitHalfEdge( mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getNext(), frac );
         insertForcedSegment( p1, newpoint, breakline );
         int e = insertForcedSegment( newpoint, p2, breakline );
         return e;
       }
 
-      crossedEdges.append( mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getNext() );
+      crossedEdges.append( mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getNext() );
       continue;
     }
-    else if ( MathUtils::lineIntersection( mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getNext()]->getPoint()], mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getNext()]->getNext()]->getPoint()], mPointVector[p1], mPointVector[p2] ) )
+    else if ( MathUtils::lineIntersection( mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getNext()].getPoint()], mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getNext()].getNext()].getPoint()], mPointVector[p1], mPointVector[p2] ) )
     {
-      if ( mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getNext()]->getNext()]->getForced() && mForcedCrossBehaviour == Triangulation::SnappingType_VERTICE )//if the crossed edge is a forced edge and mForcedCrossBehaviour is SnappingType_VERTICE, we have to snap the forced line to the next node
+      if ( mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getNext()].getNext()].getForced() && mForcedCrossBehaviour == Triangulation::SnappingType_VERTICE )//if the crossed edge is a forced edge and mForcedCrossBehaviour is SnappingType_VERTICE, we have to snap the forced line to the next node
       {
         Point3D crosspoint;
         int p3, p4;
-        p3 = mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getNext()]->getPoint();
-        p4 = mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getNext()]->getNext()]->getPoint();
+        p3 = mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getNext()].getPoint();
+        p4 = mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getNext()].getNext()].getPoint();
         MathUtils::lineIntersection( mPointVector[p1], mPointVector[p2], mPointVector[p3], mPointVector[p4], &crosspoint );
         double dista = sqrt(( crosspoint.getX() - mPointVector[p3]->getX() ) * ( crosspoint.getX() - mPointVector[p3]->getX() ) + ( crosspoint.getY() - mPointVector[p3]->getY() ) * ( crosspoint.getY() - mPointVector[p3]->getY() ) );
         double distb = sqrt(( crosspoint.getX() - mPointVector[p4]->getX() ) * ( crosspoint.getX() - mPointVector[p4]->getX() ) + ( crosspoint.getY() - mPointVector[p4]->getY() ) * ( crosspoint.getY() - mPointVector[p4]->getY() ) );
@@ -1425,12 +1416,12 @@ int DualEdgeTriangulation::insertForcedSegment( int p1, int p2, bool breakline )
           return e;
         }
       }
-      else if ( mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getNext()]->getNext()]->getForced() && mForcedCrossBehaviour == Triangulation::INSERT_VERTICE )//if the crossed edge is a forced edge, we have to insert a new vertice on this edge
+      else if ( mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getNext()].getNext()].getForced() && mForcedCrossBehaviour == Triangulation::INSERT_VERTICE )//if the crossed edge is a forced edge, we have to insert a new vertice on this edge
       {
         Point3D crosspoint;
         int p3, p4;
-        p3 = mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getNext()]->getPoint();
-        p4 = mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getNext()]->getNext()]->getPoint();
+        p3 = mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getNext()].getPoint();
+        p4 = mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getNext()].getNext()].getPoint();
         MathUtils::lineIntersection( mPointVector[p1], mPointVector[p2], mPointVector[p3], mPointVector[p4], &crosspoint );
         double distpart = sqrt(( crosspoint.getX() - mPointVector[p3]->getX() ) * ( crosspoint.getX() - mPointVector[p3]->getX() ) + ( crosspoint.getY() - mPointVector[p3]->getY() ) * ( crosspoint.getY() - mPointVector[p3]->getY() ) );
         double disttot = sqrt(( mPointVector[p3]->getX() - mPointVector[p4]->getX() ) * ( mPointVector[p3]->getX() - mPointVector[p4]->getX() ) + ( mPointVector[p3]->getY() - mPointVector[p4]->getY() ) * ( mPointVector[p3]->getY() - mPointVector[p4]->getY() ) );
@@ -1439,13 +1430,13 @@ int DualEdgeTriangulation::insertForcedSegment( int p1, int p2, bool breakline )
         {
           break;//seems that a roundoff error occurred. We found the endpoint
         }
-        int newpoint = splitHalfEdge( mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getNext()]->getNext(), frac );
+        int newpoint = splitHalfEdge( mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getNext()].getNext(), frac );
         insertForcedSegment( p1, newpoint, breakline );
         int e = insertForcedSegment( newpoint, p2, breakline );
         return e;
       }
 
-      crossedEdges.append( mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getNext()]->getNext() );
+      crossedEdges.append( mHalfEdge[mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getNext()].getNext() );
       continue;
     }
     else//forced edge terminates
@@ -1458,10 +1449,10 @@ int DualEdgeTriangulation::insertForcedSegment( int p1, int p2, bool breakline )
   QList<int>::const_iterator iter;
   for ( iter = crossedEdges.constBegin(); iter != crossedEdges.constEnd(); ++iter )
   {
-    mHalfEdge[( *( iter ) )]->setForced( false );
-    mHalfEdge[( *( iter ) )]->setBreak( false );
-    mHalfEdge[mHalfEdge[( *( iter ) )]->getDual()]->setForced( false );
-    mHalfEdge[mHalfEdge[( *( iter ) )]->getDual()]->setBreak( false );
+    mHalfEdge[( *( iter ) )].setForced( false );
+    mHalfEdge[( *( iter ) )].setBreak( false );
+    mHalfEdge[mHalfEdge[( *( iter ) )].getDual()].setForced( false );
+    mHalfEdge[mHalfEdge[( *( iter ) )].getDual()].setBreak( false );
   }
 
   //crossed edges is filled, now the two polygons to be retriangulated can be build
@@ -1475,12 +1466,12 @@ int DualEdgeTriangulation::insertForcedSegment( int p1, int p2, bool breakline )
 
   //insert the forced edge and enter the corresponding halfedges as the first edges in the left and right polygons. The nexts and points are set later because of the algorithm to build two polygons from 'crossedEdges'
   int firstedge = freelist.first();//edge pointing from p1 to p2
-  mHalfEdge[firstedge]->setForced( true );
-  mHalfEdge[firstedge]->setBreak( breakline );
+  mHalfEdge[firstedge].setForced( true );
+  mHalfEdge[firstedge].setBreak( breakline );
   leftPolygon.append( firstedge );
-  int dualfirstedge = mHalfEdge[freelist.first()]->getDual();//edge pointing from p2 to p1
-  mHalfEdge[dualfirstedge]->setForced( true );
-  mHalfEdge[dualfirstedge]->setBreak( breakline );
+  int dualfirstedge = mHalfEdge[freelist.first()].getDual();//edge pointing from p2 to p1
+  mHalfEdge[dualfirstedge].setForced( true );
+  mHalfEdge[dualfirstedge].setBreak( breakline );
   rightPolygon.append( dualfirstedge );
   freelist.pop_front();//delete the first entry from the freelist
 
@@ -1491,12 +1482,12 @@ int DualEdgeTriangulation::insertForcedSegment( int p1, int p2, bool breakline )
   --leftiter;
   while ( true )
   {
-    int newpoint = mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[( *leftiter )]->getDual()]->getNext()]->getNext()]->getPoint();
+    int newpoint = mHalfEdge[mHalfEdge[mHalfEdge[mHalfEdge[( *leftiter )].getDual()].getNext()].getNext()].getPoint();
     if ( newpoint != actpointl )
     {
       //insert the edge into the leftPolygon
       actpointl = newpoint;
-      int theedge = mHalfEdge[mHalfEdge[mHalfEdge[( *leftiter )]->getDual()]->getNext()]->getNext();
+      int theedge = mHalfEdge[mHalfEdge[mHalfEdge[( *leftiter )].getDual()].getNext()].getNext();
       leftPolygon.append( theedge );
     }
     if ( leftiter == crossedEdges.constBegin() )
@@ -1505,27 +1496,27 @@ int DualEdgeTriangulation::insertForcedSegment( int p1, int p2, bool breakline )
   }
 
   //insert the last element into leftPolygon
-  leftPolygon.append( mHalfEdge[crossedEdges.first()]->getNext() );
+  leftPolygon.append( mHalfEdge[crossedEdges.first()].getNext() );
 
   //finish the polygon on the right side
   QList<int>::const_iterator rightiter;
   int actpointr = p1;
   for ( rightiter = crossedEdges.constBegin(); rightiter != crossedEdges.constEnd(); ++rightiter )
   {
-    int newpoint = mHalfEdge[mHalfEdge[mHalfEdge[( *rightiter )]->getNext()]->getNext()]->getPoint();
+    int newpoint = mHalfEdge[mHalfEdge[mHalfEdge[( *rightiter )].getNext()].getNext()].getPoint();
     if ( newpoint != actpointr )
     {
       //insert the edge into the right polygon
       actpointr = newpoint;
-      int theedge = mHalfEdge[mHalfEdge[( *rightiter )]->getNext()]->getNext();
+      int theedge = mHalfEdge[mHalfEdge[( *rightiter )].getNext()].getNext();
       rightPolygon.append( theedge );
     }
   }
 
 
   //insert the last element into rightPolygon
-  rightPolygon.append( mHalfEdge[mHalfEdge[crossedEdges.last()]->getDual()]->getNext() );
-  mHalfEdge[rightPolygon.last()]->setNext( dualfirstedge );//set 'Next' of the last edge to dualfirstedge
+  rightPolygon.append( mHalfEdge[mHalfEdge[crossedEdges.last()].getDual()].getNext() );
+  mHalfEdge[rightPolygon.last()].setNext( dualfirstedge );//set 'Next' of the last edge to dualfirstedge
 
   //set the necessary nexts of leftPolygon(exept the first)
   int actedgel = leftPolygon[1];
@@ -1533,7 +1524,7 @@ int DualEdgeTriangulation::insertForcedSegment( int p1, int p2, bool breakline )
   leftiter += 2;
   for ( ; leftiter != leftPolygon.constEnd(); ++leftiter )
   {
-    mHalfEdge[actedgel]->setNext(( *leftiter ) );
+    mHalfEdge[actedgel].setNext(( *leftiter ) );
     actedgel = ( *leftiter );
   }
 
@@ -1543,18 +1534,18 @@ int DualEdgeTriangulation::insertForcedSegment( int p1, int p2, bool breakline )
   rightiter += 2;
   for ( ; rightiter != rightPolygon.constEnd(); ++rightiter )
   {
-    mHalfEdge[actedger]->setNext(( *rightiter ) );
+    mHalfEdge[actedger].setNext(( *rightiter ) );
     actedger = ( *( rightiter ) );
   }
 
 
   //setNext and setPoint for the forced edge because this would disturb the building of 'leftpoly' and 'rightpoly' otherwise
-  mHalfEdge[leftPolygon.first()]->setNext(( *( ++( leftiter = leftPolygon.begin() ) ) ) );
-  mHalfEdge[leftPolygon.first()]->setPoint( p2 );
-  mHalfEdge[leftPolygon.last()]->setNext( firstedge );
-  mHalfEdge[rightPolygon.first()]->setNext(( *( ++( rightiter = rightPolygon.begin() ) ) ) );
-  mHalfEdge[rightPolygon.first()]->setPoint( p1 );
-  mHalfEdge[rightPolygon.last()]->setNext( dualfirstedge );
+  mHalfEdge[leftPolygon.first()].setNext(( *( ++( leftiter = leftPolygon.begin() ) ) ) );
+  mHalfEdge[leftPolygon.first()].setPoint( p2 );
+  mHalfEdge[leftPolygon.last()].setNext( firstedge );
+  mHalfEdge[rightPolygon.first()].setNext(( *( ++( rightiter = rightPolygon.begin() ) ) ) );
+  mHalfEdge[rightPolygon.first()].setPoint( p1 );
+  mHalfEdge[rightPolygon.last()].setNext( dualfirstedge );
 
   triangulatePolygon( &leftPolygon, &freelist, firstedge );
   triangulatePolygon( &rightPolygon, &freelist, dualfirstedge );
@@ -1618,13 +1609,13 @@ void DualEdgeTriangulation::eliminateHorizontalTriangles()
 
       int e1, e2, e3;//numbers of the three edges
       e1 = i;
-      e2 = mHalfEdge[e1]->getNext();
-      e3 = mHalfEdge[e2]->getNext();
+      e2 = mHalfEdge[e1].getNext();
+      e3 = mHalfEdge[e2].getNext();
 
       int p1, p2, p3;//numbers of the three points
-      p1 = mHalfEdge[e1]->getPoint();
-      p2 = mHalfEdge[e2]->getPoint();
-      p3 = mHalfEdge[e3]->getPoint();
+      p1 = mHalfEdge[e1].getPoint();
+      p2 = mHalfEdge[e2].getPoint();
+      p3 = mHalfEdge[e3].getPoint();
 
       //skip the iteration, if one point is the virtual point
       if ( p1 == -1 || p2 == -1 || p3 == -1 )
@@ -1643,17 +1634,17 @@ void DualEdgeTriangulation::eliminateHorizontalTriangles()
       if ( el1 == el2 && el2 == el3 )//we found a horizonal triangle
       {
         //swap edges if it is possible, if it would remove the horizontal triangle and if the minimum angle generated by the swap is high enough
-        if ( swapPossible(( uint )e1 ) && mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[e1]->getDual()]->getNext()]->getPoint()]->getZ() != el1 && swapMinAngle( e1 ) > minangle )
+        if ( swapPossible(( uint )e1 ) && mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[e1].getDual()].getNext()].getPoint()]->getZ() != el1 && swapMinAngle( e1 ) > minangle )
         {
           doOnlySwap(( uint )e1 );
           swapped = true;
         }
-        else if ( swapPossible(( uint )e2 ) && mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[e2]->getDual()]->getNext()]->getPoint()]->getZ() != el2 && swapMinAngle( e2 ) > minangle )
+        else if ( swapPossible(( uint )e2 ) && mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[e2].getDual()].getNext()].getPoint()]->getZ() != el2 && swapMinAngle( e2 ) > minangle )
         {
           doOnlySwap(( uint )e2 );
           swapped = true;
         }
-        else if ( swapPossible(( uint )e3 ) && mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[e3]->getDual()]->getNext()]->getPoint()]->getZ() != el3 && swapMinAngle( e3 ) > minangle )
+        else if ( swapPossible(( uint )e3 ) && mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[e3].getDual()].getNext()].getPoint()]->getZ() != el3 && swapMinAngle( e3 ) > minangle )
         {
           doOnlySwap(( uint )e3 );
           swapped = true;
@@ -1703,15 +1694,15 @@ void DualEdgeTriangulation::ruppertRefinement()
 
     for ( int i = 0; i < nhalfedges - 1; i++ )
     {
-      int next = mHalfEdge[i]->getNext();
-      int nextnext = mHalfEdge[next]->getNext();
+      int next = mHalfEdge[i].getNext();
+      int nextnext = mHalfEdge[next].getNext();
 
-      if ( mHalfEdge[next]->getPoint() != -1 && ( mHalfEdge[i]->getForced() || mHalfEdge[mHalfEdge[mHalfEdge[i]->getDual()]->getNext()]->getPoint() == -1 ) )//check for encroached points on forced segments and segments on the inner side of the convex hull, but don't consider edges on the outer side of the convex hull
+      if ( mHalfEdge[next].getPoint() != -1 && ( mHalfEdge[i].getForced() || mHalfEdge[mHalfEdge[mHalfEdge[i].getDual()].getNext()].getPoint() == -1 ) )//check for encroached points on forced segments and segments on the inner side of the convex hull, but don't consider edges on the outer side of the convex hull
       {
-        if ( !(( mHalfEdge[next]->getForced() || edgeOnConvexHull( next ) ) || ( mHalfEdge[nextnext]->getForced() || edgeOnConvexHull( nextnext ) ) ) )//don't consider triangles where all three edges are forced edges or hull edges
+        if ( !(( mHalfEdge[next].getForced() || edgeOnConvexHull( next ) ) || ( mHalfEdge[nextnext].getForced() || edgeOnConvexHull( nextnext ) ) ) )//don't consider triangles where all three edges are forced edges or hull edges
         {
           //test for encroachment
-          while ( MathUtils::inDiametral( mPointVector[mHalfEdge[mHalfEdge[i]->getDual()]->getPoint()], mPointVector[mHalfEdge[i]->getPoint()], mPointVector[mHalfEdge[next]->getPoint()] ) )
+          while ( MathUtils::inDiametral( mPointVector[mHalfEdge[mHalfEdge[i].getDual()].getPoint()], mPointVector[mHalfEdge[i].getPoint()], mPointVector[mHalfEdge[next].getPoint()] ) )
           {
             //split segment
             int pointno = splitHalfEdge( i, 0.5 );
@@ -1728,9 +1719,9 @@ void DualEdgeTriangulation::ruppertRefinement()
   int p1, p2, p3;//numbers of the triangle points
   for ( int i = 0; i < mHalfEdge.count() - 1; i++ )
   {
-    p1 = mHalfEdge[mHalfEdge[i]->getDual()]->getPoint();
-    p2 = mHalfEdge[i]->getPoint();
-    p3 = mHalfEdge[mHalfEdge[i]->getNext()]->getPoint();
+    p1 = mHalfEdge[mHalfEdge[i].getDual()].getPoint();
+    p2 = mHalfEdge[i].getPoint();
+    p3 = mHalfEdge[mHalfEdge[i].getNext()].getPoint();
 
     if ( p1 == -1 || p2 == -1 || p3 == -1 )//don't consider triangles with the virtual point
     {
@@ -1741,7 +1732,7 @@ void DualEdgeTriangulation::ruppertRefinement()
     bool twoforcededges;//flag to decide, if edges should be added to the maps. Do not add them if true
 
 
-    if (( mHalfEdge[i]->getForced() || edgeOnConvexHull( i ) ) && ( mHalfEdge[mHalfEdge[i]->getNext()]->getForced() || edgeOnConvexHull( mHalfEdge[i]->getNext() ) ) )
+    if (( mHalfEdge[i].getForced() || edgeOnConvexHull( i ) ) && ( mHalfEdge[mHalfEdge[i].getNext()].getForced() || edgeOnConvexHull( mHalfEdge[i].getNext() ) ) )
     {
       twoforcededges = true;
     }
@@ -1776,11 +1767,11 @@ void DualEdgeTriangulation::ruppertRefinement()
     minangle = angle_edge.begin()->first;
     QgsDebugMsg( QString( "minangle: %1" ).arg( minangle ) );
     minedge = angle_edge.begin()->second;
-    minedgenext = mHalfEdge[minedge]->getNext();
-    minedgenextnext = mHalfEdge[minedgenext]->getNext();
+    minedgenext = mHalfEdge[minedge].getNext();
+    minedgenextnext = mHalfEdge[minedgenext].getNext();
 
     //calculate the circumcenter
-    if ( !MathUtils::circumcenter( mPointVector[mHalfEdge[minedge]->getPoint()], mPointVector[mHalfEdge[minedgenext]->getPoint()], mPointVector[mHalfEdge[minedgenextnext]->getPoint()], &circumcenter ) )
+    if ( !MathUtils::circumcenter( mPointVector[mHalfEdge[minedge].getPoint()], mPointVector[mHalfEdge[minedgenext].getPoint()], mPointVector[mHalfEdge[minedgenextnext].getPoint()], &circumcenter ) )
     {
       QgsDebugMsg( "warning, calculation of circumcenter failed" );
       //put all three edges to dontexamine and remove them from the other maps
@@ -1819,9 +1810,9 @@ void DualEdgeTriangulation::ruppertRefinement()
     int numhalfedges = mHalfEdge.count();//begin slow version
     for ( int i = 0; i < numhalfedges; i++ )
     {
-      if ( mHalfEdge[i]->getForced() || edgeOnConvexHull( i ) )
+      if ( mHalfEdge[i].getForced() || edgeOnConvexHull( i ) )
       {
-        if ( MathUtils::inDiametral( mPointVector[mHalfEdge[i]->getPoint()], mPointVector[mHalfEdge[mHalfEdge[i]->getDual()]->getPoint()], &circumcenter ) )
+        if ( MathUtils::inDiametral( mPointVector[mHalfEdge[i].getPoint()], mPointVector[mHalfEdge[mHalfEdge[i].getDual()].getPoint()], &circumcenter ) )
         {
           encroached = true;
           //split segment
@@ -1838,12 +1829,12 @@ void DualEdgeTriangulation::ruppertRefinement()
 
           do
           {
-            ed1 = mHalfEdge[actedge]->getDual();
-            pt1 = mHalfEdge[ed1]->getPoint();
-            ed2 = mHalfEdge[ed1]->getNext();
-            pt2 = mHalfEdge[ed2]->getPoint();
-            ed3 = mHalfEdge[ed2]->getNext();
-            pt3 = mHalfEdge[ed3]->getPoint();
+            ed1 = mHalfEdge[actedge].getDual();
+            pt1 = mHalfEdge[ed1].getPoint();
+            ed2 = mHalfEdge[ed1].getNext();
+            pt2 = mHalfEdge[ed2].getPoint();
+            ed3 = mHalfEdge[ed2].getNext();
+            pt3 = mHalfEdge[ed3].getPoint();
             actedge = ed3;
 
             if ( pt1 == -1 || pt2 == -1 || pt3 == -1 )//don't consider triangles with the virtual point
@@ -1858,7 +1849,7 @@ void DualEdgeTriangulation::ruppertRefinement()
             //don't put the edges on the maps if two segments are forced or on a hull
             bool twoforcededges1, twoforcededges2, twoforcededges3;//flag to indicate, if angle1, angle2 and angle3 are between forced edges or hull edges
 
-            if (( mHalfEdge[ed1]->getForced() || edgeOnConvexHull( ed1 ) ) && ( mHalfEdge[ed2]->getForced() || edgeOnConvexHull( ed2 ) ) )
+            if (( mHalfEdge[ed1].getForced() || edgeOnConvexHull( ed1 ) ) && ( mHalfEdge[ed2].getForced() || edgeOnConvexHull( ed2 ) ) )
             {
               twoforcededges1 = true;
             }
@@ -1867,7 +1858,7 @@ void DualEdgeTriangulation::ruppertRefinement()
               twoforcededges1 = false;
             }
 
-            if (( mHalfEdge[ed2]->getForced() || edgeOnConvexHull( ed2 ) ) && ( mHalfEdge[ed3]->getForced() || edgeOnConvexHull( ed3 ) ) )
+            if (( mHalfEdge[ed2].getForced() || edgeOnConvexHull( ed2 ) ) && ( mHalfEdge[ed3].getForced() || edgeOnConvexHull( ed3 ) ) )
             {
               twoforcededges2 = true;
             }
@@ -1876,7 +1867,7 @@ void DualEdgeTriangulation::ruppertRefinement()
               twoforcededges2 = false;
             }
 
-            if (( mHalfEdge[ed3]->getForced() || edgeOnConvexHull( ed3 ) ) && ( mHalfEdge[ed1]->getForced() || edgeOnConvexHull( ed1 ) ) )
+            if (( mHalfEdge[ed3].getForced() || edgeOnConvexHull( ed3 ) ) && ( mHalfEdge[ed1].getForced() || edgeOnConvexHull( ed1 ) ) )
             {
               twoforcededges3 = true;
             }
@@ -2023,12 +2014,12 @@ void DualEdgeTriangulation::ruppertRefinement()
     }
 
     evaluateInfluenceRegion( &circumcenter, baseedge, influenceedges );
-    evaluateInfluenceRegion( &circumcenter, mHalfEdge[baseedge]->getNext(), influenceedges );
-    evaluateInfluenceRegion( &circumcenter, mHalfEdge[mHalfEdge[baseedge]->getNext()]->getNext(), influenceedges );
+    evaluateInfluenceRegion( &circumcenter, mHalfEdge[baseedge].getNext(), influenceedges );
+    evaluateInfluenceRegion( &circumcenter, mHalfEdge[mHalfEdge[baseedge].getNext()].getNext(), influenceedges );
 
     for ( QSet<int>::iterator it = influenceedges.begin(); it != influenceedges.end(); ++it )
     {
-      if (( mHalfEdge[*it]->getForced() || edgeOnConvexHull( *it ) ) && MathUtils::inDiametral( mPointVector[mHalfEdge[*it]->getPoint()], mPointVector[mHalfEdge[mHalfEdge[*it]->getDual()]->getPoint()], &circumcenter ) )
+      if (( mHalfEdge[*it].getForced() || edgeOnConvexHull( *it ) ) && MathUtils::inDiametral( mPointVector[mHalfEdge[*it].getPoint()], mPointVector[mHalfEdge[mHalfEdge[*it].getDual()].getPoint()], &circumcenter ) )
       {
         //split segment
         QgsDebugMsg( "segment split" );
@@ -2045,12 +2036,12 @@ void DualEdgeTriangulation::ruppertRefinement()
 
         do
         {
-          ed1 = mHalfEdge[actedge]->getDual();
-          pt1 = mHalfEdge[ed1]->getPoint();
-          ed2 = mHalfEdge[ed1]->getNext();
-          pt2 = mHalfEdge[ed2]->getPoint();
-          ed3 = mHalfEdge[ed2]->getNext();
-          pt3 = mHalfEdge[ed3]->getPoint();
+          ed1 = mHalfEdge[actedge].getDual();
+          pt1 = mHalfEdge[ed1].getPoint();
+          ed2 = mHalfEdge[ed1].getNext();
+          pt2 = mHalfEdge[ed2].getPoint();
+          ed3 = mHalfEdge[ed2].getNext();
+          pt3 = mHalfEdge[ed3].getPoint();
           actedge = ed3;
 
           if ( pt1 == -1 || pt2 == -1 || pt3 == -1 )//don't consider triangles with the virtual point
@@ -2067,7 +2058,7 @@ void DualEdgeTriangulation::ruppertRefinement()
 
 
 
-          if (( mHalfEdge[ed1]->getForced() || edgeOnConvexHull( ed1 ) ) && ( mHalfEdge[ed2]->getForced() || edgeOnConvexHull( ed2 ) ) )
+          if (( mHalfEdge[ed1].getForced() || edgeOnConvexHull( ed1 ) ) && ( mHalfEdge[ed2].getForced() || edgeOnConvexHull( ed2 ) ) )
           {
             twoforcededges1 = true;
           }
@@ -2076,7 +2067,7 @@ void DualEdgeTriangulation::ruppertRefinement()
             twoforcededges1 = false;
           }
 
-          if (( mHalfEdge[ed2]->getForced() || edgeOnConvexHull( ed2 ) ) && ( mHalfEdge[ed3]->getForced() || edgeOnConvexHull( ed3 ) ) )
+          if (( mHalfEdge[ed2].getForced() || edgeOnConvexHull( ed2 ) ) && ( mHalfEdge[ed3].getForced() || edgeOnConvexHull( ed3 ) ) )
           {
             twoforcededges2 = true;
           }
@@ -2085,7 +2076,7 @@ void DualEdgeTriangulation::ruppertRefinement()
             twoforcededges2 = false;
           }
 
-          if (( mHalfEdge[ed3]->getForced() || edgeOnConvexHull( ed3 ) ) && ( mHalfEdge[ed1]->getForced() || edgeOnConvexHull( ed1 ) ) )
+          if (( mHalfEdge[ed3].getForced() || edgeOnConvexHull( ed3 ) ) && ( mHalfEdge[ed1].getForced() || edgeOnConvexHull( ed1 ) ) )
           {
             twoforcededges3 = true;
           }
@@ -2260,12 +2251,12 @@ void DualEdgeTriangulation::ruppertRefinement()
 
       do
       {
-        ed1 = mHalfEdge[actedge]->getDual();
-        pt1 = mHalfEdge[ed1]->getPoint();
-        ed2 = mHalfEdge[ed1]->getNext();
-        pt2 = mHalfEdge[ed2]->getPoint();
-        ed3 = mHalfEdge[ed2]->getNext();
-        pt3 = mHalfEdge[ed3]->getPoint();
+        ed1 = mHalfEdge[actedge].getDual();
+        pt1 = mHalfEdge[ed1].getPoint();
+        ed2 = mHalfEdge[ed1].getNext();
+        pt2 = mHalfEdge[ed2].getPoint();
+        ed3 = mHalfEdge[ed2].getNext();
+        pt3 = mHalfEdge[ed3].getPoint();
         actedge = ed3;
 
         if ( pt1 == -1 || pt2 == -1 || pt3 == -1 )//don't consider triangles with the virtual point
@@ -2280,7 +2271,7 @@ void DualEdgeTriangulation::ruppertRefinement()
         //todo: put all three edges on the dontexamine list if two edges are forced or convex hull edges
         bool twoforcededges1, twoforcededges2, twoforcededges3;
 
-        if (( mHalfEdge[ed1]->getForced() || edgeOnConvexHull( ed1 ) ) && ( mHalfEdge[ed2]->getForced() || edgeOnConvexHull( ed2 ) ) )
+        if (( mHalfEdge[ed1].getForced() || edgeOnConvexHull( ed1 ) ) && ( mHalfEdge[ed2].getForced() || edgeOnConvexHull( ed2 ) ) )
         {
           twoforcededges1 = true;
         }
@@ -2289,7 +2280,7 @@ void DualEdgeTriangulation::ruppertRefinement()
           twoforcededges1 = false;
         }
 
-        if (( mHalfEdge[ed2]->getForced() || edgeOnConvexHull( ed2 ) ) && ( mHalfEdge[ed3]->getForced() || edgeOnConvexHull( ed3 ) ) )
+        if (( mHalfEdge[ed2].getForced() || edgeOnConvexHull( ed2 ) ) && ( mHalfEdge[ed3].getForced() || edgeOnConvexHull( ed3 ) ) )
         {
           twoforcededges2 = true;
         }
@@ -2298,7 +2289,7 @@ void DualEdgeTriangulation::ruppertRefinement()
           twoforcededges2 = false;
         }
 
-        if (( mHalfEdge[ed3]->getForced() || edgeOnConvexHull( ed3 ) ) && ( mHalfEdge[ed1]->getForced() || edgeOnConvexHull( ed1 ) ) )
+        if (( mHalfEdge[ed3].getForced() || edgeOnConvexHull( ed3 ) ) && ( mHalfEdge[ed1].getForced() || edgeOnConvexHull( ed1 ) ) )
         {
           twoforcededges3 = true;
         }
@@ -2424,21 +2415,21 @@ void DualEdgeTriangulation::ruppertRefinement()
 bool DualEdgeTriangulation::swapPossible( unsigned int edge )
 {
   //test, if edge belongs to a forced edge
-  if ( mHalfEdge[edge]->getForced() )
+  if ( mHalfEdge[edge].getForced() )
   {
     return false;
   }
 
   //test, if the edge is on the convex hull or is connected to the virtual point
-  if ( mHalfEdge[edge]->getPoint() == -1 || mHalfEdge[mHalfEdge[edge]->getNext()]->getPoint() == -1 || mHalfEdge[mHalfEdge[mHalfEdge[edge]->getDual()]->getNext()]->getPoint() == -1 || mHalfEdge[mHalfEdge[edge]->getDual()]->getPoint() == -1 )
+  if ( mHalfEdge[edge].getPoint() == -1 || mHalfEdge[mHalfEdge[edge].getNext()].getPoint() == -1 || mHalfEdge[mHalfEdge[mHalfEdge[edge].getDual()].getNext()].getPoint() == -1 || mHalfEdge[mHalfEdge[edge].getDual()].getPoint() == -1 )
   {
     return false;
   }
   //then, test, if the edge is in the middle of a not convex quad
-  Point3D* pta = mPointVector[mHalfEdge[edge]->getPoint()];
-  Point3D* ptb = mPointVector[mHalfEdge[mHalfEdge[edge]->getNext()]->getPoint()];
-  Point3D* ptc = mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[edge]->getNext()]->getNext()]->getPoint()];
-  Point3D* ptd = mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[edge]->getDual()]->getNext()]->getPoint()];
+  Point3D* pta = mPointVector[mHalfEdge[edge].getPoint()];
+  Point3D* ptb = mPointVector[mHalfEdge[mHalfEdge[edge].getNext()].getPoint()];
+  Point3D* ptc = mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[edge].getNext()].getNext()].getPoint()];
+  Point3D* ptd = mPointVector[mHalfEdge[mHalfEdge[mHalfEdge[edge].getDual()].getNext()].getPoint()];
   if ( MathUtils::leftOf( ptc, pta, ptb ) > leftOfTresh )
   {
     return false;
@@ -2469,18 +2460,18 @@ void DualEdgeTriangulation::triangulatePolygon( QList<int>* poly, QList<int>* fr
 
     //search for the edge pointing on the closest point(distedge) and for the next(nextdistedge)
     QList<int>::const_iterator iterator = ++( poly->constBegin() );//go to the second edge
-    double distance = MathUtils::distPointFromLine( mPointVector[mHalfEdge[( *iterator )]->getPoint()], mPointVector[mHalfEdge[mHalfEdge[mainedge]->getDual()]->getPoint()], mPointVector[mHalfEdge[mainedge]->getPoint()] );
+    double distance = MathUtils::distPointFromLine( mPointVector[mHalfEdge[( *iterator )].getPoint()], mPointVector[mHalfEdge[mHalfEdge[mainedge].getDual()].getPoint()], mPointVector[mHalfEdge[mainedge].getPoint()] );
     int distedge = ( *iterator );
-    int nextdistedge = mHalfEdge[( *iterator )]->getNext();
+    int nextdistedge = mHalfEdge[( *iterator )].getNext();
     ++iterator;
 
     while ( iterator != --( poly->constEnd() ) )
     {
-      if ( MathUtils::distPointFromLine( mPointVector[mHalfEdge[( *iterator )]->getPoint()], mPointVector[mHalfEdge[mHalfEdge[mainedge]->getDual()]->getPoint()], mPointVector[mHalfEdge[mainedge]->getPoint()] ) < distance )
+      if ( MathUtils::distPointFromLine( mPointVector[mHalfEdge[( *iterator )].getPoint()], mPointVector[mHalfEdge[mHalfEdge[mainedge].getDual()].getPoint()], mPointVector[mHalfEdge[mainedge].getPoint()] ) < distance )
       {
         distedge = ( *iterator );
-        nextdistedge = mHalfEdge[( *iterator )]->getNext();
-        distance = MathUtils::distPointFromLine( mPointVector[mHalfEdge[( *iterator )]->getPoint()], mPointVector[mHalfEdge[mHalfEdge[mainedge]->getDual()]->getPoint()], mPointVector[mHalfEdge[mainedge]->getPoint()] );
+        nextdistedge = mHalfEdge[( *iterator )].getNext();
+        distance = MathUtils::distPointFromLine( mPointVector[mHalfEdge[( *iterator )].getPoint()], mPointVector[mHalfEdge[mHalfEdge[mainedge].getDual()].getPoint()], mPointVector[mHalfEdge[mainedge].getPoint()] );
       }
       ++iterator;
     }
@@ -2488,15 +2479,15 @@ void DualEdgeTriangulation::triangulatePolygon( QList<int>* poly, QList<int>* fr
     if ( nextdistedge == ( *( --poly->end() ) ) )//the nearest point is connected to the endpoint of mainedge
     {
       int inserta = free->first();//take an edge from the freelist
-      int insertb = mHalfEdge[inserta]->getDual();
+      int insertb = mHalfEdge[inserta].getDual();
       free->pop_front();
 
-      mHalfEdge[inserta]->setNext(( poly->at( 1 ) ) );
-      mHalfEdge[inserta]->setPoint( mHalfEdge[mainedge]->getPoint() );
-      mHalfEdge[insertb]->setNext( nextdistedge );
-      mHalfEdge[insertb]->setPoint( mHalfEdge[distedge]->getPoint() );
-      mHalfEdge[distedge]->setNext( inserta );
-      mHalfEdge[mainedge]->setNext( insertb );
+      mHalfEdge[inserta].setNext(( poly->at( 1 ) ) );
+      mHalfEdge[inserta].setPoint( mHalfEdge[mainedge].getPoint() );
+      mHalfEdge[insertb].setNext( nextdistedge );
+      mHalfEdge[insertb].setPoint( mHalfEdge[distedge].getPoint() );
+      mHalfEdge[distedge].setNext( inserta );
+      mHalfEdge[mainedge].setNext( insertb );
 
       QList<int> polya;
       for ( iterator = ( ++( poly->constBegin() ) ); ( *iterator ) != nextdistedge; ++iterator )
@@ -2519,15 +2510,15 @@ void DualEdgeTriangulation::triangulatePolygon( QList<int>* poly, QList<int>* fr
     else if ( distedge == ( *( ++poly->begin() ) ) )//the nearest point is connected to the beginpoint of mainedge
     {
       int inserta = free->first();//take an edge from the freelist
-      int insertb = mHalfEdge[inserta]->getDual();
+      int insertb = mHalfEdge[inserta].getDual();
       free->pop_front();
 
-      mHalfEdge[inserta]->setNext(( poly->at( 2 ) ) );
-      mHalfEdge[inserta]->setPoint( mHalfEdge[distedge]->getPoint() );
-      mHalfEdge[insertb]->setNext( mainedge );
-      mHalfEdge[insertb]->setPoint( mHalfEdge[mHalfEdge[mainedge]->getDual()]->getPoint() );
-      mHalfEdge[distedge]->setNext( insertb );
-      mHalfEdge[( *( --poly->end() ) )]->setNext( inserta );
+      mHalfEdge[inserta].setNext(( poly->at( 2 ) ) );
+      mHalfEdge[inserta].setPoint( mHalfEdge[distedge].getPoint() );
+      mHalfEdge[insertb].setNext( mainedge );
+      mHalfEdge[insertb].setPoint( mHalfEdge[mHalfEdge[mainedge].getDual()].getPoint() );
+      mHalfEdge[distedge].setNext( insertb );
+      mHalfEdge[( *( --poly->end() ) )].setNext( inserta );
 
       QList<int> polya;
       iterator = poly->constBegin();
@@ -2545,25 +2536,25 @@ void DualEdgeTriangulation::triangulatePolygon( QList<int>* poly, QList<int>* fr
     else//the nearest point is not connected to an endpoint of mainedge
     {
       int inserta = free->first();//take an edge from the freelist
-      int insertb = mHalfEdge[inserta]->getDual();
+      int insertb = mHalfEdge[inserta].getDual();
       free->pop_front();
 
       int insertc = free->first();
-      int insertd = mHalfEdge[insertc]->getDual();
+      int insertd = mHalfEdge[insertc].getDual();
       free->pop_front();
 
-      mHalfEdge[inserta]->setNext(( poly->at( 1 ) ) );
-      mHalfEdge[inserta]->setPoint( mHalfEdge[mainedge]->getPoint() );
-      mHalfEdge[insertb]->setNext( insertd );
-      mHalfEdge[insertb]->setPoint( mHalfEdge[distedge]->getPoint() );
-      mHalfEdge[insertc]->setNext( nextdistedge );
-      mHalfEdge[insertc]->setPoint( mHalfEdge[distedge]->getPoint() );
-      mHalfEdge[insertd]->setNext( mainedge );
-      mHalfEdge[insertd]->setPoint( mHalfEdge[mHalfEdge[mainedge]->getDual()]->getPoint() );
+      mHalfEdge[inserta].setNext(( poly->at( 1 ) ) );
+      mHalfEdge[inserta].setPoint( mHalfEdge[mainedge].getPoint() );
+      mHalfEdge[insertb].setNext( insertd );
+      mHalfEdge[insertb].setPoint( mHalfEdge[distedge].getPoint() );
+      mHalfEdge[insertc].setNext( nextdistedge );
+      mHalfEdge[insertc].setPoint( mHalfEdge[distedge].getPoint() );
+      mHalfEdge[insertd].setNext( mainedge );
+      mHalfEdge[insertd].setPoint( mHalfEdge[mHalfEdge[mainedge].getDual()].getPoint() );
 
-      mHalfEdge[distedge]->setNext( inserta );
-      mHalfEdge[mainedge]->setNext( insertb );
-      mHalfEdge[( *( --poly->end() ) )]->setNext( insertc );
+      mHalfEdge[distedge].setNext( inserta );
+      mHalfEdge[mainedge].setNext( insertb );
+      mHalfEdge[( *( --poly->end() ) )].setNext( insertc );
 
       //build two new polygons for recursive triangulation
       QList<int> polya;
@@ -2612,7 +2603,7 @@ bool DualEdgeTriangulation::pointInside( double x, double y )
       return false;
     }
 
-    if ( MathUtils::leftOf( &point, mPointVector[mHalfEdge[mHalfEdge[actedge]->getDual()]->getPoint()], mPointVector[mHalfEdge[actedge]->getPoint()] ) < ( -leftOfTresh ) )//point is on the left side
+    if ( MathUtils::leftOf( &point, mPointVector[mHalfEdge[mHalfEdge[actedge].getDual()].getPoint()], mPointVector[mHalfEdge[actedge].getPoint()] ) < ( -leftOfTresh ) )//point is on the left side
     {
       counter += 1;
       if ( counter == 3 )//three successful passes means that we have found the triangle
@@ -2621,7 +2612,7 @@ bool DualEdgeTriangulation::pointInside( double x, double y )
       }
     }
 
-    else if ( MathUtils::leftOf( &point, mPointVector[mHalfEdge[mHalfEdge[actedge]->getDual()]->getPoint()], mPointVector[mHalfEdge[actedge]->getPoint()] ) == 0 )//point is exactly in the line of the edge
+    else if ( MathUtils::leftOf( &point, mPointVector[mHalfEdge[mHalfEdge[actedge].getDual()].getPoint()], mPointVector[mHalfEdge[actedge].getPoint()] ) == 0 )//point is exactly in the line of the edge
     {
       counter += 1;
       mEdgeWithPoint = actedge;
@@ -2631,7 +2622,7 @@ bool DualEdgeTriangulation::pointInside( double x, double y )
         break;
       }
     }
-    else if ( MathUtils::leftOf( &point, mPointVector[mHalfEdge[mHalfEdge[actedge]->getDual()]->getPoint()], mPointVector[mHalfEdge[actedge]->getPoint()] ) < leftOfTresh )//numerical problems
+    else if ( MathUtils::leftOf( &point, mPointVector[mHalfEdge[mHalfEdge[actedge].getDual()].getPoint()], mPointVector[mHalfEdge[actedge].getPoint()] ) < leftOfTresh )//numerical problems
     {
       counter += 1;
       numinstabs += 1;
@@ -2642,20 +2633,20 @@ bool DualEdgeTriangulation::pointInside( double x, double y )
     }
     else//point is on the right side
     {
-      actedge = mHalfEdge[actedge]->getDual();
+      actedge = mHalfEdge[actedge].getDual();
       counter = 1;
       nulls = 0;
       numinstabs = 0;
     }
 
-    actedge = mHalfEdge[actedge]->getNext();
-    if ( mHalfEdge[actedge]->getPoint() == -1 )//the half edge points to the virtual point
+    actedge = mHalfEdge[actedge].getNext();
+    if ( mHalfEdge[actedge].getPoint() == -1 )//the half edge points to the virtual point
     {
       if ( nulls == 1 )//point is exactly on the convex hull
       {
         return true;
       }
-      mEdgeOutside = ( unsigned int )mHalfEdge[mHalfEdge[actedge]->getNext()]->getNext();
+      mEdgeOutside = ( unsigned int )mHalfEdge[mHalfEdge[actedge].getNext()].getNext();
       return false;//the point is outside the convex hull
     }
     runs++;
@@ -2783,19 +2774,19 @@ bool DualEdgeTriangulation::readFromTAFF( QString filename )
       break2 = true;
     }
 
-    HalfEdge* hf1 = new HalfEdge();
-    hf1->setDual( nr2 );
-    hf1->setNext( next1 );
-    hf1->setPoint( point1 );
-    hf1->setBreak( break1 );
-    hf1->setForced( forced1 );
+    HalfEdge hf1;
+    hf1.setDual( nr2 );
+    hf1.setNext( next1 );
+    hf1.setPoint( point1 );
+    hf1.setBreak( break1 );
+    hf1.setForced( forced1 );
 
-    HalfEdge* hf2 = new HalfEdge();
-    hf2->setDual( nr1 );
-    hf2->setNext( next2 );
-    hf2->setPoint( point2 );
-    hf2->setBreak( break2 );
-    hf2->setForced( forced2 );
+    HalfEdge hf2;
+    hf2.setDual( nr1 );
+    hf2.setNext( next2 );
+    hf2.setPoint( point2 );
+    hf2.setBreak( break2 );
+    hf2.setForced( forced2 );
 
     // QgsDebugMsg( QString( "inserting half edge pair %1" ).arg( i ) );
     mHalfEdge.insert( nr1, hf1 );
@@ -2810,10 +2801,10 @@ bool DualEdgeTriangulation::readFromTAFF( QString filename )
   for ( int i = 0; i < numberofhalfedges; i++ )
   {
     int a, b, c, d;
-    a = mHalfEdge[i]->getPoint();
-    b = mHalfEdge[mHalfEdge[i]->getDual()]->getPoint();
-    c = mHalfEdge[mHalfEdge[i]->getNext()]->getPoint();
-    d = mHalfEdge[mHalfEdge[mHalfEdge[i]->getDual()]->getNext()]->getPoint();
+    a = mHalfEdge[i].getPoint();
+    b = mHalfEdge[mHalfEdge[i].getDual()].getPoint();
+    c = mHalfEdge[mHalfEdge[i].getNext()].getPoint();
+    d = mHalfEdge[mHalfEdge[mHalfEdge[i].getDual()].getNext()].getPoint();
     if ( a != -1 && b != -1 && c != -1 && d != -1 )
     {
       mEdgeInside = i;
@@ -2932,9 +2923,9 @@ bool DualEdgeTriangulation::saveToTAFF( QString filename ) const
       continue;
     }
 
-    int dual = mHalfEdge[i]->getDual();
-    outstream << i << " " << mHalfEdge[i]->getPoint() << " " << mHalfEdge[i]->getNext() << " " << mHalfEdge[i]->getForced() << " " << mHalfEdge[i]->getBreak() << " ";
-    outstream << dual << " " << mHalfEdge[dual]->getPoint() << " " << mHalfEdge[dual]->getNext() << " " << mHalfEdge[dual]->getForced() << " " << mHalfEdge[dual]->getBreak() << " ";
+    int dual = mHalfEdge[i].getDual();
+    outstream << i << " " << mHalfEdge[i].getPoint() << " " << mHalfEdge[i].getNext() << " " << mHalfEdge[i].getForced() << " " << mHalfEdge[i].getBreak() << " ";
+    outstream << dual << " " << mHalfEdge[dual].getPoint() << " " << mHalfEdge[dual].getNext() << " " << mHalfEdge[dual].getForced() << " " << mHalfEdge[dual].getBreak() << " ";
     cont[i] = true;
     cont[dual] = true;
   }
@@ -2971,11 +2962,11 @@ bool DualEdgeTriangulation::swapEdge( double x, double y )
     Point3D* point1;
     Point3D* point2;
     Point3D* point3;
-    edge2 = mHalfEdge[edge1]->getNext();
-    edge3 = mHalfEdge[edge2]->getNext();
-    point1 = getPoint( mHalfEdge[edge1]->getPoint() );
-    point2 = getPoint( mHalfEdge[edge2]->getPoint() );
-    point3 = getPoint( mHalfEdge[edge3]->getPoint() );
+    edge2 = mHalfEdge[edge1].getNext();
+    edge3 = mHalfEdge[edge2].getNext();
+    point1 = getPoint( mHalfEdge[edge1].getPoint() );
+    point2 = getPoint( mHalfEdge[edge2].getPoint() );
+    point3 = getPoint( mHalfEdge[edge3].getPoint() );
     if ( point1 && point2 && point3 )
     {
       //find out the closest edge to the point and swap this edge
@@ -3033,11 +3024,11 @@ QList<int>* DualEdgeTriangulation::getPointsAroundEdge( double x, double y )
     Point3D* point1;
     Point3D* point2;
     Point3D* point3;
-    edge2 = mHalfEdge[edge1]->getNext();
-    edge3 = mHalfEdge[edge2]->getNext();
-    point1 = getPoint( mHalfEdge[edge1]->getPoint() );
-    point2 = getPoint( mHalfEdge[edge2]->getPoint() );
-    point3 = getPoint( mHalfEdge[edge3]->getPoint() );
+    edge2 = mHalfEdge[edge1].getNext();
+    edge3 = mHalfEdge[edge2].getNext();
+    point1 = getPoint( mHalfEdge[edge1].getPoint() );
+    point2 = getPoint( mHalfEdge[edge2].getPoint() );
+    point3 = getPoint( mHalfEdge[edge3].getPoint() );
     if ( point1 && point2 && point3 )
     {
       double dist1, dist2, dist3;
@@ -3046,24 +3037,24 @@ QList<int>* DualEdgeTriangulation::getPointsAroundEdge( double x, double y )
       dist3 = MathUtils::distPointFromLine( &p, point2, point3 );
       if ( dist1 <= dist2 && dist1 <= dist3 )
       {
-        p1 = mHalfEdge[edge1]->getPoint();
-        p2 = mHalfEdge[mHalfEdge[edge1]->getNext()]->getPoint();
-        p3 = mHalfEdge[mHalfEdge[edge1]->getDual()]->getPoint();
-        p4 = mHalfEdge[mHalfEdge[mHalfEdge[edge1]->getDual()]->getNext()]->getPoint();
+        p1 = mHalfEdge[edge1].getPoint();
+        p2 = mHalfEdge[mHalfEdge[edge1].getNext()].getPoint();
+        p3 = mHalfEdge[mHalfEdge[edge1].getDual()].getPoint();
+        p4 = mHalfEdge[mHalfEdge[mHalfEdge[edge1].getDual()].getNext()].getPoint();
       }
       else if ( dist2 <= dist1 && dist2 <= dist3 )
       {
-        p1 = mHalfEdge[edge2]->getPoint();
-        p2 = mHalfEdge[mHalfEdge[edge2]->getNext()]->getPoint();
-        p3 = mHalfEdge[mHalfEdge[edge2]->getDual()]->getPoint();
-        p4 = mHalfEdge[mHalfEdge[mHalfEdge[edge2]->getDual()]->getNext()]->getPoint();
+        p1 = mHalfEdge[edge2].getPoint();
+        p2 = mHalfEdge[mHalfEdge[edge2].getNext()].getPoint();
+        p3 = mHalfEdge[mHalfEdge[edge2].getDual()].getPoint();
+        p4 = mHalfEdge[mHalfEdge[mHalfEdge[edge2].getDual()].getNext()].getPoint();
       }
       else if ( dist3 <= dist1 && dist3 <= dist2 )
       {
-        p1 = mHalfEdge[edge3]->getPoint();
-        p2 = mHalfEdge[mHalfEdge[edge3]->getNext()]->getPoint();
-        p3 = mHalfEdge[mHalfEdge[edge3]->getDual()]->getPoint();
-        p4 = mHalfEdge[mHalfEdge[mHalfEdge[edge3]->getDual()]->getNext()]->getPoint();
+        p1 = mHalfEdge[edge3].getPoint();
+        p2 = mHalfEdge[mHalfEdge[edge3].getNext()].getPoint();
+        p3 = mHalfEdge[mHalfEdge[edge3].getDual()].getPoint();
+        p4 = mHalfEdge[mHalfEdge[mHalfEdge[edge3].getDual()].getNext()].getPoint();
       }
       QList<int>* list = new QList<int>();
       list->append( p1 );
@@ -3127,14 +3118,14 @@ bool DualEdgeTriangulation::saveAsShapefile( const QString& fileName ) const
 
   for ( int i = 0; i < mHalfEdge.size(); ++i )
   {
-    HalfEdge* currentEdge = mHalfEdge[i];
-    if ( currentEdge->getPoint() != -1 && mHalfEdge[currentEdge->getDual()]->getPoint() != -1 && !alreadyVisitedEdges[currentEdge->getDual()] )
+    const HalfEdge& currentEdge = mHalfEdge[i];
+    if ( currentEdge.getPoint() != -1 && mHalfEdge[currentEdge.getDual()].getPoint() != -1 && !alreadyVisitedEdges[currentEdge.getDual()] )
     {
       QgsFeature edgeLineFeature;
 
       //geometry
-      Point3D* p1 = mPointVector[currentEdge->getPoint()];
-      Point3D* p2 = mPointVector[mHalfEdge[currentEdge->getDual()]->getPoint()];
+      Point3D* p1 = mPointVector[currentEdge.getPoint()];
+      Point3D* p2 = mPointVector[mHalfEdge[currentEdge.getDual()].getPoint()];
       QgsPolyline lineGeom;
       lineGeom.push_back( QgsPoint( p1->getX(), p1->getY() ) );
       lineGeom.push_back( QgsPoint( p2->getX(), p2->getY() ) );
@@ -3144,9 +3135,9 @@ bool DualEdgeTriangulation::saveAsShapefile( const QString& fileName ) const
 
       //attributes
       QString attributeString;
-      if ( currentEdge->getForced() )
+      if ( currentEdge.getForced() )
       {
-        if ( currentEdge->getBreak() )
+        if ( currentEdge.getBreak() )
         {
           attributeString = "break line";
         }
@@ -3169,10 +3160,10 @@ bool DualEdgeTriangulation::saveAsShapefile( const QString& fileName ) const
 
 double DualEdgeTriangulation::swapMinAngle( int edge ) const
 {
-  Point3D* p1 = getPoint( mHalfEdge[edge]->getPoint() );
-  Point3D* p2 = getPoint( mHalfEdge[mHalfEdge[edge]->getNext()]->getPoint() );
-  Point3D* p3 = getPoint( mHalfEdge[mHalfEdge[edge]->getDual()]->getPoint() );
-  Point3D* p4 = getPoint( mHalfEdge[mHalfEdge[mHalfEdge[edge]->getDual()]->getNext()]->getPoint() );
+  Point3D* p1 = getPoint( mHalfEdge[edge].getPoint() );
+  Point3D* p2 = getPoint( mHalfEdge[mHalfEdge[edge].getNext()].getPoint() );
+  Point3D* p3 = getPoint( mHalfEdge[mHalfEdge[edge].getDual()].getPoint() );
+  Point3D* p4 = getPoint( mHalfEdge[mHalfEdge[mHalfEdge[edge].getDual()].getNext()].getPoint() );
 
   //search for the minimum angle (it is important, which directions the lines have!)
   double minangle;
@@ -3216,7 +3207,7 @@ int DualEdgeTriangulation::splitHalfEdge( int edge, float position )
   }
 
   //create the new point on the heap
-  Point3D* p = new Point3D( mPointVector[mHalfEdge[edge]->getPoint()]->getX()*position + mPointVector[mHalfEdge[mHalfEdge[edge]->getDual()]->getPoint()]->getX()*( 1 - position ), mPointVector[mHalfEdge[edge]->getPoint()]->getY()*position + mPointVector[mHalfEdge[mHalfEdge[edge]->getDual()]->getPoint()]->getY()*( 1 - position ), 0 );
+  Point3D* p = new Point3D( mPointVector[mHalfEdge[edge].getPoint()]->getX()*position + mPointVector[mHalfEdge[mHalfEdge[edge].getDual()].getPoint()]->getX()*( 1 - position ), mPointVector[mHalfEdge[edge].getPoint()]->getY()*position + mPointVector[mHalfEdge[mHalfEdge[edge].getDual()].getPoint()]->getY()*( 1 - position ), 0 );
 
   //calculate the z-value of the point to insert
   Point3D zvaluepoint;
@@ -3232,30 +3223,30 @@ int DualEdgeTriangulation::splitHalfEdge( int edge, float position )
   mPointVector.insert( mPointVector.count(), p );
 
   //insert the six new halfedges
-  int dualedge = mHalfEdge[edge]->getDual();
+  int dualedge = mHalfEdge[edge].getDual();
   int edge1 = insertEdge( -10, -10, mPointVector.count() - 1, false, false );
-  int edge2 = insertEdge( edge1, mHalfEdge[mHalfEdge[edge]->getNext()]->getNext(), mHalfEdge[mHalfEdge[edge]->getNext()]->getPoint(), false, false );
-  int edge3 = insertEdge( -10, mHalfEdge[mHalfEdge[dualedge]->getNext()]->getNext(), mHalfEdge[mHalfEdge[dualedge]->getNext()]->getPoint(), false, false );
+  int edge2 = insertEdge( edge1, mHalfEdge[mHalfEdge[edge].getNext()].getNext(), mHalfEdge[mHalfEdge[edge].getNext()].getPoint(), false, false );
+  int edge3 = insertEdge( -10, mHalfEdge[mHalfEdge[dualedge].getNext()].getNext(), mHalfEdge[mHalfEdge[dualedge].getNext()].getPoint(), false, false );
   int edge4 = insertEdge( edge3, dualedge, mPointVector.count() - 1, false, false );
-  int edge5 = insertEdge( -10, mHalfEdge[edge]->getNext(), mHalfEdge[edge]->getPoint(), mHalfEdge[edge]->getBreak(), mHalfEdge[edge]->getForced() );
-  int edge6 = insertEdge( edge5, edge3, mPointVector.count() - 1, mHalfEdge[dualedge]->getBreak(), mHalfEdge[dualedge]->getForced() );
-  mHalfEdge[edge1]->setDual( edge2 );
-  mHalfEdge[edge1]->setNext( edge5 );
-  mHalfEdge[edge3]->setDual( edge4 );
-  mHalfEdge[edge5]->setDual( edge6 );
+  int edge5 = insertEdge( -10, mHalfEdge[edge].getNext(), mHalfEdge[edge].getPoint(), mHalfEdge[edge].getBreak(), mHalfEdge[edge].getForced() );
+  int edge6 = insertEdge( edge5, edge3, mPointVector.count() - 1, mHalfEdge[dualedge].getBreak(), mHalfEdge[dualedge].getForced() );
+  mHalfEdge[edge1].setDual( edge2 );
+  mHalfEdge[edge1].setNext( edge5 );
+  mHalfEdge[edge3].setDual( edge4 );
+  mHalfEdge[edge5].setDual( edge6 );
 
   //adjust the already existing halfedges
-  mHalfEdge[mHalfEdge[edge]->getNext()]->setNext( edge1 );
-  mHalfEdge[mHalfEdge[dualedge]->getNext()]->setNext( edge4 );
-  mHalfEdge[edge]->setNext( edge2 );
-  mHalfEdge[edge]->setPoint( mPointVector.count() - 1 );
-  mHalfEdge[mHalfEdge[edge3]->getNext()]->setNext( edge6 );
+  mHalfEdge[mHalfEdge[edge].getNext()].setNext( edge1 );
+  mHalfEdge[mHalfEdge[dualedge].getNext()].setNext( edge4 );
+  mHalfEdge[edge].setNext( edge2 );
+  mHalfEdge[edge].setPoint( mPointVector.count() - 1 );
+  mHalfEdge[mHalfEdge[edge3].getNext()].setNext( edge6 );
 
   //test four times recursively for swapping
-  checkSwap( mHalfEdge[edge5]->getNext(), 0 );
-  checkSwap( mHalfEdge[edge2]->getNext(), 0 );
-  checkSwap( mHalfEdge[dualedge]->getNext(), 0 );
-  checkSwap( mHalfEdge[edge3]->getNext(), 0 );
+  checkSwap( mHalfEdge[edge5].getNext(), 0 );
+  checkSwap( mHalfEdge[edge2].getNext(), 0 );
+  checkSwap( mHalfEdge[dualedge].getNext(), 0 );
+  checkSwap( mHalfEdge[edge3].getNext(), 0 );
 
   mDecorator->addPoint( new Point3D( p->getX(), p->getY(), 0 ) );//dirty hack to enforce update of decorators
 
@@ -3264,7 +3255,7 @@ int DualEdgeTriangulation::splitHalfEdge( int edge, float position )
 
 bool DualEdgeTriangulation::edgeOnConvexHull( int edge )
 {
-  return ( mHalfEdge[mHalfEdge[edge]->getNext()]->getPoint() == -1 || mHalfEdge[mHalfEdge[mHalfEdge[edge]->getDual()]->getNext()]->getPoint() == -1 );
+  return ( mHalfEdge[mHalfEdge[edge].getNext()].getPoint() == -1 || mHalfEdge[mHalfEdge[mHalfEdge[edge].getDual()].getNext()].getPoint() == -1 );
 }
 
 void DualEdgeTriangulation::evaluateInfluenceRegion( Point3D* point, int edge, QSet<int> &set )
@@ -3278,13 +3269,13 @@ void DualEdgeTriangulation::evaluateInfluenceRegion( Point3D* point, int edge, Q
     return;
   }
 
-  if ( !mHalfEdge[edge]->getForced() && !edgeOnConvexHull( edge ) )
+  if ( !mHalfEdge[edge].getForced() && !edgeOnConvexHull( edge ) )
   {
     //test, if point is in the circle through both endpoints of edge and the endpoint of edge->dual->next->point
-    if ( MathUtils::inCircle( point, mPointVector[mHalfEdge[mHalfEdge[edge]->getDual()]->getPoint()], mPointVector[mHalfEdge[edge]->getPoint()], mPointVector[mHalfEdge[mHalfEdge[edge]->getNext()]->getPoint()] ) )
+    if ( MathUtils::inCircle( point, mPointVector[mHalfEdge[mHalfEdge[edge].getDual()].getPoint()], mPointVector[mHalfEdge[edge].getPoint()], mPointVector[mHalfEdge[mHalfEdge[edge].getNext()].getPoint()] ) )
     {
-      evaluateInfluenceRegion( point, mHalfEdge[mHalfEdge[edge]->getDual()]->getNext(), set );
-      evaluateInfluenceRegion( point, mHalfEdge[mHalfEdge[mHalfEdge[edge]->getDual()]->getNext()]->getNext(), set );
+      evaluateInfluenceRegion( point, mHalfEdge[mHalfEdge[edge].getDual()].getNext(), set );
+      evaluateInfluenceRegion( point, mHalfEdge[mHalfEdge[mHalfEdge[edge].getDual()].getNext()].getNext(), set );
     }
   }
 }
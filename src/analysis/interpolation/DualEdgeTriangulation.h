@@ -117,8 +117,8 @@ class ANALYSIS_EXPORT DualEdgeTriangulation: public Triangulation
     QVector<Point3D*> mPointVector;
     /** Default value for the number of storable HalfEdges at the beginning*/
     const static unsigned int mDefaultStorageForHalfEdges = 300006;
-    /** Stores pointers to the HalfEdges*/
-    QVector<HalfEdge*> mHalfEdge;
+    /** Stores the HalfEdges, which refer to each other by their index in this vector*/
+    QVector<HalfEdge> mHalfEdge;
     /** Association to an interpolator object*/
     TriangleInterpolator* mTriangleInterpolator;
     /** Member to store the behaviour in case of crossing forced segments*/
@@ -230,14 +230,14 @@ inline Point3D* DualEdgeTriangulation::getPoint( unsigned int i ) const
 inline bool DualEdgeTriangulation::halfEdgeBBoxTest( int edge, double xlowleft, double ylowleft, double xupright, double yupright ) const
 {
   return (
-           ( getPoint( mHalfEdge[edge]->getPoint() )->getX() >= xlowleft &&
-             getPoint( mHalfEdge[edge]->getPoint() )->getX() <= xupright &&
-             getPoint( mHalfEdge[edge]->getPoint() )->getY() >= ylowleft &&
-             getPoint( mHalfEdge[edge]->getPoint() )->getY() <= yupright ) ||
-           ( getPoint( mHalfEdge[mHalfEdge[edge]->getDual()]->getPoint() )->getX() >= xlowleft &&
-             getPoint( mHalfEdge[mHalfEdge[edge]->getDual()]->getPoint() )->getX() <= xupright &&
-             getPoint( mHalfEdge[mHalfEdge[edge]->getDual()]->getPoint() )->getY() >= ylowleft &&
-             getPoint( mHalfEdge[mHalfEdge[edge]->getDual()]->getPoint() )->getY() <= yupright )
+           ( getPoint( mHalfEdge[edge].getPoint() )->getX() >= xlowleft &&
+             getPoint( mHalfEdge[edge].getPoint() )->getX() <= xupright &&
+             getPoint( mHalfEdge[edge].getPoint() )->getY() >= ylowleft &&
+             getPoint( mHalfEdge[edge].getPoint() )->getY() <= yupright ) ||
+           ( getPoint( mHalfEdge[mHalfEdge[edge].getDual()].getPoint() )->getX() >= xlowleft &&
+             getPoint( mHalfEdge[mHalfEdge[edge].getDual()].getPoint() )->getX() <= xupright &&
+             getPoint( mHalfEdge[mHalfEdge[edge].getDual()].getPoint() )->getY() >= ylowleft &&
+             getPoint( mHalfEdge[mHalfEdge[edge].getDual()].getPoint() )->getY() <= yupright )
          );
 }
 
@@ -17,6 +17,8 @@
 #ifndef HALFEDGE_H
 #define HALFEDGE_H
 
+#include <QtGlobal>
+
 /** \ingroup analysis
  * \class HalfEdge
  */
@@ -61,6 +63,9 @@ class ANALYSIS_EXPORT HalfEdge
     void setForced( bool f );
 };
 
+// half edges are stored by value, they can be moved in memory when the storage grows
+Q_DECLARE_TYPEINFO( HalfEdge, Q_MOVABLE_TYPE );
+
 inline HalfEdge::HalfEdge(): mDual( -10 ), mNext( -10 ), mPoint( -10 ), mBreak( false ), mForced( false )
 {
 
@@ -98,6 +98,13 @@ bool LinTriangleInterpolator::calcNormVec( double x, double y, Vector3D* vec )
 }
 
 
+void LinTriangleInterpolator::calcPlane( const Point3D& pt1, const Point3D& pt2, const Point3D& pt3, double& a, double& b, double& c )
+{
+  a = ( pt1.getZ() * ( pt2.getY() - pt3.getY() ) + pt2.getZ() * ( pt3.getY() - pt1.getY() ) + pt3.getZ() * ( pt1.getY() - pt2.getY() ) ) / (( pt1.getX() - pt2.getX() ) * ( pt2.getY() - pt3.getY() ) - ( pt2.getX() - pt3.getX() ) * ( pt1.getY() - pt2.getY() ) );
+  b = ( pt1.getZ() * ( pt2.getX() - pt3.getX() ) + pt2.getZ() * ( pt3.getX() - pt1.getX() ) + pt3.getZ() * ( pt1.getX() - pt2.getX() ) ) / (( pt1.getY() - pt2.getY() ) * ( pt2.getX() - pt3.getX() ) - ( pt2.getY() - pt3.getY() ) * ( pt1.getX() - pt2.getX() ) );
+  c = pt1.getZ() - a * pt1.getX() - b * pt1.getY();
+}
+
 bool LinTriangleInterpolator::calcPoint( double x, double y, Point3D* point )
 {
   if ( point && mTIN )
@@ -111,9 +118,8 @@ bool LinTriangleInterpolator::calcPoint( double x, double y, Point3D* point )
       return false;//point is outside the convex hull or numerical problems
     }
 
-    double a = ( pt1.getZ() * ( pt2.getY() - pt3.getY() ) + pt2.getZ() * ( pt3.getY() - pt1.getY() ) + pt3.getZ() * ( pt1.getY() - pt2.getY() ) ) / (( pt1.getX() - pt2.getX() ) * ( pt2.getY() - pt3.getY() ) - ( pt2.getX() - pt3.getX() ) * ( pt1.getY() - pt2.getY() ) );
-    double b = ( pt1.getZ() * ( pt2.getX() - pt3.getX() ) + pt2.getZ() * ( pt3.getX() - pt1.getX() ) + pt3.getZ() * ( pt1.getX() - pt2.getX() ) ) / (( pt1.getY() - pt2.getY() ) * ( pt2.getX() - pt3.getX() ) - ( pt2.getY() - pt3.getY() ) * ( pt1.getX() - pt2.getX() ) );
-    double c = pt1.getZ() - a * pt1.getX() - b * pt1.getY();
+    double a, b, c;
+    calcPlane( pt1, pt2, pt3, a, b, c );
 
     point->setX( x );
     point->setY( y );
@@ -39,6 +39,9 @@ class ANALYSIS_EXPORT LinTriangleInterpolator : public TriangleInterpolator
     virtual DualEdgeTriangulation* getTriangulation() const;
     /** Sets a Triangulation*/
     virtual void setTriangulation( DualEdgeTriangulation* tin );
+    /** Calculates the coefficients of the plane z = a * x + b * y + c through three points
+      @note added in QGIS 3.0*/
+    static void calcPlane( const Point3D& pt1, const Point3D& pt2, const Point3D& pt3, double& a, double& b, double& c );
 
 
   protected:
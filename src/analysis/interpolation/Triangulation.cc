@@ -13,5 +13,92 @@
  *                                                                         *
  ***************************************************************************/
 #include "Triangulation.h"
+#include "MathUtils.h"
+#include <QPair>
+#include <algorithm>
 
-//empty file (abstract class)
+//! Number of cells of the grid along each axis when ordering points along a Hilbert curve
+static const quint32 HILBERT_GRID_SIZE = 1 << 16;
+
+//! Distance along the Hilbert curve filling the grid of the cell x, y
+static quint32 hilbertDistance( quint32 x, quint32 y )
+{
+  quint32 d = 0;
+  for ( quint32 s = HILBERT_GRID_SIZE / 2; s > 0; s /= 2 )
+  {
+    quint32 rx = ( x & s ) > 0;
+    quint32 ry = ( y & s ) > 0;
+    d += s * s * (( 3 * rx ) ^ ry );
+    // rotate the quadrant
+    if ( ry == 0 )
+    {
+      if ( rx == 1 )
+      {
+        x = HILBERT_GRID_SIZE - 1 - x;
+        y = HILBERT_GRID_SIZE - 1 - y;
+      }
+      qSwap( x, y );
+    }
+  }
+  return d;
+}
+
+void Triangulation::addPoints( const QVector<Point3D*>& points )
+{
+  if ( points.isEmpty() )
+  {
+    return;
+  }
+
+  double xMin = points.at( 0 )->getX();
+  double xMax = xMin;
+  double yMin = points.at( 0 )->getY();
+  double yMax = yMin;
+  for ( int i = 1; i < points.size(); ++i )
+  {
+    xMin = qMin( xMin, points.at( i )->getX() );
+    xMax = qMax( xMax, points.at( i )->getX() );
+    yMin = qMin( yMin, points.at( i )->getY() );
+    yMax = qMax( yMax, points.at( i )->getY() );
+  }
+  double xScale = xMax > xMin ? ( HILBERT_GRID_SIZE - 1 ) / ( xMax - xMin ) : 0.0;
+  double yScale = yMax > yMin ? ( HILBERT_GRID_SIZE - 1 ) / ( yMax - yMin ) : 0.0;
+
+  QVector< QPair<quint32, int> > order( points.size() );
+  for ( int i = 0; i < points.size(); ++i )
+  {
+    quint32 x = static_cast< quint32 >(( points.at( i )->getX() - xMin ) * xScale );
+    quint32 y = static_cast< quint32 >(( points.at( i )->getY() - yMin ) * yScale );
+    order[i] = qMakePair( hilbertDistance( x, y ), i );
+  }
+  std::sort( order.begin(), order.end() );
+
+  if ( getNumberOfPoints() == 0 )
+  {
+    // the first three points of a triangulation must form a triangle, bring forward the first ones which do
+    int second = 1;
+    while ( second < order.size() && points.at( order.at( second ).second )->getX() == points.at( order.at( 0 ).second )->getX()
+            && points.at( order.at( second ).second )->getY() == points.at( order.at( 0 ).second )->getY() )
+    {
+      ++second;
+    }
+    if ( second < order.size() )
+    {
+      std::rotate( order.begin() + 1, order.begin() + second, order.begin() + second + 1 );
+      int third = 2;
+      while ( third < order.size() && qAbs( MathUtils::leftOf( points.at( order.at( third ).second ), points.at( order.at( 0 ).second ), points.at( order.at( 1 ).second ) ) ) <= 0.00000001 )
+      {
+        ++third;
+      }
+      if ( third < order.size() )
+      {
+        std::rotate( order.begin() + 2, order.begin() + third, order.begin() + third + 1 );
+      }
+    }
+  }
+
+  for ( int i = 0; i < order.size(); ++i )
+  {
+    addPoint( points.at( order.at( i ).second ) );
+  }
+}
@@ -18,6 +18,7 @@
 #define TRIANGULATION_H
 
 #include <QList>
+#include <QVector>
 #include <qpainter.h>
 #include <TriangleInterpolator.h>
 
@@ -49,6 +50,16 @@ class ANALYSIS_EXPORT Triangulation
      */
     virtual int addPoint( Point3D* p ) = 0;
 
+    /**
+     * Adds many points to the triangulation. The points are inserted with addPoint() along a
+     * Hilbert curve, so that consecutive points are close to each other and locating them in
+     * the triangulation is fast whatever the order of the input.
+     * Ownership is transferred to this class
+     * @note added in QGIS 3.0
+     * @note not available in Python bindings
+     */
+    virtual void addPoints( const QVector<Point3D*>& points );
+
     /**
      * Calculates the normal at a point on the surface and assigns it to 'result'.
      * @return true in case of success and false in case of failure
@@ -18,9 +18,81 @@
 #include "qgsgridfilewriter.h"
 #include "qgsinterpolator.h"
 #include "qgsvectorlayer.h"
+#include "gdal.h"
+#include "cpl_string.h"
 #include <QFile>
 #include <QFileInfo>
+#include <QFuture>
+#include <QList>
+#include <QPair>
 #include <QProgressDialog>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrentMap>
+#include <QtConcurrentRun>
+
+#if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 1800
+#define TO8F(x) (x).toUtf8().constData()
+#else
+#define TO8F(x) QFile::encodeName( x ).constData()
+#endif
+
+//! Maximum number of cells of the strips of rows interpolated and written at once with GDAL
+static const int MAX_STRIP_CELLS = 4 * 1024 * 1024;
+
+//! Interpolates whole rows of a grid into a buffer, for QtConcurrent::blockingMap
+class QgsGridRowJob
+{
+  public:
+    QgsGridRowJob( QgsInterpolator* interpolator, double xMin, double cellSizeX, int nCols, double* values, bool* valid )
+        : mInterpolator( interpolator )
+        , mXMin( xMin )
+        , mCellSizeX( cellSizeX )
+        , mNumColumns( nCols )
+        , mValues( values )
+        , mValid( valid )
+    {}
+
+    typedef void result_type;
+
+    //! Interpolates a row, the pair holds the row position in the buffer and the y value of the cell centers
+    void operator()( const QPair<int, double>& row )
+    {
+      //calculate values in the center of the cells
+      mInterpolator->interpolateRow( mXMin + mCellSizeX / 2.0, row.second, mCellSizeX, mNumColumns,
+                                     mValues + row.first * mNumColumns, mValid + row.first * mNumColumns );
+    }
+
+  private:
+    QgsInterpolator* mInterpolator;
+    double mXMin;
+    double mCellSizeX;
+    int mNumColumns;
+    double* mValues;
+    bool* mValid;
+};
+
+//! Interpolates rows, concurrently if the interpolator supports it
+static void interpolateRows( QList< QPair<int, double> >& rows, QgsGridRowJob& job, bool concurrent )
+{
+  if ( concurrent && rows.size() > 1 )
+  {
+    QtConcurrent::blockingMap( rows, job );
+  }
+  else
+  {
+    for ( int i = 0; i < rows.size(); ++i )
+    {
+      job( rows.at( i ) );
+    }
+  }
+}
+
+//! Writes a strip of rows to a raster band, runs while the next strip is interpolated
+static CPLErr writeStrip( GDALRasterBandH band, int firstRow, int nRows, int nCols, float* values )
+{
+  return GDALRasterIO( band, GF_Write, 0, firstRow, nCols, nRows, values, nCols, nRows, GDT_Float32, 0, 0 );
+}
 
 QgsGridFileWriter::QgsGridFileWriter( QgsInterpolator* i, const QString& outputPath, const QgsRectangle& extent, int nCols, int nRows, double cellSizeX, double cellSizeY )
     : mInterpolator( i )
@@ -46,6 +118,11 @@ QgsGridFileWriter::QgsGridFileWriter()
 
 int QgsGridFileWriter::writeFile( bool showProgressDialog )
 {
+  if ( !mOutputFormat.isEmpty() )
+  {
+    return writeGdalFile( showProgressDialog );
+  }
+
   QFile outputFile( mOutputFilePath );
 
   if ( !outputFile.open( QFile::WriteOnly ) )
@@ -59,13 +136,18 @@ int QgsGridFileWriter::writeFile( bool showProgressDialog )
     return 2;
   }
 
+  //without base data, every cell would be no data
+  if ( mInterpolator->prepare() != 0 )
+  {
+    outputFile.remove();
+    return 5;
+  }
+
   QTextStream outStream( &outputFile );
   outStream.setRealNumberPrecision( 8 );
   writeHeader( outStream );
 
   double currentYValue = mInterpolationExtent.yMaximum() - mCellSizeY / 2.0; //calculate value in the center of the cell
-  double currentXValue;
-  double interpolatedValue;
 
   QProgressDialog* progressDialog = nullptr;
   if ( showProgressDialog )
@@ -74,23 +156,40 @@ int QgsGridFileWriter::writeFile( bool showProgressDialog )
     progressDialog->setWindowModality( Qt::WindowModal );
   }
 
-  for ( int i = 0; i < mNumRows; ++i )
+  // rows are interpolated in blocks, concurrently if the interpolator allows it, and written in order
+  bool concurrent = mInterpolator->supportsConcurrentInterpolation() && QThread::idealThreadCount() > 1;
+  int blockRows = concurrent ? 4 * QThread::idealThreadCount() : 1;
+  QVector<double> values( blockRows * mNumColumns );
+  QVector<bool> valid( blockRows * mNumColumns );
+  QgsGridRowJob job( mInterpolator, mInterpolationExtent.xMinimum(), mCellSizeX, mNumColumns, values.data(), valid.data() );
+
+  for ( int i = 0; i < mNumRows; i += blockRows )
   {
-    currentXValue = mInterpolationExtent.xMinimum() + mCellSizeX / 2.0; //calculate value in the center of the cell
-    for ( int j = 0; j < mNumColumns; ++j )
+    int nBlockRows = qMin( blockRows, mNumRows - i );
+    QList< QPair<int, double> > rows;
+    for ( int k = 0; k < nBlockRows; ++k )
     {
-      if ( mInterpolator->interpolatePoint( currentXValue, currentYValue, interpolatedValue ) == 0 )
-      {
-        outStream << interpolatedValue << ' ';
-      }
-      else
+      rows << qMakePair( k, currentYValue );
+      currentYValue -= mCellSizeY;
+    }
+    interpolateRows( rows, job, concurrent );
+
+    for ( int k = 0; k < nBlockRows; ++k )
+    {
+      for ( int j = 0; j < mNumColumns; ++j )
       {
-        outStream << "-9999 ";
+        int cell = k * mNumColumns + j;
+        if ( valid.at( cell ) )
+        {
+          outStream << values.at( cell ) << ' ';
+        }
+        else
+        {
+          outStream << "-9999 ";
+        }
       }
-      currentXValue += mCellSizeX;
+      outStream << endl;
     }
-    outStream << endl;
-    currentYValue -= mCellSizeY;
 
     if ( showProgressDialog )
     {
@@ -99,20 +198,24 @@ int QgsGridFileWriter::writeFile( bool showProgressDialog )
         outputFile.remove();
         return 3;
       }
-      progressDialog->setValue( i );
+      progressDialog->setValue( i + nBlockRows - 1 );
     }
   }
 
-  // create prj file
-  QgsInterpolator::LayerData ld;
-  ld = mInterpolator->layerData().first();
-  QgsVectorLayer* vl = ld.vectorLayer;
+  // create prj file, the interpolator may have no layer to take the crs from
+  QgsVectorLayer* vl = mInterpolator->layerData().isEmpty() ? nullptr : mInterpolator->layerData().first().vectorLayer;
+  if ( !vl )
+  {
+    delete progressDialog;
+    return 0;
+  }
   QString crs = vl->crs().toWkt();
   QFileInfo fi( mOutputFilePath );
   QString fileName = fi.absolutePath() + '/' + fi.completeBaseName() + ".prj";
   QFile prjFile( fileName );
   if ( !prjFile.open( QFile::WriteOnly ) )
   {
+    delete progressDialog;
     return 1;
   }
   QTextStream prjStream( &prjFile );
@@ -124,6 +227,179 @@ int QgsGridFileWriter::writeFile( bool showProgressDialog )
   return 0;
 }
 
+int QgsGridFileWriter::writeGdalFile( bool showProgressDialog )
+{
+  if ( !mInterpolator )
+  {
+    return 2;
+  }
+
+  if ( mInterpolator->prepare() != 0 )
+  {
+    return 5;
+  }
+
+  GDALAllRegister();
+  GDALDriverH driver = GDALGetDriverByName( mOutputFormat.toLocal8Bit().data() );
+  if ( !driver )
+  {
+    return 4;
+  }
+
+  //drivers which cannot create a dataset row by row get a copy of a temporary GeoTIFF file
+  char** driverMetadata = GDALGetMetadata( driver, nullptr );
+  bool directCreate = CSLFetchBoolean( driverMetadata, GDAL_DCAP_CREATE, false );
+  if ( !directCreate && !CSLFetchBoolean( driverMetadata, GDAL_DCAP_CREATECOPY, false ) )
+  {
+    return 4;
+  }
+  GDALDriverH createDriver = directCreate ? driver : GDALGetDriverByName( "GTiff" );
+  QString createPath = directCreate ? mOutputFilePath : mOutputFilePath + ".tmp.tif";
+
+  char** options = nullptr;
+  Q_FOREACH ( const QString& option, mCreationOptions )
+  {
+    options = CSLAddString( options, option.toLocal8Bit().data() );
+  }
+  char** createOptions = nullptr;
+  if ( createDriver != driver || ( mCreationOptions.isEmpty() && mOutputFormat == "GTiff" ) )
+  {
+    createOptions = CSLSetNameValue( createOptions, "TILED", "YES" );
+    if ( createDriver == driver )
+    {
+      createOptions = CSLSetNameValue( createOptions, "COMPRESS", "DEFLATE" );
+    }
+  }
+  else
+  {
+    createOptions = CSLDuplicate( options );
+  }
+
+  GDALDatasetH dataset = GDALCreate( createDriver, TO8F( createPath ), mNumColumns, mNumRows, 1, GDT_Float32, createOptions );
+  CSLDestroy( createOptions );
+  if ( !dataset )
+  {
+    CSLDestroy( options );
+    return 1;
+  }
+
+  double geoTransform[6] = { mInterpolationExtent.xMinimum(), mCellSizeX, 0, mInterpolationExtent.yMaximum(), 0, -mCellSizeY };
+  GDALSetGeoTransform( dataset, geoTransform );
+  QgsVectorLayer* vl = mInterpolator->layerData().isEmpty() ? nullptr : mInterpolator->layerData().first().vectorLayer;
+  if ( vl )
+  {
+    GDALSetProjection( dataset, vl->crs().toWkt().toLocal8Bit().data() );
+  }
+  GDALRasterBandH band = GDALGetRasterBand( dataset, 1 );
+  GDALSetRasterNoDataValue( band, -9999 );
+
+  //strips are a multiple of the block height, so that blocks are written once and in full.
+  //Very wide grids still get strips of one block row.
+  int stripRows = qMax( 1, MAX_STRIP_CELLS / qMax( 1, mNumColumns ) );
+  int blockXSize = 0;
+  int blockYSize = 0;
+  GDALGetBlockSize( band, &blockXSize, &blockYSize );
+  if ( blockYSize > 0 )
+  {
+    stripRows = qMax( blockYSize, stripRows - stripRows % blockYSize );
+  }
+  stripRows = qMax( 1, qMin( stripRows, mNumRows ) );
+
+  QProgressDialog* progressDialog = nullptr;
+  if ( showProgressDialog )
+  {
+    progressDialog = new QProgressDialog( QObject::tr( "Interpolating..." ), QObject::tr( "Abort" ), 0, mNumRows, nullptr );
+    progressDialog->setWindowModality( Qt::WindowModal );
+  }
+
+  bool concurrent = mInterpolator->supportsConcurrentInterpolation() && QThread::idealThreadCount() > 1;
+  QVector<double> values( stripRows * mNumColumns );
+  QVector<bool> valid( stripRows * mNumColumns );
+  QgsGridRowJob job( mInterpolator, mInterpolationExtent.xMinimum(), mCellSizeX, mNumColumns, values.data(), valid.data() );
+
+  //a strip is written in the background while the next one is interpolated, each with its own buffer
+  QVector<float> writeBuffers[2];
+  writeBuffers[0].resize( stripRows * mNumColumns );
+  writeBuffers[1].resize( stripRows * mNumColumns );
+  QFuture<CPLErr> writeFuture;
+  bool writing = false;
+  bool writeError = false;
+  bool canceled = false;
+
+  double currentYValue = mInterpolationExtent.yMaximum() - mCellSizeY / 2.0; //calculate value in the center of the cell
+  for ( int i = 0, strip = 0; i < mNumRows; i += stripRows, ++strip )
+  {
+    int nStripRows = qMin( stripRows, mNumRows - i );
+    QList< QPair<int, double> > rows;
+    for ( int k = 0; k < nStripRows; ++k )
+    {
+      rows << qMakePair( k, currentYValue );
+      currentYValue -= mCellSizeY;
+    }
+    interpolateRows( rows, job, concurrent );
+
+    //the buffer was last written two strips ago, that write is finished
+    float* buffer = writeBuffers[ strip % 2 ].data();
+    for ( int cell = 0; cell < nStripRows * mNumColumns; ++cell )
+    {
+      buffer[cell] = valid.at( cell ) ? values.at( cell ) : -9999;
+    }
+
+    if ( writing && writeFuture.result() != CE_None )
+    {
+      writeError = true;
+      break;
+    }
+    writeFuture = QtConcurrent::run( writeStrip, band, i, nStripRows, mNumColumns, buffer );
+    writing = true;
+
+    if ( showProgressDialog )
+    {
+      progressDialog->setValue( i + nStripRows - 1 );
+      if ( progressDialog->wasCanceled() )
+      {
+        canceled = true;
+        break;
+      }
+    }
+  }
+  if ( writing && writeFuture.result() != CE_None )
+  {
+    writeError = true;
+  }
+  delete progressDialog;
+
+  if ( canceled || writeError )
+  {
+    CSLDestroy( options );
+    GDALClose( dataset );
+    GDALDeleteDataset( createDriver, TO8F( createPath ) );
+    return canceled ? 3 : 1;
+  }
+
+  int result = 0;
+  if ( !directCreate )
+  {
+    GDALDatasetH copy = GDALCreateCopy( driver, TO8F( mOutputFilePath ), dataset, false, options, nullptr, nullptr );
+    if ( copy )
+    {
+      GDALClose( copy );
+    }
+    else
+    {
+      result = 1;
+    }
+    GDALClose( dataset );
+    GDALDeleteDataset( createDriver, TO8F( createPath ) );
+  }
+  else
+  {
+    GDALClose( dataset );
+  }
+  CSLDestroy( options );
+  return result;
+}
+
 int QgsGridFileWriter::writeHeader( QTextStream& outStream )
 {
   outStream << "NCOLS " << mNumColumns << endl;
@@ -20,29 +20,59 @@
 
 #include "qgsrectangle.h"
 #include <QString>
+#include <QStringList>
 #include <QTextStream>
 
 class QgsInterpolator;
 
 /** \ingroup analysis
- * A class that does interpolation to a grid and writes the results to an ascii grid*/
-//todo: extend such that writing to other file types is possible
+ * A class that does interpolation to a grid and writes the results to an ascii grid
+ * or, if an output format is set, to any raster format supported by a GDAL driver*/
 class ANALYSIS_EXPORT QgsGridFileWriter
 {
   public:
     QgsGridFileWriter( QgsInterpolator* i, const QString& outputPath, const QgsRectangle& extent, int nCols, int nRows, double cellSizeX, double cellSizeY );
 
-    /** Writes the grid file.
+    /** Writes the grid file. Rows are interpolated concurrently if the interpolator supports it,
+     interpolators reimplemented in Python are then called from the worker threads, one at a time.
      @param showProgressDialog shows a dialog with the possibility to cancel
-    @return 0 in case of success*/
+    @return 0 in case of success, 5 if the interpolator cannot be prepared, e.g. if its base data cannot be read*/
 
     int writeFile( bool showProgressDialog = false );
 
+    /** Sets the short name of the GDAL driver used to write the grid, e.g. "GTiff".
+     * An empty name (the default) writes an ascii grid without GDAL.
+     * @note added in QGIS 3.0
+     */
+    void setOutputFormat( const QString& format ) { mOutputFormat = format; }
+
+    /** Returns the short name of the GDAL driver used to write the grid
+     * @note added in QGIS 3.0
+     */
+    QString outputFormat() const { return mOutputFormat; }
+
+    /** Sets the GDAL creation options, e.g. "COMPRESS=LZW". Without options,
+     * GeoTIFF files are written tiled and deflate compressed.
+     * @note added in QGIS 3.0
+     */
+    void setCreationOptions( const QStringList& options ) { mCreationOptions = options; }
+
+    /** Returns the GDAL creation options
+     * @note added in QGIS 3.0
+     */
+    QStringList creationOptions() const { return mCreationOptions; }
+
   private:
 
     QgsGridFileWriter(); //forbidden
     int writeHeader( QTextStream& outStream );
 
+    /** Writes the grid with the GDAL driver of mOutputFormat, in strips of whole blocks.
+     * A strip is written in the background while the next strip is interpolated.
+     * @return 0 in case of success, 4 if the driver does not exist or cannot create files,
+     * 5 if the interpolator cannot be prepared*/
+    int writeGdalFile( bool showProgressDialog );
+
     QgsInterpolator* mInterpolator;
     QString mOutputFilePath;
     QgsRectangle mInterpolationExtent;
@@ -51,6 +81,9 @@ class ANALYSIS_EXPORT QgsGridFileWriter
 
     double mCellSizeX;
     double mCellSizeY;
+
+    QString mOutputFormat;
+    QStringList mCreationOptions;
 };
 
 #endif
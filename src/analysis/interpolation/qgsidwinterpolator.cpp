@@ -16,15 +16,52 @@
  ***************************************************************************/
 
 #include "qgsidwinterpolator.h"
+#include <algorithm>
 #include <cmath>
 #include <limits>
 
-QgsIDWInterpolator::QgsIDWInterpolator( const QList<LayerData>& layerData ): QgsInterpolator( layerData ), mDistanceCoefficient( 2.0 )
+//! Largest distance coefficient for which the weights are computed by multiplications
+static const int MAX_INTEGER_POWER = 16;
+
+//! Orders indexes of cached vertices along one axis, for the kd-tree construction
+class QgsVertexAxisLess
+{
+  public:
+    QgsVertexAxisLess( const vertexData* vertices, int axis )
+        : mVertices( vertices )
+        , mAxis( axis )
+    {}
+
+    bool operator()( int a, int b ) const
+    {
+      return mAxis == 0 ? mVertices[a].x < mVertices[b].x : mVertices[a].y < mVertices[b].y;
+    }
+
+  private:
+    const vertexData* mVertices;
+    int mAxis;
+};
+
+QgsIDWInterpolator::QgsIDWInterpolator( const QList<LayerData>& layerData )
+    : QgsInterpolator( layerData )
+    , mDistanceCoefficient( 2.0 )
+    , mIntegerPower( 2 )
+    , mSearchRadius( 0.0 )
+    , mMaxPoints( 0 )
+    , mMinPoints( 0 )
+    , mTreeBuilt( false )
 {
 
 }
 
-QgsIDWInterpolator::QgsIDWInterpolator(): QgsInterpolator( QList<LayerData>() ), mDistanceCoefficient( 2.0 )
+QgsIDWInterpolator::QgsIDWInterpolator()
+    : QgsInterpolator( QList<LayerData>() )
+    , mDistanceCoefficient( 2.0 )
+    , mIntegerPower( 2 )
+    , mSearchRadius( 0.0 )
+    , mMaxPoints( 0 )
+    , mMinPoints( 0 )
+    , mTreeBuilt( false )
 {
 
 }
@@ -34,30 +71,213 @@ QgsIDWInterpolator::~QgsIDWInterpolator()
 
 }
 
-int QgsIDWInterpolator::interpolatePoint( double x, double y, double& result )
+void QgsIDWInterpolator::setDistanceCoefficient( double p )
+{
+  mDistanceCoefficient = p;
+  mIntegerPower = ( p >= 0 && p <= MAX_INTEGER_POWER && p == std::floor( p ) ) ? static_cast< int >( p ) : -1;
+}
+
+int QgsIDWInterpolator::prepare()
 {
+  int result = 0;
   if ( !mDataIsCached )
   {
-    cacheBaseData();
+    result = cacheBaseData();
+  }
+
+  if ( !mTreeBuilt )
+  {
+    int n = mCachedBaseData.size();
+    mTreeSourceIndex.resize( n );
+    for ( int i = 0; i < n; ++i )
+    {
+      mTreeSourceIndex[i] = i;
+    }
+    mTreeAxis.fill( 0, n );
+    buildTree( 0, n );
+
+    mTreeVertices.resize( n );
+    for ( int i = 0; i < n; ++i )
+    {
+      mTreeVertices[i] = mCachedBaseData.at( mTreeSourceIndex.at( i ) );
+    }
+    mTreeBuilt = true;
+  }
+  return result;
+}
+
+void QgsIDWInterpolator::buildTree( int begin, int end )
+{
+  if ( end - begin < 2 )
+  {
+    return;
+  }
+
+  // split along the axis with the largest spread
+  const vertexData* vertices = mCachedBaseData.constData();
+  int* indexes = mTreeSourceIndex.data();
+  double xMin = std::numeric_limits<double>::max();
+  double xMax = -std::numeric_limits<double>::max();
+  double yMin = xMin;
+  double yMax = xMax;
+  for ( int i = begin; i < end; ++i )
+  {
+    const vertexData& v = vertices[ indexes[i] ];
+    xMin = qMin( xMin, v.x );
+    xMax = qMax( xMax, v.x );
+    yMin = qMin( yMin, v.y );
+    yMax = qMax( yMax, v.y );
+  }
+  int axis = ( xMax - xMin >= yMax - yMin ) ? 0 : 1;
+
+  int mid = begin + ( end - begin ) / 2;
+  std::nth_element( indexes + begin, indexes + mid, indexes + end, QgsVertexAxisLess( vertices, axis ) );
+  mTreeAxis[mid] = axis;
+
+  buildTree( begin, mid );
+  buildTree( mid + 1, end );
+}
+
+void QgsIDWInterpolator::searchTree( int begin, int end, double x, double y, double& sqrBound, QVector< QPair<double, int> >& neighbors ) const
+{
+  if ( begin >= end )
+  {
+    return;
+  }
+
+  int mid = begin + ( end - begin ) / 2;
+  const vertexData& v = mTreeVertices.at( mid );
+  double dx = x - v.x;
+  double dy = y - v.y;
+  double sqrDist = dx * dx + dy * dy;
+  if ( sqrDist <= sqrBound )
+  {
+    QPair<double, int> candidate( sqrDist, mTreeSourceIndex.at( mid ) );
+    if ( mMaxPoints <= 0 )
+    {
+      neighbors << candidate;
+    }
+    else if ( neighbors.size() < mMaxPoints )
+    {
+      neighbors << candidate;
+      std::push_heap( neighbors.begin(), neighbors.end() );
+      if ( neighbors.size() == mMaxPoints )
+      {
+        sqrBound = neighbors.front().first;
+      }
+    }
+    else if ( candidate < neighbors.front() )
+    {
+      // ties are resolved by the index in the base data, the results do not depend on the tree
+      std::pop_heap( neighbors.begin(), neighbors.end() );
+      neighbors.back() = candidate;
+      std::push_heap( neighbors.begin(), neighbors.end() );
+      sqrBound = neighbors.front().first;
+    }
+  }
+
+  double diff = mTreeAxis.at( mid ) == 0 ? dx : dy;
+  if ( diff < 0 )
+  {
+    searchTree( begin, mid, x, y, sqrBound, neighbors );
+    if ( diff * diff <= sqrBound )
+    {
+      searchTree( mid + 1, end, x, y, sqrBound, neighbors );
+    }
+  }
+  else
+  {
+    searchTree( mid + 1, end, x, y, sqrBound, neighbors );
+    if ( diff * diff <= sqrBound )
+    {
+      searchTree( begin, mid, x, y, sqrBound, neighbors );
+    }
+  }
+}
+
+double QgsIDWInterpolator::weight( double sqrDist ) const
+{
+  if ( mIntegerPower < 0 )
+  {
+    return 1 / ( pow( sqrt( sqrDist ), mDistanceCoefficient ) );
+  }
+
+  double denominator = ( mIntegerPower % 2 ) ? sqrt( sqrDist ) : 1.0;
+  for ( int i = 1; i < mIntegerPower; i += 2 )
+  {
+    denominator *= sqrDist;
+  }
+  return 1 / denominator;
+}
+
+int QgsIDWInterpolator::interpolatePoint( double x, double y, double& result )
+{
+  if ( !mTreeBuilt )
+  {
+    prepare();
   }
 
   double currentWeight;
-  double distance;
+  double sqrDist;
 
   double sumCounter = 0;
   double sumDenominator = 0;
 
-  Q_FOREACH ( const vertexData& vertex_it, mCachedBaseData )
+  if ( mSearchRadius <= 0 && mMaxPoints <= 0 )
+  {
+    if ( mCachedBaseData.size() < mMinPoints )
+    {
+      return 1;
+    }
+
+    Q_FOREACH ( const vertexData& vertex_it, mCachedBaseData )
+    {
+      sqrDist = ( vertex_it.x - x ) * ( vertex_it.x - x ) + ( vertex_it.y - y ) * ( vertex_it.y - y );
+      if ( sqrDist <= 0.0 )
+      {
+        result = vertex_it.z;
+        return 0;
+      }
+      currentWeight = weight( sqrDist );
+      sumCounter += ( currentWeight * vertex_it.z );
+      sumDenominator += currentWeight;
+    }
+  }
+  else
   {
-    distance = sqrt(( vertex_it.x - x ) * ( vertex_it.x - x ) + ( vertex_it.y - y ) * ( vertex_it.y - y ) );
-    if (( distance - 0 ) < std::numeric_limits<double>::min() )
+    QVector< QPair<double, int> > neighbors;
+    if ( mMaxPoints > 0 )
     {
-      result = vertex_it.z;
+      neighbors.reserve( mMaxPoints );
+    }
+    double sqrBound = mSearchRadius > 0 ? mSearchRadius * mSearchRadius : std::numeric_limits<double>::infinity();
+    searchTree( 0, mTreeVertices.size(), x, y, sqrBound, neighbors );
+    if ( neighbors.size() < mMinPoints )
+    {
+      return 1;
+    }
+
+    // as without search, the first vertex of the base data at the interpolated point gives the value
+    int hit = -1;
+    for ( int i = 0; i < neighbors.size(); ++i )
+    {
+      if ( neighbors.at( i ).first <= 0.0 && ( hit < 0 || neighbors.at( i ).second < hit ) )
+      {
+        hit = neighbors.at( i ).second;
+      }
+    }
+    if ( hit >= 0 )
+    {
+      result = mCachedBaseData.at( hit ).z;
       return 0;
     }
-    currentWeight = 1 / ( pow( distance, mDistanceCoefficient ) );
-    sumCounter += ( currentWeight * vertex_it.z );
-    sumDenominator += currentWeight;
+
+    for ( int i = 0; i < neighbors.size(); ++i )
+    {
+      currentWeight = weight( neighbors.at( i ).first );
+      sumCounter += ( currentWeight * mCachedBaseData.at( neighbors.at( i ).second ).z );
+      sumDenominator += currentWeight;
+    }
   }
 
   if ( sumDenominator == 0.0 )
@@ -19,9 +19,14 @@
 #define QGSIDWINTERPOLATOR_H
 
 #include "qgsinterpolator.h"
+#include <QPair>
 
 /** \ingroup analysis
  * \class QgsIDWInterpolator
+ * Inverse distance weighting. By default, all the vertices of the base data
+ * contribute to each interpolated value. A search radius and a maximum number
+ * of points restrict the interpolation to the nearest vertices, which are found
+ * with a kd-tree built over the base data.
  */
 class ANALYSIS_EXPORT QgsIDWInterpolator: public QgsInterpolator
 {
@@ -36,16 +41,73 @@ class ANALYSIS_EXPORT QgsIDWInterpolator: public QgsInterpolator
        @return 0 in case of success*/
     int interpolatePoint( double x, double y, double& result ) override;
 
-    void setDistanceCoefficient( double p ) {mDistanceCoefficient = p;}
+    /** Caches the base data and builds the kd-tree used by the searches
+      @return 0 in case of success
+      @note added in QGIS 3.0*/
+    int prepare() override;
+
+    bool supportsConcurrentInterpolation() const override { return true; }
+
+    void setDistanceCoefficient( double p );
+
+    /** Sets the radius around an interpolated point in which vertices are used.
+      A value of 0 (the default) or less means that there is no search radius.
+      @note added in QGIS 3.0*/
+    void setSearchRadius( double radius ) { mSearchRadius = radius; }
+    /** Returns the search radius, see setSearchRadius()
+      @note added in QGIS 3.0*/
+    double searchRadius() const { return mSearchRadius; }
+
+    /** Sets the maximum number of vertices used for an interpolated point, the nearest ones are used.
+      A value of 0 (the default) means that there is no limit.
+      @note added in QGIS 3.0*/
+    void setMaxPoints( int maxPoints ) { mMaxPoints = maxPoints; }
+    /** Returns the maximum number of vertices used for an interpolated point, see setMaxPoints()
+      @note added in QGIS 3.0*/
+    int maxPoints() const { return mMaxPoints; }
+
+    /** Sets the minimum number of vertices required for an interpolated point. If fewer
+      vertices are found, interpolatePoint() fails. The default is 0.
+      @note added in QGIS 3.0*/
+    void setMinPoints( int minPoints ) { mMinPoints = minPoints; }
+    /** Returns the minimum number of vertices required for an interpolated point, see setMinPoints()
+      @note added in QGIS 3.0*/
+    int minPoints() const { return mMinPoints; }
 
   private:
 
     QgsIDWInterpolator(); //forbidden
 
+    /** Weight of a vertex at the squared distance sqrDist*/
+    double weight( double sqrDist ) const;
+
+    /** Sorts the vertices in [begin, end) of the tree arrays into a kd-tree*/
+    void buildTree( int begin, int end );
+
+    /** Collects the tree vertices of [begin, end) within the squared search bound as pairs of
+      squared distance and index in mCachedBaseData. If there is a maximum number of points,
+      neighbors is a max-heap and the bound shrinks once it is full*/
+    void searchTree( int begin, int end, double x, double y, double& sqrBound, QVector< QPair<double, int> >& neighbors ) const;
+
     /** The parameter that sets how the values are weighted with distance.
        Smaller values mean sharper peaks at the data points. The default is a
        value of 2*/
     double mDistanceCoefficient;
+    /** The distance coefficient if it is a small non negative integer, the weights
+      are then computed without pow(). -1 otherwise*/
+    int mIntegerPower;
+
+    double mSearchRadius;
+    int mMaxPoints;
+    int mMinPoints;
+
+    bool mTreeBuilt;
+    /** Base data in kd-tree order, the splitting vertex of a range is in its middle*/
+    QVector<vertexData> mTreeVertices;
+    /** Index in mCachedBaseData of each tree vertex*/
+    QVector<int> mTreeSourceIndex;
+    /** Split axis of the range with its splitting vertex at this index, 0 for x and 1 for y*/
+    QVector<unsigned char> mTreeAxis;
 };
 
 #endif
@@ -40,6 +40,15 @@ QgsInterpolator::~QgsInterpolator()
 
 }
 
+void QgsInterpolator::interpolateRow( double x, double y, double dx, int count, double* results, bool* valid )
+{
+  for ( int i = 0; i < count; ++i )
+  {
+    valid[i] = interpolatePoint( x, y, results[i] ) == 0;
+    x += dx;
+  }
+}
+
 int QgsInterpolator::cacheBaseData()
 {
   if ( mLayerData.size() < 1 )
@@ -65,6 +65,29 @@ class ANALYSIS_EXPORT QgsInterpolator
        @return 0 in case of success*/
     virtual int interpolatePoint( double x, double y, double& result ) = 0;
 
+    /** Calculates interpolation values for a row of points with the same y-coordinate. The
+       default implementation calls interpolatePoint() for each point.
+       @param x x-coordinate of the first point (in map units)
+       @param y y-coordinate of the row (in map units)
+       @param dx distance between two consecutive points (in map units)
+       @param count number of points
+       @param results out: count interpolation results
+       @param valid out: for each point, true in case of success
+       @note added in QGIS 3.0
+       @note not available in Python bindings*/
+    virtual void interpolateRow( double x, double y, double dx, int count, double* results, bool* valid );
+
+    /** Caches the base data and builds the structures used by interpolatePoint(). This is
+     otherwise done on the first call to interpolatePoint().
+    @return 0 in case of success
+    @note added in QGIS 3.0*/
+    virtual int prepare() { return 0; }
+
+    /** Returns true if interpolatePoint() may be called from several threads at once, once
+     prepare() has been called. The default implementation returns false.
+    @note added in QGIS 3.0*/
+    virtual bool supportsConcurrentInterpolation() const { return false; }
+
     //! @note not available in Python bindings
     const QList<LayerData>& layerData() const { return mLayerData; }
 
@@ -22,6 +22,7 @@
 #include "NormVecDecorator.h"
 #include "LinTriangleInterpolator.h"
 #include "Line3D.h"
+#include "MathUtils.h"
 #include "Point3D.h"
 #include "qgsfeature.h"
 #include "qgsgeometry.h"
@@ -67,6 +68,67 @@ int QgsTINInterpolator::interpolatePoint( double x, double y, double& result )
   return 0;
 }
 
+void QgsTINInterpolator::interpolateRow( double x, double y, double dx, int count, double* results, bool* valid )
+{
+  if ( !mIsInitialized )
+  {
+    initialize();
+  }
+
+  if ( mInterpolation != Linear || !mTriangleInterpolator )
+  {
+    QgsInterpolator::interpolateRow( x, y, dx, count, results, valid );
+    return;
+  }
+
+  //plane of LinTriangleInterpolator::calcPoint, computed once per triangle
+  Point3D pt1( 0, 0, 0 );
+  Point3D pt2( 0, 0, 0 );
+  Point3D pt3( 0, 0, 0 );
+  double a = 0, b = 0, c = 0;
+  bool hasTriangle = false;
+  Point3D point( x, y, 0 );
+  for ( int i = 0; i < count; ++i )
+  {
+    point.setX( x );
+    //strictly inside the previous triangle, locating the point would find that triangle again
+    if ( !hasTriangle || MathUtils::leftOf( &point, &pt3, &pt1 ) >= -0.00000001
+         || MathUtils::leftOf( &point, &pt1, &pt2 ) >= -0.00000001 || MathUtils::leftOf( &point, &pt2, &pt3 ) >= -0.00000001 )
+    {
+      hasTriangle = mTriangulation->getTriangle( x, y, &pt1, &pt2, &pt3 );
+      if ( hasTriangle )
+      {
+        LinTriangleInterpolator::calcPlane( pt1, pt2, pt3, a, b, c );
+      }
+    }
+
+    valid[i] = hasTriangle;
+    if ( hasTriangle )
+    {
+      results[i] = a * x + b * y + c;
+    }
+    x += dx;
+  }
+}
+
+int QgsTINInterpolator::prepare()
+{
+  if ( !mIsInitialized )
+  {
+    initialize();
+  }
+  return mTriangleInterpolator ? 0 : 1;
+}
+
+void QgsTINInterpolator::addPendingPoints()
+{
+  if ( !mPendingPoints.isEmpty() )
+  {
+    mTriangulation->addPoints( mPendingPoints );
+    mPendingPoints.clear();
+  }
+}
+
 void QgsTINInterpolator::initialize()
 {
   DualEdgeTriangulation* theDualEdgeTriangulation = new DualEdgeTriangulation( 100000, nullptr );
@@ -132,6 +194,7 @@ void QgsTINInterpolator::initialize()
     }
   }
 
+  addPendingPoints();
   delete theProgressDialog;
 
   if ( mInterpolation == CloughTocher )
@@ -223,11 +286,7 @@ int QgsTINInterpolator::insertData( QgsFeature* f, bool zCoord, int attr, InputT
       {
         z = attributeValue;
       }
-      Point3D* thePoint = new Point3D( x, y, z );
-      if ( mTriangulation->addPoint( thePoint ) == -100 )
-      {
-        return -1;
-      }
+      mPendingPoints << new Point3D( x, y, z );
       break;
     }
     case QGis::WKBMultiPoint25D:
@@ -277,8 +336,7 @@ int QgsTINInterpolator::insertData( QgsFeature* f, bool zCoord, int attr, InputT
 
         if ( type == POINTS )
         {
-          //todo: handle error code -100
-          mTriangulation->addPoint( new Point3D( x, y, z ) );
+          mPendingPoints << new Point3D( x, y, z );
         }
         else
         {
@@ -288,6 +346,7 @@ int QgsTINInterpolator::insertData( QgsFeature* f, bool zCoord, int attr, InputT
 
       if ( type != POINTS )
       {
+        addPendingPoints();
         mTriangulation->addLine( line, type == BREAK_LINES );
       }
       break;
@@ -321,8 +380,7 @@ int QgsTINInterpolator::insertData( QgsFeature* f, bool zCoord, int attr, InputT
 
           if ( type == POINTS )
           {
-            //todo: handle error code -100
-            mTriangulation->addPoint( new Point3D( x, y, z ) );
+            mPendingPoints << new Point3D( x, y, z );
           }
           else
           {
@@ -331,6 +389,7 @@ int QgsTINInterpolator::insertData( QgsFeature* f, bool zCoord, int attr, InputT
         }
         if ( type != POINTS )
         {
+          addPendingPoints();
           mTriangulation->addLine( line, type == BREAK_LINES );
         }
       }
@@ -365,8 +424,7 @@ int QgsTINInterpolator::insertData( QgsFeature* f, bool zCoord, int attr, InputT
           }
           if ( type == POINTS )
           {
-            //todo: handle error code -100
-            mTriangulation->addPoint( new Point3D( x, y, z ) );
+            mPendingPoints << new Point3D( x, y, z );
           }
           else
           {
@@ -376,6 +434,7 @@ int QgsTINInterpolator::insertData( QgsFeature* f, bool zCoord, int attr, InputT
 
         if ( type != POINTS )
         {
+          addPendingPoints();
           mTriangulation->addLine( line, type == BREAK_LINES );
         }
       }
@@ -415,8 +474,7 @@ int QgsTINInterpolator::insertData( QgsFeature* f, bool zCoord, int attr, InputT
             }
             if ( type == POINTS )
             {
-              //todo: handle error code -100
-              mTriangulation->addPoint( new Point3D( x, y, z ) );
+              mPendingPoints << new Point3D( x, y, z );
             }
             else
             {
@@ -425,6 +483,7 @@ int QgsTINInterpolator::insertData( QgsFeature* f, bool zCoord, int attr, InputT
           }
           if ( type != POINTS )
           {
+            addPendingPoints();
             mTriangulation->addLine( line, type == BREAK_LINES );
           }
         }
@@ -21,6 +21,7 @@
 #include "qgsinterpolator.h"
 #include <QString>
 
+class Point3D;
 class Triangulation;
 class TriangleInterpolator;
 class QgsFeature;
@@ -46,6 +47,18 @@ class ANALYSIS_EXPORT QgsTINInterpolator: public QgsInterpolator
        @return 0 in case of success*/
     int interpolatePoint( double x, double y, double& result ) override;
 
+    /** Calculates interpolation values for a row of points. With linear interpolation, the plane
+      of a triangle is reused for the following points of the row as long as they are inside it.
+      The vertices of the triangle may then be in another order than when the point is located
+      by interpolatePoint(), so values agree with interpolatePoint() up to floating point rounding.
+      @note added in QGIS 3.0
+      @note not available in Python bindings*/
+    void interpolateRow( double x, double y, double dx, int count, double* results, bool* valid ) override;
+
+    /** Builds the triangulation, this is otherwise done on the first interpolation
+      @note added in QGIS 3.0*/
+    int prepare() override;
+
     void setExportTriangulationToFile( bool e ) {mExportTriangulationToFile = e;}
     void setTriangulationFilePath( const QString& filepath ) {mTriangulationFilePath = filepath;}
 
@@ -60,6 +73,8 @@ class ANALYSIS_EXPORT QgsTINInterpolator: public QgsInterpolator
     QString mTriangulationFilePath;
     /** Type of interpolation*/
     TIN_INTERPOLATION mInterpolation;
+    /** Points read from the input layers and not yet added to the triangulation*/
+    QVector<Point3D*> mPendingPoints;
 
     /** Create dual edge triangulation*/
     void initialize();
@@ -68,8 +83,10 @@ class ANALYSIS_EXPORT QgsTINInterpolator: public QgsInterpolator
       @param zCoord true if the z coordinate is the interpolation attribute
       @param attr interpolation attribute index (if zCoord is false)
       @param type point/structure line, break line
-      @return 0 in case of success, -1 if the feature could not be inserted because of numerical problems*/
+      @return 0 in case of success*/
     int insertData( QgsFeature* f, bool zCoord, int attr, InputType type );
+    /** Adds the pending points to the triangulation at once*/
+    void addPendingPoints();
 };
 
 #endif
@@ -0,0 +1,75 @@
+/***************************************************************************
+  qgscompactgraph.cpp
+  --------------------------------------
+  Date                 : October 2016
+  Copyright            : (C) 2016 by the QGIS project
+****************************************************************************
+*                                                                          *
+*   This program is free software; you can redistribute it and/or modify   *
+*   it under the terms of the GNU General Public License as published by   *
+*   the Free Software Foundation; either version 2 of the License, or      *
+*   (at your option) any later version.                                    *
+*                                                                          *
+***************************************************************************/
+
+#include "qgscompactgraph.h"
+#include "qgsgraph.h"
+
+QgsCompactGraph::QgsCompactGraph( const QgsGraph* graph )
+{
+  int vertexCount = graph->vertexCount();
+  int arcCount = graph->arcCount();
+
+  mPoints.resize( vertexCount );
+  for ( int i = 0; i < vertexCount; ++i )
+  {
+    mPoints[i] = graph->vertex( i ).point();
+  }
+
+  // count arcs per vertex, then turn the counts into offsets
+  mOutArcOffsets.fill( 0, vertexCount + 1 );
+  mInArcOffsets.fill( 0, vertexCount + 1 );
+  int criterionCount = 0;
+  for ( int i = 0; i < arcCount; ++i )
+  {
+    const QgsGraphArc& arc = graph->arc( i );
+    ++mOutArcOffsets[ arc.outVertex() + 1 ];
+    ++mInArcOffsets[ arc.inVertex() + 1 ];
+    criterionCount = qMax( criterionCount, arc.properties().size() );
+  }
+  for ( int i = 0; i < vertexCount; ++i )
+  {
+    mOutArcOffsets[ i + 1 ] += mOutArcOffsets[ i ];
+    mInArcOffsets[ i + 1 ] += mInArcOffsets[ i ];
+  }
+
+  mOutArcTarget.resize( arcCount );
+  mOutArcId.resize( arcCount );
+  mInArcSource.resize( arcCount );
+  mInArcId.resize( arcCount );
+  mOutCosts.fill( QVector<double>( arcCount, 0.0 ), criterionCount );
+  mInCosts.fill( QVector<double>( arcCount, 0.0 ), criterionCount );
+
+  // arcs are visited in index order, so the slots of a vertex keep the order of QgsGraphVertex::outArc()
+  QVector<int> outNext = mOutArcOffsets;
+  QVector<int> inNext = mInArcOffsets;
+  for ( int i = 0; i < arcCount; ++i )
+  {
+    const QgsGraphArc& arc = graph->arc( i );
+    int outSlot = outNext[ arc.outVertex()]++;
+    int inSlot = inNext[ arc.inVertex()]++;
+
+    mOutArcTarget[ outSlot ] = arc.inVertex();
+    mOutArcId[ outSlot ] = i;
+    mInArcSource[ inSlot ] = arc.outVertex();
+    mInArcId[ inSlot ] = i;
+
+    QVector< QVariant > properties = arc.properties();
+    for ( int c = 0; c < properties.size(); ++c )
+    {
+      double cost = properties.at( c ).toDouble();
+      mOutCosts[c][ outSlot ] = cost;
+      mInCosts[c][ inSlot ] = cost;
+    }
+  }
+}
@@ -0,0 +1,152 @@
+/***************************************************************************
+  qgscompactgraph.h
+  --------------------------------------
+  Date                 : October 2016
+  Copyright            : (C) 2016 by the QGIS project
+****************************************************************************
+*                                                                          *
+*   This program is free software; you can redistribute it and/or modify   *
+*   it under the terms of the GNU General Public License as published by   *
+*   the Free Software Foundation; either version 2 of the License, or      *
+*   (at your option) any later version.                                    *
+*                                                                          *
+***************************************************************************/
+
+#ifndef QGSCOMPACTGRAPHH
+#define QGSCOMPACTGRAPHH
+
+// QT4 includes
+#include <QVector>
+
+// QGIS includes
+#include "qgspoint.h"
+
+class QgsGraph;
+
+/**
+ * \ingroup networkanalysis
+ * \class QgsCompactGraph
+ * \brief Read only, compressed sparse row representation of a QgsGraph
+ *
+ * Outgoing and incoming arcs of all vertices are stored in contiguous arrays,
+ * indexed by arc slots. The slots of a vertex are in the range
+ * [ outArcBegin( vertex ), outArcEnd( vertex ) ) for outgoing arcs and
+ * [ inArcBegin( vertex ), inArcEnd( vertex ) ) for incoming arcs. Arc properties
+ * are converted once to arrays of doubles, one per criterion, so that searching
+ * the graph does not copy arcs or convert variants.
+ *
+ * Vertex indexes are the same as in the source graph, arc slots are mapped
+ * back to arc indexes of the source graph with outArcId() and inArcId().
+ *
+ * @note added in QGIS 3.0
+ */
+class ANALYSIS_EXPORT QgsCompactGraph
+{
+  public:
+    /**
+     * Builds the compact form of a graph. Later changes to the graph are not reflected.
+     * @param graph source graph
+     */
+    explicit QgsCompactGraph( const QgsGraph* graph );
+
+    /**
+     * return vertex count
+     */
+    int vertexCount() const { return mPoints.size(); }
+
+    /**
+     * return arc count
+     */
+    int arcCount() const { return mOutArcTarget.size(); }
+
+    /**
+     * return number of criteria (arc properties) converted to costs
+     */
+    int criterionCount() const { return mOutCosts.size(); }
+
+    /**
+     * return vertex point
+     */
+    QgsPoint point( int vertexIdx ) const { return mPoints.at( vertexIdx ); }
+
+    /**
+     * return first outgoing arc slot of a vertex
+     */
+    int outArcBegin( int vertexIdx ) const { return mOutArcOffsets.at( vertexIdx ); }
+
+    /**
+     * return one past the last outgoing arc slot of a vertex
+     */
+    int outArcEnd( int vertexIdx ) const { return mOutArcOffsets.at( vertexIdx + 1 ); }
+
+    /**
+     * return incoming vertex of an outgoing arc slot
+     */
+    int outArcTarget( int slot ) const { return mOutArcTarget.at( slot ); }
+
+    /**
+     * return index in the source graph of an outgoing arc slot
+     */
+    int outArcId( int slot ) const { return mOutArcId.at( slot ); }
+
+    /**
+     * return cost of an outgoing arc slot
+     * @param criterionNum index of arc property
+     * @param slot outgoing arc slot
+     */
+    double outArcCost( int criterionNum, int slot ) const { return mOutCosts.at( criterionNum ).at( slot ); }
+
+    /**
+     * return costs of all outgoing arc slots, for a criterion
+     */
+    const QVector<double>& outArcCosts( int criterionNum ) const { return mOutCosts.at( criterionNum ); }
+
+    /**
+     * return first incoming arc slot of a vertex
+     */
+    int inArcBegin( int vertexIdx ) const { return mInArcOffsets.at( vertexIdx ); }
+
+    /**
+     * return one past the last incoming arc slot of a vertex
+     */
+    int inArcEnd( int vertexIdx ) const { return mInArcOffsets.at( vertexIdx + 1 ); }
+
+    /**
+     * return outgoing vertex of an incoming arc slot
+     */
+    int inArcSource( int slot ) const { return mInArcSource.at( slot ); }
+
+    /**
+     * return index in the source graph of an incoming arc slot
+     */
+    int inArcId( int slot ) const { return mInArcId.at( slot ); }
+
+    /**
+     * return cost of an incoming arc slot
+     * @param criterionNum index of arc property
+     * @param slot incoming arc slot
+     */
+    double inArcCost( int criterionNum, int slot ) const { return mInCosts.at( criterionNum ).at( slot ); }
+
+    /**
+     * return costs of all incoming arc slots, for a criterion
+     */
+    const QVector<double>& inArcCosts( int criterionNum ) const { return mInCosts.at( criterionNum ); }
+
+  private:
+    QVector<QgsPoint> mPoints;
+
+    //! vertexCount() + 1 offsets into the outgoing arc arrays
+    QVector<int> mOutArcOffsets;
+    QVector<int> mOutArcTarget;
+    QVector<int> mOutArcId;
+    QVector< QVector<double> > mOutCosts;
+
+    //! vertexCount() + 1 offsets into the incoming arc arrays
+    QVector<int> mInArcOffsets;
+    QVector<int> mInArcSource;
+    QVector<int> mInArcId;
+    QVector< QVector<double> > mInCosts;
+};
+
+#endif // QGSCOMPACTGRAPHH
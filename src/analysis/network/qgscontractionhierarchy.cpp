@@ -0,0 +1,622 @@
+/***************************************************************************
+  qgscontractionhierarchy.cpp
+  --------------------------------------
+  Date                 : October 2016
+  Copyright            : (C) 2016 by the QGIS project
+****************************************************************************
+*                                                                          *
+*   This program is free software; you can redistribute it and/or modify   *
+*   it under the terms of the GNU General Public License as published by   *
+*   the Free Software Foundation; either version 2 of the License, or      *
+*   (at your option) any later version.                                    *
+*                                                                          *
+***************************************************************************/
+
+#include "qgscontractionhierarchy.h"
+#include "qgscompactgraph.h"
+#include "qgslogger.h"
+#include "qgsvertexheap.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QHash>
+#include <QPair>
+
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <vector>
+
+//! Identifies files written by QgsContractionHierarchy::writeToFile()
+static const quint32 CH_FILE_MAGIC = 0x51474348;
+static const quint32 CH_FILE_VERSION = 2;
+
+//! Maximum number of vertices settled by a witness search, more shortcuts are added when it is reached
+static const int MAX_WITNESS_SETTLED = 500;
+
+/**
+ * Contracts the vertices of a graph, in order of their edge difference (number
+ * of shortcuts added, counted twice, minus number of arcs removed) plus their
+ * number of contracted neighbors, which keeps the contraction spread over the graph.
+ */
+class QgsContractionBuilder
+{
+  public:
+    QgsContractionBuilder( QgsContractionHierarchy& ch, int vertexCount )
+        : mCh( ch )
+        , mOut( vertexCount )
+        , mIn( vertexCount )
+        , mContractedNeighbors( vertexCount, 0 )
+        , mWitnessCost( vertexCount, std::numeric_limits<double>::infinity() )
+        , mWitnessTarget( vertexCount, false )
+        , mWitnessHeap( vertexCount )
+        , mUp( vertexCount )
+        , mDown( vertexCount )
+    {}
+
+    //! Add an arc between two uncontracted vertices, unless a cheaper one already links them
+    void addArc( int from, int to, double cost, int sourceId, int first, int second )
+    {
+      if ( from == to )
+        return;
+
+      QVector<int>& out = mOut[ from ];
+      for ( int i = 0; i < out.size(); ++i )
+      {
+        int arc = out.at( i );
+        if ( mCh.mArcTo.at( arc ) != to )
+          continue;
+        if ( mCh.mArcCost.at( arc ) <= cost )
+          return;
+        // the replaced arc is kept, it may already be part of a shortcut
+        out.remove( i );
+        mIn[ to ].remove( mIn.at( to ).indexOf( arc ) );
+        break;
+      }
+
+      int arc = mCh.mArcFrom.size();
+      mCh.mArcFrom.append( from );
+      mCh.mArcTo.append( to );
+      mCh.mArcCost.append( cost );
+      mCh.mArcSourceId.append( sourceId );
+      mCh.mArcFirst.append( first );
+      mCh.mArcSecond.append( second );
+      out.append( arc );
+      mIn[ to ].append( arc );
+    }
+
+    void run()
+    {
+      int vertexCount = mOut.size();
+
+      QgsVertexHeap queue( vertexCount );
+      for ( int v = 0; v < vertexCount; ++v )
+      {
+        queue.push( v, priority( v ) );
+      }
+
+      while ( !queue.isEmpty() )
+      {
+        int v = queue.pop();
+        // priorities of the neighbors of contracted vertices are updated lazily
+        double p = priority( v );
+        if ( !queue.isEmpty() && p > queue.topKey() )
+        {
+          queue.push( v, p );
+          continue;
+        }
+
+        contract( v, false );
+        mUp[ v ] = mOut.at( v );
+        mDown[ v ] = mIn.at( v );
+
+        Q_FOREACH ( int arc, mOut.at( v ) )
+        {
+          int w = mCh.mArcTo.at( arc );
+          mIn[ w ].remove( mIn.at( w ).indexOf( arc ) );
+          ++mContractedNeighbors[ w ];
+        }
+        Q_FOREACH ( int arc, mIn.at( v ) )
+        {
+          int u = mCh.mArcFrom.at( arc );
+          mOut[ u ].remove( mOut.at( u ).indexOf( arc ) );
+          ++mContractedNeighbors[ u ];
+        }
+        mOut[ v ].clear();
+        mIn[ v ].clear();
+      }
+
+      mCh.mUpOffsets = offsets( mUp, mCh.mUpArcs );
+      mCh.mDownOffsets = offsets( mDown, mCh.mDownArcs );
+    }
+
+  private:
+    double priority( int v )
+    {
+      int shortcuts = contract( v, true );
+      return 2 * shortcuts - mOut.at( v ).size() - mIn.at( v ).size() + mContractedNeighbors.at( v );
+    }
+
+    /**
+     * Add the shortcuts needed to contract a vertex, or only count them when simulating.
+     * @return number of shortcuts
+     */
+    int contract( int v, bool simulate )
+    {
+      int shortcuts = 0;
+      QVector<int> in = mIn.at( v );
+      QVector<int> out = mOut.at( v );
+      Q_FOREACH ( int inArc, in )
+      {
+        int u = mCh.mArcFrom.at( inArc );
+        double inCost = mCh.mArcCost.at( inArc );
+
+        double maxCost = -1;
+        int targets = 0;
+        Q_FOREACH ( int outArc, out )
+        {
+          int w = mCh.mArcTo.at( outArc );
+          if ( w == u )
+            continue;
+          maxCost = qMax( maxCost, inCost + mCh.mArcCost.at( outArc ) );
+          if ( !mWitnessTarget.at( w ) )
+          {
+            mWitnessTarget[ w ] = true;
+            ++targets;
+          }
+        }
+        if ( maxCost < 0 )
+          continue;
+
+        witnessSearch( u, v, maxCost, targets );
+        Q_FOREACH ( int outArc, out )
+        {
+          mWitnessTarget[ mCh.mArcTo.at( outArc )] = false;
+        }
+        Q_FOREACH ( int outArc, out )
+        {
+          int w = mCh.mArcTo.at( outArc );
+          double cost = inCost + mCh.mArcCost.at( outArc );
+          if ( w == u || mWitnessCost.at( w ) <= cost )
+            continue;
+
+          ++shortcuts;
+          if ( !simulate )
+            addArc( u, w, cost, -1, inArc, outArc );
+        }
+        resetWitnessSearch();
+      }
+      return shortcuts;
+    }
+
+    //! Dijkstra search from a vertex avoiding the vertex being contracted, until all targets are settled or up to a cost
+    void witnessSearch( int start, int avoid, double maxCost, int targets )
+    {
+      mWitnessCost[ start ] = 0.0;
+      mWitnessTouched.append( start );
+      mWitnessHeap.push( start, 0.0 );
+
+      int settled = 0;
+      while ( !mWitnessHeap.isEmpty() && mWitnessHeap.topKey() <= maxCost && settled < MAX_WITNESS_SETTLED )
+      {
+        int x = mWitnessHeap.pop();
+        ++settled;
+        if ( mWitnessTarget.at( x ) && --targets == 0 )
+          break;
+        double cost = mWitnessCost.at( x );
+        Q_FOREACH ( int arc, mOut.at( x ) )
+        {
+          int y = mCh.mArcTo.at( arc );
+          if ( y == avoid )
+            continue;
+          double newCost = cost + mCh.mArcCost.at( arc );
+          if ( newCost < mWitnessCost.at( y ) )
+          {
+            if ( mWitnessCost.at( y ) == std::numeric_limits<double>::infinity() )
+              mWitnessTouched.append( y );
+            mWitnessCost[ y ] = newCost;
+            mWitnessHeap.push( y, newCost );
+          }
+        }
+      }
+      mWitnessHeap.clear();
+    }
+
+    void resetWitnessSearch()
+    {
+      Q_FOREACH ( int v, mWitnessTouched )
+      {
+        mWitnessCost[ v ] = std::numeric_limits<double>::infinity();
+      }
+      mWitnessTouched.clear();
+    }
+
+    //! Flatten per vertex arc lists into compressed sparse rows
+    static QVector<int> offsets( const QVector< QVector<int> >& lists, QVector<int>& arcs )
+    {
+      QVector<int> result( lists.size() + 1, 0 );
+      for ( int v = 0; v < lists.size(); ++v )
+      {
+        result[ v + 1 ] = result.at( v ) + lists.at( v ).size();
+      }
+      arcs.clear();
+      arcs.reserve( result.last() );
+      for ( int v = 0; v < lists.size(); ++v )
+      {
+        arcs += lists.at( v );
+      }
+      return result;
+    }
+
+    QgsContractionHierarchy& mCh;
+
+    //! arcs between uncontracted vertices
+    QVector< QVector<int> > mOut;
+    QVector< QVector<int> > mIn;
+    QVector<int> mContractedNeighbors;
+
+    QVector<double> mWitnessCost;
+    QVector<bool> mWitnessTarget;
+    QVector<int> mWitnessTouched;
+    QgsVertexHeap mWitnessHeap;
+
+    QVector< QVector<int> > mUp;
+    QVector< QVector<int> > mDown;
+};
+
+
+//! Adds the 8 bytes of a value to a FNV-1a hash
+static quint64 _fnv1a( quint64 hash, quint64 value )
+{
+  for ( int i = 0; i < 8; ++i )
+  {
+    hash ^= ( value >> ( 8 * i ) ) & 0xff;
+    hash *= Q_UINT64_C( 0x100000001b3 );
+  }
+  return hash;
+}
+
+/**
+ * Hash of the vertex count and of the source vertex, target vertex, id and cost
+ * of every arc of a graph, for a criterion
+ */
+static quint64 _graphFingerprint( const QgsCompactGraph* graph, int criterionNum )
+{
+  quint64 hash = Q_UINT64_C( 0xcbf29ce484222325 );
+  hash = _fnv1a( hash, graph->vertexCount() );
+  const QVector<double>& costs = graph->outArcCosts( criterionNum );
+  for ( int v = 0; v < graph->vertexCount(); ++v )
+  {
+    int end = graph->outArcEnd( v );
+    for ( int slot = graph->outArcBegin( v ); slot < end; ++slot )
+    {
+      quint64 costBits;
+      double cost = costs.at( slot );
+      memcpy( &costBits, &cost, sizeof( costBits ) );
+      hash = _fnv1a( hash, v );
+      hash = _fnv1a( hash, graph->outArcTarget( slot ) );
+      hash = _fnv1a( hash, graph->outArcId( slot ) );
+      hash = _fnv1a( hash, costBits );
+    }
+  }
+  return hash;
+}
+
+QgsContractionHierarchy::QgsContractionHierarchy()
+    : mValid( false )
+    , mCriterion( -1 )
+    , mGraphFingerprint( 0 )
+{
+}
+
+QgsContractionHierarchy::QgsContractionHierarchy( const QgsCompactGraph* graph, int criterionNum )
+    : mValid( false )
+    , mCriterion( criterionNum )
+    , mGraphFingerprint( 0 )
+{
+  if ( criterionNum < 0 || criterionNum >= graph->criterionCount() )
+  {
+    QgsDebugMsg( QString( "invalid criterion %1" ).arg( criterionNum ) );
+    return;
+  }
+
+  const QVector<double>& costs = graph->outArcCosts( criterionNum );
+  for ( int slot = 0; slot < costs.size(); ++slot )
+  {
+    if ( costs.at( slot ) < 0 )
+    {
+      QgsDebugMsg( QString( "negative cost of arc %1" ).arg( graph->outArcId( slot ) ) );
+      return;
+    }
+  }
+
+  QgsContractionBuilder builder( *this, graph->vertexCount() );
+  for ( int v = 0; v < graph->vertexCount(); ++v )
+  {
+    int end = graph->outArcEnd( v );
+    for ( int slot = graph->outArcBegin( v ); slot < end; ++slot )
+    {
+      builder.addArc( v, graph->outArcTarget( slot ), costs.at( slot ), graph->outArcId( slot ), -1, -1 );
+    }
+  }
+  builder.run();
+  mGraphFingerprint = _graphFingerprint( graph, criterionNum );
+  mValid = true;
+}
+
+int QgsContractionHierarchy::shortcutCount() const
+{
+  return mArcSourceId.count( -1 );
+}
+
+//! Cost and arc leading to a vertex reached by one of the searches of a query
+struct QgsContractionLabel
+{
+  double cost;
+  int arc;
+};
+
+typedef QPair<double, int> QgsContractionQueueItem;
+typedef std::priority_queue< QgsContractionQueueItem, std::vector< QgsContractionQueueItem >, std::greater< QgsContractionQueueItem > > QgsContractionQueue;
+
+double QgsContractionHierarchy::shortestPath( int startVertexIdx, int endVertexIdx, QVector<int>* resultPath ) const
+{
+  double inf = std::numeric_limits<double>::infinity();
+  if ( resultPath )
+  {
+    resultPath->clear();
+  }
+  if ( startVertexIdx < 0 || startVertexIdx >= vertexCount() || endVertexIdx < 0 || endVertexIdx >= vertexCount() )
+    return inf;
+
+  // both searches only reach a few hundred vertices, so their state is kept in hashes
+  QHash<int, QgsContractionLabel> labels[2];
+  QgsContractionQueue queues[2];
+  QgsContractionLabel first = { 0.0, -1 };
+  labels[0].insert( startVertexIdx, first );
+  labels[1].insert( endVertexIdx, first );
+  queues[0].push( qMakePair( 0.0, startVertexIdx ) );
+  queues[1].push( qMakePair( 0.0, endVertexIdx ) );
+
+  double bestCost = inf;
+  int meetVertex = -1;
+
+  // forward search follows arcs up from the start vertex, backward search follows arcs down to the end vertex
+  while ( !queues[0].empty() || !queues[1].empty() )
+  {
+    for ( int dir = 0; dir < 2; ++dir )
+    {
+      QgsContractionQueue& queue = queues[ dir ];
+      if ( queue.empty() )
+        continue;
+
+      QgsContractionQueueItem item = queue.top();
+      queue.pop();
+      if ( item.first >= bestCost )
+      {
+        // no shorter path can be found in this direction
+        queue = QgsContractionQueue();
+        continue;
+      }
+
+      int v = item.second;
+      if ( item.first > labels[ dir ].value( v ).cost )
+        continue;
+
+      QHash<int, QgsContractionLabel>::const_iterator other = labels[ 1 - dir ].constFind( v );
+      if ( other != labels[ 1 - dir ].constEnd() && item.first + other->cost < bestCost )
+      {
+        bestCost = item.first + other->cost;
+        meetVertex = v;
+      }
+
+      const QVector<int>& offsets = dir == 0 ? mUpOffsets : mDownOffsets;
+      const QVector<int>& arcs = dir == 0 ? mUpArcs : mDownArcs;
+      const QVector<int>& next = dir == 0 ? mArcTo : mArcFrom;
+      for ( int i = offsets.at( v ); i < offsets.at( v + 1 ); ++i )
+      {
+        int arc = arcs.at( i );
+        int w = next.at( arc );
+        double cost = item.first + mArcCost.at( arc );
+        QHash<int, QgsContractionLabel>::iterator it = labels[ dir ].find( w );
+        if ( it == labels[ dir ].end() || cost < it->cost )
+        {
+          QgsContractionLabel label = { cost, arc };
+          labels[ dir ].insert( w, label );
+          queue.push( qMakePair( cost, w ) );
+        }
+      }
+    }
+  }
+
+  if ( resultPath && meetVertex >= 0 )
+  {
+    QVector<int> arcs;
+    for ( int v = meetVertex; v != startVertexIdx; v = mArcFrom.at( arcs.last() ) )
+    {
+      arcs.append( labels[0].value( v ).arc );
+    }
+    for ( int i = arcs.size() - 1; i >= 0; --i )
+    {
+      unpackArc( arcs.at( i ), resultPath );
+    }
+    for ( int v = meetVertex; v != endVertexIdx; )
+    {
+      int arc = labels[1].value( v ).arc;
+      unpackArc( arc, resultPath );
+      v = mArcTo.at( arc );
+    }
+  }
+  return bestCost;
+}
+
+void QgsContractionHierarchy::unpackArc( int arc, QVector<int>* path ) const
+{
+  // shortcuts are unpacked with an explicit stack, the second arc is pushed first
+  QVector<int> stack;
+  stack.append( arc );
+  while ( !stack.isEmpty() )
+  {
+    int a = stack.last();
+    stack.pop_back();
+    if ( mArcSourceId.at( a ) >= 0 )
+    {
+      path->append( mArcSourceId.at( a ) );
+    }
+    else
+    {
+      stack.append( mArcSecond.at( a ) );
+      stack.append( mArcFirst.at( a ) );
+    }
+  }
+}
+
+bool QgsContractionHierarchy::writeToFile( const QString& fileName ) const
+{
+  if ( !mValid )
+    return false;
+
+  QFile file( fileName );
+  if ( !file.open( QIODevice::WriteOnly ) )
+  {
+    QgsDebugMsg( QString( "cannot open %1 for writing" ).arg( fileName ) );
+    return false;
+  }
+
+  QDataStream out( &file );
+  out.setVersion( QDataStream::Qt_4_8 );
+  out << CH_FILE_MAGIC << CH_FILE_VERSION;
+  out << static_cast< qint32 >( mCriterion ) << mGraphFingerprint;
+  out << mUpOffsets << mUpArcs << mDownOffsets << mDownArcs;
+  out << mArcFrom << mArcTo << mArcCost << mArcSourceId << mArcFirst << mArcSecond;
+  return out.status() == QDataStream::Ok;
+}
+
+/**
+ * Check that offsets start at 0, never decrease and end at the size of the arc list,
+ * and that every arc in the list is an arc of the hierarchy
+ */
+static bool _validArcLists( const QVector<int>& offsets, const QVector<int>& arcs, int arcCount )
+{
+  if ( offsets.isEmpty() || offsets.first() != 0 || offsets.last() != arcs.size() )
+    return false;
+  for ( int i = 1; i < offsets.size(); ++i )
+  {
+    if ( offsets.at( i ) < offsets.at( i - 1 ) )
+      return false;
+  }
+  for ( int i = 0; i < arcs.size(); ++i )
+  {
+    if ( arcs.at( i ) < 0 || arcs.at( i ) >= arcCount )
+      return false;
+  }
+  return true;
+}
+
+bool QgsContractionHierarchy::isConsistent( int vertexCount, int arcCount ) const
+{
+  int chArcCount = mArcFrom.size();
+  if ( mUpOffsets.size() != vertexCount + 1 || mDownOffsets.size() != vertexCount + 1 ||
+       mArcTo.size() != chArcCount || mArcCost.size() != chArcCount || mArcSourceId.size() != chArcCount ||
+       mArcFirst.size() != chArcCount || mArcSecond.size() != chArcCount )
+    return false;
+
+  if ( !_validArcLists( mUpOffsets, mUpArcs, chArcCount ) || !_validArcLists( mDownOffsets, mDownArcs, chArcCount ) )
+    return false;
+
+  for ( int arc = 0; arc < chArcCount; ++arc )
+  {
+    if ( mArcFrom.at( arc ) < 0 || mArcFrom.at( arc ) >= vertexCount ||
+         mArcTo.at( arc ) < 0 || mArcTo.at( arc ) >= vertexCount ||
+         !( mArcCost.at( arc ) >= 0 ) )
+      return false;
+
+    if ( mArcSourceId.at( arc ) >= 0 )
+    {
+      if ( mArcSourceId.at( arc ) >= arcCount || mArcFirst.at( arc ) != -1 || mArcSecond.at( arc ) != -1 )
+        return false;
+    }
+    // shortcuts replace arcs added before them, so that unpacking ends
+    else if ( mArcSourceId.at( arc ) != -1 ||
+              mArcFirst.at( arc ) < 0 || mArcFirst.at( arc ) >= arc ||
+              mArcSecond.at( arc ) < 0 || mArcSecond.at( arc ) >= arc )
+    {
+      return false;
+    }
+  }
+
+  // queries follow up arcs from their vertex and down arcs to their vertex
+  for ( int v = 0; v < vertexCount; ++v )
+  {
+    for ( int i = mUpOffsets.at( v ); i < mUpOffsets.at( v + 1 ); ++i )
+    {
+      if ( mArcFrom.at( mUpArcs.at( i ) ) != v )
+        return false;
+    }
+    for ( int i = mDownOffsets.at( v ); i < mDownOffsets.at( v + 1 ); ++i )
+    {
+      if ( mArcTo.at( mDownArcs.at( i ) ) != v )
+        return false;
+    }
+  }
+  return true;
+}
+
+bool QgsContractionHierarchy::readFromFile( const QString& fileName, const QgsCompactGraph* graph, int criterionNum )
+{
+  mValid = false;
+
+  if ( !graph || criterionNum < 0 || criterionNum >= graph->criterionCount() )
+    return false;
+
+  QFile file( fileName );
+  if ( !file.open( QIODevice::ReadOnly ) )
+  {
+    QgsDebugMsg( QString( "cannot open %1 for reading" ).arg( fileName ) );
+    return false;
+  }
+
+  QDataStream in( &file );
+  in.setVersion( QDataStream::Qt_4_8 );
+  quint32 magic, version;
+  in >> magic >> version;
+  if ( magic != CH_FILE_MAGIC || version != CH_FILE_VERSION )
+  {
+    QgsDebugMsg( QString( "%1 is not a contraction hierarchy file" ).arg( fileName ) );
+    return false;
+  }
+
+  qint32 criterion;
+  quint64 fingerprint;
+  in >> criterion >> fingerprint;
+  if ( in.status() != QDataStream::Ok || criterion != criterionNum || fingerprint != _graphFingerprint( graph, criterionNum ) )
+  {
+    QgsDebugMsg( QString( "%1 was built for another criterion or graph" ).arg( fileName ) );
+    return false;
+  }
+
+  in >> mUpOffsets >> mUpArcs >> mDownOffsets >> mDownArcs;
+  in >> mArcFrom >> mArcTo >> mArcCost >> mArcSourceId >> mArcFirst >> mArcSecond;
+
+  if ( in.status() != QDataStream::Ok || !isConsistent( graph->vertexCount(), graph->arcCount() ) )
+  {
+    QgsDebugMsg( QString( "%1 is corrupted or was built from another graph" ).arg( fileName ) );
+    mUpOffsets.clear();
+    mUpArcs.clear();
+    mDownOffsets.clear();
+    mDownArcs.clear();
+    mArcFrom.clear();
+    mArcTo.clear();
+    mArcCost.clear();
+    mArcSourceId.clear();
+    mArcFirst.clear();
+    mArcSecond.clear();
+    return false;
+  }
+
+  mCriterion = criterion;
+  mGraphFingerprint = fingerprint;
+  mValid = true;
+  return true;
+}
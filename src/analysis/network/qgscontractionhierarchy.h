@@ -0,0 +1,132 @@
+/***************************************************************************
+  qgscontractionhierarchy.h
+  --------------------------------------
+  Date                 : October 2016
+  Copyright            : (C) 2016 by the QGIS project
+****************************************************************************
+*                                                                          *
+*   This program is free software; you can redistribute it and/or modify   *
+*   it under the terms of the GNU General Public License as published by   *
+*   the Free Software Foundation; either version 2 of the License, or      *
+*   (at your option) any later version.                                    *
+*                                                                          *
+***************************************************************************/
+
+#ifndef QGSCONTRACTIONHIERARCHYH
+#define QGSCONTRACTIONHIERARCHYH
+
+// QT4 includes
+#include <QString>
+#include <QVector>
+
+class QgsCompactGraph;
+
+/**
+ * \ingroup networkanalysis
+ * \class QgsContractionHierarchy
+ * \brief Preprocessed graph answering repeated shortest path queries on a static network
+ *
+ * Vertices are contracted one after the other, from the least to the most
+ * important one. Contracting a vertex adds shortcut arcs between its neighbors
+ * wherever the shortest path between them goes through the vertex. A query
+ * then only follows arcs towards more important vertices, from both the start
+ * and the end vertex, and explores a tiny part of the graph.
+ *
+ * Preprocessing is done once for a criterion, the result can be saved with
+ * writeToFile() and loaded with readFromFile(). Queries do not modify the
+ * hierarchy and can run concurrently from several threads.
+ *
+ * @note added in QGIS 3.0
+ */
+class ANALYSIS_EXPORT QgsContractionHierarchy
+{
+  public:
+    /**
+     * Constructs an empty, invalid hierarchy, see readFromFile()
+     */
+    QgsContractionHierarchy();
+
+    /**
+     * Preprocesses a graph. Arc costs must not be negative, the hierarchy is invalid otherwise.
+     * @param graph source graph
+     * @param criterionNum index of arc property as optimization criterion
+     */
+    QgsContractionHierarchy( const QgsCompactGraph* graph, int criterionNum );
+
+    /**
+     * return true if the hierarchy was successfully built or read
+     */
+    bool isValid() const { return mValid; }
+
+    /**
+     * return vertex count
+     */
+    int vertexCount() const { return mValid ? mUpOffsets.size() - 1 : 0; }
+
+    /**
+     * return number of shortcut arcs added by the preprocessing
+     */
+    int shortcutCount() const;
+
+    /**
+     * find the shortest path between two vertices
+     * @param startVertexIdx index of start vertex
+     * @param endVertexIdx index of end vertex
+     * @param resultPath indexes of the arcs of the path in the source graph, from start to end vertex. Empty if end vertex is not reachable.
+     * @return cost of the path, infinity if end vertex is not reachable
+     */
+    double shortestPath( int startVertexIdx, int endVertexIdx, QVector<int>* resultPath = nullptr ) const;
+
+    /**
+     * Save the hierarchy to a file
+     * @return true on success
+     */
+    bool writeToFile( const QString& fileName ) const;
+
+    /**
+     * Load a hierarchy saved with writeToFile(). The file is rejected if it is
+     * corrupted, was built for another criterion or from a graph which differs in
+     * its vertices, arcs or arc costs.
+     * @param fileName file written by writeToFile()
+     * @param graph graph the hierarchy was built from
+     * @param criterionNum index of arc property the hierarchy was built for
+     * @return true on success
+     */
+    bool readFromFile( const QString& fileName, const QgsCompactGraph* graph, int criterionNum );
+
+  private:
+    //! Check the arrays read from a file, for a graph of vertexCount vertices and arcCount arcs
+    bool isConsistent( int vertexCount, int arcCount ) const;
+
+    //! Append the arcs of the source graph represented by an arc of the hierarchy
+    void unpackArc( int arc, QVector<int>* path ) const;
+
+    bool mValid;
+
+    //! criterion the hierarchy was built for
+    int mCriterion;
+    //! hash of the arcs and costs of the source graph
+    quint64 mGraphFingerprint;
+
+    //! vertexCount() + 1 offsets into mUpArcs
+    QVector<int> mUpOffsets;
+    //! arcs from each vertex to more important vertices
+    QVector<int> mUpArcs;
+    //! vertexCount() + 1 offsets into mDownArcs
+    QVector<int> mDownOffsets;
+    //! arcs from more important vertices to each vertex
+    QVector<int> mDownArcs;
+
+    QVector<int> mArcFrom;
+    QVector<int> mArcTo;
+    QVector<double> mArcCost;
+    //! index of the arc in the source graph, -1 for shortcuts
+    QVector<int> mArcSourceId;
+    //! first and second arc replaced by a shortcut, -1 for arcs of the source graph
+    QVector<int> mArcFirst;
+    QVector<int> mArcSecond;
+
+    friend class QgsContractionBuilder;
+};
+
+#endif // QGSCONTRACTIONHIERARCHYH
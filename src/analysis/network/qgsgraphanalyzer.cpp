@@ -15,76 +15,489 @@
  *                                                                         *
  ***************************************************************************/
 // C++ standard includes
+#include <cmath>
 #include <limits>
 
 // QT includes
-#include <QMap>
+#include <QList>
+#include <QThread>
 #include <QVector>
-#include <QPair>
+#include <QtConcurrentMap>
 
 //QGIS-uncludes
+#include "qgscompactgraph.h"
+#include "qgsdistancearea.h"
 #include "qgsgraph.h"
 #include "qgsgraphanalyzer.h"
+#include "qgsvertexheap.h"
 
-void QgsGraphAnalyzer::dijkstra( const QgsGraph* source, int startPointIdx, int criterionNum, QVector<int>* resultTree, QVector<double>* resultCost )
+/**
+ * Return the costs of the outgoing or incoming arc slots for a criterion.
+ * Arcs without the criterion have no cost, noCosts keeps the zero costs alive.
+ */
+static const double* arcCosts( const QgsCompactGraph* source, int criterionNum, bool outgoing, QVector<double>& noCosts )
 {
-  QVector< double > * result = nullptr;
-  if ( resultCost )
+  if ( criterionNum >= 0 && criterionNum < source->criterionCount() )
   {
-    result = resultCost;
+    return outgoing ? source->outArcCosts( criterionNum ).constData() : source->inArcCosts( criterionNum ).constData();
   }
-  else
+  noCosts.fill( 0.0, source->arcCount() );
+  return noCosts.constData();
+}
+
+//! Heuristic of a search without estimate, i.e. dijkstra algorithm
+struct QgsNoHeuristic
+{
+  double operator()( int vertexIdx ) const
   {
-    result = new QVector<double>();
+    Q_UNUSED( vertexIdx );
+    return 0.0;
   }
+};
+
+//! Distance to the end vertex multiplied by the lowest cost per distance unit
+class QgsDistanceHeuristic
+{
+  public:
+    QgsDistanceHeuristic( const QgsCompactGraph* source, int endVertexIdx, double costPerDistance, const QgsDistanceArea* distanceArea )
+        : mSource( source )
+        , mEnd( source->point( endVertexIdx ) )
+        , mCostPerDistance( costPerDistance )
+        , mDistanceArea( distanceArea )
+    {}
+
+    double operator()( int vertexIdx ) const
+    {
+      QgsPoint p = mSource->point( vertexIdx );
+      double distance = mDistanceArea ? mDistanceArea->measureLine( p, mEnd ) : std::sqrt( p.sqrDist( mEnd ) );
+      return distance * mCostPerDistance;
+    }
+
+  private:
+    const QgsCompactGraph* mSource;
+    QgsPoint mEnd;
+    double mCostPerDistance;
+    const QgsDistanceArea* mDistanceArea;
+};
+
+/**
+ * Point to point search, stopped when the end vertex is settled. Vertices
+ * are ordered by their cost plus the heuristic estimate of the remaining cost.
+ */
+template <class Heuristic>
+static double pointToPointSearch( const QgsCompactGraph* source, int startVertexIdx, int endVertexIdx, int criterionNum, const Heuristic& heuristic, QVector<int>* resultPath )
+{
+  double inf = std::numeric_limits<double>::infinity();
+  if ( resultPath )
+  {
+    resultPath->clear();
+  }
+
+  int vertexCount = source->vertexCount();
+  if ( startVertexIdx < 0 || startVertexIdx >= vertexCount || endVertexIdx < 0 || endVertexIdx >= vertexCount )
+    return inf;
+
+  QVector<double> noCosts;
+  const double* costs = arcCosts( source, criterionNum, true, noCosts );
 
-  result->clear();
-  result->insert( result->begin(), source->vertexCount(), std::numeric_limits<double>::infinity() );
-  ( *result )[ startPointIdx ] = 0.0;
+  QVector<double> cost( vertexCount, inf );
+  // estimates are computed once per vertex, -1 if not computed yet
+  QVector<double> estimate( vertexCount, -1.0 );
+  QVector<int> predVertex( vertexCount, -1 );
+  QVector<int> predArc( vertexCount, -1 );
+
+  QgsVertexHeap heap( vertexCount );
+  cost[ startVertexIdx ] = 0.0;
+  heap.push( startVertexIdx, heuristic( startVertexIdx ) );
+
+  while ( !heap.isEmpty() )
+  {
+    int curVertex = heap.pop();
+    if ( curVertex == endVertexIdx )
+      break;
+
+    double curCost = cost.at( curVertex );
+    int end = source->outArcEnd( curVertex );
+    for ( int slot = source->outArcBegin( curVertex ); slot < end; ++slot )
+    {
+      double newCost = curCost + costs[ slot ];
+      int inVertex = source->outArcTarget( slot );
+      if ( newCost < cost.at( inVertex ) )
+      {
+        cost[ inVertex ] = newCost;
+        predVertex[ inVertex ] = curVertex;
+        predArc[ inVertex ] = source->outArcId( slot );
+        if ( estimate.at( inVertex ) < 0 )
+        {
+          estimate[ inVertex ] = heuristic( inVertex );
+        }
+        heap.push( inVertex, newCost + estimate.at( inVertex ) );
+      }
+    }
+  }
+
+  if ( resultPath && cost.at( endVertexIdx ) < inf )
+  {
+    for ( int v = endVertexIdx; v != startVertexIdx; v = predVertex.at( v ) )
+    {
+      resultPath->prepend( predArc.at( v ) );
+    }
+  }
+  return cost.at( endVertexIdx );
+}
+
+void QgsGraphAnalyzer::dijkstra( const QgsGraph* source, int startPointIdx, int criterionNum, QVector<int>* resultTree, QVector<double>* resultCost )
+{
+  QgsCompactGraph graph( source );
+  dijkstra( &graph, startPointIdx, criterionNum, resultTree, resultCost );
+}
+
+void QgsGraphAnalyzer::dijkstra( const QgsCompactGraph* source, int startPointIdx, int criterionNum, QVector<int>* resultTree, QVector<double>* resultCost )
+{
+  QVector< double > localCost;
+  QVector< double >& cost = resultCost ? *resultCost : localCost;
+  cost.fill( std::numeric_limits<double>::infinity(), source->vertexCount() );
 
   if ( resultTree )
   {
-    resultTree->clear();
-    resultTree->insert( resultTree->begin(), source->vertexCount(), -1 );
+    resultTree->fill( -1, source->vertexCount() );
   }
 
-  // QMultiMap< cost, vertexIdx > not_begin
-  // I use it and not create any struct or class.
-  QMultiMap< double, int > not_begin;
-  QMultiMap< double, int >::iterator it;
+  if ( startPointIdx < 0 || startPointIdx >= source->vertexCount() )
+    return;
+
+  QVector<double> noCosts;
+  const double* costs = arcCosts( source, criterionNum, true, noCosts );
 
-  not_begin.insert( 0.0, startPointIdx );
+  double* vertexCost = cost.data();
+  int* tree = resultTree ? resultTree->data() : nullptr;
+  vertexCost[ startPointIdx ] = 0.0;
 
-  while ( !not_begin.empty() )
+  QgsVertexHeap heap( source->vertexCount() );
+  heap.push( startPointIdx, 0.0 );
+
+  while ( !heap.isEmpty() )
   {
-    it = not_begin.begin();
-    double curCost = it.key();
-    int curVertex = it.value();
-    not_begin.erase( it );
+    int curVertex = heap.pop();
+    double curCost = vertexCost[ curVertex ];
 
-    // edge index list
-    QgsGraphArcIdList l = source->vertex( curVertex ).outArc();
-    QgsGraphArcIdList::iterator arcIt;
-    for ( arcIt = l.begin(); arcIt != l.end(); ++arcIt )
+    int end = source->outArcEnd( curVertex );
+    for ( int slot = source->outArcBegin( curVertex ); slot < end; ++slot )
     {
-      const QgsGraphArc arc = source->arc( *arcIt );
-      double cost = arc.property( criterionNum ).toDouble() + curCost;
+      double newCost = curCost + costs[ slot ];
+      int inVertex = source->outArcTarget( slot );
+      if ( newCost < vertexCost[ inVertex ] )
+      {
+        vertexCost[ inVertex ] = newCost;
+        if ( tree )
+        {
+          tree[ inVertex ] = source->outArcId( slot );
+        }
+        heap.push( inVertex, newCost );
+      }
+    }
+  }
+}
+
+double QgsGraphAnalyzer::shortestPath( const QgsCompactGraph* source, int startVertexIdx, int endVertexIdx, int criterionNum, QVector<int>* resultPath )
+{
+  return pointToPointSearch( source, startVertexIdx, endVertexIdx, criterionNum, QgsNoHeuristic(), resultPath );
+}
+
+double QgsGraphAnalyzer::aStar( const QgsCompactGraph* source, int startVertexIdx, int endVertexIdx, int criterionNum, double costPerDistance, const QgsDistanceArea* distanceArea, QVector<int>* resultPath )
+{
+  if ( endVertexIdx < 0 || endVertexIdx >= source->vertexCount() )
+  {
+    if ( resultPath )
+      resultPath->clear();
+    return std::numeric_limits<double>::infinity();
+  }
+  QgsDistanceHeuristic heuristic( source, endVertexIdx, costPerDistance, distanceArea );
+  return pointToPointSearch( source, startVertexIdx, endVertexIdx, criterionNum, heuristic, resultPath );
+}
+
+double QgsGraphAnalyzer::bidirectionalShortestPath( const QgsCompactGraph* source, int startVertexIdx, int endVertexIdx, int criterionNum, QVector<int>* resultPath )
+{
+  double inf = std::numeric_limits<double>::infinity();
+  if ( resultPath )
+  {
+    resultPath->clear();
+  }
+
+  int vertexCount = source->vertexCount();
+  if ( startVertexIdx < 0 || startVertexIdx >= vertexCount || endVertexIdx < 0 || endVertexIdx >= vertexCount )
+    return inf;
+  if ( startVertexIdx == endVertexIdx )
+    return 0.0;
+
+  QVector<double> noOutCosts, noInCosts;
+  const double* outCosts = arcCosts( source, criterionNum, true, noOutCosts );
+  const double* inCosts = arcCosts( source, criterionNum, false, noInCosts );
+
+  // forward search from the start vertex, backward search from the end vertex
+  QVector<double> forwardCost( vertexCount, inf );
+  QVector<double> backwardCost( vertexCount, inf );
+  // previous vertex of the forward path, next vertex of the backward path
+  QVector<int> forwardVertex( vertexCount, -1 );
+  QVector<int> backwardVertex( vertexCount, -1 );
+  QVector<int> forwardArc( vertexCount, -1 );
+  QVector<int> backwardArc( vertexCount, -1 );
+
+  QgsVertexHeap forwardHeap( vertexCount );
+  QgsVertexHeap backwardHeap( vertexCount );
+  forwardCost[ startVertexIdx ] = 0.0;
+  backwardCost[ endVertexIdx ] = 0.0;
+  forwardHeap.push( startVertexIdx, 0.0 );
+  backwardHeap.push( endVertexIdx, 0.0 );
 
-      if ( cost < ( *result )[ arc.inVertex()] )
+  // cost of the best path found so far and vertex where both searches meet on it
+  double bestCost = inf;
+  int meetVertex = -1;
+
+  while ( !forwardHeap.isEmpty() && !backwardHeap.isEmpty() )
+  {
+    if ( forwardHeap.topKey() + backwardHeap.topKey() >= bestCost )
+      break;
+
+    if ( forwardHeap.topKey() <= backwardHeap.topKey() )
+    {
+      int curVertex = forwardHeap.pop();
+      double curCost = forwardCost.at( curVertex );
+      int end = source->outArcEnd( curVertex );
+      for ( int slot = source->outArcBegin( curVertex ); slot < end; ++slot )
+      {
+        double newCost = curCost + outCosts[ slot ];
+        int v = source->outArcTarget( slot );
+        if ( newCost < forwardCost.at( v ) )
+        {
+          forwardCost[ v ] = newCost;
+          forwardVertex[ v ] = curVertex;
+          forwardArc[ v ] = source->outArcId( slot );
+          forwardHeap.push( v, newCost );
+          if ( newCost + backwardCost.at( v ) < bestCost )
+          {
+            bestCost = newCost + backwardCost.at( v );
+            meetVertex = v;
+          }
+        }
+      }
+    }
+    else
+    {
+      int curVertex = backwardHeap.pop();
+      double curCost = backwardCost.at( curVertex );
+      int end = source->inArcEnd( curVertex );
+      for ( int slot = source->inArcBegin( curVertex ); slot < end; ++slot )
+      {
+        double newCost = curCost + inCosts[ slot ];
+        int v = source->inArcSource( slot );
+        if ( newCost < backwardCost.at( v ) )
+        {
+          backwardCost[ v ] = newCost;
+          backwardVertex[ v ] = curVertex;
+          backwardArc[ v ] = source->inArcId( slot );
+          backwardHeap.push( v, newCost );
+          if ( newCost + forwardCost.at( v ) < bestCost )
+          {
+            bestCost = newCost + forwardCost.at( v );
+            meetVertex = v;
+          }
+        }
+      }
+    }
+  }
+
+  if ( resultPath && meetVertex >= 0 )
+  {
+    for ( int v = meetVertex; v != startVertexIdx; v = forwardVertex.at( v ) )
+    {
+      resultPath->prepend( forwardArc.at( v ) );
+    }
+    for ( int v = meetVertex; v != endVertexIdx; v = backwardVertex.at( v ) )
+    {
+      resultPath->append( backwardArc.at( v ) );
+    }
+  }
+  return bestCost;
+}
+
+//! Range of origins of a cost matrix searched by a job
+struct QgsCostMatrixJob
+{
+  int firstOrigin;
+  //! one past the last origin
+  int lastOrigin;
+};
+
+/**
+ * Searches the origins of a job one after the other, for QtConcurrent::blockingMap.
+ * Search buffers are allocated once per job, and only the vertices reached by
+ * a search are reset before the next one.
+ */
+class QgsCostMatrixSearch
+{
+  public:
+    QgsCostMatrixSearch( const QgsCompactGraph* source, const double* costs, const QVector<int>& origins, const QVector<int>& destinations,
+                         const QVector<bool>& isDestination, int destinationVertexCount, double maxCost,
+                         QVector<double>* rows, QVector<int>* trees )
+        : mSource( source )
+        , mCosts( costs )
+        , mOrigins( origins )
+        , mDestinations( destinations )
+        , mIsDestination( isDestination )
+        , mDestinationVertexCount( destinationVertexCount )
+        , mMaxCost( maxCost )
+        , mRows( rows )
+        , mTrees( trees )
+    {}
+
+    typedef void result_type;
+
+    void operator()( const QgsCostMatrixJob& job ) const
+    {
+      double inf = std::numeric_limits<double>::infinity();
+      int vertexCount = mSource->vertexCount();
+      QVector<double> cost( vertexCount, inf );
+      QVector<int> predArc( mTrees ? vertexCount : 0, -1 );
+      QVector<int> touched;
+      QgsVertexHeap heap( vertexCount );
+
+      for ( int i = job.firstOrigin; i < job.lastOrigin; ++i )
       {
-        ( *result )[ arc.inVertex()] = cost;
-        if ( resultTree )
+        QVector<double>& row = mRows[i];
+        row.fill( inf, mDestinations.size() );
+        if ( mTrees )
         {
-          ( *resultTree )[ arc.inVertex()] = *arcIt;
+          mTrees[i].fill( -1, vertexCount );
         }
-        not_begin.insert( cost, arc.inVertex() );
+
+        int start = mOrigins.at( i );
+        if ( start < 0 || start >= vertexCount )
+          continue;
+
+        cost[ start ] = 0.0;
+        touched.append( start );
+        heap.push( start, 0.0 );
+
+        int remaining = mDestinationVertexCount;
+        while ( !heap.isEmpty() && heap.topKey() <= mMaxCost )
+        {
+          int curVertex = heap.pop();
+          if ( mTrees )
+          {
+            mTrees[i][ curVertex ] = predArc.at( curVertex );
+          }
+          if ( mIsDestination.at( curVertex ) && --remaining == 0 )
+            break;
+
+          double curCost = cost.at( curVertex );
+          int end = mSource->outArcEnd( curVertex );
+          for ( int slot = mSource->outArcBegin( curVertex ); slot < end; ++slot )
+          {
+            double newCost = curCost + mCosts[ slot ];
+            int inVertex = mSource->outArcTarget( slot );
+            if ( newCost < cost.at( inVertex ) )
+            {
+              if ( cost.at( inVertex ) == inf )
+                touched.append( inVertex );
+              cost[ inVertex ] = newCost;
+              if ( mTrees )
+              {
+                predArc[ inVertex ] = mSource->outArcId( slot );
+              }
+              heap.push( inVertex, newCost );
+            }
+          }
+        }
+        heap.clear();
+
+        // vertices left in the heap cost more than maxCost, the other ones are settled
+        for ( int j = 0; j < mDestinations.size(); ++j )
+        {
+          int destination = mDestinations.at( j );
+          if ( destination >= 0 && destination < vertexCount && cost.at( destination ) <= mMaxCost )
+            row[j] = cost.at( destination );
+        }
+
+        Q_FOREACH ( int v, touched )
+        {
+          cost[ v ] = inf;
+          if ( mTrees )
+          {
+            predArc[ v ] = -1;
+          }
+        }
+        touched.clear();
       }
     }
+
+  private:
+    const QgsCompactGraph* mSource;
+    const double* mCosts;
+    const QVector<int>& mOrigins;
+    const QVector<int>& mDestinations;
+    const QVector<bool>& mIsDestination;
+    int mDestinationVertexCount;
+    double mMaxCost;
+    QVector<double>* mRows;
+    QVector<int>* mTrees;
+};
+
+QVector< QVector<double> > QgsGraphAnalyzer::costMatrix( const QgsCompactGraph* source, const QVector<int>& origins, const QVector<int>& destinations, int criterionNum,
+    double maxCost, QVector< QVector<int> >* resultTrees )
+{
+  QVector< QVector<double> > result( origins.size() );
+  if ( resultTrees )
+  {
+    resultTrees->clear();
+    resultTrees->resize( origins.size() );
+  }
+  if ( origins.isEmpty() )
+    return result;
+
+  if ( maxCost < 0 )
+  {
+    maxCost = std::numeric_limits<double>::infinity();
+  }
+
+  QVector<double> noCosts;
+  const double* costs = arcCosts( source, criterionNum, true, noCosts );
+
+  QVector<bool> isDestination( source->vertexCount(), false );
+  int destinationVertexCount = 0;
+  Q_FOREACH ( int destination, destinations )
+  {
+    if ( destination >= 0 && destination < source->vertexCount() && !isDestination.at( destination ) )
+    {
+      isDestination[ destination ] = true;
+      ++destinationVertexCount;
+    }
+  }
+
+  // several origins per job, so that search buffers are reused
+  int jobCount = qMin( origins.size(), 4 * qMax( 1, QThread::idealThreadCount() ) );
+  int originsPerJob = ( origins.size() + jobCount - 1 ) / jobCount;
+  QList<QgsCostMatrixJob> jobs;
+  for ( int first = 0; first < origins.size(); first += originsPerJob )
+  {
+    QgsCostMatrixJob job;
+    job.firstOrigin = first;
+    job.lastOrigin = qMin( first + originsPerJob, origins.size() );
+    jobs << job;
   }
-  if ( !resultCost )
+
+  // rows are detached here, each job then only writes its own rows
+  QgsCostMatrixSearch search( source, costs, origins, destinations, isDestination, destinationVertexCount, maxCost,
+                              result.data(), resultTrees ? resultTrees->data() : nullptr );
+  if ( jobs.size() > 1 )
+  {
+    QtConcurrent::blockingMap( jobs, search );
+  }
+  else
   {
-    delete result;
+    search( jobs.at( 0 ) );
   }
+  return result;
 }
 
 QgsGraph* QgsGraphAnalyzer::shortestTree( const QgsGraph* source, int startVertexIdx, int criterionNum )
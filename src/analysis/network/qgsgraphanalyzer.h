@@ -23,6 +23,8 @@
 
 // forward-declaration
 class QgsGraph;
+class QgsCompactGraph;
+class QgsDistanceArea;
 
 /** \ingroup networkanalysis
  * The QGis class provides graph analysis functions
@@ -32,7 +34,11 @@ class ANALYSIS_EXPORT QgsGraphAnalyzer
 {
   public:
     /**
-     * solve shortest path problem using dijkstra algorithm
+     * solve shortest path problem using dijkstra algorithm. The graph is converted to a
+     * QgsCompactGraph on each call, use the QgsCompactGraph overload to run several searches.
+     * When a vertex is reached by several paths of the same cost, the arc kept in resultTree
+     * depends on the order in which vertices of equal cost are settled, which differs from
+     * QGIS 2.x.
      * @param source The source graph
      * @param startVertexIdx index of start vertex
      * @param criterionNum index of arc property as optimization criterion
@@ -41,6 +47,80 @@ class ANALYSIS_EXPORT QgsGraphAnalyzer
      */
     static void dijkstra( const QgsGraph* source, int startVertexIdx, int criterionNum, QVector<int>* resultTree = nullptr, QVector<double>* resultCost = nullptr );
 
+    /**
+     * solve shortest path problem using dijkstra algorithm with a binary heap.
+     * Build the compact graph once to run several searches on the same graph.
+     * @param source The source graph
+     * @param startVertexIdx index of start vertex
+     * @param criterionNum index of arc property as optimization criterion
+     * @param resultTree array represents the shortest path tree. resultTree[ vertexIndex ] == inboundingArcIndex if vertex reacheble and resultTree[ vertexIndex ] == -1 others.
+     * Arc indexes are those of the graph the compact graph was built from.
+     * @param resultCost array of cost paths
+     * @note added in QGIS 3.0
+     */
+    static void dijkstra( const QgsCompactGraph* source, int startVertexIdx, int criterionNum, QVector<int>* resultTree = nullptr, QVector<double>* resultCost = nullptr );
+
+    /**
+     * find the shortest path between two vertices using dijkstra algorithm. The search stops
+     * as soon as the end vertex is reached.
+     * @param source The source graph
+     * @param startVertexIdx index of start vertex
+     * @param endVertexIdx index of end vertex
+     * @param criterionNum index of arc property as optimization criterion
+     * @param resultPath indexes of the arcs of the path, from start to end vertex. Empty if end vertex is not reachable.
+     * @return cost of the path, infinity if end vertex is not reachable
+     * @note added in QGIS 3.0
+     */
+    static double shortestPath( const QgsCompactGraph* source, int startVertexIdx, int endVertexIdx, int criterionNum, QVector<int>* resultPath = nullptr );
+
+    /**
+     * find the shortest path between two vertices using A* algorithm. Vertices are explored
+     * in order of their cost from the start vertex plus the distance between their point and
+     * the point of the end vertex, multiplied by costPerDistance. The path is the shortest one
+     * if this estimate never exceeds the actual cost to the end vertex.
+     * @param source The source graph
+     * @param startVertexIdx index of start vertex
+     * @param endVertexIdx index of end vertex
+     * @param criterionNum index of arc property as optimization criterion
+     * @param costPerDistance lowest arc cost per distance unit, e.g. 1 when the criterion is the arc length or the inverse of the highest speed when it is the travel time
+     * @param distanceArea measures the distance between points, e.g. on the ellipsoid of the graph builder. If nullptr, the euclidean distance in graph coordinates is used.
+     * @param resultPath indexes of the arcs of the path, from start to end vertex. Empty if end vertex is not reachable.
+     * @return cost of the path, infinity if end vertex is not reachable
+     * @note added in QGIS 3.0
+     */
+    static double aStar( const QgsCompactGraph* source, int startVertexIdx, int endVertexIdx, int criterionNum, double costPerDistance, const QgsDistanceArea* distanceArea = nullptr, QVector<int>* resultPath = nullptr );
+
+    /**
+     * find the shortest path between two vertices using bidirectional dijkstra algorithm,
+     * searching forward from the start vertex and backward from the end vertex until both
+     * searches meet. Arc costs must not be negative.
+     * @param source The source graph
+     * @param startVertexIdx index of start vertex
+     * @param endVertexIdx index of end vertex
+     * @param criterionNum index of arc property as optimization criterion
+     * @param resultPath indexes of the arcs of the path, from start to end vertex. Empty if end vertex is not reachable.
+     * @return cost of the path, infinity if end vertex is not reachable
+     * @note added in QGIS 3.0
+     */
+    static double bidirectionalShortestPath( const QgsCompactGraph* source, int startVertexIdx, int endVertexIdx, int criterionNum, QVector<int>* resultPath = nullptr );
+
+    /**
+     * compute the costs of the shortest paths from several origins to several destinations.
+     * Origins are searched concurrently. The search from an origin stops as soon as all
+     * destinations are reached or when the costs exceed maxCost.
+     * @param source The source graph
+     * @param origins indexes of origin vertices
+     * @param destinations indexes of destination vertices
+     * @param criterionNum index of arc property as optimization criterion
+     * @param maxCost highest cost of interest, e.g. the cost of an isochrone. Costs above it are infinity in the result. Negative for no limit.
+     * @param resultTrees shortest path trees of the origins, as for dijkstra(), limited to the vertices reached
+     * before the search stopped. With no destination, they contain all vertices reachable within maxCost.
+     * @return costs of the paths, result[ originIndex ][ destinationIndex ] is infinity if the destination is not reachable
+     * @note added in QGIS 3.0
+     */
+    static QVector< QVector<double> > costMatrix( const QgsCompactGraph* source, const QVector<int>& origins, const QVector<int>& destinations, int criterionNum,
+        double maxCost = -1, QVector< QVector<int> >* resultTrees = nullptr );
+
     /**
      * return shortest path tree with root-node in startVertexIdx
      * @param source The source graph
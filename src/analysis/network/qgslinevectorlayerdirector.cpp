@@ -27,8 +27,15 @@
 #include <qgswkbtypes.h>
 
 // QT includes
+#include <QHash>
+#include <QList>
 #include <QString>
+#include <QThread>
 #include <QtAlgorithms>
+#include <QtConcurrentMap>
+
+#include <cmath>
+#include <cstring>
 
 /** \ingroup analysis
  * \class QgsPointCompare
@@ -92,14 +99,346 @@ struct TiePointInfo
   QgsPoint mLastPoint;
 };
 
-bool TiePointInfoCompare( const TiePointInfo& a, const TiePointInfo& b )
+//! Hash of a coordinate, -0.0 and 0.0 are the same key
+static uint coordinateHash( double value )
+{
+  value += 0.0;
+  quint64 bits;
+  memcpy( &bits, &value, sizeof( bits ) );
+  return qHash( bits );
+}
+
+/** \ingroup analysis
+ * Key of a vertex in the tolerance grid, or its exact coordinates without tolerance
+ */
+struct QgsVertexCellKey
+{
+  double x;
+  double y;
+
+  bool operator==( const QgsVertexCellKey& other ) const
+  {
+    return x == other.x && y == other.y;
+  }
+};
+
+inline uint qHash( const QgsVertexCellKey& key )
+{
+  return coordinateHash( key.x ) ^( coordinateHash( key.y ) * 31 );
+}
+
+/** \ingroup analysis
+ * Key of a segment, from its first and last point
+ */
+struct QgsSegmentKey
+{
+  double x1;
+  double y1;
+  double x2;
+  double y2;
+
+  bool operator==( const QgsSegmentKey& other ) const
+  {
+    return x1 == other.x1 && y1 == other.y1 && x2 == other.x2 && y2 == other.y2;
+  }
+};
+
+inline uint qHash( const QgsSegmentKey& key )
+{
+  return coordinateHash( key.x1 ) ^( coordinateHash( key.y1 ) * 31 ) ^( coordinateHash( key.x2 ) * 961 ) ^( coordinateHash( key.y2 ) * 29791 );
+}
+
+static QgsSegmentKey segmentKey( const QgsPoint& p1, const QgsPoint& p2 )
 {
-  if ( a.mFirstPoint == b.mFirstPoint )
-    return a.mLastPoint.x() == b.mLastPoint.x() ? a.mLastPoint.y() < b.mLastPoint.y() : a.mLastPoint.x() < b.mLastPoint.x();
+  QgsSegmentKey key;
+  // -0.0 and 0.0 compare equal, as they do for QgsPoint
+  key.x1 = p1.x() + 0.0;
+  key.y1 = p1.y() + 0.0;
+  key.x2 = p2.x() + 0.0;
+  key.y2 = p2.y() + 0.0;
+  return key;
+}
+
+//! Whether both coordinates of a point are finite, a NaN or infinite coordinate has no grid cell
+static bool isFinitePoint( const QgsPoint& pt )
+{
+  return qIsFinite( pt.x() ) && qIsFinite( pt.y() );
+}
 
-  return a.mFirstPoint.x() == b.mFirstPoint.x() ? a.mFirstPoint.y() < b.mFirstPoint.y() : a.mFirstPoint.x() < b.mFirstPoint.x();
+//! Index of the cell of a coordinate relative to the first cell, bounded to [0, cellCount - 1]
+static int cellIndex( double value, double cellSize, int cellCount )
+{
+  double index = floor( value / cellSize );
+  // also false for NaN
+  if ( !( index > 0 ) )
+    return 0;
+  return index < cellCount - 1 ? static_cast< int >( index ) : cellCount - 1;
 }
 
+/** \ingroup analysis
+ * Finds the index of graph vertices. All the points of a tolerance cell are
+ * found at the same index, the one found by a binary search in the sorted points.
+ */
+class QgsVertexLookup
+{
+  public:
+    QgsVertexLookup( const QVector< QgsPoint >& points, double tolerance )
+        : mPoints( points )
+        , mTolerance( tolerance )
+        , mCompare( tolerance )
+    {}
+
+    //! Index of the vertex merging a point, -1 if there is none
+    int index( const QgsPoint& pt )
+    {
+      QgsVertexCellKey key;
+      if ( mTolerance <= 0 )
+      {
+        key.x = pt.x() + 0.0;
+        key.y = pt.y() + 0.0;
+      }
+      else
+      {
+        key.x = ceil( pt.x() / mTolerance ) + 0.0;
+        key.y = ceil( pt.y() / mTolerance ) + 0.0;
+      }
+
+      QHash< QgsVertexCellKey, int >::const_iterator it = mIndexes.constFind( key );
+      if ( it != mIndexes.constEnd() )
+        return it.value();
+
+      // the binary search only compares cells, so its result is the same for all points of a cell
+      int idx = -1;
+      if ( !mPoints.isEmpty() )
+      {
+        QVector< QgsPoint >::const_iterator found = my_binary_search( mPoints.constBegin(), mPoints.constEnd(), pt, mCompare );
+        if ( found != mPoints.constEnd() )
+          idx = found - mPoints.constBegin();
+      }
+      mIndexes.insert( key, idx );
+      return idx;
+    }
+
+  private:
+    const QVector< QgsPoint >& mPoints;
+    double mTolerance;
+    QgsPointCompare mCompare;
+    QHash< QgsVertexCellKey, int > mIndexes;
+};
+
+/** \ingroup analysis
+ * Uniform grid of the segments of the layer, used to find the segment nearest to tie points.
+ * Each cell lists the segments whose bounding box intersects it, in order of segment index.
+ * All the points of the segments must be finite.
+ */
+class QgsSegmentGrid
+{
+  public:
+    explicit QgsSegmentGrid( const QVector< QgsPoint >& segmentPoints )
+        : mPoints( segmentPoints )
+        , mXMin( 0 )
+        , mYMin( 0 )
+        , mCellSize( 1 )
+        , mColumns( 1 )
+        , mRows( 1 )
+    {
+      int segmentCount = mPoints.size() / 2;
+      if ( segmentCount == 0 )
+      {
+        mOffsets.fill( 0, 2 );
+        return;
+      }
+
+      double xMax = mPoints.at( 0 ).x(), yMax = mPoints.at( 0 ).y();
+      mXMin = xMax;
+      mYMin = yMax;
+      double totalSize = 0;
+      for ( int i = 0; i < segmentCount; ++i )
+      {
+        const QgsPoint& p1 = mPoints.at( 2 * i );
+        const QgsPoint& p2 = mPoints.at( 2 * i + 1 );
+        mXMin = qMin( mXMin, qMin( p1.x(), p2.x() ) );
+        mYMin = qMin( mYMin, qMin( p1.y(), p2.y() ) );
+        xMax = qMax( xMax, qMax( p1.x(), p2.x() ) );
+        yMax = qMax( yMax, qMax( p1.y(), p2.y() ) );
+        totalSize += qMax( qAbs( p2.x() - p1.x() ), qAbs( p2.y() - p1.y() ) );
+      }
+
+      // about one segment per cell, cells not smaller than an average segment
+      double width = xMax - mXMin;
+      double height = yMax - mYMin;
+      mCellSize = qMax( sqrt( width * height / segmentCount ), totalSize / segmentCount );
+      mCellSize = qMax( mCellSize, qMax( width, height ) / segmentCount );
+      if ( !( mCellSize > 0 ) || !qIsFinite( width ) || !qIsFinite( height ) || !qIsFinite( mCellSize ) )
+      {
+        // extent too large to be measured, a single cell holds all the segments
+        mCellSize = 1;
+        width = 0;
+        height = 0;
+      }
+      mColumns = static_cast< int >( width / mCellSize ) + 1;
+      mRows = static_cast< int >( height / mCellSize ) + 1;
+
+      // count the segments of each cell, then fill the cells
+      mOffsets.fill( 0, mColumns * mRows + 1 );
+      for ( int pass = 0; pass < 2; ++pass )
+      {
+        QVector<int> next;
+        if ( pass == 1 )
+        {
+          for ( int c = 0; c < mColumns * mRows; ++c )
+            mOffsets[ c + 1 ] += mOffsets.at( c );
+          mSegments.resize( mOffsets.last() );
+          next = mOffsets;
+        }
+
+        for ( int i = 0; i < segmentCount; ++i )
+        {
+          const QgsPoint& p1 = mPoints.at( 2 * i );
+          const QgsPoint& p2 = mPoints.at( 2 * i + 1 );
+          int col1 = column( qMin( p1.x(), p2.x() ) ), col2 = column( qMax( p1.x(), p2.x() ) );
+          int row1 = row( qMin( p1.y(), p2.y() ) ), row2 = row( qMax( p1.y(), p2.y() ) );
+          for ( int r = row1; r <= row2; ++r )
+          {
+            for ( int c = col1; c <= col2; ++c )
+            {
+              if ( pass == 0 )
+                ++mOffsets[ r * mColumns + c + 1 ];
+              else
+                mSegments[ next[ r * mColumns + c ]++ ] = i;
+            }
+          }
+        }
+      }
+    }
+
+    /**
+     * Find the segment nearest to a point. Of several segments at the same distance,
+     * the one with the lowest index is chosen.
+     * @return false if there is no segment at a finite distance or if a coordinate of the point is not finite
+     */
+    bool nearest( const QgsPoint& pt, TiePointInfo& info ) const
+    {
+      if ( !isFinitePoint( pt ) )
+        return false;
+
+      int bestSegment = -1;
+      int col = static_cast< int >( qBound( -1.0e8, floor(( pt.x() - mXMin ) / mCellSize ), 1.0e8 ) );
+      int row = static_cast< int >( qBound( -1.0e8, floor(( pt.y() - mYMin ) / mCellSize ), 1.0e8 ) );
+
+      // visit rings of cells around the point, rings before the first one do not intersect the grid
+      int firstRing = qMax( qMax( 0, qMax( -col, col - mColumns + 1 ) ), qMax( -row, row - mRows + 1 ) );
+      for ( int ring = firstRing; ; ++ring )
+      {
+        // cells not visited yet are at least ( ring - 1 ) cells away from the point. Distances
+        // below the segment epsilon are 0, so segments that near can tie with the best one.
+        double minDistance = ( ring - 1 ) * mCellSize;
+        double minSqrDistance = minDistance * minDistance * ( 1 - 1e-9 );
+        if ( bestSegment >= 0 && ring > 0 && minSqrDistance > DEFAULT_SEGMENT_EPSILON && info.mLength < minSqrDistance )
+          break;
+
+        for ( int r = qMax( 0, row - ring ); r <= qMin( mRows - 1, row + ring ); ++r )
+        {
+          bool edgeRow = r == row - ring || r == row + ring;
+          for ( int c = qMax( 0, col - ring ); c <= qMin( mColumns - 1, col + ring ); ++c )
+          {
+            if ( !edgeRow && c != col - ring && c != col + ring )
+              continue;
+
+            for ( int i = mOffsets.at( r * mColumns + c ); i < mOffsets.at( r * mColumns + c + 1 ); ++i )
+            {
+              int segment = mSegments.at( i );
+              QgsPoint p1 = mPoints.at( 2 * segment );
+              QgsPoint p2 = mPoints.at( 2 * segment + 1 );
+              QgsPoint tiedPoint;
+              double length;
+              if ( p1 == p2 )
+              {
+                length = pt.sqrDist( p1 );
+                tiedPoint = p1;
+              }
+              else
+              {
+                length = pt.sqrDistToSegment( p1.x(), p1.y(), p2.x(), p2.y(), tiedPoint );
+              }
+              // an overflowing distance is never the nearest one
+              if ( !qIsFinite( length ) )
+                continue;
+
+              if ( bestSegment < 0 || length < info.mLength || ( length == info.mLength && segment < bestSegment ) )
+              {
+                bestSegment = segment;
+                info.mLength = length;
+                info.mTiedPoint = tiedPoint;
+                info.mFirstPoint = p1;
+                info.mLastPoint = p2;
+              }
+            }
+          }
+        }
+
+        if ( col - ring <= 0 && col + ring >= mColumns - 1 && row - ring <= 0 && row + ring >= mRows - 1 )
+          break;
+      }
+      return bestSegment >= 0;
+    }
+
+  private:
+    int column( double x ) const { return cellIndex( x - mXMin, mCellSize, mColumns ); }
+    int row( double y ) const { return cellIndex( y - mYMin, mCellSize, mRows ); }
+
+    //! first and last point of each segment
+    const QVector< QgsPoint >& mPoints;
+    double mXMin;
+    double mYMin;
+    double mCellSize;
+    int mColumns;
+    int mRows;
+    QVector<int> mOffsets;
+    QVector<int> mSegments;
+};
+
+//! Range of tie points, for QtConcurrent::blockingMap
+struct QgsTiePointRange
+{
+  int first;
+  //! one past the last tie point
+  int last;
+};
+
+//! Ties a range of points to their nearest segment
+class QgsTiePoints
+{
+  public:
+    QgsTiePoints( const QgsSegmentGrid& grid, const QVector< QgsPoint >& additionalPoints, TiePointInfo* infos, QgsPoint* tiedPoints )
+        : mGrid( grid )
+        , mAdditionalPoints( additionalPoints )
+        , mInfos( infos )
+        , mTiedPoints( tiedPoints )
+    {}
+
+    typedef void result_type;
+
+    void operator()( const QgsTiePointRange& range ) const
+    {
+      for ( int i = range.first; i < range.last; ++i )
+      {
+        TiePointInfo info;
+        if ( mGrid.nearest( mAdditionalPoints.at( i ), info ) )
+        {
+          mInfos[i] = info;
+          mTiedPoints[i] = info.mTiedPoint;
+        }
+      }
+    }
+
+  private:
+    const QgsSegmentGrid& mGrid;
+    const QVector< QgsPoint >& mAdditionalPoints;
+    TiePointInfo* mInfos;
+    QgsPoint* mTiedPoints;
+};
+
 QgsLineVectorLayerDirector::QgsLineVectorLayerDirector( QgsVectorLayer *myLayer,
     int directionFieldId,
     const QString& directDirectionValue,
@@ -154,11 +493,13 @@ void QgsLineVectorLayerDirector::makeGraph( QgsGraphBuilderInterface *builder, c
   tmpInfo.mLength = std::numeric_limits<double>::infinity();
 
   QVector< TiePointInfo > pointLengthMap( additionalPoints.size(), tmpInfo );
-  QVector< TiePointInfo >::iterator pointLengthIt;
 
   //Graph's points;
   QVector< QgsPoint > points;
 
+  // first and last point of each segment, in the order of the layer
+  QVector< QgsPoint > segmentPoints;
+
   QgsFeatureIterator fit = vl->getFeatures( QgsFeatureRequest().setSubsetOfAttributes( QgsAttributeList() ) );
 
   // begin: tie points to the graph
@@ -183,33 +524,11 @@ void QgsLineVectorLayerDirector::makeGraph( QgsGraphBuilderInterface *builder, c
         pt2 = ct.transform( *pointIt );
         points.push_back( pt2 );
 
-        if ( !isFirstPoint )
+        // segments with a NaN or infinite coordinate are never the nearest one
+        if ( !isFirstPoint && !additionalPoints.isEmpty() && isFinitePoint( pt1 ) && isFinitePoint( pt2 ) )
         {
-          int i = 0;
-          for ( i = 0; i != additionalPoints.size(); ++i )
-          {
-            TiePointInfo info;
-            if ( pt1 == pt2 )
-            {
-              info.mLength = additionalPoints[ i ].sqrDist( pt1 );
-              info.mTiedPoint = pt1;
-            }
-            else
-            {
-              info.mLength = additionalPoints[ i ].sqrDistToSegment( pt1.x(), pt1.y(),
-                             pt2.x(), pt2.y(), info.mTiedPoint );
-            }
-
-            if ( pointLengthMap[ i ].mLength > info.mLength )
-            {
-              Q_UNUSED( info.mTiedPoint );
-              info.mFirstPoint = pt1;
-              info.mLastPoint = pt2;
-
-              pointLengthMap[ i ] = info;
-              tiedPoint[ i ] = info.mTiedPoint;
-            }
-          }
+          segmentPoints.push_back( pt1 );
+          segmentPoints.push_back( pt2 );
         }
         pt1 = pt2;
         isFirstPoint = false;
@@ -217,6 +536,34 @@ void QgsLineVectorLayerDirector::makeGraph( QgsGraphBuilderInterface *builder, c
     }
     emit buildProgress( ++step, featureCount );
   }
+
+  // each point is tied to the nearest segment, or to the first one in the layer at the same distance.
+  // Points with a NaN or infinite coordinate are not tied.
+  if ( !segmentPoints.isEmpty() )
+  {
+    QgsSegmentGrid grid( segmentPoints );
+
+    int rangeSize = qMax( 1, additionalPoints.size() / ( 4 * qMax( 1, QThread::idealThreadCount() ) ) );
+    QList< QgsTiePointRange > ranges;
+    for ( int first = 0; first < additionalPoints.size(); first += rangeSize )
+    {
+      QgsTiePointRange range;
+      range.first = first;
+      range.last = qMin( first + rangeSize, additionalPoints.size() );
+      ranges << range;
+    }
+
+    // results are detached here, each range then only writes its own points
+    QgsTiePoints tie( grid, additionalPoints, pointLengthMap.data(), tiedPoint.data() );
+    if ( ranges.size() > 1 )
+    {
+      QtConcurrent::blockingMap( ranges, tie );
+    }
+    else
+    {
+      tie( ranges.at( 0 ) );
+    }
+  }
   // end: tie points to graph
 
   // add tied point to graph
@@ -238,10 +585,21 @@ void QgsLineVectorLayerDirector::makeGraph( QgsGraphBuilderInterface *builder, c
   for ( i = 0;i < points.size();++i )
     builder->addVertex( i, points[ i ] );
 
+  QgsVertexLookup vertexLookup( points, builder->topologyTolerance() );
   for ( i = 0; i < tiedPoint.size() ; ++i )
-    tiedPoint[ i ] = *( my_binary_search( points.begin(), points.end(), tiedPoint[ i ], pointCompare ) );
+  {
+    int idx = vertexLookup.index( tiedPoint[ i ] );
+    if ( idx >= 0 )
+      tiedPoint[ i ] = points[ idx ];
+  }
 
-  qSort( pointLengthMap.begin(), pointLengthMap.end(), TiePointInfoCompare );
+  // tied points of each segment
+  QHash< QgsSegmentKey, QgsPoint > segmentTiedPoints;
+  QVector< TiePointInfo >::const_iterator pointLengthIt;
+  for ( pointLengthIt = pointLengthMap.constBegin(); pointLengthIt != pointLengthMap.constEnd(); ++pointLengthIt )
+  {
+    segmentTiedPoints.insertMulti( segmentKey( pointLengthIt->mFirstPoint, pointLengthIt->mLastPoint ), pointLengthIt->mTiedPoint );
+  }
 
   {
     // fill attribute list 'la'
@@ -323,29 +681,10 @@ void QgsLineVectorLayerDirector::makeGraph( QgsGraphBuilderInterface *builder, c
           pointsOnArc[ 0.0 ] = pt1;
           pointsOnArc[ pt1.sqrDist( pt2 )] = pt2;
 
-          TiePointInfo t;
-          t.mFirstPoint = pt1;
-          t.mLastPoint  = pt2;
-          t.mLength = 0.0;
-          pointLengthIt = my_binary_search( pointLengthMap.begin(), pointLengthMap.end(), t, TiePointInfoCompare );
-
-          if ( pointLengthIt != pointLengthMap.end() )
+          QHash< QgsSegmentKey, QgsPoint >::const_iterator it = segmentTiedPoints.constFind( segmentKey( pt1, pt2 ) );
+          for ( ; it != segmentTiedPoints.constEnd() && it.key() == segmentKey( pt1, pt2 ); ++it )
           {
-            QVector< TiePointInfo >::iterator it;
-            for ( it = pointLengthIt; it - pointLengthMap.begin() >= 0; --it )
-            {
-              if ( it->mFirstPoint == pt1 && it->mLastPoint == pt2 )
-              {
-                pointsOnArc[ pt1.sqrDist( it->mTiedPoint )] = it->mTiedPoint;
-              }
-            }
-            for ( it = pointLengthIt + 1; it != pointLengthMap.end(); ++it )
-            {
-              if ( it->mFirstPoint == pt1 && it->mLastPoint == pt2 )
-              {
-                pointsOnArc[ pt1.sqrDist( it->mTiedPoint )] = it->mTiedPoint;
-              }
-            }
+            pointsOnArc[ pt1.sqrDist( it.value() )] = it.value();
           }
 
           QMap< double, QgsPoint >::iterator pointsIt;
@@ -355,10 +694,10 @@ void QgsLineVectorLayerDirector::makeGraph( QgsGraphBuilderInterface *builder, c
           bool isFirstPoint = true;
           for ( pointsIt = pointsOnArc.begin(); pointsIt != pointsOnArc.end(); ++pointsIt )
           {
-            pt2 = *pointsIt;
-            tmp = my_binary_search( points.begin(), points.end(), pt2, pointCompare );
-            pt2 = *tmp;
-            pt2idx = tmp - points.begin();
+            pt2idx = vertexLookup.index( *pointsIt );
+            if ( pt2idx < 0 )
+              continue;
+            pt2 = points[ pt2idx ];
 
             if ( !isFirstPoint && pt1 != pt2 )
             {
@@ -0,0 +1,137 @@
+/***************************************************************************
+  qgsvertexheap.h
+  --------------------------------------
+  Date                 : October 2016
+  Copyright            : (C) 2016 by the QGIS project
+****************************************************************************
+*                                                                          *
+*   This program is free software; you can redistribute it and/or modify   *
+*   it under the terms of the GNU General Public License as published by   *
+*   the Free Software Foundation; either version 2 of the License, or      *
+*   (at your option) any later version.                                    *
+*                                                                          *
+***************************************************************************/
+
+#ifndef QGSVERTEXHEAPH
+#define QGSVERTEXHEAPH
+
+#include <QVector>
+
+/**
+ * Binary min-heap of vertices keyed by cost, with decrease-key.
+ * A vertex popped from the heap may be pushed again, so negative arc costs
+ * are still handled (at the price of visiting vertices more than once).
+ * @note not available in Python bindings
+ */
+class QgsVertexHeap
+{
+  public:
+    explicit QgsVertexHeap( int vertexCount )
+        : mPos( vertexCount, -1 )
+    {}
+
+    bool isEmpty() const { return mHeap.isEmpty(); }
+
+    //! Cost of the vertex at the top of the heap
+    double topKey() const { return mHeap.at( 0 ).key; }
+
+    //! Remove the vertex with the lowest cost and return it
+    int pop()
+    {
+      int vertex = mHeap.at( 0 ).vertex;
+      mPos[ vertex ] = -1;
+      Entry last = mHeap.last();
+      mHeap.pop_back();
+      if ( !mHeap.isEmpty() )
+      {
+        mHeap[0] = last;
+        mPos[ last.vertex ] = 0;
+        siftDown( 0 );
+      }
+      return vertex;
+    }
+
+    //! Remove all vertices from the heap
+    void clear()
+    {
+      for ( int i = 0; i < mHeap.size(); ++i )
+      {
+        mPos[ mHeap.at( i ).vertex ] = -1;
+      }
+      mHeap.clear();
+    }
+
+    //! Insert a vertex, or lower its cost if it is already in the heap
+    void push( int vertex, double key )
+    {
+      int i = mPos.at( vertex );
+      if ( i < 0 )
+      {
+        Entry e;
+        e.key = key;
+        e.vertex = vertex;
+        mHeap.append( e );
+        i = mHeap.size() - 1;
+        mPos[ vertex ] = i;
+      }
+      else if ( key < mHeap.at( i ).key )
+      {
+        mHeap[i].key = key;
+      }
+      else
+      {
+        return;
+      }
+      siftUp( i );
+    }
+
+  private:
+    struct Entry
+    {
+      double key;
+      int vertex;
+    };
+
+    void siftUp( int i )
+    {
+      Entry e = mHeap.at( i );
+      while ( i > 0 )
+      {
+        int parent = ( i - 1 ) / 2;
+        if ( !( e.key < mHeap.at( parent ).key ) )
+          break;
+        mHeap[i] = mHeap.at( parent );
+        mPos[ mHeap.at( i ).vertex ] = i;
+        i = parent;
+      }
+      mHeap[i] = e;
+      mPos[ e.vertex ] = i;
+    }
+
+    void siftDown( int i )
+    {
+      Entry e = mHeap.at( i );
+      int size = mHeap.size();
+      for ( ;; )
+      {
+        int child = 2 * i + 1;
+        if ( child >= size )
+          break;
+        if ( child + 1 < size && mHeap.at( child + 1 ).key < mHeap.at( child ).key )
+          ++child;
+        if ( !( mHeap.at( child ).key < e.key ) )
+          break;
+        mHeap[i] = mHeap.at( child );
+        mPos[ mHeap.at( i ).vertex ] = i;
+        i = child;
+      }
+      mHeap[i] = e;
+      mPos[ e.vertex ] = i;
+    }
+
+    QVector<Entry> mHeap;
+    //! position of each vertex in the heap, -1 if it is not in the heap
+    QVector<int> mPos;
+};
+
+#endif // QGSVERTEXHEAPH
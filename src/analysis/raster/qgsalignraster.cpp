@@ -23,6 +23,8 @@
 #include <qmath.h>
 #include <QPair>
 #include <QString>
+#include <QThread>
+#include <QtConcurrentMap>
 
 #include "qgscoordinatereferencesystem.h"
 #include "qgsrectangle.h"
@@ -61,17 +63,55 @@ static QgsRectangle transform_to_extent( const double* geotransform, double xSiz
 }
 
 
+//! Progress argument of the warp of one raster
+struct QgsAlignRasterProgressArg
+{
+  QgsAlignRaster* align;
+  int index;
+
+  bool update( double complete )
+  {
+    if ( index >= 0 )
+      return align->updateProgress( index, complete );
+
+    // a raster aligned on its own, from the calling thread
+    QgsAlignRaster::ProgressHandler* handler = align->progressHandler();
+    return handler ? handler->progress( complete ) : true;
+  }
+};
+
 static int CPL_STDCALL _progress( double dfComplete, const char* pszMessage, void* pProgressArg )
 {
   Q_UNUSED( pszMessage );
 
-  QgsAlignRaster::ProgressHandler* handler = (( QgsAlignRaster* ) pProgressArg )->progressHandler();
-  if ( handler )
-    return handler->progress( dfComplete );
-  else
-    return true;
+  return static_cast< QgsAlignRasterProgressArg* >( pProgressArg )->update( dfComplete );
 }
 
+//! Aligns one raster, for QtConcurrent::map
+class QgsAlignRasterWarp
+{
+  public:
+    explicit QgsAlignRasterWarp( QgsAlignRaster* align )
+        : mAlign( align )
+    {}
+
+    typedef void result_type;
+
+    void operator()( int index )
+    {
+      {
+        QMutexLocker locker( &mAlign->mProgressMutex );
+        if ( mAlign->mCanceled )
+          return;
+      }
+      if ( mAlign->createAndWarp( mAlign->mRasters.at( index ), index ) )
+        mAlign->updateProgress( index, 1.0 );
+    }
+
+  private:
+    QgsAlignRaster* mAlign;
+};
+
 
 static CPLErr rescalePreWarpChunkProcessor( void* pKern, void* pArg )
 {
@@ -118,6 +158,10 @@ static CPLErr rescalePostWarpChunkProcessor( void* pKern, void* pArg )
 
 QgsAlignRaster::QgsAlignRaster()
     : mProgressHandler( nullptr )
+    , mMemoryLimit( 0 )
+    , mCanceled( false )
+    , mWarpThreads( 1 )
+    , mWarpMemoryLimit( 0 )
 {
   // parameters
   mCellSizeX = mCellSizeY = 0;
@@ -365,12 +409,99 @@ bool QgsAlignRaster::run()
 
   //dump();
 
-  Q_FOREACH ( const Item& r, mRasters )
+  int rasterCount = mRasters.count();
+  if ( rasterCount == 0 )
+    return true;
+
+  // Rasters are aligned concurrently, and each warp uses the remaining threads
+  int threads = qMax( 1, QThread::idealThreadCount() );
+  int concurrentRasters = qMin( rasterCount, threads );
+  mWarpThreads = qMax( 1, threads / concurrentRasters );
+  mWarpMemoryLimit = mMemoryLimit > 0 ? mMemoryLimit * 1024.0 * 1024.0 / concurrentRasters : 0;
+
+  mRasterProgress.fill( 0, rasterCount );
+  mReportedProgress.fill( -1, rasterCount );
+  mCanceled = false;
+
+  QList<int> indexes;
+  for ( int i = 0; i < rasterCount; ++i )
+    indexes << i;
+  QFuture<void> future = QtConcurrent::map( indexes, QgsAlignRasterWarp( this ) );
+
+  // the progress handler is called from this thread, e.g. to update widgets
+  while ( !future.isFinished() )
+  {
+    {
+      QMutexLocker locker( &mProgressMutex );
+      mProgressChanged.wait( &mProgressMutex, 100 );
+    }
+    if ( !reportProgress() )
+    {
+      QMutexLocker locker( &mProgressMutex );
+      mCanceled = true;
+    }
+  }
+  future.waitForFinished();
+  reportProgress();
+
+  QMutexLocker locker( &mProgressMutex );
+  if ( mCanceled && mErrorMessage.isEmpty() )
+  {
+    mErrorMessage = QObject::tr( "Alignment was cancelled." );
+  }
+  return !mCanceled;
+}
+
+bool QgsAlignRaster::updateProgress( int index, double complete )
+{
+  QMutexLocker locker( &mProgressMutex );
+  if ( index >= 0 && index < mRasterProgress.size() )
+  {
+    mRasterProgress[index] = complete;
+  }
+  mProgressChanged.wakeAll();
+  return !mCanceled;
+}
+
+void QgsAlignRaster::setError( const QString& message )
+{
+  QMutexLocker locker( &mProgressMutex );
+  if ( mErrorMessage.isEmpty() )
+  {
+    mErrorMessage = message;
+  }
+  mCanceled = true;
+  mProgressChanged.wakeAll();
+}
+
+bool QgsAlignRaster::reportProgress()
+{
+  QVector<double> progress;
+  {
+    QMutexLocker locker( &mProgressMutex );
+    progress = mRasterProgress;
+  }
+
+  if ( !mProgressHandler || progress.isEmpty() )
+    return true;
+
+  bool changed = false;
+  double total = 0;
+  for ( int i = 0; i < progress.size(); ++i )
   {
-    if ( !createAndWarp( r ) )
+    total += progress.at( i );
+    if ( progress.at( i ) == mReportedProgress.at( i ) )
+      continue;
+
+    changed = true;
+    mReportedProgress[i] = progress.at( i );
+    if ( !mProgressHandler->rasterProgress( i, progress.at( i ) ) )
       return false;
   }
-  return true;
+  if ( !changed )
+    return true;
+
+  return mProgressHandler->progress( total / progress.size() );
 }
 
 
@@ -418,12 +549,12 @@ int QgsAlignRaster::suggestedReferenceLayer() const
 }
 
 
-bool QgsAlignRaster::createAndWarp( const Item& raster )
+bool QgsAlignRaster::createAndWarp( const Item& raster, int index )
 {
   GDALDriverH hDriver = GDALGetDriverByName( "GTiff" );
   if ( !hDriver )
   {
-    mErrorMessage = QString( "GDALGetDriverByName(GTiff) failed." );
+    setError( QString( "GDALGetDriverByName(GTiff) failed." ) );
     return false;
   }
 
@@ -431,7 +562,7 @@ bool QgsAlignRaster::createAndWarp( const Item& raster )
   GDALDatasetH hSrcDS = GDALOpen( raster.inputFilename.toLocal8Bit().constData(), GA_ReadOnly );
   if ( !hSrcDS )
   {
-    mErrorMessage = QObject::tr( "Unable to open input file: %1" ).arg( raster.inputFilename );
+    setError( QObject::tr( "Unable to open input file: %1" ).arg( raster.inputFilename ) );
     return false;
   }
 
@@ -447,7 +578,7 @@ bool QgsAlignRaster::createAndWarp( const Item& raster )
   if ( !hDstDS )
   {
     GDALClose( hSrcDS );
-    mErrorMessage = QObject::tr( "Unable to create output file: %1" ).arg( raster.outputFilename );
+    setError( QObject::tr( "Unable to create output file: %1" ).arg( raster.outputFilename ) );
     return false;
   }
 
@@ -479,8 +610,16 @@ bool QgsAlignRaster::createAndWarp( const Item& raster )
   psWarpOptions->eResampleAlg = static_cast< GDALResampleAlg >( raster.resampleMethod );
 
   // our progress function
+  QgsAlignRasterProgressArg progressArg;
+  progressArg.align = this;
+  progressArg.index = index;
   psWarpOptions->pfnProgress = _progress;
-  psWarpOptions->pProgressArg = this;
+  psWarpOptions->pProgressArg = &progressArg;
+
+  // multithreaded warping, within the memory budget
+  psWarpOptions->papszWarpOptions = CSLSetNameValue( psWarpOptions->papszWarpOptions, "NUM_THREADS", QString::number( mWarpThreads ).toAscii().constData() );
+  if ( mWarpMemoryLimit > 0 )
+    psWarpOptions->dfWarpMemoryLimit = mWarpMemoryLimit;
 
   // Establish reprojection transformer.
   psWarpOptions->pTransformerArg =
@@ -505,13 +644,27 @@ bool QgsAlignRaster::createAndWarp( const Item& raster )
   // Initialize and execute the warp operation.
   GDALWarpOperation oOperation;
   oOperation.Initialize( psWarpOptions );
-  oOperation.ChunkAndWarpImage( 0, 0, mXSize, mYSize );
+  // overlaps reading and writing with warping
+  CPLErr err = oOperation.ChunkAndWarpMulti( 0, 0, mXSize, mYSize );
 
   GDALDestroyGenImgProjTransformer( psWarpOptions->pTransformerArg );
   GDALDestroyWarpOptions( psWarpOptions );
 
   GDALClose( hDstDS );
   GDALClose( hSrcDS );
+
+  if ( err != CE_None )
+  {
+    // cancellation is reported by run()
+    bool canceled;
+    {
+      QMutexLocker locker( &mProgressMutex );
+      canceled = mCanceled;
+    }
+    if ( !canceled )
+      setError( QObject::tr( "Unable to align raster: %1" ).arg( raster.inputFilename ) );
+    return false;
+  }
   return true;
 }
 
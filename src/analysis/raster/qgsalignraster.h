@@ -17,9 +17,12 @@
 #define QGSALIGNRASTER_H
 
 #include <QList>
+#include <QMutex>
 #include <QPointF>
 #include <QSizeF>
 #include <QString>
+#include <QVector>
+#include <QWaitCondition>
 #include <gdal_version.h>
 
 class QgsRectangle;
@@ -147,6 +150,14 @@ class ANALYSIS_EXPORT QgsAlignRaster
       //! @return false if the execution should be cancelled, true otherwise
       virtual bool progress( double complete ) = 0;
 
+      //! Method to be overridden for progress reporting of each raster.
+      //! Rasters are aligned concurrently, it is called before progress().
+      //! @param index Index of the raster in the list of rasters
+      //! @param complete Progress of the alignment of the raster
+      //! @return false if the execution should be cancelled, true otherwise
+      //! @note added in QGIS 3.0
+      virtual bool rasterProgress( int index, double complete ) { Q_UNUSED( index ); Q_UNUSED( complete ); return true; }
+
       virtual ~ProgressHandler() {}
     };
 
@@ -210,7 +221,16 @@ class ANALYSIS_EXPORT QgsAlignRaster
     //! @note first need to run checkInputParameters() which returns with success
     QgsRectangle alignedRasterExtent() const;
 
-    //! Run the alignment process
+    //! Set the working memory budget of the alignment, in megabytes. It is shared
+    //! by the rasters aligned at the same time. 0 uses GDAL's default limit for each raster.
+    //! @note added in QGIS 3.0
+    void setMemoryLimit( int megabytes ) { mMemoryLimit = megabytes; }
+    //! Get the working memory budget of the alignment, in megabytes
+    //! @note added in QGIS 3.0
+    int memoryLimit() const { return mMemoryLimit; }
+
+    //! Run the alignment process. Rasters are aligned concurrently, with GDAL
+    //! multithreaded warping. Progress handler is called from the calling thread.
     //! @return true on success, sets error on error (see errorMessage())
     bool run();
 
@@ -227,7 +247,9 @@ class ANALYSIS_EXPORT QgsAlignRaster
   protected:
 
     //! Internal function for processing of one raster (1. create output, 2. do the alignment)
-    bool createAndWarp( const Item& raster );
+    //! @param raster raster to align
+    //! @param index index of the raster for progress reporting, -1 to report its progress as overall progress
+    bool createAndWarp( const Item& raster, int index = -1 );
 
     //! Determine suggested output of raster warp to a different CRS. Returns true on success
     static bool suggestedWarpOutput( const RasterInfo& info, const QString& destWkt, QSizeF* cellSize = nullptr, QPointF* gridOffset = nullptr, QgsRectangle* rect = nullptr );
@@ -263,6 +285,37 @@ class ANALYSIS_EXPORT QgsAlignRaster
     //! Computed raster grid width/height
     int mXSize, mYSize;
 
+    //! Working memory budget in megabytes, 0 for GDAL default
+    int mMemoryLimit;
+
+  private:
+    QgsAlignRaster( const QgsAlignRaster& rh );
+    QgsAlignRaster& operator=( const QgsAlignRaster& rh );
+
+    //! Record the progress of a raster, called by warping threads. Returns false if cancelled
+    bool updateProgress( int index, double complete );
+    //! Record the error of a raster and cancel the other ones, called by warping threads
+    void setError( const QString& message );
+    //! Report recorded progress to the progress handler. Returns false if cancelled
+    bool reportProgress();
+
+    //! Guards progress and error of the rasters being aligned
+    QMutex mProgressMutex;
+    //! Signalled when a raster makes progress
+    QWaitCondition mProgressChanged;
+    //! Progress of each raster being aligned
+    QVector<double> mRasterProgress;
+    //! Progress of each raster last reported to the progress handler
+    QVector<double> mReportedProgress;
+    //! Whether the run was cancelled or failed
+    bool mCanceled;
+    //! Number of threads used by each GDAL warp
+    int mWarpThreads;
+    //! Working memory limit of each GDAL warp, in bytes, 0 for default
+    double mWarpMemoryLimit;
+
+    friend class QgsAlignRasterWarp;
+    friend struct QgsAlignRasterProgressArg;
 };
 
 
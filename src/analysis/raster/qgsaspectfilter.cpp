@@ -17,10 +17,13 @@
 
 #include "qgsaspectfilter.h"
 
+#include <typeinfo>
+
 QgsAspectFilter::QgsAspectFilter( const QString& inputFile, const QString& outputFile, const QString& outputFormat )
     : QgsDerivativeFilter( inputFile, outputFile, outputFormat )
 {
-
+  // the windows of the filter are reentrant
+  setMultiThreaded( true );
 }
 
 QgsAspectFilter::~QgsAspectFilter()
@@ -48,3 +51,18 @@ float QgsAspectFilter::processNineCellWindow(
   }
 }
 
+void QgsAspectFilter::processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCols )
+{
+  // subclasses reimplementing processNineCellWindow(), in C++ or Python, get their own windows
+  if ( typeid( *this ) != typeid( QgsAspectFilter ) )
+  {
+    QgsNineCellFilter::processNineCellRow( rowAbove, row, rowBelow, result, nCols );
+    return;
+  }
+
+  for ( int i = 0; i < nCols; ++i )
+  {
+    result[i] = QgsAspectFilter::processNineCellWindow( &rowAbove[i], &rowAbove[i+1], &rowAbove[i+2], &row[i], &row[i+1],
+                &row[i+2], &rowBelow[i], &rowBelow[i+1], &rowBelow[i+2] );
+  }
+}
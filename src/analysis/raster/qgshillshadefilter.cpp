@@ -17,12 +17,16 @@
 
 #include "qgshillshadefilter.h"
 
+#include <typeinfo>
+
 QgsHillshadeFilter::QgsHillshadeFilter( const QString& inputFile, const QString& outputFile, const QString& outputFormat, double lightAzimuth,
                                         double lightAngle )
     : QgsDerivativeFilter( inputFile, outputFile, outputFormat )
     , mLightAzimuth( lightAzimuth )
     , mLightAngle( lightAngle )
 {
+  // the windows of the filter are reentrant
+  setMultiThreaded( true );
 }
 
 QgsHillshadeFilter::~QgsHillshadeFilter()
@@ -55,3 +59,19 @@ float QgsHillshadeFilter::processNineCellWindow( float* x11, float* x21, float*
   }
   return qMax( 0.0, 255.0 * (( cos( zenith_rad ) * cos( slope_rad ) ) + ( sin( zenith_rad ) * sin( slope_rad ) * cos( azimuth_rad - aspect_rad ) ) ) );
 }
+
+void QgsHillshadeFilter::processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCols )
+{
+  // subclasses reimplementing processNineCellWindow(), in C++ or Python, get their own windows
+  if ( typeid( *this ) != typeid( QgsHillshadeFilter ) )
+  {
+    QgsNineCellFilter::processNineCellRow( rowAbove, row, rowBelow, result, nCols );
+    return;
+  }
+
+  for ( int i = 0; i < nCols; ++i )
+  {
+    result[i] = QgsHillshadeFilter::processNineCellWindow( &rowAbove[i], &rowAbove[i+1], &rowAbove[i+2], &row[i], &row[i+1],
+                &row[i+2], &rowBelow[i], &rowBelow[i+1], &rowBelow[i+2] );
+  }
+}
@@ -20,6 +20,9 @@
 #include "cpl_string.h"
 #include <QProgressDialog>
 #include <QFile>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrentMap>
 
 #if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 1800
 #define TO8F(x) (x).toUtf8().constData()
@@ -27,6 +30,40 @@
 #define TO8F(x) QFile::encodeName( x ).constData()
 #endif
 
+//! Maximum number of cells of the strips of rows read and calculated at once
+static const int MAX_STRIP_CELLS = 4 * 1024 * 1024;
+
+//! Calculates ranges of rows of a strip, used with QtConcurrent
+class QgsNineCellRowsCalculation
+{
+  public:
+    QgsNineCellRowsCalculation( QgsNineCellFilter* filter, float* input, float* output, int nCols )
+        : mFilter( filter )
+        , mInput( input )
+        , mOutput( output )
+        , mCols( nCols )
+    {}
+
+    typedef void result_type;
+
+    void operator()( const QPair<int, int>& rows )
+    {
+      int rowLength = mCols + 2;
+      for ( int i = rows.first; i < rows.first + rows.second; ++i )
+      {
+        //input row 0 is the row above the strip
+        float* rowAbove = mInput + i * rowLength;
+        mFilter->processNineCellRow( rowAbove, rowAbove + rowLength, rowAbove + 2 * rowLength, mOutput + i * mCols, mCols );
+      }
+    }
+
+  private:
+    QgsNineCellFilter* mFilter;
+    float* mInput;
+    float* mOutput;
+    int mCols;
+};
+
 QgsNineCellFilter::QgsNineCellFilter( const QString& inputFile, const QString& outputFile, const QString& outputFormat )
     : mInputFile( inputFile )
     , mOutputFile( outputFile )
@@ -36,6 +73,8 @@ QgsNineCellFilter::QgsNineCellFilter( const QString& inputFile, const QString& o
     , mInputNodataValue( -1.0 )
     , mOutputNodataValue( -1.0 )
     , mZFactor( 1.0 )
+    , mMultiThreaded( false )
+    , mMaxStripHeight( 0 )
 {
 
 }
@@ -46,6 +85,8 @@ QgsNineCellFilter::QgsNineCellFilter()
     , mInputNodataValue( -1.0 )
     , mOutputNodataValue( -1.0 )
     , mZFactor( 1.0 )
+    , mMultiThreaded( false )
+    , mMaxStripHeight( 0 )
 {
 }
 
@@ -107,24 +148,29 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
     return 6;
   }
 
-  //keep only three scanlines in memory at a time
-  float* scanLine1 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
-  float* scanLine2 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
-  float* scanLine3 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
+  //the raster is processed in strips of rows. The input strip has an additional row above and below
+  //and a nodata column on each side, so that every cell has a full 3x3 window. Values outside the layer extent
+  //(if the 3x3 window is on the border) are sent to the processing method as (input) nodata values
+  int stripRows = stripHeight( outputRasterBand, xSize, ySize );
+  if ( mMaxStripHeight > 0 )
+  {
+    stripRows = qMin( stripRows, mMaxStripHeight );
+  }
+  QVector<float> input(( stripRows + 2 ) * ( xSize + 2 ) );
+  QVector<float> output( stripRows * xSize );
 
-  float* resultLine = ( float * ) CPLMalloc( sizeof( float ) * xSize );
+  int nThreads = mMultiThreaded ? qMax( 1, QThread::idealThreadCount() ) : 1;
 
   if ( p )
   {
     p->setMaximum( ySize );
   }
 
-  //values outside the layer extent (if the 3x3 window is on the border) are sent to the processing method as (input) nodata values
-  for ( int i = 0; i < ySize; ++i )
+  for ( int startRow = 0; startRow < ySize; startRow += stripRows )
   {
     if ( p )
     {
-      p->setValue( i );
+      p->setValue( startRow );
     }
 
     if ( p && p->wasCanceled() )
@@ -132,62 +178,24 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
       break;
     }
 
-    if ( i == 0 )
+    int nRows = qMin( stripRows, ySize - startRow );
+    if ( !readStrip( rasterBand, startRow, nRows, xSize, ySize, mInputNodataValue, input.data() ) )
     {
-      //fill scanline 1 with (input) nodata for the values above the first row and feed scanline2 with the first row
-      for ( int a = 0; a < xSize; ++a )
-      {
-        scanLine1[a] = mInputNodataValue;
-      }
-      if ( GDALRasterIO( rasterBand, GF_Read, 0, 0, xSize, 1, scanLine2, xSize, 1, GDT_Float32, 0, 0 ) != CE_None )
-      {
-        QgsDebugMsg( "Raster IO Error" );
-      }
-    }
-    else
-    {
-      //normally fetch only scanLine3 and release scanline 1 if we move forward one row
-      CPLFree( scanLine1 );
-      scanLine1 = scanLine2;
-      scanLine2 = scanLine3;
-      scanLine3 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
+      QgsDebugMsg( "Raster IO Error" );
     }
 
-    if ( i == ySize - 1 ) //fill the row below the bottom with nodata values
+    QVector< QPair<int, int> > ranges = stripRowRanges( nRows, nThreads );
+    QgsNineCellRowsCalculation calculation( this, input.data(), output.data(), xSize );
+    if ( nThreads > 1 )
     {
-      for ( int a = 0; a < xSize; ++a )
-      {
-        scanLine3[a] = mInputNodataValue;
-      }
+      QtConcurrent::blockingMap( ranges, calculation );
     }
     else
     {
-      if ( GDALRasterIO( rasterBand, GF_Read, 0, i + 1, xSize, 1, scanLine3, xSize, 1, GDT_Float32, 0, 0 ) != CE_None )
-      {
-        QgsDebugMsg( "Raster IO Error" );
-      }
-    }
-
-    for ( int j = 0; j < xSize; ++j )
-    {
-      if ( j == 0 )
-      {
-        resultLine[j] = processNineCellWindow( &mInputNodataValue, &scanLine1[j], &scanLine1[j+1], &mInputNodataValue, &scanLine2[j],
-                                               &scanLine2[j+1], &mInputNodataValue, &scanLine3[j], &scanLine3[j+1] );
-      }
-      else if ( j == xSize - 1 )
-      {
-        resultLine[j] = processNineCellWindow( &scanLine1[j-1], &scanLine1[j], &mInputNodataValue, &scanLine2[j-1], &scanLine2[j],
-                                               &mInputNodataValue, &scanLine3[j-1], &scanLine3[j], &mInputNodataValue );
-      }
-      else
-      {
-        resultLine[j] = processNineCellWindow( &scanLine1[j-1], &scanLine1[j], &scanLine1[j+1], &scanLine2[j-1], &scanLine2[j],
-                                               &scanLine2[j+1], &scanLine3[j-1], &scanLine3[j], &scanLine3[j+1] );
-      }
+      calculation( ranges.at( 0 ) );
     }
 
-    if ( GDALRasterIO( outputRasterBand, GF_Write, 0, i, xSize, 1, resultLine, xSize, 1, GDT_Float32, 0, 0 ) != CE_None )
+    if ( GDALRasterIO( outputRasterBand, GF_Write, 0, startRow, xSize, nRows, output.data(), xSize, nRows, GDT_Float32, 0, 0 ) != CE_None )
     {
       QgsDebugMsg( "Raster IO Error" );
     }
@@ -198,11 +206,6 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
     p->setValue( ySize );
   }
 
-  CPLFree( resultLine );
-  CPLFree( scanLine1 );
-  CPLFree( scanLine2 );
-  CPLFree( scanLine3 );
-
   GDALClose( inputDataset );
 
   if ( p && p->wasCanceled() )
@@ -216,6 +219,77 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
   return 0;
 }
 
+void QgsNineCellFilter::processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCols )
+{
+  for ( int i = 0; i < nCols; ++i )
+  {
+    result[i] = processNineCellWindow( &rowAbove[i], &rowAbove[i+1], &rowAbove[i+2], &row[i], &row[i+1],
+                                       &row[i+2], &rowBelow[i], &rowBelow[i+1], &rowBelow[i+2] );
+  }
+}
+
+int QgsNineCellFilter::stripHeight( GDALRasterBandH outputRasterBand, int nCellsX, int nCellsY )
+{
+  int nRows = qMax( 1, MAX_STRIP_CELLS / ( nCellsX + 2 ) );
+
+  int blockXSize = 0;
+  int blockYSize = 0;
+  GDALGetBlockSize( outputRasterBand, &blockXSize, &blockYSize );
+  if ( blockYSize > 0 && nRows > blockYSize )
+  {
+    nRows -= nRows % blockYSize;
+  }
+
+  return qMin( nRows, nCellsY );
+}
+
+bool QgsNineCellFilter::readStrip( GDALRasterBandH inputRasterBand, int startRow, int nRows, int nCellsX, int nCellsY,
+                                   float nodataValue, float* strip )
+{
+  int rowLength = nCellsX + 2;
+
+  //rows above the first row and below the last row are nodata
+  int readStart = qMax( 0, startRow - 1 );
+  int readEnd = qMin( nCellsY, startRow + nRows + 1 );
+  if ( startRow == 0 )
+  {
+    for ( int a = 0; a < rowLength; ++a )
+    {
+      strip[a] = nodataValue;
+    }
+  }
+  if ( readEnd < startRow + nRows + 1 )
+  {
+    float* lastRow = strip + ( nRows + 1 ) * rowLength;
+    for ( int a = 0; a < rowLength; ++a )
+    {
+      lastRow[a] = nodataValue;
+    }
+  }
+  for ( int r = 0; r < nRows + 2; ++r )
+  {
+    strip[r * rowLength] = nodataValue;
+    strip[r * rowLength + nCellsX + 1] = nodataValue;
+  }
+
+  //read the rows directly between the nodata columns
+  float* readTarget = strip + ( readStart - startRow + 1 ) * rowLength + 1;
+  return GDALRasterIO( inputRasterBand, GF_Read, 0, readStart, nCellsX, readEnd - readStart, readTarget, nCellsX, readEnd - readStart,
+                       GDT_Float32, 0, rowLength * sizeof( float ) ) == CE_None;
+}
+
+QVector< QPair<int, int> > QgsNineCellFilter::stripRowRanges( int nRows, int nThreads )
+{
+  //a few ranges of rows per thread, to balance the load
+  QVector< QPair<int, int> > ranges;
+  int rangeRows = nThreads > 1 ? qMax( 1, nRows / ( nThreads * 4 ) ) : nRows;
+  for ( int firstRow = 0; firstRow < nRows; firstRow += rangeRows )
+  {
+    ranges << qMakePair( firstRow, qMin( rangeRows, nRows - firstRow ) );
+  }
+  return ranges;
+}
+
 GDALDatasetH QgsNineCellFilter::openInputFile( int& nCellsX, int& nCellsY )
 {
   GDALDatasetH inputDataset = GDALOpen( TO8F( mInputFile ), GA_ReadOnly );
@@ -18,7 +18,9 @@
 #ifndef QGSNINECELLFILTER_H
 #define QGSNINECELLFILTER_H
 
+#include <QPair>
 #include <QString>
+#include <QVector>
 #include "gdal.h"
 
 class QProgressDialog;
@@ -58,6 +60,53 @@ class ANALYSIS_EXPORT QgsNineCellFilter
                                          float* x12, float* x22, float* x32,
                                          float* x13, float* x23, float* x33 ) = 0;
 
+    /** Calculates the output values of a row from the input rows above, at and below it. The input rows hold
+      nCols + 2 values, the first and the last ones are (input) nodata values standing for the cells outside of the
+      border, so that the window of the output cell i is made of the input values i, i + 1 and i + 2 of the three rows.
+      The default implementation calls processNineCellWindow() for each cell. Subclasses reimplement it with a loop
+      calling their own processNineCellWindow() directly, which avoids a virtual call per cell.
+      Rows are calculated by several threads at the same time if multi-threading is enabled. Reimplementations
+      in the filters of QGIS only call their own processNineCellWindow() for instances of their exact class.
+      @note added in QGIS 3.0*/
+    virtual void processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCols );
+
+    /** Sets whether processRaster() calculates the rows on several threads. Disabled by default, the filters of
+      QGIS enable it. Subclasses may only enable it if their processNineCellWindow() is reentrant. Reimplementations
+      in Python are then called from the worker threads, one at a time.
+      @note added in QGIS 3.0*/
+    void setMultiThreaded( bool enabled ) { mMultiThreaded = enabled; }
+    /** Returns whether processRaster() calculates the rows on several threads
+      @note added in QGIS 3.0*/
+    bool isMultiThreaded() const { return mMultiThreaded; }
+
+    /** Sets the maximum number of rows processed at once by processRaster(). 0 (the default) picks it from the
+      raster width and the block height of the output band.
+      @note added in QGIS 3.0*/
+    void setMaxStripHeight( int rows ) { mMaxStripHeight = rows; }
+    /** Returns the maximum number of rows processed at once by processRaster(), 0 if not limited
+      @note added in QGIS 3.0*/
+    int maxStripHeight() const { return mMaxStripHeight; }
+
+    /** Number of rows processed at once, a multiple of the block height of the output band if possible
+      @note added in QGIS 3.0
+      @note not available in Python bindings*/
+    static int stripHeight( GDALRasterBandH outputRasterBand, int nCellsX, int nCellsY );
+
+    /** Reads the rows startRow to startRow + nRows - 1 of a band into a strip of nRows + 2 rows of nCellsX + 2 values.
+      The strip has the row above and the row below the range and a column on each side, as passed to
+      processNineCellRow(). Cells outside of the raster are set to nodataValue.
+      @return false in case of a read error
+      @note added in QGIS 3.0
+      @note not available in Python bindings*/
+    static bool readStrip( GDALRasterBandH inputRasterBand, int startRow, int nRows, int nCellsX, int nCellsY,
+                           float nodataValue, float* strip );
+
+    /** Splits the rows of a strip in ranges to calculate on nThreads threads. Each range is a pair of first row
+      and number of rows.
+      @note added in QGIS 3.0
+      @note not available in Python bindings*/
+    static QVector< QPair<int, int> > stripRowRanges( int nRows, int nThreads );
+
   private:
     //default constructor forbidden. We need input file, output file and format obligatory
     QgsNineCellFilter();
@@ -85,6 +134,10 @@ class ANALYSIS_EXPORT QgsNineCellFilter
     float mOutputNodataValue;
     /** Scale factor for z-value if x-/y- units are different to z-units (111120 for degree->meters and 370400 for degree->feet)*/
     double mZFactor;
+    /** Whether rows are calculated on several threads*/
+    bool mMultiThreaded;
+    /** Maximum number of rows processed at once, 0 if not limited*/
+    int mMaxStripHeight;
 };
 
 #endif // QGSNINECELLFILTER_H
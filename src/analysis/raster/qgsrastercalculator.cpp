@@ -25,6 +25,8 @@
 
 #include <QProgressDialog>
 #include <QFile>
+#include <QThread>
+#include <QtConcurrentMap>
 
 #include <cpl_string.h>
 #include <gdalwarper.h>
@@ -37,6 +39,55 @@
 #define TO8F(x)  QFile::encodeName( x ).constData()
 #endif
 
+//! Default memory limit for the strips calculated at the same time, in megabytes
+static const int DEFAULT_MEMORY_LIMIT = 256;
+
+//! Rows of the output calculated at once, with the input data they need
+struct QgsRasterCalculatorStrip
+{
+  int startRow;
+  int nRows;
+  QMap< QString, QgsRasterBlock* > inputBlocks;
+  //! Calculated values, nullptr if the calculation failed
+  float* data;
+};
+
+//! Calculates a strip, used with QtConcurrent
+class QgsRasterCalculatorStripCalculation
+{
+  public:
+    QgsRasterCalculatorStripCalculation( const QgsRasterCalcNode* calcNode, int nColumns, float nodataValue )
+        : mCalcNode( calcNode )
+        , mNumColumns( nColumns )
+        , mNodataValue( nodataValue )
+    {}
+
+    typedef void result_type;
+
+    void operator()( QgsRasterCalculatorStrip& strip )
+    {
+      QgsRasterMatrix resultMatrix;
+      resultMatrix.setNodataValue( mNodataValue );
+      if ( !mCalcNode->calculate( strip.inputBlocks, resultMatrix ) )
+      {
+        return;
+      }
+
+      int nEntries = mNumColumns * strip.nRows;
+      bool resultIsNumber = resultMatrix.isNumber();
+      strip.data = new float[nEntries];
+      for ( int j = 0; j < nEntries; ++j )
+      {
+        strip.data[j] = ( float )( resultIsNumber ? resultMatrix.number() : resultMatrix.data()[j] );
+      }
+    }
+
+  private:
+    const QgsRasterCalcNode* mCalcNode;
+    int mNumColumns;
+    float mNodataValue;
+};
+
 QgsRasterCalculator::QgsRasterCalculator( const QString& formulaString, const QString& outputFile, const QString& outputFormat,
     const QgsRectangle& outputExtent, int nOutputColumns, int nOutputRows, const QVector<QgsRasterCalculatorEntry>& rasterEntries )
     : mFormulaString( formulaString )
@@ -46,6 +97,7 @@ QgsRasterCalculator::QgsRasterCalculator( const QString& formulaString, const QS
     , mNumOutputColumns( nOutputColumns )
     , mNumOutputRows( nOutputRows )
     , mRasterEntries( rasterEntries )
+    , mMemoryLimit( DEFAULT_MEMORY_LIMIT )
 {
   //default to first layer's crs
   mOutputCrs = mRasterEntries.at( 0 ).raster->crs();
@@ -61,6 +113,7 @@ QgsRasterCalculator::QgsRasterCalculator( const QString& formulaString, const QS
     , mNumOutputColumns( nOutputColumns )
     , mNumOutputRows( nOutputRows )
     , mRasterEntries( rasterEntries )
+    , mMemoryLimit( DEFAULT_MEMORY_LIMIT )
 {
 }
 
@@ -75,96 +128,126 @@ int QgsRasterCalculator::processCalculation( QProgressDialog* p )
     return static_cast<int>( ParserError );
   }
 
-  QMap< QString, QgsRasterBlock* > inputBlocks;
   QVector<QgsRasterCalculatorEntry>::const_iterator it = mRasterEntries.constBegin();
   for ( ; it != mRasterEntries.constEnd(); ++it )
   {
     if ( !it->raster ) // no raster layer in entry
     {
       delete calcNode;
-      qDeleteAll( inputBlocks );
       return static_cast< int >( InputLayerError );
     }
-
-    QgsRasterBlock* block = nullptr;
-    // if crs transform needed
-    if ( it->raster->crs() != mOutputCrs )
-    {
-      QgsRasterProjector proj;
-      proj.setCrs( it->raster->crs(), mOutputCrs );
-      proj.setInput( it->raster->dataProvider() );
-      proj.setPrecision( QgsRasterProjector::Exact );
-
-      block = proj.block( it->bandNumber, mOutputRectangle, mNumOutputColumns, mNumOutputRows );
-    }
-    else
-    {
-      block = it->raster->dataProvider()->block( it->bandNumber, mOutputRectangle, mNumOutputColumns, mNumOutputRows );
-    }
-    if ( block->isEmpty() )
-    {
-      delete block;
-      delete calcNode;
-      qDeleteAll( inputBlocks );
-      return static_cast<int>( MemoryError );
-    }
-    inputBlocks.insert( it->ref, block );
   }
 
   //open output dataset for writing
   GDALDriverH outputDriver = openOutputDriver();
   if ( !outputDriver )
   {
+    delete calcNode;
     return static_cast< int >( CreateOutputError );
   }
 
   GDALDatasetH outputDataset = openOutputFile( outputDriver );
+  if ( !outputDataset )
+  {
+    delete calcNode;
+    return static_cast< int >( CreateOutputError );
+  }
   GDALSetProjection( outputDataset, mOutputCrs.toWkt().toLocal8Bit().data() );
   GDALRasterBandH outputRasterBand = GDALGetRasterBand( outputDataset, 1 );
 
   float outputNodataValue = -FLT_MAX;
   GDALSetRasterNoDataValue( outputRasterBand, outputNodataValue );
 
+  //the projectors of the inputs which need a crs transform are reused for all strips
+  QVector<QgsRasterProjector*> projectors( mRasterEntries.size(), nullptr );
+  for ( int i = 0; i < mRasterEntries.size(); ++i )
+  {
+    const QgsRasterCalculatorEntry& entry = mRasterEntries.at( i );
+    if ( entry.raster->crs() != mOutputCrs )
+    {
+      QgsRasterProjector* proj = new QgsRasterProjector();
+      proj->setCrs( entry.raster->crs(), mOutputCrs );
+      proj->setInput( entry.raster->dataProvider() );
+      proj->setPrecision( QgsRasterProjector::Exact );
+      projectors[i] = proj;
+    }
+  }
+
   if ( p )
   {
     p->setMaximum( mNumOutputRows );
   }
 
-  QgsRasterMatrix resultMatrix;
-  resultMatrix.setNodataValue( outputNodataValue );
+  int parallelStrips = qMax( 1, QThread::idealThreadCount() );
+  int rowsPerStrip = stripHeight( outputRasterBand, parallelStrips );
+  double rowHeight = mOutputRectangle.height() / mNumOutputRows;
+  Result result = Success;
 
-  //read / write line by line
-  for ( int i = 0; i < mNumOutputRows; ++i )
+  //read a batch of strips, calculate them in parallel and write them in order
+  for ( int batchRow = 0; batchRow < mNumOutputRows && result == Success; batchRow += rowsPerStrip * parallelStrips )
   {
     if ( p )
     {
-      p->setValue( i );
+      p->setValue( batchRow );
     }
 
     if ( p && p->wasCanceled() )
     {
+      result = Cancelled;
       break;
     }
 
-    if ( calcNode->calculate( inputBlocks, resultMatrix, i ) )
+    //inputs are read from this thread, data providers are not thread safe
+    QVector<QgsRasterCalculatorStrip> strips;
+    for ( int startRow = batchRow; startRow < mNumOutputRows && strips.size() < parallelStrips && result == Success; startRow += rowsPerStrip )
     {
-      bool resultIsNumber = resultMatrix.isNumber();
-      float* calcData = new float[mNumOutputColumns];
-
-      for ( int j = 0; j < mNumOutputColumns; ++j )
+      QgsRasterCalculatorStrip strip;
+      strip.startRow = startRow;
+      strip.nRows = qMin( rowsPerStrip, mNumOutputRows - startRow );
+      strip.data = nullptr;
+      QgsRectangle stripExtent( mOutputRectangle.xMinimum(), mOutputRectangle.yMaximum() - ( startRow + strip.nRows ) * rowHeight,
+                                mOutputRectangle.xMaximum(), mOutputRectangle.yMaximum() - startRow * rowHeight );
+
+      for ( int i = 0; i < mRasterEntries.size(); ++i )
       {
-        calcData[j] = ( float )( resultIsNumber ? resultMatrix.number() : resultMatrix.data()[j] );
+        const QgsRasterCalculatorEntry& entry = mRasterEntries.at( i );
+        QgsRasterBlock* block = nullptr;
+        if ( projectors.at( i ) )
+        {
+          block = projectors.at( i )->block( entry.bandNumber, stripExtent, mNumOutputColumns, strip.nRows );
+        }
+        else
+        {
+          block = entry.raster->dataProvider()->block( entry.bandNumber, stripExtent, mNumOutputColumns, strip.nRows );
+        }
+        if ( block->isEmpty() )
+        {
+          delete block;
+          result = MemoryError;
+          break;
+        }
+        strip.inputBlocks.insert( entry.ref, block );
       }
+      strips << strip;
+    }
 
-      //write scanline to the dataset
-      if ( GDALRasterIO( outputRasterBand, GF_Write, 0, i, mNumOutputColumns, 1, calcData, mNumOutputColumns, 1, GDT_Float32, 0, 0 ) != CE_None )
+    if ( result == Success )
+    {
+      QtConcurrent::blockingMap( strips, QgsRasterCalculatorStripCalculation( calcNode, mNumOutputColumns, outputNodataValue ) );
+    }
+
+    for ( int i = 0; i < strips.size(); ++i )
+    {
+      QgsRasterCalculatorStrip& strip = strips[i];
+      //write the strip to the dataset, in chunks aligned with the output blocks
+      if ( result == Success && strip.data &&
+           GDALRasterIO( outputRasterBand, GF_Write, 0, strip.startRow, mNumOutputColumns, strip.nRows, strip.data, mNumOutputColumns, strip.nRows, GDT_Float32, 0, 0 ) != CE_None )
       {
         QgsDebugMsg( "RasterIO error!" );
       }
-
-      delete[] calcData;
+      delete[] strip.data;
+      qDeleteAll( strip.inputBlocks );
     }
-
   }
 
   if ( p )
@@ -174,23 +257,40 @@ int QgsRasterCalculator::processCalculation( QProgressDialog* p )
 
   //close datasets and release memory
   delete calcNode;
-  qDeleteAll( inputBlocks );
-  inputBlocks.clear();
+  qDeleteAll( projectors );
 
-  if ( p && p->wasCanceled() )
+  if ( result != Success )
   {
     //delete the dataset without closing (because it is faster)
     GDALDeleteDataset( outputDriver, TO8F( mOutputFile ) );
-    return static_cast< int >( Cancelled );
+    return static_cast< int >( result );
   }
   GDALClose( outputDataset );
 
   return static_cast< int >( Success );
 }
 
+int QgsRasterCalculator::stripHeight( GDALRasterBandH outputRasterBand, int parallelStrips ) const
+{
+  //input blocks and intermediate matrices of the calculation tree, all counted as doubles
+  qint64 rowSize = static_cast<qint64>( mNumOutputColumns ) * sizeof( double ) * ( mRasterEntries.size() + 3 );
+  qint64 nRows = static_cast<qint64>( mMemoryLimit ) * 1024 * 1024 / ( rowSize * parallelStrips );
+
+  int blockXSize = 0;
+  int blockYSize = 0;
+  GDALGetBlockSize( outputRasterBand, &blockXSize, &blockYSize );
+  if ( blockYSize > 0 && nRows > blockYSize )
+  {
+    nRows -= nRows % blockYSize;
+  }
+
+  return static_cast<int>( qBound( static_cast<qint64>( 1 ), nRows, static_cast<qint64>( mNumOutputRows ) ) );
+}
+
 QgsRasterCalculator::QgsRasterCalculator()
     : mNumOutputColumns( 0 )
     , mNumOutputRows( 0 )
+    , mMemoryLimit( DEFAULT_MEMORY_LIMIT )
 {
 }
 
@@ -36,7 +36,13 @@ struct ANALYSIS_EXPORT QgsRasterCalculatorEntry
 };
 
 /** \ingroup analysis
- * Raster calculator class*/
+ * Raster calculator class.
+ *
+ * The output is calculated in strips of rows, so that the memory used does not
+ * depend on the size of the output raster. The input rasters are read for one
+ * strip at a time, several strips are calculated in parallel and written to
+ * the output dataset in order.
+ */
 class ANALYSIS_EXPORT QgsRasterCalculator
 {
   public:
@@ -84,6 +90,21 @@ class ANALYSIS_EXPORT QgsRasterCalculator
     //TODO QGIS 3.0 - return QgsRasterCalculator::Result
     int processCalculation( QProgressDialog* p = nullptr );
 
+    /** Sets the maximum amount of memory used for the input and intermediate
+     * data of the strips being calculated at the same time.
+     * @param megabytes memory limit in megabytes
+     * @see memoryLimit()
+     * @note added in QGIS 3.0
+     */
+    void setMemoryLimit( int megabytes ) { mMemoryLimit = megabytes; }
+
+    /** Returns the maximum amount of memory (in megabytes) used for the strips
+     * being calculated at the same time.
+     * @see setMemoryLimit()
+     * @note added in QGIS 3.0
+     */
+    int memoryLimit() const { return mMemoryLimit; }
+
   private:
     //default constructor forbidden. We need formula, output file, output format and output raster resolution obligatory
     QgsRasterCalculator();
@@ -100,6 +121,11 @@ class ANALYSIS_EXPORT QgsRasterCalculator
       @param transform double[6] array that receives the GDAL parameters*/
     void outputGeoTransform( double* transform ) const;
 
+    /** Number of rows of the strips, a multiple of the block height of the output band
+     * when possible, so that the memory limit is honoured for the given number of strips
+     * calculated at the same time*/
+    int stripHeight( GDALRasterBandH outputRasterBand, int parallelStrips ) const;
+
     QString mFormulaString;
     QString mOutputFile;
     QString mOutputFormat;
@@ -115,6 +141,9 @@ class ANALYSIS_EXPORT QgsRasterCalculator
 
     /***/
     QVector<QgsRasterCalculatorEntry> mRasterEntries;
+
+    /** Memory limit in megabytes*/
+    int mMemoryLimit;
 };
 
 #endif // QGSRASTERCALCULATOR_H
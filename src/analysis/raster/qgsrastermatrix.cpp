@@ -19,6 +19,119 @@
 #include <string.h>
 #include <qmath.h>
 
+/* Element wise kernels of the operators.
+ *
+ * The operator is a template parameter, so that the switch on the operator
+ * is done once per matrix rather than once per cell, and no data cells are
+ * handled with a select rather than a branch. The loops have no branch and
+ * no function call for the arithmetic, comparison and logical operators,
+ * which lets the compiler vectorize them for the instruction set of the
+ * build. The result of an operator is computed for no data cells too and
+ * then discarded.
+ */
+
+struct QgsRasterPlus { static inline double calculate( double a, double b, double ) { return a + b; } };
+struct QgsRasterMinus { static inline double calculate( double a, double b, double ) { return a - b; } };
+struct QgsRasterMul { static inline double calculate( double a, double b, double ) { return a * b; } };
+struct QgsRasterDiv { static inline double calculate( double a, double b, double nodata ) { return b == 0 ? nodata : a / b; } };
+struct QgsRasterEq { static inline double calculate( double a, double b, double ) { return a == b ? 1.0 : 0.0; } };
+struct QgsRasterNe { static inline double calculate( double a, double b, double ) { return a == b ? 0.0 : 1.0; } };
+struct QgsRasterGt { static inline double calculate( double a, double b, double ) { return a > b ? 1.0 : 0.0; } };
+struct QgsRasterLt { static inline double calculate( double a, double b, double ) { return a < b ? 1.0 : 0.0; } };
+struct QgsRasterGe { static inline double calculate( double a, double b, double ) { return a >= b ? 1.0 : 0.0; } };
+struct QgsRasterLe { static inline double calculate( double a, double b, double ) { return a <= b ? 1.0 : 0.0; } };
+struct QgsRasterAnd { static inline double calculate( double a, double b, double ) { return a != 0 && b != 0 ? 1.0 : 0.0; } };
+struct QgsRasterOr { static inline double calculate( double a, double b, double ) { return a != 0 || b != 0 ? 1.0 : 0.0; } };
+struct QgsRasterPow
+{
+  static inline double calculate( double a, double b, double nodata )
+  {
+    if (( a == 0 && b < 0 ) || ( a < 0 && ( b - floor( b ) ) > 0 ) )
+      return nodata;
+    return qPow( a, b );
+  }
+};
+
+//! matrix = matrix op other matrix
+template <class Op>
+static void matrixMatrixKernel( double* data, const double* other, int nEntries, double nodata, double otherNodata )
+{
+  for ( int i = 0; i < nEntries; ++i )
+  {
+    double value1 = data[i];
+    double value2 = other[i];
+    double result = Op::calculate( value1, value2, nodata );
+    data[i] = ( value1 == nodata || value2 == otherNodata ) ? nodata : result;
+  }
+}
+
+//! result = number op other matrix, the number is not no data
+template <class Op>
+static void numberMatrixKernel( double* result, double number, const double* other, int nEntries, double nodata, double otherNodata )
+{
+  for ( int i = 0; i < nEntries; ++i )
+  {
+    double value = other[i];
+    double r = Op::calculate( number, value, nodata );
+    result[i] = value == otherNodata ? nodata : r;
+  }
+}
+
+//! matrix = matrix op number, the number is not no data
+template <class Op>
+static void matrixNumberKernel( double* data, double number, int nEntries, double nodata )
+{
+  for ( int i = 0; i < nEntries; ++i )
+  {
+    double value = data[i];
+    double result = Op::calculate( value, number, nodata );
+    data[i] = value == nodata ? nodata : result;
+  }
+}
+
+//! Calls the kernel with given operator, e.g. QGS_RASTER_DISPATCH( op, matrixNumberKernel, ( mData, value, nEntries, mNodataValue ) )
+#define QGS_RASTER_DISPATCH( op, kernel, args ) \
+  switch ( op ) \
+  { \
+    case opPLUS: kernel<QgsRasterPlus> args; break; \
+    case opMINUS: kernel<QgsRasterMinus> args; break; \
+    case opMUL: kernel<QgsRasterMul> args; break; \
+    case opDIV: kernel<QgsRasterDiv> args; break; \
+    case opPOW: kernel<QgsRasterPow> args; break; \
+    case opEQ: kernel<QgsRasterEq> args; break; \
+    case opNE: kernel<QgsRasterNe> args; break; \
+    case opGT: kernel<QgsRasterGt> args; break; \
+    case opLT: kernel<QgsRasterLt> args; break; \
+    case opGE: kernel<QgsRasterGe> args; break; \
+    case opLE: kernel<QgsRasterLe> args; break; \
+    case opAND: kernel<QgsRasterAnd> args; break; \
+    case opOR: kernel<QgsRasterOr> args; break; \
+  }
+
+struct QgsRasterSqrt { static inline double calculate( double v, double nodata ) { return v < 0 ? nodata : sqrt( v ); } };
+struct QgsRasterSin { static inline double calculate( double v, double ) { return sin( v ); } };
+struct QgsRasterCos { static inline double calculate( double v, double ) { return cos( v ); } };
+struct QgsRasterTan { static inline double calculate( double v, double ) { return tan( v ); } };
+struct QgsRasterAsin { static inline double calculate( double v, double ) { return asin( v ); } };
+struct QgsRasterAcos { static inline double calculate( double v, double ) { return acos( v ); } };
+struct QgsRasterAtan { static inline double calculate( double v, double ) { return atan( v ); } };
+struct QgsRasterSign { static inline double calculate( double v, double ) { return -v; } };
+struct QgsRasterLog { static inline double calculate( double v, double nodata ) { return v <= 0 ? nodata : ::log( v ); } };
+struct QgsRasterLog10 { static inline double calculate( double v, double nodata ) { return v <= 0 ? nodata : ::log10( v ); } };
+
+//! matrix = op matrix
+template <class Op>
+static void oneArgumentKernel( double* data, int nEntries, double nodata )
+{
+  for ( int i = 0; i < nEntries; ++i )
+  {
+    double value = data[i];
+    double result = Op::calculate( value, nodata );
+    data[i] = value == nodata ? nodata : result;
+  }
+}
+
+
 QgsRasterMatrix::QgsRasterMatrix()
     : mColumns( 0 )
     , mRows( 0 )
@@ -201,67 +314,38 @@ bool QgsRasterMatrix::oneArgumentOperation( OneArgOperator op )
   }
 
   int nEntries = mColumns * mRows;
-  double value;
-  for ( int i = 0; i < nEntries; ++i )
+  switch ( op )
   {
-    value = mData[i];
-    if ( value != mNodataValue )
-    {
-      switch ( op )
-      {
-        case opSQRT:
-          if ( value < 0 ) //no complex numbers
-          {
-            mData[i] = mNodataValue;
-          }
-          else
-          {
-            mData[i] = sqrt( value );
-          }
-          break;
-        case opSIN:
-          mData[i] = sin( value );
-          break;
-        case opCOS:
-          mData[i] = cos( value );
-          break;
-        case opTAN:
-          mData[i] = tan( value );
-          break;
-        case opASIN:
-          mData[i] = asin( value );
-          break;
-        case opACOS:
-          mData[i] = acos( value );
-          break;
-        case opATAN:
-          mData[i] = atan( value );
-          break;
-        case opSIGN:
-          mData[i] = -value;
-          break;
-        case opLOG:
-          if ( value <= 0 )
-          {
-            mData[i] = mNodataValue;
-          }
-          else
-          {
-            mData[i] = ::log( value );
-          }
-          break;
-        case opLOG10:
-          if ( value <= 0 )
-          {
-            mData[i] = mNodataValue;
-          }
-          else
-          {
-            mData[i] = ::log10( value );
-          }
-          break;
-      }
-    }
+    case opSQRT:
+      oneArgumentKernel<QgsRasterSqrt>( mData, nEntries, mNodataValue );
+      break;
+    case opSIN:
+      oneArgumentKernel<QgsRasterSin>( mData, nEntries, mNodataValue );
+      break;
+    case opCOS:
+      oneArgumentKernel<QgsRasterCos>( mData, nEntries, mNodataValue );
+      break;
+    case opTAN:
+      oneArgumentKernel<QgsRasterTan>( mData, nEntries, mNodataValue );
+      break;
+    case opASIN:
+      oneArgumentKernel<QgsRasterAsin>( mData, nEntries, mNodataValue );
+      break;
+    case opACOS:
+      oneArgumentKernel<QgsRasterAcos>( mData, nEntries, mNodataValue );
+      break;
+    case opATAN:
+      oneArgumentKernel<QgsRasterAtan>( mData, nEntries, mNodataValue );
+      break;
+    case opSIGN:
+      oneArgumentKernel<QgsRasterSign>( mData, nEntries, mNodataValue );
+      break;
+    case opLOG:
+      oneArgumentKernel<QgsRasterLog>( mData, nEntries, mNodataValue );
+      break;
+    case opLOG10:
+      oneArgumentKernel<QgsRasterLog10>( mData, nEntries, mNodataValue );
+      break;
   }
   return true;
 }
@@ -333,30 +417,14 @@ bool QgsRasterMatrix::twoArgumentOperation( TwoArgOperator op, const QgsRasterMa
   //two matrices
   if ( !isNumber() && !other.isNumber() )
   {
-    double* matrix = other.mData;
     int nEntries = mColumns * mRows;
-    double value1, value2;
-
-    for ( int i = 0; i < nEntries; ++i )
-    {
-      value1 = mData[i];
-      value2 = matrix[i];
-      if ( value1 == mNodataValue || value2 == other.mNodataValue )
-      {
-        mData[i] = mNodataValue;
-      }
-      else
-      {
-        mData[i] = calculateTwoArgumentOp( op, value1, value2 );
-      }
-    }
+    QGS_RASTER_DISPATCH( op, matrixMatrixKernel, ( mData, other.mData, nEntries, mNodataValue, other.mNodataValue ) );
     return true;
   }
 
   //this matrix is a single number and the other one a real matrix
   if ( isNumber() )
   {
-    double* matrix = other.mData;
     int nEntries = other.nColumns() * other.nRows();
     double value = mData[0];
     delete[] mData;
@@ -374,16 +442,7 @@ bool QgsRasterMatrix::twoArgumentOperation( TwoArgOperator op, const QgsRasterMa
       return true;
     }
 
-    for ( int i = 0; i < nEntries; ++i )
-    {
-      if ( matrix[i] == other.mNodataValue )
-      {
-        mData[i] = mNodataValue;
-        continue;
-      }
-
-      mData[i] = calculateTwoArgumentOp( op, value, matrix[i] );
-    }
+    QGS_RASTER_DISPATCH( op, numberMatrixKernel, ( mData, value, other.mData, nEntries, mNodataValue, other.mNodataValue ) );
     return true;
   }
   else //this matrix is a real matrix and the other a number
@@ -400,15 +459,7 @@ bool QgsRasterMatrix::twoArgumentOperation( TwoArgOperator op, const QgsRasterMa
       return true;
     }
 
-    for ( int i = 0; i < nEntries; ++i )
-    {
-      if ( mData[i] == mNodataValue )
-      {
-        continue;
-      }
-
-      mData[i] = calculateTwoArgumentOp( op, mData[i], value );
-    }
+    QGS_RASTER_DISPATCH( op, matrixNumberKernel, ( mData, value, nEntries, mNodataValue ) );
     return true;
   }
 }
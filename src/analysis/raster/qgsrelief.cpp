@@ -27,6 +27,9 @@
 
 #include <QFile>
 #include <QTextStream>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrentMap>
 
 #if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 1800
 #define TO8F(x) (x).toUtf8().constData()
@@ -34,6 +37,42 @@
 #define TO8F(x) QFile::encodeName( x ).constData()
 #endif
 
+//! Calculates ranges of rows of a strip, used with QtConcurrent
+class QgsReliefRowsCalculation
+{
+  public:
+    QgsReliefRowsCalculation( QgsRelief* relief, float* input, unsigned char* red, unsigned char* green, unsigned char* blue, int nCols )
+        : mRelief( relief )
+        , mInput( input )
+        , mRed( red )
+        , mGreen( green )
+        , mBlue( blue )
+        , mCols( nCols )
+    {}
+
+    typedef void result_type;
+
+    void operator()( const QPair<int, int>& rows )
+    {
+      int rowLength = mCols + 2;
+      for ( int i = rows.first; i < rows.first + rows.second; ++i )
+      {
+        //input row 0 is the row above the strip
+        float* rowAbove = mInput + i * rowLength;
+        mRelief->processNineCellRow( rowAbove, rowAbove + rowLength, rowAbove + 2 * rowLength,
+                                     mRed + i * mCols, mGreen + i * mCols, mBlue + i * mCols, mCols );
+      }
+    }
+
+  private:
+    QgsRelief* mRelief;
+    float* mInput;
+    unsigned char* mRed;
+    unsigned char* mGreen;
+    unsigned char* mBlue;
+    int mCols;
+};
+
 QgsRelief::QgsRelief( const QString& inputFile, const QString& outputFile, const QString& outputFormat )
     : mInputFile( inputFile )
     , mOutputFile( outputFile )
@@ -43,6 +82,7 @@ QgsRelief::QgsRelief( const QString& inputFile, const QString& outputFile, const
     , mInputNodataValue( -1 )
     , mOutputNodataValue( -1 )
     , mZFactor( 1.0 )
+    , mMultiThreaded( true )
 {
   mSlopeFilter = new QgsSlopeFilter( inputFile, outputFile, outputFormat );
   mAspectFilter = new QgsAspectFilter( inputFile, outputFile, outputFormat );
@@ -167,28 +207,27 @@ int QgsRelief::processRaster( QProgressDialog* p )
     return 6;
   }
 
-  //keep only three scanlines in memory at a time
-  float* scanLine1 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
-  float* scanLine2 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
-  float* scanLine3 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
+  //the raster is processed in strips of rows, read with an additional row above and below and a nodata
+  //column on each side, as for QgsNineCellFilter. Values outside the layer extent (if the 3x3 window is on
+  //the border) are sent to the processing method as (input) nodata values
+  int stripRows = QgsNineCellFilter::stripHeight( outputRedBand, xSize, ySize );
+  QVector<float> input(( stripRows + 2 ) * ( xSize + 2 ) );
+  QVector<unsigned char> resultRed( stripRows * xSize );
+  QVector<unsigned char> resultGreen( stripRows * xSize );
+  QVector<unsigned char> resultBlue( stripRows * xSize );
 
-  unsigned char* resultRedLine = ( unsigned char * ) CPLMalloc( sizeof( unsigned char ) * xSize );
-  unsigned char* resultGreenLine = ( unsigned char * ) CPLMalloc( sizeof( unsigned char ) * xSize );
-  unsigned char* resultBlueLine = ( unsigned char * ) CPLMalloc( sizeof( unsigned char ) * xSize );
+  int nThreads = mMultiThreaded ? qMax( 1, QThread::idealThreadCount() ) : 1;
 
   if ( p )
   {
     p->setMaximum( ySize );
   }
 
-  bool resultOk;
-
-  //values outside the layer extent (if the 3x3 window is on the border) are sent to the processing method as (input) nodata values
-  for ( int i = 0; i < ySize; ++i )
+  for ( int startRow = 0; startRow < ySize; startRow += stripRows )
   {
     if ( p )
     {
-      p->setValue( i );
+      p->setValue( startRow );
     }
 
     if ( p && p->wasCanceled() )
@@ -196,80 +235,32 @@ int QgsRelief::processRaster( QProgressDialog* p )
       break;
     }
 
-    if ( i == 0 )
-    {
-      //fill scanline 1 with (input) nodata for the values above the first row and feed scanline2 with the first row
-      for ( int a = 0; a < xSize; ++a )
-      {
-        scanLine1[a] = mInputNodataValue;
-      }
-      if ( GDALRasterIO( rasterBand, GF_Read, 0, 0, xSize, 1, scanLine2, xSize, 1, GDT_Float32, 0, 0 )  != CE_None )
-      {
-        QgsDebugMsg( "Raster IO Error" );
-      }
-    }
-    else
+    int nRows = qMin( stripRows, ySize - startRow );
+    if ( !QgsNineCellFilter::readStrip( rasterBand, startRow, nRows, xSize, ySize, mInputNodataValue, input.data() ) )
     {
-      //normally fetch only scanLine3 and release scanline 1 if we move forward one row
-      CPLFree( scanLine1 );
-      scanLine1 = scanLine2;
-      scanLine2 = scanLine3;
-      scanLine3 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
+      QgsDebugMsg( "Raster IO Error" );
     }
 
-    if ( i == ySize - 1 ) //fill the row below the bottom with nodata values
+    QVector< QPair<int, int> > ranges = QgsNineCellFilter::stripRowRanges( nRows, nThreads );
+    QgsReliefRowsCalculation calculation( this, input.data(), resultRed.data(), resultGreen.data(), resultBlue.data(), xSize );
+    if ( nThreads > 1 )
     {
-      for ( int a = 0; a < xSize; ++a )
-      {
-        scanLine3[a] = mInputNodataValue;
-      }
+      QtConcurrent::blockingMap( ranges, calculation );
     }
     else
     {
-      if ( GDALRasterIO( rasterBand, GF_Read, 0, i + 1, xSize, 1, scanLine3, xSize, 1, GDT_Float32, 0, 0 ) != CE_None )
-      {
-        QgsDebugMsg( "Raster IO Error" );
-      }
-    }
-
-    for ( int j = 0; j < xSize; ++j )
-    {
-      if ( j == 0 )
-      {
-        resultOk = processNineCellWindow( &mInputNodataValue, &scanLine1[j], &scanLine1[j+1], &mInputNodataValue, &scanLine2[j], \
-                                          &scanLine2[j+1], &mInputNodataValue, &scanLine3[j], &scanLine3[j+1], \
-                                          &resultRedLine[j], &resultGreenLine[j], &resultBlueLine[j] );
-      }
-      else if ( j == xSize - 1 )
-      {
-        resultOk = processNineCellWindow( &scanLine1[j-1], &scanLine1[j], &mInputNodataValue, &scanLine2[j-1], &scanLine2[j], \
-                                          &mInputNodataValue, &scanLine3[j-1], &scanLine3[j], &mInputNodataValue, \
-                                          &resultRedLine[j], &resultGreenLine[j], &resultBlueLine[j] );
-      }
-      else
-      {
-        resultOk = processNineCellWindow( &scanLine1[j-1], &scanLine1[j], &scanLine1[j+1], &scanLine2[j-1], &scanLine2[j], \
-                                          &scanLine2[j+1], &scanLine3[j-1], &scanLine3[j], &scanLine3[j+1], \
-                                          &resultRedLine[j], &resultGreenLine[j], &resultBlueLine[j] );
-      }
-
-      if ( !resultOk )
-      {
-        resultRedLine[j] = mOutputNodataValue;
-        resultGreenLine[j] = mOutputNodataValue;
-        resultBlueLine[j] = mOutputNodataValue;
-      }
+      calculation( ranges.at( 0 ) );
     }
 
-    if ( GDALRasterIO( outputRedBand, GF_Write, 0, i, xSize, 1, resultRedLine, xSize, 1, GDT_Byte, 0, 0 ) != CE_None )
+    if ( GDALRasterIO( outputRedBand, GF_Write, 0, startRow, xSize, nRows, resultRed.data(), xSize, nRows, GDT_Byte, 0, 0 ) != CE_None )
     {
       QgsDebugMsg( "Raster IO Error" );
     }
-    if ( GDALRasterIO( outputGreenBand, GF_Write, 0, i, xSize, 1, resultGreenLine, xSize, 1, GDT_Byte, 0, 0 ) != CE_None )
+    if ( GDALRasterIO( outputGreenBand, GF_Write, 0, startRow, xSize, nRows, resultGreen.data(), xSize, nRows, GDT_Byte, 0, 0 ) != CE_None )
     {
       QgsDebugMsg( "Raster IO Error" );
     }
-    if ( GDALRasterIO( outputBlueBand, GF_Write, 0, i, xSize, 1, resultBlueLine, xSize, 1, GDT_Byte, 0, 0 ) != CE_None )
+    if ( GDALRasterIO( outputBlueBand, GF_Write, 0, startRow, xSize, nRows, resultBlue.data(), xSize, nRows, GDT_Byte, 0, 0 ) != CE_None )
     {
       QgsDebugMsg( "Raster IO Error" );
     }
@@ -280,13 +271,6 @@ int QgsRelief::processRaster( QProgressDialog* p )
     p->setValue( ySize );
   }
 
-  CPLFree( resultRedLine );
-  CPLFree( resultBlueLine );
-  CPLFree( resultGreenLine );
-  CPLFree( scanLine1 );
-  CPLFree( scanLine2 );
-  CPLFree( scanLine3 );
-
   GDALClose( inputDataset );
 
   if ( p && p->wasCanceled() )
@@ -300,6 +284,21 @@ int QgsRelief::processRaster( QProgressDialog* p )
   return 0;
 }
 
+void QgsRelief::processNineCellRow( float* rowAbove, float* row, float* rowBelow,
+                                    unsigned char* red, unsigned char* green, unsigned char* blue, int nCols )
+{
+  for ( int j = 0; j < nCols; ++j )
+  {
+    if ( !processNineCellWindow( &rowAbove[j], &rowAbove[j+1], &rowAbove[j+2], &row[j], &row[j+1], &row[j+2],
+                                 &rowBelow[j], &rowBelow[j+1], &rowBelow[j+2], &red[j], &green[j], &blue[j] ) )
+    {
+      red[j] = mOutputNodataValue;
+      green[j] = mOutputNodataValue;
+      blue[j] = mOutputNodataValue;
+    }
+  }
+}
+
 bool QgsRelief::processNineCellWindow( float* x1, float* x2, float* x3, float* x4, float* x5, float* x6, float* x7, float* x8, float* x9,
                                        unsigned char* red, unsigned char* green, unsigned char* blue )
 {
@@ -308,7 +307,7 @@ bool QgsRelief::processNineCellWindow( float* x1, float* x2, float* x3, float* x
   int g = 0;
   int b = 0;
 
-  float hillShadeValue300 = mHillshadeFilter300->processNineCellWindow( x1, x2, x3, x4, x5, x6, x7, x8, x9 );
+  float hillShadeValue300 = mHillshadeFilter300->QgsHillshadeFilter::processNineCellWindow( x1, x2, x3, x4, x5, x6, x7, x8, x9 );
   if ( hillShadeValue300 != mOutputNodataValue )
   {
     if ( !setElevationColor( *x5, &r, &g, &b ) )
@@ -326,8 +325,8 @@ bool QgsRelief::processNineCellWindow( float* x1, float* x2, float* x3, float* x
   }
 
   //2. component: hillshade and slope
-  float hillShadeValue315 = mHillshadeFilter315->processNineCellWindow( x1, x2, x3, x4, x5, x6, x7, x8, x9 );
-  float slope = mSlopeFilter->processNineCellWindow( x1, x2, x3, x4, x5, x6, x7, x8, x9 );
+  float hillShadeValue315 = mHillshadeFilter315->QgsHillshadeFilter::processNineCellWindow( x1, x2, x3, x4, x5, x6, x7, x8, x9 );
+  float slope = mSlopeFilter->QgsSlopeFilter::processNineCellWindow( x1, x2, x3, x4, x5, x6, x7, x8, x9 );
   if ( hillShadeValue315 != mOutputNodataValue && slope != mOutputNodataValue )
   {
     int r2, g2, b2;
@@ -358,8 +357,8 @@ bool QgsRelief::processNineCellWindow( float* x1, float* x2, float* x3, float* x
   }
 
   //3. combine yellow aspect with 10% transparency, illumination from 285 degrees
-  float hillShadeValue285 = mHillshadeFilter285->processNineCellWindow( x1, x2, x3, x4, x5, x6, x7, x8, x9 );
-  float aspect = mAspectFilter->processNineCellWindow( x1, x2, x3, x4, x5, x6, x7, x8, x9 );
+  float hillShadeValue285 = mHillshadeFilter285->QgsHillshadeFilter::processNineCellWindow( x1, x2, x3, x4, x5, x6, x7, x8, x9 );
+  float aspect = mAspectFilter->QgsAspectFilter::processNineCellWindow( x1, x2, x3, x4, x5, x6, x7, x8, x9 );
   if ( hillShadeValue285 != mOutputNodataValue && aspect != mOutputNodataValue )
   {
     double angle_diff = qAbs( 285 - aspect );
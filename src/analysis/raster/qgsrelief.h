@@ -65,6 +65,13 @@ class ANALYSIS_EXPORT QgsRelief
     /** Write frequency of elevation values to file for manual inspection*/
     bool exportFrequencyDistributionToCsv( const QString& file );
 
+    /** Sets whether processRaster() calculates the rows on several threads. Enabled by default.
+      @note added in QGIS 3.0*/
+    void setMultiThreaded( bool enabled ) { mMultiThreaded = enabled; }
+    /** Returns whether processRaster() calculates the rows on several threads
+      @note added in QGIS 3.0*/
+    bool isMultiThreaded() const { return mMultiThreaded; }
+
   private:
 
     QString mInputFile;
@@ -79,6 +86,8 @@ class ANALYSIS_EXPORT QgsRelief
     float mOutputNodataValue;
 
     double mZFactor;
+    /** Whether rows are calculated on several threads*/
+    bool mMultiThreaded;
 
     QgsSlopeFilter* mSlopeFilter;
     QgsAspectFilter* mAspectFilter;
@@ -91,6 +100,11 @@ class ANALYSIS_EXPORT QgsRelief
 
     bool processNineCellWindow( float* x1, float* x2, float* x3, float* x4, float* x5, float* x6, float* x7, float* x8, float* x9,
                                 unsigned char* red, unsigned char* green, unsigned char* blue );
+    /** Calculates the colors of a row of cells. The input rows have a nodata value on each side, as for
+      QgsNineCellFilter::processNineCellRow()*/
+    void processNineCellRow( float* rowAbove, float* row, float* rowBelow,
+                             unsigned char* red, unsigned char* green, unsigned char* blue, int nCols );
+    friend class QgsReliefRowsCalculation;
 
     /** Opens the input file and returns the dataset handle and the number of pixels in x-/y- direction*/
     GDALDatasetH openInputFile( int& nCellsX, int& nCellsY );
@@ -17,14 +17,18 @@
 
 #include "qgsruggednessfilter.h"
 
+#include <typeinfo>
+
 QgsRuggednessFilter::QgsRuggednessFilter( const QString& inputFile, const QString& outputFile, const QString& outputFormat ): QgsNineCellFilter( inputFile, outputFile, outputFormat )
 {
-
+  // the windows of the filter are reentrant
+  setMultiThreaded( true );
 }
 
 QgsRuggednessFilter::QgsRuggednessFilter(): QgsNineCellFilter( "", "", "" )
 {
-
+  // the windows of the filter are reentrant
+  setMultiThreaded( true );
 }
 
 
@@ -92,3 +96,18 @@ float QgsRuggednessFilter::processNineCellWindow( float* x11, float* x21, float*
   return sqrt( sum );
 }
 
+void QgsRuggednessFilter::processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCols )
+{
+  // subclasses reimplementing processNineCellWindow(), in C++ or Python, get their own windows
+  if ( typeid( *this ) != typeid( QgsRuggednessFilter ) )
+  {
+    QgsNineCellFilter::processNineCellRow( rowAbove, row, rowBelow, result, nCols );
+    return;
+  }
+
+  for ( int i = 0; i < nCols; ++i )
+  {
+    result[i] = QgsRuggednessFilter::processNineCellWindow( &rowAbove[i], &rowAbove[i+1], &rowAbove[i+2], &row[i], &row[i+1],
+                &row[i+2], &rowBelow[i], &rowBelow[i+1], &rowBelow[i+2] );
+  }
+}
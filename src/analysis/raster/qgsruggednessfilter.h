@@ -36,6 +36,9 @@ class ANALYSIS_EXPORT QgsRuggednessFilter: public QgsNineCellFilter
                                  float* x12, float* x22, float* x32,
                                  float* x13, float* x23, float* x33 ) override;
 
+    /** Calculates a row of output values, without a virtual call per cell*/
+    void processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCols ) override;
+
   private:
     QgsRuggednessFilter();
 };
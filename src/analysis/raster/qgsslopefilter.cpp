@@ -17,10 +17,13 @@
 
 #include "qgsslopefilter.h"
 
+#include <typeinfo>
+
 QgsSlopeFilter::QgsSlopeFilter( const QString& inputFile, const QString& outputFile, const QString& outputFormat )
     : QgsDerivativeFilter( inputFile, outputFile, outputFormat )
 {
-
+  // the windows of the filter are reentrant
+  setMultiThreaded( true );
 }
 
 QgsSlopeFilter::~QgsSlopeFilter()
@@ -42,3 +45,18 @@ float QgsSlopeFilter::processNineCellWindow( float* x11, float* x21, float* x31,
   return atan( sqrt( derX * derX + derY * derY ) ) * 180.0 / M_PI;
 }
 
+void QgsSlopeFilter::processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCols )
+{
+  // subclasses reimplementing processNineCellWindow(), in C++ or Python, get their own windows
+  if ( typeid( *this ) != typeid( QgsSlopeFilter ) )
+  {
+    QgsNineCellFilter::processNineCellRow( rowAbove, row, rowBelow, result, nCols );
+    return;
+  }
+
+  for ( int i = 0; i < nCols; ++i )
+  {
+    result[i] = QgsSlopeFilter::processNineCellWindow( &rowAbove[i], &rowAbove[i+1], &rowAbove[i+2], &row[i], &row[i+1],
+                &row[i+2], &rowBelow[i], &rowBelow[i+1], &rowBelow[i+2] );
+  }
+}
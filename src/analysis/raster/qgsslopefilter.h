@@ -33,6 +33,9 @@ class ANALYSIS_EXPORT QgsSlopeFilter: public QgsDerivativeFilter
     float processNineCellWindow( float* x11, float* x21, float* x31,
                                  float* x12, float* x22, float* x32,
                                  float* x13, float* x23, float* x33 ) override;
+
+    /** Calculates a row of output values, without a virtual call per cell*/
+    void processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCols ) override;
 };
 
 #endif // QGSSLOPEFILTER_H
@@ -17,10 +17,13 @@
 
 #include "qgstotalcurvaturefilter.h"
 
+#include <typeinfo>
+
 QgsTotalCurvatureFilter::QgsTotalCurvatureFilter( const QString& inputFile, const QString& outputFile, const QString& outputFormat )
     : QgsNineCellFilter( inputFile, outputFile, outputFormat )
 {
-
+  // the windows of the filter are reentrant
+  setMultiThreaded( true );
 }
 
 QgsTotalCurvatureFilter::~QgsTotalCurvatureFilter()
@@ -46,3 +49,19 @@ float QgsTotalCurvatureFilter::processNineCellWindow( float* x11, float* x21, fl
 
   return dxx*dxx + 2*dxy*dxy + dyy*dyy;
 }
+
+void QgsTotalCurvatureFilter::processNineCellRow( float* rowAbove, float* row, float* rowBelow, float* result, int nCols )
+{
+  // subclasses reimplementing processNineCellWindow(), in C++ or Python, get their own windows
+  if ( typeid( *this ) != typeid( QgsTotalCurvatureFilter ) )
+  {
+    QgsNineCellFilter::processNineCellRow( rowAbove, row, rowBelow, result, nCols );
+    return;
+  }
+
+  for ( int i = 0; i < nCols; ++i )
+  {
+    result[i] = QgsTotalCurvatureFilter::processNineCellWindow( &rowAbove[i], &rowAbove[i+1], &rowAbove[i+2], &row[i], &row[i+1],
+                &row[i+2], &rowBelow[i], &rowBelow[i+1], &rowBelow[i+2] );
+  }
+}
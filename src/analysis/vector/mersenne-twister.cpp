@@ -32,8 +32,11 @@ static const unsigned SIZE   = 624;
 static const unsigned PERIOD = 397;
 static const unsigned DIFF   = SIZE - PERIOD;
 
-static uint32_t MT[SIZE];
-static unsigned index = 0;
+/*
+ * State of the global generator used by the libc replacement functions.
+ * The *_r functions below use a state owned by the caller instead.
+ */
+static mt_state global_state;
 
 #define M32(x) (0x80000000 & x) // 32nd Most Significant Bit
 #define L31(x) (0x7FFFFFFF & x) // 31 Least Significant Bits
@@ -46,7 +49,7 @@ static unsigned index = 0;
 
 #define MD_UINT32_MAX std::numeric_limits<uint32_t>::max()
 
-static inline void generate_numbers()
+static inline void generate_numbers( uint32_t* MT )
 {
   /*
    * Originally, we had one loop with i going from [0, SIZE) and
@@ -108,7 +111,7 @@ static inline void generate_numbers()
   MT[SIZE-1] = MT[PERIOD-1] ^( y >> 1 ) ^ MATRIX[ODD( y )];
 }
 
-extern "C" void seed( uint32_t value )
+extern "C" void mt_seed_r( mt_state* state, uint32_t value )
 {
   /*
    * The equation below is a linear congruential generator (LCG),
@@ -142,19 +145,20 @@ extern "C" void seed( uint32_t value )
    * masking with 0xFFFFFFFF below.
    */
 
+  uint32_t* MT = state->mt;
   MT[0] = value;
-  index = 0;
+  state->index = 0;
 
   for ( unsigned i = 1; i < SIZE; ++i )
     MT[i] = 0x6c078965 * ( MT[i-1] ^ MT[i-1] >> 30 ) + i;
 }
 
-extern "C" uint32_t rand_u32()
+extern "C" uint32_t mt_rand_u32_r( mt_state* state )
 {
-  if ( !index )
-    generate_numbers();
+  if ( !state->index )
+    generate_numbers( state->mt );
 
-  uint32_t y = MT[index];
+  uint32_t y = state->mt[state->index];
 
   // Tempering
   y ^= y >> 11;
@@ -162,12 +166,32 @@ extern "C" uint32_t rand_u32()
   y ^= y << 15 & 0xefc60000;
   y ^= y >> 18;
 
-  if ( ++index == SIZE )
-    index = 0;
+  if ( ++state->index == SIZE )
+    state->index = 0;
 
   return y;
 }
 
+extern "C" int mt_rand_r( mt_state* state )
+{
+  return static_cast<int>( 0x7FFFFFFF & mt_rand_u32_r( state ) );
+}
+
+extern "C" double mt_randd_co_r( mt_state* state )
+{
+  return static_cast<double>( mt_rand_u32_r( state ) ) / ( MD_UINT32_MAX + 1.0 );
+}
+
+extern "C" void seed( uint32_t value )
+{
+  mt_seed_r( &global_state, value );
+}
+
+extern "C" uint32_t rand_u32()
+{
+  return mt_rand_u32_r( &global_state );
+}
+
 extern "C" int mt_rand()
 {
   /*
@@ -44,6 +44,37 @@ extern "C"
    */
 #define MD_RAND_MAX std::numeric_limits<int32_t>::max()
 
+  /*
+   * Generator state. The functions without _r suffix share one global
+   * state, the reentrant _r functions work on a state owned by the caller
+   * and can be used from several threads with one state per thread.
+   */
+  typedef struct mt_state
+  {
+    uint32_t mt[624];
+    unsigned index;
+  } mt_state;
+
+  /*
+   * Initialize the given state with given seed.
+   */
+  void mt_seed_r( mt_state* state, uint32_t seed_value );
+
+  /*
+   * Extract a pseudo-random unsigned 32-bit integer from the given state.
+   */
+  uint32_t mt_rand_u32_r( mt_state* state );
+
+  /*
+   * Extract a pseudo-random integer in the range 0 ... MD_RAND_MAX from the given state.
+   */
+  int mt_rand_r( mt_state* state );
+
+  /*
+   * Return a random double in the OPEN range [0, 1> from the given state.
+   */
+  double mt_randd_co_r( mt_state* state );
+
   /*
    * Initialize the number generator with given seed.
    * (LIBC REPLACEMENT FUNCTION)
@@ -15,21 +15,312 @@
 #include "qgspointsample.h"
 #include "qgsfeatureiterator.h"
 #include "qgsgeometry.h"
-#include "qgsspatialindex.h"
 #include "qgsvectorfilewriter.h"
 #include "qgsvectorlayer.h"
+#include <QDateTime>
 #include <QFile>
+#include <QHash>
+#include <QPair>
+#include <QtConcurrentMap>
+#include <algorithm>
+#include <cmath>
 #include "mersenne-twister.h"
 
+//! Outer rings with more vertices are not triangulated, ear clipping takes up to cubic time in their number
+static const int MAX_TRIANGULATED_RING_VERTICES = 256;
+
+//! A triangle of a polygon, with the index of the polygon in the multipolygon
+struct QgsPointSampleTriangle
+{
+  QgsPoint a;
+  QgsPoint b;
+  QgsPoint c;
+  int polygon;
+};
+
+//! A stratum and the points sampled in it
+struct QgsPointSampleStratum
+{
+  QgsFeatureId id;
+  QgsMultiPolygon polygons;
+  int nPoints;
+  double minDistance;
+  quint32 seed;
+  QVector<QgsPoint> points;
+};
+
+static double cross( const QgsPoint& o, const QgsPoint& a, const QgsPoint& b )
+{
+  return ( a.x() - o.x() ) * ( b.y() - o.y() ) - ( a.y() - o.y() ) * ( b.x() - o.x() );
+}
+
+//! Even-odd test of a point against a closed ring
+static bool pointInRing( const QgsPoint& pt, const QgsPolyline& ring )
+{
+  bool inside = false;
+  int n = ring.size();
+  for ( int i = 0, j = n - 1; i < n; j = i++ )
+  {
+    const QgsPoint& pi = ring.at( i );
+    const QgsPoint& pj = ring.at( j );
+    if (( pi.y() > pt.y() ) != ( pj.y() > pt.y() )
+        && pt.x() < ( pj.x() - pi.x() ) * ( pt.y() - pi.y() ) / ( pj.y() - pi.y() ) + pi.x() )
+    {
+      inside = !inside;
+    }
+  }
+  return inside;
+}
+
+//! Even-odd test of a point against all rings of a polygon, holes included
+static bool pointInPolygon( const QgsPoint& pt, const QgsPolygon& polygon )
+{
+  bool inside = false;
+  for ( int i = 0; i < polygon.size(); ++i )
+  {
+    if ( pointInRing( pt, polygon.at( i ) ) )
+      inside = !inside;
+  }
+  return inside;
+}
+
+/** Triangulates a ring by ear clipping and appends the triangles.
+ * @return false if no ear was found before the ring was used up (e.g. self intersecting ring)
+ */
+static bool triangulateRing( const QgsPolyline& ring, int polygon, QVector<QgsPointSampleTriangle>& triangles )
+{
+  // drop the closing point and repeated vertices
+  QVector<QgsPoint> pts;
+  pts.reserve( ring.size() );
+  for ( int i = 0; i < ring.size(); ++i )
+  {
+    if ( pts.isEmpty() || pts.last() != ring.at( i ) )
+      pts << ring.at( i );
+  }
+  while ( pts.size() > 1 && pts.last() == pts.first() )
+    pts.pop_back();
+
+  int n = pts.size();
+  if ( n < 3 )
+    return true;
+
+  double area2 = 0;
+  for ( int i = 0, j = n - 1; i < n; j = i++ )
+    area2 += pts.at( j ).x() * pts.at( i ).y() - pts.at( i ).x() * pts.at( j ).y();
+  if ( area2 < 0 )
+    std::reverse( pts.begin(), pts.end() );
+
+  QVector<int> prev( n );
+  QVector<int> next( n );
+  for ( int i = 0; i < n; ++i )
+  {
+    prev[i] = ( i + n - 1 ) % n;
+    next[i] = ( i + 1 ) % n;
+  }
+
+  int remaining = n;
+  int current = 0;
+  int tested = 0; //vertices tested since the last ear was clipped
+  while ( remaining > 2 )
+  {
+    if ( tested > remaining )
+      return false;
+
+    int p = prev[current];
+    int q = next[current];
+    const QgsPoint& a = pts.at( p );
+    const QgsPoint& b = pts.at( current );
+    const QgsPoint& c = pts.at( q );
+    double turn = cross( a, b, c );
+
+    // reflex vertices are no ears, collinear vertices are removed without a triangle
+    bool ear = turn >= 0;
+    if ( turn > 0 )
+    {
+      // no other vertex may lie inside the candidate ear
+      for ( int v = next[q]; v != p; v = next[v] )
+      {
+        const QgsPoint& pt = pts.at( v );
+        if ( pt == a || pt == b || pt == c )
+          continue;
+        if ( cross( a, b, pt ) >= 0 && cross( b, c, pt ) >= 0 && cross( c, a, pt ) >= 0 )
+        {
+          ear = false;
+          break;
+        }
+      }
+    }
+
+    if ( !ear )
+    {
+      current = q;
+      ++tested;
+      continue;
+    }
+
+    if ( turn > 0 )
+    {
+      QgsPointSampleTriangle t;
+      t.a = a;
+      t.b = b;
+      t.c = c;
+      t.polygon = polygon;
+      triangles << t;
+    }
+    next[p] = q;
+    prev[q] = p;
+    --remaining;
+    current = p;
+    tested = 0;
+  }
+  return true;
+}
+
+//! Key of the min distance grid cell containing a point
+static QPair<qint64, qint64> gridCell( const QgsPoint& pt, double cellSize )
+{
+  return qMakePair( static_cast< qint64 >( std::floor( pt.x() / cellSize ) ), static_cast< qint64 >( std::floor( pt.y() / cellSize ) ) );
+}
+
+//! Samples the points of a stratum, for QtConcurrent::blockingMap
+class QgsPointSampleJob
+{
+  public:
+    typedef void result_type;
+
+    void operator()( QgsPointSampleStratum& stratum )
+    {
+      if ( stratum.nPoints <= 0 || stratum.polygons.isEmpty() )
+        return;
+
+      mt_state random;
+      mt_seed_r( &random, stratum.seed );
+
+      // candidates are drawn in the triangles of the outer rings, only the holes remain to be tested.
+      // Large rings and rings which cannot be triangulated fall back to a test of random points in the bounding box
+      QVector<QgsPointSampleTriangle> triangles;
+      QVector<int> fallbackPolygons;
+      for ( int i = 0; i < stratum.polygons.size(); ++i )
+      {
+        const QgsPolygon& polygon = stratum.polygons.at( i );
+        if ( polygon.isEmpty() )
+          continue;
+        int nTriangles = triangles.size();
+        if ( polygon.at( 0 ).size() > MAX_TRIANGULATED_RING_VERTICES || !triangulateRing( polygon.at( 0 ), i, triangles ) )
+        {
+          triangles.resize( nTriangles );
+          fallbackPolygons << i;
+        }
+      }
+
+      QVector<double> cumulativeArea;
+      double area = 0;
+      for ( int i = 0; i < triangles.size(); ++i )
+      {
+        const QgsPointSampleTriangle& t = triangles.at( i );
+        area += 0.5 * cross( t.a, t.b, t.c );
+        cumulativeArea << area;
+      }
+      QgsRectangle fallbackRect;
+      fallbackRect.setMinimal();
+      for ( int i = 0; i < fallbackPolygons.size(); ++i )
+      {
+        const QgsPolyline& ring = stratum.polygons.at( fallbackPolygons.at( i ) ).at( 0 );
+        for ( int j = 0; j < ring.size(); ++j )
+        {
+          fallbackRect.combineExtentWith( ring.at( j ).x(), ring.at( j ).y() );
+        }
+      }
+      double fallbackArea = fallbackPolygons.isEmpty() ? 0 : fallbackRect.width() * fallbackRect.height();
+      if ( area <= 0 && fallbackArea <= 0 )
+        return;
+
+      bool checkDistance = stratum.minDistance > 0;
+      double sqrMinDistance = stratum.minDistance * stratum.minDistance;
+      QMultiHash< QPair<qint64, qint64>, int > grid;
+
+      int nIterations = 0;
+      int maxIterations = stratum.nPoints * 200;
+      while ( nIterations < maxIterations && stratum.points.size() < stratum.nPoints )
+      {
+        ++nIterations;
+
+        QgsPoint candidate;
+        double r = mt_randd_co_r( &random ) * ( area + fallbackArea );
+        if ( r < area )
+        {
+          int index = std::upper_bound( cumulativeArea.constBegin(), cumulativeArea.constEnd(), r ) - cumulativeArea.constBegin();
+          const QgsPointSampleTriangle& t = triangles.at( qMin( index, triangles.size() - 1 ) );
+          double u = mt_randd_co_r( &random );
+          double v = mt_randd_co_r( &random );
+          if ( u + v > 1 )
+          {
+            u = 1 - u;
+            v = 1 - v;
+          }
+          candidate.set( t.a.x() + u * ( t.b.x() - t.a.x() ) + v * ( t.c.x() - t.a.x() ),
+                         t.a.y() + u * ( t.b.y() - t.a.y() ) + v * ( t.c.y() - t.a.y() ) );
+
+          const QgsPolygon& polygon = stratum.polygons.at( t.polygon );
+          bool inHole = false;
+          for ( int h = 1; h < polygon.size() && !inHole; ++h )
+          {
+            inHole = pointInRing( candidate, polygon.at( h ) );
+          }
+          if ( inHole )
+            continue;
+        }
+        else
+        {
+          candidate.set( fallbackRect.xMinimum() + mt_randd_co_r( &random ) * fallbackRect.width(),
+                         fallbackRect.yMinimum() + mt_randd_co_r( &random ) * fallbackRect.height() );
+          bool inside = false;
+          for ( int i = 0; i < fallbackPolygons.size() && !inside; ++i )
+          {
+            inside = pointInPolygon( candidate, stratum.polygons.at( fallbackPolygons.at( i ) ) );
+          }
+          if ( !inside )
+            continue;
+        }
+
+        if ( checkDistance )
+        {
+          QPair<qint64, qint64> cell = gridCell( candidate, stratum.minDistance );
+          bool tooClose = false;
+          for ( qint64 x = cell.first - 1; x <= cell.first + 1 && !tooClose; ++x )
+          {
+            for ( qint64 y = cell.second - 1; y <= cell.second + 1 && !tooClose; ++y )
+            {
+              QMultiHash< QPair<qint64, qint64>, int >::const_iterator it = grid.constFind( qMakePair( x, y ) );
+              for ( ; it != grid.constEnd() && it.key() == qMakePair( x, y ); ++it )
+              {
+                if ( stratum.points.at( it.value() ).sqrDist( candidate ) < sqrMinDistance )
+                {
+                  tooClose = true;
+                  break;
+                }
+              }
+            }
+          }
+          if ( tooClose )
+            continue;
+          grid.insert( cell, stratum.points.size() );
+        }
+        stratum.points << candidate;
+      }
+    }
+};
 
 QgsPointSample::QgsPointSample( QgsVectorLayer* inputLayer, const QString& outputLayer, const QString& nPointsAttribute, const QString& minDistAttribute ): mInputLayer( inputLayer ),
     mOutputLayer( outputLayer ), mNumberOfPointsAttribute( nPointsAttribute ), mMinDistanceAttribute( minDistAttribute ), mNCreatedPoints( 0 )
+    , mSeed( static_cast< unsigned >( QDateTime::currentMSecsSinceEpoch() ) )
 {
 }
 
 QgsPointSample::QgsPointSample()
     : mInputLayer( nullptr )
     , mNCreatedPoints( 0 )
+    , mSeed( 0 )
 {
 }
 
@@ -70,10 +361,9 @@ int QgsPointSample::createRandomPoints( QProgressDialog* pd )
     return 3;
   }
 
-  //init random number generator
-  mt_srand( QTime::currentTime().msec() );
+  //read the strata first, their points are sampled in parallel without touching the layer or GEOS
+  QList<QgsPointSampleStratum> strata;
   QgsFeature fet;
-  int nPoints = 0;
   double minDistance = 0;
   mNCreatedPoints = 0;
 
@@ -81,94 +371,60 @@ int QgsPointSample::createRandomPoints( QProgressDialog* pd )
                              QStringList() << mNumberOfPointsAttribute << mMinDistanceAttribute, mInputLayer->fields() ) );
   while ( fIt.nextFeature( fet ) )
   {
-    nPoints = fet.attribute( mNumberOfPointsAttribute ).toInt();
-    if ( !mMinDistanceAttribute.isEmpty() )
+    const QgsGeometry* geom = fet.constGeometry();
+    if ( !geom || geom->boundingBox().isEmpty() )
     {
-      minDistance = fet.attribute( mMinDistanceAttribute ).toDouble();
+      continue;
     }
-    addSamplePoints( fet, writer, nPoints, minDistance );
-  }
 
-  return 0;
-}
-
-void QgsPointSample::addSamplePoints( QgsFeature& inputFeature, QgsVectorFileWriter& writer, int nPoints, double minDistance )
-{
-  if ( !inputFeature.constGeometry() )
-    return;
-
-  const QgsGeometry* geom = inputFeature.constGeometry();
-  QgsRectangle geomRect = geom->boundingBox();
-  if ( geomRect.isEmpty() )
-  {
-    return;
-  }
-
-  QgsSpatialIndex sIndex; //to check minimum distance
-  QMap< QgsFeatureId, QgsPoint > pointMapForFeature;
-
-  int nIterations = 0;
-  int maxIterations = nPoints * 200;
-  int points = 0;
-
-  double randX = 0;
-  double randY = 0;
-
-  while ( nIterations < maxIterations && points < nPoints )
-  {
-    randX = (( double )mt_rand() / MD_RAND_MAX ) * geomRect.width() + geomRect.xMinimum();
-    randY = (( double )mt_rand() / MD_RAND_MAX ) * geomRect.height() + geomRect.yMinimum();
-    QgsPoint randPoint( randX, randY );
-    QgsGeometry* ptGeom = QgsGeometry::fromPoint( randPoint );
-    if ( ptGeom->within( geom ) && checkMinDistance( randPoint, sIndex, minDistance, pointMapForFeature ) )
+    if ( !mMinDistanceAttribute.isEmpty() )
     {
-      //add feature to writer
-      QgsFeature f( mNCreatedPoints );
-      f.setAttribute( "id", mNCreatedPoints + 1 );
-      f.setAttribute( "station_id", points + 1 );
-      f.setAttribute( "stratum_id", inputFeature.id() );
-      f.setGeometry( ptGeom );
-      writer.addFeature( f );
-      sIndex.insertFeature( f );
-      pointMapForFeature.insert( mNCreatedPoints, randPoint );
-      ++points;
-      ++mNCreatedPoints;
+      minDistance = fet.attribute( mMinDistanceAttribute ).toDouble();
     }
+
+    QgsPointSampleStratum stratum;
+    stratum.id = fet.id();
+    if ( geom->isMultipart() )
+      stratum.polygons = geom->asMultiPolygon();
     else
-    {
-      delete ptGeom;
-    }
-    ++nIterations;
+      stratum.polygons << geom->asPolygon();
+    stratum.nPoints = fet.attribute( mNumberOfPointsAttribute ).toInt();
+    stratum.minDistance = minDistance;
+    //each stratum has its own generator, so the result does not depend on the scheduling of the threads
+    stratum.seed = mSeed ^ ( static_cast< quint32 >( fet.id() + 1 ) * 0x9e3779b9U );
+    strata << stratum;
   }
-}
 
-bool QgsPointSample::checkMinDistance( QgsPoint& pt, QgsSpatialIndex& index, double minDistance, QMap< QgsFeatureId, QgsPoint >& pointMap )
-{
-  if ( minDistance <= 0 )
+  if ( strata.isEmpty() )
   {
-    return true;
+    return 0;
   }
 
-  QList<QgsFeatureId> neighborList = index.nearestNeighbor( pt, 1 );
-  if ( neighborList.isEmpty() )
+  QgsPointSampleJob job;
+  if ( strata.size() > 1 )
   {
-    return true;
+    QtConcurrent::blockingMap( strata, job );
   }
-
-  QMap< QgsFeatureId, QgsPoint >::const_iterator it = pointMap.find( neighborList[0] );
-  if ( it == pointMap.constEnd() ) //should not happen
+  else
   {
-    return true;
+    job( strata[0] );
   }
 
-  QgsPoint neighborPt = it.value();
-  if ( neighborPt.sqrDist( pt ) < ( minDistance * minDistance ) )
+  //write in feature order, so that ids are the same whatever the number of threads
+  for ( int i = 0; i < strata.size(); ++i )
   {
-    return false;
+    const QgsPointSampleStratum& stratum = strata.at( i );
+    for ( int j = 0; j < stratum.points.size(); ++j )
+    {
+      QgsFeature f( outputFields, mNCreatedPoints );
+      f.setAttribute( "id", mNCreatedPoints + 1 );
+      f.setAttribute( "station_id", j + 1 );
+      f.setAttribute( "stratum_id", stratum.id );
+      f.setGeometry( QgsGeometry::fromPoint( stratum.points.at( j ) ) );
+      writer.addFeature( f );
+      ++mNCreatedPoints;
+    }
   }
-  return true;
-}
-
-
-
 
+  return 0;
+}
@@ -19,14 +19,12 @@
 #include <QString>
 
 class QgsFeature;
-class QgsPoint;
-class QgsSpatialIndex;
-class QgsVectorFileWriter;
 class QgsVectorLayer;
 class QProgressDialog;
 
 /** \ingroup analysis
- * Creates random points in polygons / multipolygons*/
+ * Creates random points in polygons / multipolygons. The strata are sampled in parallel,
+ * each with its own random generator seeded from seed(), so the result only depends on the seed*/
 class ANALYSIS_EXPORT QgsPointSample
 {
   public:
@@ -36,11 +34,19 @@ class ANALYSIS_EXPORT QgsPointSample
         @return 0 in case of success*/
     int createRandomPoints( QProgressDialog* pd );
 
+    /** Sets the seed of the random generators. Defaults to a time based value
+     * @note added in QGIS 3.0
+     */
+    void setSeed( unsigned seed ) { mSeed = seed; }
+
+    /** Returns the seed of the random generators
+     * @note added in QGIS 3.0
+     */
+    unsigned seed() const { return mSeed; }
+
   private:
 
     QgsPointSample(); //default constructor is forbidden
-    void addSamplePoints( QgsFeature& inputFeature, QgsVectorFileWriter& writer, int nPoints, double minDistance );
-    bool checkMinDistance( QgsPoint& pt, QgsSpatialIndex& index, double minDistance, QMap< QgsFeatureId, QgsPoint >& pointMap );
 
     /** Layer id of input polygon/multipolygon layer*/
     QgsVectorLayer* mInputLayer;
@@ -51,6 +57,7 @@ class ANALYSIS_EXPORT QgsPointSample
     /** Attribute containing minimum distance between sample points (or -1 if no min. distance constraint)*/
     QString mMinDistanceAttribute;
     QgsFeatureId mNCreatedPoints; //helper to find free ids
+    unsigned mSeed;
 };
 
 #endif // QGSPOINTSAMPLE_H
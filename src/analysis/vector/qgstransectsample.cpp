@@ -16,17 +16,141 @@
 #include "qgsdistancearea.h"
 #include "qgsfeatureiterator.h"
 #include "qgsgeometry.h"
-#include "qgsspatialindex.h"
 #include "qgsvectorfilewriter.h"
 #include "qgsvectorlayer.h"
+#include <QDateTime>
 #include <QProgressDialog>
 #include <QFileInfo>
+#include <QHash>
 #ifndef _MSC_VER
 #include <stdint.h>
 #endif
 #include "mersenne-twister.h"
+#include <cmath>
 #include <limits>
 
+//! Maximum number of minimum distance grid cells along the larger side of a stratum
+static const double MAX_GRID_CELLS = 256;
+
+//! Returns the parts of a line or multiline geometry
+static QgsMultiPolyline lineParts( const QgsGeometry* geom )
+{
+  if ( geom->isMultipart() )
+    return geom->asMultiPolyline();
+  return QgsMultiPolyline() << geom->asPolyline();
+}
+
+/** Grid of the transects of a stratum, to find the transects near a new one without buffering it.
+ * A transect is registered in every cell its segments pass through. The cells are at least as large as
+ * the minimum distance, so the transects closer than that to a line are in the cells of the line or their neighbors*/
+class QgsTransectSample::TransectGrid
+{
+  public:
+    TransectGrid( const QgsRectangle& extent, double minCellSize )
+        : mQuery( 0 )
+    {
+      mCellSize = qMax( minCellSize, qMax( extent.width(), extent.height() ) / MAX_GRID_CELLS );
+      if ( mCellSize <= 0 )
+        mCellSize = 1.0;
+    }
+
+    ~TransectGrid() { qDeleteAll( mLines ); }
+
+    //! Adds a transect, the grid takes ownership
+    void insert( QgsGeometry* line )
+    {
+      int index = mLines.size();
+      mLines << line;
+      mStamps << 0;
+      QVector< QPair<qint64, qint64> > cells = lineCells( line );
+      for ( int i = 0; i < cells.size(); ++i )
+      {
+        QVector<int>& cellLines = mCells[ cells.at( i )];
+        if ( cellLines.isEmpty() || cellLines.last() != index )
+          cellLines << index;
+      }
+    }
+
+    //! Returns the transects in the cells of a line and their neighbors, each one once
+    QVector<QgsGeometry*> candidates( const QgsGeometry* line )
+    {
+      ++mQuery;
+      QVector<QgsGeometry*> result;
+      QVector< QPair<qint64, qint64> > cells = lineCells( line );
+      for ( int i = 0; i < cells.size(); ++i )
+      {
+        for ( qint64 x = cells.at( i ).first - 1; x <= cells.at( i ).first + 1; ++x )
+        {
+          for ( qint64 y = cells.at( i ).second - 1; y <= cells.at( i ).second + 1; ++y )
+          {
+            QHash< QPair<qint64, qint64>, QVector<int> >::const_iterator cellIt = mCells.constFind( qMakePair( x, y ) );
+            if ( cellIt == mCells.constEnd() )
+              continue;
+            const QVector<int>& cellLines = cellIt.value();
+            for ( int j = 0; j < cellLines.size(); ++j )
+            {
+              int index = cellLines.at( j );
+              if ( mStamps.at( index ) != mQuery )
+              {
+                mStamps[ index ] = mQuery;
+                result << mLines.at( index );
+              }
+            }
+          }
+        }
+      }
+      return result;
+    }
+
+  private:
+    Q_DISABLE_COPY( TransectGrid )
+
+    qint64 cellIndex( double coordinate ) const { return static_cast< qint64 >( std::floor( coordinate / mCellSize ) ); }
+
+    //! Cells crossed by the segments of a line, row by row
+    QVector< QPair<qint64, qint64> > lineCells( const QgsGeometry* line ) const
+    {
+      QVector< QPair<qint64, qint64> > cells;
+      QgsMultiPolyline parts = lineParts( line );
+      for ( int p = 0; p < parts.size(); ++p )
+      {
+        const QgsPolyline& part = parts.at( p );
+        for ( int i = 0; i + 1 < part.size(); ++i )
+        {
+          const QgsPoint& p1 = part.at( i );
+          const QgsPoint& p2 = part.at( i + 1 );
+          double yMin = qMin( p1.y(), p2.y() );
+          double yMax = qMax( p1.y(), p2.y() );
+          for ( qint64 row = cellIndex( yMin ); row <= cellIndex( yMax ); ++row )
+          {
+            // x range of the segment inside the row
+            double y1 = qMax( yMin, row * mCellSize );
+            double y2 = qMin( yMax, ( row + 1 ) * mCellSize );
+            double x1 = p1.x();
+            double x2 = p2.x();
+            if ( p1.y() != p2.y() )
+            {
+              x1 = p1.x() + ( p2.x() - p1.x() ) * ( y1 - p1.y() ) / ( p2.y() - p1.y() );
+              x2 = p1.x() + ( p2.x() - p1.x() ) * ( y2 - p1.y() ) / ( p2.y() - p1.y() );
+            }
+            for ( qint64 column = cellIndex( qMin( x1, x2 ) ); column <= cellIndex( qMax( x1, x2 ) ); ++column )
+            {
+              cells << qMakePair( column, row );
+            }
+          }
+        }
+      }
+      return cells;
+    }
+
+    double mCellSize;
+    QHash< QPair<qint64, qint64>, QVector<int> > mCells;
+    QVector<QgsGeometry*> mLines;
+    //! Query number of the last query which returned each line
+    QVector<int> mStamps;
+    int mQuery;
+};
+
 QgsTransectSample::QgsTransectSample( QgsVectorLayer* strataLayer, const QString& strataIdAttribute, const QString& minDistanceAttribute, const QString& nPointsAttribute, DistanceUnits minDistUnits,
                                       QgsVectorLayer* baselineLayer, bool shareBaseline, const QString& baselineStrataId, const QString& outputPointLayer,
                                       const QString& outputLineLayer, const QString& usedBaselineLayer, double minTransectLength,
@@ -45,6 +169,7 @@ QgsTransectSample::QgsTransectSample( QgsVectorLayer* strataLayer, const QString
     , mMinTransectLength( minTransectLength )
     , mBaselineBufferDistance( baselineBufferDistance )
     , mBaselineSimplificationTolerance( baselineSimplificationTolerance )
+    , mSeed( static_cast< unsigned >( QDateTime::currentMSecsSinceEpoch() ) )
 {
 }
 
@@ -56,6 +181,7 @@ QgsTransectSample::QgsTransectSample()
     , mMinTransectLength( 0.0 )
     , mBaselineBufferDistance( -1.0 )
     , mBaselineSimplificationTolerance( -1.0 )
+    , mSeed( 0 )
 {
 }
 
@@ -136,8 +262,17 @@ int QgsTransectSample::createSample( QProgressDialog* pd )
   //possibility to transform output points to lat/long
   QgsCoordinateTransform toLatLongTransform( mStrataLayer->crs(), QgsCoordinateReferenceSystem( 4326, QgsCoordinateReferenceSystem::EpsgCrsId ) );
 
-  //init random number generator
-  mt_srand( QTime::currentTime().msec() );
+  //read the baselines once instead of searching the baseline layer for every stratum
+  QList< QPair< QVariant, QgsGeometry > > baselines;
+  QgsFeatureIterator baselineIt = mBaselineLayer->getFeatures( QgsFeatureRequest().setSubsetOfAttributes( QStringList( mBaselineStrataId ), mBaselineLayer->fields() ) );
+  QgsFeature baselineFeature;
+  while ( baselineIt.nextFeature( baselineFeature ) )
+  {
+    if ( baselineFeature.constGeometry() )
+    {
+      baselines << qMakePair( baselineFeature.attribute( mBaselineStrataId ), *baselineFeature.constGeometry() );
+    }
+  }
 
   QgsFeatureRequest fr;
   fr.setSubsetOfAttributes( QStringList() << mStrataIdAttribute << mMinDistanceAttribute << mNPointsAttribute, mStrataLayer->fields() );
@@ -171,7 +306,7 @@ int QgsTransectSample::createSample( QProgressDialog* pd )
 
     //find baseline for strata
     QVariant strataId = fet.attribute( mStrataIdAttribute );
-    QgsGeometry* baselineGeom = findBaselineGeometry( strataId.isValid() ? strataId : -1 );
+    QgsGeometry* baselineGeom = findBaselineGeometry( strataId.isValid() ? strataId : -1, baselines );
     if ( !baselineGeom )
     {
       continue;
@@ -212,12 +347,15 @@ int QgsTransectSample::createSample( QProgressDialog* pd )
     int nIterations = 0;
     int nMaxIterations = nTransects * 50;
 
-    QgsSpatialIndex sIndex; //to check minimum distance
-    QMap< QgsFeatureId, QgsGeometry* > lineFeatureMap;
+    TransectGrid grid( strataGeom->boundingBox(), minDistanceLayerUnits ); //to check minimum distance
+
+    //each stratum has its own generator, the transects of a stratum do not depend on the previous strata
+    mt_state random;
+    mt_seed_r( &random, mSeed ^ ( static_cast< quint32 >( fet.id() + 1 ) * 0x9e3779b9U ) );
 
     while ( nCreatedTransects < nTransects && nIterations < nMaxIterations )
     {
-      double randomPosition = (( double )mt_rand() / MD_RAND_MAX ) * clippedBaseline->length();
+      double randomPosition = (( double )mt_rand_r( &random ) / MD_RAND_MAX ) * clippedBaseline->length();
       QgsGeometry* samplePoint = clippedBaseline->interpolate( randomPosition );
       ++nIterations;
       if ( !samplePoint )
@@ -292,7 +430,7 @@ int QgsTransectSample::createSample( QProgressDialog* pd )
       }
 
       //search closest existing profile. Cancel if dist < minDist
-      if ( otherTransectWithinDistance( lineClipStratum, minDistanceLayerUnits, minDistance, sIndex, lineFeatureMap, distanceArea ) )
+      if ( otherTransectWithinDistance( lineClipStratum, minDistanceLayerUnits, minDistance, grid, distanceArea ) )
       {
         delete lineFarAwayGeom;
         delete lineClipStratum;
@@ -315,9 +453,8 @@ int QgsTransectSample::createSample( QProgressDialog* pd )
       //It can only be written if the corresponding transect has been as well
       outputPointWriter.addFeature( samplePointFeature );
 
-      sIndex.insertFeature( sampleLineFeature );
       Q_NOWARN_DEPRECATED_PUSH
-      lineFeatureMap.insert( fid, sampleLineFeature.geometryAndOwnership() );
+      grid.insert( sampleLineFeature.geometryAndOwnership() );
       Q_NOWARN_DEPRECATED_POP
 
       delete lineFarAwayGeom;
@@ -332,13 +469,6 @@ int QgsTransectSample::createSample( QProgressDialog* pd )
     bufferClipLineWriter.addFeature( bufferClipFeature );
     //delete bufferLineClipped;
 
-    //delete all line geometries in spatial index
-    QMap< QgsFeatureId, QgsGeometry* >::iterator featureMapIt = lineFeatureMap.begin();
-    for ( ; featureMapIt != lineFeatureMap.end(); ++featureMapIt )
-    {
-      delete( featureMapIt.value() );
-    }
-    lineFeatureMap.clear();
     delete baselineGeom;
 
     ++nFeatures;
@@ -352,64 +482,39 @@ int QgsTransectSample::createSample( QProgressDialog* pd )
   return 0;
 }
 
-QgsGeometry* QgsTransectSample::findBaselineGeometry( const QVariant& strataId )
+QgsGeometry* QgsTransectSample::findBaselineGeometry( const QVariant& strataId, const QList< QPair< QVariant, QgsGeometry > >& baselines ) const
 {
-  if ( !mBaselineLayer )
+  QList< QPair< QVariant, QgsGeometry > >::const_iterator baselineIt = baselines.constBegin();
+  for ( ; baselineIt != baselines.constEnd(); ++baselineIt )
   {
-    return nullptr;
-  }
-
-  QgsFeatureIterator baseLineIt = mBaselineLayer->getFeatures( QgsFeatureRequest().setSubsetOfAttributes( QStringList( mBaselineStrataId ), mBaselineLayer->fields() ) );
-  QgsFeature fet;
-
-  while ( baseLineIt.nextFeature( fet ) ) //todo: cache this in case there are many baslines
-  {
-    if ( strataId == fet.attribute( mBaselineStrataId ) || mShareBaseline )
+    if ( strataId == baselineIt->first || mShareBaseline )
     {
-      Q_NOWARN_DEPRECATED_PUSH
-      return fet.geometryAndOwnership();
-      Q_NOWARN_DEPRECATED_POP
+      return new QgsGeometry( baselineIt->second );
     }
   }
   return nullptr;
 }
 
-bool QgsTransectSample::otherTransectWithinDistance( QgsGeometry* geom, double minDistLayerUnit, double minDistance, QgsSpatialIndex& sIndex,
-    const QMap< QgsFeatureId, QgsGeometry* >& lineFeatureMap, QgsDistanceArea& da )
+bool QgsTransectSample::otherTransectWithinDistance( QgsGeometry* geom, double minDistLayerUnit, double minDistance, TransectGrid& grid, QgsDistanceArea& da )
 {
-  if ( !geom )
+  if ( !geom || minDistLayerUnit <= 0 )
   {
     return false;
   }
 
-  QgsGeometry* buffer = geom->buffer( minDistLayerUnit, 8 );
-  if ( !buffer )
+  QVector<QgsGeometry*> lines = grid.candidates( geom );
+  for ( int i = 0; i < lines.size(); ++i )
   {
-    return false;
-  }
-  QgsRectangle rect = buffer->boundingBox();
-  QList<QgsFeatureId> lineIdList = sIndex.intersects( rect );
+    double dist = 0;
+    QgsPoint pt1, pt2;
+    closestSegmentPoints( *geom, *lines.at( i ), dist, pt1, pt2 );
+    dist = da.measureLine( pt1, pt2 ); //convert degrees to meters if necessary
 
-  QList<QgsFeatureId>::const_iterator lineIdIt = lineIdList.constBegin();
-  for ( ; lineIdIt != lineIdList.constEnd(); ++lineIdIt )
-  {
-    const QMap< QgsFeatureId, QgsGeometry* >::const_iterator idMapIt = lineFeatureMap.find( *lineIdIt );
-    if ( idMapIt != lineFeatureMap.constEnd() )
+    if ( dist < minDistance )
     {
-      double dist = 0;
-      QgsPoint pt1, pt2;
-      closestSegmentPoints( *geom, *( idMapIt.value() ), dist, pt1, pt2 );
-      dist = da.measureLine( pt1, pt2 ); //convert degrees to meters if necessary
-
-      if ( dist < minDistance )
-      {
-        delete buffer;
-        return true;
-      }
+      return true;
     }
   }
-
-  delete buffer;
   return false;
 }
 
@@ -16,18 +16,20 @@
 #define QGSTRANSECTSAMPLE_H
 
 #include "qgsfeature.h"
-#include <QMap>
+#include <QList>
+#include <QPair>
 #include <QString>
 
 class QgsDistanceArea;
 class QgsGeometry;
-class QgsSpatialIndex;
 class QgsVectorLayer;
 class QgsPoint;
 class QProgressDialog;
 
 /** \ingroup analysis
- * A class for the creation of transect sample lines based on a set of strata polygons and baselines*/
+ * A class for the creation of transect sample lines based on a set of strata polygons and baselines.
+ * Each stratum has its own random generator seeded from seed(), so the transects of a stratum
+ * do not depend on the other strata*/
 class ANALYSIS_EXPORT QgsTransectSample
 {
   public:
@@ -45,14 +47,28 @@ class ANALYSIS_EXPORT QgsTransectSample
 
     int createSample( QProgressDialog* pd );
 
+    /** Sets the seed of the random generators. Defaults to a time based value
+     * @note added in QGIS 3.0
+     */
+    void setSeed( unsigned seed ) { mSeed = seed; }
+
+    /** Returns the seed of the random generators
+     * @note added in QGIS 3.0
+     */
+    unsigned seed() const { return mSeed; }
+
   private:
     QgsTransectSample(); //default constructor forbidden
 
-    QgsGeometry* findBaselineGeometry( const QVariant& strataId );
+    class TransectGrid;
+
+    /** Returns a copy of the baseline of a stratum (caller takes ownership)
+        @param strataId stratum id
+        @param baselines baseline strata ids and geometries, read once for all strata*/
+    QgsGeometry* findBaselineGeometry( const QVariant& strataId, const QList< QPair< QVariant, QgsGeometry > >& baselines ) const;
 
     /** Returns true if another transect is within the specified minimum distance*/
-    static bool otherTransectWithinDistance( QgsGeometry* geom, double minDistLayerUnit, double minDistance, QgsSpatialIndex& sIndex, const QMap< QgsFeatureId, QgsGeometry* >&
-        lineFeatureMap, QgsDistanceArea& da );
+    static bool otherTransectWithinDistance( QgsGeometry* geom, double minDistLayerUnit, double minDistance, TransectGrid& grid, QgsDistanceArea& da );
 
     QgsVectorLayer* mStrataLayer;
     QString mStrataIdAttribute;
@@ -76,6 +92,8 @@ class ANALYSIS_EXPORT QgsTransectSample
     /** If value is negative, no simplification is done to the baseline prior to create the buffer*/
     double mBaselineSimplificationTolerance;
 
+    unsigned mSeed;
+
     /** Finds the closest points between two line segments
         @param g1 first input geometry. Must be a linestring with two vertices
         @param g2 second input geometry. Must be a linestring with two vertices
@@ -25,6 +25,9 @@
 #include "cpl_string.h"
 #include <QProgressDialog>
 #include <QFile>
+#include <QtConcurrentMap>
+#include <algorithm>
+#include <climits>
 
 #if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 1800
 #define TO8F(x) (x).toUtf8().constData()
@@ -32,6 +35,147 @@
 #define TO8F(x) QFile::encodeName( x ).constData()
 #endif
 
+//! Maximum number of raster cells read ahead for a batch of features. Larger features are read in strips of this size
+static const qint64 MAX_BATCH_CELLS = 16 * 1024 * 1024;
+//! Maximum number of features calculated in a batch
+static const int MAX_BATCH_FEATURES = 256;
+
+//! A feature, the raster window covering it and its statistics
+struct QgsZonalStatistics::FeatureJob
+{
+  FeatureJob()
+      : fid( 0 )
+      , offsetX( 0 )
+      , offsetY( 0 )
+      , nCellsX( 0 )
+      , nCellsY( 0 )
+      , calculated( false )
+  {}
+
+  QgsFeatureId fid;
+  QgsMultiPolygon polygons;
+  int offsetX;
+  int offsetY;
+  int nCellsX;
+  int nCellsY;
+  //! Raster values of the window, row by row
+  QVector<float> data;
+  FeatureStats stats;
+  //! Whether the statistics are already calculated (features read in strips)
+  bool calculated;
+};
+
+//! Calculates the statistics of a feature job, for QtConcurrent::blockingMap
+class QgsZonalStatistics::FeatureJobCalculation
+{
+  public:
+    FeatureJobCalculation( const QgsZonalStatistics* zonalStatistics, double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox )
+        : mZonalStatistics( zonalStatistics )
+        , mCellSizeX( cellSizeX )
+        , mCellSizeY( cellSizeY )
+        , mRasterBBox( rasterBBox )
+    {}
+
+    typedef void result_type;
+
+    void operator()( FeatureJob& job )
+    {
+      if ( job.calculated )
+        return;
+
+      mZonalStatistics->statisticsFromMiddlePointTest( job.data.constData(), job.polygons, job.offsetX, job.offsetY, job.nCellsX, job.nCellsY,
+          mCellSizeX, mCellSizeY, mRasterBBox, job.stats );
+      if ( job.stats.count <= 1 )
+      {
+        //the cell resolution is probably larger than the polygon area. We switch to precise pixel - polygon intersection in this case
+        job.stats.reset();
+        mZonalStatistics->statisticsFromPreciseIntersection( job.data.constData(), job.polygons, job.offsetX, job.offsetY, job.nCellsX, job.nCellsY,
+            mCellSizeX, mCellSizeY, mRasterBBox, job.stats );
+      }
+      job.data.clear();
+      job.calculated = true;
+    }
+
+  private:
+    const QgsZonalStatistics* mZonalStatistics;
+    double mCellSizeX;
+    double mCellSizeY;
+    QgsRectangle mRasterBBox;
+};
+
+//! A polygon edge, for the scanline rasterization
+struct QgsZonalStatisticsEdge
+{
+  double x1;
+  double y1;
+  double x2;
+  double y2;
+  double yMin;
+  double yMax;
+};
+
+static bool edgeYMaxGreaterThan( const QgsZonalStatisticsEdge& e1, const QgsZonalStatisticsEdge& e2 )
+{
+  return e1.yMax > e2.yMax;
+}
+
+//! Clips a ring against one side of an axis aligned rectangle (one step of the Sutherland-Hodgman algorithm)
+static void clipRing( const QVector<QgsPoint>& input, QVector<QgsPoint>& output, bool vertical, double limit, bool keepGreater )
+{
+  output.clear();
+  int n = input.size();
+  for ( int i = 0; i < n; ++i )
+  {
+    const QgsPoint& current = input.at( i );
+    const QgsPoint& previous = input.at(( i + n - 1 ) % n );
+    double c = vertical ? current.x() : current.y();
+    double p = vertical ? previous.x() : previous.y();
+    bool currentInside = keepGreater ? c >= limit : c <= limit;
+    bool previousInside = keepGreater ? p >= limit : p <= limit;
+    if ( currentInside != previousInside )
+    {
+      double t = ( limit - p ) / ( c - p );
+      if ( vertical )
+        output << QgsPoint( limit, previous.y() + t * ( current.y() - previous.y() ) );
+      else
+        output << QgsPoint( previous.x() + t * ( current.x() - previous.x() ), limit );
+    }
+    if ( currentInside )
+      output << current;
+  }
+}
+
+//! Area of the part of a ring inside a rectangle
+static double clippedRingArea( const QgsPolyline& ring, const QgsRectangle& rect, QVector<QgsPoint>& buffer1, QVector<QgsPoint>& buffer2 )
+{
+  clipRing( ring, buffer1, true, rect.xMinimum(), true );
+  clipRing( buffer1, buffer2, true, rect.xMaximum(), false );
+  clipRing( buffer2, buffer1, false, rect.yMinimum(), true );
+  clipRing( buffer1, buffer2, false, rect.yMaximum(), false );
+
+  double area = 0;
+  int n = buffer2.size();
+  for ( int i = 0; i < n; ++i )
+  {
+    const QgsPoint& p1 = buffer2.at( i );
+    const QgsPoint& p2 = buffer2.at(( i + 1 ) % n );
+    area += p1.x() * p2.y() - p2.x() * p1.y();
+  }
+  return qAbs( area ) / 2.0;
+}
+
+//! Bounding box of a ring
+static QgsRectangle ringBoundingBox( const QgsPolyline& ring )
+{
+  QgsRectangle bbox;
+  bbox.setMinimal();
+  Q_FOREACH ( const QgsPoint& pt, ring )
+  {
+    bbox.combineExtentWith( pt.x(), pt.y() );
+  }
+  return bbox;
+}
+
 QgsZonalStatistics::QgsZonalStatistics( QgsVectorLayer* polygonLayer, const QString& rasterFile, const QString& attributePrefix, int rasterBand, const Statistics& stats )
     : mRasterFilePath( rasterFile )
     , mRasterBand( rasterBand )
@@ -234,133 +378,169 @@ int QgsZonalStatistics::calculateStatistics( QProgressDialog* p )
   QgsFeatureIterator fi = vectorProvider->getFeatures( request );
   QgsFeature f;
 
-  bool statsStoreValues = ( mStatistics & QgsZonalStatistics::Median ) ||
-                          ( mStatistics & QgsZonalStatistics::StDev );
+  bool statsStoreValues = mStatistics & QgsZonalStatistics::Median;
   bool statsStoreValueCount = ( mStatistics & QgsZonalStatistics::Minority ) ||
-                              ( mStatistics & QgsZonalStatistics::Majority );
+                              ( mStatistics & QgsZonalStatistics::Majority ) ||
+                              ( mStatistics & QgsZonalStatistics::Variety );
 
-  FeatureStats featureStats( statsStoreValues, statsStoreValueCount );
+  //features are processed in batches: the raster windows of a batch are read on this thread, in feature order, so that
+  //overlapping zones hit the blocks GDAL has just cached, then the statistics of the batch are calculated in parallel
+  FeatureJobCalculation calculation( this, cellsizeX, cellsizeY, rasterBBox );
   int featureCounter = 0;
+  bool endOfFeatures = false;
+  bool canceled = false;
 
   QgsChangedAttributesMap changeMap;
-  while ( fi.nextFeature( f ) )
+  while ( !endOfFeatures )
   {
-    if ( p )
+    QList<FeatureJob> jobs;
+    qint64 batchCells = 0;
+    while ( jobs.size() < MAX_BATCH_FEATURES && batchCells < MAX_BATCH_CELLS )
     {
-      p->setValue( featureCounter );
-    }
+      if ( !fi.nextFeature( f ) )
+      {
+        endOfFeatures = true;
+        break;
+      }
 
-    if ( p && p->wasCanceled() )
-    {
-      break;
-    }
+      if ( p )
+      {
+        p->setValue( featureCounter );
+      }
 
-    if ( !f.constGeometry() )
-    {
-      ++featureCounter;
-      continue;
-    }
-    const QgsGeometry* featureGeometry = f.constGeometry();
+      if ( p && p->wasCanceled() )
+      {
+        endOfFeatures = true;
+        canceled = true;
+        break;
+      }
 
-    QgsRectangle featureRect = featureGeometry->boundingBox().intersect( &rasterBBox );
-    if ( featureRect.isEmpty() )
-    {
-      ++featureCounter;
-      continue;
-    }
+      if ( !f.constGeometry() )
+      {
+        ++featureCounter;
+        continue;
+      }
+      const QgsGeometry* featureGeometry = f.constGeometry();
 
-    int offsetX, offsetY, nCellsX, nCellsY;
-    if ( cellInfoForBBox( rasterBBox, featureRect, cellsizeX, cellsizeY, offsetX, offsetY, nCellsX, nCellsY ) != 0 )
-    {
-      ++featureCounter;
-      continue;
-    }
+      QgsRectangle featureRect = featureGeometry->boundingBox().intersect( &rasterBBox );
+      if ( featureRect.isEmpty() )
+      {
+        ++featureCounter;
+        continue;
+      }
 
-    //avoid access to cells outside of the raster (may occur because of rounding)
-    if (( offsetX + nCellsX ) > nCellsXGDAL )
-    {
-      nCellsX = nCellsXGDAL - offsetX;
-    }
-    if (( offsetY + nCellsY ) > nCellsYGDAL )
-    {
-      nCellsY = nCellsYGDAL - offsetY;
-    }
+      FeatureJob job;
+      if ( cellInfoForBBox( rasterBBox, featureRect, cellsizeX, cellsizeY, job.offsetX, job.offsetY, job.nCellsX, job.nCellsY ) != 0 )
+      {
+        ++featureCounter;
+        continue;
+      }
 
-    statisticsFromMiddlePointTest( rasterBand, featureGeometry, offsetX, offsetY, nCellsX, nCellsY, cellsizeX, cellsizeY,
-                                   rasterBBox, featureStats );
+      //avoid access to cells outside of the raster (may occur because of rounding)
+      if (( job.offsetX + job.nCellsX ) > nCellsXGDAL )
+      {
+        job.nCellsX = nCellsXGDAL - job.offsetX;
+      }
+      if (( job.offsetY + job.nCellsY ) > nCellsYGDAL )
+      {
+        job.nCellsY = nCellsYGDAL - job.offsetY;
+      }
 
-    if ( featureStats.count <= 1 )
-    {
-      //the cell resolution is probably larger than the polygon area. We switch to precise pixel - polygon intersection in this case
-      statisticsFromPreciseIntersection( rasterBand, featureGeometry, offsetX, offsetY, nCellsX, nCellsY, cellsizeX, cellsizeY,
-                                         rasterBBox, featureStats );
-    }
+      job.fid = f.id();
+      job.polygons = featureGeometry->isMultipart() ? featureGeometry->asMultiPolygon() : QgsMultiPolygon() << featureGeometry->asPolygon();
+      job.stats = FeatureStats( statsStoreValues, statsStoreValueCount );
 
-    //write the statistics value to the vector data provider
-    QgsAttributeMap changeAttributeMap;
-    if ( mStatistics & QgsZonalStatistics::Count )
-      changeAttributeMap.insert( countIndex, QVariant( featureStats.count ) );
-    if ( mStatistics & QgsZonalStatistics::Sum )
-      changeAttributeMap.insert( sumIndex, QVariant( featureStats.sum ) );
-    if ( featureStats.count > 0 )
-    {
-      double mean = featureStats.sum / featureStats.count;
-      if ( mStatistics & QgsZonalStatistics::Mean )
-        changeAttributeMap.insert( meanIndex, QVariant( mean ) );
-      if ( mStatistics & QgsZonalStatistics::Median )
+      qint64 cells = ( qint64 )job.nCellsX * job.nCellsY;
+      if ( cells > MAX_BATCH_CELLS )
       {
-        qSort( featureStats.values.begin(), featureStats.values.end() );
-        int size =  featureStats.values.count();
-        bool even = ( size % 2 ) < 1;
-        double medianValue;
-        if ( even )
-        {
-          medianValue = ( featureStats.values.at( size / 2 - 1 ) + featureStats.values.at( size / 2 ) ) / 2;
-        }
-        else //odd
-        {
-          medianValue = featureStats.values.at(( size + 1 ) / 2 - 1 );
-        }
-        changeAttributeMap.insert( medianIndex, QVariant( medianValue ) );
+        //the window does not fit in memory, read and process it here, strip by strip
+        statisticsInStrips( rasterBand, job.polygons, job.offsetX, job.offsetY, job.nCellsX, job.nCellsY, cellsizeX, cellsizeY,
+                            rasterBBox, job.stats );
+        job.calculated = true;
       }
-      if ( mStatistics & QgsZonalStatistics::StDev )
+      else if ( cells > 0 )
       {
-        double sumSquared = 0;
-        for ( int i = 0; i < featureStats.values.count(); ++i )
+        job.data.resize(( int )cells );
+        if ( GDALRasterIO( rasterBand, GF_Read, job.offsetX, job.offsetY, job.nCellsX, job.nCellsY, job.data.data(),
+                           job.nCellsX, job.nCellsY, GDT_Float32, 0, 0 ) != CE_None )
         {
-          double diff = featureStats.values.at( i ) - mean;
-          sumSquared += diff * diff;
+          QgsDebugMsg( "Raster IO Error" );
+          job.data.fill( mInputNodataValue );
         }
-        double stdev = qPow( sumSquared / featureStats.values.count(), 0.5 );
-        changeAttributeMap.insert( stdevIndex, QVariant( stdev ) );
+        batchCells += cells;
       }
-      if ( mStatistics & QgsZonalStatistics::Min )
-        changeAttributeMap.insert( minIndex, QVariant( featureStats.min ) );
-      if ( mStatistics & QgsZonalStatistics::Max )
-        changeAttributeMap.insert( maxIndex, QVariant( featureStats.max ) );
-      if ( mStatistics & QgsZonalStatistics::Range )
-        changeAttributeMap.insert( rangeIndex, QVariant( featureStats.max - featureStats.min ) );
-      if ( mStatistics & QgsZonalStatistics::Minority || mStatistics & QgsZonalStatistics::Majority )
+      jobs << job;
+      ++featureCounter;
+    }
+
+    QtConcurrent::blockingMap( jobs, calculation );
+
+    //write the statistics value to the vector data provider
+    for ( QList<FeatureJob>::iterator jobIt = jobs.begin(); jobIt != jobs.end(); ++jobIt )
+    {
+      FeatureStats& featureStats = jobIt->stats;
+      QgsAttributeMap changeAttributeMap;
+      if ( mStatistics & QgsZonalStatistics::Count )
+        changeAttributeMap.insert( countIndex, QVariant( featureStats.count ) );
+      if ( mStatistics & QgsZonalStatistics::Sum )
+        changeAttributeMap.insert( sumIndex, QVariant( featureStats.sum ) );
+      if ( featureStats.count > 0 )
       {
-        QList<int> vals = featureStats.valueCount.values();
-        qSort( vals.begin(), vals.end() );
-        if ( mStatistics & QgsZonalStatistics::Minority )
+        double mean = featureStats.sum / featureStats.count;
+        if ( mStatistics & QgsZonalStatistics::Mean )
+          changeAttributeMap.insert( meanIndex, QVariant( mean ) );
+        if ( mStatistics & QgsZonalStatistics::Median )
         {
-          float minorityKey = featureStats.valueCount.key( vals.first() );
-          changeAttributeMap.insert( minorityIndex, QVariant( minorityKey ) );
+          //partial sorts are enough to find the middle values
+          QVector<float>::iterator middle = featureStats.values.begin() + featureStats.values.count() / 2;
+          std::nth_element( featureStats.values.begin(), middle, featureStats.values.end() );
+          double medianValue = *middle;
+          bool even = ( featureStats.values.count() % 2 ) < 1;
+          if ( even )
+          {
+            medianValue = ( *std::max_element( featureStats.values.begin(), middle ) + medianValue ) / 2;
+          }
+          changeAttributeMap.insert( medianIndex, QVariant( medianValue ) );
         }
-        if ( mStatistics & QgsZonalStatistics::Majority )
+        if ( mStatistics & QgsZonalStatistics::StDev )
+          changeAttributeMap.insert( stdevIndex, QVariant( featureStats.stDev() ) );
+        if ( mStatistics & QgsZonalStatistics::Min )
+          changeAttributeMap.insert( minIndex, QVariant( featureStats.min ) );
+        if ( mStatistics & QgsZonalStatistics::Max )
+          changeAttributeMap.insert( maxIndex, QVariant( featureStats.max ) );
+        if ( mStatistics & QgsZonalStatistics::Range )
+          changeAttributeMap.insert( rangeIndex, QVariant( featureStats.max - featureStats.min ) );
+        if ( mStatistics & QgsZonalStatistics::Minority || mStatistics & QgsZonalStatistics::Majority )
         {
-          float majKey = featureStats.valueCount.key( vals.last() );
-          changeAttributeMap.insert( majorityIndex, QVariant( majKey ) );
+          //first (smallest) values with the lowest and highest counts
+          float minorityKey = 0;
+          float majKey = 0;
+          int minorityCount = INT_MAX;
+          int majCount = 0;
+          for ( QMap< float, int >::const_iterator countIt = featureStats.valueCount.constBegin(); countIt != featureStats.valueCount.constEnd(); ++countIt )
+          {
+            if ( countIt.value() < minorityCount )
+            {
+              minorityCount = countIt.value();
+              minorityKey = countIt.key();
+            }
+            if ( countIt.value() > majCount )
+            {
+              majCount = countIt.value();
+              majKey = countIt.key();
+            }
+          }
+          if ( mStatistics & QgsZonalStatistics::Minority )
+            changeAttributeMap.insert( minorityIndex, QVariant( minorityKey ) );
+          if ( mStatistics & QgsZonalStatistics::Majority )
+            changeAttributeMap.insert( majorityIndex, QVariant( majKey ) );
         }
+        if ( mStatistics & QgsZonalStatistics::Variety )
+          changeAttributeMap.insert( varietyIndex, QVariant( featureStats.valueCount.count() ) );
       }
-      if ( mStatistics & QgsZonalStatistics::Variety )
-        changeAttributeMap.insert( varietyIndex, QVariant( featureStats.valueCount.count() ) );
-    }
 
-    changeMap.insert( f.id(), changeAttributeMap );
-    ++featureCounter;
+      changeMap.insert( jobIt->fid, changeAttributeMap );
+    }
   }
 
   vectorProvider->changeAttributeValues( changeMap );
@@ -373,7 +553,7 @@ int QgsZonalStatistics::calculateStatistics( QProgressDialog* p )
   GDALClose( inputDataset );
   mPolygonLayer->updateFields();
 
-  if ( p && p->wasCanceled() )
+  if ( canceled )
   {
     return 9;
   }
@@ -408,112 +588,168 @@ int QgsZonalStatistics::cellInfoForBBox( const QgsRectangle& rasterBBox, const Q
   return 0;
 }
 
-void QgsZonalStatistics::statisticsFromMiddlePointTest( void* band, const QgsGeometry* poly, int pixelOffsetX,
-    int pixelOffsetY, int nCellsX, int nCellsY, double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, FeatureStats &stats )
+void QgsZonalStatistics::statisticsFromMiddlePointTest( const float* data, const QgsMultiPolygon& polygons, int pixelOffsetX,
+    int pixelOffsetY, int nCellsX, int nCellsY, double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, FeatureStats &stats ) const
 {
-  double cellCenterX, cellCenterY;
-
-  float* scanLine = ( float * ) CPLMalloc( sizeof( float ) * nCellsX );
-  cellCenterY = rasterBBox.yMaximum() - pixelOffsetY * cellSizeY - cellSizeY / 2;
-  stats.reset();
-
-  const GEOSGeometry* polyGeos = poly->asGeos();
-  if ( !polyGeos )
+  //edges of all the rings. With the even-odd rule, holes and the parts of multipolygons need no special treatment
+  QVector<QgsZonalStatisticsEdge> edges;
+  Q_FOREACH ( const QgsPolygon& polygon, polygons )
   {
-    return;
-  }
-
-  GEOSContextHandle_t geosctxt = QgsGeometry::getGEOSHandler();
-  const GEOSPreparedGeometry* polyGeosPrepared = GEOSPrepare_r( geosctxt, poly->asGeos() );
-  if ( !polyGeosPrepared )
-  {
-    return;
+    Q_FOREACH ( const QgsPolyline& ring, polygon )
+    {
+      int n = ring.size();
+      for ( int i = 0; i < n; ++i )
+      {
+        const QgsPoint& p1 = ring.at( i );
+        const QgsPoint& p2 = ring.at(( i + 1 ) % n );
+        if ( p1.y() == p2.y() )
+        {
+          continue; //horizontal edges and the closing vertex never cross a row of cell centers
+        }
+        QgsZonalStatisticsEdge edge;
+        edge.x1 = p1.x();
+        edge.y1 = p1.y();
+        edge.x2 = p2.x();
+        edge.y2 = p2.y();
+        edge.yMin = qMin( p1.y(), p2.y() );
+        edge.yMax = qMax( p1.y(), p2.y() );
+        edges << edge;
+      }
+    }
   }
+  //rows are scanned from top to bottom, edges enter the active list in the order of their top
+  qSort( edges.begin(), edges.end(), edgeYMaxGreaterThan );
 
-  GEOSCoordSequence* cellCenterCoords = nullptr;
-  GEOSGeometry* currentCellCenter = nullptr;
+  QVector<const QgsZonalStatisticsEdge*> activeEdges;
+  QVector<double> crossings;
+  int nextEdge = 0;
 
-  for ( int i = 0; i < nCellsY; ++i )
+  double firstCellCenterX = rasterBBox.xMinimum() + pixelOffsetX * cellSizeX + cellSizeX / 2;
+  double cellCenterY = rasterBBox.yMaximum() - pixelOffsetY * cellSizeY - cellSizeY / 2;
+  for ( int i = 0; i < nCellsY; ++i, cellCenterY -= cellSizeY )
   {
-    if ( GDALRasterIO( band, GF_Read, pixelOffsetX, pixelOffsetY + i, nCellsX, 1, scanLine, nCellsX, 1, GDT_Float32, 0, 0 )
-         != CPLE_None )
+    while ( nextEdge < edges.size() && edges.at( nextEdge ).yMax > cellCenterY )
+    {
+      activeEdges << &edges.at( nextEdge );
+      ++nextEdge;
+    }
+
+    //an edge crosses the row if yMin <= y < yMax. Edges below the row are finished
+    crossings.clear();
+    int nActive = 0;
+    for ( int e = 0; e < activeEdges.size(); ++e )
     {
-      continue;
+      const QgsZonalStatisticsEdge* edge = activeEdges.at( e );
+      if ( edge->yMin > cellCenterY )
+        continue;
+      activeEdges[nActive++] = edge;
+      crossings << edge->x1 + ( cellCenterY - edge->y1 ) * ( edge->x2 - edge->x1 ) / ( edge->y2 - edge->y1 );
     }
-    cellCenterX = rasterBBox.xMinimum() + pixelOffsetX * cellSizeX + cellSizeX / 2;
-    for ( int j = 0; j < nCellsX; ++j )
+    activeEdges.resize( nActive );
+    qSort( crossings.begin(), crossings.end() );
+
+    //cells whose center is strictly between a pair of crossings are inside
+    const float* row = data + ( qint64 )i * nCellsX;
+    for ( int c = 0; c + 1 < crossings.size(); c += 2 )
     {
-      if ( validPixel( scanLine[j] ) )
+      int firstCol = qMax( 0, ( int )floor(( crossings.at( c ) - firstCellCenterX ) / cellSizeX ) + 1 );
+      int lastCol = qMin( nCellsX - 1, ( int )ceil(( crossings.at( c + 1 ) - firstCellCenterX ) / cellSizeX ) - 1 );
+      for ( int j = firstCol; j <= lastCol; ++j )
       {
-        GEOSGeom_destroy_r( geosctxt, currentCellCenter );
-        cellCenterCoords = GEOSCoordSeq_create_r( geosctxt, 1, 2 );
-        GEOSCoordSeq_setX_r( geosctxt, cellCenterCoords, 0, cellCenterX );
-        GEOSCoordSeq_setY_r( geosctxt, cellCenterCoords, 0, cellCenterY );
-        currentCellCenter = GEOSGeom_createPoint_r( geosctxt, cellCenterCoords );
-        if ( GEOSPreparedContains_r( geosctxt, polyGeosPrepared, currentCellCenter ) )
+        if ( validPixel( row[j] ) )
         {
-          stats.addValue( scanLine[j] );
+          stats.addValue( row[j] );
         }
       }
-      cellCenterX += cellSizeX;
     }
-    cellCenterY -= cellSizeY;
   }
-  GEOSGeom_destroy_r( geosctxt, currentCellCenter );
-  CPLFree( scanLine );
-  GEOSPreparedGeom_destroy_r( geosctxt, polyGeosPrepared );
 }
 
-void QgsZonalStatistics::statisticsFromPreciseIntersection( void* band, const QgsGeometry* poly, int pixelOffsetX,
-    int pixelOffsetY, int nCellsX, int nCellsY, double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, FeatureStats &stats )
+void QgsZonalStatistics::statisticsFromPreciseIntersection( const float* data, const QgsMultiPolygon& polygons, int pixelOffsetX,
+    int pixelOffsetY, int nCellsX, int nCellsY, double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, FeatureStats &stats ) const
 {
-  stats.reset();
-
-  double currentY = rasterBBox.yMaximum() - pixelOffsetY * cellSizeY - cellSizeY / 2;
-  float* pixelData = ( float * ) CPLMalloc( sizeof( float ) );
-  QgsGeometry* pixelRectGeometry = nullptr;
+  QVector<QgsRectangle> ringBBoxes;
+  Q_FOREACH ( const QgsPolygon& polygon, polygons )
+  {
+    Q_FOREACH ( const QgsPolyline& ring, polygon )
+    {
+      ringBBoxes << ringBoundingBox( ring );
+    }
+  }
 
-  double hCellSizeX = cellSizeX / 2.0;
-  double hCellSizeY = cellSizeY / 2.0;
+  QVector<QgsPoint> buffer1;
+  QVector<QgsPoint> buffer2;
   double pixelArea = cellSizeX * cellSizeY;
-  double weight = 0;
 
-  for ( int row = 0; row < nCellsY; ++row )
+  double cellTop = rasterBBox.yMaximum() - pixelOffsetY * cellSizeY;
+  for ( int row = 0; row < nCellsY; ++row, cellTop -= cellSizeY )
   {
-    double currentX = rasterBBox.xMinimum() + cellSizeX / 2.0 + pixelOffsetX * cellSizeX;
-    for ( int col = 0; col < nCellsX; ++col )
+    double cellLeft = rasterBBox.xMinimum() + pixelOffsetX * cellSizeX;
+    for ( int col = 0; col < nCellsX; ++col, cellLeft += cellSizeX )
     {
-      if ( GDALRasterIO( band, GF_Read, pixelOffsetX + col, pixelOffsetY + row, nCellsX, 1, pixelData, 1, 1, GDT_Float32, 0, 0 ) != CE_None )
-      {
-        QgsDebugMsg( "Raster IO Error" );
-      }
-
-      if ( !validPixel( *pixelData ) )
+      float value = data[( qint64 )row * nCellsX + col];
+      if ( !validPixel( value ) )
         continue;
 
-      pixelRectGeometry = QgsGeometry::fromRect( QgsRectangle( currentX - hCellSizeX, currentY - hCellSizeY, currentX + hCellSizeX, currentY + hCellSizeY ) );
-      if ( pixelRectGeometry )
+      //covered area: the exterior rings clipped to the cell minus the holes clipped to the cell
+      QgsRectangle cellRect( cellLeft, cellTop - cellSizeY, cellLeft + cellSizeX, cellTop );
+      double intersectionArea = 0;
+      int ringIndex = 0;
+      Q_FOREACH ( const QgsPolygon& polygon, polygons )
       {
-        //intersection
-        QgsGeometry *intersectGeometry = pixelRectGeometry->intersection( poly );
-        if ( intersectGeometry )
+        for ( int r = 0; r < polygon.size(); ++r, ++ringIndex )
         {
-          double intersectionArea = intersectGeometry->area();
-          if ( intersectionArea >= 0.0 )
-          {
-            weight = intersectionArea / pixelArea;
-            stats.addValue( *pixelData, weight );
-          }
-          delete intersectGeometry;
+          if ( !ringBBoxes.at( ringIndex ).intersects( cellRect ) )
+            continue;
+          double ringArea = clippedRingArea( polygon.at( r ), cellRect, buffer1, buffer2 );
+          intersectionArea += r == 0 ? ringArea : -ringArea;
         }
-        delete pixelRectGeometry;
-        pixelRectGeometry = nullptr;
       }
-      currentX += cellSizeX;
+
+      if ( intersectionArea > 0.0 )
+      {
+        stats.addValue( value, qMin( 1.0, intersectionArea / pixelArea ) );
+      }
+    }
+  }
+}
+
+void QgsZonalStatistics::statisticsInStrips( void* band, const QgsMultiPolygon& polygons, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
+    double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, FeatureStats& stats ) const
+{
+  int stripHeight = qMax( 1, ( int )( MAX_BATCH_CELLS / nCellsX ) );
+  QVector<float> strip( stripHeight * nCellsX );
+
+  for ( int pass = 0; pass < 2; ++pass )
+  {
+    for ( int stripOffset = 0; stripOffset < nCellsY; stripOffset += stripHeight )
+    {
+      int rows = qMin( stripHeight, nCellsY - stripOffset );
+      if ( GDALRasterIO( band, GF_Read, pixelOffsetX, pixelOffsetY + stripOffset, nCellsX, rows, strip.data(), nCellsX, rows, GDT_Float32, 0, 0 )
+           != CE_None )
+      {
+        QgsDebugMsg( "Raster IO Error" );
+        continue;
+      }
+      if ( pass == 0 )
+      {
+        statisticsFromMiddlePointTest( strip.constData(), polygons, pixelOffsetX, pixelOffsetY + stripOffset, nCellsX, rows,
+                                       cellSizeX, cellSizeY, rasterBBox, stats );
+      }
+      else
+      {
+        statisticsFromPreciseIntersection( strip.constData(), polygons, pixelOffsetX, pixelOffsetY + stripOffset, nCellsX, rows,
+                                           cellSizeX, cellSizeY, rasterBBox, stats );
+      }
+    }
+
+    if ( pass == 1 || stats.count > 1 )
+    {
+      break;
     }
-    currentY -= cellSizeY;
+    //the cell resolution is probably larger than the polygon area. We switch to precise pixel - polygon intersection in this case
+    stats.reset();
   }
-  CPLFree( pixelData );
 }
 
 bool QgsZonalStatistics::validPixel( float value ) const
@@ -18,12 +18,15 @@
 #ifndef QGSZONALSTATISTICS_H
 #define QGSZONALSTATISTICS_H
 
+#include "qgsgeometry.h"
+
 #include <QString>
 #include <QMap>
+#include <QVector>
 #include <limits>
 #include <cfloat>
+#include <cmath>
 
-class QgsGeometry;
 class QgsVectorLayer;
 class QProgressDialog;
 class QgsRectangle;
@@ -71,7 +74,11 @@ class ANALYSIS_EXPORT QgsZonalStatistics
         {
           reset();
         }
-        void reset() { sum = 0; count = 0; max = -FLT_MAX; min = FLT_MAX; valueCount.clear(); values.clear(); }
+        void reset()
+        {
+          sum = 0; count = 0; max = -FLT_MAX; min = FLT_MAX; valueCount.clear(); values.clear();
+          nValues = 0; shift = 0; shiftedSum = 0; shiftedSumSquares = 0;
+        }
         void addValue( float value, double weight = 1.0 )
         {
           if ( weight < 1.0 )
@@ -86,35 +93,64 @@ class ANALYSIS_EXPORT QgsZonalStatistics
           }
           min = qMin( min, value );
           max = qMax( max, value );
+          //unweighted moments for the standard deviation, shifted by the first value for numerical stability
+          if ( nValues == 0 )
+            shift = value;
+          double d = value - shift;
+          shiftedSum += d;
+          shiftedSumSquares += d * d;
+          ++nValues;
           if ( mStoreValueCounts )
             valueCount.insert( value, valueCount.value( value, 0 ) + 1 );
           if ( mStoreValues )
             values.append( value );
         }
+        /** Population standard deviation of the values around the (weighted) mean*/
+        double stDev() const
+        {
+          if ( nValues == 0 || count <= 0 )
+            return 0;
+          double d = sum / count - shift;
+          double sumSquared = shiftedSumSquares - 2 * d * shiftedSum + nValues * d * d;
+          return sqrt( qMax( 0.0, sumSquared / nValues ) );
+        }
         double sum;
         double count;
         float max;
         float min;
         QMap< float, int > valueCount;
-        QList< float > values;
+        QVector< float > values;
+        int nValues;
+        double shift;
+        double shiftedSum;
+        double shiftedSumSquares;
 
       private:
         bool mStoreValues;
         bool mStoreValueCounts;
     };
 
+    struct FeatureJob;
+    class FeatureJobCalculation;
+    friend class FeatureJobCalculation;
+
     /** Analysis what cells need to be considered to cover the bounding box of a feature
       @return 0 in case of success*/
     int cellInfoForBBox( const QgsRectangle& rasterBBox, const QgsRectangle& featureBBox, double cellSizeX, double cellSizeY,
                          int& offsetX, int& offsetY, int& nCellsX, int& nCellsY ) const;
 
-    /** Returns statistics by considering the pixels where the center point is within the polygon (fast)*/
-    void statisticsFromMiddlePointTest( void* band, const QgsGeometry* poly, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
-                                        double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, FeatureStats& stats );
+    /** Adds to stats the pixels of a window (nCellsX * nCellsY values, row by row) where the center point is within the polygon (fast).
+      The window rows are scanned at once, by intersecting the row of cell centers with the polygon edges*/
+    void statisticsFromMiddlePointTest( const float* data, const QgsMultiPolygon& polygons, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
+                                        double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, FeatureStats& stats ) const;
+
+    /** Adds to stats the pixels of a window weighted by the exact fraction of their area covered by the polygon (slow) */
+    void statisticsFromPreciseIntersection( const float* data, const QgsMultiPolygon& polygons, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
+                                            double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, FeatureStats& stats ) const;
 
-    /** Returns statistics with precise pixel - polygon intersection test (slow) */
-    void statisticsFromPreciseIntersection( void* band, const QgsGeometry* poly, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
-                                            double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, FeatureStats& stats );
+    /** Calculates the statistics of a feature whose window is too large to be held in memory, reading the band in strips of rows*/
+    void statisticsInStrips( void* band, const QgsMultiPolygon& polygons, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
+                             double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, FeatureStats& stats ) const;
 
     /** Tests whether a pixel's value should be included in the result*/
     bool validPixel( float value ) const;
@@ -27,6 +27,7 @@
 #include "qgscoordinatetransform.h"
 #include "qgscubicrasterresampler.h"
 #include "qgsgenericprojectionselector.h"
+#include "qgslanczosrasterresampler.h"
 #include "qgslogger.h"
 #include "qgsmapcanvas.h"
 #include "qgsmaplayerregistry.h"
@@ -263,8 +264,10 @@ QgsRasterLayerProperties::QgsRasterLayerProperties( QgsMapLayer* lyr, QgsMapCanv
   mZoomedInResamplingComboBox->insertItem( 0, tr( "Nearest neighbour" ) );
   mZoomedInResamplingComboBox->insertItem( 1, tr( "Bilinear" ) );
   mZoomedInResamplingComboBox->insertItem( 2, tr( "Cubic" ) );
+  mZoomedInResamplingComboBox->insertItem( 3, tr( "Lanczos" ) );
   mZoomedOutResamplingComboBox->insertItem( 0, tr( "Nearest neighbour" ) );
   mZoomedOutResamplingComboBox->insertItem( 1, tr( "Average" ) );
+  mZoomedOutResamplingComboBox->insertItem( 2, tr( "Lanczos" ) );
 
   const QgsRasterResampleFilter* resampleFilter = mRasterLayer->resampleFilter();
   //set combo boxes to current resampling types
@@ -281,6 +284,10 @@ QgsRasterLayerProperties::QgsRasterLayerProperties( QgsMapLayer* lyr, QgsMapCanv
       {
         mZoomedInResamplingComboBox->setCurrentIndex( 2 );
       }
+      else if ( zoomedInResampler->type() == "lanczos" )
+      {
+        mZoomedInResamplingComboBox->setCurrentIndex( 3 );
+      }
     }
     else
     {
@@ -294,6 +301,10 @@ QgsRasterLayerProperties::QgsRasterLayerProperties( QgsMapLayer* lyr, QgsMapCanv
       {
         mZoomedOutResamplingComboBox->setCurrentIndex( 1 );
       }
+      else if ( zoomedOutResampler->type() == "lanczos" )
+      {
+        mZoomedOutResamplingComboBox->setCurrentIndex( 2 );
+      }
     }
     else
     {
@@ -933,6 +944,10 @@ void QgsRasterLayerProperties::apply()
     {
       zoomedInResampler = new QgsCubicRasterResampler();
     }
+    else if ( zoomedInResamplingMethod == tr( "Lanczos" ) )
+    {
+      zoomedInResampler = new QgsLanczosRasterResampler();
+    }
 
     resampleFilter->setZoomedInResampler( zoomedInResampler );
 
@@ -943,6 +958,10 @@ void QgsRasterLayerProperties::apply()
     {
       zoomedOutResampler = new QgsBilinearRasterResampler();
     }
+    else if ( zoomedOutResamplingMethod == tr( "Lanczos" ) )
+    {
+      zoomedOutResampler = new QgsLanczosRasterResampler();
+    }
 
     resampleFilter->setZoomedOutResampler( zoomedOutResampler );
 
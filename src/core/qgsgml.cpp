@@ -24,13 +24,16 @@
 #include "qgscrscache.h"
 
 #include <QBuffer>
+#include <QFuture>
 #include <QList>
 #include <QNetworkRequest>
 #include <QNetworkReply>
 #include <QProgressDialog>
 #include <QSet>
 #include <QSettings>
+#include <QThread>
 #include <QUrl>
+#include <QtConcurrentRun>
 
 #include "ogr_api.h"
 
@@ -40,6 +43,65 @@ static const char NS_SEPARATOR = '?';
 static const char* GML_NAMESPACE = "http://www.opengis.net/gml";
 static const char* GML32_NAMESPACE = "http://www.opengis.net/gml/3.2";
 
+//! Maximum number of features of a batch in pipelined mode
+static const int PIPELINED_BATCH_FEATURES = 256;
+//! Size of the geometry fragments above which a batch is dispatched in pipelined mode
+static const int PIPELINED_BATCH_BYTES = 1024 * 1024;
+//! Element names used to wrap the geometry fragments processed by worker threads
+static const char* PIPELINED_FEATURE = "qgisPipelinedFeature";
+static const char* PIPELINED_GEOMETRY = "qgisPipelinedGeometry";
+
+/** Features handed over to a worker thread in pipelined mode, together with
+ * the parser state they depend on */
+struct QgsGmlStreamingParser::PipelinedBatch
+{
+  PipelinedBatch()
+      : gmlNameSpaceURIPtr( nullptr )
+      , epsg( 0 )
+      , dimension( 0 )
+      , invertAxisOrientation( false )
+  {}
+
+  QVector<QgsGmlFeaturePtrGmlIdPair> features;
+  //! Raw (index, value) attributes of each feature
+  QVector< QVector< QPair<int, QString> > > attributes;
+  //! Wrapped geometry fragments of the features
+  QByteArray fragments;
+  QgsFields fields;
+  QString gmlNameSpaceURI;
+  const char* gmlNameSpaceURIPtr;
+  int epsg;
+  int dimension;
+  bool invertAxisOrientation;
+  QFuture<QGis::WkbType> future;
+};
+
+//! Appends character data to a XML fragment, escaping the markup characters
+static void appendEscaped( QByteArray& out, const char* chars, int len )
+{
+  for ( int i = 0; i < len; ++i )
+  {
+    switch ( chars[i] )
+    {
+      case '&':
+        out.append( "&amp;" );
+        break;
+      case '<':
+        out.append( "&lt;" );
+        break;
+      case '>':
+        out.append( "&gt;" );
+        break;
+      case '"':
+        out.append( "&quot;" );
+        break;
+      default:
+        out.append( chars[i] );
+        break;
+    }
+  }
+}
+
 QgsGml::QgsGml(
   const QString& typeName,
   const QString& geometryAttribute,
@@ -291,6 +353,11 @@ QgsGmlStreamingParser::QgsGmlStreamingParser( const QString& typeName,
     , mNumberReturned( -1 )
     , mNumberMatched( -1 )
     , mFoundUnhandledGeometryElement( false )
+    , mPipelined( false )
+    , mPipelinedMaxThreads( 1 )
+    , mAtEnd( false )
+    , mPipelinedGeometryDepth( 0 )
+    , mPipelinedBatch( nullptr )
 {
   mThematicAttributes.clear();
   for ( int i = 0; i < fields.size(); i++ )
@@ -352,6 +419,11 @@ QgsGmlStreamingParser::QgsGmlStreamingParser( const QList<LayerProperties>& laye
     , mNumberReturned( -1 )
     , mNumberMatched( -1 )
     , mFoundUnhandledGeometryElement( false )
+    , mPipelined( false )
+    , mPipelinedMaxThreads( 1 )
+    , mAtEnd( false )
+    , mPipelinedGeometryDepth( 0 )
+    , mPipelinedBatch( nullptr )
 {
   mThematicAttributes.clear();
   for ( int i = 0; i < fields.size(); i++ )
@@ -410,6 +482,24 @@ QgsGmlStreamingParser::~QgsGmlStreamingParser()
 {
   XML_ParserFree( mParser );
 
+  // Worker threads might still be processing some batches
+  Q_FOREACH ( PipelinedBatch* batch, mPipelinedBatches )
+  {
+    batch->future.waitForFinished();
+  }
+  mPipelinedBatches.prepend( mPipelinedBatch );
+  Q_FOREACH ( PipelinedBatch* batch, mPipelinedBatches )
+  {
+    if ( batch )
+    {
+      Q_FOREACH ( QgsGmlFeaturePtrGmlIdPair featPair, batch->features )
+      {
+        delete featPair.first;
+      }
+      delete batch;
+    }
+  }
+
   // Normally a sane user of this class should have consumed everything...
   Q_FOREACH ( QgsGmlFeaturePtrGmlIdPair featPair, mFeatureList )
   {
@@ -443,16 +533,168 @@ bool QgsGmlStreamingParser::processData( const QByteArray& data, bool atEnd, QSt
     return false;
   }
 
+  if ( atEnd )
+  {
+    mAtEnd = true;
+    if ( mPipelined )
+      dispatchPipelinedBatch();
+  }
+
   return true;
 }
 
 QVector<QgsGmlStreamingParser::QgsGmlFeaturePtrGmlIdPair> QgsGmlStreamingParser::getAndStealReadyFeatures()
 {
+  if ( mPipelined )
+    collectPipelinedBatches( mAtEnd );
+
   QVector<QgsGmlFeaturePtrGmlIdPair> ret = mFeatureList;
   mFeatureList.clear();
   return ret;
 }
 
+void QgsGmlStreamingParser::setPipelined( bool pipelined, int maxThreads )
+{
+  // Join layers switch the geometry attribute from one member to another,
+  // so keep them on the sequential code path
+  mPipelined = pipelined && mTypeNamePtr && !mTypeName.isEmpty();
+  mPipelinedMaxThreads = ( maxThreads > 0 ) ? maxThreads : QThread::idealThreadCount();
+  if ( mPipelinedMaxThreads < 1 )
+    mPipelinedMaxThreads = 1;
+}
+
+void QgsGmlStreamingParser::queuePipelinedFeature()
+{
+  // The coordinates of the batch must be interpreted with the same settings
+  if ( mPipelinedBatch &&
+       ( mPipelinedBatch->epsg != mEpsg ||
+         mPipelinedBatch->dimension != mDimension ||
+         mPipelinedBatch->invertAxisOrientation != mInvertAxisOrientation ) )
+  {
+    dispatchPipelinedBatch();
+  }
+
+  if ( !mPipelinedBatch )
+  {
+    mPipelinedBatch = new PipelinedBatch();
+    mPipelinedBatch->fields = mFields;
+    mPipelinedBatch->epsg = mEpsg;
+    mPipelinedBatch->dimension = mDimension;
+    mPipelinedBatch->invertAxisOrientation = mInvertAxisOrientation;
+  }
+
+  mPipelinedBatch->features.push_back( QgsGmlFeaturePtrGmlIdPair( mCurrentFeature, mCurrentFeatureId ) );
+  mPipelinedBatch->attributes.push_back( mPipelinedAttributes );
+  mPipelinedAttributes.clear();
+
+  QByteArray& fragments = mPipelinedBatch->fragments;
+  fragments.append( '<' ).append( PIPELINED_FEATURE ).append( "><" ).append( PIPELINED_GEOMETRY ).append( '>' );
+  fragments.append( mPipelinedGeometry );
+  fragments.append( "</" ).append( PIPELINED_GEOMETRY ).append( "></" ).append( PIPELINED_FEATURE ).append( '>' );
+  mPipelinedGeometry.clear();
+
+  if ( mPipelinedBatch->features.size() >= PIPELINED_BATCH_FEATURES ||
+       fragments.size() >= PIPELINED_BATCH_BYTES )
+  {
+    dispatchPipelinedBatch();
+  }
+}
+
+void QgsGmlStreamingParser::dispatchPipelinedBatch()
+{
+  if ( !mPipelinedBatch )
+    return;
+
+  // Bound the memory used by the pending batches
+  while ( mPipelinedBatches.size() >= 2 * mPipelinedMaxThreads )
+    takeFirstPipelinedBatch();
+
+  // The namespace might only have been found after the first features of the batch
+  mPipelinedBatch->gmlNameSpaceURI = mGMLNameSpaceURIPtr ? mGMLNameSpaceURI : QString( GML_NAMESPACE );
+  mPipelinedBatch->gmlNameSpaceURIPtr = mGMLNameSpaceURIPtr ? mGMLNameSpaceURIPtr : GML_NAMESPACE;
+
+  mPipelinedBatch->future = QtConcurrent::run( &QgsGmlStreamingParser::processPipelinedBatch, mPipelinedBatch );
+  mPipelinedBatches.append( mPipelinedBatch );
+  mPipelinedBatch = nullptr;
+}
+
+void QgsGmlStreamingParser::collectPipelinedBatches( bool wait )
+{
+  while ( !mPipelinedBatches.isEmpty() &&
+          ( wait || mPipelinedBatches.first()->future.isFinished() ) )
+  {
+    takeFirstPipelinedBatch();
+  }
+}
+
+void QgsGmlStreamingParser::takeFirstPipelinedBatch()
+{
+  PipelinedBatch* batch = mPipelinedBatches.takeFirst();
+  QGis::WkbType wkbType = batch->future.result();
+
+  // Same logic as in endElement(): keep multitype in case of geometry type mix
+  if ( wkbType != QGis::WKBUnknown &&
+       !( wkbType == QGis::WKBPoint && mWkbType == QGis::WKBMultiPoint ) &&
+       !( wkbType == QGis::WKBLineString && mWkbType == QGis::WKBMultiLineString ) &&
+       !( wkbType == QGis::WKBPolygon && mWkbType == QGis::WKBMultiPolygon ) )
+  {
+    mWkbType = wkbType;
+  }
+
+  mFeatureList += batch->features;
+  delete batch;
+}
+
+QGis::WkbType QgsGmlStreamingParser::processPipelinedBatch( PipelinedBatch* batch )
+{
+  // Parse the geometry fragments with a sequential parser, set up with the
+  // state that the expat side had when it extracted them
+  QgsGmlStreamingParser parser( PIPELINED_FEATURE, PIPELINED_GEOMETRY, QgsFields() );
+  parser.mGMLNameSpaceURI = batch->gmlNameSpaceURI;
+  parser.mGMLNameSpaceURIPtr = batch->gmlNameSpaceURIPtr;
+  // srsName has already been handled by the expat side, so never read it again
+  parser.mEpsg = batch->epsg != 0 ? batch->epsg : -1;
+  parser.mDimension = batch->dimension;
+  parser.mInvertAxisOrientation = batch->invertAxisOrientation;
+
+  QByteArray document( "<qgisPipelinedBatch xmlns:gml=\"" );
+  document.append( batch->gmlNameSpaceURI.toUtf8() ).append( "\">" );
+  document.append( batch->fragments );
+  document.append( "</qgisPipelinedBatch>" );
+  batch->fragments.clear();
+
+  QString errorMsg;
+  if ( !parser.processData( document, true, errorMsg ) )
+  {
+    QgsDebugMsg( "Error when parsing pipelined geometries: " + errorMsg );
+  }
+
+  QVector<QgsGmlFeaturePtrGmlIdPair> parsedFeatures = parser.getAndStealReadyFeatures();
+  for ( int i = 0; i < batch->features.size(); ++i )
+  {
+    QgsFeature* feature = batch->features[i].first;
+    if ( i < parsedFeatures.size() && parsedFeatures[i].first->constGeometry() )
+    {
+      feature->setGeometry( *parsedFeatures[i].first->constGeometry() );
+    }
+
+    const QVector< QPair<int, QString> >& attributes = batch->attributes.at( i );
+    for ( int j = 0; j < attributes.size(); ++j )
+    {
+      const int idx = attributes[j].first;
+      feature->setAttribute( idx, convertAttributeValue( batch->fields.at( idx ).type(), attributes[j].second ) );
+    }
+  }
+  batch->attributes.clear();
+
+  Q_FOREACH ( const QgsGmlFeaturePtrGmlIdPair& featPair, parsedFeatures )
+  {
+    delete featPair.first;
+  }
+
+  return parser.mWkbType;
+}
+
 #define LOCALNAME_EQUALS(string_constant) \
   ( localNameLen == strlen( string_constant ) && memcmp(pszLocalName, string_constant, localNameLen) == 0 )
 
@@ -483,6 +725,45 @@ void QgsGmlStreamingParser::startElement( const XML_Char* el, const XML_Char** a
   const bool isGMLNS = ( nsLen == mGMLNameSpaceURI.size() && mGMLNameSpaceURIPtr && memcmp( el, mGMLNameSpaceURIPtr, nsLen ) == 0 );
   bool isGeom = false;
 
+  if ( mPipelined && theParseMode == geometry )
+  {
+    // Only record the geometry fragment, it is turned into a geometry by
+    // processPipelinedBatch() in a worker thread
+    mPipelinedGeometry.append( '<' );
+    if ( isGMLNS )
+      mPipelinedGeometry.append( "gml:" );
+    mPipelinedGeometry.append( pszLocalName, localNameLen );
+    for ( const XML_Char** attrIter = attr; attrIter && *attrIter; attrIter += 2 )
+    {
+      // Namespaced attributes (gml:id, xlink:href...) are not needed to build the geometry
+      if ( strchr( attrIter[0], NS_SEPARATOR ) )
+        continue;
+      mPipelinedGeometry.append( ' ' ).append( attrIter[0] ).append( "=\"" );
+      appendEscaped( mPipelinedGeometry, attrIter[1], ( int )strlen( attrIter[1] ) );
+      mPipelinedGeometry.append( '"' );
+    }
+    mPipelinedGeometry.append( '>' );
+
+    // The srsDimension and srsName are still tracked here, as they apply to the following features
+    if ( mDimension == 0 )
+    {
+      QString srsDimension = readAttribute( "srsDimension", attr );
+      bool ok;
+      int dimension = srsDimension.toInt( &ok );
+      if ( ok )
+      {
+        mDimension = dimension;
+      }
+    }
+    if ( mEpsg == 0 && readEpsgFromAttribute( mEpsg, attr ) == 0 )
+    {
+      QgsDebugMsg( QString( "mEpsg = %1" ).arg( mEpsg ) );
+    }
+
+    mParseDepth ++;
+    return;
+  }
+
   if ( theParseMode == geometry || theParseMode == coordinate || theParseMode == posList ||
        theParseMode == multiPoint || theParseMode == multiLine || theParseMode == multiPolygon )
   {
@@ -539,6 +820,8 @@ void QgsGmlStreamingParser::startElement( const XML_Char* el, const XML_Char** a
     mParseModeStack.push( QgsGmlStreamingParser::geometry );
     mFoundUnhandledGeometryElement = false;
     mGeometryString.clear();
+    mPipelinedGeometryDepth = mParseDepth;
+    mPipelinedGeometry.clear();
   }
   //else if ( mParseModeStack.size() == 0 && elementName == mGMLNameSpaceURI + NS_SEPARATOR + "boundedBy" )
   else if ( isGMLNS && LOCALNAME_EQUALS( "boundedBy" ) )
@@ -633,6 +916,7 @@ void QgsGmlStreamingParser::startElement( const XML_Char* el, const XML_Char** a
     QgsAttributes attributes( mThematicAttributes.size() ); //add empty attributes
     mCurrentFeature->setAttributes( attributes );
     mParseModeStack.push( QgsGmlStreamingParser::feature );
+    mPipelinedAttributes.clear();
     mCurrentFeatureId = readAttribute( "fid", attr );
     if ( mCurrentFeatureId.isEmpty() )
     {
@@ -826,6 +1110,24 @@ void QgsGmlStreamingParser::endElement( const XML_Char* el )
 
   const bool isGMLNS = ( nsLen == mGMLNameSpaceURI.size() && mGMLNameSpaceURIPtr && memcmp( el, mGMLNameSpaceURIPtr, nsLen ) == 0 );
 
+  if ( mPipelined && theParseMode == geometry )
+  {
+    if ( mParseDepth == mPipelinedGeometryDepth )
+    {
+      // end of the geometry attribute element
+      mParseModeStack.pop();
+    }
+    else
+    {
+      mPipelinedGeometry.append( "</" );
+      if ( isGMLNS )
+        mPipelinedGeometry.append( "gml:" );
+      mPipelinedGeometry.append( pszLocalName, localNameLen );
+      mPipelinedGeometry.append( '>' );
+    }
+    return;
+  }
+
   if ( theParseMode == coordinate && isGMLNS && LOCALNAME_EQUALS( "coordinates" ) )
   {
     mParseModeStack.pop();
@@ -950,7 +1252,10 @@ void QgsGmlStreamingParser::endElement( const XML_Char* el )
     }
     mCurrentFeature->setValid( true );
 
-    mFeatureList.push_back( QgsGmlFeaturePtrGmlIdPair( mCurrentFeature, mCurrentFeatureId ) );
+    if ( mPipelined )
+      queuePipelinedFeature();
+    else
+      mFeatureList.push_back( QgsGmlFeaturePtrGmlIdPair( mCurrentFeature, mCurrentFeatureId ) );
 
     mCurrentFeature = nullptr;
     ++mFeatureCount;
@@ -1123,12 +1428,18 @@ void QgsGmlStreamingParser::characters( const XML_Char* chars, int len )
     return;
   }
 
+  QgsGmlStreamingParser::ParseMode theParseMode = mParseModeStack.top();
+  if ( mPipelined && theParseMode == QgsGmlStreamingParser::geometry )
+  {
+    appendEscaped( mPipelinedGeometry, chars, len );
+    return;
+  }
+
   if ( !mGeometryString.empty() )
   {
     mGeometryString.append( chars, len );
   }
 
-  QgsGmlStreamingParser::ParseMode theParseMode = mParseModeStack.top();
   if ( theParseMode == QgsGmlStreamingParser::attribute ||
        theParseMode == QgsGmlStreamingParser::attributeTuple ||
        theParseMode == QgsGmlStreamingParser::coordinate ||
@@ -1147,27 +1458,31 @@ void QgsGmlStreamingParser::setAttribute( const QString& name, const QString& va
   QMap<QString, QPair<int, QgsField> >::const_iterator att_it = mThematicAttributes.constFind( name );
   if ( att_it != mThematicAttributes.constEnd() )
   {
-    QVariant var;
-    switch ( att_it.value().second.type() )
+    Q_ASSERT( mCurrentFeature );
+    if ( mPipelined )
     {
-      case QVariant::Double:
-        var = QVariant( value.toDouble() );
-        break;
-      case QVariant::Int:
-        var = QVariant( value.toInt() );
-        break;
-      case QVariant::LongLong:
-        var = QVariant( value.toLongLong() );
-        break;
-      case QVariant::DateTime:
-        var = QVariant( QDateTime::fromString( value, Qt::ISODate ) );
-        break;
-      default: //string type is default
-        var = QVariant( value );
-        break;
+      // converted by processPipelinedBatch()
+      mPipelinedAttributes.push_back( qMakePair( att_it.value().first, value ) );
+      return;
     }
-    Q_ASSERT( mCurrentFeature );
-    mCurrentFeature->setAttribute( att_it.value().first, var );
+    mCurrentFeature->setAttribute( att_it.value().first, convertAttributeValue( att_it.value().second.type(), value ) );
+  }
+}
+
+QVariant QgsGmlStreamingParser::convertAttributeValue( QVariant::Type type, const QString& value )
+{
+  switch ( type )
+  {
+    case QVariant::Double:
+      return QVariant( value.toDouble() );
+    case QVariant::Int:
+      return QVariant( value.toInt() );
+    case QVariant::LongLong:
+      return QVariant( value.toLongLong() );
+    case QVariant::DateTime:
+      return QVariant( QDateTime::fromString( value, Qt::ISODate ) );
+    default: //string type is default
+      return QVariant( value );
   }
 }
 
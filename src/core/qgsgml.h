@@ -102,6 +102,21 @@ class CORE_EXPORT QgsGmlStreamingParser
         by later calls. */
     QVector<QgsGmlFeaturePtrGmlIdPair> getAndStealReadyFeatures();
 
+    /** Enables or disables the pipelined mode. In that mode, the expat callbacks
+        only extract the raw geometry fragment and attribute values of each feature,
+        and a pool of worker threads parses the coordinates, builds the geometries
+        and converts the attribute values. getAndStealReadyFeatures() still returns
+        the features in document order. The pipelined mode is ignored for join
+        layers. Must be called before the first call to processData().
+        @param pipelined whether to enable the pipelined mode
+        @param maxThreads maximum number of worker threads, or 0 to use QThread::idealThreadCount()
+        @note Added in QGIS 3.0 */
+    void setPipelined( bool pipelined, int maxThreads = 0 );
+
+    /** Return whether the pipelined mode is enabled
+        @note Added in QGIS 3.0 */
+    bool isPipelined() const { return mPipelined; }
+
     /** Return the EPSG code, or 0 if unknown */
     int getEPSGCode() const { return mEpsg; }
 
@@ -111,7 +126,8 @@ class CORE_EXPORT QgsGmlStreamingParser
     /** Return layer bounding box */
     const QgsRectangle& layerExtent() const { return mLayerExtent; }
 
-    /** Return the geometry type */
+    /** Return the geometry type. In pipelined mode, only the features already
+        returned by getAndStealReadyFeatures() are taken into account. */
     QGis::WkbType wkbType() const { return mWkbType; }
 
     /** Return WFS 2.0 "numberMatched" attribute, or -1 if invalid/not found */
@@ -174,6 +190,24 @@ class CORE_EXPORT QgsGmlStreamingParser
     // Set current feature attribute
     void setAttribute( const QString& name, const QString& value );
 
+    /** Converts an attribute value from its GML string representation */
+    static QVariant convertAttributeValue( QVariant::Type type, const QString& value );
+
+    /** Features of the pipelined mode waiting for, or being processed by, a worker thread */
+    struct PipelinedBatch;
+
+    /** Adds the current feature, with its raw geometry fragment and attribute values, to the batch being filled */
+    void queuePipelinedFeature();
+    /** Hands the batch being filled over to a worker thread */
+    void dispatchPipelinedBatch();
+    /** Moves the features of the processed batches to mFeatureList, in document order.
+        If wait is true, waits for all dispatched batches to be processed. */
+    void collectPipelinedBatches( bool wait );
+    /** Waits for the first dispatched batch and moves its features to mFeatureList */
+    void takeFirstPipelinedBatch();
+    /** Builds the geometries and converts the attribute values of a batch. Run in a worker thread. */
+    static QGis::WkbType processPipelinedBatch( PipelinedBatch* batch );
+
     //helper routines
 
     /** Reads attribute srsName="EpsgCrsId:..."
@@ -311,6 +345,22 @@ class CORE_EXPORT QgsGmlStreamingParser
     std::string mGeometryString;
     /** Whether we found a unhandled geometry element */
     bool mFoundUnhandledGeometryElement;
+    /** Whether the pipelined mode is enabled */
+    bool mPipelined;
+    /** Maximum number of worker threads in pipelined mode */
+    int mPipelinedMaxThreads;
+    /** Whether the last chunk of data has been processed */
+    bool mAtEnd;
+    /** Parsing depth of the geometry attribute element, in pipelined mode */
+    int mPipelinedGeometryDepth;
+    /** XML fragment of the geometry of the current feature, in pipelined mode */
+    QByteArray mPipelinedGeometry;
+    /** Raw (index, value) attributes of the current feature, in pipelined mode */
+    QVector< QPair<int, QString> > mPipelinedAttributes;
+    /** Batch being filled, in pipelined mode */
+    PipelinedBatch* mPipelinedBatch;
+    /** Batches handed over to worker threads, in document order */
+    QList<PipelinedBatch*> mPipelinedBatches;
 };
 
 
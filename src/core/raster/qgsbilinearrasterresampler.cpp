@@ -16,9 +16,17 @@
  ***************************************************************************/
 
 #include "qgsbilinearrasterresampler.h"
+#include "qgsseparableresampler.h"
 #include <QImage>
 #include <cmath>
 
+//! Triangle (tent) kernel
+static double triangleKernel( double x )
+{
+  x = std::fabs( x );
+  return x < 1.0 ? 1.0 - x : 0.0;
+}
+
 QgsBilinearRasterResampler::QgsBilinearRasterResampler()
 {
 }
@@ -34,5 +42,7 @@ QgsBilinearRasterResampler* QgsBilinearRasterResampler::clone() const
 
 void QgsBilinearRasterResampler::resample( const QImage& srcImage, QImage& dstImage )
 {
-  dstImage = srcImage.scaled( dstImage.width(), dstImage.height(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+  // the kernel is stretched when downsampling, averaging the covered source pixels
+  QgsSeparableResampler resampler( triangleKernel, 1.0, true );
+  resampler.resample( srcImage, dstImage );
 }
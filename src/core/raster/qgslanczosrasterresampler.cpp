@@ -0,0 +1,57 @@
+/***************************************************************************
+                         qgslanczosrasterresampler.cpp
+                         -----------------------------
+    begin                : October 2016
+    copyright            : (C) 2016 by the QGIS project
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgslanczosrasterresampler.h"
+#include "qgsseparableresampler.h"
+#include <QImage>
+#include <cmath>
+
+//! Number of lobes of the kernel
+static const int LANCZOS_LOBES = 3;
+
+static double sinc( double x )
+{
+  if ( qAbs( x ) < 1e-8 )
+    return 1.0;
+  x *= M_PI;
+  return std::sin( x ) / x;
+}
+
+static double lanczosKernel( double x )
+{
+  if ( qAbs( x ) >= LANCZOS_LOBES )
+    return 0.0;
+  return sinc( x ) * sinc( x / LANCZOS_LOBES );
+}
+
+QgsLanczosRasterResampler::QgsLanczosRasterResampler()
+{
+}
+
+QgsLanczosRasterResampler::~QgsLanczosRasterResampler()
+{
+}
+
+QgsLanczosRasterResampler* QgsLanczosRasterResampler::clone() const
+{
+  return new QgsLanczosRasterResampler();
+}
+
+void QgsLanczosRasterResampler::resample( const QImage& srcImage, QImage& dstImage )
+{
+  QgsSeparableResampler resampler( lanczosKernel, LANCZOS_LOBES, true );
+  resampler.resample( srcImage, dstImage );
+}
@@ -0,0 +1,39 @@
+/***************************************************************************
+                         qgslanczosrasterresampler.h
+                         ---------------------------
+    begin                : October 2016
+    copyright            : (C) 2016 by the QGIS project
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSLANCZOSRASTERRESAMPLER_H
+#define QGSLANCZOSRASTERRESAMPLER_H
+
+#include "qgsrasterresampler.h"
+
+/** \ingroup core
+ * Lanczos (3 lobes) Raster Resampler. When zooming out, the kernel is
+ * stretched over all the covered source pixels, which gives sharp and
+ * antialiased results without pyramids.
+ * @note added in QGIS 3.0
+ */
+class CORE_EXPORT QgsLanczosRasterResampler: public QgsRasterResampler
+{
+  public:
+    QgsLanczosRasterResampler();
+    ~QgsLanczosRasterResampler();
+
+    void resample( const QImage& srcImage, QImage& dstImage ) override;
+    QString type() const override { return "lanczos"; }
+    QgsLanczosRasterResampler * clone() const override;
+};
+
+#endif // QGSLANCZOSRASTERRESAMPLER_H
@@ -23,6 +23,11 @@
 #include <QDomElement>
 #include <QImage>
 #include <QSet>
+#include <climits>
+
+//! Lookup table entry of no data values and values out of the displayable range. Not -1, since unstretched
+//! Int16 values are negative
+static const int NODATA_LUT_VALUE = INT_MIN;
 
 QgsMultiBandColorRenderer::QgsMultiBandColorRenderer( QgsRasterInterface* input, int redBand, int greenBand, int blueBand,
     QgsContrastEnhancement* redEnhancement,
@@ -226,93 +231,160 @@ QgsRasterBlock* QgsMultiBandColorRenderer::block( int bandNo, QgsRectangle  cons
   }
 
   QRgb myDefaultColor = NODATA_COLOR;
-
-  for ( qgssize i = 0; i < ( qgssize )width*height; i++ )
+  QRgb* outputData = reinterpret_cast< QRgb* >( outputBlock->bits() );
+  qgssize count = ( qgssize )width * height;
+
+  //integer bands are stretched through tables with the value of each input value, as long as the
+  //transparency does not depend on the combination of the three values
+  bool threeValueTransparency = mRasterTransparency && !mRasterTransparency->transparentThreeValuePixelList().isEmpty();
+  QVector<quint16> redIndexes, greenIndexes, blueIndexes;
+  QVector<int> redLut, greenLut, blueLut;
+  if ( redBlock && greenBlock && blueBlock && !threeValueTransparency
+       && bandLookupTable( redBlock, mRedContrastEnhancement, redIndexes, redLut )
+       && bandLookupTable( greenBlock, mGreenContrastEnhancement, greenIndexes, greenLut )
+       && bandLookupTable( blueBlock, mBlueContrastEnhancement, blueIndexes, blueLut ) )
   {
-    if ( fastDraw ) //fast rendering if no transparency, stretching, color inversion, etc.
+    double blockOpacity = mOpacity;
+    if ( mRasterTransparency )
     {
-      if ( redBlock->isNoData( i ) ||
-           greenBlock->isNoData( i ) ||
-           blueBlock->isNoData( i ) )
+      blockOpacity = mRasterTransparency->alphaValue( 0, 0, 0, mOpacity * 255 ) / 255.0;
+    }
+    //without a no data value, no data are given by a bitmap
+    bool checkNoDataBitmap = ( redBlock->hasNoData() && !redBlock->hasNoDataValue() )
+                             || ( greenBlock->hasNoData() && !greenBlock->hasNoDataValue() )
+                             || ( blueBlock->hasNoData() && !blueBlock->hasNoDataValue() );
+
+    const int* redLutData = redLut.constData();
+    const int* greenLutData = greenLut.constData();
+    const int* blueLutData = blueLut.constData();
+    const quint16* redIndex = redIndexes.constData();
+    const quint16* greenIndex = greenIndexes.constData();
+    const quint16* blueIndex = blueIndexes.constData();
+    for ( qgssize i = 0; i < count; i++ )
+    {
+      int redVal = redLutData[redIndex[i]];
+      int greenVal = greenLutData[greenIndex[i]];
+      int blueVal = blueLutData[blueIndex[i]];
+      if ( redVal == NODATA_LUT_VALUE || greenVal == NODATA_LUT_VALUE || blueVal == NODATA_LUT_VALUE )
       {
-        outputBlock->setColor( i, myDefaultColor );
+        outputData[i] = myDefaultColor;
+        continue;
+      }
+
+      double currentOpacity = blockOpacity;
+      if ( mAlphaBand > 0 )
+      {
+        currentOpacity *= alphaBlock->value( i ) / 255.0;
+      }
+
+      if ( qgsDoubleNear( currentOpacity, 1.0 ) )
+      {
+        outputData[i] = qRgba( redVal, greenVal, blueVal, 255 );
       }
       else
       {
-        int redVal = ( int )redBlock->value( i );
-        int greenVal = ( int )greenBlock->value( i );
-        int blueVal = ( int )blueBlock->value( i );
-        outputBlock->setColor( i, qRgba( redVal, greenVal, blueVal, 255 ) );
+        outputData[i] = qRgba( currentOpacity * redVal, currentOpacity * greenVal, currentOpacity * blueVal, currentOpacity * 255 );
       }
-      continue;
     }
 
-    bool isNoData = false;
-    double redVal = 0;
-    double greenVal = 0;
-    double blueVal = 0;
-    if ( mRedBand > 0 )
-    {
-      redVal = redBlock->value( i );
-      if ( redBlock->isNoData( i ) ) isNoData = true;
-    }
-    if ( !isNoData && mGreenBand > 0 )
-    {
-      greenVal = greenBlock->value( i );
-      if ( greenBlock->isNoData( i ) ) isNoData = true;
-    }
-    if ( !isNoData && mBlueBand > 0 )
+    if ( checkNoDataBitmap )
     {
-      blueVal = blueBlock->value( i );
-      if ( blueBlock->isNoData( i ) ) isNoData = true;
+      for ( qgssize i = 0; i < count; i++ )
+      {
+        if ( redBlock->isNoData( i ) || greenBlock->isNoData( i ) || blueBlock->isNoData( i ) )
+          outputData[i] = myDefaultColor;
+      }
     }
-    if ( isNoData )
+  }
+  else
+  {
+    for ( qgssize i = 0; i < count; i++ )
     {
-      outputBlock->setColor( i, myDefaultColor );
-      continue;
-    }
+      if ( fastDraw ) //fast rendering if no transparency, stretching, color inversion, etc.
+      {
+        if ( redBlock->isNoData( i ) ||
+             greenBlock->isNoData( i ) ||
+             blueBlock->isNoData( i ) )
+        {
+          outputBlock->setColor( i, myDefaultColor );
+        }
+        else
+        {
+          int redVal = ( int )redBlock->value( i );
+          int greenVal = ( int )greenBlock->value( i );
+          int blueVal = ( int )blueBlock->value( i );
+          outputBlock->setColor( i, qRgba( redVal, greenVal, blueVal, 255 ) );
+        }
+        continue;
+      }
 
-    //apply default color if red, green or blue not in displayable range
-    if (( mRedContrastEnhancement && !mRedContrastEnhancement->isValueInDisplayableRange( redVal ) )
-        || ( mGreenContrastEnhancement && !mGreenContrastEnhancement->isValueInDisplayableRange( redVal ) )
-        || ( mBlueContrastEnhancement && !mBlueContrastEnhancement->isValueInDisplayableRange( redVal ) ) )
-    {
-      outputBlock->setColor( i, myDefaultColor );
-      continue;
-    }
+      bool isNoData = false;
+      double redVal = 0;
+      double greenVal = 0;
+      double blueVal = 0;
+      if ( mRedBand > 0 )
+      {
+        redVal = redBlock->value( i );
+        if ( redBlock->isNoData( i ) ) isNoData = true;
+      }
+      if ( !isNoData && mGreenBand > 0 )
+      {
+        greenVal = greenBlock->value( i );
+        if ( greenBlock->isNoData( i ) ) isNoData = true;
+      }
+      if ( !isNoData && mBlueBand > 0 )
+      {
+        blueVal = blueBlock->value( i );
+        if ( blueBlock->isNoData( i ) ) isNoData = true;
+      }
+      if ( isNoData )
+      {
+        outputBlock->setColor( i, myDefaultColor );
+        continue;
+      }
 
-    //stretch color values
-    if ( mRedContrastEnhancement )
-    {
-      redVal = mRedContrastEnhancement->enhanceContrast( redVal );
-    }
-    if ( mGreenContrastEnhancement )
-    {
-      greenVal = mGreenContrastEnhancement->enhanceContrast( greenVal );
-    }
-    if ( mBlueContrastEnhancement )
-    {
-      blueVal = mBlueContrastEnhancement->enhanceContrast( blueVal );
-    }
+      //apply default color if red, green or blue not in displayable range
+      if (( mRedContrastEnhancement && !mRedContrastEnhancement->isValueInDisplayableRange( redVal ) )
+          || ( mGreenContrastEnhancement && !mGreenContrastEnhancement->isValueInDisplayableRange( greenVal ) )
+          || ( mBlueContrastEnhancement && !mBlueContrastEnhancement->isValueInDisplayableRange( blueVal ) ) )
+      {
+        outputBlock->setColor( i, myDefaultColor );
+        continue;
+      }
 
-    //opacity
-    double currentOpacity = mOpacity;
-    if ( mRasterTransparency )
-    {
-      currentOpacity = mRasterTransparency->alphaValue( redVal, greenVal, blueVal, mOpacity * 255 ) / 255.0;
-    }
-    if ( mAlphaBand > 0 )
-    {
-      currentOpacity *= alphaBlock->value( i ) / 255.0;
-    }
+      //stretch color values
+      if ( mRedContrastEnhancement )
+      {
+        redVal = mRedContrastEnhancement->enhanceContrast( redVal );
+      }
+      if ( mGreenContrastEnhancement )
+      {
+        greenVal = mGreenContrastEnhancement->enhanceContrast( greenVal );
+      }
+      if ( mBlueContrastEnhancement )
+      {
+        blueVal = mBlueContrastEnhancement->enhanceContrast( blueVal );
+      }
 
-    if ( qgsDoubleNear( currentOpacity, 1.0 ) )
-    {
-      outputBlock->setColor( i, qRgba( redVal, greenVal, blueVal, 255 ) );
-    }
-    else
-    {
-      outputBlock->setColor( i, qRgba( currentOpacity * redVal, currentOpacity * greenVal, currentOpacity * blueVal, currentOpacity * 255 ) );
+      //opacity
+      double currentOpacity = mOpacity;
+      if ( mRasterTransparency )
+      {
+        currentOpacity = mRasterTransparency->alphaValue( redVal, greenVal, blueVal, mOpacity * 255 ) / 255.0;
+      }
+      if ( mAlphaBand > 0 )
+      {
+        currentOpacity *= alphaBlock->value( i ) / 255.0;
+      }
+
+      if ( qgsDoubleNear( currentOpacity, 1.0 ) )
+      {
+        outputBlock->setColor( i, qRgba( redVal, greenVal, blueVal, 255 ) );
+      }
+      else
+      {
+        outputBlock->setColor( i, qRgba( currentOpacity * redVal, currentOpacity * greenVal, currentOpacity * blueVal, currentOpacity * 255 ) );
+      }
     }
   }
 
@@ -326,6 +398,32 @@ QgsRasterBlock* QgsMultiBandColorRenderer::block( int bandNo, QgsRectangle  cons
   return outputBlock;
 }
 
+bool QgsMultiBandColorRenderer::bandLookupTable( QgsRasterBlock* block, QgsContrastEnhancement* enhancement, QVector<quint16>& indexes, QVector<int>& lut )
+{
+  int minimum, size;
+  if ( !lookupTableIndexes( block, indexes, minimum, size ) )
+    return false;
+
+  lut.resize( size );
+  for ( int v = 0; v < size; ++v )
+  {
+    double val = minimum + v;
+    if ( block->hasNoDataValue() && block->isNoDataValue( val ) )
+    {
+      lut[v] = NODATA_LUT_VALUE;
+    }
+    else if ( enhancement )
+    {
+      lut[v] = enhancement->isValueInDisplayableRange( val ) ? enhancement->enhanceContrast( val ) : NODATA_LUT_VALUE;
+    }
+    else
+    {
+      lut[v] = minimum + v;
+    }
+  }
+  return true;
+}
+
 void QgsMultiBandColorRenderer::writeXml( QDomDocument& doc, QDomElement& parentElem ) const
 {
   if ( parentElem.isNull() )
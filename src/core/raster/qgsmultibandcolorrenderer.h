@@ -71,6 +71,10 @@ class CORE_EXPORT QgsMultiBandColorRenderer: public QgsRasterRenderer
     QgsContrastEnhancement* mGreenContrastEnhancement;
     QgsContrastEnhancement* mBlueContrastEnhancement;
 
+    /** Prepares the lookup table of the stretched values of an integer band (see lookupTableIndexes()).
+     * The table holds INT_MIN for no data and for values out of the displayable range*/
+    static bool bandLookupTable( QgsRasterBlock* block, QgsContrastEnhancement* enhancement, QVector<quint16>& indexes, QVector<int>& lut );
+
     QgsMultiBandColorRenderer( const QgsMultiBandColorRenderer& );
     const QgsMultiBandColorRenderer& operator=( const QgsMultiBandColorRenderer& );
 };
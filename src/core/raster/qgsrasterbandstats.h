@@ -54,6 +54,7 @@ class CORE_EXPORT QgsRasterBandStats
       mean = 0.0;
       sumOfSquares = 0.0;
       stdDev = 0.0;
+      meanError = 0.0;
       sum = 0.0;
       elementCount = 0;
       width = 0;
@@ -95,6 +96,13 @@ class CORE_EXPORT QgsRasterBandStats
     /** \brief The standard deviation of the cell values. */
     double stdDev;
 
+    /** \brief Half width of the 95% confidence interval of the mean, if the
+     * statistics were calculated on a sample of the cells (see theSampleSize
+     * in QgsRasterInterface::bandStatistics()). 0 for exact statistics.
+     * @note added in QGIS 3.0
+     */
+    double meanError;
+
     /** \brief Collected statistics */
     int statsGathered;
 
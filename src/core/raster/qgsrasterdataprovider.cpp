@@ -520,6 +520,11 @@ void QgsRasterDataProvider::copyBaseSettings( const QgsRasterDataProvider& other
   mUseSrcNoDataValue = other.mUseSrcNoDataValue;
   mUserNoDataValue = other.mUserNoDataValue;
   mExtent = other.mExtent;
+
+  // statistics and histograms depend only on the data source, clones
+  // (e.g. used for rendering) start with what is already calculated
+  mStatistics = other.mStatistics;
+  mHistograms = other.mHistograms;
 }
 
 // ENDS
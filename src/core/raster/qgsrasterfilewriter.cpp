@@ -25,9 +25,146 @@
 #include "qgsrasternuller.h"
 
 #include <QCoreApplication>
+#include <QFuture>
 #include <QProgressDialog>
 #include <QTextStream>
 #include <QMessageBox>
+#include <QtConcurrentRun>
+
+/** A part read from the pipe. It is converted and written by a worker thread
+ * while the next part is read. Parts are written one at a time, in order.
+ */
+struct QgsRasterFileWriterPart
+{
+  QgsRasterFileWriterPart()
+      : provider( nullptr )
+      , ownsProvider( false )
+      , image( false )
+      , dataType( QGis::UnknownDataType )
+      , cols( 0 )
+      , rows( 0 )
+      , left( 0 )
+      , top( 0 )
+  {}
+
+  QgsRasterDataProvider* provider;
+  //! The provider of a part file (tiled mode), deleted once written
+  bool ownsProvider;
+  //! One ARGB block split into 4 byte bands, or one block per band
+  bool image;
+  QList<QgsRasterBlock*> blocks;
+  //! Data type written, for data blocks
+  QGis::DataType dataType;
+  int cols;
+  int rows;
+  int left;
+  int top;
+};
+
+static void writeRasterPart( QgsRasterFileWriterPart* part )
+{
+  if ( part->image )
+  {
+    QgsRasterBlock* inputBlock = part->blocks.value( 0 );
+    bool premultiplied = inputBlock->dataType() == QGis::ARGB32_Premultiplied;
+
+    //fill into red/green/blue/alpha channels
+    int nPixels = part->cols * part->rows;
+    QByteArray redData( nPixels, 0 );
+    QByteArray greenData( nPixels, 0 );
+    QByteArray blueData( nPixels, 0 );
+    QByteArray alphaData( nPixels, 0 );
+    for ( int i = 0; i < nPixels; ++i )
+    {
+      QRgb c = inputBlock->color( i );
+      int alpha = qAlpha( c );
+      int red = qRed( c );
+      int green = qGreen( c );
+      int blue = qBlue( c );
+
+      if ( premultiplied && alpha > 0 )
+      {
+        double a = alpha / 255.;
+        red /= a;
+        green /= a;
+        blue /= a;
+      }
+      redData[i] = static_cast< char >( red );
+      greenData[i] = static_cast< char >( green );
+      blueData[i] = static_cast< char >( blue );
+      alphaData[i] = static_cast< char >( alpha );
+    }
+
+    part->provider->write( redData.data(), 1, part->cols, part->rows, part->left, part->top );
+    part->provider->write( greenData.data(), 2, part->cols, part->rows, part->left, part->top );
+    part->provider->write( blueData.data(), 3, part->cols, part->rows, part->left, part->top );
+    part->provider->write( alphaData.data(), 4, part->cols, part->rows, part->left, part->top );
+  }
+  else
+  {
+    for ( int i = 0; i < part->blocks.size(); ++i )
+    {
+      QgsRasterBlock* block = part->blocks.at( i );
+      // It may happen that internal data type (dataType) is wider than destDataType
+      // TODO: this conversion should go to QgsRasterDataProvider::write with additional input data type param
+      if ( block->dataType() != part->dataType )
+      {
+        block->convert( part->dataType );
+      }
+      part->provider->write( block->bits( 0 ), i + 1, part->cols, part->rows, part->left, part->top );
+    }
+  }
+
+  qDeleteAll( part->blocks );
+  part->blocks.clear();
+}
+
+//! Wait until the part being written is finished and release it
+static void finishRasterPart( QFuture<void>& writing, QgsRasterFileWriterPart& part )
+{
+  writing.waitForFinished();
+  qDeleteAll( part.blocks );
+  part.blocks.clear();
+  if ( part.ownsProvider )
+  {
+    delete part.provider;
+  }
+  part.provider = nullptr;
+  part.ownsProvider = false;
+}
+
+/** Make the parts read from the pipe cover whole blocks of the output, so that
+ * every output block (strip or tile) is written once, in the block layout of the file
+ */
+static void alignPartsToOutputBlocks( QgsRasterIterator* iter, const QgsRasterDataProvider* destProvider, int nCols, int maxPartWidth, int maxPartHeight )
+{
+  if ( !destProvider )
+    return;
+
+  int blockWidth = destProvider->xBlockSize();
+  int blockHeight = destProvider->yBlockSize();
+  if ( blockWidth <= 0 || blockHeight <= 0 )
+    return;
+
+  int partWidth;
+  int partHeight;
+  if ( blockWidth >= nCols )
+  {
+    // strips, read whole rows, about as many cells as the maximum part size
+    partWidth = nCols;
+    partHeight = static_cast< int >( qMax( static_cast< qgssize >( 1 ), static_cast< qgssize >( maxPartWidth ) * maxPartHeight / nCols ) );
+  }
+  else
+  {
+    partWidth = qMax( 1, maxPartWidth / blockWidth ) * blockWidth;
+    partHeight = maxPartHeight;
+  }
+  partHeight = qMax( 1, partHeight / blockHeight ) * blockHeight;
+
+  QgsDebugMsgLevel( QString( "output block %1 x %2, part %3 x %4" ).arg( blockWidth ).arg( blockHeight ).arg( partWidth ).arg( partHeight ), 4 );
+  iter->setMaximumTileWidth( partWidth );
+  iter->setMaximumTileHeight( partHeight );
+}
 
 QgsRasterFileWriter::QgsRasterFileWriter( const QString& outputUrl )
     : mMode( Raw )
@@ -329,7 +466,6 @@ QgsRasterFileWriter::WriterError QgsRasterFileWriter::writeDataRaster(
   QgsDebugMsgLevel( "Entered", 4 );
 
   const QgsRasterInterface* iface = iter->input();
-  const QgsRasterDataProvider *srcProvider = dynamic_cast<const QgsRasterDataProvider*>( iface->sourceInput() );
   int nBands = iface->bandCount();
   QgsDebugMsgLevel( QString( "nBands = %1" ).arg( nBands ), 4 );
 
@@ -339,6 +475,8 @@ QgsRasterFileWriter::WriterError QgsRasterFileWriter::writeDataRaster(
   int iterCols = 0;
   int iterRows = 0;
 
+  alignPartsToOutputBlocks( iter, destProvider, nCols, mMaxTileWidth, mMaxTileHeight );
+
   QList<QgsRasterBlock*> blockList;
   blockList.reserve( nBands );
   for ( int i = 1; i <= nBands; ++i )
@@ -363,6 +501,10 @@ QgsRasterFileWriter::WriterError QgsRasterFileWriter::writeDataRaster(
     progressDialog->setLabelText( QObject::tr( "Reading raster part %1 of %2" ).arg( fileIndex + 1 ).arg( nParts ) );
   }
 
+  // The previous part is written by a worker thread while the next one is read
+  QFuture<void> writing;
+  QgsRasterFileWriterPart part;
+
   // hmm why is there a for(;;) here ..
   // not good coding practice IMHO, it might be better to use [ for() and break ] or  [ while (test) ]
   Q_FOREVER
@@ -371,6 +513,8 @@ QgsRasterFileWriter::WriterError QgsRasterFileWriter::writeDataRaster(
     {
       if ( !iter->readNextRasterPart( i, iterCols, iterRows, &( blockList[i - 1] ), iterLeft, iterTop ) )
       {
+        finishRasterPart( writing, part );
+
         // No more parts, create VRT and return
         if ( mTiledMode )
         {
@@ -410,22 +554,19 @@ QgsRasterFileWriter::WriterError QgsRasterFileWriter::writeDataRaster(
       }
     }
 
-    // It may happen that internal data type (dataType) is wider than destDataType
-    QList<QgsRasterBlock*> destBlockList;
-    for ( int i = 1; i <= nBands; ++i )
+    // parts are written in order, one at a time
+    finishRasterPart( writing, part );
+    for ( int i = 0; i < nBands; ++i )
     {
-      if ( srcProvider && srcProvider->dataType( i ) == destDataType )
-      {
-        destBlockList.push_back( blockList[i-1] );
-      }
-      else
-      {
-        // TODO: this conversion should go to QgsRasterDataProvider::write with additional input data type param
-        blockList[i-1]->convert( destDataType );
-        destBlockList.push_back( blockList[i-1] );
-      }
-      blockList[i-1] = nullptr;
+      part.blocks << blockList[i];
+      blockList[i] = nullptr;
     }
+    part.dataType = destDataType;
+    part.cols = iterCols;
+    part.rows = iterRows;
+    // part files are written at their origin
+    part.left = mTiledMode ? 0 : iterLeft;
+    part.top = mTiledMode ? 0 : iterTop;
 
     if ( mTiledMode ) //write to file
     {
@@ -436,32 +577,31 @@ QgsRasterFileWriter::WriterError QgsRasterFileWriter::writeDataRaster(
 
       if ( partDestProvider )
       {
-        //write data to output file. todo: loop over the data list
         for ( int i = 1; i <= nBands; ++i )
         {
           if ( destHasNoDataValueList.value( i - 1 ) )
           {
             partDestProvider->setNoDataValue( i, destNoDataValueList.value( i - 1 ) );
           }
-          partDestProvider->write( destBlockList[i - 1]->bits( 0 ), i, iterCols, iterRows, 0, 0 );
-          delete destBlockList[i - 1];
           addToVRT( partFileName( fileIndex ), i, iterCols, iterRows, iterLeft, iterTop );
         }
-        delete partDestProvider;
+        part.provider = partDestProvider;
+        part.ownsProvider = true;
       }
     }
     else if ( destProvider )
     {
-      //loop over data
-      for ( int i = 1; i <= nBands; ++i )
-      {
-        destProvider->write( destBlockList[i - 1]->bits( 0 ), i, iterCols, iterRows, iterLeft, iterTop );
-        delete destBlockList[i - 1];
-      }
+      part.provider = destProvider;
+    }
+
+    if ( part.provider )
+    {
+      writing = QtConcurrent::run( writeRasterPart, &part );
     }
     ++fileIndex;
   }
 
+  finishRasterPart( writing, part );
   QgsDebugMsgLevel( "Done", 4 );
   return NoError;
 }
@@ -488,10 +628,6 @@ QgsRasterFileWriter::WriterError QgsRasterFileWriter::writeImageRaster( QgsRaste
   iter->setMaximumTileWidth( mMaxTileWidth );
   iter->setMaximumTileHeight( mMaxTileHeight );
 
-  void* redData = qgsMalloc( mMaxTileWidth * mMaxTileHeight );
-  void* greenData = qgsMalloc( mMaxTileWidth * mMaxTileHeight );
-  void* blueData = qgsMalloc( mMaxTileWidth * mMaxTileHeight );
-  void* alphaData = qgsMalloc( mMaxTileWidth * mMaxTileHeight );
   QgsRectangle mapRect;
   int iterLeft = 0, iterTop = 0, iterCols = 0, iterRows = 0;
   int fileIndex = 0;
@@ -504,6 +640,8 @@ QgsRasterFileWriter::WriterError QgsRasterFileWriter::writeImageRaster( QgsRaste
 
   destProvider = initOutput( nCols, nRows, crs, geoTransform, 4, QGis::Byte );
 
+  alignPartsToOutputBlocks( iter, destProvider, nCols, mMaxTileWidth, mMaxTileHeight );
+
   iter->startRasterRead( 1, nCols, nRows, outputExtent );
 
   int nParts = 0;
@@ -517,6 +655,12 @@ QgsRasterFileWriter::WriterError QgsRasterFileWriter::writeImageRaster( QgsRaste
     progressDialog->setLabelText( QObject::tr( "Reading raster part %1 of %2" ).arg( fileIndex + 1 ).arg( nParts ) );
   }
 
+  // The previous part is split into channels and written by a worker thread
+  // while the next one is read
+  QFuture<void> writing;
+  QgsRasterFileWriterPart part;
+  part.image = true;
+
   QgsRasterBlock *inputBlock = nullptr;
   while ( iter->readNextRasterPart( 1, iterCols, iterRows, &inputBlock, iterLeft, iterTop ) )
   {
@@ -537,40 +681,19 @@ QgsRasterFileWriter::WriterError QgsRasterFileWriter::writeImageRaster( QgsRaste
       }
     }
 
-    //fill into red/green/blue/alpha channels
-    qgssize nPixels = static_cast< qgssize >( iterCols ) * iterRows;
-    // TODO: should be char not int? we are then copying 1 byte
-    int red = 0;
-    int green = 0;
-    int blue = 0;
-    int alpha = 255;
-    for ( qgssize i = 0; i < nPixels; ++i )
-    {
-      QRgb c = inputBlock->color( i );
-      alpha = qAlpha( c );
-      red = qRed( c );
-      green = qGreen( c );
-      blue = qBlue( c );
-
-      if ( inputDataType == QGis::ARGB32_Premultiplied )
-      {
-        double a = alpha / 255.;
-        QgsDebugMsgLevel( QString( "red = %1 green = %2 blue = %3 alpha = %4 p = %5 a = %6" ).arg( red ).arg( green ).arg( blue ).arg( alpha ).arg( static_cast< int >( c ), 0, 16 ).arg( a ), 5 );
-        red /= a;
-        green /= a;
-        blue /= a;
-      }
-      memcpy( reinterpret_cast< char* >( redData ) + i, &red, 1 );
-      memcpy( reinterpret_cast< char* >( greenData ) + i, &green, 1 );
-      memcpy( reinterpret_cast< char* >( blueData ) + i, &blue, 1 );
-      memcpy( reinterpret_cast< char* >( alphaData ) + i, &alpha, 1 );
-    }
-    delete inputBlock;
+    // parts are written in order, one at a time
+    finishRasterPart( writing, part );
+    part.blocks << inputBlock;
+    inputBlock = nullptr;
+    part.cols = iterCols;
+    part.rows = iterRows;
+    // part files are written at their origin
+    part.left = mTiledMode ? 0 : iterLeft;
+    part.top = mTiledMode ? 0 : iterTop;
 
     //create output file
     if ( mTiledMode )
     {
-      //delete destProvider;
       QgsRasterDataProvider* partDestProvider = createPartProvider( outputExtent,
           nCols, iterCols, iterRows,
           iterLeft, iterTop, mOutputUrl, fileIndex,
@@ -578,38 +701,30 @@ QgsRasterFileWriter::WriterError QgsRasterFileWriter::writeImageRaster( QgsRaste
 
       if ( partDestProvider )
       {
-        //write data to output file
-        partDestProvider->write( redData, 1, iterCols, iterRows, 0, 0 );
-        partDestProvider->write( greenData, 2, iterCols, iterRows, 0, 0 );
-        partDestProvider->write( blueData, 3, iterCols, iterRows, 0, 0 );
-        partDestProvider->write( alphaData, 4, iterCols, iterRows, 0, 0 );
-
         addToVRT( partFileName( fileIndex ), 1, iterCols, iterRows, iterLeft, iterTop );
         addToVRT( partFileName( fileIndex ), 2, iterCols, iterRows, iterLeft, iterTop );
         addToVRT( partFileName( fileIndex ), 3, iterCols, iterRows, iterLeft, iterTop );
         addToVRT( partFileName( fileIndex ), 4, iterCols, iterRows, iterLeft, iterTop );
-        delete partDestProvider;
+        part.provider = partDestProvider;
+        part.ownsProvider = true;
       }
     }
     else if ( destProvider )
     {
-      destProvider->write( redData, 1, iterCols, iterRows, iterLeft, iterTop );
-      destProvider->write( greenData, 2, iterCols, iterRows, iterLeft, iterTop );
-      destProvider->write( blueData, 3, iterCols, iterRows, iterLeft, iterTop );
-      destProvider->write( alphaData, 4, iterCols, iterRows, iterLeft, iterTop );
+      part.provider = destProvider;
     }
 
+    if ( part.provider )
+    {
+      writing = QtConcurrent::run( writeRasterPart, &part );
+    }
     ++fileIndex;
   }
+  finishRasterPart( writing, part );
 
   if ( destProvider )
     delete destProvider;
 
-  qgsFree( redData );
-  qgsFree( greenData );
-  qgsFree( blueData );
-  qgsFree( alphaData );
-
   if ( progressDialog )
   {
     progressDialog->setValue( progressDialog->maximum() );
@@ -21,6 +21,7 @@
 #include <QByteArray>
 #include <QTime>
 #include <QStringList>
+#include <QtConcurrentMap>
 
 #include <qmath.h>
 
@@ -30,6 +31,191 @@
 #include "qgsrasterinterface.h"
 #include "qgsrectangle.h"
 
+//! Maximum number of cells read before they are accumulated on several threads
+static const qgssize MAX_BATCH_CELLS = 16 * 1024 * 1024;
+
+/** Statistics of a part of a band, which can be merged with other parts.
+ * The variance is merged with the pairwise algorithm of Chan et al.
+ */
+struct QgsRasterPartialStatistics
+{
+  QgsRasterPartialStatistics()
+      : count( 0 )
+      , sum( 0.0 )
+      , mean( 0.0 )
+      , sumOfSquares( 0.0 )
+      , minimum( std::numeric_limits<double>::max() )
+      , maximum( -std::numeric_limits<double>::max() )
+  {}
+
+  void add( double value )
+  {
+    sum += value;
+    count++;
+    if ( value < minimum ) minimum = value;
+    if ( value > maximum ) maximum = value;
+
+    // Single pass stdev
+    double delta = value - mean;
+    mean += delta / count;
+    sumOfSquares += delta * ( value - mean );
+  }
+
+  void merge( const QgsRasterPartialStatistics& other )
+  {
+    if ( other.count == 0 )
+      return;
+    if ( count == 0 )
+    {
+      *this = other;
+      return;
+    }
+    double total = static_cast< double >( count ) + other.count;
+    double delta = other.mean - mean;
+    mean += delta * other.count / total;
+    sumOfSquares += other.sumOfSquares + delta * delta * count * other.count / total;
+    sum += other.sum;
+    count += other.count;
+    minimum = qMin( minimum, other.minimum );
+    maximum = qMax( maximum, other.maximum );
+  }
+
+  qgssize count;
+  double sum;
+  double mean;
+  //! Sum of squared differences from the mean
+  double sumOfSquares;
+  double minimum;
+  double maximum;
+};
+
+//! A block read for statistics and the statistics of its cells
+struct QgsRasterStatisticsJob
+{
+  QgsRasterBlock* block;
+  QgsRasterPartialStatistics statistics;
+};
+
+//! Calculates the statistics of a block, for QtConcurrent::blockingMap
+struct QgsRasterStatisticsCalculation
+{
+  typedef void result_type;
+
+  void operator()( QgsRasterStatisticsJob& job )
+  {
+    QgsRasterBlock* blk = job.block;
+    qgssize count = static_cast< qgssize >( blk->width() ) * blk->height();
+    for ( qgssize i = 0; i < count; i++ )
+    {
+      if ( blk->isNoData( i ) ) continue; // NULL
+      job.statistics.add( blk->value( i ) );
+    }
+  }
+};
+
+//! Calculates the statistics of the read blocks, merges them in reading order and deletes the blocks
+static void accumulateStatistics( QList<QgsRasterStatisticsJob>& jobs, QgsRasterPartialStatistics& statistics )
+{
+  if ( jobs.size() > 1 )
+  {
+    QtConcurrent::blockingMap( jobs, QgsRasterStatisticsCalculation() );
+  }
+  else if ( !jobs.isEmpty() )
+  {
+    QgsRasterStatisticsCalculation()( jobs[0] );
+  }
+
+  for ( int i = 0; i < jobs.size(); i++ )
+  {
+    statistics.merge( jobs.at( i ).statistics );
+    delete jobs.at( i ).block;
+  }
+  jobs.clear();
+}
+
+//! A block read for a histogram and the bin counts of its cells
+struct QgsRasterHistogramJob
+{
+  QgsRasterBlock* block;
+  QgsRasterHistogram::HistogramVector counts;
+  int nonNullCount;
+};
+
+//! Calculates the histogram of a block, for QtConcurrent::blockingMap
+class QgsRasterHistogramCalculation
+{
+  public:
+    QgsRasterHistogramCalculation( int binCount, double minimum, double binSize, bool includeOutOfRange )
+        : mBinCount( binCount )
+        , mMinimum( minimum )
+        , mBinSize( binSize )
+        , mIncludeOutOfRange( includeOutOfRange )
+    {}
+
+    typedef void result_type;
+
+    void operator()( QgsRasterHistogramJob& job )
+    {
+      QgsRasterBlock* blk = job.block;
+      job.counts.fill( 0, mBinCount );
+      job.nonNullCount = 0;
+      int* counts = job.counts.data();
+
+      qgssize count = static_cast< qgssize >( blk->width() ) * blk->height();
+      for ( qgssize i = 0; i < count; i++ )
+      {
+        if ( blk->isNoData( i ) )
+        {
+          continue; // NULL
+        }
+        double myValue = blk->value( i );
+
+        int myBinIndex = static_cast <int>( qFloor(( myValue - mMinimum ) /  mBinSize ) );
+
+        if (( myBinIndex < 0 || myBinIndex > ( mBinCount - 1 ) ) && !mIncludeOutOfRange )
+        {
+          continue;
+        }
+        if ( myBinIndex < 0 ) myBinIndex = 0;
+        if ( myBinIndex > ( mBinCount - 1 ) ) myBinIndex = mBinCount - 1;
+
+        counts[myBinIndex] += 1;
+        job.nonNullCount++;
+      }
+    }
+
+  private:
+    int mBinCount;
+    double mMinimum;
+    double mBinSize;
+    bool mIncludeOutOfRange;
+};
+
+//! Calculates the histograms of the read blocks, adds them to the histogram and deletes the blocks
+static void accumulateHistogram( QList<QgsRasterHistogramJob>& jobs, const QgsRasterHistogramCalculation& calculation, QgsRasterHistogram& histogram )
+{
+  if ( jobs.size() > 1 )
+  {
+    QtConcurrent::blockingMap( jobs, calculation );
+  }
+  else if ( !jobs.isEmpty() )
+  {
+    QgsRasterHistogramCalculation( calculation )( jobs[0] );
+  }
+
+  for ( int i = 0; i < jobs.size(); i++ )
+  {
+    const QgsRasterHistogramJob& job = jobs.at( i );
+    for ( int bin = 0; bin < job.counts.size(); bin++ )
+    {
+      histogram.histogramVector[bin] += job.counts.at( bin );
+    }
+    histogram.nonNullCount += job.nonNullCount;
+    delete job.block;
+  }
+  jobs.clear();
+}
+
 QgsRasterInterface::QgsRasterInterface( QgsRasterInterface * input )
     : mInput( input )
     , mOn( true )
@@ -164,11 +350,11 @@ QgsRasterBandStats QgsRasterInterface::bandStatistics( int theBandNo,
   double myYRes = myExtent.height() / myHeight;
   // TODO: progress signals
 
-  // used by single pass stdev
-  double myMean = 0;
-  double mySumOfSquares = 0;
-
-  bool myFirstIterationFlag = true;
+  // Blocks are read on this thread, providers are not thread safe, and
+  // their statistics are calculated in batches on several threads
+  QList<QgsRasterStatisticsJob> myJobs;
+  qgssize myBatchCells = 0;
+  QgsRasterPartialStatistics myStatistics;
   for ( int myYBlock = 0; myYBlock < myNYBlocks; myYBlock++ )
   {
     for ( int myXBlock = 0; myXBlock < myNXBlocks; myXBlock++ )
@@ -184,44 +370,28 @@ QgsRasterBandStats QgsRasterInterface::bandStatistics( int theBandNo,
 
       QgsRectangle myPartExtent( xmin, ymin, xmax, ymax );
 
-      QgsRasterBlock* blk = block( theBandNo, myPartExtent, myBlockWidth, myBlockHeight );
+      QgsRasterStatisticsJob myJob;
+      myJob.block = block( theBandNo, myPartExtent, myBlockWidth, myBlockHeight );
+      myJobs << myJob;
 
-      // Collect the histogram counts.
-      for ( qgssize i = 0; i < ( static_cast< qgssize >( myBlockHeight ) ) * myBlockWidth; i++ )
+      myBatchCells += static_cast< qgssize >( myBlockWidth ) * myBlockHeight;
+      if ( myBatchCells >= MAX_BATCH_CELLS )
       {
-        if ( blk->isNoData( i ) ) continue; // NULL
-
-        double myValue = blk->value( i );
-
-        myRasterBandStats.sum += myValue;
-        myRasterBandStats.elementCount++;
-
-        if ( myFirstIterationFlag )
-        {
-          myFirstIterationFlag = false;
-          myRasterBandStats.minimumValue = myValue;
-          myRasterBandStats.maximumValue = myValue;
-        }
-        else
-        {
-          if ( myValue < myRasterBandStats.minimumValue )
-          {
-            myRasterBandStats.minimumValue = myValue;
-          }
-          if ( myValue > myRasterBandStats.maximumValue )
-          {
-            myRasterBandStats.maximumValue = myValue;
-          }
-        }
-
-        // Single pass stdev
-        double myDelta = myValue - myMean;
-        myMean += myDelta / myRasterBandStats.elementCount;
-        mySumOfSquares += myDelta * ( myValue - myMean );
+        accumulateStatistics( myJobs, myStatistics );
+        myBatchCells = 0;
       }
-      delete blk;
     }
   }
+  accumulateStatistics( myJobs, myStatistics );
+
+  myRasterBandStats.sum = myStatistics.sum;
+  myRasterBandStats.elementCount = myStatistics.count;
+  if ( myStatistics.count > 0 )
+  {
+    myRasterBandStats.minimumValue = myStatistics.minimum;
+    myRasterBandStats.maximumValue = myStatistics.maximum;
+  }
+  double mySumOfSquares = myStatistics.sumOfSquares;
 
   myRasterBandStats.range = myRasterBandStats.maximumValue - myRasterBandStats.minimumValue;
   myRasterBandStats.mean = myRasterBandStats.sum / myRasterBandStats.elementCount;
@@ -233,12 +403,28 @@ QgsRasterBandStats QgsRasterInterface::bandStatistics( int theBandNo,
   // Divide result by sample size - 1 and get square root to get stdev
   myRasterBandStats.stdDev = sqrt( mySumOfSquares / ( myRasterBandStats.elementCount - 1 ) );
 
+  // Statistics calculated on a sample (coarser resolution than the data)
+  // are approximate, report the uncertainty of the mean
+  double mySampledFraction = 0;
+  if ( capabilities() & Size )
+  {
+    double myCellArea = ( extent().width() / xSize() ) * ( extent().height() / ySize() );
+    double myPopulation = myExtent.width() * myExtent.height() / myCellArea;
+    mySampledFraction = qMin( 1.0, static_cast< double >( myWidth ) * myHeight / myPopulation );
+  }
+  if ( mySampledFraction < 1.0 && myRasterBandStats.elementCount > 1 )
+  {
+    myRasterBandStats.meanError = 1.96 * myRasterBandStats.stdDev / sqrt( static_cast< double >( myRasterBandStats.elementCount ) )
+                                  * sqrt( 1.0 - mySampledFraction );
+  }
+
   QgsDebugMsgLevel( "************ STATS **************", 4 );
   QgsDebugMsgLevel( QString( "MIN %1" ).arg( myRasterBandStats.minimumValue ), 4 );
   QgsDebugMsgLevel( QString( "MAX %1" ).arg( myRasterBandStats.maximumValue ), 4 );
   QgsDebugMsgLevel( QString( "RANGE %1" ).arg( myRasterBandStats.range ), 4 );
   QgsDebugMsgLevel( QString( "MEAN %1" ).arg( myRasterBandStats.mean ), 4 );
   QgsDebugMsgLevel( QString( "STDDEV %1" ).arg( myRasterBandStats.stdDev ), 4 );
+  QgsDebugMsgLevel( QString( "MEAN ERROR %1" ).arg( myRasterBandStats.meanError ), 4 );
 
   myRasterBandStats.statsGathered = QgsRasterBandStats::All;
   mStatistics.append( myRasterBandStats );
@@ -451,6 +637,12 @@ QgsRasterHistogram QgsRasterInterface::histogram( int theBandNo,
 
   double myBinSize = ( myMaximum - myMinimum ) / myBinCount;
 
+  // Blocks are read on this thread, providers are not thread safe, and
+  // their histograms are calculated in batches on several threads
+  QgsRasterHistogramCalculation myCalculation( myBinCount, myMinimum, myBinSize, theIncludeOutOfRange );
+  QList<QgsRasterHistogramJob> myJobs;
+  qgssize myBatchCells = 0;
+
   // TODO: progress signals
   for ( int myYBlock = 0; myYBlock < myNYBlocks; myYBlock++ )
   {
@@ -466,32 +658,20 @@ QgsRasterHistogram QgsRasterInterface::histogram( int theBandNo,
 
       QgsRectangle myPartExtent( xmin, ymin, xmax, ymax );
 
-      QgsRasterBlock* blk = block( theBandNo, myPartExtent, myBlockWidth, myBlockHeight );
+      QgsRasterHistogramJob myJob;
+      myJob.block = block( theBandNo, myPartExtent, myBlockWidth, myBlockHeight );
+      myJob.nonNullCount = 0;
+      myJobs << myJob;
 
-      // Collect the histogram counts.
-      for ( qgssize i = 0; i < ( static_cast< qgssize >( myBlockHeight ) ) * myBlockWidth; i++ )
+      myBatchCells += static_cast< qgssize >( myBlockWidth ) * myBlockHeight;
+      if ( myBatchCells >= MAX_BATCH_CELLS )
       {
-        if ( blk->isNoData( i ) )
-        {
-          continue; // NULL
-        }
-        double myValue = blk->value( i );
-
-        int myBinIndex = static_cast <int>( qFloor(( myValue - myMinimum ) /  myBinSize ) );
-
-        if (( myBinIndex < 0 || myBinIndex > ( myBinCount - 1 ) ) && !theIncludeOutOfRange )
-        {
-          continue;
-        }
-        if ( myBinIndex < 0 ) myBinIndex = 0;
-        if ( myBinIndex > ( myBinCount - 1 ) ) myBinIndex = myBinCount - 1;
-
-        myHistogram.histogramVector[myBinIndex] += 1;
-        myHistogram.nonNullCount++;
+        accumulateHistogram( myJobs, myCalculation, myHistogram );
+        myBatchCells = 0;
       }
-      delete blk;
     }
   }
+  accumulateHistogram( myJobs, myCalculation, myHistogram );
 
   myHistogram.valid = true;
   mHistograms.append( myHistogram );
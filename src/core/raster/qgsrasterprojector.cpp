@@ -23,6 +23,63 @@
 #include "qgscoordinatetransform.h"
 #include "qgscsexception.h"
 
+#include <QCache>
+#include <QMutex>
+#include <QThread>
+#include <QtConcurrentMap>
+
+//! Approximation matrix, source extent and source size calculated by QgsRasterProjector::calc()
+struct QgsRasterProjectorGrid
+{
+  QList< QList<QgsPoint> > cpMatrix;
+  QList< QList<bool> > cpLegalMatrix;
+  int cpRows;
+  int cpCols;
+  bool approximate;
+  QgsRectangle srcExtent;
+  int srcRows;
+  int srcCols;
+};
+
+//! Maximum number of matrix points kept in the matrix cache
+static const int GRID_CACHE_MAX_POINTS = 256 * 1024;
+static QCache<QString, QgsRasterProjectorGrid> sGridCache( GRID_CACHE_MAX_POINTS );
+static QMutex sGridCacheMutex;
+
+//! Minimum number of destination pixels of a row band mapped on a thread
+static const int MIN_BAND_PIXELS = 64 * 1024;
+
+//! A band of destination rows
+struct QgsRasterProjectorRows
+{
+  int firstRow;
+  int lastRow;
+};
+
+//! Maps a band of destination rows to source rows and columns, for QtConcurrent::blockingMap
+class QgsRasterProjectorRowsMapping
+{
+  public:
+    QgsRasterProjectorRowsMapping( const QgsRasterProjector* projector, int* srcRows, int* srcCols )
+        : mProjector( projector )
+        , mSrcRows( srcRows )
+        , mSrcCols( srcCols )
+    {}
+
+    typedef void result_type;
+
+    void operator()( const QgsRasterProjectorRows& rows )
+    {
+      qgssize offset = static_cast< qgssize >( rows.firstRow ) * mProjector->mDestCols;
+      mProjector->approximateSrcRowsCols( rows.firstRow, rows.lastRow, mSrcRows + offset, mSrcCols + offset );
+    }
+
+  private:
+    const QgsRasterProjector* mProjector;
+    int* mSrcRows;
+    int* mSrcCols;
+};
+
 QgsRasterProjector::QgsRasterProjector(
   const QgsCoordinateReferenceSystem& theSrcCRS,
   const QgsCoordinateReferenceSystem& theDestCRS,
@@ -40,7 +97,6 @@ QgsRasterProjector::QgsRasterProjector(
     , mDestExtent( theDestExtent )
     , mExtent( theExtent )
     , mDestRows( theDestRows ), mDestCols( theDestCols )
-    , pHelperTop( nullptr ), pHelperBottom( nullptr )
     , mMaxSrcXRes( theMaxSrcXRes ), mMaxSrcYRes( theMaxSrcYRes )
     , mPrecision( Approximate )
     , mApproximate( true )
@@ -66,7 +122,6 @@ QgsRasterProjector::QgsRasterProjector(
     , mDestExtent( theDestExtent )
     , mExtent( theExtent )
     , mDestRows( theDestRows ), mDestCols( theDestCols )
-    , pHelperTop( nullptr ), pHelperBottom( nullptr )
     , mMaxSrcXRes( theMaxSrcXRes ), mMaxSrcYRes( theMaxSrcYRes )
     , mPrecision( Approximate )
     , mApproximate( false )
@@ -98,8 +153,6 @@ QgsRasterProjector::QgsRasterProjector(
     , mSrcYRes( 0.0 )
     , mDestRowsPerMatrixRow( 0.0 )
     , mDestColsPerMatrixCol( 0.0 )
-    , pHelperTop( nullptr ), pHelperBottom( nullptr )
-    , mHelperTopRow( 0 )
     , mCPCols( 0 )
     , mCPRows( 0 )
     , mSqrTolerance( 0.0 )
@@ -125,9 +178,6 @@ QgsRasterProjector::QgsRasterProjector()
     , mSrcYRes( 0.0 )
     , mDestRowsPerMatrixRow( 0.0 )
     , mDestColsPerMatrixCol( 0.0 )
-    , pHelperTop( nullptr )
-    , pHelperBottom( nullptr )
-    , mHelperTopRow( 0 )
     , mCPCols( 0 )
     , mCPRows( 0 )
     , mSqrTolerance( 0.0 )
@@ -141,9 +191,6 @@ QgsRasterProjector::QgsRasterProjector()
 
 QgsRasterProjector::QgsRasterProjector( const QgsRasterProjector &projector )
     : QgsRasterInterface( nullptr )
-    , pHelperTop( nullptr )
-    , pHelperBottom( nullptr )
-    , mHelperTopRow( 0 )
     , mCPCols( 0 )
     , mCPRows( 0 )
     , mSqrTolerance( 0 )
@@ -197,8 +244,6 @@ QgsRasterProjector* QgsRasterProjector::clone() const
 
 QgsRasterProjector::~QgsRasterProjector()
 {
-  delete[] pHelperTop;
-  delete[] pHelperBottom;
 }
 
 int QgsRasterProjector::bandCount() const
@@ -228,10 +273,6 @@ void QgsRasterProjector::calc()
   QgsDebugMsgLevel( "Entered", 4 );
   mCPMatrix.clear();
   mCPLegalMatrix.clear();
-  delete[] pHelperTop;
-  pHelperTop = nullptr;
-  delete[] pHelperBottom;
-  pHelperBottom = nullptr;
 
   // Get max source resolution and extent if possible
   mMaxSrcXRes = 0;
@@ -264,8 +305,6 @@ void QgsRasterProjector::calc()
   double myDestRes = mDestXRes < mDestYRes ? mDestXRes : mDestYRes;
   mSqrTolerance = myDestRes * myDestRes;
 
-  QgsCoordinateTransform inverseCt = QgsCoordinateTransformCache::instance()->transform( mDestCRS.authid(), mSrcCRS.authid(), mDestDatumTransform, mSrcDatumTransform );
-
   if ( mPrecision == Approximate )
   {
     mApproximate = true;
@@ -275,6 +314,78 @@ void QgsRasterProjector::calc()
     mApproximate = false;
   }
 
+  // The matrix only depends on the transformation, the extents and the sizes: repeated renders of
+  // the same view and server tiles reuse it
+  QString cacheKey = gridCacheKey();
+  {
+    QMutexLocker locker( &sGridCacheMutex );
+    if ( QgsRasterProjectorGrid* grid = sGridCache.object( cacheKey ) )
+    {
+      mCPMatrix = grid->cpMatrix;
+      mCPLegalMatrix = grid->cpLegalMatrix;
+      mCPRows = grid->cpRows;
+      mCPCols = grid->cpCols;
+      mApproximate = grid->approximate;
+      mSrcExtent = grid->srcExtent;
+      mSrcRows = grid->srcRows;
+      mSrcCols = grid->srcCols;
+    }
+  }
+
+  if ( mCPMatrix.isEmpty() )
+  {
+    calcGrid();
+
+    QgsRasterProjectorGrid* grid = new QgsRasterProjectorGrid;
+    grid->cpMatrix = mCPMatrix;
+    grid->cpLegalMatrix = mCPLegalMatrix;
+    grid->cpRows = mCPRows;
+    grid->cpCols = mCPCols;
+    grid->approximate = mApproximate;
+    grid->srcExtent = mSrcExtent;
+    grid->srcRows = mSrcRows;
+    grid->srcCols = mSrcCols;
+    QMutexLocker locker( &sGridCacheMutex );
+    sGridCache.insert( cacheKey, grid, mCPRows * mCPCols );
+  }
+
+  mDestRowsPerMatrixRow = static_cast< float >( mDestRows ) / ( mCPRows - 1 );
+  mDestColsPerMatrixCol = static_cast< float >( mDestCols ) / ( mCPCols - 1 );
+  mSrcYRes = mSrcExtent.height() / mSrcRows;
+  mSrcXRes = mSrcExtent.width() / mSrcCols;
+}
+
+QString QgsRasterProjector::gridCacheKey() const
+{
+  QStringList key;
+  key << mSrcCRS.authid() << mSrcCRS.toProj4() << mDestCRS.authid() << mDestCRS.toProj4()
+  << QString::number( mSrcDatumTransform ) << QString::number( mDestDatumTransform )
+  << QString::number( mDestExtent.xMinimum(), 'g', 17 ) << QString::number( mDestExtent.yMinimum(), 'g', 17 )
+  << QString::number( mDestExtent.xMaximum(), 'g', 17 ) << QString::number( mDestExtent.yMaximum(), 'g', 17 )
+  << QString::number( mDestRows ) << QString::number( mDestCols )
+  << QString::number( mExtent.xMinimum(), 'g', 17 ) << QString::number( mExtent.yMinimum(), 'g', 17 )
+  << QString::number( mExtent.xMaximum(), 'g', 17 ) << QString::number( mExtent.yMaximum(), 'g', 17 )
+  << QString::number( mMaxSrcXRes, 'g', 17 ) << QString::number( mMaxSrcYRes, 'g', 17 )
+  << QString::number( mPrecision );
+  return key.join( "|" );
+}
+
+void QgsRasterProjector::clearGridCache()
+{
+  QMutexLocker locker( &sGridCacheMutex );
+  sGridCache.clear();
+}
+
+bool QgsRasterProjector::isGridCached( const QString& key )
+{
+  QMutexLocker locker( &sGridCacheMutex );
+  return sGridCache.contains( key );
+}
+
+void QgsRasterProjector::calcGrid()
+{
+  QgsCoordinateTransform inverseCt = QgsCoordinateTransformCache::instance()->transform( mDestCRS.authid(), mSrcCRS.authid(), mDestDatumTransform, mSrcDatumTransform );
+
   // Always try to calculate mCPMatrix, it is used in calcSrcExtent() for both Approximate and Exact
   // Initialize the matrix by corners and middle points
   mCPCols = mCPRows = 3;
@@ -325,24 +436,13 @@ void QgsRasterProjector::calc()
     }
   }
   QgsDebugMsgLevel( QString( "CPMatrix size: mCPRows = %1 mCPCols = %2" ).arg( mCPRows ).arg( mCPCols ), 4 );
-  mDestRowsPerMatrixRow = static_cast< float >( mDestRows ) / ( mCPRows - 1 );
-  mDestColsPerMatrixCol = static_cast< float >( mDestCols ) / ( mCPCols - 1 );
 
   QgsDebugMsgLevel( "CPMatrix:", 5 );
   QgsDebugMsgLevel( cpToString(), 5 );
 
-  // init helper points
-  pHelperTop = new QgsPoint[mDestCols];
-  pHelperBottom = new QgsPoint[mDestCols];
-  calcHelper( 0, pHelperTop );
-  calcHelper( 1, pHelperBottom );
-  mHelperTopRow = 0;
-
   // Calculate source dimensions
   calcSrcExtent();
   calcSrcRowsCols();
-  mSrcYRes = mSrcExtent.height() / mSrcRows;
-  mSrcXRes = mSrcExtent.width() / mSrcCols;
 }
 
 void QgsRasterProjector::calcSrcExtent()
@@ -509,17 +609,17 @@ void QgsRasterProjector::calcSrcRowsCols()
 }
 
 
-inline void QgsRasterProjector::destPointOnCPMatrix( int theRow, int theCol, double *theX, double *theY )
+inline void QgsRasterProjector::destPointOnCPMatrix( int theRow, int theCol, double *theX, double *theY ) const
 {
   *theX = mDestExtent.xMinimum() + theCol * mDestExtent.width() / ( mCPCols - 1 );
   *theY = mDestExtent.yMaximum() - theRow * mDestExtent.height() / ( mCPRows - 1 );
 }
 
-inline int QgsRasterProjector::matrixRow( int theDestRow )
+inline int QgsRasterProjector::matrixRow( int theDestRow ) const
 {
   return static_cast< int >( floor(( theDestRow + 0.5 ) / mDestRowsPerMatrixRow ) );
 }
-inline int QgsRasterProjector::matrixCol( int theDestCol )
+inline int QgsRasterProjector::matrixCol( int theDestCol ) const
 {
   return static_cast< int >( floor(( theDestCol + 0.5 ) / mDestColsPerMatrixCol ) );
 }
@@ -531,7 +631,7 @@ QgsPoint QgsRasterProjector::srcPoint( int theDestRow, int theCol )
   return QgsPoint();
 }
 
-void QgsRasterProjector::calcHelper( int theMatrixRow, QgsPoint *thePoints )
+void QgsRasterProjector::calcHelper( int theMatrixRow, QgsPoint *thePoints ) const
 {
   // TODO?: should we also precalc dest cell center coordinates for x and y?
   for ( int myDestCol = 0; myDestCol < mDestCols; myDestCol++ )
@@ -547,8 +647,8 @@ void QgsRasterProjector::calcHelper( int theMatrixRow, QgsPoint *thePoints )
 
     double xfrac = ( myDestX - myDestXMin ) / ( myDestXMax - myDestXMin );
 
-    QgsPoint &mySrcPoint0 = mCPMatrix[theMatrixRow][myMatrixCol];
-    QgsPoint &mySrcPoint1 = mCPMatrix[theMatrixRow][myMatrixCol+1];
+    const QgsPoint &mySrcPoint0 = mCPMatrix.at( theMatrixRow ).at( myMatrixCol );
+    const QgsPoint &mySrcPoint1 = mCPMatrix.at( theMatrixRow ).at( myMatrixCol + 1 );
     double s = mySrcPoint0.x() + ( mySrcPoint1.x() - mySrcPoint0.x() ) * xfrac;
     double t = mySrcPoint0.y() + ( mySrcPoint1.y() - mySrcPoint0.y() ) * xfrac;
 
@@ -556,29 +656,6 @@ void QgsRasterProjector::calcHelper( int theMatrixRow, QgsPoint *thePoints )
     thePoints[myDestCol].setY( t );
   }
 }
-void QgsRasterProjector::nextHelper()
-{
-  // We just switch pHelperTop and pHelperBottom, memory is not lost
-  QgsPoint *tmp;
-  tmp = pHelperTop;
-  pHelperTop = pHelperBottom;
-  pHelperBottom = tmp;
-  calcHelper( mHelperTopRow + 2, pHelperBottom );
-  mHelperTopRow++;
-}
-
-bool QgsRasterProjector::srcRowCol( int theDestRow, int theDestCol, int *theSrcRow, int *theSrcCol, const QgsCoordinateTransform& ct )
-{
-  if ( mApproximate )
-  {
-    return approximateSrcRowCol( theDestRow, theDestCol, theSrcRow, theSrcCol );
-  }
-  else
-  {
-    return preciseSrcRowCol( theDestRow, theDestCol, theSrcRow, theSrcCol, ct );
-  }
-}
-
 bool QgsRasterProjector::preciseSrcRowCol( int theDestRow, int theDestCol, int *theSrcRow, int *theSrcCol, const QgsCoordinateTransform& ct )
 {
 #ifdef QGISDEBUG
@@ -628,17 +705,12 @@ bool QgsRasterProjector::preciseSrcRowCol( int theDestRow, int theDestCol, int *
   return true;
 }
 
-bool QgsRasterProjector::approximateSrcRowCol( int theDestRow, int theDestCol, int *theSrcRow, int *theSrcCol )
+bool QgsRasterProjector::approximateSrcRowCol( int theDestRow, int theDestCol, const QgsPoint* theHelperTop, const QgsPoint* theHelperBottom,
+    int *theSrcRow, int *theSrcCol ) const
 {
   int myMatrixRow = matrixRow( theDestRow );
   int myMatrixCol = matrixCol( theDestCol );
 
-  if ( myMatrixRow > mHelperTopRow )
-  {
-    // TODO: make it more robust (for random, not sequential reading)
-    nextHelper();
-  }
-
   double myDestY = mDestExtent.yMaximum() - ( theDestRow + 0.5 ) * mDestYRes;
 
   // See the schema in javax.media.jai.WarpGrid doc (but up side down)
@@ -650,8 +722,8 @@ bool QgsRasterProjector::approximateSrcRowCol( int theDestRow, int theDestCol, i
 
   double yfrac = ( myDestY - myDestYMin ) / ( myDestYMax - myDestYMin );
 
-  QgsPoint &myTop = pHelperTop[theDestCol];
-  QgsPoint &myBot = pHelperBottom[theDestCol];
+  const QgsPoint &myTop = theHelperTop[theDestCol];
+  const QgsPoint &myBot = theHelperBottom[theDestCol];
 
   // Warning: this is very SLOW compared to the following code!:
   //double mySrcX = myBot.x() + (myTop.x() - myBot.x()) * yfrac;
@@ -685,6 +757,37 @@ bool QgsRasterProjector::approximateSrcRowCol( int theDestRow, int theDestCol, i
   return true;
 }
 
+void QgsRasterProjector::approximateSrcRowsCols( int theFirstRow, int theLastRow, int *theSrcRows, int *theSrcCols ) const
+{
+  // helper points of the matrix rows above and below the current destination row
+  QVector<QgsPoint> helperTop( mDestCols );
+  QVector<QgsPoint> helperBottom( mDestCols );
+  int helperTopRow = matrixRow( theFirstRow );
+  calcHelper( helperTopRow, helperTop.data() );
+  calcHelper( helperTopRow + 1, helperBottom.data() );
+
+  int* srcRow = theSrcRows;
+  int* srcCol = theSrcCols;
+  for ( int i = theFirstRow; i <= theLastRow; ++i )
+  {
+    while ( matrixRow( i ) > helperTopRow )
+    {
+      // We just switch the helpers, memory is not lost
+      helperTop.swap( helperBottom );
+      calcHelper( helperTopRow + 2, helperBottom.data() );
+      helperTopRow++;
+    }
+
+    for ( int j = 0; j < mDestCols; ++j, ++srcRow, ++srcCol )
+    {
+      if ( !approximateSrcRowCol( i, j, helperTop.constData(), helperBottom.constData(), srcRow, srcCol ) )
+      {
+        *srcRow = -1;
+      }
+    }
+  }
+}
+
 void QgsRasterProjector::insertRows( const QgsCoordinateTransform& ct )
 {
   for ( int r = 0; r < mCPRows - 1; r++ )
@@ -892,6 +995,11 @@ QgsRasterBlock * QgsRasterProjector::block( int bandNo, QgsRectangle  const & ex
     return mInput->block( bandNo, extent, width, height );
   }
 
+  if ( width <= 0 || height <= 0 )
+  {
+    return new QgsRasterBlock();
+  }
+
   mDestExtent = extent;
   mDestRows = height;
   mDestCols = width;
@@ -907,7 +1015,84 @@ QgsRasterBlock * QgsRasterProjector::block( int bandNo, QgsRectangle  const & ex
     return new QgsRasterBlock();
   }
 
-  QgsRasterBlock *inputBlock = mInput->block( bandNo, srcExtent(), srcCols(), srcRows() );
+  // Map the destination pixels to source pixels (-1 row for pixels outside the source)
+  qgssize destSize = static_cast< qgssize >( width ) * height;
+  QVector<int> srcRowIndexes( destSize );
+  QVector<int> srcColIndexes( destSize );
+  if ( mApproximate )
+  {
+    // split in bands of rows mapped in parallel
+    int bandRows = qMax( 1, height / ( 4 * qMax( 1, QThread::idealThreadCount() ) ) );
+    bandRows = qMax( bandRows, MIN_BAND_PIXELS / width );
+    QList<QgsRasterProjectorRows> bands;
+    for ( int firstRow = 0; firstRow < height; firstRow += bandRows )
+    {
+      QgsRasterProjectorRows rows;
+      rows.firstRow = firstRow;
+      rows.lastRow = qMin( height, firstRow + bandRows ) - 1;
+      bands << rows;
+    }
+    QgsRasterProjectorRowsMapping mapping( this, srcRowIndexes.data(), srcColIndexes.data() );
+    if ( bands.size() > 1 )
+    {
+      QtConcurrent::blockingMap( bands, mapping );
+    }
+    else
+    {
+      mapping( bands.first() );
+    }
+  }
+  else
+  {
+    QgsCoordinateTransform inverseCt = QgsCoordinateTransformCache::instance()->transform( mDestCRS.authid(), mSrcCRS.authid(), mDestDatumTransform, mSrcDatumTransform );
+    qgssize destIndex = 0;
+    for ( int i = 0; i < height; ++i )
+    {
+      for ( int j = 0; j < width; ++j, ++destIndex )
+      {
+        if ( !preciseSrcRowCol( i, j, &srcRowIndexes[destIndex], &srcColIndexes[destIndex], inverseCt ) )
+        {
+          srcRowIndexes[destIndex] = -1;
+        }
+      }
+    }
+  }
+
+  // Only read the part of the source which is actually used
+  int minSrcRow = mSrcRows;
+  int maxSrcRow = -1;
+  int minSrcCol = mSrcCols;
+  int maxSrcCol = -1;
+  const int* srcRow = srcRowIndexes.constData();
+  const int* srcCol = srcColIndexes.constData();
+  for ( qgssize destIndex = 0; destIndex < destSize; ++destIndex )
+  {
+    if ( srcRow[destIndex] < 0 )
+      continue;
+    minSrcRow = qMin( minSrcRow, srcRow[destIndex] );
+    maxSrcRow = qMax( maxSrcRow, srcRow[destIndex] );
+    minSrcCol = qMin( minSrcCol, srcCol[destIndex] );
+    maxSrcCol = qMax( maxSrcCol, srcCol[destIndex] );
+  }
+  if ( maxSrcRow < 0 )
+  {
+    // nothing inside, the block is read anyway for its data type and no data value
+    minSrcRow = 0;
+    maxSrcRow = mSrcRows - 1;
+    minSrcCol = 0;
+    maxSrcCol = mSrcCols - 1;
+  }
+  int readRows = maxSrcRow - minSrcRow + 1;
+  int readCols = maxSrcCol - minSrcCol + 1;
+  QgsRectangle readExtent( mSrcExtent.xMinimum() + minSrcCol * mSrcXRes, mSrcExtent.yMaximum() - ( maxSrcRow + 1 ) * mSrcYRes,
+                           mSrcExtent.xMinimum() + ( maxSrcCol + 1 ) * mSrcXRes, mSrcExtent.yMaximum() - minSrcRow * mSrcYRes );
+  if ( readRows == mSrcRows && readCols == mSrcCols )
+  {
+    readExtent = mSrcExtent;
+  }
+  QgsDebugMsgLevel( QString( "readExtent:\n%1 readCols = %2 readRows = %3" ).arg( readExtent.toString() ).arg( readCols ).arg( readRows ), 4 );
+
+  QgsRasterBlock *inputBlock = mInput->block( bandNo, readExtent, readCols, readRows );
   if ( !inputBlock || inputBlock->isEmpty() )
   {
     QgsDebugMsg( "No raster data!" );
@@ -948,46 +1133,35 @@ QgsRasterBlock * QgsRasterProjector::block( int bandNo, QgsRectangle  const & ex
   // we cannot fill output block with no data because we use memcpy for data, not setValue().
   bool doNoData = !QgsRasterBlock::typeIsNumeric( inputBlock->dataType() ) && inputBlock->hasNoData() && !inputBlock->hasNoDataValue();
 
-  QgsCoordinateTransform inverseCt;
-  if ( !mApproximate )
+  char *srcData = inputBlock->bits();
+  char *destData = outputBlock->bits();
+  if ( !srcData || !destData )
   {
-    inverseCt = QgsCoordinateTransformCache::instance()->transform( mDestCRS.authid(), mSrcCRS.authid(), mDestDatumTransform, mSrcDatumTransform );
+    QgsDebugMsg( "Cannot get block data" );
+    delete inputBlock;
+    return outputBlock;
   }
 
-  outputBlock->setIsNoData();
-
-  int srcRow, srcCol;
+  qgssize destIndex = 0;
   for ( int i = 0; i < height; ++i )
   {
-    for ( int j = 0; j < width; ++j )
+    for ( int j = 0; j < width; ++j, ++destIndex )
     {
-      bool inside = srcRowCol( i, j, &srcRow, &srcCol, inverseCt );
-      if ( !inside ) continue; // we have everything set to no data
+      if ( srcRow[destIndex] < 0 ) continue; // we have everything set to no data
 
-      qgssize srcIndex = static_cast< qgssize >( srcRow ) * mSrcCols + srcCol;
-      QgsDebugMsgLevel( QString( "row = %1 col = %2 srcRow = %3 srcCol = %4" ).arg( i ).arg( j ).arg( srcRow ).arg( srcCol ), 5 );
+      int readRow = srcRow[destIndex] - minSrcRow;
+      int readCol = srcCol[destIndex] - minSrcCol;
+      QgsDebugMsgLevel( QString( "row = %1 col = %2 srcRow = %3 srcCol = %4" ).arg( i ).arg( j ).arg( readRow ).arg( readCol ), 5 );
 
       // isNoData() may be slow so we check doNoData first
-      if ( doNoData && inputBlock->isNoData( srcRow, srcCol ) )
+      if ( doNoData && inputBlock->isNoData( readRow, readCol ) )
       {
         outputBlock->setIsNoData( i, j );
         continue;
       }
 
-      qgssize destIndex = static_cast< qgssize >( i ) * width + j;
-      char *srcBits = inputBlock->bits( srcIndex );
-      char *destBits = outputBlock->bits( destIndex );
-      if ( !srcBits )
-      {
-        QgsDebugMsg( QString( "Cannot get input block data: row = %1 col = %2" ).arg( i ).arg( j ) );
-        continue;
-      }
-      if ( !destBits )
-      {
-        QgsDebugMsg( QString( "Cannot set output block data: srcRow = %1 srcCol = %2" ).arg( srcRow ).arg( srcCol ) );
-        continue;
-      }
-      memcpy( destBits, srcBits, pixelSize );
+      qgssize srcIndex = static_cast< qgssize >( readRow ) * readCols + readCol;
+      memcpy( destData + destIndex * pixelSize, srcData + srcIndex * pixelSize, pixelSize );
       outputBlock->setIsData( i, j );
     }
   }
@@ -127,6 +127,11 @@ class CORE_EXPORT QgsRasterProjector : public QgsRasterInterface
                             const QgsRectangle& theSrcExtent, int theSrcXSize, int theSrcYSize,
                             QgsRectangle& theDestExtent, int& theDestXSize, int& theDestYSize );
 
+    /** Clears the cache of approximation matrices shared by all projectors
+     * @note added in QGIS 3.0
+     */
+    static void clearGridCache();
+
   private:
     /** Get source extent */
     QgsRectangle srcExtent() { return mSrcExtent; }
@@ -137,21 +142,15 @@ class CORE_EXPORT QgsRasterProjector : public QgsRasterInterface
     void setSrcRows( int theRows ) { mSrcRows = theRows; mSrcXRes = mSrcExtent.height() / mSrcRows; }
     void setSrcCols( int theCols ) { mSrcCols = theCols; mSrcYRes = mSrcExtent.width() / mSrcCols; }
 
-    /** \brief Get source row and column indexes for current source extent and resolution
-        If source pixel is outside source extent theSrcRow and theSrcCol are left unchanged.
-        @return true if inside source
-     */
-    bool srcRowCol( int theDestRow, int theDestCol, int *theSrcRow, int *theSrcCol, const QgsCoordinateTransform& ct );
-
     int dstRows() const { return mDestRows; }
     int dstCols() const { return mDestCols; }
 
     /** \brief get destination point for _current_ destination position */
-    void destPointOnCPMatrix( int theRow, int theCol, double *theX, double *theY );
+    void destPointOnCPMatrix( int theRow, int theCol, double *theX, double *theY ) const;
 
     /** \brief Get matrix upper left row/col indexes for destination row/col */
-    int matrixRow( int theDestRow );
-    int matrixCol( int theDestCol );
+    int matrixRow( int theDestRow ) const;
+    int matrixCol( int theDestCol ) const;
 
     /** \brief get destination point for _current_ matrix position */
     QgsPoint srcPoint( int theRow, int theCol );
@@ -159,12 +158,22 @@ class CORE_EXPORT QgsRasterProjector : public QgsRasterInterface
     /** \brief Get precise source row and column indexes for current source extent and resolution */
     inline bool preciseSrcRowCol( int theDestRow, int theDestCol, int *theSrcRow, int *theSrcCol, const QgsCoordinateTransform& ct );
 
-    /** \brief Get approximate source row and column indexes for current source extent and resolution */
-    inline bool approximateSrcRowCol( int theDestRow, int theDestCol, int *theSrcRow, int *theSrcCol );
+    /** \brief Get approximate source row and column indexes for current source extent and resolution.
+     *  theHelperTop and theHelperBottom are the helper points (see calcHelper()) of the matrix rows
+     *  above and below the destination row */
+    inline bool approximateSrcRowCol( int theDestRow, int theDestCol, const QgsPoint* theHelperTop, const QgsPoint* theHelperBottom,
+                                      int *theSrcRow, int *theSrcCol ) const;
+
+    /** \brief Maps the destination rows theFirstRow to theLastRow (included) to source rows and columns, with the
+     *  approximation matrix. -1 is stored for destination pixels outside the source. Called from several threads */
+    void approximateSrcRowsCols( int theFirstRow, int theLastRow, int *theSrcRows, int *theSrcCols ) const;
 
     /** \brief Calculate matrix */
     void calc();
 
+    /** \brief Calculate the matrix and the source extent and size, without the matrix cache */
+    void calcGrid();
+
     /** \brief insert rows to matrix */
     void insertRows( const QgsCoordinateTransform& ct );
 
@@ -195,10 +204,13 @@ class CORE_EXPORT QgsRasterProjector : public QgsRasterInterface
     bool checkRows( const QgsCoordinateTransform& ct );
 
     /** Calculate array of src helper points */
-    void calcHelper( int theMatrixRow, QgsPoint *thePoints );
+    void calcHelper( int theMatrixRow, QgsPoint *thePoints ) const;
 
-    /** Calc / switch helper */
-    void nextHelper();
+    /** Key of the current approximation matrix in the matrix cache */
+    QString gridCacheKey() const;
+
+    /** Returns true if the matrix cache holds a matrix for the key */
+    static bool isGridCached( const QString& key );
 
     /** Get mCPMatrix as string */
     QString cpToString();
@@ -261,17 +273,6 @@ class CORE_EXPORT QgsRasterProjector : public QgsRasterInterface
     /* Same size as mCPMatrix */
     QList< QList<bool> > mCPLegalMatrix;
 
-    /** Array of source points for each destination column on top of current CPMatrix grid row */
-    /* Warning: using QList is slow on access */
-    QgsPoint *pHelperTop;
-
-    /** Array of source points for each destination column on bottom of current CPMatrix grid row */
-    /* Warning: using QList is slow on access */
-    QgsPoint *pHelperBottom;
-
-    /** Current mHelperTop matrix row */
-    int mHelperTopRow;
-
     /** Number of mCPMatrix columns */
     int mCPCols;
     /** Number of mCPMatrix rows */
@@ -290,6 +291,9 @@ class CORE_EXPORT QgsRasterProjector : public QgsRasterInterface
     /** Use approximation (requested precision is Approximate and it is possible to calculate
      *  an approximation matrix with a sufficient precision) */
     bool mApproximate;
+
+    friend class QgsRasterProjectorRowsMapping;
+    friend class TestQgsRasterProjector;
 };
 
 #endif
@@ -289,3 +289,46 @@ int QgsRasterRenderer::minMaxOriginFromName( const QString& theName )
   }
   return origin;
 }
+
+template <typename T>
+static bool integerLookupTableIndexes( const T* data, qgssize count, QVector<quint16>& indexes, int& minimum, int& size )
+{
+  T minValue = data[0];
+  T maxValue = data[0];
+  for ( qgssize i = 1; i < count; ++i )
+  {
+    minValue = qMin( minValue, data[i] );
+    maxValue = qMax( maxValue, data[i] );
+  }
+  minimum = minValue;
+  size = maxValue - minValue + 1;
+  if (( qgssize )size > count )
+    return false;
+
+  indexes.resize( count );
+  quint16* index = indexes.data();
+  for ( qgssize i = 0; i < count; ++i )
+  {
+    index[i] = data[i] - minValue;
+  }
+  return true;
+}
+
+bool QgsRasterRenderer::lookupTableIndexes( QgsRasterBlock* block, QVector<quint16>& indexes, int& minimum, int& size )
+{
+  if ( !block || block->isEmpty() )
+    return false;
+
+  qgssize count = ( qgssize )block->width() * block->height();
+  switch ( block->dataType() )
+  {
+    case QGis::Byte:
+      return integerLookupTableIndexes( reinterpret_cast< const quint8* >( block->bits() ), count, indexes, minimum, size );
+    case QGis::UInt16:
+      return integerLookupTableIndexes( reinterpret_cast< const quint16* >( block->bits() ), count, indexes, minimum, size );
+    case QGis::Int16:
+      return integerLookupTableIndexes( reinterpret_cast< const qint16* >( block->bits() ), count, indexes, minimum, size );
+    default:
+      return false;
+  }
+}
@@ -19,6 +19,7 @@
 #define QGSRASTERRENDERER_H
 
 #include <QPair>
+#include <QVector>
 
 #include "qgsrasterinterface.h"
 
@@ -104,6 +105,19 @@ class CORE_EXPORT QgsRasterRenderer : public QgsRasterInterface
     /** Write upper class info into rasterrenderer element (called by writeXml method of subclasses)*/
     void _writeXml( QDomDocument& doc, QDomElement& rasterRendererElem ) const;
 
+    /** Prepares the colors of a block to be calculated once per value through a lookup table instead of once
+     * per pixel. This is only possible for integer types of at most 16 bits (Byte, UInt16 and Int16). The
+     * table covers the values between the minimum and the maximum of the block, and is only worth it if
+     * it has fewer entries than the block has pixels.
+     * @param block input block
+     * @param indexes receives, for each pixel, the value minus the minimum, i.e. the table entry
+     * @param minimum receives the minimum value of the block
+     * @param size receives the number of table entries (maximum - minimum + 1)
+     * @return false if the block cannot or should not be mapped with a lookup table
+     * @note added in QGIS 3.0
+     */
+    static bool lookupTableIndexes( QgsRasterBlock* block, QVector<quint16>& indexes, int& minimum, int& size );
+
     QString mType;
 
     /** Global alpha value (0-1)*/
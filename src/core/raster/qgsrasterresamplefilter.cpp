@@ -26,6 +26,7 @@
 //resamplers
 #include "qgsbilinearrasterresampler.h"
 #include "qgscubicrasterresampler.h"
+#include "qgslanczosrasterresampler.h"
 
 #include <QDomDocument>
 #include <QDomElement>
@@ -262,10 +263,18 @@ void QgsRasterResampleFilter::readXml( const QDomElement& filterElem )
   {
     mZoomedInResampler = new QgsCubicRasterResampler();
   }
+  else if ( zoomedInResamplerType == "lanczos" )
+  {
+    mZoomedInResampler = new QgsLanczosRasterResampler();
+  }
 
   QString zoomedOutResamplerType = filterElem.attribute( "zoomedOutResampler" );
   if ( zoomedOutResamplerType == "bilinear" )
   {
     mZoomedOutResampler = new QgsBilinearRasterResampler();
   }
+  else if ( zoomedOutResamplerType == "lanczos" )
+  {
+    mZoomedOutResampler = new QgsLanczosRasterResampler();
+  }
 }
@@ -0,0 +1,255 @@
+/***************************************************************************
+                         qgsseparableresampler.cpp
+                         -------------------------
+    begin                : October 2016
+    copyright            : (C) 2016 by the QGIS project
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsseparableresampler.h"
+#include <QImage>
+#include <QList>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrentMap>
+#include <cmath>
+
+//! Minimum number of destination pixels resampled by one job
+static const int MIN_BAND_PIXELS = 64 * 1024;
+
+//! Source indexes and weights contributing to each destination index of one dimension
+struct QgsResamplingWeights
+{
+  //! First source index
+  QVector<int> first;
+  //! Number of source indexes
+  QVector<int> count;
+  //! maxCount weights per destination index, normalized to a sum of 1
+  QVector<float> weights;
+  int maxCount;
+};
+
+static void resamplingWeights( int srcSize, int dstSize, QgsSeparableResampler::Kernel kernel, double radius, bool stretch, QgsResamplingWeights& w )
+{
+  double scale = static_cast< double >( srcSize ) / dstSize;
+  double filterScale = ( stretch && scale > 1.0 ) ? scale : 1.0;
+  double support = radius * filterScale;
+
+  w.maxCount = 2 * static_cast< int >( std::ceil( support ) ) + 1;
+  w.first.resize( dstSize );
+  w.count.resize( dstSize );
+  w.weights.fill( 0.0, dstSize * w.maxCount );
+
+  QVector<double> sums( w.maxCount );
+  for ( int i = 0; i < dstSize; ++i )
+  {
+    double center = ( i + 0.5 ) * scale - 0.5;
+    int left = static_cast< int >( std::ceil( center - support ) );
+    int right = static_cast< int >( std::floor( center + support ) );
+    int first = qBound( 0, left, srcSize - 1 );
+    int last = qBound( 0, right, srcSize - 1 );
+
+    // source indexes outside of the image are replaced by the nearest edge pixel
+    sums.fill( 0.0 );
+    double total = 0.0;
+    for ( int j = left; j <= right; ++j )
+    {
+      double weight = kernel(( j - center ) / filterScale );
+      sums[ qBound( 0, j, srcSize - 1 ) - first ] += weight;
+      total += weight;
+    }
+
+    w.first[i] = first;
+    w.count[i] = last - first + 1;
+    float* weights = w.weights.data() + i * w.maxCount;
+    if ( qAbs( total ) < 1e-12 )
+    {
+      // no contribution at all, use the nearest pixel
+      w.first[i] = qBound( 0, static_cast< int >( std::floor( center + 0.5 ) ), srcSize - 1 );
+      w.count[i] = 1;
+      weights[0] = 1.0;
+      continue;
+    }
+    for ( int k = 0; k < w.count[i]; ++k )
+    {
+      weights[k] = sums[k] / total;
+    }
+  }
+}
+
+//! A band of destination rows
+struct QgsResamplingBand
+{
+  int firstRow;
+  //! one past the last row
+  int lastRow;
+};
+
+//! Resamples a band of destination rows, for QtConcurrent::blockingMap
+class QgsResamplingBandJob
+{
+  public:
+    QgsResamplingBandJob( const QImage& srcImage, uchar* dstBits, int dstBytesPerLine, int dstWidth,
+                          const QgsResamplingWeights& xWeights, const QgsResamplingWeights& yWeights )
+        : mSrcBits( srcImage.constBits() )
+        , mSrcBytesPerLine( srcImage.bytesPerLine() )
+        , mSrcWidth( srcImage.width() )
+        , mDstBits( dstBits )
+        , mDstBytesPerLine( dstBytesPerLine )
+        , mDstWidth( dstWidth )
+        , mX( xWeights )
+        , mY( yWeights )
+    {}
+
+    typedef void result_type;
+
+    void operator()( const QgsResamplingBand& band )
+    {
+      // first and last source indexes are non decreasing with the destination index
+      int srcFirstRow = mY.first[ band.firstRow ];
+      int srcLastRow = mY.first[ band.lastRow - 1 ] + mY.count[ band.lastRow - 1 ] - 1;
+      int rowLength = mDstWidth * 4;
+
+      // horizontal pass, on the source rows used by the band
+      QVector<float> srcRow( mSrcWidth * 4 );
+      QVector<float> filtered(( srcLastRow - srcFirstRow + 1 ) * rowLength );
+      for ( int srcRowIndex = srcFirstRow; srcRowIndex <= srcLastRow; ++srcRowIndex )
+      {
+        const QRgb* srcLine = reinterpret_cast< const QRgb* >( mSrcBits + srcRowIndex * mSrcBytesPerLine );
+        float* channels = srcRow.data();
+        for ( int x = 0; x < mSrcWidth; ++x )
+        {
+          QRgb px = srcLine[x];
+          channels[4 * x] = qRed( px );
+          channels[4 * x + 1] = qGreen( px );
+          channels[4 * x + 2] = qBlue( px );
+          channels[4 * x + 3] = qAlpha( px );
+        }
+
+        float* out = filtered.data() + ( srcRowIndex - srcFirstRow ) * rowLength;
+        for ( int x = 0; x < mDstWidth; ++x )
+        {
+          const float* weights = mX.weights.constData() + x * mX.maxCount;
+          const float* in = channels + 4 * mX.first[x];
+          int count = mX.count[x];
+          float r = 0, g = 0, b = 0, a = 0;
+          for ( int k = 0; k < count; ++k )
+          {
+            r += weights[k] * in[4 * k];
+            g += weights[k] * in[4 * k + 1];
+            b += weights[k] * in[4 * k + 2];
+            a += weights[k] * in[4 * k + 3];
+          }
+          out[4 * x] = r;
+          out[4 * x + 1] = g;
+          out[4 * x + 2] = b;
+          out[4 * x + 3] = a;
+        }
+      }
+
+      // vertical pass, on whole rows of channels
+      QVector<float> sum( rowLength );
+      for ( int row = band.firstRow; row < band.lastRow; ++row )
+      {
+        float* acc = sum.data();
+        for ( int i = 0; i < rowLength; ++i )
+          acc[i] = 0;
+
+        const float* weights = mY.weights.constData() + row * mY.maxCount;
+        int count = mY.count[row];
+        for ( int k = 0; k < count; ++k )
+        {
+          const float* in = filtered.constData() + ( mY.first[row] - srcFirstRow + k ) * rowLength;
+          float weight = weights[k];
+          for ( int i = 0; i < rowLength; ++i )
+            acc[i] += weight * in[i];
+        }
+
+        // negative lobes may produce values out of range, premultiplied components must not exceed alpha
+        QRgb* dstLine = reinterpret_cast< QRgb* >( mDstBits + row * mDstBytesPerLine );
+        for ( int x = 0; x < mDstWidth; ++x )
+        {
+          int a = qBound( 0, static_cast< int >( acc[4 * x + 3] + 0.5f ), 255 );
+          dstLine[x] = qRgba( qBound( 0, static_cast< int >( acc[4 * x] + 0.5f ), a ),
+                              qBound( 0, static_cast< int >( acc[4 * x + 1] + 0.5f ), a ),
+                              qBound( 0, static_cast< int >( acc[4 * x + 2] + 0.5f ), a ),
+                              a );
+        }
+      }
+    }
+
+  private:
+    const uchar* mSrcBits;
+    int mSrcBytesPerLine;
+    int mSrcWidth;
+    uchar* mDstBits;
+    int mDstBytesPerLine;
+    int mDstWidth;
+    const QgsResamplingWeights& mX;
+    const QgsResamplingWeights& mY;
+};
+
+QgsSeparableResampler::QgsSeparableResampler( Kernel kernel, double radius, bool stretchWhenDownsampling )
+    : mKernel( kernel )
+    , mRadius( radius )
+    , mStretchWhenDownsampling( stretchWhenDownsampling )
+{
+}
+
+void QgsSeparableResampler::resample( const QImage& srcImage, QImage& dstImage ) const
+{
+  int width = dstImage.width();
+  int height = dstImage.height();
+  if ( width <= 0 || height <= 0 || srcImage.width() <= 0 || srcImage.height() <= 0 )
+  {
+    return;
+  }
+
+  QImage src = srcImage.format() == QImage::Format_ARGB32_Premultiplied ? srcImage : srcImage.convertToFormat( QImage::Format_ARGB32_Premultiplied );
+  if ( src.width() == width && src.height() == height )
+  {
+    dstImage = src;
+    return;
+  }
+  if ( dstImage.format() != QImage::Format_ARGB32_Premultiplied )
+  {
+    dstImage = QImage( width, height, QImage::Format_ARGB32_Premultiplied );
+  }
+
+  QgsResamplingWeights xWeights;
+  resamplingWeights( src.width(), width, mKernel, mRadius, mStretchWhenDownsampling, xWeights );
+  QgsResamplingWeights yWeights;
+  resamplingWeights( src.height(), height, mKernel, mRadius, mStretchWhenDownsampling, yWeights );
+
+  // detach the destination image here, rows are written by several threads
+  uchar* dstBits = dstImage.bits();
+
+  int bandRows = qMax( 1, height / ( 4 * qMax( 1, QThread::idealThreadCount() ) ) );
+  bandRows = qMax( bandRows, MIN_BAND_PIXELS / width );
+  QList<QgsResamplingBand> bands;
+  for ( int firstRow = 0; firstRow < height; firstRow += bandRows )
+  {
+    QgsResamplingBand band;
+    band.firstRow = firstRow;
+    band.lastRow = qMin( firstRow + bandRows, height );
+    bands << band;
+  }
+
+  QgsResamplingBandJob job( src, dstBits, dstImage.bytesPerLine(), width, xWeights, yWeights );
+  if ( bands.size() > 1 )
+  {
+    QtConcurrent::blockingMap( bands, job );
+  }
+  else
+  {
+    job( bands.at( 0 ) );
+  }
+}
@@ -0,0 +1,58 @@
+/***************************************************************************
+                         qgsseparableresampler.h
+                         -----------------------
+    begin                : October 2016
+    copyright            : (C) 2016 by the QGIS project
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSSEPARABLERESAMPLER_H
+#define QGSSEPARABLERESAMPLER_H
+
+class QImage;
+
+/** \ingroup core
+ * Resamples premultiplied ARGB images with a separable convolution kernel.
+ *
+ * The kernel weights are computed once per destination column and row. Rows
+ * are first filtered horizontally, then vertically, so that both passes work
+ * on contiguous arrays of channels. Destination rows are processed in bands
+ * on several threads.
+ *
+ * When downsampling, the kernel can be stretched by the scale factor, so
+ * that every source pixel contributes to the result (antialiasing).
+ *
+ * @note added in QGIS 3.0
+ * @note not available in Python bindings
+ */
+class QgsSeparableResampler
+{
+  public:
+    //! Kernel function, zero outside [-radius, radius]
+    typedef double ( *Kernel )( double x );
+
+    /** Constructor
+     * @param kernel kernel function
+     * @param radius kernel support radius, in source pixels
+     * @param stretchWhenDownsampling whether to stretch the kernel by the scale factor when downsampling
+     */
+    QgsSeparableResampler( Kernel kernel, double radius, bool stretchWhenDownsampling );
+
+    //! Resample srcImage into dstImage, whose size is kept
+    void resample( const QImage& srcImage, QImage& dstImage ) const;
+
+  private:
+    Kernel mKernel;
+    double mRadius;
+    bool mStretchWhenDownsampling;
+};
+
+#endif // QGSSEPARABLERESAMPLER_H
@@ -124,47 +124,56 @@ QgsRasterBlock* QgsSingleBandGrayRenderer::block( int bandNo, QgsRectangle  cons
   }
 
   QRgb myDefaultColor = NODATA_COLOR;
-  for ( qgssize i = 0; i < ( qgssize )width*height; i++ )
+  QRgb* outputData = reinterpret_cast< QRgb* >( outputBlock->bits() );
+  qgssize count = ( qgssize )width * height;
+
+  //integer blocks are stretched through a table with the color of each value, unless an other band gives the alpha
+  QVector<quint16> indexes;
+  int lutMinimum, lutSize;
+  if (( !alphaBlock || alphaBlock == inputBlock ) && lookupTableIndexes( inputBlock, indexes, lutMinimum, lutSize ) )
   {
-    if ( inputBlock->isNoData( i ) )
+    QVector<QRgb> lut( lutSize );
+    for ( int v = 0; v < lutSize; ++v )
     {
-      outputBlock->setColor( i, myDefaultColor );
-      continue;
+      double grayVal = lutMinimum + v;
+      if (( inputBlock->hasNoDataValue() && inputBlock->isNoDataValue( grayVal ) )
+          || !valueColor( grayVal, alphaBlock ? grayVal : 255, lut[v] ) )
+      {
+        lut[v] = myDefaultColor;
+      }
     }
-    double grayVal = inputBlock->value( i );
 
-    double currentAlpha = mOpacity;
-    if ( mRasterTransparency )
+    //without a no data value, no data are given by a bitmap
+    bool checkNoDataBitmap = inputBlock->hasNoData() && !inputBlock->hasNoDataValue();
+    const QRgb* lutData = lut.constData();
+    const quint16* index = indexes.constData();
+    for ( qgssize i = 0; i < count; i++ )
     {
-      currentAlpha = mRasterTransparency->alphaValue( grayVal, mOpacity * 255 ) / 255.0;
+      outputData[i] = lutData[index[i]];
     }
-    if ( mAlphaBand > 0 )
+    if ( checkNoDataBitmap )
     {
-      currentAlpha *= alphaBlock->value( i ) / 255.0;
+      for ( qgssize i = 0; i < count; i++ )
+      {
+        if ( inputBlock->isNoData( i ) )
+          outputData[i] = myDefaultColor;
+      }
     }
-
-    if ( mContrastEnhancement )
+  }
+  else
+  {
+    for ( qgssize i = 0; i < count; i++ )
     {
-      if ( !mContrastEnhancement->isValueInDisplayableRange( grayVal ) )
+      if ( inputBlock->isNoData( i ) )
       {
-        outputBlock->setColor( i, myDefaultColor );
+        outputData[i] = myDefaultColor;
         continue;
       }
-      grayVal = mContrastEnhancement->enhanceContrast( grayVal );
-    }
-
-    if ( mGradient == WhiteToBlack )
-    {
-      grayVal = 255 - grayVal;
-    }
-
-    if ( qgsDoubleNear( currentAlpha, 1.0 ) )
-    {
-      outputBlock->setColor( i, qRgba( grayVal, grayVal, grayVal, 255 ) );
-    }
-    else
-    {
-      outputBlock->setColor( i, qRgba( currentAlpha * grayVal, currentAlpha * grayVal, currentAlpha * grayVal, currentAlpha * 255 ) );
+      double grayVal = inputBlock->value( i );
+      if ( !valueColor( grayVal, alphaBlock ? alphaBlock->value( i ) : 255, outputData[i] ) )
+      {
+        outputData[i] = myDefaultColor;
+      }
     }
   }
 
@@ -177,6 +186,43 @@ QgsRasterBlock* QgsSingleBandGrayRenderer::block( int bandNo, QgsRectangle  cons
   return outputBlock;
 }
 
+bool QgsSingleBandGrayRenderer::valueColor( double grayVal, double alphaValue, QRgb& color ) const
+{
+  double currentAlpha = mOpacity;
+  if ( mRasterTransparency )
+  {
+    currentAlpha = mRasterTransparency->alphaValue( grayVal, mOpacity * 255 ) / 255.0;
+  }
+  if ( mAlphaBand > 0 )
+  {
+    currentAlpha *= alphaValue / 255.0;
+  }
+
+  if ( mContrastEnhancement )
+  {
+    if ( !mContrastEnhancement->isValueInDisplayableRange( grayVal ) )
+    {
+      return false;
+    }
+    grayVal = mContrastEnhancement->enhanceContrast( grayVal );
+  }
+
+  if ( mGradient == WhiteToBlack )
+  {
+    grayVal = 255 - grayVal;
+  }
+
+  if ( qgsDoubleNear( currentAlpha, 1.0 ) )
+  {
+    color = qRgba( grayVal, grayVal, grayVal, 255 );
+  }
+  else
+  {
+    color = qRgba( currentAlpha * grayVal, currentAlpha * grayVal, currentAlpha * grayVal, currentAlpha * 255 );
+  }
+  return true;
+}
+
 void QgsSingleBandGrayRenderer::writeXml( QDomDocument& doc, QDomElement& parentElem ) const
 {
   if ( parentElem.isNull() )
@@ -63,6 +63,10 @@ class CORE_EXPORT QgsSingleBandGrayRenderer: public QgsRasterRenderer
     Gradient mGradient;
     QgsContrastEnhancement* mContrastEnhancement;
 
+    /** Calculates the premultiplied color of a value, stretched and with the opacity and the value transparency applied.
+     * alphaValue is the value of the alpha band, if any. Returns false if the value is out of the displayable range*/
+    bool valueColor( double grayVal, double alphaValue, QRgb& color ) const;
+
     QgsSingleBandGrayRenderer( const QgsSingleBandGrayRenderer& );
     const QgsSingleBandGrayRenderer& operator=( const QgsSingleBandGrayRenderer& );
 };
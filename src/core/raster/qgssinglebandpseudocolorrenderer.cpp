@@ -154,48 +154,79 @@ QgsRasterBlock* QgsSingleBandPseudoColorRenderer::block( int bandNo, QgsRectangl
   }
 
   QRgb myDefaultColor = NODATA_COLOR;
+  QRgb* outputData = reinterpret_cast< QRgb* >( outputBlock->bits() );
+  qgssize count = ( qgssize )width * height;
 
-  for ( qgssize i = 0; i < ( qgssize )width*height; i++ )
+  //integer blocks are colored through a table with the color of each value, unless an other band gives the alpha
+  QVector<quint16> indexes;
+  int lutMinimum, lutSize;
+  if (( !alphaBlock || alphaBlock == inputBlock ) && lookupTableIndexes( inputBlock, indexes, lutMinimum, lutSize ) )
   {
-    if ( inputBlock->isNoData( i ) )
+    QVector<QRgb> lut( lutSize );
+    for ( int v = 0; v < lutSize; ++v )
     {
-      outputBlock->setColor( i, myDefaultColor );
-      continue;
-    }
-    double val = inputBlock->value( i );
-    int red, green, blue, alpha;
-    if ( !mShader->shade( val, &red, &green, &blue, &alpha ) )
-    {
-      outputBlock->setColor( i, myDefaultColor );
-      continue;
+      double val = lutMinimum + v;
+      if ( inputBlock->hasNoDataValue() && inputBlock->isNoDataValue( val ) )
+      {
+        lut[v] = myDefaultColor;
+        continue;
+      }
+      if ( !valueColor( val, alphaBlock ? val : 255, hasTransparency, lut[v] ) )
+      {
+        lut[v] = myDefaultColor;
+      }
     }
 
-    if ( alpha < 255 )
+    //without a no data value, no data are given by a bitmap
+    bool checkNoDataBitmap = inputBlock->hasNoData() && !inputBlock->hasNoDataValue();
+    const QRgb* lutData = lut.constData();
+    const quint16* index = indexes.constData();
+    for ( qgssize i = 0; i < count; i++ )
     {
-      // Working with premultiplied colors, so multiply values by alpha
-      red *= ( alpha / 255.0 );
-      blue *= ( alpha / 255.0 );
-      green *= ( alpha / 255.0 );
+      outputData[i] = lutData[index[i]];
     }
-
-    if ( !hasTransparency )
+    if ( checkNoDataBitmap )
     {
-      outputBlock->setColor( i, qRgba( red, green, blue, alpha ) );
+      for ( qgssize i = 0; i < count; i++ )
+      {
+        if ( inputBlock->isNoData( i ) )
+          outputData[i] = myDefaultColor;
+      }
     }
-    else
+  }
+  else
+  {
+    //neighbour pixels often have the same value, e.g. in classified rasters
+    bool lastValid = false;
+    double lastVal = 0;
+    QRgb lastColor = myDefaultColor;
+    for ( qgssize i = 0; i < count; i++ )
     {
-      //opacity
-      double currentOpacity = mOpacity;
-      if ( mRasterTransparency )
+      if ( inputBlock->isNoData( i ) )
       {
-        currentOpacity = mRasterTransparency->alphaValue( val, mOpacity * 255 ) / 255.0;
+        outputData[i] = myDefaultColor;
+        continue;
       }
-      if ( mAlphaBand > 0 )
+      double val = inputBlock->value( i );
+      if ( alphaBlock && alphaBlock != inputBlock )
       {
-        currentOpacity *= alphaBlock->value( i ) / 255.0;
+        if ( !valueColor( val, alphaBlock->value( i ), hasTransparency, outputData[i] ) )
+        {
+          outputData[i] = myDefaultColor;
+        }
+        continue;
       }
 
-      outputBlock->setColor( i, qRgba( currentOpacity * red, currentOpacity * green, currentOpacity * blue, currentOpacity * alpha ) );
+      if ( !lastValid || val != lastVal )
+      {
+        if ( !valueColor( val, alphaBlock ? val : 255, hasTransparency, lastColor ) )
+        {
+          lastColor = myDefaultColor;
+        }
+        lastVal = val;
+        lastValid = true;
+      }
+      outputData[i] = lastColor;
     }
   }
 
@@ -208,6 +239,44 @@ QgsRasterBlock* QgsSingleBandPseudoColorRenderer::block( int bandNo, QgsRectangl
   return outputBlock;
 }
 
+bool QgsSingleBandPseudoColorRenderer::valueColor( double val, double alphaValue, bool hasTransparency, QRgb& color ) const
+{
+  int red, green, blue, alpha;
+  if ( !mShader->shade( val, &red, &green, &blue, &alpha ) )
+  {
+    return false;
+  }
+
+  if ( alpha < 255 )
+  {
+    // Working with premultiplied colors, so multiply values by alpha
+    red *= ( alpha / 255.0 );
+    blue *= ( alpha / 255.0 );
+    green *= ( alpha / 255.0 );
+  }
+
+  if ( !hasTransparency )
+  {
+    color = qRgba( red, green, blue, alpha );
+  }
+  else
+  {
+    //opacity
+    double currentOpacity = mOpacity;
+    if ( mRasterTransparency )
+    {
+      currentOpacity = mRasterTransparency->alphaValue( val, mOpacity * 255 ) / 255.0;
+    }
+    if ( mAlphaBand > 0 )
+    {
+      currentOpacity *= alphaValue / 255.0;
+    }
+
+    color = qRgba( currentOpacity * red, currentOpacity * green, currentOpacity * blue, currentOpacity * alpha );
+  }
+  return true;
+}
+
 void QgsSingleBandPseudoColorRenderer::writeXml( QDomDocument& doc, QDomElement& parentElem ) const
 {
   if ( parentElem.isNull() )
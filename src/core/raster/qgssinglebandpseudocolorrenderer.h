@@ -79,6 +79,10 @@ class CORE_EXPORT QgsSingleBandPseudoColorRenderer: public QgsRasterRenderer
 
     int mClassificationMinMaxOrigin;
 
+    /** Calculates the premultiplied color of a value, with the opacity and the value transparency applied.
+     * alphaValue is the value of the alpha band, if any. Returns false if the shader gives no color*/
+    bool valueColor( double val, double alphaValue, bool hasTransparency, QRgb& color ) const;
+
     QgsSingleBandPseudoColorRenderer( const QgsSingleBandPseudoColorRenderer& );
     const QgsSingleBandPseudoColorRenderer& operator=( const QgsSingleBandPseudoColorRenderer& );
 };
@@ -30,13 +30,176 @@
 
 #include <QDomDocument>
 #include <QDomElement>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QtConcurrentMap>
+#include <qmath.h>
+
+#include <algorithm>
+#include <cstring>
+
+//! Maximum number of cells of a cached density grid
+static const int MAX_CACHE_CELLS = 4 * 1024 * 1024;
+
+/** Densities of the last grid accumulated by a renderer, shared by its clones. The points
+ * within the radius of a later render are compared with the cached points before reusing them.
+ */
+class QgsHeatmapDensityCache
+{
+  public:
+    QgsHeatmapDensityCache()
+        : cellSize( 0 )
+        , radius( 0 )
+        , column( 0 )
+        , row( 0 )
+        , columns( 0 )
+        , rows( 0 )
+    {}
+
+    //! Returns true if the grid was accumulated with the same settings and covers a range of cells
+    bool covers( double cellSize, int radius, const QString& weightExpression,
+                 qint64 firstColumn, qint64 firstRow, int nColumns, int nRows ) const
+    {
+      return !values.isEmpty() && qgsDoubleNear( this->cellSize, cellSize, cellSize * 1e-9 )
+             && this->radius == radius && this->weightExpression == weightExpression
+             && firstColumn >= column && firstColumn + nColumns <= column + columns
+             && firstRow >= row && firstRow + nRows <= row + rows;
+    }
+
+    //! Returns true if a point is within a range of cells
+    static bool contains( const QgsHeatmapRenderer::DensityPoint& point, qint64 firstColumn, qint64 firstRow, qint64 lastColumn, qint64 lastRow )
+    {
+      return point.column >= firstColumn && point.column <= lastColumn && point.row >= firstRow && point.row <= lastRow;
+    }
+
+    //! Order independent hash of the points within a range of cells, with their count
+    static QPair<quint64, int> pointsHash( const QVector<QgsHeatmapRenderer::DensityPoint>& points,
+                                           qint64 firstColumn, qint64 firstRow, qint64 lastColumn, qint64 lastRow )
+    {
+      quint64 hash = 0;
+      int count = 0;
+      for ( int i = 0; i < points.size(); ++i )
+      {
+        const QgsHeatmapRenderer::DensityPoint& point = points.at( i );
+        if ( !contains( point, firstColumn, firstRow, lastColumn, lastRow ) )
+        {
+          continue;
+        }
+        quint64 weightBits;
+        memcpy( &weightBits, &point.weight, sizeof( weightBits ) );
+        // splitmix64 finalizer of the cell and weight, summed so that the order of the points does not matter
+        quint64 h = static_cast< quint64 >( point.column ) * Q_UINT64_C( 0x9E3779B97F4A7C15 ) ^ static_cast< quint64 >( point.row ) * Q_UINT64_C( 0xC2B2AE3D27D4EB4F ) ^ weightBits;
+        h = ( h ^ ( h >> 30 ) ) * Q_UINT64_C( 0xBF58476D1CE4E5B9 );
+        h = ( h ^ ( h >> 27 ) ) * Q_UINT64_C( 0x94D049BB133111EB );
+        hash += h ^ ( h >> 31 );
+        ++count;
+      }
+      return qMakePair( hash, count );
+    }
+
+    static bool rowLessThan( const QgsHeatmapRenderer::DensityPoint& a, const QgsHeatmapRenderer::DensityPoint& b )
+    {
+      return a.row < b.row;
+    }
+
+    QMutex mutex;
+    double cellSize;
+    int radius;
+    QString weightExpression;
+    qint64 column;
+    qint64 row;
+    int columns;
+    int rows;
+    QVector<double> values;
+    //! points within the radius of the grid
+    QVector<QgsHeatmapRenderer::DensityPoint> points;
+};
+
+//! A band of grid rows
+struct QgsHeatmapBand
+{
+  int firstRow;
+  //! one past the last row
+  int lastRow;
+};
+
+//! Adds the kernel masks of the points reaching a band of grid rows, for QtConcurrent::blockingMap
+class QgsHeatmapBandJob
+{
+  public:
+    QgsHeatmapBandJob( const QVector<QgsHeatmapRenderer::DensityPoint>& points, const QVector<double>& mask, const QVector<int>& halfWidth,
+                       int radius, qint64 gridColumn, qint64 gridRow, int columns, double* values )
+        : mPoints( points )
+        , mMask( mask )
+        , mHalfWidth( halfWidth )
+        , mRadius( radius )
+        , mGridColumn( gridColumn )
+        , mGridRow( gridRow )
+        , mColumns( columns )
+        , mValues( values )
+    {}
+
+    typedef void result_type;
+
+    void operator()( const QgsHeatmapBand& band )
+    {
+      // points are sorted by row, only those within the radius of the band reach it
+      QgsHeatmapRenderer::DensityPoint first;
+      first.row = mGridRow + band.firstRow - mRadius;
+      QVector<QgsHeatmapRenderer::DensityPoint>::const_iterator it = std::lower_bound( mPoints.constBegin(), mPoints.constEnd(), first, QgsHeatmapDensityCache::rowLessThan );
+      int width = 2 * mRadius + 1;
+      for ( ; it != mPoints.constEnd() && it->row - mGridRow < band.lastRow + mRadius; ++it )
+      {
+        int pointColumn = static_cast< int >( it->column - mGridColumn );
+        int pointRow = static_cast< int >( it->row - mGridRow );
+        int firstRow = qMax( band.firstRow, pointRow - mRadius );
+        int lastRow = qMin( band.lastRow - 1, pointRow + mRadius );
+        for ( int row = firstRow; row <= lastRow; ++row )
+        {
+          int dy = row - pointRow;
+          int halfWidth = mHalfWidth[ dy + mRadius ];
+          int firstColumn = qMax( 0, pointColumn - halfWidth );
+          int lastColumn = qMin( mColumns - 1, pointColumn + halfWidth );
+          const double* mask = mMask.constData() + ( dy + mRadius ) * width + mRadius;
+          double* value = mValues + row * mColumns;
+          for ( int column = firstColumn; column <= lastColumn; ++column )
+          {
+            value[column] += it->weight * mask[ column - pointColumn ];
+          }
+        }
+      }
+    }
+
+  private:
+    const QVector<QgsHeatmapRenderer::DensityPoint>& mPoints;
+    const QVector<double>& mMask;
+    const QVector<int>& mHalfWidth;
+    int mRadius;
+    qint64 mGridColumn;
+    qint64 mGridRow;
+    int mColumns;
+    double* mValues;
+};
 
 QgsHeatmapRenderer::QgsHeatmapRenderer()
     : QgsFeatureRendererV2( "heatmapRenderer" )
-    , mCalculatedMaxValue( 0 )
+    , mDensityCache( new QgsHeatmapDensityCache() )
+    , mDensityCacheMargin( 0.0 )
+    , mAlignedGrid( false )
+    , mCellSize( 0 )
+    , mGridColumn( 0 )
+    , mGridRow( 0 )
+    , mGridColumns( 0 )
+    , mGridRows( 0 )
+    , mVisibleColumn( 0 )
+    , mVisibleRow( 0 )
+    , mVisibleColumns( 0 )
+    , mVisibleRows( 0 )
+    , mCacheCandidate( false )
     , mRadius( 10 )
     , mRadiusPixels( 0 )
-    , mRadiusSquared( 0 )
     , mRadiusUnit( QgsSymbolV2::MM )
     , mWeightAttrNum( -1 )
     , mGradientRamp( nullptr )
@@ -56,12 +219,67 @@ QgsHeatmapRenderer::~QgsHeatmapRenderer()
 
 void QgsHeatmapRenderer::initializeValues( QgsRenderContext& context )
 {
-  mValues.resize( context.painter()->device()->width() * context.painter()->device()->height() / ( mRenderQuality * mRenderQuality ) );
-  mValues.fill( 0 );
-  mCalculatedMaxValue = 0;
+  mPoints.clear();
   mFeaturesRendered = 0;
   mRadiusPixels = qRound( mRadius * QgsSymbolLayerV2Utils::pixelSizeScaleFactor( context, mRadiusUnit, mRadiusMapUnitScale ) / mRenderQuality );
-  mRadiusSquared = mRadiusPixels * mRadiusPixels;
+
+  int width = context.painter()->device()->width() / mRenderQuality;
+  int height = context.painter()->device()->height() / mRenderQuality;
+  mVisibleColumn = 0;
+  mVisibleRow = 0;
+  mVisibleColumns = width;
+  mVisibleRows = height;
+  mGridColumn = 0;
+  mGridRow = 0;
+  mGridColumns = width;
+  mGridRows = height;
+  mCacheCandidate = false;
+
+  // densities can only be shared by renders on the same grid of map units
+  const QgsMapToPixel& mtp = context.mapToPixel();
+  mAlignedGrid = qgsDoubleNear( mtp.mapRotation(), 0.0 ) && !context.coordinateTransform().isValid()
+                 && mtp.mapUnitsPerPixel() > 0 && width > 0 && height > 0;
+  if ( !mAlignedGrid )
+  {
+    return;
+  }
+
+  mCellSize = mtp.mapUnitsPerPixel() * mRenderQuality;
+  QgsPoint topLeft = mtp.toMapCoordinatesF( 0, 0 );
+  {
+    QMutexLocker locker( &mDensityCache->mutex );
+    // use exactly the cached cell size, so that points fall in the same cells
+    if ( qgsDoubleNear( mDensityCache->cellSize, mCellSize, mCellSize * 1e-9 ) )
+    {
+      mCellSize = mDensityCache->cellSize;
+    }
+    // cells containing the centers of the image cells
+    mVisibleColumn = static_cast< qint64 >( floor( topLeft.x() / mCellSize + 0.5 ) );
+    mVisibleRow = static_cast< qint64 >( floor( -topLeft.y() / mCellSize + 0.5 ) );
+
+    if ( mDensityCache->covers( mCellSize, mRadiusPixels, mWeightExpressionString, mVisibleColumn, mVisibleRow, mVisibleColumns, mVisibleRows ) )
+    {
+      mCacheCandidate = true;
+      mGridColumn = mDensityCache->column;
+      mGridRow = mDensityCache->row;
+      mGridColumns = mDensityCache->columns;
+      mGridRows = mDensityCache->rows;
+      return;
+    }
+  }
+
+  // a new grid, with a margin around the image if it fits in the cache
+  int columnMargin = qMax( 0, qCeil( mDensityCacheMargin * mVisibleColumns ) );
+  int rowMargin = qMax( 0, qCeil( mDensityCacheMargin * mVisibleRows ) );
+  if ( static_cast< qint64 >( mVisibleColumns + 2 * columnMargin ) * ( mVisibleRows + 2 * rowMargin ) > MAX_CACHE_CELLS )
+  {
+    columnMargin = 0;
+    rowMargin = 0;
+  }
+  mGridColumn = mVisibleColumn - columnMargin;
+  mGridRow = mVisibleRow - rowMargin;
+  mGridColumns = mVisibleColumns + 2 * columnMargin;
+  mGridRows = mVisibleRows + 2 * rowMargin;
 }
 
 void QgsHeatmapRenderer::startRender( QgsRenderContext& context, const QgsFields& fields )
@@ -138,9 +356,6 @@ bool QgsHeatmapRenderer::renderFeature( QgsFeature& feature, QgsRenderContext& c
     }
   }
 
-  int width = context.painter()->device()->width() / mRenderQuality;
-  int height = context.painter()->device()->height() / mRenderQuality;
-
   //transform geometry if required
   QgsGeometry* transformedGeom = nullptr;
   QgsCoordinateTransform xform = context.coordinateTransform();
@@ -156,36 +371,30 @@ bool QgsHeatmapRenderer::renderFeature( QgsFeature& feature, QgsRenderContext& c
   delete transformedGeom;
   transformedGeom = nullptr;
 
-  //loop through all points in multipoint
+  //loop through all points in multipoint, points are accumulated on the grid in stopRender()
   for ( QgsMultiPoint::const_iterator pointIt = multiPoint.constBegin(); pointIt != multiPoint.constEnd(); ++pointIt )
   {
-    QgsPoint pixel = context.mapToPixel().transform( *pointIt );
-    int pointX = pixel.x() / mRenderQuality;
-    int pointY = pixel.y() / mRenderQuality;
-    for ( int x = qMax( pointX - mRadiusPixels, 0 ); x < qMin( pointX + mRadiusPixels, width ); ++x )
+    DensityPoint point;
+    point.weight = weight;
+    if ( mAlignedGrid )
     {
-      for ( int y = qMax( pointY - mRadiusPixels, 0 ); y < qMin( pointY + mRadiusPixels, height ); ++y )
-      {
-        int index = y * width + x;
-        if ( index >= mValues.count() )
-        {
-          continue;
-        }
-        double distanceSquared = pow( pointX - x, 2.0 ) + pow( pointY - y, 2.0 );
-        if ( distanceSquared > mRadiusSquared )
-        {
-          continue;
-        }
+      point.column = static_cast< qint64 >( floor( pointIt->x() / mCellSize ) );
+      point.row = static_cast< qint64 >( floor( -pointIt->y() / mCellSize ) );
+    }
+    else
+    {
+      QgsPoint pixel = context.mapToPixel().transform( *pointIt );
+      point.column = static_cast< qint64 >( floor( pixel.x() / mRenderQuality ) );
+      point.row = static_cast< qint64 >( floor( pixel.y() / mRenderQuality ) );
+    }
 
-        double score = weight * quarticKernel( sqrt( distanceSquared ), mRadiusPixels );
-        double value = mValues.at( index ) + score;
-        if ( value > mCalculatedMaxValue )
-        {
-          mCalculatedMaxValue = value;
-        }
-        mValues[ index ] = value;
-      }
+    // skip points which cannot reach the grid
+    if ( point.column < mGridColumn - mRadiusPixels || point.column >= mGridColumn + mGridColumns + mRadiusPixels
+         || point.row < mGridRow - mRadiusPixels || point.row >= mGridRow + mGridRows + mRadiusPixels )
+    {
+      continue;
     }
+    mPoints << point;
   }
 
   mFeaturesRendered++;
@@ -193,7 +402,7 @@ bool QgsHeatmapRenderer::renderFeature( QgsFeature& feature, QgsRenderContext& c
   //TODO - enable progressive rendering
   if ( mFeaturesRendered % 200  == 0 )
   {
-    renderImage( context );
+    renderImage( context, accumulate() );
   }
 #endif
   return true;
@@ -229,11 +438,136 @@ double QgsHeatmapRenderer::triangularKernel( const double distance, const int ba
 
 void QgsHeatmapRenderer::stopRender( QgsRenderContext& context )
 {
-  renderImage( context );
+  if ( context.painter() )
+  {
+    renderImage( context, densities() );
+  }
+  mPoints.clear();
   mWeightExpression.reset();
 }
 
-void QgsHeatmapRenderer::renderImage( QgsRenderContext& context )
+QVector<double> QgsHeatmapRenderer::densities()
+{
+  if ( mCacheCandidate )
+  {
+    // the cached densities are still valid if the points within the radius of the image did not change
+    qint64 firstColumn = mVisibleColumn - mRadiusPixels;
+    qint64 firstRow = mVisibleRow - mRadiusPixels;
+    qint64 lastColumn = mVisibleColumn + mVisibleColumns - 1 + mRadiusPixels;
+    qint64 lastRow = mVisibleRow + mVisibleRows - 1 + mRadiusPixels;
+    QPair<quint64, int> hash = QgsHeatmapDensityCache::pointsHash( mPoints, firstColumn, firstRow, lastColumn, lastRow );
+
+    QMutexLocker locker( &mDensityCache->mutex );
+    // another clone may have replaced the cached grid since startRender()
+    bool sameGrid = mDensityCache->covers( mCellSize, mRadiusPixels, mWeightExpressionString, mGridColumn, mGridRow, mGridColumns, mGridRows )
+                    && mDensityCache->column == mGridColumn && mDensityCache->row == mGridRow
+                    && mDensityCache->columns == mGridColumns && mDensityCache->rows == mGridRows;
+    if ( sameGrid && QgsHeatmapDensityCache::pointsHash( mDensityCache->points, firstColumn, firstRow, lastColumn, lastRow ) == hash )
+    {
+      return mDensityCache->values;
+    }
+
+    if ( sameGrid )
+    {
+      // only points around the image were read, the grid keeps the cached points of its margin
+      QVector<DensityPoint> points;
+      for ( int i = 0; i < mDensityCache->points.size(); ++i )
+      {
+        if ( !QgsHeatmapDensityCache::contains( mDensityCache->points.at( i ), firstColumn, firstRow, lastColumn, lastRow ) )
+        {
+          points << mDensityCache->points.at( i );
+        }
+      }
+      for ( int i = 0; i < mPoints.size(); ++i )
+      {
+        if ( QgsHeatmapDensityCache::contains( mPoints.at( i ), firstColumn, firstRow, lastColumn, lastRow ) )
+        {
+          points << mPoints.at( i );
+        }
+      }
+      mPoints = points;
+    }
+    else
+    {
+      // the points of the margin are unknown, the grid is reduced to the image
+      mGridColumn = mVisibleColumn;
+      mGridRow = mVisibleRow;
+      mGridColumns = mVisibleColumns;
+      mGridRows = mVisibleRows;
+    }
+  }
+
+  QVector<double> values = accumulate();
+
+  if ( mAlignedGrid && static_cast< qint64 >( mGridColumns ) * mGridRows <= MAX_CACHE_CELLS )
+  {
+    QMutexLocker locker( &mDensityCache->mutex );
+    mDensityCache->cellSize = mCellSize;
+    mDensityCache->radius = mRadiusPixels;
+    mDensityCache->weightExpression = mWeightExpressionString;
+    mDensityCache->column = mGridColumn;
+    mDensityCache->row = mGridRow;
+    mDensityCache->columns = mGridColumns;
+    mDensityCache->rows = mGridRows;
+    mDensityCache->values = values;
+    mDensityCache->points = mPoints;
+  }
+  return values;
+}
+
+QVector<double> QgsHeatmapRenderer::accumulate() const
+{
+  QVector<double> values( mGridColumns * mGridRows, 0.0 );
+  if ( mRadiusPixels <= 0 || mPoints.isEmpty() || values.isEmpty() )
+  {
+    return values;
+  }
+
+  // kernel mask, calculated once for all points
+  int width = 2 * mRadiusPixels + 1;
+  QVector<double> mask( width * width, 0.0 );
+  QVector<int> halfWidth( width, 0 );
+  for ( int dy = -mRadiusPixels; dy <= mRadiusPixels; ++dy )
+  {
+    for ( int dx = -mRadiusPixels; dx <= mRadiusPixels; ++dx )
+    {
+      int distanceSquared = dx * dx + dy * dy;
+      if ( distanceSquared > mRadiusPixels * mRadiusPixels )
+      {
+        continue;
+      }
+      halfWidth[ dy + mRadiusPixels ] = qMax( halfWidth[ dy + mRadiusPixels ], qAbs( dx ) );
+      mask[( dy + mRadiusPixels ) * width + dx + mRadiusPixels ] = quarticKernel( sqrt( static_cast< double >( distanceSquared ) ), mRadiusPixels );
+    }
+  }
+
+  QVector<DensityPoint> points = mPoints;
+  std::stable_sort( points.begin(), points.end(), QgsHeatmapDensityCache::rowLessThan );
+
+  // bands of rows are accumulated by several threads, each band only writes its own rows
+  int bandRows = qMax( 1, mGridRows / ( 4 * qMax( 1, QThread::idealThreadCount() ) ) );
+  QList<QgsHeatmapBand> bands;
+  for ( int firstRow = 0; firstRow < mGridRows; firstRow += bandRows )
+  {
+    QgsHeatmapBand band;
+    band.firstRow = firstRow;
+    band.lastRow = qMin( firstRow + bandRows, mGridRows );
+    bands << band;
+  }
+
+  QgsHeatmapBandJob job( points, mask, halfWidth, mRadiusPixels, mGridColumn, mGridRow, mGridColumns, values.data() );
+  if ( bands.size() > 1 )
+  {
+    QtConcurrent::blockingMap( bands, job );
+  }
+  else
+  {
+    job( bands.at( 0 ) );
+  }
+  return values;
+}
+
+void QgsHeatmapRenderer::renderImage( QgsRenderContext& context, const QVector<double>& values )
 {
   if ( !context.painter() || !mGradientRamp )
   {
@@ -245,24 +579,49 @@ void QgsHeatmapRenderer::renderImage( QgsRenderContext& context )
                 QImage::Format_ARGB32 );
   image.fill( Qt::transparent );
 
-  double scaleMax = mExplicitMax > 0 ? mExplicitMax : mCalculatedMaxValue;
+  // grid cells of the image columns and rows, the image starts at the first visible cell of the grid
+  QVector<int> columns( image.width() );
+  for ( int widthIndex = 0; widthIndex < image.width(); ++widthIndex )
+  {
+    columns[ widthIndex ] = static_cast< int >( mVisibleColumn - mGridColumn ) + widthIndex;
+  }
+  QVector<int> rows( image.height() );
+  for ( int heightIndex = 0; heightIndex < image.height(); ++heightIndex )
+  {
+    rows[ heightIndex ] = static_cast< int >( mVisibleRow - mGridRow ) + heightIndex;
+  }
+
+  double calculatedMaxValue = 0;
+  if ( mExplicitMax <= 0 )
+  {
+    for ( int heightIndex = 0; heightIndex < image.height(); ++heightIndex )
+    {
+      const double* row = values.constData() + rows.at( heightIndex ) * mGridColumns;
+      for ( int widthIndex = 0; widthIndex < image.width(); ++widthIndex )
+      {
+        calculatedMaxValue = qMax( calculatedMaxValue, row[ columns.at( widthIndex )] );
+      }
+    }
+  }
+  double scaleMax = mExplicitMax > 0 ? mExplicitMax : calculatedMaxValue;
 
-  int idx = 0;
   double pixVal = 0;
   QColor pixColor;
   for ( int heightIndex = 0; heightIndex < image.height(); ++heightIndex )
   {
     QRgb* scanLine = reinterpret_cast< QRgb* >( image.scanLine( heightIndex ) );
+    const double* row = values.constData() + rows.at( heightIndex ) * mGridColumns;
     for ( int widthIndex = 0; widthIndex < image.width(); ++widthIndex )
     {
+      double value = row[ columns.at( widthIndex )];
+
       //scale result to fit in the range [0, 1]
-      pixVal = mValues.at( idx ) > 0 ? qMin(( mValues.at( idx ) / scaleMax ), 1.0 ) : 0;
+      pixVal = value > 0 ? qMin(( value / scaleMax ), 1.0 ) : 0;
 
       //convert value to color from ramp
       pixColor = mGradientRamp->color( mInvertRamp ? 1 - pixVal : pixVal );
 
       scanLine[widthIndex] = pixColor.rgba();
-      idx++;
     }
   }
 
@@ -297,6 +656,8 @@ QgsHeatmapRenderer* QgsHeatmapRenderer::clone() const
   newRenderer->setMaximumValue( mExplicitMax );
   newRenderer->setRenderQuality( mRenderQuality );
   newRenderer->setWeightExpression( mWeightExpressionString );
+  newRenderer->setDensityCacheMargin( mDensityCacheMargin );
+  newRenderer->mDensityCache = mDensityCache;
   copyRendererData( newRenderer );
 
   return newRenderer;
@@ -320,10 +681,23 @@ void QgsHeatmapRenderer::modifyRequestExtent( QgsRectangle &extent, QgsRenderCon
   {
     extension = mRadius;
   }
+  if ( mAlignedGrid )
+  {
+    // a few more cells, points of the cells within the radius of the image are compared with the cached points
+    extension += 3 * mCellSize;
+  }
   extent.setXMinimum( extent.xMinimum() - extension );
   extent.setXMaximum( extent.xMaximum() + extension );
   extent.setYMinimum( extent.yMinimum() - extension );
   extent.setYMaximum( extent.yMaximum() + extension );
+
+  if ( mAlignedGrid && !mCacheCandidate )
+  {
+    // read the points of the whole grid which is cached, including its margin
+    QgsRectangle gridExtent( mGridColumn * mCellSize - extension, -( mGridRow + mGridRows ) * mCellSize - extension,
+                             ( mGridColumn + mGridColumns ) * mCellSize + extension, -mGridRow * mCellSize + extension );
+    extent.combineExtentWith( gridExtent );
+  }
 }
 
 QgsFeatureRendererV2* QgsHeatmapRenderer::create( QDomElement& element )
@@ -335,6 +709,7 @@ QgsFeatureRendererV2* QgsHeatmapRenderer::create( QDomElement& element )
   r->setMaximumValue( element.attribute( "max_value", "0.0" ).toFloat() );
   r->setRenderQuality( element.attribute( "quality", "0" ).toInt() );
   r->setWeightExpression( element.attribute( "weight_expression" ) );
+  r->setDensityCacheMargin( element.attribute( "cache_margin", "0" ).toDouble() );
 
   QDomElement sourceColorRampElem = element.firstChildElement( "colorramp" );
   if ( !sourceColorRampElem.isNull() && sourceColorRampElem.attribute( "name" ) == "[source]" )
@@ -355,6 +730,7 @@ QDomElement QgsHeatmapRenderer::save( QDomDocument& doc )
   rendererElem.setAttribute( "max_value", QString::number( mExplicitMax ) );
   rendererElem.setAttribute( "quality", QString::number( mRenderQuality ) );
   rendererElem.setAttribute( "weight_expression", mWeightExpressionString );
+  rendererElem.setAttribute( "cache_margin", QString::number( mDensityCacheMargin ) );
   if ( mGradientRamp )
   {
     QDomElement colorRampElem = QgsSymbolLayerV2Utils::saveColorRamp( "[source]", mGradientRamp, doc );
@@ -21,8 +21,10 @@
 #include "qgsexpression.h"
 #include "qgsgeometry.h"
 #include <QScopedPointer>
+#include <QSharedPointer>
 
 class QgsVectorColorRampV2;
+class QgsHeatmapDensityCache;
 
 /** \ingroup core
  * \class QgsHeatmapRenderer
@@ -165,19 +167,65 @@ class CORE_EXPORT QgsHeatmapRenderer : public QgsFeatureRendererV2
      */
     void setWeightExpression( const QString& expression ) { mWeightExpressionString = expression; }
 
+    /** Returns the margin of the cached density grid, as a fraction of the rendered size.
+     * @see setDensityCacheMargin
+     * @note added in QGIS 3.0
+     */
+    double densityCacheMargin() const { return mDensityCacheMargin; }
+
+    /** Sets the margin of the density grid which is cached after rendering, as a fraction of the
+     * rendered width and height added on each side. Densities are kept for the last rendered area,
+     * and later renders at the same scale within the cached grid, like repaints or neighbouring
+     * tiles, reuse them if the points within their radius are the same. Otherwise these points
+     * replace the cached points of the same cells and the whole grid is accumulated again.
+     * A margin of 1 caches 3 x 3 tiles around a rendered tile, but renders of new areas read
+     * and accumulate points for the whole grid. Caching requires unrotated maps without reprojection.
+     * @param margin cache margin, 0 (the default) to only reuse densities for the same area
+     * @see densityCacheMargin
+     * @note added in QGIS 3.0
+     */
+    void setDensityCacheMargin( const double margin ) { mDensityCacheMargin = margin; }
+
   private:
     /** Private copy constructor. @see clone() */
     QgsHeatmapRenderer( const QgsHeatmapRenderer& );
     /** Private assignment operator. @see clone() */
     QgsHeatmapRenderer& operator=( const QgsHeatmapRenderer& );
 
-    QVector<double> mValues;
+    //! A point to accumulate on the density grid, with the cell containing it
+    struct DensityPoint
+    {
+      qint64 column;
+      qint64 row;
+      double weight;
+    };
 
-    double mCalculatedMaxValue;
+    //! Points of the features rendered since startRender()
+    QVector<DensityPoint> mPoints;
+
+    //! Densities shared by the clones of the renderer
+    QSharedPointer<QgsHeatmapDensityCache> mDensityCache;
+    double mDensityCacheMargin;
+
+    //! True if grid cells are aligned on map units, false if they are cells of the rendered image
+    bool mAlignedGrid;
+    //! Grid cell size in map units, for aligned grids
+    double mCellSize;
+    //! First column and row and size of the grid of accumulated densities
+    qint64 mGridColumn;
+    qint64 mGridRow;
+    int mGridColumns;
+    int mGridRows;
+    //! First column and row and size of the cells under the rendered image
+    qint64 mVisibleColumn;
+    qint64 mVisibleRow;
+    int mVisibleColumns;
+    int mVisibleRows;
+    //! True if the grid is the cached grid, which covers the rendered image
+    bool mCacheCandidate;
 
     double mRadius;
     int mRadiusPixels;
-    double mRadiusSquared;
     QgsSymbolV2::OutputUnit mRadiusUnit;
     QgsMapUnitScale mRadiusMapUnitScale;
 
@@ -201,7 +249,14 @@ class CORE_EXPORT QgsHeatmapRenderer : public QgsFeatureRendererV2
 
     QgsMultiPoint convertToMultipoint( const QgsGeometry *geom );
     void initializeValues( QgsRenderContext& context );
-    void renderImage( QgsRenderContext &context );
+    void renderImage( QgsRenderContext &context, const QVector<double>& values );
+    //! Returns the densities of the grid, cached or accumulated from mPoints
+    QVector<double> densities();
+    //! Accumulates mPoints on the grid, with several threads
+    QVector<double> accumulate() const;
+
+    friend class QgsHeatmapDensityCache;
+    friend class QgsHeatmapBandJob;
 };
 
 
@@ -29,6 +29,7 @@
 #include "qgsrasterresamplefilter.h"
 #include "qgsbilinearrasterresampler.h"
 #include "qgscubicrasterresampler.h"
+#include "qgslanczosrasterresampler.h"
 
 
 static void _initRendererWidgetFunctions()
@@ -63,8 +64,10 @@ QgsRendererRasterPropertiesWidget::QgsRendererRasterPropertiesWidget( QgsMapLaye
   mZoomedInResamplingComboBox->insertItem( 0, tr( "Nearest neighbour" ) );
   mZoomedInResamplingComboBox->insertItem( 1, tr( "Bilinear" ) );
   mZoomedInResamplingComboBox->insertItem( 2, tr( "Cubic" ) );
+  mZoomedInResamplingComboBox->insertItem( 3, tr( "Lanczos" ) );
   mZoomedOutResamplingComboBox->insertItem( 0, tr( "Nearest neighbour" ) );
   mZoomedOutResamplingComboBox->insertItem( 1, tr( "Average" ) );
+  mZoomedOutResamplingComboBox->insertItem( 2, tr( "Lanczos" ) );
 
   connect( cboRenderers, SIGNAL( currentIndexChanged( int ) ), this, SLOT( rendererChanged() ) );
 
@@ -164,6 +167,10 @@ void QgsRendererRasterPropertiesWidget::apply()
     {
       zoomedInResampler = new QgsCubicRasterResampler();
     }
+    else if ( zoomedInResamplingMethod == tr( "Lanczos" ) )
+    {
+      zoomedInResampler = new QgsLanczosRasterResampler();
+    }
 
     resampleFilter->setZoomedInResampler( zoomedInResampler );
 
@@ -174,6 +181,10 @@ void QgsRendererRasterPropertiesWidget::apply()
     {
       zoomedOutResampler = new QgsBilinearRasterResampler();
     }
+    else if ( zoomedOutResamplingMethod == tr( "Lanczos" ) )
+    {
+      zoomedOutResampler = new QgsLanczosRasterResampler();
+    }
 
     resampleFilter->setZoomedOutResampler( zoomedOutResampler );
 
@@ -256,6 +267,10 @@ void QgsRendererRasterPropertiesWidget::syncToLayer( QgsRasterLayer* layer )
       {
         mZoomedInResamplingComboBox->setCurrentIndex( 2 );
       }
+      else if ( zoomedInResampler->type() == "lanczos" )
+      {
+        mZoomedInResamplingComboBox->setCurrentIndex( 3 );
+      }
     }
     else
     {
@@ -269,6 +284,10 @@ void QgsRendererRasterPropertiesWidget::syncToLayer( QgsRasterLayer* layer )
       {
         mZoomedOutResamplingComboBox->setCurrentIndex( 1 );
       }
+      else if ( zoomedOutResampler->type() == "lanczos" )
+      {
+        mZoomedOutResamplingComboBox->setCurrentIndex( 2 );
+      }
     }
     else
     {
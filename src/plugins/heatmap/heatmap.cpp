@@ -25,6 +25,7 @@
 #include <qgisgui.h>
 
 #include "heatmap.h"
+#include "heatmapaccumulator.h"
 #include "heatmapgui.h"
 
 #include "qgsfeatureiterator.h"
@@ -41,7 +42,14 @@
 #include <QToolBar>
 #include <QMessageBox>
 #include <QFileInfo>
+#include <QHash>
+#include <QPair>
 #include <QProgressDialog>
+#include <QThread>
+#include <QVector>
+
+#include <algorithm>
+#include <limits>
 
 #define NO_DATA -9999
 
@@ -55,6 +63,9 @@
 #define TO8F(x) QFile::encodeName( x ).constData()
 #endif
 
+//! Maximum number of cells of the strips of rows accumulated in memory before they are written
+static const int MAX_STRIP_CELLS = 4 * 1024 * 1024;
+
 static const QString sName = QObject::tr( "Heatmap" );
 static const QString sDescription = QObject::tr( "Creates a Heatmap raster for the input point vector" );
 static const QString sCategory = QObject::tr( "Raster" );
@@ -150,42 +161,6 @@ void Heatmap::run()
     return;
   }
 
-  double geoTransform[6] = { myBBox.xMinimum(), cellsize, 0, myBBox.yMinimum(), 0, cellsize };
-  GDALDatasetH emptyDataset = GDALCreate( myDriver, d.outputFilename().toUtf8(), columns, rows, 1, GDT_Float32, nullptr );
-  GDALSetGeoTransform( emptyDataset, geoTransform );
-  // Set the projection on the raster destination to match the input layer
-  GDALSetProjection( emptyDataset, inputLayer->crs().toWkt().toLocal8Bit().data() );
-
-  GDALRasterBandH poBand = GDALGetRasterBand( emptyDataset, 1 );
-  GDALSetRasterNoDataValue( poBand, NO_DATA );
-
-  float* line = ( float * ) CPLMalloc( sizeof( float ) * columns );
-  for ( int i = 0; i < columns ; i++ )
-  {
-    line[i] = NO_DATA;
-  }
-  // Write the empty raster
-  for ( int i = 0; i < rows ; i++ )
-  {
-    if ( GDALRasterIO( poBand, GF_Write, 0, i, columns, 1, line, columns, 1, GDT_Float32, 0, 0 ) != CE_None )
-    {
-      QgsDebugMsg( "Raster IO Error" );
-    }
-  }
-
-  CPLFree( line );
-  //close the dataset
-  GDALClose( emptyDataset );
-
-  // open the raster in GA_Update mode
-  GDALDatasetH heatmapDS = GDALOpen( TO8F( d.outputFilename() ), GA_Update );
-  if ( !heatmapDS )
-  {
-    mQGisIface->messageBar()->pushMessage( tr( "Raster update error" ), tr( "Could not open the created raster for updating. The heatmap was not generated." ), QgsMessageBar::WARNING );
-    return;
-  }
-  poBand = GDALGetRasterBand( heatmapDS, 1 );
-
   QgsAttributeList myAttrList;
   int rField = 0;
   int wField = 0;
@@ -229,6 +204,13 @@ void Heatmap::run()
   p.setWindowModality( Qt::ApplicationModal );
   p.show();
 
+  // Points are snapped to the cell containing them, so points of the same cell
+  // with the same radius get the same kernel and their weights are summed
+  QVector<HeatmapSource> sources;
+  QHash< QPair<qint64, int>, int > sourceIndex;
+  QHash<int, HeatmapStamp> stamps;
+  int maxBuffer = 0;
+
   QgsFeature myFeature;
 
   while ( fit.nextFeature( myFeature ) )
@@ -270,17 +252,21 @@ void Heatmap::run()
     if ( d.variableRadius() )
     {
       radius = myFeature.attribute( rField ).toDouble() * radiusToMapUnits;
-      myBuffer = bufferSize( radius, cellsize );
+      myBuffer = qMax( 0, bufferSize( radius, cellsize ) );
     }
 
-    int blockSize = 2 * myBuffer + 1; //Block SIDE would be more appropriate
-
     double weight = 1.0;
     if ( d.weighted() )
     {
       weight = myFeature.attribute( wField ).toDouble();
     }
 
+    if ( !stamps.contains( myBuffer ) )
+    {
+      stamps.insert( myBuffer, makeStamp( myBuffer, kernelValues( myBuffer, kernelShape, valueType ) ) );
+      maxBuffer = qMax( maxBuffer, myBuffer );
+    }
+
     //loop through all points in multipoint
     for ( QgsMultiPoint::const_iterator pointIt = multiPoints.constBegin(); pointIt != multiPoints.constEnd(); ++pointIt )
     {
@@ -292,63 +278,118 @@ void Heatmap::run()
       }
 
       // calculate the pixel position
-      unsigned int xPosition, yPosition;
-      xPosition = ((( *pointIt ).x() - myBBox.xMinimum() ) / cellsize ) - myBuffer;
-      yPosition = ((( *pointIt ).y() - myBBox.yMinimum() ) / cellsize ) - myBuffer;
-
-      // get the data
-      float *dataBuffer = ( float * ) CPLMalloc( sizeof( float ) * blockSize * blockSize );
-      if ( GDALRasterIO( poBand, GF_Read, xPosition, yPosition, blockSize, blockSize,
-                         dataBuffer, blockSize, blockSize, GDT_Float32, 0, 0 ) != CE_None )
+      int column = static_cast< int >((( *pointIt ).x() - myBBox.xMinimum() ) / cellsize );
+      int row = static_cast< int >((( *pointIt ).y() - myBBox.yMinimum() ) / cellsize );
+
+      addSource( sources, sourceIndex, columns, row, column, myBuffer, weight );
+    }
+  }
+  sourceIndex.clear();
+  std::stable_sort( sources.begin(), sources.end(), sourceRowLessThan );
+
+  double geoTransform[6] = { myBBox.xMinimum(), cellsize, 0, myBBox.yMinimum(), 0, cellsize };
+  GDALDatasetH heatmapDS = GDALCreate( myDriver, TO8F( d.outputFilename() ), columns, rows, 1, GDT_Float32, nullptr );
+  if ( !heatmapDS )
+  {
+    mQGisIface->messageBar()->pushMessage( tr( "Raster update error" ), tr( "Could not create the output raster. The heatmap was not generated." ), QgsMessageBar::WARNING );
+    return;
+  }
+  GDALSetGeoTransform( heatmapDS, geoTransform );
+  // Set the projection on the raster destination to match the input layer
+  GDALSetProjection( heatmapDS, inputLayer->crs().toWkt().toLocal8Bit().data() );
+
+  GDALRasterBandH poBand = GDALGetRasterBand( heatmapDS, 1 );
+  GDALSetRasterNoDataValue( poBand, NO_DATA );
+
+  // the raster is written in strips of whole blocks. Strips are accumulated in memory, by several threads,
+  // unless large kernels are approximated with box blurs on the whole raster
+  int stripRows = qMax( 1, MAX_STRIP_CELLS / qMax( 1, columns ) );
+  int blockXSize = 0;
+  int blockYSize = 0;
+  GDALGetBlockSize( poBand, &blockXSize, &blockYSize );
+  if ( blockYSize > 0 && stripRows > blockYSize )
+  {
+    stripRows -= stripRows % blockYSize;
+  }
+  stripRows = qMax( 1, qMin( stripRows, rows ) );
+
+  QVector<double> blurred;
+  QVector<double> blurredCoverage;
+  double stampMass = 0.0;
+  bool approximated = false;
+  if ( d.approximate() && !d.variableRadius() && !sources.isEmpty() )
+  {
+    if ( static_cast< qint64 >( rows ) * columns > std::numeric_limits<int>::max() )
+    {
+      mQGisIface->messageBar()->pushMessage( tr( "Heatmap approximation" ), tr( "The raster is too large to be approximated in memory, the kernels are calculated exactly" ), QgsMessageBar::WARNING, mQGisIface->messageTimeout() );
+    }
+    else
+    {
+      approximated = blurSources( sources, stamps.value( myBuffer ), rows, columns, blurred, blurredCoverage, stampMass );
+    }
+  }
+
+  QVector<double> values( approximated ? 0 : stripRows * columns );
+  QVector<uchar> covered( approximated ? 0 : stripRows * columns );
+  QVector<float> line( stripRows * columns );
+  int threadCount = qMax( 1, QThread::idealThreadCount() );
+  HeatmapBandJob job( sources, stamps, maxBuffer, columns, values.data(), covered.data() );
+
+  QProgressDialog writeProgress( tr( "Writing heatmap..." ), tr( "Abort" ), 0, rows, mQGisIface->mainWindow() );
+  writeProgress.setWindowTitle( tr( "QGIS" ) );
+  writeProgress.setWindowModality( Qt::ApplicationModal );
+  writeProgress.show();
+  bool canceled = false;
+
+  for ( int firstRow = 0; firstRow < rows; firstRow += stripRows )
+  {
+    int nStripRows = qMin( stripRows, rows - firstRow );
+    int nCells = nStripRows * columns;
+    float* out = line.data();
+
+    if ( canceled )
+    {
+      // rows which were not calculated are written as no data
+      for ( int i = 0; i < nCells; ++i )
       {
-        QgsDebugMsg( "Raster IO Error" );
+        out[i] = NO_DATA;
       }
+    }
+    else if ( approximated )
+    {
+      const double* value = blurred.constData() + static_cast< qint64 >( firstRow ) * columns;
+      const double* coverage = blurredCoverage.constData() + static_cast< qint64 >( firstRow ) * columns;
+      for ( int i = 0; i < nCells; ++i )
+      {
+        out[i] = coverage[i] > 0 ? stampMass * value[i] : NO_DATA;
+      }
+    }
+    else
+    {
+      values.fill( 0.0 );
+      covered.fill( 0 );
+      accumulateStrip( job, firstRow, nStripRows, threadCount );
 
-      for ( int xp = 0; xp <= myBuffer; xp++ )
+      for ( int i = 0; i < nCells; ++i )
       {
-        for ( int yp = 0; yp <= myBuffer; yp++ )
-        {
-          double distance = sqrt( pow( xp, 2.0 ) + pow( yp, 2.0 ) );
-
-          // is pixel outside search bandwidth of feature?
-          if ( distance > myBuffer )
-          {
-            continue;
-          }
-
-          double pixelValue = weight * calculateKernelValue( distance, myBuffer, kernelShape, valueType );
-
-          // clearing anamolies along the axes
-          if ( xp == 0 && yp == 0 )
-          {
-            pixelValue /= 4;
-          }
-          else if ( xp == 0 || yp == 0 )
-          {
-            pixelValue /= 2;
-          }
-
-          int pos[4];
-          pos[0] = ( myBuffer + xp ) * blockSize + ( myBuffer + yp );
-          pos[1] = ( myBuffer + xp ) * blockSize + ( myBuffer - yp );
-          pos[2] = ( myBuffer - xp ) * blockSize + ( myBuffer + yp );
-          pos[3] = ( myBuffer - xp ) * blockSize + ( myBuffer - yp );
-          for ( int p = 0; p < 4; p++ )
-          {
-            if ( dataBuffer[ pos[p] ] == NO_DATA )
-            {
-              dataBuffer[ pos[p] ] = 0;
-            }
-            dataBuffer[ pos[p] ] += pixelValue;
-          }
-        }
+        out[i] = covered.at( i ) ? values.at( i ) : NO_DATA;
       }
-      if ( GDALRasterIO( poBand, GF_Write, xPosition, yPosition, blockSize, blockSize,
-                         dataBuffer, blockSize, blockSize, GDT_Float32, 0, 0 ) != CE_None )
+    }
+
+    if ( GDALRasterIO( poBand, GF_Write, 0, firstRow, columns, nStripRows, out, columns, nStripRows, GDT_Float32, 0, 0 ) != CE_None )
+    {
+      QgsDebugMsg( "Raster IO Error" );
+    }
+
+    if ( !canceled )
+    {
+      writeProgress.setValue( firstRow + nStripRows );
+      QApplication::processEvents();
+      if ( writeProgress.wasCanceled() )
       {
-        QgsDebugMsg( "Raster IO Error" );
+        mQGisIface->messageBar()->pushMessage( tr( "Heatmap generation aborted" ), tr( "QGIS will now load the partially-computed raster" ), QgsMessageBar::INFO, mQGisIface->messageTimeout() );
+        canceled = true;
       }
-      CPLFree( dataBuffer );
     }
   }
 
@@ -394,6 +435,27 @@ int Heatmap::bufferSize( double radius, double cellsize )
   return buffer;
 }
 
+QVector<double> Heatmap::kernelValues( const int bandwidth, const KernelShape shape, const OutputValues outputType )
+{
+  int width = 2 * bandwidth + 1;
+  QVector<double> values( width * width, 0.0 );
+  for ( int yp = -bandwidth; yp <= bandwidth; yp++ )
+  {
+    for ( int xp = -bandwidth; xp <= bandwidth; xp++ )
+    {
+      double distance = sqrt( static_cast< double >( xp * xp + yp * yp ) );
+
+      // is pixel outside search bandwidth of feature?
+      if ( distance > bandwidth )
+      {
+        continue;
+      }
+      values[( yp + bandwidth ) * width + xp + bandwidth ] = calculateKernelValue( distance, bandwidth, shape, outputType );
+    }
+  }
+  return values;
+}
+
 double Heatmap::calculateKernelValue( const double distance, const int bandwidth, const KernelShape shape, const OutputValues outputType )
 {
   switch ( shape )
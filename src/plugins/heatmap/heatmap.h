@@ -37,6 +37,7 @@
 
 //QT4 includes
 #include <QObject>
+#include <QVector>
 
 //QGIS includes
 #include "../qgisplugin.h"
@@ -106,6 +107,8 @@ class Heatmap: public QObject, public QgisPlugin
     double mapUnitsOf( double dist, const QgsCoordinateReferenceSystem& layerCrs );
     //! Worker to calculate buffer size in pixels
     int bufferSize( double radius, double cellsize );
+    //! Calculate the values of the cells within a bandwidth around a point, ( 2 * bandwidth + 1 ) rows of 2 * bandwidth + 1 values
+    QVector<double> kernelValues( const int bandwidth, const KernelShape shape, const OutputValues outputType );
     //! Calculate the value given to a point width a given distance for a specified kernel shape
     double calculateKernelValue( const double distance, const int bandwidth, const KernelShape shape, const OutputValues outputType );
     //! Uniform kernel function
@@ -0,0 +1,278 @@
+/***************************************************************************
+  heatmapaccumulator.cpp
+  Accumulates the kernels of the points of a heatmap
+  -------------------
+         begin                : October 2016
+         copyright            : (C) 2016 by the QGIS project
+
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "heatmapaccumulator.h"
+
+#include <QList>
+#include <QThread>
+#include <QtConcurrentMap>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+bool sourceRowLessThan( const HeatmapSource& a, const HeatmapSource& b )
+{
+  return a.row < b.row;
+}
+
+void addSource( QVector<HeatmapSource>& sources, QHash< QPair<qint64, int>, int >& index, int columns,
+                int row, int column, int radius, double weight )
+{
+  QPair<qint64, int> key( static_cast< qint64 >( row ) * ( columns + 1 ) + column, radius );
+  QHash< QPair<qint64, int>, int >::const_iterator sourceIt = index.constFind( key );
+  if ( sourceIt != index.constEnd() )
+  {
+    sources[ sourceIt.value()].weight += weight;
+    return;
+  }
+  HeatmapSource source;
+  source.row = row;
+  source.column = column;
+  source.radius = radius;
+  source.weight = weight;
+  index.insert( key, sources.size() );
+  sources << source;
+}
+
+HeatmapStamp makeStamp( int radius, const QVector<double>& values )
+{
+  HeatmapStamp stamp;
+  stamp.radius = radius;
+  stamp.values = values;
+  stamp.halfWidth.resize( 2 * radius + 1 );
+  for ( int dy = -radius; dy <= radius; ++dy )
+  {
+    // cells are within the radius if dx^2 + dy^2 <= radius^2
+    int halfWidth = 0;
+    while (( halfWidth + 1 ) * ( halfWidth + 1 ) + dy * dy <= radius * radius )
+    {
+      ++halfWidth;
+    }
+    stamp.halfWidth[ dy + radius ] = halfWidth;
+  }
+  return stamp;
+}
+
+HeatmapBandJob::HeatmapBandJob( const QVector<HeatmapSource>& sources, const QHash<int, HeatmapStamp>& stamps, int maxRadius, int columns, double* values, uchar* covered )
+    : mSources( sources )
+    , mStamps( stamps )
+    , mMaxRadius( maxRadius )
+    , mColumns( columns )
+    , mStripFirstRow( 0 )
+    , mValues( values )
+    , mCovered( covered )
+{
+}
+
+void HeatmapBandJob::operator()( const HeatmapBand& band )
+{
+  // sources are sorted by row, only those within the largest radius of the band reach it
+  HeatmapSource first;
+  first.row = band.firstRow - mMaxRadius;
+  QVector<HeatmapSource>::const_iterator it = std::lower_bound( mSources.constBegin(), mSources.constEnd(), first, sourceRowLessThan );
+  for ( ; it != mSources.constEnd() && it->row < band.lastRow + mMaxRadius; ++it )
+  {
+    const HeatmapStamp& stamp = mStamps.constFind( it->radius ).value();
+    int radius = stamp.radius;
+    int width = 2 * radius + 1;
+    int firstRow = qMax( band.firstRow, it->row - radius );
+    int lastRow = qMin( band.lastRow - 1, it->row + radius );
+    for ( int row = firstRow; row <= lastRow; ++row )
+    {
+      int dy = row - it->row;
+      int halfWidth = stamp.halfWidth[ dy + radius ];
+      int firstColumn = qMax( 0, it->column - halfWidth );
+      int lastColumn = qMin( mColumns - 1, it->column + halfWidth );
+
+      const double* kernel = stamp.values.constData() + ( dy + radius ) * width + radius;
+      double* value = mValues + ( row - mStripFirstRow ) * mColumns;
+      uchar* covered = mCovered + ( row - mStripFirstRow ) * mColumns;
+      double weight = it->weight;
+      for ( int column = firstColumn; column <= lastColumn; ++column )
+      {
+        value[column] += weight * kernel[ column - it->column ];
+        covered[column] = 1;
+      }
+    }
+  }
+}
+
+void accumulateStrip( HeatmapBandJob& job, int firstRow, int rowCount, int threadCount )
+{
+  job.setStripFirstRow( firstRow );
+
+  int bandRows = qMax( 1, rowCount / ( 4 * qMax( 1, threadCount ) ) );
+  QList<HeatmapBand> bands;
+  for ( int bandFirstRow = firstRow; bandFirstRow < firstRow + rowCount; bandFirstRow += bandRows )
+  {
+    HeatmapBand band;
+    band.firstRow = bandFirstRow;
+    band.lastRow = qMin( bandFirstRow + bandRows, firstRow + rowCount );
+    bands << band;
+  }
+  if ( bands.size() > 1 )
+  {
+    QtConcurrent::blockingMap( bands, job );
+  }
+  else if ( !bands.isEmpty() )
+  {
+    job( bands.at( 0 ) );
+  }
+}
+
+//! Moving sum of 2 * radius + 1 values, in place. Values outside of the line are zero.
+static void boxBlurLine( double* line, double* temp, int length, int radius, double scale )
+{
+  std::copy( line, line + length, temp );
+  double sum = 0.0;
+  for ( int i = 0; i < qMin( radius, length ); ++i )
+  {
+    sum += temp[i];
+  }
+  for ( int i = 0; i < length; ++i )
+  {
+    if ( i + radius < length )
+    {
+      sum += temp[i + radius];
+    }
+    line[i] = sum * scale;
+    if ( i - radius >= 0 )
+    {
+      sum -= temp[i - radius];
+    }
+  }
+}
+
+//! Applies three box blurs to a range of lines of a grid, for QtConcurrent::blockingMap
+class HeatmapBlurJob
+{
+  public:
+    HeatmapBlurJob( double* data, int length, int elementStride, int lineStride, int radius, bool normalize )
+        : mData( data )
+        , mLength( length )
+        , mElementStride( elementStride )
+        , mLineStride( lineStride )
+        , mRadius( radius )
+        , mScale( normalize ? 1.0 / ( 2 * radius + 1 ) : 1.0 )
+    {}
+
+    typedef void result_type;
+
+    void operator()( const QPair<int, int>& lines )
+    {
+      QVector<double> line( mLength );
+      QVector<double> temp( mLength );
+      for ( int l = lines.first; l < lines.second; ++l )
+      {
+        double* data = mData + static_cast< qint64 >( l ) * mLineStride;
+        for ( int i = 0; i < mLength; ++i )
+        {
+          line[i] = data[ static_cast< qint64 >( i ) * mElementStride ];
+        }
+        for ( int pass = 0; pass < 3; ++pass )
+        {
+          boxBlurLine( line.data(), temp.data(), mLength, mRadius, mScale );
+        }
+        for ( int i = 0; i < mLength; ++i )
+        {
+          data[ static_cast< qint64 >( i ) * mElementStride ] = line[i];
+        }
+      }
+    }
+
+  private:
+    double* mData;
+    int mLength;
+    int mElementStride;
+    int mLineStride;
+    int mRadius;
+    double mScale;
+};
+
+static void blurGrid( QVector<double>& grid, int rows, int columns, int radius, bool normalize )
+{
+  int jobs = 4 * qMax( 1, QThread::idealThreadCount() );
+
+  QList< QPair<int, int> > rowRanges;
+  int rowStep = qMax( 1, rows / jobs );
+  for ( int row = 0; row < rows; row += rowStep )
+  {
+    rowRanges << qMakePair( row, qMin( row + rowStep, rows ) );
+  }
+  QtConcurrent::blockingMap( rowRanges, HeatmapBlurJob( grid.data(), columns, 1, columns, radius, normalize ) );
+
+  QList< QPair<int, int> > columnRanges;
+  int columnStep = qMax( 1, columns / jobs );
+  for ( int column = 0; column < columns; column += columnStep )
+  {
+    columnRanges << qMakePair( column, qMin( column + columnStep, columns ) );
+  }
+  QtConcurrent::blockingMap( columnRanges, HeatmapBlurJob( grid.data(), rows, columns, 1, radius, normalize ) );
+}
+
+bool blurSources( const QVector<HeatmapSource>& sources, const HeatmapStamp& stamp, int rows, int columns,
+                  QVector<double>& blurred, QVector<double>& coverage, double& stampMass )
+{
+  // the raster is kept in vectors, which are indexed by int
+  qint64 cellCount = static_cast< qint64 >( rows ) * columns;
+  if ( rows <= 0 || columns <= 0 || cellCount > std::numeric_limits<int>::max() )
+  {
+    return false;
+  }
+
+  int radius = stamp.radius;
+  int width = 2 * radius + 1;
+  double mass = 0.0;
+  double moment = 0.0;
+  for ( int dy = -radius; dy <= radius; ++dy )
+  {
+    int halfWidth = stamp.halfWidth[ dy + radius ];
+    for ( int dx = -halfWidth; dx <= halfWidth; ++dx )
+    {
+      double value = stamp.values[( dy + radius ) * width + dx + radius ];
+      mass += value;
+      moment += value * dx * dx;
+    }
+  }
+  if ( mass <= 0 || moment <= 0 )
+  {
+    return false;
+  }
+
+  // a box of 2 * r + 1 cells has a variance of r * ( r + 1 ) / 3, three of them r * ( r + 1 )
+  double variance = moment / mass;
+  int boxRadius = qRound(( sqrt( 1.0 + 4.0 * variance ) - 1.0 ) / 2.0 );
+  if ( boxRadius < 1 )
+  {
+    return false;
+  }
+
+  blurred.fill( 0.0, static_cast< int >( cellCount ) );
+  coverage.fill( 0.0, static_cast< int >( cellCount ) );
+  for ( QVector<HeatmapSource>::const_iterator it = sources.constBegin(); it != sources.constEnd(); ++it )
+  {
+    qint64 cell = static_cast< qint64 >( qMin( it->row, rows - 1 ) ) * columns + qMin( it->column, columns - 1 );
+    blurred[ cell ] += it->weight;
+    coverage[ cell ] = 1.0;
+  }
+
+  // coverage is not normalized, sums of integers are exact and zero outside of the blurs
+  blurGrid( blurred, rows, columns, boxRadius, true );
+  blurGrid( coverage, rows, columns, boxRadius, false );
+  stampMass = mass;
+  return true;
+}
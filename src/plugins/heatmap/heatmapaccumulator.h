@@ -0,0 +1,100 @@
+/***************************************************************************
+  heatmapaccumulator.h
+  Accumulates the kernels of the points of a heatmap
+  -------------------
+         begin                : October 2016
+         copyright            : (C) 2016 by the QGIS project
+
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef HEATMAPACCUMULATOR_H
+#define HEATMAPACCUMULATOR_H
+
+#include <QHash>
+#include <QPair>
+#include <QVector>
+
+//! Points snapped to the same cell, with the same radius in cells
+struct HeatmapSource
+{
+  int row;
+  int column;
+  int radius;
+  //! sum of the weights of the points
+  double weight;
+};
+
+bool sourceRowLessThan( const HeatmapSource& a, const HeatmapSource& b );
+
+/** Adds a point snapped to a cell to the sources. Its weight is added to the source of the same
+ * cell and radius if there is one. index maps the cells and radii to the sources, columns is the
+ * number of columns of the raster. */
+void addSource( QVector<HeatmapSource>& sources, QHash< QPair<qint64, int>, int >& index, int columns,
+                int row, int column, int radius, double weight );
+
+//! Kernel values of the cells within a radius around a point, calculated once per radius
+struct HeatmapStamp
+{
+  int radius;
+  //! half width of each stamp row, from -radius to radius
+  QVector<int> halfWidth;
+  //! 2 * radius + 1 values per stamp row
+  QVector<double> values;
+};
+
+//! Makes the stamp of a radius from the ( 2 * radius + 1 )^2 kernel values around a point
+HeatmapStamp makeStamp( int radius, const QVector<double>& values );
+
+//! A band of rows of a strip
+struct HeatmapBand
+{
+  int firstRow;
+  //! one past the last row
+  int lastRow;
+};
+
+//! Adds the stamps of the sources reaching a band of rows, for QtConcurrent::blockingMap
+class HeatmapBandJob
+{
+  public:
+    /** Sources must be sorted by row. values and covered are the buffers of a strip of rows,
+     * of columns cells per row, which are added to. */
+    HeatmapBandJob( const QVector<HeatmapSource>& sources, const QHash<int, HeatmapStamp>& stamps, int maxRadius, int columns, double* values, uchar* covered );
+
+    typedef void result_type;
+
+    //! Sets the raster row of the first row of the buffers
+    void setStripFirstRow( int row ) { mStripFirstRow = row; }
+
+    void operator()( const HeatmapBand& band );
+
+  private:
+    const QVector<HeatmapSource>& mSources;
+    const QHash<int, HeatmapStamp>& mStamps;
+    int mMaxRadius;
+    int mColumns;
+    int mStripFirstRow;
+    double* mValues;
+    uchar* mCovered;
+};
+
+/** Adds the stamps reaching a strip of rows to the buffers of the job, in bands of rows
+ * accumulated by several threads */
+void accumulateStrip( HeatmapBandJob& job, int firstRow, int rowCount, int threadCount );
+
+/** Approximates the sum of the stamps of all sources by three successive box blurs of the binned
+ * weights, which converge to a gaussian of the same variance and mass as the stamp. The cost does
+ * not depend on the radius, but the whole raster is kept in memory. Cells reached by the blurs of
+ * the binned points are covered.
+ * @return false if the stamp cannot be approximated or the raster has more cells than a vector can hold
+ */
+bool blurSources( const QVector<HeatmapSource>& sources, const HeatmapStamp& stamp, int rows, int columns,
+                  QVector<double>& blurred, QVector<double>& coverage, double& stampMass );
+
+#endif // HEATMAPACCUMULATOR_H
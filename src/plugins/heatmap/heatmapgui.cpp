@@ -202,6 +202,7 @@ void HeatmapGui::restoreSettings( bool usingLastInputLayer )
   }
   mOutputValuesComboBox->setCurrentIndex( mOutputValuesComboBox->findData(
                                             ( Heatmap::OutputValues )( mHeatmapSessionSettings->value( QString( "lastOutputValues" ), "0" ).toInt() ) ) );
+  mApproximateCheckBox->setChecked( mHeatmapSessionSettings->value( QString( "approximate" ) ).toBool() );
 
 }
 
@@ -226,6 +227,7 @@ void HeatmapGui::saveSettings()
   mHeatmapSessionSettings->insert( QString( "weightField" ), QVariant( mWeightFieldCombo->currentField() ) );
   mHeatmapSessionSettings->insert( QString( "decayRatio" ), QVariant( mDecayLineEdit->text() ) );
   mHeatmapSessionSettings->insert( QString( "lastOutputValues" ), QVariant( mOutputValuesComboBox->itemData( mOutputValuesComboBox->currentIndex() ).toInt() ) );
+  mHeatmapSessionSettings->insert( QString( "approximate" ), QVariant( mApproximateCheckBox->isChecked() ) );
 }
 
 void HeatmapGui::on_mButtonBox_rejected()
@@ -546,6 +548,11 @@ double HeatmapGui::decayRatio() const
   return mDecayLineEdit->text().toDouble();
 }
 
+bool HeatmapGui::approximate() const
+{
+  return mApproximateCheckBox->isChecked() && !mRadiusFieldCheckBox->isChecked();
+}
+
 int HeatmapGui::radiusField() const
 {
   QgsVectorLayer *inputLayer = inputVectorLayer();
@@ -58,6 +58,9 @@ class HeatmapGui : public QDialog, private Ui::HeatmapGuiBase
     /** Return the decay ratio */
     double decayRatio() const;
 
+    /** Returns whether large kernels are approximated with box blurs, only with a fixed radius */
+    bool approximate() const;
+
     /** Return the attribute field for variable radius */
     int radiusField() const;
 
@@ -199,6 +199,12 @@ void QgsInterpolationDialog::on_buttonBox_accepted()
   //create grid file writer
   QgsGridFileWriter theWriter( theInterpolator, fileName, outputBBox, mNumberOfColumnsSpinBox->value(),
                                mNumberOfRowsSpinBox->value(), mCellsizeXSpinBox->value(), mCellSizeYSpinBox->value() );
+  //GeoTIFF files are written tiled and compressed with GDAL
+  if ( QFileInfo( fileName ).suffix().compare( "tif", Qt::CaseInsensitive ) == 0
+       || QFileInfo( fileName ).suffix().compare( "tiff", Qt::CaseInsensitive ) == 0 )
+  {
+    theWriter.setOutputFormat( "GTiff" );
+  }
   if ( theWriter.writeFile( true ) == 0 )
   {
     if ( mAddResultToProjectCheckBox->isChecked() )
@@ -322,7 +328,10 @@ void QgsInterpolationDialog::on_mOutputFileButton_clicked()
 
 void QgsInterpolationDialog::on_mOutputFileLineEdit_textChanged()
 {
-  if ( mOutputFileLineEdit->text().endsWith( ".asc" ) )
+  QString text = mOutputFileLineEdit->text();
+  //same suffixes as in on_buttonBox_accepted, whatever their case
+  if ( text.endsWith( ".asc", Qt::CaseInsensitive ) || text.endsWith( ".tif", Qt::CaseInsensitive )
+       || text.endsWith( ".tiff", Qt::CaseInsensitive ) )
   {
     enableOrDisableOkButton();
   }
@@ -15,6 +15,9 @@
  * \brief implemetation UI for find shotest path
  */
 
+// C++ standard includes
+#include <limits>
+
 //qt includes
 #include <qcombobox.h>
 #include <qlayout.h>
@@ -43,6 +46,7 @@
 #include <qgsgraphdirector.h>
 #include <qgsgraphbuilder.h>
 #include <qgsgraph.h>
+#include <qgscompactgraph.h>
 #include <qgsgraphanalyzer.h>
 
 // roadgraph plugin includes
@@ -315,17 +319,30 @@ QgsGraph* RgShortestPathWidget::getPath( QgsPoint& p1, QgsPoint& p2 )
     return nullptr;
   }
 
-
-  QgsGraph* shortestpathTree = QgsGraphAnalyzer::shortestTree( graph, startVertexIdx, criterionNum );
-  delete graph;
-
-  if ( shortestpathTree->findVertex( p2 ) == -1 )
+  // search only between both points instead of building the whole shortest path tree
+  int stopVertexIdx = graph->findVertex( p2 );
+  QgsCompactGraph compactGraph( graph );
+  QVector<int> pathArcs;
+  double pathCost = QgsGraphAnalyzer::bidirectionalShortestPath( &compactGraph, startVertexIdx, stopVertexIdx, criterionNum, &pathArcs );
+  if ( stopVertexIdx < 0 || pathCost == std::numeric_limits<double>::infinity() )
   {
-    delete shortestpathTree;
+    delete graph;
     QMessageBox::critical( this, tr( "Path not found" ), tr( "Path not found" ) );
     return nullptr;
   }
-  return shortestpathTree;
+
+  QgsGraph* shortestPath = new QgsGraph();
+  int prevVertexIdx = shortestPath->addVertex( graph->vertex( startVertexIdx ).point() );
+  Q_FOREACH ( int arcIdx, pathArcs )
+  {
+    const QgsGraphArc& arc = graph->arc( arcIdx );
+    int nextVertexIdx = shortestPath->addVertex( graph->vertex( arc.inVertex() ).point() );
+    shortestPath->addArc( prevVertexIdx, nextVertexIdx, arc.properties() );
+    prevVertexIdx = nextVertexIdx;
+  }
+  delete graph;
+
+  return shortestPath;
 }
 
 void RgShortestPathWidget::findingPath()
@@ -45,6 +45,14 @@
 #include <QFile>
 #include <QHash>
 #include <QTime>
+#include <QCache>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QAtomicInt>
 #include <QTextDocument>
 #include <QDebug>
 
@@ -105,6 +113,7 @@ QgsGdalProvider::QgsGdalProvider( const QString &uri, QgsError error )
     , mYBlockSize( 0 )
     , mGdalBaseDataset( nullptr )
     , mGdalDataset( nullptr )
+    , mUsesReadDatasets( false )
 {
   mGeoTransform[0] =  0;
   mGeoTransform[1] =  1;
@@ -127,6 +136,7 @@ QgsGdalProvider::QgsGdalProvider( const QString &uri, bool update )
     , mYBlockSize( 0 )
     , mGdalBaseDataset( nullptr )
     , mGdalDataset( nullptr )
+    , mUsesReadDatasets( false )
 {
   mGeoTransform[0] =  0;
   mGeoTransform[1] =  1;
@@ -226,6 +236,8 @@ bool QgsGdalProvider::crsFromWkt( const char *wkt )
 
 QgsGdalProvider::~QgsGdalProvider()
 {
+  if ( mUsesReadDatasets )
+    releaseReadDatasetUser( dataSourceUri() );
   if ( mGdalBaseDataset )
   {
     GDALDereferenceDataset( mGdalBaseDataset );
@@ -246,6 +258,10 @@ void QgsGdalProvider::closeDataset()
   }
   mValid = false;
 
+  // the dataset is closed to be reloaded, its content may have changed
+  resetReadDatasets( dataSourceUri() );
+  invalidateBlockCache( dataSourceUri() );
+
   GDALDereferenceDataset( mGdalBaseDataset );
   mGdalBaseDataset = nullptr;
 
@@ -604,14 +620,11 @@ void QgsGdalProvider::readBlock( int theBandNo, QgsRectangle  const & theExtent,
     QgsDebugMsg( QString( "Coudn't allocate temporary buffer of %1 bytes" ).arg( dataSize * tmpWidth * tmpHeight ) );
     return;
   }
-  GDALRasterBandH gdalBand = GDALGetRasterBand( mGdalDataset, theBandNo );
-  GDALDataType type = ( GDALDataType )mGdalDataType.at( theBandNo - 1 );
   CPLErrorReset();
-  CPLErr err = gdalRasterIO( gdalBand, GF_Read,
-                             srcLeft, srcTop, srcWidth, srcHeight,
-                             ( void * )tmpBlock,
-                             tmpWidth, tmpHeight, type,
-                             0, 0 );
+  CPLErr err = readWindow( theBandNo,
+                           srcLeft, srcTop, srcWidth, srcHeight,
+                           ( void * )tmpBlock,
+                           tmpWidth, tmpHeight );
 
   if ( err != CPLE_None )
   {
@@ -658,6 +671,426 @@ void QgsGdalProvider::readBlock( int theBandNo, QgsRectangle  const & theExtent,
   return;
 }
 
+/** Minimum number of cells of a unit read from a dataset and cached. Units
+ * are made of whole native blocks, the strips of datasets organized in strips
+ * of one or a few lines are merged to avoid tiny reads. */
+static const int MIN_BLOCK_UNIT_CELLS = 65536;
+
+/** Ratio of the cells read to the cells of the output buffer above which a
+ * window is read by GDAL directly, rather than by whole units */
+static const int MAX_BLOCK_UNIT_DECIMATION = 2;
+
+//! Decoded units shared by all the GDAL providers, keyed by "source|band|overview|type|column|row"
+static QCache<QString, QByteArray> sBlockCache;
+static QMutex sBlockCacheMutex;
+static bool sBlockCacheInitialized = false;
+
+//! Read the maximum size of the block cache from the settings on first use. Must be called with the mutex locked.
+static void initBlockCache()
+{
+  if ( sBlockCacheInitialized )
+    return;
+
+  QSettings s;
+  sBlockCache.setMaxCost( s.value( "/qgis/gdalBlockCacheSize", 64 * 1024 ).toInt() );
+  sBlockCacheInitialized = true;
+}
+
+/** Read only dataset handles of a source, shared by the parallel block readers
+ * of all its providers, so that the providers cloned for each rendering do not
+ * reopen the source. Guarded by sBlockCacheMutex. */
+struct QgsGdalReadDatasets
+{
+  QgsGdalReadDatasets()
+      : generation( 0 )
+      , users( 0 )
+  {}
+
+  //! Incremented when the source changes, handles of older generations are closed when released
+  int generation;
+  //! Number of providers which used the handles
+  int users;
+  //! Handles not used by a reader
+  QList<GDALDatasetH> idle;
+};
+
+static QHash<QString, QgsGdalReadDatasets> sReadDatasets;
+
+/** Take an idle read only handle of a source, or open a new one.
+ * @param source data source
+ * @param generation out: generation of the handle, to pass to releaseReadDataset()
+ */
+static GDALDatasetH acquireReadDataset( const QString& source, int& generation )
+{
+  {
+    QMutexLocker locker( &sBlockCacheMutex );
+    QgsGdalReadDatasets& datasets = sReadDatasets[source];
+    generation = datasets.generation;
+    if ( !datasets.idle.isEmpty() )
+      return datasets.idle.takeLast();
+  }
+  return QgsGdalProviderBase::gdalOpen( TO8F( source ), GA_ReadOnly );
+}
+
+//! Give a handle back to the idle handles of its source, or close it if it is outdated or not needed
+static void releaseReadDataset( const QString& source, GDALDatasetH dataset, int generation )
+{
+  {
+    QMutexLocker locker( &sBlockCacheMutex );
+    QHash<QString, QgsGdalReadDatasets>::iterator it = sReadDatasets.find( source );
+    if ( it != sReadDatasets.end() && it->generation == generation && it->users > 0 &&
+         it->idle.size() < QThread::idealThreadCount() )
+    {
+      it->idle << dataset;
+      return;
+    }
+  }
+  GDALClose( dataset );
+}
+
+//! Private thread pool of the block readers, so that they do not compete with QtConcurrent jobs
+static QThreadPool* blockReaderPool()
+{
+  static QThreadPool* sPool = nullptr;
+
+  QMutexLocker locker( &sBlockCacheMutex );
+  if ( !sPool )
+  {
+    sPool = new QThreadPool();
+    sPool->setMaxThreadCount( QThread::idealThreadCount() );
+  }
+  return sPool;
+}
+
+//! Band or overview band of a dataset, overview -1 is the full resolution band
+static GDALRasterBandH levelBand( GDALDatasetH dataset, int bandNo, int overview )
+{
+  GDALRasterBandH band = GDALGetRasterBand( dataset, bandNo );
+  if ( band && overview >= 0 )
+    band = GDALGetOverview( band, overview );
+  return band;
+}
+
+//! A block aligned window of a band, read at once and cached
+struct QgsGdalBlockUnit
+{
+  int index;
+  int xOff;
+  int yOff;
+  int width;
+  int height;
+  QString key;
+  QByteArray data;
+};
+
+static CPLErr readBlockUnit( GDALRasterBandH band, GDALDataType type, QgsGdalBlockUnit& unit )
+{
+  unit.data.resize( unit.width * unit.height * ( GDALGetDataTypeSize( type ) / 8 ) );
+  return QgsGdalProviderBase::gdalRasterIO( band, GF_Read, unit.xOff, unit.yOff, unit.width, unit.height,
+         unit.data.data(), unit.width, unit.height, type, 0, 0 );
+}
+
+/** Reads units, taken in turn from a list shared by all the readers of the
+ * same window, with its own dataset handle.
+ */
+class QgsGdalBlockUnitReader : public QRunnable
+{
+  public:
+    QgsGdalBlockUnitReader( GDALDatasetH dataset, int bandNo, int overview, GDALDataType type,
+                            QgsGdalBlockUnit* units, int count, QAtomicInt* next, QAtomicInt* failed, QSemaphore* done )
+        : mDataset( dataset )
+        , mBandNo( bandNo )
+        , mOverview( overview )
+        , mType( type )
+        , mUnits( units )
+        , mCount( count )
+        , mNext( next )
+        , mFailed( failed )
+        , mDone( done )
+    {
+    }
+
+    void run() override
+    {
+      GDALRasterBandH band = levelBand( mDataset, mBandNo, mOverview );
+      for ( ;; )
+      {
+        int i = mNext->fetchAndAddOrdered( 1 );
+        if ( i >= mCount )
+          break;
+        if ( !band || readBlockUnit( band, mType, mUnits[i] ) != CE_None )
+          mFailed->fetchAndStoreOrdered( 1 );
+      }
+      mDone->release();
+    }
+
+  private:
+    GDALDatasetH mDataset;
+    int mBandNo;
+    int mOverview;
+    GDALDataType mType;
+    QgsGdalBlockUnit* mUnits;
+    int mCount;
+    QAtomicInt* mNext;
+    QAtomicInt* mFailed;
+    QSemaphore* mDone;
+};
+
+CPLErr QgsGdalProvider::readWindow( int theBandNo, int xOff, int yOff, int width, int height, void *buffer, int bufWidth, int bufHeight )
+{
+  GDALRasterBandH gdalBand = GDALGetRasterBand( mGdalDataset, theBandNo );
+  GDALDataType type = ( GDALDataType )mGdalDataType.at( theBandNo - 1 );
+
+  int cacheSize;
+  {
+    QMutexLocker locker( &sBlockCacheMutex );
+    initBlockCache();
+    cacheSize = sBlockCache.maxCost();
+  }
+
+  // Datasets opened for writing may change under the cache and warped VRTs
+  // cannot be reopened from the source, they are read directly
+  if ( mUpdate || mGdalDataset != mGdalBaseDataset || cacheSize <= 0 || width <= 0 || height <= 0 || bufWidth <= 0 || bufHeight <= 0 )
+  {
+    return gdalRasterIO( gdalBand, GF_Read, xOff, yOff, width, height, buffer, bufWidth, bufHeight, type, 0, 0 );
+  }
+
+  // Pick the coarsest overview which is still at least as fine as the output
+  int xSize = GDALGetRasterBandXSize( gdalBand );
+  int ySize = GDALGetRasterBandYSize( gdalBand );
+  double decimation = qMin( static_cast<double>( width ) / bufWidth, static_cast<double>( height ) / bufHeight );
+  int overview = -1;
+  GDALRasterBandH band = gdalBand;
+  int levelXSize = xSize;
+  int levelYSize = ySize;
+  int overviewCount = gdalGetOverviewCount( gdalBand );
+  for ( int i = 0; i < overviewCount; i++ )
+  {
+    GDALRasterBandH overviewBand = GDALGetOverview( gdalBand, i );
+    if ( !overviewBand )
+      continue;
+    int ovXSize = GDALGetRasterBandXSize( overviewBand );
+    int ovYSize = GDALGetRasterBandYSize( overviewBand );
+    if ( ovXSize <= 0 || ovYSize <= 0 || ovXSize >= levelXSize )
+      continue;
+    // overview sizes are rounded, allow for a small difference
+    double factor = qMin( static_cast<double>( xSize ) / ovXSize, static_cast<double>( ySize ) / ovYSize );
+    if ( factor <= decimation * 1.01 )
+    {
+      overview = i;
+      band = overviewBand;
+      levelXSize = ovXSize;
+      levelYSize = ovYSize;
+    }
+  }
+
+  double xScale = static_cast<double>( levelXSize ) / xSize;
+  double yScale = static_cast<double>( levelYSize ) / ySize;
+  int levelLeft = qBound( 0, static_cast<int>( floor( xOff * xScale ) ), levelXSize - 1 );
+  int levelTop = qBound( 0, static_cast<int>( floor( yOff * yScale ) ), levelYSize - 1 );
+  int levelRight = qBound( levelLeft + 1, static_cast<int>( ceil(( xOff + width ) * xScale ) ), levelXSize );
+  int levelBottom = qBound( levelTop + 1, static_cast<int>( ceil(( yOff + height ) * yScale ) ), levelYSize );
+
+  int blockXSize = 0;
+  int blockYSize = 0;
+  GDALGetBlockSize( band, &blockXSize, &blockYSize );
+
+  // Without a fitting overview most of the whole units would be wasted
+  if ( blockXSize <= 0 || blockYSize <= 0 ||
+       levelRight - levelLeft > MAX_BLOCK_UNIT_DECIMATION * bufWidth ||
+       levelBottom - levelTop > MAX_BLOCK_UNIT_DECIMATION * bufHeight )
+  {
+    return gdalRasterIO( gdalBand, GF_Read, xOff, yOff, width, height, buffer, bufWidth, bufHeight, type, 0, 0 );
+  }
+
+  int unitXSize = blockXSize;
+  int unitYSize = blockYSize;
+  while ( static_cast<qint64>( unitXSize ) * unitYSize < MIN_BLOCK_UNIT_CELLS && unitYSize < levelYSize )
+  {
+    unitYSize += blockYSize;
+  }
+
+  int firstUnitCol = levelLeft / unitXSize;
+  int firstUnitRow = levelTop / unitYSize;
+  int unitCols = ( levelRight - 1 ) / unitXSize - firstUnitCol + 1;
+  int unitRows = ( levelBottom - 1 ) / unitYSize - firstUnitRow + 1;
+
+  QString prefix = QString( "%1|%2|%3|%4|" ).arg( dataSourceUri() ).arg( theBandNo ).arg( overview ).arg( type );
+  QVector<QByteArray> unitData( unitCols * unitRows );
+  QVector<QgsGdalBlockUnit> missing;
+  {
+    QMutexLocker locker( &sBlockCacheMutex );
+    for ( int row = 0; row < unitRows; row++ )
+    {
+      for ( int col = 0; col < unitCols; col++ )
+      {
+        QgsGdalBlockUnit unit;
+        unit.index = row * unitCols + col;
+        unit.key = prefix + QString( "%1|%2" ).arg( firstUnitCol + col ).arg( firstUnitRow + row );
+        if ( QByteArray* data = sBlockCache.object( unit.key ) )
+        {
+          unitData[unit.index] = *data;
+          continue;
+        }
+        unit.xOff = ( firstUnitCol + col ) * unitXSize;
+        unit.yOff = ( firstUnitRow + row ) * unitYSize;
+        unit.width = qMin( unitXSize, levelXSize - unit.xOff );
+        unit.height = qMin( unitYSize, levelYSize - unit.yOff );
+        missing << unit;
+      }
+    }
+  }
+
+  bool failed = false;
+  if ( missing.size() == 1 )
+  {
+    failed = readBlockUnit( band, type, missing[0] ) != CE_None;
+  }
+  else if ( missing.size() > 1 )
+  {
+    // Each reader needs its own dataset handle, GDAL datasets are not thread safe.
+    // The handles are shared with the other providers of the source
+    QThreadPool* pool = blockReaderPool();
+    if ( !mUsesReadDatasets )
+    {
+      QMutexLocker locker( &sBlockCacheMutex );
+      sReadDatasets[dataSourceUri()].users++;
+      mUsesReadDatasets = true;
+    }
+    QList<GDALDatasetH> readDatasets;
+    QList<int> generations;
+    while ( readDatasets.size() < qMin( missing.size(), pool->maxThreadCount() ) )
+    {
+      int generation = 0;
+      GDALDatasetH dataset = acquireReadDataset( dataSourceUri(), generation );
+      if ( !dataset )
+        break;
+      readDatasets << dataset;
+      generations << generation;
+    }
+    int readers = readDatasets.size();
+
+    if ( readers == 0 )
+    {
+      failed = true;
+    }
+    else
+    {
+      QAtomicInt next( 0 );
+      QAtomicInt readFailed( 0 );
+      QSemaphore done;
+      for ( int i = 0; i < readers; i++ )
+      {
+        pool->start( new QgsGdalBlockUnitReader( readDatasets.at( i ), theBandNo, overview, type,
+                     missing.data(), missing.size(), &next, &readFailed, &done ) );
+      }
+      done.acquire( readers );
+      failed = readFailed.fetchAndAddOrdered( 0 ) != 0;
+    }
+
+    for ( int i = 0; i < readDatasets.size(); i++ )
+    {
+      releaseReadDataset( dataSourceUri(), readDatasets.at( i ), generations.at( i ) );
+    }
+  }
+
+  if ( failed )
+  {
+    QgsDebugMsg( "Block read failed, reading the window directly" );
+    return gdalRasterIO( gdalBand, GF_Read, xOff, yOff, width, height, buffer, bufWidth, bufHeight, type, 0, 0 );
+  }
+
+  if ( !missing.isEmpty() )
+  {
+    QMutexLocker locker( &sBlockCacheMutex );
+    Q_FOREACH ( const QgsGdalBlockUnit& unit, missing )
+    {
+      unitData[unit.index] = unit.data;
+      // the cost is the size of the unit, in kilobytes
+      sBlockCache.insert( unit.key, new QByteArray( unit.data ), unit.data.size() / 1024 + 1 );
+    }
+  }
+
+  // Nearest neighbour sampling of the cell centers, as GDALRasterIO does
+  int dataSize = GDALGetDataTypeSize( type ) / 8;
+  QVector<int> colUnit( bufWidth );
+  QVector<int> colOffset( bufWidth );
+  QVector<int> colUnitWidth( bufWidth );
+  for ( int col = 0; col < bufWidth; col++ )
+  {
+    double x = xOff + ( col + 0.5 ) * width / bufWidth;
+    int levelCol = qBound( levelLeft, static_cast<int>( floor( x * xScale ) ), levelRight - 1 );
+    int unitCol = levelCol / unitXSize;
+    colUnit[col] = unitCol - firstUnitCol;
+    colOffset[col] = levelCol - unitCol * unitXSize;
+    colUnitWidth[col] = qMin( unitXSize, levelXSize - unitCol * unitXSize );
+  }
+
+  char *dst = static_cast<char *>( buffer );
+  for ( int row = 0; row < bufHeight; row++ )
+  {
+    double y = yOff + ( row + 0.5 ) * height / bufHeight;
+    int levelRow = qBound( levelTop, static_cast<int>( floor( y * yScale ) ), levelBottom - 1 );
+    int unitRow = levelRow / unitYSize;
+    int rowOffset = levelRow - unitRow * unitYSize;
+    const QByteArray* rowUnits = unitData.constData() + ( unitRow - firstUnitRow ) * unitCols;
+    for ( int col = 0; col < bufWidth; col++ )
+    {
+      const char *src = rowUnits[colUnit[col]].constData() + dataSize * ( rowOffset * colUnitWidth[col] + colOffset[col] );
+      memcpy( dst, src, dataSize );
+      dst += dataSize;
+    }
+  }
+
+  return CE_None;
+}
+
+void QgsGdalProvider::resetReadDatasets( const QString& source )
+{
+  QList<GDALDatasetH> idle;
+  {
+    QMutexLocker locker( &sBlockCacheMutex );
+    QHash<QString, QgsGdalReadDatasets>::iterator it = sReadDatasets.find( source );
+    if ( it == sReadDatasets.end() )
+      return;
+    it->generation++;
+    idle = it->idle;
+    it->idle.clear();
+  }
+  Q_FOREACH ( GDALDatasetH dataset, idle )
+  {
+    GDALClose( dataset );
+  }
+}
+
+void QgsGdalProvider::releaseReadDatasetUser( const QString& source )
+{
+  QList<GDALDatasetH> idle;
+  {
+    QMutexLocker locker( &sBlockCacheMutex );
+    QHash<QString, QgsGdalReadDatasets>::iterator it = sReadDatasets.find( source );
+    if ( it == sReadDatasets.end() || --it->users > 0 )
+      return;
+    idle = it->idle;
+    sReadDatasets.erase( it );
+  }
+  Q_FOREACH ( GDALDatasetH dataset, idle )
+  {
+    GDALClose( dataset );
+  }
+}
+
+void QgsGdalProvider::invalidateBlockCache( const QString& source )
+{
+  QMutexLocker locker( &sBlockCacheMutex );
+  QString prefix = source + '|';
+  Q_FOREACH ( const QString& key, sBlockCache.keys() )
+  {
+    if ( key.startsWith( prefix ) )
+      sBlockCache.remove( key );
+  }
+}
+
 //void * QgsGdalProvider::readBlock( int bandNo, QgsRectangle  const & extent, int width, int height )
 //{
 //  return 0;
@@ -1722,6 +2155,10 @@ QString QgsGdalProvider::buildPyramids( const QList<QgsRasterPyramid> & theRaste
 
   QgsDebugMsg( "Pyramid overviews built" );
 
+  // the overviews of the cached blocks and of the read datasets are outdated
+  resetReadDatasets( dataSourceUri() );
+  invalidateBlockCache( dataSourceUri() );
+
   // Observed problem: if a *.rrd file exists and GDALBuildOverviews() is called,
   // the *.rrd is deleted and no overviews are created, if GDALBuildOverviews()
   // is called next time, it crashes somewhere in GDAL:
@@ -2815,6 +3252,7 @@ bool QgsGdalProvider::write( void* data, int band, int width, int height, int xO
   {
     return false;
   }
+  invalidateBlockCache( dataSourceUri() );
   return gdalRasterIO( rasterBand, GF_Write, xOffset, yOffset, width, height, data, width, height, GDALGetRasterDataType( rasterBand ), 0, 0 ) == CE_None;
 }
 
@@ -32,6 +32,7 @@
 #include <QDomElement>
 #include <QMap>
 #include <QVector>
+#include <QList>
 
 class QgsRasterPyramid;
 
@@ -248,6 +249,24 @@ class QgsGdalProvider : public QgsRasterDataProvider, QgsGdalProviderBase
     /** Do some initialization on the dataset (e.g. handling of south-up datasets)*/
     void initBaseDataset();
 
+    /** Read a window of a band into a buffer of bufWidth x bufHeight cells of
+     * the QGIS data type of the band, with nearest neighbour resampling, like
+     * GDALRasterIO. The best overview is picked explicitly and the data are
+     * read in units aligned to the native block size, which are decoded in
+     * parallel and kept in a cache shared by all the GDAL providers.
+     */
+    CPLErr readWindow( int theBandNo, int xOff, int yOff, int width, int height, void *buffer, int bufWidth, int bufHeight );
+
+    /** Close the idle read only datasets of a source shared by the parallel block
+     * readers, the datasets in use are closed when released. Called when the source changes */
+    static void resetReadDatasets( const QString& source );
+
+    //! Remove a provider from the users of the read only datasets of a source, and close them after the last one
+    static void releaseReadDatasetUser( const QString& source );
+
+    //! Remove the blocks of given data source from the block cache
+    static void invalidateBlockCache( const QString& source );
+
     /**
      * Flag indicating if the layer data source is a valid layer
      */
@@ -282,6 +301,9 @@ class QgsGdalProvider : public QgsRasterDataProvider, QgsGdalProviderBase
     /** \brief Pointer to the gdaldataset (possibly warped vrt) */
     GDALDatasetH mGdalDataset;
 
+    /** \brief Whether this provider is counted as a user of the read only datasets of its source */
+    bool mUsesReadDatasets;
+
     /** \brief Values for mapping pixel to world coordinates. Contents of this array are the same as the GDAL adfGeoTransform */
     double mGeoTransform[6];
 
@@ -803,8 +803,73 @@ void QgsSqliteHandle::closeAll()
   handles.clear();
 }
 
+//! maximum number of prepared statements kept per connection
+static const int STATEMENT_CACHE_SIZE = 32;
+
+sqlite3_stmt *QgsSqliteHandle::prepareCachedStatement( const QString& sql )
+{
+  for ( int i = 0; i < mStatementCache.size(); ++i )
+  {
+    if ( mStatementCache.at( i ).first == sql )
+    {
+      return mStatementCache.takeAt( i ).second;
+    }
+  }
+
+  if ( !sqlite_handle )
+    return nullptr;
+
+  sqlite3_stmt *stmt = nullptr;
+  if ( sqlite3_prepare_v2( sqlite_handle, sql.toUtf8().constData(), -1, &stmt, nullptr ) != SQLITE_OK )
+  {
+    sqlite3_finalize( stmt );
+    return nullptr;
+  }
+  return stmt;
+}
+
+void QgsSqliteHandle::releaseStatement( const QString& sql, sqlite3_stmt *stmt )
+{
+  if ( !stmt )
+    return;
+
+  if ( !sqlite_handle || sqlite3_reset( stmt ) != SQLITE_OK )
+  {
+    sqlite3_finalize( stmt );
+    return;
+  }
+  sqlite3_clear_bindings( stmt );
+
+  for ( int i = 0; i < mStatementCache.size(); ++i )
+  {
+    if ( mStatementCache.at( i ).first == sql )
+    {
+      // an identical statement is already cached
+      sqlite3_finalize( stmt );
+      return;
+    }
+  }
+
+  mStatementCache.prepend( qMakePair( sql, stmt ) );
+  while ( mStatementCache.size() > STATEMENT_CACHE_SIZE )
+  {
+    sqlite3_finalize( mStatementCache.takeLast().second );
+  }
+}
+
+void QgsSqliteHandle::clearStatementCache()
+{
+  for ( int i = 0; i < mStatementCache.size(); ++i )
+  {
+    sqlite3_finalize( mStatementCache.at( i ).second );
+  }
+  mStatementCache.clear();
+}
+
 void QgsSqliteHandle::sqliteClose()
 {
+  clearStatementCache();
+
   if ( sqlite_handle )
   {
     QgsSLConnect::sqlite3_close( sqlite_handle );
@@ -17,6 +17,7 @@
 
 #include <QStringList>
 #include <QObject>
+#include <QPair>
 
 extern "C"
 {
@@ -161,6 +162,26 @@ class QgsSqliteHandle
       mIsValid = false;
     }
 
+    /**
+     * Returns a prepared statement for \a sql. If a statement with the same
+     * text was released earlier it is taken out of the statement cache
+     * instead of being parsed and planned again. The caller owns the
+     * statement until it hands it back with releaseStatement().
+     * Returns nullptr if the statement could not be prepared.
+     * @note not thread safe, the handle must only be used by one thread at a time
+     */
+    sqlite3_stmt *prepareCachedStatement( const QString& sql );
+
+    /**
+     * Hands back a statement obtained through prepareCachedStatement(). The
+     * statement is reset and its bindings cleared before it is stored; the
+     * least recently used statement is finalized when the cache is full.
+     */
+    void releaseStatement( const QString& sql, sqlite3_stmt *stmt );
+
+    //! Finalizes all cached statements
+    void clearStatementCache();
+
     //
     // libsqlite3 wrapper
     //
@@ -183,6 +204,9 @@ class QgsSqliteHandle
     QString mDbPath;
     bool mIsValid;
 
+    //! cached prepared statements, most recently used first
+    QList< QPair<QString, sqlite3_stmt *> > mStatementCache;
+
     static QMap < QString, QgsSqliteHandle * > handles;
 };
 
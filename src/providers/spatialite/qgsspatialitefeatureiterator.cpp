@@ -27,6 +27,7 @@
 QgsSpatiaLiteFeatureIterator::QgsSpatiaLiteFeatureIterator( QgsSpatiaLiteFeatureSource* source, bool ownSource, const QgsFeatureRequest& request )
     : QgsAbstractFeatureIteratorFromSource<QgsSpatiaLiteFeatureSource>( source, ownSource, request )
     , sqliteStatement( nullptr )
+    , mRTreeJoin( false )
     , mExpressionCompiled( false )
 {
 
@@ -36,6 +37,12 @@ QgsSpatiaLiteFeatureIterator::QgsSpatiaLiteFeatureIterator( QgsSpatiaLiteFeature
   mHasPrimaryKey = !mSource->mPrimaryKey.isEmpty();
   mRowNumber = 0;
 
+  // rectangle requests against a plain table with a R*Tree index are driven
+  // directly by the index instead of going through an IN (...) subquery
+  mRTreeJoin = !request.filterRect().isNull() && request.filterRect().isFinite()
+               && !mSource->mGeometryColumn.isNull() && mSource->mSpatialIndexRTree
+               && !mSource->mIsQuery && !mSource->mViewBased && !mSource->mVShapeBased;
+
   QStringList whereClauses;
   bool useFallbackWhereClause = false;
   QString fallbackWhereClause;
@@ -216,8 +223,7 @@ bool QgsSpatiaLiteFeatureIterator::fetchFeature( QgsFeature& feature )
 
   if ( !getFeature( sqliteStatement, feature ) )
   {
-    sqlite3_finalize( sqliteStatement );
-    sqliteStatement = nullptr;
+    releaseStatement();
     close();
     return false;
   }
@@ -264,11 +270,7 @@ bool QgsSpatiaLiteFeatureIterator::close()
     return false;
   }
 
-  if ( sqliteStatement )
-  {
-    sqlite3_finalize( sqliteStatement );
-    sqliteStatement = nullptr;
-  }
+  releaseStatement();
 
   QgsSpatiaLiteConnPool::instance()->releaseConnection( mHandle );
   mHandle = nullptr;
@@ -316,6 +318,19 @@ bool QgsSpatiaLiteFeatureIterator::prepareStatement( const QString& whereClause,
     }
     sql += QString( " FROM %1" ).arg( mSource->mQuery );
 
+    if ( mRTreeJoin )
+    {
+      // the R*Tree drives the query, its MBR filter values are the first bound parameters
+      QString idxName = QString( "idx_%1_%2" ).arg( mSource->mIndexTable, mSource->mIndexGeometry );
+      QString pkidAlias = QgsSpatiaLiteProvider::quotedIdentifier( "_qgis_rtree_pkid" );
+      QString idxAlias = QgsSpatiaLiteProvider::quotedIdentifier( "_qgis_rtree" );
+      sql += QString( " JOIN (SELECT pkid AS %1 FROM %2 WHERE xmin <= ? AND xmax >= ? AND ymin <= ? AND ymax >= ?) AS %3 ON %4 = %3.%1" )
+             .arg( pkidAlias,
+                   QgsSpatiaLiteProvider::quotedIdentifier( idxName ),
+                   idxAlias,
+                   quotedPrimaryKey() );
+    }
+
     if ( !whereClause.isEmpty() )
       sql += QString( " WHERE %1" ).arg( whereClause );
 
@@ -323,14 +338,25 @@ bool QgsSpatiaLiteFeatureIterator::prepareStatement( const QString& whereClause,
       sql += QString( " ORDER BY %1" ).arg( orderBy );
 
     if ( limit >= 0 )
-      sql += QString( " LIMIT %1" ).arg( limit );
+      sql += " LIMIT ?";
 
-    if ( sqlite3_prepare_v2( mHandle->handle(), sql.toUtf8().constData(), -1, &sqliteStatement, nullptr ) != SQLITE_OK )
+    // statements of the same shape only differ in their bound values,
+    // so they can be reused from the cache of the connection
+    sqliteStatement = mHandle->prepareCachedStatement( sql );
+    if ( !sqliteStatement )
     {
       // some error occurred
       QgsMessageLog::logMessage( QObject::tr( "SQLite error: %2\nSQL: %1" ).arg( sql, sqlite3_errmsg( mHandle->handle() ) ), QObject::tr( "SpatiaLite" ) );
       return false;
     }
+    mStatementSql = sql;
+
+    if ( !bindParameters( limit ) )
+    {
+      QgsMessageLog::logMessage( QObject::tr( "SQLite error binding parameters: %2\nSQL: %1" ).arg( sql, sqlite3_errmsg( mHandle->handle() ) ), QObject::tr( "SpatiaLite" ) );
+      releaseStatement();
+      return false;
+    }
   }
   catch ( QgsSpatiaLiteProvider::SLFieldNotFound )
   {
@@ -341,25 +367,95 @@ bool QgsSpatiaLiteFeatureIterator::prepareStatement( const QString& whereClause,
   return true;
 }
 
+bool QgsSpatiaLiteFeatureIterator::bindParameters( long limit )
+{
+  int idx = 1;
+  Q_FOREACH ( const QVariant& value, mBindValues )
+  {
+    int ret;
+    if ( value.type() == QVariant::Double )
+      ret = sqlite3_bind_double( sqliteStatement, idx, value.toDouble() );
+    else
+      ret = sqlite3_bind_int64( sqliteStatement, idx, value.toLongLong() );
+
+    if ( ret != SQLITE_OK )
+      return false;
+    ++idx;
+  }
+
+  if ( limit >= 0 )
+    return sqlite3_bind_int64( sqliteStatement, idx, limit ) == SQLITE_OK;
+
+  return true;
+}
+
+void QgsSpatiaLiteFeatureIterator::releaseStatement()
+{
+  if ( !sqliteStatement )
+    return;
+
+  if ( mHandle )
+    mHandle->releaseStatement( mStatementSql, sqliteStatement );
+  else
+    sqlite3_finalize( sqliteStatement );
+
+  sqliteStatement = nullptr;
+  mStatementSql.clear();
+}
+
 QString QgsSpatiaLiteFeatureIterator::quotedPrimaryKey()
 {
-  return mSource->mPrimaryKey.isEmpty() ? "ROWID" : QgsSpatiaLiteProvider::quotedIdentifier( mSource->mPrimaryKey );
+  QString pk = mSource->mPrimaryKey.isEmpty() ? "ROWID" : QgsSpatiaLiteProvider::quotedIdentifier( mSource->mPrimaryKey );
+  // qualify the key, the joined R*Tree subquery would otherwise make ROWID ambiguous
+  return mRTreeJoin ? QString( "%1.%2" ).arg( mSource->mQuery, pk ) : pk;
 }
 
 QString QgsSpatiaLiteFeatureIterator::whereClauseFid()
 {
-  return QString( "%1=%2" ).arg( quotedPrimaryKey() ).arg( mRequest.filterFid() );
+  mBindValues << QVariant( mRequest.filterFid() );
+  return QString( "%1=?" ).arg( quotedPrimaryKey() );
 }
 
 QString QgsSpatiaLiteFeatureIterator::whereClauseFids()
 {
-  if ( mRequest.filterFids().isEmpty() )
+  const QgsFeatureIds& fids = mRequest.filterFids();
+  if ( fids.isEmpty() )
     return "";
 
   QString expr = QString( "%1 IN (" ).arg( quotedPrimaryKey() ), delim;
-  Q_FOREACH ( const QgsFeatureId featureId, mRequest.filterFids() )
+
+  if ( fids.size() > 256 )
+  {
+    // too many values for bound parameters, inline them
+    Q_FOREACH ( const QgsFeatureId featureId, fids )
+    {
+      expr += delim + QString::number( featureId );
+      delim = ',';
+    }
+    expr += ')';
+    return expr;
+  }
+
+  // round the number of placeholders up to a power of two by repeating the
+  // last id, so that requests for similar numbers of ids share one statement
+  int placeholders = 1;
+  while ( placeholders < fids.size() )
+    placeholders *= 2;
+
+  QgsFeatureId lastId = 0;
+  Q_FOREACH ( const QgsFeatureId featureId, fids )
+  {
+    mBindValues << QVariant( featureId );
+    lastId = featureId;
+  }
+  for ( int i = fids.size(); i < placeholders; ++i )
   {
-    expr += delim + QString::number( featureId );
+    mBindValues << QVariant( lastId );
+  }
+
+  for ( int i = 0; i < placeholders; ++i )
+  {
+    expr += delim + '?';
     delim = ',';
   }
   expr += ')';
@@ -369,63 +465,66 @@ QString QgsSpatiaLiteFeatureIterator::whereClauseFids()
 QString QgsSpatiaLiteFeatureIterator::whereClauseRect()
 {
   QgsRectangle rect = mRequest.filterRect();
-  QString whereClause;
 
+  if ( !mSource->mVShapeBased && !rect.isFinite() )
+  {
+    return "1";
+  }
+
+  if ( mRTreeJoin )
+  {
+    // values for the R*Tree subquery joined in prepareStatement()
+    mBindValues << rect.xMaximum() << rect.xMinimum() << rect.yMaximum() << rect.yMinimum();
+  }
+
+  QStringList clauses;
   if ( mRequest.flags() & QgsFeatureRequest::ExactIntersect )
   {
     // we are requested to evaluate a true INTERSECT relationship
-    whereClause += QString( "Intersects(%1, BuildMbr(%2)) AND " ).arg( QgsSpatiaLiteProvider::quotedIdentifier( mSource->mGeometryColumn ), mbr( rect ) );
+    clauses << QString( "Intersects(%1, BuildMbr(%2))" ).arg( QgsSpatiaLiteProvider::quotedIdentifier( mSource->mGeometryColumn ), mbr( rect ) );
   }
+
   if ( mSource->mVShapeBased )
   {
     // handling a VirtualShape layer
-    whereClause += QString( "MbrIntersects(%1, BuildMbr(%2))" ).arg( QgsSpatiaLiteProvider::quotedIdentifier( mSource->mGeometryColumn ), mbr( rect ) );
+    clauses << QString( "MbrIntersects(%1, BuildMbr(%2))" ).arg( QgsSpatiaLiteProvider::quotedIdentifier( mSource->mGeometryColumn ), mbr( rect ) );
   }
-  else if ( rect.isFinite() )
+  else if ( mRTreeJoin )
   {
-    if ( mSource->mSpatialIndexRTree )
-    {
-      // using the RTree spatial index
-      QString mbrFilter = QString( "xmin <= %1 AND " ).arg( qgsDoubleToString( rect.xMaximum() ) );
-      mbrFilter += QString( "xmax >= %1 AND " ).arg( qgsDoubleToString( rect.xMinimum() ) );
-      mbrFilter += QString( "ymin <= %1 AND " ).arg( qgsDoubleToString( rect.yMaximum() ) );
-      mbrFilter += QString( "ymax >= %1" ).arg( qgsDoubleToString( rect.yMinimum() ) );
-      QString idxName = QString( "idx_%1_%2" ).arg( mSource->mIndexTable, mSource->mIndexGeometry );
-      whereClause += QString( "%1 IN (SELECT pkid FROM %2 WHERE %3)" )
-                     .arg( quotedPrimaryKey(),
-                           QgsSpatiaLiteProvider::quotedIdentifier( idxName ),
-                           mbrFilter );
-    }
-    else if ( mSource->mSpatialIndexMbrCache )
-    {
-      // using the MbrCache spatial index
-      QString idxName = QString( "cache_%1_%2" ).arg( mSource->mIndexTable, mSource->mIndexGeometry );
-      whereClause += QString( "%1 IN (SELECT rowid FROM %2 WHERE mbr = FilterMbrIntersects(%3))" )
-                     .arg( quotedPrimaryKey(),
-                           QgsSpatiaLiteProvider::quotedIdentifier( idxName ),
-                           mbr( rect ) );
-    }
-    else
-    {
-      // using simple MBR filtering
-      whereClause += QString( "MbrIntersects(%1, BuildMbr(%2))" ).arg( QgsSpatiaLiteProvider::quotedIdentifier( mSource->mGeometryColumn ), mbr( rect ) );
-    }
+    // MBR filtering is done by the joined R*Tree
+  }
+  else if ( mSource->mSpatialIndexRTree )
+  {
+    // using the RTree spatial index
+    mBindValues << rect.xMaximum() << rect.xMinimum() << rect.yMaximum() << rect.yMinimum();
+    QString idxName = QString( "idx_%1_%2" ).arg( mSource->mIndexTable, mSource->mIndexGeometry );
+    clauses << QString( "%1 IN (SELECT pkid FROM %2 WHERE xmin <= ? AND xmax >= ? AND ymin <= ? AND ymax >= ?)" )
+    .arg( quotedPrimaryKey(),
+          QgsSpatiaLiteProvider::quotedIdentifier( idxName ) );
+  }
+  else if ( mSource->mSpatialIndexMbrCache )
+  {
+    // using the MbrCache spatial index
+    QString idxName = QString( "cache_%1_%2" ).arg( mSource->mIndexTable, mSource->mIndexGeometry );
+    clauses << QString( "%1 IN (SELECT rowid FROM %2 WHERE mbr = FilterMbrIntersects(%3))" )
+    .arg( quotedPrimaryKey(),
+          QgsSpatiaLiteProvider::quotedIdentifier( idxName ),
+          mbr( rect ) );
   }
   else
   {
-    whereClause = '1';
+    // using simple MBR filtering
+    clauses << QString( "MbrIntersects(%1, BuildMbr(%2))" ).arg( QgsSpatiaLiteProvider::quotedIdentifier( mSource->mGeometryColumn ), mbr( rect ) );
   }
-  return whereClause;
+
+  return clauses.join( " AND " );
 }
 
 
 QString QgsSpatiaLiteFeatureIterator::mbr( const QgsRectangle& rect )
 {
-  return QString( "%1, %2, %3, %4" )
-         .arg( qgsDoubleToString( rect.xMinimum() ),
-               qgsDoubleToString( rect.yMinimum() ),
-               qgsDoubleToString( rect.xMaximum() ),
-               qgsDoubleToString( rect.yMaximum() ) );
+  mBindValues << rect.xMinimum() << rect.yMinimum() << rect.xMaximum() << rect.yMaximum();
+  return "?, ?, ?, ?";
 }
 
 
@@ -80,6 +80,8 @@ class QgsSpatiaLiteFeatureIterator : public QgsAbstractFeatureIteratorFromSource
     QString whereClauseFids();
     QString mbr( const QgsRectangle& rect );
     bool prepareStatement( const QString& whereClause, long limit = -1 , const QString& orderBy = QString() );
+    bool bindParameters( long limit );
+    void releaseStatement();
     QString quotedPrimaryKey();
     bool getFeature( sqlite3_stmt *stmt, QgsFeature &feature );
     QString fieldName( const QgsField& fld );
@@ -94,6 +96,15 @@ class QgsSpatiaLiteFeatureIterator : public QgsAbstractFeatureIteratorFromSource
      */
     sqlite3_stmt *sqliteStatement;
 
+    //! SQL text of the current statement, used as key in the statement cache of the connection
+    QString mStatementSql;
+
+    //! values bound to the placeholders of the FROM and WHERE clauses, in order of appearance
+    QList<QVariant> mBindValues;
+
+    //! true if the rectangle filter is evaluated by joining the R*Tree spatial index
+    bool mRTreeJoin;
+
     /** Geometry column index used when fetching geometry */
     int mGeomColIdx;
 
@@ -35,6 +35,7 @@ const QString QgsWFSConstants::URI_PARAM_IGNOREAXISORIENTATION( "IgnoreAxisOrien
 const QString QgsWFSConstants::URI_PARAM_INVERTAXISORIENTATION( "InvertAxisOrientation" );
 const QString QgsWFSConstants::URI_PARAM_VALIDATESQLFUNCTIONS( "validateSQLFunctions" );
 const QString QgsWFSConstants::URI_PARAM_HIDEDOWNLOADPROGRESSDIALOG( "hideDownloadProgressDialog" );
+const QString QgsWFSConstants::URI_PARAM_PAGINGPARALLELISM( "pagingParallelism" );
 
 const QString QgsWFSConstants::VERSION_AUTO( "auto" );
 
@@ -177,6 +177,13 @@ bool QgsWFSDataSourceURI::hideDownloadProgressDialog() const
   return mURI.hasParam( QgsWFSConstants::URI_PARAM_HIDEDOWNLOADPROGRESSDIALOG );
 }
 
+int QgsWFSDataSourceURI::pagingParallelism() const
+{
+  if ( !mURI.hasParam( QgsWFSConstants::URI_PARAM_PAGINGPARALLELISM ) )
+    return 0;
+  return mURI.param( QgsWFSConstants::URI_PARAM_PAGINGPARALLELISM ).toInt();
+}
+
 QString QgsWFSDataSourceURI::build( const QString& baseUri,
                                     const QString& typeName,
                                     const QString& crsString,
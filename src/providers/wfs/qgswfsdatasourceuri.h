@@ -119,6 +119,9 @@ class QgsWFSDataSourceURI
     /** Whether to hide download progress dialog in QGIS main app. Defaults to false */
     bool hideDownloadProgressDialog() const;
 
+    /** Maximum number of GetFeature pages downloaded concurrently, or 0 if not set in the URI */
+    int pagingParallelism() const;
+
     /** Return authorization parameters */
     QgsWFSAuthorization& auth() { return mAuth; }
 
@@ -31,6 +31,7 @@
 #include <QTimer>
 #include <QSettings>
 #include <QStyle>
+#include <QtConcurrentRun>
 
 QgsWFSFeatureHitsAsyncRequest::QgsWFSFeatureHitsAsyncRequest( QgsWFSDataSourceURI& uri )
     : QgsWfsRequest( uri.uri() )
@@ -78,6 +79,63 @@ QString QgsWFSFeatureHitsAsyncRequest::errorMessageWithReason( const QString& re
 
 // -------------------------
 
+QgsWFSFeaturePageRequest::QgsWFSFeaturePageRequest( QgsWFSDataSourceURI& uri, QgsGmlStreamingParser* parser, int startIndex )
+    : QgsWfsRequest( uri.uri() )
+    , mStartIndex( startIndex )
+    , mParser( parser )
+    , mReady( false )
+    , mParseSucceeded( false )
+{
+  connect( this, SIGNAL( downloadFinished() ), this, SLOT( startParsing() ) );
+  connect( &mWatcher, SIGNAL( finished() ), this, SLOT( parsingFinished() ) );
+}
+
+QgsWFSFeaturePageRequest::~QgsWFSFeaturePageRequest()
+{
+  abort();
+  // the parser might still be in use by the worker thread
+  mWatcher.waitForFinished();
+  delete mParser;
+}
+
+void QgsWFSFeaturePageRequest::launch( const QUrl& url )
+{
+  sendGET( url,
+           false, /* synchronous */
+           true, /* forceRefresh */
+           false /* cache */ );
+}
+
+void QgsWFSFeaturePageRequest::startParsing()
+{
+  if ( mErrorCode != NoError )
+  {
+    mReady = true;
+    emit pageReady();
+    return;
+  }
+  mWatcher.setFuture( QtConcurrent::run( this, &QgsWFSFeaturePageRequest::parse ) );
+}
+
+void QgsWFSFeaturePageRequest::parse()
+{
+  mParseSucceeded = mParser->processData( mResponse, true, mParseErrorMessage );
+  mResponse.clear();
+}
+
+void QgsWFSFeaturePageRequest::parsingFinished()
+{
+  mReady = true;
+  emit pageReady();
+}
+
+QString QgsWFSFeaturePageRequest::errorMessageWithReason( const QString& reason )
+{
+  return tr( "Download of features failed: %1" ).arg( reason );
+}
+
+// -------------------------
+
 QgsWFSFeatureDownloader::QgsWFSFeatureDownloader( QgsWFSSharedData* shared )
     : QgsWfsRequest( shared->mURI.uri() )
     , mShared( shared )
@@ -91,14 +149,21 @@ QgsWFSFeatureDownloader::QgsWFSFeatureDownloader( QgsWFSSharedData* shared )
     , mTimer( nullptr )
     , mFeatureHitsAsyncRequest( shared->mURI )
     , mTotalDownloadedFeatureCount( 0 )
+    , mPagingParallelism( shared->mURI.pagingParallelism() )
+    , mPipelinedParsing( QSettings().value( "/qgis/wfsPipelinedParsing", false ).toBool() )
 {
   // Needed because used by a signal
   qRegisterMetaType< QVector<QgsWFSFeatureGmlIdPair> >( "QVector<QgsWFSFeatureGmlIdPair>" );
+
+  if ( mPagingParallelism <= 0 )
+    mPagingParallelism = QSettings().value( "/qgis/wfsPagingParallelism", 1 ).toInt();
+  mPagingParallelism = qBound( 1, mPagingParallelism, 16 );
 }
 
 QgsWFSFeatureDownloader::~QgsWFSFeatureDownloader()
 {
   stop();
+  clearPageRequests();
 
   if ( mProgressDialog )
     mProgressDialog->deleteLater();
@@ -326,6 +391,30 @@ QUrl QgsWFSFeatureDownloader::buildURL( int startIndex, int maxFeatures, bool fo
   return getFeatureUrl;
 }
 
+void QgsWFSFeatureDownloader::schedulePageRequests( int startIndex, int pageSize, QEventLoop& loop )
+{
+  int nextStartIndex = mPageRequests.isEmpty() ? startIndex : mPageRequests.last()->startIndex() + pageSize;
+  while ( mPageRequests.size() < mPagingParallelism )
+  {
+    // Do not go beyond the announced number of features, except for the
+    // page we need right now
+    if ( !mPageRequests.isEmpty() && mNumberMatched > 0 && nextStartIndex >= mNumberMatched )
+      break;
+
+    QgsWFSFeaturePageRequest* page = new QgsWFSFeaturePageRequest( mShared->mURI, mShared->createParser(), nextStartIndex );
+    connect( page, SIGNAL( pageReady() ), &loop, SLOT( quit() ) );
+    page->launch( buildURL( nextStartIndex, pageSize, false ) );
+    mPageRequests.append( page );
+    nextStartIndex += pageSize;
+  }
+}
+
+void QgsWFSFeatureDownloader::clearPageRequests()
+{
+  qDeleteAll( mPageRequests );
+  mPageRequests.clear();
+}
+
 // Called when we get the response of the asynchronous RESULTTYPE=hits request
 void QgsWFSFeatureDownloader::gotHitsResponse()
 {
@@ -406,10 +495,11 @@ void QgsWFSFeatureDownloader::run( bool serializeFeatures, int maxFeatures )
   while ( true )
   {
     success = true;
-    QgsGmlStreamingParser* parser = mShared->createParser();
+    QgsGmlStreamingParser* parser = nullptr;
+    QgsWFSFeaturePageRequest* page = nullptr;
+    const int pageSize = maxFeatures ? maxFeatures : mShared->mMaxFeatures;
 
-    QUrl url( buildURL( mTotalDownloadedFeatureCount,
-                        maxFeatures ? maxFeatures : mShared->mMaxFeatures, false ) );
+    QUrl url( buildURL( mTotalDownloadedFeatureCount, pageSize, false ) );
 
     // Small hack for testing purposes
     if ( retryIter > 0 && url.toString().contains( "fake_qgis_http_endpoint" ) )
@@ -417,46 +507,97 @@ void QgsWFSFeatureDownloader::run( bool serializeFeatures, int maxFeatures )
       url.addQueryItem( "RETRY", QString::number( retryIter ) );
     }
 
-    sendGET( url,
-             false, /* synchronous */
-             true, /* forceRefresh */
-             false /* cache */ );
+    if ( mPagingParallelism > 1 && mSupportsPaging && pageSize > 0 && maxFeatures != 1 && retryIter == 0 )
+    {
+      // Download the following pages concurrently. They are still consumed
+      // in order, so that the paging heuristics below see them one after
+      // the other.
+      if ( !mPageRequests.isEmpty() && mPageRequests.first()->startIndex() != mTotalDownloadedFeatureCount )
+      {
+        // The server did not return the number of features we expected
+        clearPageRequests();
+      }
+      schedulePageRequests( mTotalDownloadedFeatureCount, pageSize, loop );
+      page = mPageRequests.takeFirst();
+      parser = page->parser();
+    }
+    else
+    {
+      parser = mShared->createParser();
+      // Optionally build geometries and convert attributes in worker threads
+      // while the response is being downloaded and tokenized. wkbType() then
+      // only reflects the features already returned by the parser
+      parser->setPipelined( mPipelinedParsing );
+      sendGET( url,
+               false, /* synchronous */
+               true, /* forceRefresh */
+               false /* cache */ );
+    }
 
     int featureCountForThisResponse = 0;
     while ( true )
     {
-      loop.exec( QEventLoop::ExcludeUserInputEvents );
+      if ( page )
+      {
+        while ( !page->isReady() && !mStop )
+          loop.exec( QEventLoop::ExcludeUserInputEvents );
+      }
+      else
+      {
+        loop.exec( QEventLoop::ExcludeUserInputEvents );
+      }
       if ( mStop )
       {
         interrupted = true;
         success = false;
         break;
       }
+      if ( page && page->errorCode() != NoError )
+      {
+        mErrorMessage = page->errorMessage();
+        success = false;
+        break;
+      }
       if ( mErrorCode != NoError )
       {
         success = false;
         break;
       }
 
-      QByteArray data;
       bool finished = false;
-      if ( mReply )
+      if ( page )
       {
-        data = mReply->readAll();
-      }
-      else
-      {
-        data = mResponse;
+        // The whole response has already been parsed in a worker thread
         finished = true;
+        if ( !page->parseSucceeded() )
+        {
+          success = false;
+          mErrorMessage = tr( "Error when parsing GetFeature response" ) + " : " + page->parseErrorMessage();
+          QgsMessageLog::logMessage( mErrorMessage, tr( "WFS" ) );
+          break;
+        }
       }
-      // Parse the received chunk of data
-      QString gmlProcessErrorMsg;
-      if ( !parser->processData( data, finished, gmlProcessErrorMsg ) )
+      else
       {
-        success = false;
-        mErrorMessage = tr( "Error when parsing GetFeature response" ) + " : " + gmlProcessErrorMsg;
-        QgsMessageLog::logMessage( mErrorMessage, tr( "WFS" ) );
-        break;
+        QByteArray data;
+        if ( mReply )
+        {
+          data = mReply->readAll();
+        }
+        else
+        {
+          data = mResponse;
+          finished = true;
+        }
+        // Parse the received chunk of data
+        QString gmlProcessErrorMsg;
+        if ( !parser->processData( data, finished, gmlProcessErrorMsg ) )
+        {
+          success = false;
+          mErrorMessage = tr( "Error when parsing GetFeature response" ) + " : " + gmlProcessErrorMsg;
+          QgsMessageLog::logMessage( mErrorMessage, tr( "WFS" ) );
+          break;
+        }
       }
       if ( parser->isException() && finished )
       {
@@ -598,7 +739,10 @@ void QgsWFSFeatureDownloader::run( bool serializeFeatures, int maxFeatures )
 
           featureList.push_back( QgsWFSFeatureGmlIdPair( f, gmlId ) );
           delete featPair.first;
-          if (( i > 0 && ( i % 1000 ) == 0 ) || i + 1 == featurePtrList.size() )
+          // Pages downloaded in advance are complete, so they are cached in
+          // a single transaction. Streamed responses are flushed regularly
+          // to notify the subscribers early.
+          if (( !page && i > 0 && ( i % 1000 ) == 0 ) || i + 1 == featurePtrList.size() )
           {
             // We call it directly to avoid asynchronous signal notification, and
             // as serializeFeatures() can modify the featureList to remove features
@@ -631,12 +775,16 @@ void QgsWFSFeatureDownloader::run( bool serializeFeatures, int maxFeatures )
       }
     }
 
-    delete parser;
+    if ( page )
+      delete page;
+    else
+      delete parser;
 
     if ( mStop )
       break;
     if ( !success )
     {
+      clearPageRequests();
       if ( ++retryIter <= maxRetry )
       {
         QgsMessageLog::logMessage( tr( "Retrying request %1: %2/%3" ).arg( url.toString() ).arg( retryIter ).arg( maxRetry ), tr( "WFS" ) );
@@ -661,6 +809,7 @@ void QgsWFSFeatureDownloader::run( bool serializeFeatures, int maxFeatures )
     ++ pagingIter;
     if ( disablePaging )
     {
+      clearPageRequests();
       mSupportsPaging = mShared->mCaps.supportsPaging = false;
       mTotalDownloadedFeatureCount = 0;
       if ( mShared->mMaxFeaturesWasSetFromDefaultForPaging )
@@ -670,6 +819,7 @@ void QgsWFSFeatureDownloader::run( bool serializeFeatures, int maxFeatures )
     }
   }
 
+  clearPageRequests();
   mStop = true;
 
   if ( serializeFeatures )
@@ -22,6 +22,7 @@
 #include "qgsgml.h"
 #include "qgsspatialindex.h"
 
+#include <QFutureWatcher>
 #include <QProgressDialog>
 #include <QPushButton>
 
@@ -29,6 +30,7 @@ class QgsWFSProvider;
 class QgsWFSSharedData;
 class QgsVectorDataProvider;
 class QProgressDialog;
+class QEventLoop;
 
 typedef QPair<QgsFeature, QString> QgsWFSFeatureGmlIdPair;
 
@@ -60,6 +62,58 @@ class QgsWFSFeatureHitsAsyncRequest: public QgsWfsRequest
 };
 
 
+/** Utility class to download one page of a paged GetFeature request ahead
+    of time. Once the response is received, it is parsed on a worker thread,
+    and pageReady() is emitted in the thread of the object. */
+class QgsWFSFeaturePageRequest: public QgsWfsRequest
+{
+    Q_OBJECT
+  public:
+    /** Constructor. Takes ownership of parser */
+    QgsWFSFeaturePageRequest( QgsWFSDataSourceURI& uri, QgsGmlStreamingParser* parser, int startIndex );
+    ~QgsWFSFeaturePageRequest();
+
+    /** Start the download of the page */
+    void launch( const QUrl& url );
+
+    /** Index of the first feature of the page */
+    int startIndex() const { return mStartIndex; }
+
+    /** Whether the response has been downloaded and parsed (or the download failed) */
+    bool isReady() const { return mReady; }
+
+    /** Whether parsing succeeded. Only meaningful once isReady() */
+    bool parseSucceeded() const { return mParseSucceeded; }
+
+    /** Parsing error message */
+    const QString& parseErrorMessage() const { return mParseErrorMessage; }
+
+    /** Parser that has consumed the whole response. Owned by the page */
+    QgsGmlStreamingParser* parser() { return mParser; }
+
+  signals:
+    /** Emitted when the page is downloaded and parsed, or when the download failed */
+    void pageReady();
+
+  protected:
+    virtual QString errorMessageWithReason( const QString& reason ) override;
+
+  private slots:
+    void startParsing();
+    void parsingFinished();
+
+  private:
+    /** Run in a worker thread */
+    void parse();
+
+    int mStartIndex;
+    QgsGmlStreamingParser* mParser;
+    QFutureWatcher<void> mWatcher;
+    bool mReady;
+    bool mParseSucceeded;
+    QString mParseErrorMessage;
+};
+
 /** Utility class for QgsWFSFeatureDownloader */
 class QgsWFSProgressDialog: public QProgressDialog
 {
@@ -134,6 +188,10 @@ class QgsWFSFeatureDownloader: public QgsWfsRequest
     QUrl buildURL( int startIndex, int maxFeatures, bool forHits );
     void pushError( const QString& errorMsg );
     QString sanitizeFilter( QString filter );
+    /** Issue the requests for the pages following startIndex, up to the paging parallelism */
+    void schedulePageRequests( int startIndex, int pageSize, QEventLoop& loop );
+    /** Abort and delete pages downloaded in advance */
+    void clearPageRequests();
 
     /** Mutable data shared between provider, feature sources and downloader. */
     QgsWFSSharedData* mShared;
@@ -151,6 +209,12 @@ class QgsWFSFeatureDownloader: public QgsWfsRequest
     QTimer* mTimer;
     QgsWFSFeatureHitsAsyncRequest mFeatureHitsAsyncRequest;
     int mTotalDownloadedFeatureCount;
+    /** Maximum number of pages downloaded concurrently. 1 means sequential paging */
+    int mPagingParallelism;
+    /** Whether geometries are built in worker threads while a response is streamed (/qgis/wfsPipelinedParsing setting) */
+    bool mPipelinedParsing;
+    /** Pages downloaded in advance, by increasing start index */
+    QList<QgsWFSFeaturePageRequest*> mPageRequests;
 };
 
 /** Downloader thread */
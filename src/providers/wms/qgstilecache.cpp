@@ -0,0 +1,266 @@
+/***************************************************************************
+    qgstilecache.cpp
+    ---------------------
+    begin                : October 2016
+    copyright            : (C) 2016 by the QGIS project
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgstilecache.h"
+
+#include "qgslogger.h"
+#include "qgsnetworkaccessmanager.h"
+#include "qgswmscapabilities.h"
+
+#include <QAbstractNetworkCache>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QLocale>
+#include <QMutexLocker>
+#include <QNetworkReply>
+#include <QRegExp>
+#include <QSettings>
+#include <QThread>
+
+//! Maximum number of prefetch requests running at the same time
+static const int MAX_RUNNING_PREFETCH_REQUESTS = 4;
+
+QCache<QUrl, QgsTileCache::CachedTile> QgsTileCache::sTileCache;
+QMutex QgsTileCache::sTileCacheMutex;
+bool QgsTileCache::sInitialized = false;
+
+void QgsTileCache::init()
+{
+  if ( sInitialized )
+    return;
+
+  QSettings s;
+  sTileCache.setMaxCost( s.value( "/qgis/tileCacheMemorySize", 64 * 1024 ).toInt() );
+  sInitialized = true;
+}
+
+void QgsTileCache::insertTile( const QUrl& url, const QImage& image, const QDateTime& expiry, const QString& layerUri )
+{
+  QMutexLocker locker( &sTileCacheMutex );
+  init();
+  CachedTile* tile = new CachedTile;
+  tile->image = image;
+  tile->expiry = expiry;
+  tile->layerUri = layerUri;
+  // the cost is the size of the decoded image, in kilobytes
+  sTileCache.insert( url, tile, image.byteCount() / 1024 + 1 );
+}
+
+QgsTileCache::CachedTile* QgsTileCache::validTile( const QUrl& url )
+{
+  CachedTile* tile = sTileCache.object( url );
+  if ( tile && tile->expiry.isValid() && tile->expiry < QDateTime::currentDateTime() )
+  {
+    sTileCache.remove( url );
+    return nullptr;
+  }
+  return tile;
+}
+
+bool QgsTileCache::tile( const QUrl& url, QImage& image )
+{
+  QMutexLocker locker( &sTileCacheMutex );
+  if ( CachedTile* tile = validTile( url ) )
+  {
+    image = tile->image;
+    return true;
+  }
+  return false;
+}
+
+bool QgsTileCache::contains( const QUrl& url )
+{
+  QMutexLocker locker( &sTileCacheMutex );
+  return validTile( url );
+}
+
+void QgsTileCache::removeLayerTiles( const QString& layerUri )
+{
+  QMutexLocker locker( &sTileCacheMutex );
+  Q_FOREACH ( const QUrl& url, sTileCache.keys() )
+  {
+    if ( sTileCache.object( url )->layerUri == layerUri )
+      sTileCache.remove( url );
+  }
+}
+
+int QgsTileCache::count()
+{
+  QMutexLocker locker( &sTileCacheMutex );
+  return sTileCache.count();
+}
+
+int QgsTileCache::totalCost()
+{
+  QMutexLocker locker( &sTileCacheMutex );
+  return sTileCache.totalCost();
+}
+
+int QgsTileCache::maxCost()
+{
+  QMutexLocker locker( &sTileCacheMutex );
+  init();
+  return sTileCache.maxCost();
+}
+
+void QgsTileCache::setMaxCost( int kilobytes )
+{
+  QMutexLocker locker( &sTileCacheMutex );
+  sInitialized = true;
+  sTileCache.setMaxCost( kilobytes );
+}
+
+void QgsTileCache::clear()
+{
+  QMutexLocker locker( &sTileCacheMutex );
+  sTileCache.clear();
+}
+
+QDateTime QgsTileCache::updateNetworkCacheExpiry( const QUrl& url )
+{
+  QAbstractNetworkCache* cache = QgsNetworkAccessManager::instance()->cache();
+  if ( !cache )
+    return QDateTime();
+
+  QNetworkCacheMetaData cmd = cache->metaData( url );
+  if ( !cmd.isValid() )
+    return QDateTime();
+
+  QNetworkCacheMetaData::RawHeaderList hl;
+  Q_FOREACH ( const QNetworkCacheMetaData::RawHeader &h, cmd.rawHeaders() )
+  {
+    if ( h.first != "Cache-Control" )
+      hl.append( h );
+  }
+  cmd.setRawHeaders( hl );
+
+  QgsDebugMsg( QString( "expirationDate:%1" ).arg( cmd.expirationDate().toString() ) );
+  if ( cmd.expirationDate().isNull() )
+  {
+    QSettings s;
+    cmd.setExpirationDate( QDateTime::currentDateTime().addSecs( s.value( "/qgis/defaultTileExpiry", "24" ).toInt() * 60 * 60 ) );
+  }
+
+  cache->updateMetaData( cmd );
+  return cmd.expirationDate();
+}
+
+QDateTime QgsTileCache::replyExpiry( QNetworkReply* reply )
+{
+  QDateTime expiry = updateNetworkCacheExpiry( reply->request().url() );
+  if ( expiry.isValid() )
+    return expiry;
+
+  QDateTime now = QDateTime::currentDateTime();
+  QString cacheControl = QString::fromLatin1( reply->rawHeader( "Cache-Control" ) );
+  if ( cacheControl.contains( "no-store", Qt::CaseInsensitive ) || cacheControl.contains( "no-cache", Qt::CaseInsensitive ) )
+    return now;
+
+  QRegExp maxAge( "max-age\\s*=\\s*(\\d+)", Qt::CaseInsensitive );
+  if ( maxAge.indexIn( cacheControl ) >= 0 )
+    return now.addSecs( maxAge.cap( 1 ).toInt() );
+
+  if ( reply->hasRawHeader( "Expires" ) )
+  {
+    // RFC 1123 date, e.g. "Thu, 01 Dec 1994 16:00:00 GMT". An invalid date means already expired
+    QDateTime expires = QLocale::c().toDateTime( QString::fromLatin1( reply->rawHeader( "Expires" ) ).trimmed(), "ddd, dd MMM yyyy hh:mm:ss 'GMT'" );
+    if ( !expires.isValid() )
+      return now;
+    expires.setTimeSpec( Qt::UTC );
+    return expires.toLocalTime();
+  }
+
+  QSettings s;
+  return now.addSecs( s.value( "/qgis/defaultTileExpiry", "24" ).toInt() * 60 * 60 );
+}
+
+
+// ----------
+
+
+QgsWmsTilePrefetcher::QgsWmsTilePrefetcher()
+{
+}
+
+QgsWmsTilePrefetcher* QgsWmsTilePrefetcher::instance()
+{
+  static QMutex sMutex;
+  static QgsWmsTilePrefetcher* sInstance = nullptr;
+
+  QMutexLocker locker( &sMutex );
+  if ( !sInstance && QCoreApplication::instance() )
+  {
+    sInstance = new QgsWmsTilePrefetcher();
+    sInstance->moveToThread( QCoreApplication::instance()->thread() );
+  }
+  return sInstance;
+}
+
+void QgsWmsTilePrefetcher::prefetch( const QList<QNetworkRequest>& requests )
+{
+  {
+    QMutexLocker locker( &mMutex );
+    // requests queued for a previous view are no longer useful
+    mQueue = requests;
+  }
+  QMetaObject::invokeMethod( this, "sendRequests", Qt::QueuedConnection );
+}
+
+void QgsWmsTilePrefetcher::sendRequests()
+{
+  QMutexLocker locker( &mMutex );
+  while ( mReplies.size() < MAX_RUNNING_PREFETCH_REQUESTS && !mQueue.isEmpty() )
+  {
+    QNetworkRequest request = mQueue.takeFirst();
+    if ( QgsTileCache::contains( request.url() ) )
+      continue;
+
+    QNetworkReply* reply = QgsNetworkAccessManager::instance()->get( request );
+    connect( reply, SIGNAL( finished() ), this, SLOT( replyFinished() ) );
+    mReplies << reply;
+  }
+}
+
+void QgsWmsTilePrefetcher::replyFinished()
+{
+  QNetworkReply* reply = qobject_cast<QNetworkReply*>( sender() );
+  if ( !reply )
+    return;
+
+  // Redirections, server errors and non image contents are left to the
+  // regular tile requests, which report them
+  QVariant status = reply->attribute( QNetworkRequest::HttpStatusCodeAttribute );
+  if ( reply->error() == QNetworkReply::NoError &&
+       reply->attribute( QNetworkRequest::RedirectionTargetAttribute ).isNull() &&
+       ( status.isNull() || status.toInt() < 400 ) )
+  {
+    QDateTime expiry = QgsTileCache::replyExpiry( reply );
+
+    QImage image = QImage::fromData( reply->readAll() );
+    if ( !image.isNull() )
+      QgsTileCache::insertTile( reply->request().url(), image, expiry, reply->request().attribute( static_cast<QNetworkRequest::Attribute>( TileLayerUri ) ).toString() );
+  }
+  else
+  {
+    QgsDebugMsg( QString( "Tile prefetch failed [%1]" ).arg( reply->url().toString() ) );
+  }
+
+  {
+    QMutexLocker locker( &mMutex );
+    mReplies.removeOne( reply );
+  }
+  reply->deleteLater();
+
+  sendRequests();
+}
@@ -0,0 +1,146 @@
+/***************************************************************************
+    qgstilecache.h
+    ---------------------
+    begin                : October 2016
+    copyright            : (C) 2016 by the QGIS project
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef QGSTILECACHE_H
+#define QGSTILECACHE_H
+
+#include <QCache>
+#include <QDateTime>
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QNetworkRequest>
+#include <QObject>
+#include <QUrl>
+
+class QNetworkReply;
+
+/** A simple tile cache shared by all WMS-C/WMTS layers.
+ *
+ * Tiles are keyed by their URL, which identifies the layer, style, tile
+ * matrix and tile coordinates. Decoded tiles are kept in memory, in a cache
+ * bounded by the "/qgis/tileCacheMemorySize" setting (in kilobytes). The
+ * persistent, disk bounded, cache is the network disk cache of
+ * QgsNetworkAccessManager. Tiles in memory expire like their network
+ * replies, and are dropped with the other tiles of their layer when the
+ * layer is reloaded.
+ *
+ * All methods are thread-safe.
+ */
+class QgsTileCache
+{
+  public:
+
+    /** Add a tile image with given URL to the cache
+     * @param url tile URL
+     * @param image decoded tile
+     * @param expiry date after which the tile is no longer used, or a null date for a tile which does not expire
+     * @param layerUri data source URI of the layer, see removeLayerTiles()
+     */
+    static void insertTile( const QUrl& url, const QImage& image, const QDateTime& expiry = QDateTime(), const QString& layerUri = QString() );
+
+    /** Try to access a tile and load it into "image" argument
+     * @returns true if the tile exists in the cache and has not expired
+     */
+    static bool tile( const QUrl& url, QImage& image );
+
+    //! Whether a tile which has not expired is in the in-memory cache
+    static bool contains( const QUrl& url );
+
+    //! Remove the tiles of a layer from the in-memory cache
+    static void removeLayerTiles( const QString& layerUri );
+
+    //! How many tiles are stored in the in-memory cache
+    static int count();
+
+    //! Size of the tiles stored in the in-memory cache, in kilobytes
+    static int totalCost();
+
+    //! Maximum size of the in-memory cache, in kilobytes
+    static int maxCost();
+
+    //! Set the maximum size of the in-memory cache, in kilobytes
+    static void setMaxCost( int kilobytes );
+
+    //! Remove all the tiles from the in-memory cache
+    static void clear();
+
+    /** Make sure that a tile without expiration date is kept in the network
+     * disk cache for "/qgis/defaultTileExpiry" hours.
+     * @returns the expiration date of the cached reply, or a null date if it is not in the disk cache
+     */
+    static QDateTime updateNetworkCacheExpiry( const QUrl& url );
+
+    /** Returns the expiration date of a tile reply, and updates it in the network
+     * disk cache. Replies which are not in the disk cache expire as told by their
+     * Cache-Control and Expires headers, or after "/qgis/defaultTileExpiry" hours.
+     */
+    static QDateTime replyExpiry( QNetworkReply* reply );
+
+  private:
+    //! A decoded tile, with its expiration date and layer
+    struct CachedTile
+    {
+      QImage image;
+      QDateTime expiry;
+      QString layerUri;
+    };
+
+    //! Read the maximum size from the settings on first use. Must be called with the mutex locked.
+    static void init();
+
+    //! Returns the tile, or a null pointer if it is missing or expired. Must be called with the mutex locked.
+    static CachedTile* validTile( const QUrl& url );
+
+    static QCache<QUrl, CachedTile> sTileCache;
+    static QMutex sTileCacheMutex;
+    static bool sInitialized;
+};
+
+
+/** Downloads tiles ahead of their use, at low priority, so that they end up
+ * in QgsTileCache and in the network disk cache.
+ *
+ * The prefetcher lives in the main thread, whose event loop is always
+ * running, so that prefetch requests issued from a rendering thread
+ * complete even after its drawing is finished.
+ */
+class QgsWmsTilePrefetcher : public QObject
+{
+    Q_OBJECT
+  public:
+    //! Returns the prefetcher, or a null pointer if there is no application instance
+    static QgsWmsTilePrefetcher* instance();
+
+    /** Replace the queued (not yet sent) prefetch requests. The requests are
+     * sent in the given order. Tiles already in the in-memory cache are skipped.
+     * This method is thread-safe.
+     */
+    void prefetch( const QList<QNetworkRequest>& requests );
+
+  private slots:
+    void sendRequests();
+    void replyFinished();
+
+  private:
+    QgsWmsTilePrefetcher();
+
+    QMutex mMutex;
+    //! Requests waiting to be sent
+    QList<QNetworkRequest> mQueue;
+    //! Running prefetch requests
+    QList<QNetworkReply*> mReplies;
+};
+
+#endif // QGSTILECACHE_H
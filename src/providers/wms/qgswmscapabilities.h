@@ -432,6 +432,7 @@ enum QgsWmsTileAttribute
   TileIndex = QNetworkRequest::User + 1,
   TileRect  = QNetworkRequest::User + 2,
   TileRetry = QNetworkRequest::User + 3,
+  TileLayerUri = QNetworkRequest::User + 4, //!< data source URI of the layer, to drop its tiles from QgsTileCache
 };
 
 enum QgsWmsDpiMode
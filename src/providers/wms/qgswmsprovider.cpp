@@ -24,6 +24,7 @@
  *                                                                         *
  ***************************************************************************/
 
+#include "qgsapplication.h"
 #include "qgslogger.h"
 #include "qgswmsprovider.h"
 #include "qgswmsconnection.h"
@@ -45,6 +46,7 @@
 #include "qgswmscapabilities.h"
 #include "qgscrscache.h"
 #include "qgscsexception.h"
+#include "qgstilecache.h"
 
 #include <QNetworkRequest>
 #include <QNetworkReply>
@@ -663,37 +665,11 @@ QImage *QgsWmsProvider::draw( QgsRectangle const &viewExtent, int pixelWidth, in
                  .arg( tm->identifier )
                );
 
-    // calculate tile coordinates
-    double twMap = tm->tileWidth * tres;
-    double thMap = tm->tileHeight * tres;
-    QgsDebugMsg( QString( "tile map size: %1,%2" ).arg( qgsDoubleToString( twMap ), qgsDoubleToString( thMap ) ) );
-
-    int minTileCol = 0;
-    int maxTileCol = tm->matrixWidth - 1;
-    int minTileRow = 0;
-    int maxTileRow = tm->matrixHeight - 1;
-
+    QgsDebugMsg( QString( "tile map size: %1,%2" ).arg( qgsDoubleToString( tm->tileWidth * tres ), qgsDoubleToString( tm->tileHeight * tres ) ) );
 
-    if ( mTileLayer &&
-         mTileLayer->setLinks.contains( mTileMatrixSet->identifier ) &&
-         mTileLayer->setLinks[ mTileMatrixSet->identifier ].limits.contains( tm->identifier ) )
-    {
-      const QgsWmtsTileMatrixLimits &tml = mTileLayer->setLinks[ mTileMatrixSet->identifier ].limits[ tm->identifier ];
-      minTileCol = tml.minTileCol;
-      maxTileCol = tml.maxTileCol;
-      minTileRow = tml.minTileRow;
-      maxTileRow = tml.maxTileRow;
-      QgsDebugMsg( QString( "%1 %2: TileMatrixLimits col %3-%4 row %5-%6" )
-                   .arg( mTileMatrixSet->identifier,
-                         tm->identifier )
-                   .arg( minTileCol ).arg( maxTileCol )
-                   .arg( minTileRow ).arg( maxTileRow ) );
-    }
-
-    int col0 = qBound( minTileCol, ( int ) floor(( viewExtent.xMinimum() - tm->topLeft.x() ) / twMap ), maxTileCol );
-    int row0 = qBound( minTileRow, ( int ) floor(( tm->topLeft.y() - viewExtent.yMaximum() ) / thMap ), maxTileRow );
-    int col1 = qBound( minTileCol, ( int ) floor(( viewExtent.xMaximum() - tm->topLeft.x() ) / twMap ), maxTileCol );
-    int row1 = qBound( minTileRow, ( int ) floor(( tm->topLeft.y() - viewExtent.yMinimum() ) / thMap ), maxTileRow );
+    // calculate tile coordinates
+    int col0, row0, col1, row1;
+    tileRange( tm, tres, viewExtent, col0, row0, col1, row1 );
 
 #if QGISDEBUG
     int n = ( col1 - col0 + 1 ) * ( row1 - row0 + 1 );
@@ -705,163 +681,323 @@ QImage *QgsWmsProvider::draw( QgsRectangle const &viewExtent, int pixelWidth, in
     }
 #endif
 
-    QList<QgsWmsTiledImageDownloadHandler::TileRequest> requests;
+    // request the tiles closest to the center of the view first
+    TilePositions tiles;
+    for ( int row = row0; row <= row1; row++ )
+    {
+      for ( int col = col0; col <= col1; col++ )
+      {
+        tiles << TilePosition( row, col );
+      }
+    }
+    sortTilesByDistance( tiles, tm, tres, viewExtent.center() );
+
+    TileRequests requests;
+    if ( !createTileRequests( tileMode, tm, tres, tiles, requests ) )
+      return mCachedImage;
+
+    emit statusChanged( tr( "Getting tiles." ) );
+
+    QgsWmsTiledImageDownloadHandler handler( dataSourceUri(), mSettings.authorization(), mTileReqNo, requests, mCachedImage, mCachedViewExtent, mSettings.mSmoothPixmapTransform );
+    handler.downloadBlocking();
+
+    prefetchTiles( tileMode, tm, tres, viewExtent, col0, row0, col1, row1 );
+
+
+#if 0
+    const QgsWmsStatistics::Stat& stat = QgsWmsStatistics::statForUri( dataSourceUri() );
+    emit statusChanged( tr( "%n tile requests in background", "tile request count", requests.count() )
+                        + tr( ", %n cache hits", "tile cache hits", stat.cacheHits )
+                        + tr( ", %n cache misses.", "tile cache missed", stat.cacheMisses )
+                        + tr( ", %n errors.", "errors", stat.errors )
+                      );
+#endif
+  }
+
+  return mCachedImage;
+}
+
+void QgsWmsProvider::tileMatrixLimits( const QgsWmtsTileMatrix* tm, int& minTileCol, int& maxTileCol, int& minTileRow, int& maxTileRow ) const
+{
+  minTileCol = 0;
+  maxTileCol = tm->matrixWidth - 1;
+  minTileRow = 0;
+  maxTileRow = tm->matrixHeight - 1;
+
+  if ( mTileLayer &&
+       mTileLayer->setLinks.contains( mTileMatrixSet->identifier ) &&
+       mTileLayer->setLinks[ mTileMatrixSet->identifier ].limits.contains( tm->identifier ) )
+  {
+    const QgsWmtsTileMatrixLimits &tml = mTileLayer->setLinks[ mTileMatrixSet->identifier ].limits[ tm->identifier ];
+    minTileCol = tml.minTileCol;
+    maxTileCol = tml.maxTileCol;
+    minTileRow = tml.minTileRow;
+    maxTileRow = tml.maxTileRow;
+    QgsDebugMsg( QString( "%1 %2: TileMatrixLimits col %3-%4 row %5-%6" )
+                 .arg( mTileMatrixSet->identifier,
+                       tm->identifier )
+                 .arg( minTileCol ).arg( maxTileCol )
+                 .arg( minTileRow ).arg( maxTileRow ) );
+  }
+}
+
+void QgsWmsProvider::tileRange( const QgsWmtsTileMatrix* tm, double tres, const QgsRectangle& extent, int& col0, int& row0, int& col1, int& row1 ) const
+{
+  int minTileCol, maxTileCol, minTileRow, maxTileRow;
+  tileMatrixLimits( tm, minTileCol, maxTileCol, minTileRow, maxTileRow );
+
+  double twMap = tm->tileWidth * tres;
+  double thMap = tm->tileHeight * tres;
 
-    switch ( tileMode )
+  col0 = qBound( minTileCol, ( int ) floor(( extent.xMinimum() - tm->topLeft.x() ) / twMap ), maxTileCol );
+  row0 = qBound( minTileRow, ( int ) floor(( tm->topLeft.y() - extent.yMaximum() ) / thMap ), maxTileRow );
+  col1 = qBound( minTileCol, ( int ) floor(( extent.xMaximum() - tm->topLeft.x() ) / twMap ), maxTileCol );
+  row1 = qBound( minTileRow, ( int ) floor(( tm->topLeft.y() - extent.yMinimum() ) / thMap ), maxTileRow );
+}
+
+/** Orders tiles by the distance of their center to a point, in tile units */
+struct QgsTileDistanceLessThan
+{
+  QgsTileDistanceLessThan( double col, double row )
+      : mCol( col )
+      , mRow( row )
+  {}
+
+  double distance( const QgsWmsProvider::TilePosition& t ) const
+  {
+    double dc = t.col + 0.5 - mCol;
+    double dr = t.row + 0.5 - mRow;
+    return dc * dc + dr * dr;
+  }
+
+  bool operator()( const QgsWmsProvider::TilePosition& t1, const QgsWmsProvider::TilePosition& t2 ) const
+  {
+    return distance( t1 ) < distance( t2 );
+  }
+
+  double mCol;
+  double mRow;
+};
+
+void QgsWmsProvider::sortTilesByDistance( TilePositions& tiles, const QgsWmtsTileMatrix* tm, double tres, const QgsPoint& center )
+{
+  QgsTileDistanceLessThan lessThan(( center.x() - tm->topLeft.x() ) / ( tm->tileWidth * tres ),
+                                   ( tm->topLeft.y() - center.y() ) / ( tm->tileHeight * tres ) );
+  qStableSort( tiles.begin(), tiles.end(), lessThan );
+}
+
+bool QgsWmsProvider::createTileRequests( QgsTileMode tileMode, const QgsWmtsTileMatrix* tm, double tres, const TilePositions& tiles, TileRequests& requests )
+{
+  bool changeXY = mCaps.shouldInvertAxisOrientation( mImageCrs );
+
+  double twMap = tm->tileWidth * tres;
+  double thMap = tm->tileHeight * tres;
+
+#ifdef QGISDEBUG
+  int n = tiles.size();
+#endif
+
+  switch ( tileMode )
+  {
+    case WMSC:
     {
-      case WMSC:
+      // add WMS request
+      QUrl url( mSettings.mIgnoreGetMapUrl ? mSettings.mBaseUrl : getMapUrl() );
+      setQueryItem( url, "SERVICE", "WMS" );
+      setQueryItem( url, "VERSION", mCaps.mCapabilities.version );
+      setQueryItem( url, "REQUEST", "GetMap" );
+      setQueryItem( url, "WIDTH", QString::number( tm->tileWidth ) );
+      setQueryItem( url, "HEIGHT", QString::number( tm->tileHeight ) );
+      setQueryItem( url, "LAYERS", mSettings.mActiveSubLayers.join( "," ) );
+      setQueryItem( url, "STYLES", mSettings.mActiveSubStyles.join( "," ) );
+      setFormatQueryItem( url );
+
+      setSRSQueryItem( url );
+
+      if ( mSettings.mTiled )
       {
-        // add WMS request
-        QUrl url( mSettings.mIgnoreGetMapUrl ? mSettings.mBaseUrl : getMapUrl() );
-        setQueryItem( url, "SERVICE", "WMS" );
-        setQueryItem( url, "VERSION", mCaps.mCapabilities.version );
-        setQueryItem( url, "REQUEST", "GetMap" );
-        setQueryItem( url, "WIDTH", QString::number( tm->tileWidth ) );
-        setQueryItem( url, "HEIGHT", QString::number( tm->tileHeight ) );
-        setQueryItem( url, "LAYERS", mSettings.mActiveSubLayers.join( "," ) );
-        setQueryItem( url, "STYLES", mSettings.mActiveSubStyles.join( "," ) );
-        setFormatQueryItem( url );
+        setQueryItem( url, "TILED", "true" );
+      }
 
-        setSRSQueryItem( url );
+      if ( mDpi != -1 )
+      {
+        if ( mSettings.mDpiMode & dpiQGIS )
+          setQueryItem( url, "DPI", QString::number( mDpi ) );
+        if ( mSettings.mDpiMode & dpiUMN )
+          setQueryItem( url, "MAP_RESOLUTION", QString::number( mDpi ) );
+        if ( mSettings.mDpiMode & dpiGeoServer )
+          setQueryItem( url, "FORMAT_OPTIONS", QString( "dpi:%1" ).arg( mDpi ) );
+      }
+
+      if ( mSettings.mImageMimeType == "image/x-jpegorpng" ||
+           ( !mSettings.mImageMimeType.contains( "jpeg", Qt::CaseInsensitive ) &&
+             !mSettings.mImageMimeType.contains( "jpg", Qt::CaseInsensitive ) ) )
+      {
+        setQueryItem( url, "TRANSPARENT", "TRUE" );  // some servers giving error for 'true' (lowercase)
+      }
+
+      int i = 0;
+      Q_FOREACH ( const TilePosition& tile, tiles )
+      {
+        QString turl;
+        turl += url.toString();
+        turl += QString( changeXY ? "&BBOX=%2,%1,%4,%3" : "&BBOX=%1,%2,%3,%4" )
+                .arg( qgsDoubleToString( tm->topLeft.x() +         tile.col * twMap /* + twMap * 0.001 */ ),
+                      qgsDoubleToString( tm->topLeft.y() - ( tile.row + 1 ) * thMap /* - thMap * 0.001 */ ),
+                      qgsDoubleToString( tm->topLeft.x() + ( tile.col + 1 ) * twMap /* - twMap * 0.001 */ ),
+                      qgsDoubleToString( tm->topLeft.y() -         tile.row * thMap /* + thMap * 0.001 */ ) );
+
+        QgsDebugMsg( QString( "tileRequest %1 %2/%3 (%4,%5): %6" ).arg( mTileReqNo ).arg( i ).arg( n ).arg( tile.row ).arg( tile.col ).arg( turl ) );
+        QRectF rect( tm->topLeft.x() + tile.col * twMap, tm->topLeft.y() - ( tile.row + 1 ) * thMap, twMap, thMap );
+        requests << TileRequest( turl, rect, i++ );
+      }
+    }
+    break;
+
+    case WMTS:
+    {
+      if ( !getTileUrl().isNull() )
+      {
+        // KVP
+        QUrl url( mSettings.mIgnoreGetMapUrl ? mSettings.mBaseUrl : getTileUrl() );
 
-        if ( mSettings.mTiled )
+        // compose static request arguments.
+        setQueryItem( url, "SERVICE", "WMTS" );
+        setQueryItem( url, "REQUEST", "GetTile" );
+        setQueryItem( url, "VERSION", mCaps.mCapabilities.version );
+        setQueryItem( url, "LAYER", mSettings.mActiveSubLayers[0] );
+        setQueryItem( url, "STYLE", mSettings.mActiveSubStyles[0] );
+        setQueryItem( url, "FORMAT", mSettings.mImageMimeType );
+        setQueryItem( url, "TILEMATRIXSET", mTileMatrixSet->identifier );
+        setQueryItem( url, "TILEMATRIX", tm->identifier );
+
+        for ( QHash<QString, QString>::const_iterator it = mSettings.mTileDimensionValues.constBegin(); it != mSettings.mTileDimensionValues.constEnd(); ++it )
         {
-          setQueryItem( url, "TILED", "true" );
+          setQueryItem( url, it.key(), it.value() );
         }
 
-        if ( mDpi != -1 )
+        url.removeQueryItem( "TILEROW" );
+        url.removeQueryItem( "TILECOL" );
+
+        int i = 0;
+        Q_FOREACH ( const TilePosition& tile, tiles )
         {
-          if ( mSettings.mDpiMode & dpiQGIS )
-            setQueryItem( url, "DPI", QString::number( mDpi ) );
-          if ( mSettings.mDpiMode & dpiUMN )
-            setQueryItem( url, "MAP_RESOLUTION", QString::number( mDpi ) );
-          if ( mSettings.mDpiMode & dpiGeoServer )
-            setQueryItem( url, "FORMAT_OPTIONS", QString( "dpi:%1" ).arg( mDpi ) );
+          QString turl;
+          turl += url.toString();
+          turl += QString( "&TILEROW=%1&TILECOL=%2" ).arg( tile.row ).arg( tile.col );
+
+          QgsDebugMsg( QString( "tileRequest %1 %2/%3 (%4,%5): %6" ).arg( mTileReqNo ).arg( i ).arg( n ).arg( tile.row ).arg( tile.col ).arg( turl ) );
+          QRectF rect( tm->topLeft.x() + tile.col * twMap, tm->topLeft.y() - ( tile.row + 1 ) * thMap, twMap, thMap );
+          requests << TileRequest( turl, rect, i++ );
         }
+      }
+      else
+      {
+        // REST
+        QString url = mTileLayer->getTileURLs[ mSettings.mImageMimeType ];
+
+        url.replace( "{layer}", mSettings.mActiveSubLayers[0], Qt::CaseInsensitive );
+        url.replace( "{style}", mSettings.mActiveSubStyles[0], Qt::CaseInsensitive );
+        url.replace( "{tilematrixset}", mTileMatrixSet->identifier, Qt::CaseInsensitive );
+        url.replace( "{tilematrix}", tm->identifier, Qt::CaseInsensitive );
 
-        if ( mSettings.mImageMimeType == "image/x-jpegorpng" ||
-             ( !mSettings.mImageMimeType.contains( "jpeg", Qt::CaseInsensitive ) &&
-               !mSettings.mImageMimeType.contains( "jpg", Qt::CaseInsensitive ) ) )
+        for ( QHash<QString, QString>::const_iterator it = mSettings.mTileDimensionValues.constBegin(); it != mSettings.mTileDimensionValues.constEnd(); ++it )
         {
-          setQueryItem( url, "TRANSPARENT", "TRUE" );  // some servers giving error for 'true' (lowercase)
+          url.replace( "{" + it.key() + "}", it.value(), Qt::CaseInsensitive );
         }
 
         int i = 0;
-        for ( int row = row0; row <= row1; row++ )
+        Q_FOREACH ( const TilePosition& tile, tiles )
         {
-          for ( int col = col0; col <= col1; col++ )
-          {
-            QString turl;
-            turl += url.toString();
-            turl += QString( changeXY ? "&BBOX=%2,%1,%4,%3" : "&BBOX=%1,%2,%3,%4" )
-                    .arg( qgsDoubleToString( tm->topLeft.x() +         col * twMap /* + twMap * 0.001 */ ),
-                          qgsDoubleToString( tm->topLeft.y() - ( row + 1 ) * thMap /* - thMap * 0.001 */ ),
-                          qgsDoubleToString( tm->topLeft.x() + ( col + 1 ) * twMap /* - twMap * 0.001 */ ),
-                          qgsDoubleToString( tm->topLeft.y() -         row * thMap /* + thMap * 0.001 */ ) );
-
-            QgsDebugMsg( QString( "tileRequest %1 %2/%3 (%4,%5): %6" ).arg( mTileReqNo ).arg( i++ ).arg( n ).arg( row ).arg( col ).arg( turl ) );
-            QRectF rect( tm->topLeft.x() + col * twMap, tm->topLeft.y() - ( row + 1 ) * thMap, twMap, thMap );
-            requests << QgsWmsTiledImageDownloadHandler::TileRequest( turl, rect, i );
-          }
+          QString turl( url );
+          turl.replace( "{tilerow}", QString::number( tile.row ), Qt::CaseInsensitive );
+          turl.replace( "{tilecol}", QString::number( tile.col ), Qt::CaseInsensitive );
+
+          QgsDebugMsg( QString( "tileRequest %1 %2/%3 (%4,%5): %6" ).arg( mTileReqNo ).arg( i ).arg( n ).arg( tile.row ).arg( tile.col ).arg( turl ) );
+          QRectF rect( tm->topLeft.x() + tile.col * twMap, tm->topLeft.y() - ( tile.row + 1 ) * thMap, twMap, thMap );
+          requests << TileRequest( turl, rect, i++ );
         }
       }
-      break;
-
-      case WMTS:
-      {
-        if ( !getTileUrl().isNull() )
-        {
-          // KVP
-          QUrl url( mSettings.mIgnoreGetMapUrl ? mSettings.mBaseUrl : getTileUrl() );
-
-          // compose static request arguments.
-          setQueryItem( url, "SERVICE", "WMTS" );
-          setQueryItem( url, "REQUEST", "GetTile" );
-          setQueryItem( url, "VERSION", mCaps.mCapabilities.version );
-          setQueryItem( url, "LAYER", mSettings.mActiveSubLayers[0] );
-          setQueryItem( url, "STYLE", mSettings.mActiveSubStyles[0] );
-          setQueryItem( url, "FORMAT", mSettings.mImageMimeType );
-          setQueryItem( url, "TILEMATRIXSET", mTileMatrixSet->identifier );
-          setQueryItem( url, "TILEMATRIX", tm->identifier );
-
-          for ( QHash<QString, QString>::const_iterator it = mSettings.mTileDimensionValues.constBegin(); it != mSettings.mTileDimensionValues.constEnd(); ++it )
-          {
-            setQueryItem( url, it.key(), it.value() );
-          }
+    }
+    break;
 
-          url.removeQueryItem( "TILEROW" );
-          url.removeQueryItem( "TILECOL" );
+    default:
+      QgsDebugMsg( QString( "unexpected tile mode %1" ).arg( tileMode ) );
+      return false;
+  }
 
-          int i = 0;
-          for ( int row = row0; row <= row1; row++ )
-          {
-            for ( int col = col0; col <= col1; col++ )
-            {
-              QString turl;
-              turl += url.toString();
-              turl += QString( "&TILEROW=%1&TILECOL=%2" ).arg( row ).arg( col );
+  return true;
+}
 
-              QgsDebugMsg( QString( "tileRequest %1 %2/%3 (%4,%5): %6" ).arg( mTileReqNo ).arg( i++ ).arg( n ).arg( row ).arg( col ).arg( turl ) );
-              QRectF rect( tm->topLeft.x() + col * twMap, tm->topLeft.y() - ( row + 1 ) * thMap, twMap, thMap );
-              requests << QgsWmsTiledImageDownloadHandler::TileRequest( turl, rect, i );
-            }
-          }
-        }
-        else
-        {
-          // REST
-          QString url = mTileLayer->getTileURLs[ mSettings.mImageMimeType ];
+void QgsWmsProvider::prefetchTiles( QgsTileMode tileMode, const QgsWmtsTileMatrix* tm, double tres, const QgsRectangle& viewExtent, int col0, int row0, int col1, int row1 )
+{
+  QSettings s;
+  if ( !s.value( "/qgis/wmsTilePrefetch", true ).toBool() )
+    return;
 
-          url.replace( "{layer}", mSettings.mActiveSubLayers[0], Qt::CaseInsensitive );
-          url.replace( "{style}", mSettings.mActiveSubStyles[0], Qt::CaseInsensitive );
-          url.replace( "{tilematrixset}", mTileMatrixSet->identifier, Qt::CaseInsensitive );
-          url.replace( "{tilematrix}", tm->identifier, Qt::CaseInsensitive );
+  // a server renders each request once, prefetched tiles would only load the remote service
+  if ( QgsApplication::platform() == "server" )
+    return;
 
-          for ( QHash<QString, QString>::const_iterator it = mSettings.mTileDimensionValues.constBegin(); it != mSettings.mTileDimensionValues.constEnd(); ++it )
-          {
-            url.replace( "{" + it.key() + "}", it.value(), Qt::CaseInsensitive );
-          }
+  QgsWmsTilePrefetcher* prefetcher = QgsWmsTilePrefetcher::instance();
+  if ( !prefetcher )
+    return;
 
-          int i = 0;
-          for ( int row = row0; row <= row1; row++ )
-          {
-            for ( int col = col0; col <= col1; col++ )
-            {
-              QString turl( url );
-              turl.replace( "{tilerow}", QString::number( row ), Qt::CaseInsensitive );
-              turl.replace( "{tilecol}", QString::number( col ), Qt::CaseInsensitive );
+  TileRequests requests;
 
-              QgsDebugMsg( QString( "tileRequest %1 %2/%3 (%4,%5): %6" ).arg( mTileReqNo ).arg( i++ ).arg( n ).arg( row ).arg( col ).arg( turl ) );
-              QRectF rect( tm->topLeft.x() + col * twMap, tm->topLeft.y() - ( row + 1 ) * thMap, twMap, thMap );
-              requests << QgsWmsTiledImageDownloadHandler::TileRequest( turl, rect, i );
-            }
-          }
-        }
-      }
-      break;
+  // next ring of tiles around the view, for panning
+  int minTileCol, maxTileCol, minTileRow, maxTileRow;
+  tileMatrixLimits( tm, minTileCol, maxTileCol, minTileRow, maxTileRow );
 
-      default:
-        QgsDebugMsg( QString( "unexpected tile mode %1" ).arg( mTileLayer->tileMode ) );
-        return mCachedImage;
+  TilePositions ring;
+  for ( int row = qMax( row0 - 1, minTileRow ); row <= qMin( row1 + 1, maxTileRow ); row++ )
+  {
+    for ( int col = qMax( col0 - 1, minTileCol ); col <= qMin( col1 + 1, maxTileCol ); col++ )
+    {
+      if ( row < row0 || row > row1 || col < col0 || col > col1 )
+        ring << TilePosition( row, col );
     }
+  }
+  sortTilesByDistance( ring, tm, tres, viewExtent.center() );
+  createTileRequests( tileMode, tm, tres, ring, requests );
 
-    emit statusChanged( tr( "Getting tiles." ) );
-
-    QgsWmsTiledImageDownloadHandler handler( dataSourceUri(), mSettings.authorization(), mTileReqNo, requests, mCachedImage, mCachedViewExtent, mSettings.mSmoothPixmapTransform );
-    handler.downloadBlocking();
+  // tiles of the next lower zoom level covering the view, for zooming out
+  if ( mSettings.mTiled && mTileMatrixSet )
+  {
+    const QMap<double, QgsWmtsTileMatrix> &m = mTileMatrixSet->tileMatrices;
+    QMap<double, QgsWmtsTileMatrix>::const_iterator lower = m.upperBound( tres );
+    if ( lower != m.constEnd() )
+    {
+      int lcol0, lrow0, lcol1, lrow1;
+      tileRange( &lower.value(), lower.key(), viewExtent, lcol0, lrow0, lcol1, lrow1 );
 
+      TilePositions lowerTiles;
+      for ( int row = lrow0; row <= lrow1; row++ )
+      {
+        for ( int col = lcol0; col <= lcol1; col++ )
+        {
+          lowerTiles << TilePosition( row, col );
+        }
+      }
+      sortTilesByDistance( lowerTiles, &lower.value(), lower.key(), viewExtent.center() );
+      createTileRequests( tileMode, &lower.value(), lower.key(), lowerTiles, requests );
+    }
+  }
 
-#if 0
-    const QgsWmsStatistics::Stat& stat = QgsWmsStatistics::statForUri( dataSourceUri() );
-    emit statusChanged( tr( "%n tile requests in background", "tile request count", requests.count() )
-                        + tr( ", %n cache hits", "tile cache hits", stat.cacheHits )
-                        + tr( ", %n cache misses.", "tile cache missed", stat.cacheMisses )
-                        + tr( ", %n errors.", "errors", stat.errors )
-                      );
-#endif
+  QList<QNetworkRequest> networkRequests;
+  Q_FOREACH ( const TileRequest& r, requests )
+  {
+    QNetworkRequest request( r.url );
+    mSettings.authorization().setAuthorization( request );
+    request.setAttribute( QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::PreferCache );
+    request.setAttribute( QNetworkRequest::CacheSaveControlAttribute, true );
+    request.setPriority( QNetworkRequest::LowPriority );
+    request.setAttribute( static_cast<QNetworkRequest::Attribute>( TileLayerUri ), dataSourceUri() );
+    networkRequests << request;
   }
 
-  return mCachedImage;
+  QgsDebugMsg( QString( "prefetching %1 tiles" ).arg( networkRequests.size() ) );
+  prefetcher->prefetch( networkRequests );
 }
 
 void QgsWmsProvider::readBlock( int bandNo, QgsRectangle  const & viewExtent, int pixelWidth, int pixelHeight, void *block )
@@ -2889,6 +3025,7 @@ void QgsWmsProvider::reloadData()
 {
   delete mCachedImage;
   mCachedImage = nullptr;
+  QgsTileCache::removeLayerTiles( dataSourceUri() );
 }
 
 
@@ -3362,8 +3499,19 @@ QgsWmsTiledImageDownloadHandler::QgsWmsTiledImageDownloadHandler( const QString&
 {
   Q_FOREACH ( const TileRequest& r, requests )
   {
+    // tiles already decoded in memory do not need a request
+    QImage cachedTile;
+    if ( QgsTileCache::tile( r.url, cachedTile ) )
+    {
+      drawTile( r.rect, cachedTile );
+      continue;
+    }
+
     QNetworkRequest request( r.url );
     auth.setAuthorization( request );
+    // the requests are sorted by distance to the center of the view, and
+    // the visible tiles have precedence over the prefetched ones
+    request.setPriority( QNetworkRequest::HighPriority );
     request.setAttribute( QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::PreferCache );
     request.setAttribute( QNetworkRequest::CacheSaveControlAttribute, true );
     request.setAttribute( static_cast<QNetworkRequest::Attribute>( TileReqNo ), mTileReqNo );
@@ -3385,6 +3533,9 @@ QgsWmsTiledImageDownloadHandler::~QgsWmsTiledImageDownloadHandler()
 
 void QgsWmsTiledImageDownloadHandler::downloadBlocking()
 {
+  if ( mReplies.isEmpty() )
+    return; // all tiles were in the tile cache
+
   mEventLoop->exec( QEventLoop::ExcludeUserInputEvents );
 
   Q_ASSERT( mReplies.isEmpty() );
@@ -3413,27 +3564,7 @@ void QgsWmsTiledImageDownloadHandler::tileReplyFinished()
   }
 #endif
 
-  if ( QgsNetworkAccessManager::instance()->cache() )
-  {
-    QNetworkCacheMetaData cmd = QgsNetworkAccessManager::instance()->cache()->metaData( reply->request().url() );
-
-    QNetworkCacheMetaData::RawHeaderList hl;
-    Q_FOREACH ( const QNetworkCacheMetaData::RawHeader &h, cmd.rawHeaders() )
-    {
-      if ( h.first != "Cache-Control" )
-        hl.append( h );
-    }
-    cmd.setRawHeaders( hl );
-
-    QgsDebugMsg( QString( "expirationDate:%1" ).arg( cmd.expirationDate().toString() ) );
-    if ( cmd.expirationDate().isNull() )
-    {
-      QSettings s;
-      cmd.setExpirationDate( QDateTime::currentDateTime().addSecs( s.value( "/qgis/defaultTileExpiry", "24" ).toInt() * 60 * 60 ) );
-    }
-
-    QgsNetworkAccessManager::instance()->cache()->updateMetaData( cmd );
-  }
+  QDateTime expiry = QgsTileCache::replyExpiry( reply );
 
   int tileReqNo = reply->request().attribute( static_cast<QNetworkRequest::Attribute>( TileReqNo ) ).toInt();
   int tileNo = reply->request().attribute( static_cast<QNetworkRequest::Attribute>( TileIndex ) ).toInt();
@@ -3531,35 +3662,20 @@ void QgsWmsTiledImageDownloadHandler::tileReplyFinished()
       return;
     }
 
-    // only take results from current request number
-    if ( mTileReqNo == tileReqNo )
-    {
-      double cr = mCachedViewExtent.width() / mCachedImage->width();
+    QgsDebugMsg( QString( "tile reply: length %1" ).arg( reply->bytesAvailable() ) );
 
-      QRectF dst(( r.left() - mCachedViewExtent.xMinimum() ) / cr,
-                 ( mCachedViewExtent.yMaximum() - r.bottom() ) / cr,
-                 r.width() / cr,
-                 r.height() / cr );
+    QImage myLocalImage = QImage::fromData( reply->readAll() );
 
-      QgsDebugMsg( QString( "tile reply: length %1" ).arg( reply->bytesAvailable() ) );
-
-      QImage myLocalImage = QImage::fromData( reply->readAll() );
+    // keep the decoded tile, even if the reply is too late for this request
+    if ( !myLocalImage.isNull() )
+      QgsTileCache::insertTile( reply->request().url(), myLocalImage, expiry, mProviderUri );
 
+    // only take results from current request number
+    if ( mTileReqNo == tileReqNo )
+    {
       if ( !myLocalImage.isNull() )
       {
-        QPainter p( mCachedImage );
-        if ( mSmoothPixmapTransform )
-          p.setRenderHint( QPainter::SmoothPixmapTransform, true );
-        p.drawImage( dst, myLocalImage );
-#if 0
-        myLocalImage.save( QString( "%1/%2-tile-%3.png" ).arg( QDir::tempPath() ).arg( mTileReqNo ).arg( tileNo ) );
-        p.drawRect( dst ); // show tile bounds
-        p.drawText( dst, Qt::AlignCenter, QString( "(%1)\n%2,%3\n%4,%5\n%6x%7" )
-                    .arg( tileNo )
-                    .arg( r.left() ).arg( r.bottom() )
-                    .arg( r.right() ).arg( r.top() )
-                    .arg( r.width() ).arg( r.height() ) );
-#endif
+        drawTile( r, myLocalImage );
       }
       else
       {
@@ -3606,6 +3722,28 @@ void QgsWmsTiledImageDownloadHandler::tileReplyFinished()
 }
 
 
+void QgsWmsTiledImageDownloadHandler::drawTile( const QRectF& r, const QImage& image )
+{
+  double cr = mCachedViewExtent.width() / mCachedImage->width();
+
+  QRectF dst(( r.left() - mCachedViewExtent.xMinimum() ) / cr,
+             ( mCachedViewExtent.yMaximum() - r.bottom() ) / cr,
+             r.width() / cr,
+             r.height() / cr );
+
+  QPainter p( mCachedImage );
+  if ( mSmoothPixmapTransform )
+    p.setRenderHint( QPainter::SmoothPixmapTransform, true );
+  p.drawImage( dst, image );
+#if 0
+  p.drawRect( dst ); // show tile bounds
+  p.drawText( dst, Qt::AlignCenter, QString( "%1,%2\n%3,%4\n%5x%6" )
+              .arg( r.left() ).arg( r.bottom() )
+              .arg( r.right() ).arg( r.top() )
+              .arg( r.width() ).arg( r.height() ) );
+#endif
+}
+
 void QgsWmsTiledImageDownloadHandler::repeatTileRequest( QNetworkRequest const &oldRequest )
 {
   QgsWmsStatistics::Stat& stat = QgsWmsStatistics::statForUri( mProviderUri );
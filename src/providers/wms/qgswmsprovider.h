@@ -325,6 +325,32 @@ class QgsWmsProvider : public QgsRasterDataProvider
      */
     QString description() const override;
 
+    //! Request of a single tile
+    struct TileRequest
+    {
+      TileRequest( const QUrl& u, const QRectF& r, int i )
+          : url( u )
+          , rect( r )
+          , index( i )
+      {}
+      QUrl url;
+      QRectF rect;
+      int index;
+    };
+    typedef QList<TileRequest> TileRequests;
+
+    //! Position of a tile in a tile matrix
+    struct TilePosition
+    {
+      TilePosition( int r, int c )
+          : row( r )
+          , col( c )
+      {}
+      int row;
+      int col;
+    };
+    typedef QList<TilePosition> TilePositions;
+
     /** Reloads the data from the source. Needs to be implemented by providers with data caches to
      * synchronize with changes in the data source
      */
@@ -439,6 +465,25 @@ class QgsWmsProvider : public QgsRasterDataProvider
     //! add image FORMAT parameter to url
     void setFormatQueryItem( QUrl &url );
 
+    //! Range of tiles of a tile matrix allowed by its TileMatrixLimits
+    void tileMatrixLimits( const QgsWmtsTileMatrix* tm, int& minTileCol, int& maxTileCol, int& minTileRow, int& maxTileRow ) const;
+
+    //! Range of tiles of a tile matrix (of resolution tres) covering an extent
+    void tileRange( const QgsWmtsTileMatrix* tm, double tres, const QgsRectangle& extent, int& col0, int& row0, int& col1, int& row1 ) const;
+
+    //! Sort tiles by increasing distance of their center to a point
+    static void sortTilesByDistance( TilePositions& tiles, const QgsWmtsTileMatrix* tm, double tres, const QgsPoint& center );
+
+    /** Create the requests of the given tiles of a tile matrix (of resolution tres)
+     * @returns false if the tile mode is not supported
+     */
+    bool createTileRequests( QgsTileMode tileMode, const QgsWmtsTileMatrix* tm, double tres, const TilePositions& tiles, TileRequests& requests );
+
+    /** Prefetch, at low priority, the ring of tiles around the ones covering
+     * the view and the tiles of the next lower zoom level
+     */
+    void prefetchTiles( QgsTileMode tileMode, const QgsWmtsTileMatrix* tm, double tres, const QgsRectangle& viewExtent, int col0, int row0, int col1, int row1 );
+
     //! Name of the stored connection
     QString mConnectionName;
 
@@ -588,17 +633,7 @@ class QgsWmsTiledImageDownloadHandler : public QObject
     Q_OBJECT
   public:
 
-    struct TileRequest
-    {
-      TileRequest( const QUrl& u, const QRectF& r, int i )
-          : url( u )
-          , rect( r )
-          , index( i )
-      {}
-      QUrl url;
-      QRectF rect;
-      int index;
-    };
+    typedef QgsWmsProvider::TileRequest TileRequest;
 
     QgsWmsTiledImageDownloadHandler( const QString& providerUri, const QgsWmsAuthorization& auth, int reqNo, const QList<TileRequest>& requests, QImage* cachedImage, const QgsRectangle& cachedViewExtent, bool smoothPixmapTransform );
     ~QgsWmsTiledImageDownloadHandler();
@@ -609,6 +644,9 @@ class QgsWmsTiledImageDownloadHandler : public QObject
     void tileReplyFinished();
 
   protected:
+    //! Draw a tile covering rect (in map units) on the cached image
+    void drawTile( const QRectF& rect, const QImage& image );
+
     /**
      * \brief Relaunch tile request cloning previous request parameters and managing max repeat
      *
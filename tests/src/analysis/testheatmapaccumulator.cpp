@@ -0,0 +1,256 @@
+/***************************************************************************
+  testheatmapaccumulator.cpp
+  --------------------------------------
+  Date                 : October 2016
+  Copyright            : (C) 2016 by the QGIS project
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "qgis.h"
+#include "heatmapaccumulator.h"
+#include "qgstestrandom.h"
+
+#include <QHash>
+#include <QVector>
+
+#include <algorithm>
+#include <cmath>
+
+#define NO_DATA -9999
+
+//! Kernel of the tests, zero on the radius so that covered cells may have no value
+static double _kernel( double distance, int radius )
+{
+  if ( radius == 0 )
+  {
+    return 1.0;
+  }
+  double u = distance / radius;
+  return ( 1 - u * u ) * ( 1 - u * u );
+}
+
+//! Kernel values of the ( 2 * radius + 1 )^2 cells around a point, as Heatmap::kernelValues
+static QVector<double> _kernelValues( int radius )
+{
+  int width = 2 * radius + 1;
+  QVector<double> values( width * width, 0.0 );
+  for ( int yp = -radius; yp <= radius; yp++ )
+  {
+    for ( int xp = -radius; xp <= radius; xp++ )
+    {
+      double distance = sqrt( static_cast< double >( xp * xp + yp * yp ) );
+      if ( distance <= radius )
+      {
+        values[( yp + radius ) * width + xp + radius ] = _kernel( distance, radius );
+      }
+    }
+  }
+  return values;
+}
+
+struct ReferencePoint
+{
+  int row;
+  int column;
+  int radius;
+  double weight;
+};
+
+/** The heatmap as the plugin calculated it before the stamps: the kernel is added point by point
+ * to a float raster, a quadrant at a time. The plugin dropped the windows crossing the raster
+ * edges, they are clipped here as the stamps are. */
+static QVector<float> _referenceHeatmap( const QList<ReferencePoint>& points, int rows, int columns )
+{
+  QVector<float> raster( rows * columns, NO_DATA );
+  Q_FOREACH ( const ReferencePoint& point, points )
+  {
+    for ( int xp = 0; xp <= point.radius; xp++ )
+    {
+      for ( int yp = 0; yp <= point.radius; yp++ )
+      {
+        double distance = sqrt( pow( xp, 2.0 ) + pow( yp, 2.0 ) );
+        if ( distance > point.radius )
+        {
+          continue;
+        }
+
+        double pixelValue = point.weight * _kernel( distance, point.radius );
+        if ( xp == 0 && yp == 0 )
+        {
+          pixelValue /= 4;
+        }
+        else if ( xp == 0 || yp == 0 )
+        {
+          pixelValue /= 2;
+        }
+
+        int dx[4] = { xp, xp, -xp, -xp };
+        int dy[4] = { yp, -yp, yp, -yp };
+        for ( int p = 0; p < 4; p++ )
+        {
+          int row = point.row + dy[p];
+          int column = point.column + dx[p];
+          if ( row < 0 || row >= rows || column < 0 || column >= columns )
+          {
+            continue;
+          }
+          float& cell = raster[ row * columns + column ];
+          if ( cell == NO_DATA )
+          {
+            cell = 0;
+          }
+          cell += pixelValue;
+        }
+      }
+    }
+  }
+  return raster;
+}
+
+/** \ingroup UnitTests
+ * This is a unit test for the accumulation of the heatmap kernels
+ */
+class TestHeatmapAccumulator : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void stampHalfWidth()
+    {
+      HeatmapStamp stamp = makeStamp( 3, _kernelValues( 3 ) );
+      QCOMPARE( stamp.radius, 3 );
+      QCOMPARE( stamp.halfWidth, QVector<int>() << 0 << 2 << 2 << 3 << 2 << 2 << 0 );
+
+      stamp = makeStamp( 0, _kernelValues( 0 ) );
+      QCOMPARE( stamp.halfWidth, QVector<int>() << 0 );
+
+      // the half widths cover the cells within the radius, as the quadrants of the old plugin
+      for ( int radius = 0; radius < 12; ++radius )
+      {
+        stamp = makeStamp( radius, _kernelValues( radius ) );
+        for ( int dy = -radius; dy <= radius; ++dy )
+        {
+          for ( int dx = -radius; dx <= radius; ++dx )
+          {
+            bool inside = sqrt( pow( dx, 2.0 ) + pow( dy, 2.0 ) ) <= radius;
+            QCOMPARE( qAbs( dx ) <= stamp.halfWidth[ dy + radius ], inside );
+          }
+        }
+      }
+    }
+
+    void sameAsPointByPoint_data()
+    {
+      QTest::addColumn<int>( "stripRows" );
+      QTest::addColumn<int>( "threadCount" );
+
+      QTest::newRow( "single strip" ) << 40 << 1;
+      QTest::newRow( "single strip, bands" ) << 40 << 4;
+      QTest::newRow( "strips" ) << 7 << 1;
+      QTest::newRow( "strips, bands" ) << 7 << 4;
+      QTest::newRow( "row strips" ) << 1 << 4;
+    }
+
+    void sameAsPointByPoint()
+    {
+      QFETCH( int, stripRows );
+      QFETCH( int, threadCount );
+
+      const int rows = 40;
+      const int columns = 37;
+      const int radii[] = { 0, 1, 3, 5, 8 };
+
+      // points may be snapped to the row and column past the last ones, on the maximum of the extent
+      QList<ReferencePoint> points;
+      QgsTestRandom random( 7 );
+      for ( int i = 0; i < 300; ++i )
+      {
+        ReferencePoint point;
+        point.row = random.nextInt( rows + 1 );
+        point.column = random.nextInt( columns + 1 );
+        point.radius = radii[ random.nextInt( 5 )];
+        point.weight = 0.5 + random.nextInt( 1000 ) / 500.0;
+        points << point;
+      }
+      // several points of the same cell and radius
+      for ( int i = 0; i < 20; ++i )
+      {
+        points << points.at( i );
+        points.last().weight = 0.25 * i;
+      }
+      QVector<float> reference = _referenceHeatmap( points, rows, columns );
+
+      QVector<HeatmapSource> sources;
+      QHash< QPair<qint64, int>, int > sourceIndex;
+      QHash<int, HeatmapStamp> stamps;
+      int maxRadius = 0;
+      Q_FOREACH ( const ReferencePoint& point, points )
+      {
+        if ( !stamps.contains( point.radius ) )
+        {
+          stamps.insert( point.radius, makeStamp( point.radius, _kernelValues( point.radius ) ) );
+          maxRadius = qMax( maxRadius, point.radius );
+        }
+        addSource( sources, sourceIndex, columns, point.row, point.column, point.radius, point.weight );
+      }
+      QVERIFY( sources.size() < points.size() );
+      std::stable_sort( sources.begin(), sources.end(), sourceRowLessThan );
+
+      QVector<double> values( stripRows * columns );
+      QVector<uchar> covered( stripRows * columns );
+      HeatmapBandJob job( sources, stamps, maxRadius, columns, values.data(), covered.data() );
+      for ( int firstRow = 0; firstRow < rows; firstRow += stripRows )
+      {
+        int nStripRows = qMin( stripRows, rows - firstRow );
+        values.fill( 0.0 );
+        covered.fill( 0 );
+        accumulateStrip( job, firstRow, nStripRows, threadCount );
+
+        for ( int i = 0; i < nStripRows * columns; ++i )
+        {
+          float expected = reference.at( firstRow * columns + i );
+          QCOMPARE( covered.at( i ) != 0, expected != NO_DATA );
+          if ( covered.at( i ) )
+          {
+            float value = values.at( i );
+            QVERIFY2( qgsDoubleNear( value, expected, 1e-5 * qMax( 1.0f, qAbs( expected ) ) ),
+                      QString( "cell %1: %2 != %3" ).arg( firstRow * columns + i ).arg( value ).arg( expected ).toLocal8Bit().constData() );
+          }
+        }
+      }
+    }
+
+    void blurTooLarge()
+    {
+      QVector<HeatmapSource> sources;
+      HeatmapSource source;
+      source.row = 10;
+      source.column = 10;
+      source.radius = 8;
+      source.weight = 1.0;
+      sources << source;
+
+      QVector<double> blurred;
+      QVector<double> coverage;
+      double stampMass = 0.0;
+      HeatmapStamp stamp = makeStamp( 8, _kernelValues( 8 ) );
+      QVERIFY( !blurSources( sources, stamp, 50000, 50000, blurred, coverage, stampMass ) );
+      QVERIFY( blurred.isEmpty() );
+      QVERIFY( coverage.isEmpty() );
+
+      QVERIFY( blurSources( sources, stamp, 30, 30, blurred, coverage, stampMass ) );
+      QCOMPARE( blurred.size(), 900 );
+      QVERIFY( stampMass > 0 );
+    }
+};
+
+QTEST_MAIN( TestHeatmapAccumulator )
+#include "testheatmapaccumulator.moc"
@@ -31,6 +31,27 @@ static QString _tempFile( const QString& name )
   return QString( "%1/aligntest-%2.tif" ).arg( QDir::tempPath(), name );
 }
 
+//! Records the reported progress
+struct TestAlignRasterProgress : public QgsAlignRaster::ProgressHandler
+{
+  TestAlignRasterProgress() : mComplete( 0 ) {}
+
+  virtual bool progress( double complete ) override
+  {
+    mComplete = complete;
+    return true;
+  }
+
+  virtual bool rasterProgress( int index, double complete ) override
+  {
+    mRasterComplete[index] = complete;
+    return true;
+  }
+
+  double mComplete;
+  QMap<int, double> mRasterComplete;
+};
+
 
 class TestAlignRaster : public QObject
 {
@@ -92,6 +113,41 @@ class TestAlignRaster : public QObject
       QVERIFY( !res );
     }
 
+    void testMultipleRasters()
+    {
+      QString tmpFile1( _tempFile( "multiple-1" ) );
+      QString tmpFile2( _tempFile( "multiple-2" ) );
+
+      QgsAlignRaster align;
+      QgsAlignRaster::List rasters;
+      rasters << QgsAlignRaster::Item( SRC_FILE, tmpFile1 );
+      rasters << QgsAlignRaster::Item( SRC_FILE, tmpFile2 );
+      align.setRasters( rasters );
+      align.setParametersFromRaster( SRC_FILE );
+      align.setClipExtent( 106.3, -6.65, 106.35, -6.5 );
+      align.setMemoryLimit( 16 );
+      QCOMPARE( align.memoryLimit(), 16 );
+      TestAlignRasterProgress progress;
+      align.setProgressHandler( &progress );
+      bool res = align.run();
+      QVERIFY( res );
+
+      // progress of each raster and overall progress are reported
+      QCOMPARE( progress.mRasterComplete.keys(), QList<int>() << 0 << 1 );
+      QCOMPARE( progress.mRasterComplete.value( 0 ), 1.0 );
+      QCOMPARE( progress.mRasterComplete.value( 1 ), 1.0 );
+      QCOMPARE( progress.mComplete, 1.0 );
+
+      Q_FOREACH ( const QString& tmpFile, QStringList() << tmpFile1 << tmpFile2 )
+      {
+        QgsAlignRaster::RasterInfo out( tmpFile );
+        QVERIFY( out.isValid() );
+        QCOMPARE( out.rasterSize(), QSize( 1, 2 ) );
+        QCOMPARE( out.identify( 106.3, -6.7 ), 10. );
+        QCOMPARE( out.identify( 106.3, -6.5 ), 6. );
+      }
+    }
+
     void testChangeGridOffsetNN()
     {
       QString tmpFile( _tempFile( "change-grid-offset-nn" ) );
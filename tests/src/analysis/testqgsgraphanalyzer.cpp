@@ -0,0 +1,491 @@
+/***************************************************************************
+  testqgsgraphanalyzer.cpp
+  --------------------------------------
+  Date                 : October 2016
+  Copyright            : (C) 2016 by the QGIS project
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "qgis.h"
+#include "qgscompactgraph.h"
+#include "qgscontractionhierarchy.h"
+#include "qgsgraph.h"
+#include "qgsgraphanalyzer.h"
+#include "qgsvertexheap.h"
+
+#include <QDir>
+#include <QFile>
+
+#include <cmath>
+#include <limits>
+
+//! Adds an arc with a single cost
+static void _addArc( QgsGraph& graph, int outVertex, int inVertex, double cost )
+{
+  graph.addArc( outVertex, inVertex, QVector<QVariant>() << cost );
+}
+
+/**
+ * Grid of 3 x 3 vertices with arcs of cost 1 in both directions between neighbours,
+ * so that most vertices are reached by several paths of the same cost
+ */
+static void _buildTiedGrid( QgsGraph& graph )
+{
+  for ( int row = 0; row < 3; ++row )
+  {
+    for ( int col = 0; col < 3; ++col )
+    {
+      graph.addVertex( QgsPoint( col, row ) );
+    }
+  }
+  for ( int row = 0; row < 3; ++row )
+  {
+    for ( int col = 0; col < 3; ++col )
+    {
+      int vertex = row * 3 + col;
+      if ( col < 2 )
+      {
+        _addArc( graph, vertex, vertex + 1, 1 );
+        _addArc( graph, vertex + 1, vertex, 1 );
+      }
+      if ( row < 2 )
+      {
+        _addArc( graph, vertex, vertex + 3, 1 );
+        _addArc( graph, vertex + 3, vertex, 1 );
+      }
+    }
+  }
+}
+
+//! Adds an arc costing a factor of at least 1 times its length, so that A* with a cost per distance of 1 is exact
+static void _addDistanceArc( QgsGraph& graph, int outVertex, int inVertex, double factor )
+{
+  QgsPoint p1 = graph.vertex( outVertex ).point();
+  QgsPoint p2 = graph.vertex( inVertex ).point();
+  _addArc( graph, outVertex, inVertex, factor * sqrt( p1.sqrDist( p2 ) ) );
+}
+
+/**
+ * Small network with one way arcs, paths of the same cost, a vertex which can be
+ * reached but has no outgoing arc and a vertex which cannot be reached
+ */
+static void _buildNetwork( QgsGraph& graph )
+{
+  graph.addVertex( QgsPoint( 0, 0 ) );
+  graph.addVertex( QgsPoint( 1, 0 ) );
+  graph.addVertex( QgsPoint( 2, 0 ) );
+  graph.addVertex( QgsPoint( 0, 1 ) );
+  graph.addVertex( QgsPoint( 1, 1 ) );
+  graph.addVertex( QgsPoint( 2, 1 ) );
+  graph.addVertex( QgsPoint( 3, 3 ) );
+  graph.addVertex( QgsPoint( 5, 5 ) );
+
+  _addDistanceArc( graph, 0, 1, 1 );
+  _addDistanceArc( graph, 1, 0, 1 );
+  _addDistanceArc( graph, 1, 2, 3 );
+  _addDistanceArc( graph, 2, 1, 3 );
+  _addDistanceArc( graph, 0, 3, 2 );
+  _addDistanceArc( graph, 3, 0, 2 );
+  _addDistanceArc( graph, 3, 4, 1 );
+  _addDistanceArc( graph, 4, 3, 1 );
+  _addDistanceArc( graph, 4, 5, 1 );
+  _addDistanceArc( graph, 5, 4, 1.5 );
+  _addDistanceArc( graph, 1, 4, 2 );
+  _addDistanceArc( graph, 4, 1, 2 );
+  _addDistanceArc( graph, 0, 4, 1.2 );
+  //one way arcs
+  _addDistanceArc( graph, 2, 5, 1 );
+  _addDistanceArc( graph, 5, 6, 1 );
+}
+
+/**
+ * Checks that a path leads from a vertex to another one and returns its cost,
+ * 0 for an empty path and -1 if arcs are not connected
+ */
+static double _pathCost( const QgsGraph& graph, const QVector<int>& path, int startVertex, int endVertex )
+{
+  int vertex = startVertex;
+  double cost = 0;
+  Q_FOREACH ( int arcIdx, path )
+  {
+    const QgsGraphArc& arc = graph.arc( arcIdx );
+    if ( arc.outVertex() != vertex )
+      return -1;
+    vertex = arc.inVertex();
+    cost += arc.property( 0 ).toDouble();
+  }
+  return vertex == endVertex ? cost : -1;
+}
+
+/**
+ * Reads a contraction hierarchy file and writes it again with one value of one of its
+ * integer arrays replaced
+ */
+static bool _corruptHierarchyFile( const QString& fileName, int array, int index, int value )
+{
+  quint32 magic, version;
+  qint32 criterion;
+  quint64 fingerprint;
+  QVector<int> intArrays[4];
+  QVector<int> arcFrom, arcTo;
+  QVector<double> arcCost;
+  QVector<int> arcArrays[3];
+  {
+    QFile file( fileName );
+    if ( !file.open( QIODevice::ReadOnly ) )
+      return false;
+    QDataStream in( &file );
+    in.setVersion( QDataStream::Qt_4_8 );
+    in >> magic >> version >> criterion >> fingerprint;
+    in >> intArrays[0] >> intArrays[1] >> intArrays[2] >> intArrays[3];
+    in >> arcFrom >> arcTo >> arcCost >> arcArrays[0] >> arcArrays[1] >> arcArrays[2];
+    if ( in.status() != QDataStream::Ok || index >= intArrays[ array ].size() )
+      return false;
+  }
+
+  intArrays[ array ][ index ] = value;
+
+  QFile file( fileName );
+  if ( !file.open( QIODevice::WriteOnly ) )
+    return false;
+  QDataStream out( &file );
+  out.setVersion( QDataStream::Qt_4_8 );
+  out << magic << version << criterion << fingerprint;
+  out << intArrays[0] << intArrays[1] << intArrays[2] << intArrays[3];
+  out << arcFrom << arcTo << arcCost << arcArrays[0] << arcArrays[1] << arcArrays[2];
+  return out.status() == QDataStream::Ok;
+}
+
+class TestQgsGraphAnalyzer : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+
+    void vertexHeapPopOrder()
+    {
+      QgsVertexHeap heap( 8 );
+      QVERIFY( heap.isEmpty() );
+      double keys[8] = { 5, 3, 7, 1, 3, 6, 0.5, 2 };
+      for ( int i = 0; i < 8; ++i )
+      {
+        heap.push( i, keys[i] );
+      }
+
+      QList<int> order;
+      double previous = -1;
+      while ( !heap.isEmpty() )
+      {
+        double key = heap.topKey();
+        QVERIFY( key >= previous );
+        previous = key;
+        order << heap.pop();
+      }
+      QCOMPARE( order, QList<int>() << 6 << 3 << 7 << 1 << 4 << 0 << 5 << 2 );
+    }
+
+    void vertexHeapTies()
+    {
+      //equal keys are not popped in insertion order
+      QgsVertexHeap heap( 3 );
+      heap.push( 0, 1 );
+      heap.push( 1, 1 );
+      heap.push( 2, 1 );
+      QCOMPARE( heap.pop(), 0 );
+      QCOMPARE( heap.pop(), 2 );
+      QCOMPARE( heap.pop(), 1 );
+      QVERIFY( heap.isEmpty() );
+    }
+
+    void vertexHeapDecreaseKey()
+    {
+      QgsVertexHeap heap( 5 );
+      heap.push( 0, 10 );
+      heap.push( 1, 20 );
+      heap.push( 2, 30 );
+      heap.push( 3, 40 );
+
+      //lower key moves the vertex up, a higher key is ignored
+      heap.push( 3, 5 );
+      QCOMPARE( heap.topKey(), 5.0 );
+      heap.push( 0, 50 );
+      heap.push( 2, 15 );
+
+      QCOMPARE( heap.pop(), 3 );
+      QCOMPARE( heap.topKey(), 10.0 );
+      QCOMPARE( heap.pop(), 0 );
+      QCOMPARE( heap.topKey(), 15.0 );
+
+      //a popped vertex can be pushed again
+      heap.push( 3, 1 );
+      QCOMPARE( heap.pop(), 3 );
+      QCOMPARE( heap.pop(), 2 );
+      QCOMPARE( heap.pop(), 1 );
+      QVERIFY( heap.isEmpty() );
+
+      heap.push( 4, 2 );
+      heap.push( 1, 3 );
+      heap.clear();
+      QVERIFY( heap.isEmpty() );
+      heap.push( 1, 4 );
+      QCOMPARE( heap.pop(), 1 );
+      QVERIFY( heap.isEmpty() );
+    }
+
+    void dijkstraTiedPaths()
+    {
+      //two paths of cost 2 from 0 to 3, the first settled vertex is the parent
+      QgsGraph diamond;
+      for ( int i = 0; i < 4; ++i )
+        diamond.addVertex( QgsPoint( i, 0 ) );
+      _addArc( diamond, 0, 1, 1 );
+      _addArc( diamond, 0, 2, 1 );
+      _addArc( diamond, 1, 3, 1 );
+      _addArc( diamond, 2, 3, 1 );
+
+      QVector<int> tree;
+      QVector<double> cost;
+      QgsGraphAnalyzer::dijkstra( &diamond, 0, 0, &tree, &cost );
+      QCOMPARE( tree, QVector<int>() << -1 << 0 << 1 << 2 );
+      QCOMPARE( cost, QVector<double>() << 0 << 1 << 1 << 2 );
+
+      QgsGraph grid;
+      _buildTiedGrid( grid );
+      QgsGraphAnalyzer::dijkstra( &grid, 0, 0, &tree, &cost );
+      QCOMPARE( tree, QVector<int>() << -1 << 0 << 4 << 2 << 6 << 14 << 12 << 16 << 18 );
+      QCOMPARE( cost, QVector<double>() << 0 << 1 << 2 << 1 << 2 << 3 << 2 << 3 << 4 );
+
+      QgsGraphAnalyzer::dijkstra( &grid, 4, 0, &tree, &cost );
+      QCOMPARE( tree, QVector<int>() << 1 << 7 << 4 << 11 << -1 << 14 << 21 << 16 << 22 );
+      QCOMPARE( cost, QVector<double>() << 2 << 1 << 2 << 1 << 0 << 1 << 2 << 1 << 2 );
+
+      //the compact graph gives the same tree
+      QgsCompactGraph compact( &grid );
+      QVector<int> compactTree;
+      QVector<double> compactCost;
+      QgsGraphAnalyzer::dijkstra( &compact, 4, 0, &compactTree, &compactCost );
+      QCOMPARE( compactTree, tree );
+      QCOMPARE( compactCost, cost );
+    }
+
+    void pointToPointSearches()
+    {
+      QgsGraph graph;
+      _buildNetwork( graph );
+      QgsCompactGraph compact( &graph );
+      QgsContractionHierarchy ch( &compact, 0 );
+      QVERIFY( ch.isValid() );
+      QCOMPARE( ch.vertexCount(), graph.vertexCount() );
+
+      double inf = std::numeric_limits<double>::infinity();
+      int unreachable = 0;
+      for ( int start = 0; start < graph.vertexCount(); ++start )
+      {
+        QVector<double> expected;
+        QgsGraphAnalyzer::dijkstra( &compact, start, 0, nullptr, &expected );
+        QCOMPARE( expected.at( start ), 0.0 );
+
+        for ( int end = 0; end < graph.vertexCount(); ++end )
+        {
+          QVector<int> paths[4];
+          double costs[4];
+          costs[0] = QgsGraphAnalyzer::shortestPath( &compact, start, end, 0, &paths[0] );
+          costs[1] = QgsGraphAnalyzer::aStar( &compact, start, end, 0, 1.0, nullptr, &paths[1] );
+          costs[2] = QgsGraphAnalyzer::bidirectionalShortestPath( &compact, start, end, 0, &paths[2] );
+          costs[3] = ch.shortestPath( start, end, &paths[3] );
+
+          for ( int i = 0; i < 4; ++i )
+          {
+            if ( expected.at( end ) == inf )
+            {
+              QVERIFY( costs[i] == inf );
+              QVERIFY( paths[i].isEmpty() );
+            }
+            else
+            {
+              QVERIFY( qgsDoubleNear( costs[i], expected.at( end ), 1e-9 ) );
+              QVERIFY( qgsDoubleNear( _pathCost( graph, paths[i], start, end ), expected.at( end ), 1e-9 ) );
+            }
+            if ( start == end )
+            {
+              QCOMPARE( costs[i], 0.0 );
+              QVERIFY( paths[i].isEmpty() );
+            }
+          }
+          if ( expected.at( end ) == inf )
+            ++unreachable;
+        }
+      }
+      //vertex 7 from all other vertices, every vertex from 6 and 7
+      QVERIFY( unreachable > 0 );
+
+      //vertices out of the graph
+      QVERIFY( QgsGraphAnalyzer::bidirectionalShortestPath( &compact, 0, graph.vertexCount(), 0 ) == inf );
+      QVERIFY( ch.shortestPath( -1, 0 ) == inf );
+    }
+
+    void costMatrix()
+    {
+      QgsGraph graph;
+      _buildNetwork( graph );
+      QgsCompactGraph compact( &graph );
+      double inf = std::numeric_limits<double>::infinity();
+
+      //7 cannot be reached and 6 has no outgoing arc, 6 is a destination twice
+      QVector<int> origins;
+      origins << 0 << 4 << 6 << 7 << 2 << 5;
+      QVector<int> destinations;
+      destinations << 1 << 7 << 6 << 0 << 3 << 6 << 5;
+
+      double maxCosts[3] = { -1, inf, 2.5 };
+      for ( int m = 0; m < 3; ++m )
+      {
+        double maxCost = maxCosts[m];
+        QVector< QVector<int> > trees;
+        QVector< QVector<double> > matrix = QgsGraphAnalyzer::costMatrix( &compact, origins, destinations, 0, maxCost, &trees );
+        QCOMPARE( matrix.size(), origins.size() );
+        QCOMPARE( trees.size(), origins.size() );
+
+        int unreachable = 0;
+        for ( int o = 0; o < origins.size(); ++o )
+        {
+          QVector<double> expected;
+          QgsGraphAnalyzer::dijkstra( &compact, origins.at( o ), 0, nullptr, &expected );
+          QCOMPARE( matrix.at( o ).size(), destinations.size() );
+          for ( int d = 0; d < destinations.size(); ++d )
+          {
+            int destination = destinations.at( d );
+            double cost = expected.at( destination );
+            if ( maxCost >= 0 && cost > maxCost )
+              cost = inf;
+
+            if ( cost == inf )
+            {
+              QVERIFY( matrix.at( o ).at( d ) == inf );
+              ++unreachable;
+              continue;
+            }
+            QVERIFY( qgsDoubleNear( matrix.at( o ).at( d ), cost, 1e-9 ) );
+
+            //the tree leads back to the origin with the same cost
+            double treeCost = 0;
+            for ( int v = destination; v != origins.at( o ); )
+            {
+              int arc = trees.at( o ).at( v );
+              QVERIFY( arc >= 0 );
+              treeCost += graph.arc( arc ).property( 0 ).toDouble();
+              v = graph.arc( arc ).outVertex();
+            }
+            QVERIFY( qgsDoubleNear( treeCost, cost, 1e-9 ) );
+          }
+        }
+        QVERIFY( unreachable > 0 );
+      }
+
+      //no origin, no destination
+      QVERIFY( QgsGraphAnalyzer::costMatrix( &compact, QVector<int>(), destinations, 0 ).isEmpty() );
+      QVector< QVector<double> > empty = QgsGraphAnalyzer::costMatrix( &compact, origins, QVector<int>(), 0 );
+      QCOMPARE( empty.size(), origins.size() );
+      QVERIFY( empty.at( 0 ).isEmpty() );
+    }
+
+    void contractionHierarchyFile()
+    {
+      QgsGraph graph;
+      _buildNetwork( graph );
+      QgsCompactGraph compact( &graph );
+      QgsContractionHierarchy ch( &compact, 0 );
+      QVERIFY( ch.isValid() );
+
+      QString fileName = QDir::tempPath() + "/graphanalyzertest.ch";
+      QVERIFY( ch.writeToFile( fileName ) );
+
+      //save, load and query
+      QgsContractionHierarchy loaded;
+      QVERIFY( !loaded.isValid() );
+      QVERIFY( loaded.readFromFile( fileName, &compact, 0 ) );
+      QVERIFY( loaded.isValid() );
+      QCOMPARE( loaded.vertexCount(), ch.vertexCount() );
+      QCOMPARE( loaded.shortcutCount(), ch.shortcutCount() );
+      for ( int start = 0; start < graph.vertexCount(); ++start )
+      {
+        for ( int end = 0; end < graph.vertexCount(); ++end )
+        {
+          QVector<int> path;
+          QVector<int> loadedPath;
+          QVERIFY( loaded.shortestPath( start, end, &loadedPath ) == ch.shortestPath( start, end, &path ) );
+          QCOMPARE( loadedPath, path );
+        }
+      }
+
+      //another graph
+      QgsGraph grid;
+      _buildTiedGrid( grid );
+      QgsCompactGraph compactGrid( &grid );
+      QVERIFY( !loaded.readFromFile( fileName, &compactGrid, 0 ) );
+      QVERIFY( !loaded.isValid() );
+      QVERIFY( !loaded.readFromFile( fileName, nullptr, 0 ) );
+
+      //the same vertices and arcs, with another cost or with two criteria
+      QgsGraph changed;
+      QgsGraph twoCriteria;
+      for ( int v = 0; v < graph.vertexCount(); ++v )
+      {
+        changed.addVertex( graph.vertex( v ).point() );
+        twoCriteria.addVertex( graph.vertex( v ).point() );
+      }
+      for ( int a = 0; a < graph.arcCount(); ++a )
+      {
+        const QgsGraphArc& arc = graph.arc( a );
+        QVector<QVariant> properties = arc.properties();
+        twoCriteria.addArc( arc.outVertex(), arc.inVertex(), QVector<QVariant>() << properties.at( 0 ) << properties.at( 0 ) );
+        if ( a == 3 )
+        {
+          properties[0] = properties.at( 0 ).toDouble() + 0.5;
+        }
+        changed.addArc( arc.outVertex(), arc.inVertex(), properties );
+      }
+      QgsCompactGraph compactChanged( &changed );
+      QVERIFY( !loaded.readFromFile( fileName, &compactChanged, 0 ) );
+      QgsCompactGraph compactTwoCriteria( &twoCriteria );
+      QVERIFY( loaded.readFromFile( fileName, &compactTwoCriteria, 0 ) );
+      QVERIFY( !loaded.readFromFile( fileName, &compactTwoCriteria, 1 ) );
+      QVERIFY( !loaded.readFromFile( fileName, &compact, 1 ) );
+      QgsContractionHierarchy second( &compactTwoCriteria, 1 );
+      QVERIFY( second.writeToFile( fileName ) );
+      QVERIFY( !loaded.readFromFile( fileName, &compactTwoCriteria, 0 ) );
+      QVERIFY( loaded.readFromFile( fileName, &compactTwoCriteria, 1 ) );
+      QVERIFY( ch.writeToFile( fileName ) );
+
+      //up arc out of the arcs, decreasing up offsets, down offsets not starting at 0
+      QVERIFY( _corruptHierarchyFile( fileName, 1, 0, 100000 ) );
+      QVERIFY( !loaded.readFromFile( fileName, &compact, 0 ) );
+      QVERIFY( ch.writeToFile( fileName ) );
+      QVERIFY( _corruptHierarchyFile( fileName, 0, 1, -1 ) );
+      QVERIFY( !loaded.readFromFile( fileName, &compact, 0 ) );
+      QVERIFY( ch.writeToFile( fileName ) );
+      QVERIFY( _corruptHierarchyFile( fileName, 2, 0, 1000 ) );
+      QVERIFY( !loaded.readFromFile( fileName, &compact, 0 ) );
+
+      //truncated
+      QVERIFY( ch.writeToFile( fileName ) );
+      QFile file( fileName );
+      QVERIFY( file.resize( file.size() / 2 ) );
+      QVERIFY( !loaded.readFromFile( fileName, &compact, 0 ) );
+      QVERIFY( !loaded.isValid() );
+      QVERIFY( loaded.shortestPath( 0, 1 ) == std::numeric_limits<double>::infinity() );
+
+      QFile::remove( fileName );
+    }
+};
+
+QTEST_MAIN( TestQgsGraphAnalyzer )
+#include "testqgsgraphanalyzer.moc"
@@ -0,0 +1,490 @@
+/***************************************************************************
+  testqgsinterpolator.cpp
+  --------------------------------------
+  Date                 : October 2016
+  Copyright            : (C) 2016 by the QGIS project
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "qgis.h"
+#include "qgsapplication.h"
+#include "qgsfeature.h"
+#include "qgsgeometry.h"
+#include "qgsgridfilewriter.h"
+#include "qgsidwinterpolator.h"
+#include "qgstestrandom.h"
+#include "qgstininterpolator.h"
+#include "qgsvectordataprovider.h"
+#include "qgsvectorlayer.h"
+
+#include <QDir>
+#include <QFile>
+#include <QPair>
+
+#include <algorithm>
+#include <cmath>
+
+#include <gdal.h>
+
+//! Point layer with the values of the vertices in its first attribute, in the order of the vertices
+static QgsVectorLayer* _pointLayer( const QVector<vertexData>& vertices )
+{
+  QgsVectorLayer* layer = new QgsVectorLayer( "Point?field=value:double", "points", "memory" );
+  QgsFeatureList features;
+  Q_FOREACH ( const vertexData& v, vertices )
+  {
+    QgsFeature f( layer->dataProvider()->fields() );
+    f.setGeometry( QgsGeometry::fromPoint( QgsPoint( v.x, v.y ) ) );
+    f.setAttribute( 0, v.z );
+    features << f;
+  }
+  layer->dataProvider()->addFeatures( features );
+  return layer;
+}
+
+static QList<QgsInterpolator::LayerData> _layerData( QgsVectorLayer* layer )
+{
+  QgsInterpolator::LayerData ld;
+  ld.vectorLayer = layer;
+  ld.zCoordInterpolation = false;
+  ld.interpolationAttribute = 0;
+  ld.mInputType = QgsInterpolator::POINTS;
+  return QList<QgsInterpolator::LayerData>() << ld;
+}
+
+static vertexData _vertex( double x, double y, double z )
+{
+  vertexData v;
+  v.x = x;
+  v.y = y;
+  v.z = z;
+  return v;
+}
+
+/**
+ * Inverse distance weighting comparing all the vertices and using pow(): the vertices within
+ * the radius are ordered by distance, then by index, and the first maxPoints are used.
+ * @return 0 in case of success
+ */
+static int _bruteForceIdw( const QVector<vertexData>& vertices, double x, double y, double radius, int maxPoints,
+                           int minPoints, double power, double& result )
+{
+  QVector< QPair<double, int> > neighbors;
+  for ( int i = 0; i < vertices.size(); ++i )
+  {
+    double dx = x - vertices.at( i ).x;
+    double dy = y - vertices.at( i ).y;
+    double sqrDist = dx * dx + dy * dy;
+    if ( radius <= 0 || sqrDist <= radius * radius )
+      neighbors << qMakePair( sqrDist, i );
+  }
+  std::sort( neighbors.begin(), neighbors.end() );
+  if ( maxPoints > 0 && neighbors.size() > maxPoints )
+    neighbors.resize( maxPoints );
+  if ( neighbors.size() < minPoints )
+    return 1;
+  if ( !neighbors.isEmpty() && neighbors.at( 0 ).first <= 0 )
+  {
+    result = vertices.at( neighbors.at( 0 ).second ).z;
+    return 0;
+  }
+
+  double sumCounter = 0;
+  double sumDenominator = 0;
+  for ( int i = 0; i < neighbors.size(); ++i )
+  {
+    double weight = 1 / pow( sqrt( neighbors.at( i ).first ), power );
+    sumCounter += weight * vertices.at( neighbors.at( i ).second ).z;
+    sumDenominator += weight;
+  }
+  if ( sumDenominator == 0.0 )
+    return 1;
+  result = sumCounter / sumDenominator;
+  return 0;
+}
+
+//! Interpolator whose base data cannot be read
+class FailingInterpolator : public QgsInterpolator
+{
+  public:
+    FailingInterpolator()
+        : QgsInterpolator( QList<LayerData>() )
+    {}
+
+    int interpolatePoint( double, double, double& result ) override
+    {
+      result = 1;
+      return 0;
+    }
+
+    int prepare() override { return 1; }
+};
+
+/**
+ * Interpolator without layers, with a value of x + 10 * y left of x = 6 and no value right of it.
+ * Rows may be interpolated concurrently.
+ */
+class HalfPlaneInterpolator : public QgsInterpolator
+{
+  public:
+    HalfPlaneInterpolator()
+        : QgsInterpolator( QList<LayerData>() )
+    {}
+
+    int interpolatePoint( double x, double y, double& result ) override
+    {
+      if ( x >= 6 )
+        return 1;
+      result = x + 10 * y;
+      return 0;
+    }
+
+    bool supportsConcurrentInterpolation() const override { return true; }
+};
+
+/** \ingroup UnitTests
+ * This is a unit test for the interpolators and the grid file writer
+ */
+class TestQgsInterpolator : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void initTestCase()
+    {
+      QgsApplication::init();
+      QgsApplication::initQgis();
+    }
+
+    void cleanupTestCase()
+    {
+      QgsApplication::exitQgis();
+    }
+
+    void idwSearch_data()
+    {
+      QTest::addColumn<double>( "radius" );
+      QTest::addColumn<int>( "maxPoints" );
+      QTest::addColumn<int>( "minPoints" );
+      QTest::addColumn<double>( "power" );
+
+      QTest::newRow( "all points" ) << 0.0 << 0 << 0 << 2.0;
+      QTest::newRow( "radius" ) << 15.0 << 0 << 0 << 2.0;
+      QTest::newRow( "max points" ) << 0.0 << 5 << 0 << 2.0;
+      QTest::newRow( "nearest point" ) << 0.0 << 1 << 0 << 2.0;
+      QTest::newRow( "radius and max points" ) << 20.0 << 8 << 0 << 2.0;
+      QTest::newRow( "radius and min points" ) << 10.0 << 0 << 4 << 2.0;
+      QTest::newRow( "power 0" ) << 15.0 << 0 << 0 << 0.0;
+      QTest::newRow( "power 1" ) << 0.0 << 6 << 0 << 1.0;
+      QTest::newRow( "power 3" ) << 15.0 << 0 << 0 << 3.0;
+      QTest::newRow( "power 16" ) << 20.0 << 8 << 0 << 16.0;
+      QTest::newRow( "power 1.5" ) << 20.0 << 6 << 0 << 1.5;
+      QTest::newRow( "power 2.5" ) << 0.0 << 0 << 0 << 2.5;
+      QTest::newRow( "power 17" ) << 20.0 << 8 << 0 << 17.0;
+    }
+
+    void idwSearch() // the kd-tree search finds the vertices of a brute force search
+    {
+      QFETCH( double, radius );
+      QFETCH( int, maxPoints );
+      QFETCH( int, minPoints );
+      QFETCH( double, power );
+
+      // random vertices, some of them at the same place with different values
+      QgsTestRandom random( 7 );
+      QVector<vertexData> vertices;
+      for ( int i = 0; i < 300; ++i )
+        vertices << _vertex( random.nextCoordinate( 100 ), random.nextCoordinate( 100 ), random.nextCoordinate( 100 ) );
+      for ( int i = 0; i < 20; ++i )
+        vertices << _vertex( vertices.at( i ).x, vertices.at( i ).y, vertices.at( i ).z + 50 );
+
+      QScopedPointer<QgsVectorLayer> layer( _pointLayer( vertices ) );
+      QgsIDWInterpolator idw( _layerData( layer.data() ) );
+      idw.setSearchRadius( radius );
+      idw.setMaxPoints( maxPoints );
+      idw.setMinPoints( minPoints );
+      idw.setDistanceCoefficient( power );
+      QCOMPARE( idw.prepare(), 0 );
+
+      // grid of points inside and outside of the vertices, and the vertices themselves
+      QVector< QPair<double, double> > points;
+      for ( int row = 0; row < 25; ++row )
+      {
+        for ( int col = 0; col < 25; ++col )
+          points << qMakePair( col * 6.1 - 40, row * 5.9 - 40 );
+      }
+      for ( int i = 0; i < 40; ++i )
+        points << qMakePair( vertices.at( i ).x, vertices.at( i ).y );
+
+      int failed = 0;
+      for ( int i = 0; i < points.size(); ++i )
+      {
+        double x = points.at( i ).first;
+        double y = points.at( i ).second;
+        double expected = 0;
+        int expectedStatus = _bruteForceIdw( vertices, x, y, radius, maxPoints, minPoints, power, expected );
+        double result = 0;
+        int status = idw.interpolatePoint( x, y, result );
+        QCOMPARE( status == 0, expectedStatus == 0 );
+        if ( status != 0 )
+        {
+          ++failed;
+          continue;
+        }
+        // the sums are in a different order, results agree up to rounding
+        QVERIFY2( qgsDoubleNearSig( result, expected, 10 ), QString( "%1 %2: %3 instead of %4" ).arg( x ).arg( y ).arg( result, 0, 'g', 17 ).arg( expected, 0, 'g', 17 ).toLocal8Bit().constData() );
+      }
+      // with a radius, points far from the vertices have no value
+      QCOMPARE( failed > 0, radius > 0 );
+    }
+
+    void idwEqualDistances() // of vertices at the same distance, the first ones are used
+    {
+      QVector<vertexData> vertices;
+      vertices << _vertex( 10, 10, 100 ) << _vertex( 11, 10, 1 ) << _vertex( 10, 11, 2 ) << _vertex( 9, 10, 4 ) << _vertex( 10, 9, 8 );
+      QScopedPointer<QgsVectorLayer> layer( _pointLayer( vertices ) );
+      QgsIDWInterpolator idw( _layerData( layer.data() ) );
+      idw.setMaxPoints( 2 );
+
+      double result = 0;
+      QCOMPARE( idw.interpolatePoint( 10, 10, result ), 0 );
+      QCOMPARE( result, 100.0 );
+      // the first three vertices are at the same distance from ( 10.5, 10.5 )
+      QCOMPARE( idw.interpolatePoint( 10.5, 10.5, result ), 0 );
+      QCOMPARE( result, 50.5 );
+      idw.setMaxPoints( 3 );
+      QCOMPARE( idw.interpolatePoint( 10.5, 10.5, result ), 0 );
+      QCOMPARE( result, 103.0 / 3.0 );
+      idw.setMaxPoints( 4 );
+      idw.setSearchRadius( 1 );
+      QCOMPARE( idw.interpolatePoint( 10, 10, result ), 0 );
+      QCOMPARE( result, 100.0 );
+      QCOMPARE( idw.interpolatePoint( 10, 10.5, result ), 0 );
+      QCOMPARE( result, 51.0 );
+    }
+
+    void idwCoincidentPoint() // at a vertex, its value is the result
+    {
+      QVector<vertexData> vertices;
+      vertices << _vertex( 0, 0, 1 ) << _vertex( 5, 5, 7 ) << _vertex( 5, 5, 9 ) << _vertex( 10, 0, 3 );
+      QScopedPointer<QgsVectorLayer> layer( _pointLayer( vertices ) );
+
+      for ( int search = 0; search < 3; ++search )
+      {
+        QgsIDWInterpolator idw( _layerData( layer.data() ) );
+        if ( search == 1 )
+          idw.setSearchRadius( 2 );
+        else if ( search == 2 )
+          idw.setMaxPoints( 3 );
+
+        double result = 0;
+        QCOMPARE( idw.interpolatePoint( 0, 0, result ), 0 );
+        QCOMPARE( result, 1.0 );
+        QCOMPARE( idw.interpolatePoint( 10, 0, result ), 0 );
+        QCOMPARE( result, 3.0 );
+        // of two vertices at the same place, the first one gives the value
+        QCOMPARE( idw.interpolatePoint( 5, 5, result ), 0 );
+        QCOMPARE( result, 7.0 );
+      }
+    }
+
+    void idwMinPoints() // too few vertices in the radius fail the interpolation
+    {
+      QVector<vertexData> vertices;
+      vertices << _vertex( 0, 0, 1 ) << _vertex( 1, 0, 2 ) << _vertex( 10, 10, 3 );
+      QScopedPointer<QgsVectorLayer> layer( _pointLayer( vertices ) );
+      QgsIDWInterpolator idw( _layerData( layer.data() ) );
+      idw.setSearchRadius( 2 );
+      idw.setMinPoints( 2 );
+
+      double result = 0;
+      QCOMPARE( idw.interpolatePoint( 0.5, 0, result ), 0 );
+      QCOMPARE( result, 1.5 );
+      QVERIFY( idw.interpolatePoint( 10, 10.5, result ) != 0 );
+      idw.setMinPoints( 3 );
+      QVERIFY( idw.interpolatePoint( 0.5, 0, result ) != 0 );
+
+      // without a search radius, all the vertices are counted
+      idw.setSearchRadius( 0 );
+      QCOMPARE( idw.interpolatePoint( 0.5, 0, result ), 0 );
+      idw.setMinPoints( 4 );
+      QVERIFY( idw.interpolatePoint( 0.5, 0, result ) != 0 );
+    }
+
+    void tinRows() // rows interpolated at once have the values of single points
+    {
+      QgsTestRandom random( 11 );
+      QVector<vertexData> vertices;
+      for ( int i = 0; i < 400; ++i )
+        vertices << _vertex( random.nextCoordinate( 100 ), random.nextCoordinate( 100 ), random.nextCoordinate( 100 ) );
+      QScopedPointer<QgsVectorLayer> layer( _pointLayer( vertices ) );
+      QgsTINInterpolator tin( _layerData( layer.data() ) );
+      QCOMPARE( tin.prepare(), 0 );
+
+      // rows start and end outside of the convex hull
+      const int count = 130;
+      double results[count];
+      bool valid[count];
+      int validCount = 0;
+      for ( int row = 0; row < 40; ++row )
+      {
+        double y = row * 2.6 - 1.3;
+        tin.interpolateRow( -10.15, y, 0.93, count, results, valid );
+        for ( int i = 0; i < count; ++i )
+        {
+          double x = -10.15 + i * 0.93;
+          double expected = 0;
+          bool expectedValid = tin.interpolatePoint( x, y, expected ) == 0;
+          QCOMPARE( valid[i], expectedValid );
+          if ( !valid[i] )
+            continue;
+          ++validCount;
+          // the plane of a triangle may be calculated from its vertices in another order
+          QVERIFY2( qgsDoubleNear( results[i], expected, 1e-8 ), QString( "%1 %2: %3 instead of %4" ).arg( x ).arg( y ).arg( results[i], 0, 'g', 17 ).arg( expected, 0, 'g', 17 ).toLocal8Bit().constData() );
+        }
+      }
+      QVERIFY( validCount > 0 );
+      QVERIFY( validCount < 40 * count );
+    }
+
+    void tinBulkInsertion() // duplicate and collinear points first in the insertion order are triangulated
+    {
+      // the points are inserted from the corner at ( 0, 0 ), after its duplicates come
+      // points on the diagonal. All the values are on a plane.
+      QVector<vertexData> vertices;
+      for ( int i = 0; i < 3; ++i )
+        vertices << _vertex( 0, 0, 1 );
+      for ( int i = 1; i <= 10; ++i )
+        vertices << _vertex( i, i, 5 * i + 1 );
+      vertices << _vertex( 2, 2, 11 ) << _vertex( 10, 0, 21 ) << _vertex( 0, 10, 31 ) << _vertex( 10, 0, 21 );
+      QScopedPointer<QgsVectorLayer> layer( _pointLayer( vertices ) );
+      QgsTINInterpolator tin( _layerData( layer.data() ) );
+      QCOMPARE( tin.prepare(), 0 );
+
+      for ( int row = 0; row < 10; ++row )
+      {
+        for ( int col = 0; col < 10; ++col )
+        {
+          double x = col + 0.5;
+          double y = row + 0.5;
+          double result = 0;
+          QCOMPARE( tin.interpolatePoint( x, y, result ), 0 );
+          QVERIFY( qgsDoubleNear( result, 2 * x + 3 * y + 1, 1e-8 ) );
+        }
+      }
+      double result = 0;
+      QCOMPARE( tin.interpolatePoint( 0, 10, result ), 0 );
+      QVERIFY( qgsDoubleNear( result, 31, 1e-8 ) );
+      QVERIFY( tin.interpolatePoint( 11, 5, result ) != 0 );
+    }
+
+    void writerGdal_data()
+    {
+      QTest::addColumn<int>( "columns" );
+      QTest::addColumn<int>( "rows" );
+      QTest::addColumn<QStringList>( "options" );
+
+      QTest::newRow( "tiled" ) << 12 << 6 << QStringList();
+      QTest::newRow( "stripped" ) << 12 << 6 << ( QStringList() << "TILED=NO" );
+      QTest::newRow( "compressed" ) << 38 << 300 << ( QStringList() << "COMPRESS=LZW" );
+      QTest::newRow( "several strips" ) << 2100 << 2100 << QStringList();
+    }
+
+    void writerGdal() // a GeoTIFF written in strips has the values, no data and geotransform of the grid
+    {
+      QFETCH( int, columns );
+      QFETCH( int, rows );
+      QFETCH( QStringList, options );
+
+      HalfPlaneInterpolator interpolator;
+      QString tifFile = QDir::tempPath() + "/qgis_interpolator_grid.tif";
+      QFile::remove( tifFile );
+
+      QgsRectangle extent( 0, 20, 12, 29 );
+      double cellSizeX = extent.width() / columns;
+      double cellSizeY = extent.height() / rows;
+      QgsGridFileWriter writer( &interpolator, tifFile, extent, columns, rows, cellSizeX, cellSizeY );
+      writer.setOutputFormat( "GTiff" );
+      writer.setCreationOptions( options );
+      QCOMPARE( writer.writeFile(), 0 );
+
+      GDALDatasetH dataset = GDALOpen( tifFile.toUtf8().constData(), GA_ReadOnly );
+      QVERIFY( dataset );
+      QCOMPARE( GDALGetRasterXSize( dataset ), columns );
+      QCOMPARE( GDALGetRasterYSize( dataset ), rows );
+      QCOMPARE( GDALGetRasterCount( dataset ), 1 );
+      double geoTransform[6];
+      QCOMPARE( GDALGetGeoTransform( dataset, geoTransform ), CE_None );
+      QCOMPARE( geoTransform[0], 0.0 );
+      QCOMPARE( geoTransform[1], cellSizeX );
+      QCOMPARE( geoTransform[2], 0.0 );
+      QCOMPARE( geoTransform[3], 29.0 );
+      QCOMPARE( geoTransform[4], 0.0 );
+      QCOMPARE( geoTransform[5], -cellSizeY );
+
+      GDALRasterBandH band = GDALGetRasterBand( dataset, 1 );
+      QCOMPARE( GDALGetRasterDataType( band ), GDT_Float32 );
+      int hasNoData = 0;
+      QCOMPARE( GDALGetRasterNoDataValue( band, &hasNoData ), -9999.0 );
+      QVERIFY( hasNoData );
+
+      QVector<float> values( columns * rows );
+      CPLErr err = GDALRasterIO( band, GF_Read, 0, 0, columns, rows, values.data(), columns, rows, GDT_Float32, 0, 0 );
+      GDALClose( dataset );
+      QFile::remove( tifFile );
+      QCOMPARE( err, CE_None );
+
+      // cell centers calculated as by the writer
+      int noData = 0;
+      double y = extent.yMaximum() - cellSizeY / 2.0;
+      for ( int row = 0; row < rows; ++row, y -= cellSizeY )
+      {
+        double x = extent.xMinimum() + cellSizeX / 2.0;
+        for ( int col = 0; col < columns; ++col, x += cellSizeX )
+        {
+          double expected = 0;
+          float value = values.at( row * columns + col );
+          if ( interpolator.interpolatePoint( x, y, expected ) == 0 )
+          {
+            QCOMPARE( value, static_cast< float >( expected ) );
+          }
+          else
+          {
+            QCOMPARE( value, -9999.0f );
+            ++noData;
+          }
+        }
+      }
+      // the interpolator has no value in the right half of the grid
+      QCOMPARE( noData, columns * rows / 2 );
+    }
+
+    void writerPrepareError() // no grid is written if the interpolator cannot be prepared
+    {
+      FailingInterpolator interpolator;
+      QString ascFile = QDir::tempPath() + "/qgis_interpolator_failed.asc";
+      QString tifFile = QDir::tempPath() + "/qgis_interpolator_failed.tif";
+      QFile::remove( ascFile );
+      QFile::remove( tifFile );
+
+      QgsGridFileWriter writer( &interpolator, ascFile, QgsRectangle( 0, 0, 10, 10 ), 10, 10, 1, 1 );
+      QCOMPARE( writer.writeFile(), 5 );
+      QVERIFY( !QFile::exists( ascFile ) );
+
+      QgsGridFileWriter gdalWriter( &interpolator, tifFile, QgsRectangle( 0, 0, 10, 10 ), 10, 10, 1, 1 );
+      gdalWriter.setOutputFormat( "GTiff" );
+      QCOMPARE( gdalWriter.writeFile(), 5 );
+      QVERIFY( !QFile::exists( tifFile ) );
+    }
+};
+
+QTEST_MAIN( TestQgsInterpolator )
+#include "testqgsinterpolator.moc"
@@ -0,0 +1,368 @@
+/***************************************************************************
+  testqgslinevectorlayerdirector.cpp
+  --------------------------------------
+  Date                 : October 2016
+  Copyright            : (C) 2016 by the QGIS project
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "qgis.h"
+#include "qgsapplication.h"
+#include "qgsdistancearcproperter.h"
+#include "qgsfeature.h"
+#include "qgsgeometry.h"
+#include "qgsgraph.h"
+#include "qgsgraphbuilder.h"
+#include "qgslinevectorlayerdirector.h"
+#include "qgstestrandom.h"
+#include "qgsvectordataprovider.h"
+#include "qgsvectorlayer.h"
+
+#include <QMap>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/**
+ * Point order of the graph vertices, as in QgsLineVectorLayerDirector. With a
+ * tolerance, points are compared by their tolerance cell.
+ */
+class ReferencePointCompare
+{
+  public:
+    explicit ReferencePointCompare( double tolerance )
+        : mTolerance( tolerance )
+    {}
+
+    bool operator()( const QgsPoint& p1, const QgsPoint& p2 ) const
+    {
+      if ( mTolerance <= 0 )
+        return p1.x() == p2.x() ? p1.y() < p2.y() : p1.x() < p2.x();
+
+      double tx1 = ceil( p1.x() / mTolerance );
+      double tx2 = ceil( p2.x() / mTolerance );
+      if ( tx1 == tx2 )
+        return ceil( p1.y() / mTolerance ) < ceil( p2.y() / mTolerance );
+      return tx1 < tx2;
+    }
+
+  private:
+    double mTolerance;
+};
+
+/**
+ * Index of a point in the sorted vertices, found by the binary search of the
+ * director before the segment grid, -1 if not found
+ */
+static int _referenceIndex( const QVector< QgsPoint >& points, const QgsPoint& pt, const ReferencePointCompare& comp )
+{
+  int begin = 0;
+  int end = points.size();
+  while ( true )
+  {
+    int avg = begin + ( end - begin ) / 2;
+    if ( begin == avg || end == avg )
+    {
+      if ( !comp( points.at( begin ), pt ) && !comp( pt, points.at( begin ) ) )
+        return begin;
+      if ( end < points.size() && !comp( points.at( end ), pt ) && !comp( pt, points.at( end ) ) )
+        return end;
+      return -1;
+    }
+    if ( comp( pt, points.at( avg ) ) )
+      end = avg;
+    else if ( comp( points.at( avg ), pt ) )
+      begin = avg;
+    else
+      return avg;
+  }
+}
+
+struct ReferenceTiePoint
+{
+  QgsPoint tiedPoint;
+  double length;
+  QgsPoint firstPoint;
+  QgsPoint lastPoint;
+};
+
+/**
+ * Builds the graph of polylines with arcs in both directions the way the director did
+ * before the segment grid: each point is tied to the first segment at the lowest distance,
+ * found by comparing all the segments.
+ */
+static void _referenceGraph( QgsGraphBuilderInterface& builder, const QList< QgsMultiPolyline >& lines,
+                             const QVector< QgsPoint >& additionalPoints, QVector< QgsPoint >& tiedPoints )
+{
+  tiedPoints = QVector< QgsPoint >( additionalPoints.size(), QgsPoint( 0.0, 0.0 ) );
+  ReferenceTiePoint untied;
+  untied.length = std::numeric_limits<double>::infinity();
+  QVector< ReferenceTiePoint > infos( additionalPoints.size(), untied );
+
+  QVector< QgsPoint > points;
+  Q_FOREACH ( const QgsMultiPolyline& mpl, lines )
+  {
+    Q_FOREACH ( const QgsPolyline& pl, mpl )
+    {
+      for ( int p = 0; p < pl.size(); ++p )
+      {
+        points << pl.at( p );
+        if ( p == 0 )
+          continue;
+
+        QgsPoint pt1 = pl.at( p - 1 );
+        QgsPoint pt2 = pl.at( p );
+        for ( int i = 0; i < additionalPoints.size(); ++i )
+        {
+          ReferenceTiePoint info;
+          if ( pt1 == pt2 )
+          {
+            info.length = additionalPoints.at( i ).sqrDist( pt1 );
+            info.tiedPoint = pt1;
+          }
+          else
+          {
+            info.length = additionalPoints.at( i ).sqrDistToSegment( pt1.x(), pt1.y(), pt2.x(), pt2.y(), info.tiedPoint );
+          }
+          if ( infos.at( i ).length > info.length )
+          {
+            info.firstPoint = pt1;
+            info.lastPoint = pt2;
+            infos[i] = info;
+            tiedPoints[i] = info.tiedPoint;
+          }
+        }
+      }
+    }
+  }
+
+  for ( int i = 0; i < tiedPoints.size(); ++i )
+  {
+    if ( tiedPoints.at( i ) != QgsPoint( 0.0, 0.0 ) )
+      points << tiedPoints.at( i );
+  }
+
+  ReferencePointCompare comp( builder.topologyTolerance() );
+  qSort( points.begin(), points.end(), comp );
+  points.resize( std::unique( points.begin(), points.end() ) - points.begin() );
+  for ( int i = 0; i < points.size(); ++i )
+    builder.addVertex( i, points.at( i ) );
+
+  for ( int i = 0; i < tiedPoints.size(); ++i )
+  {
+    if ( tiedPoints.at( i ) == QgsPoint( 0.0, 0.0 ) )
+      continue;
+    tiedPoints[i] = points.at( _referenceIndex( points, tiedPoints.at( i ), comp ) );
+  }
+
+  Q_FOREACH ( const QgsMultiPolyline& mpl, lines )
+  {
+    Q_FOREACH ( const QgsPolyline& pl, mpl )
+    {
+      for ( int p = 1; p < pl.size(); ++p )
+      {
+        QgsPoint segmentFirst = pl.at( p - 1 );
+        QgsPoint segmentLast = pl.at( p );
+        QMap< double, QgsPoint > pointsOnArc;
+        pointsOnArc[ 0.0 ] = segmentFirst;
+        pointsOnArc[ segmentFirst.sqrDist( segmentLast )] = segmentLast;
+        for ( int i = 0; i < infos.size(); ++i )
+        {
+          if ( infos.at( i ).firstPoint == segmentFirst && infos.at( i ).lastPoint == segmentLast )
+            pointsOnArc[ segmentFirst.sqrDist( infos.at( i ).tiedPoint )] = infos.at( i ).tiedPoint;
+        }
+
+        QgsPoint pt1;
+        int pt1idx = -1;
+        bool isFirstPoint = true;
+        for ( QMap< double, QgsPoint >::const_iterator it = pointsOnArc.constBegin(); it != pointsOnArc.constEnd(); ++it )
+        {
+          int pt2idx = _referenceIndex( points, it.value(), comp );
+          QgsPoint pt2 = points.at( pt2idx );
+          if ( !isFirstPoint && pt1 != pt2 )
+          {
+            QVector< QVariant > prop;
+            prop << builder.distanceArea()->measureLine( pt1, pt2 );
+            builder.addArc( pt1idx, pt1, pt2idx, pt2, prop );
+            builder.addArc( pt2idx, pt2, pt1idx, pt1, prop );
+          }
+          pt1idx = pt2idx;
+          pt1 = pt2;
+          isFirstPoint = false;
+        }
+      }
+    }
+  }
+}
+
+/** \ingroup UnitTests
+ * This is a unit test for the graph built by QgsLineVectorLayerDirector
+ */
+class TestQgsLineVectorLayerDirector : public QObject
+{
+    Q_OBJECT
+
+  public:
+    TestQgsLineVectorLayerDirector()
+        : mLayer( nullptr )
+    {}
+
+  private slots:
+    void initTestCase()
+    {
+      QgsApplication::init();
+      QgsApplication::initQgis();
+
+      // lines around the first segments: a parallel one at the same distance from
+      // (15, 11), a degenerate segment, a vertex near (20, 10) and a multi line
+      mLines << ( QgsMultiPolyline() << ( QgsPolyline() << QgsPoint( 10, 10 ) << QgsPoint( 20, 10 ) << QgsPoint( 20, 20 ) ) );
+      mLines << ( QgsMultiPolyline() << ( QgsPolyline() << QgsPoint( 10, 12 ) << QgsPoint( 20, 12 ) ) );
+      mLines << ( QgsMultiPolyline() << ( QgsPolyline() << QgsPoint( 30, 30 ) << QgsPoint( 30, 30 ) << QgsPoint( 35, 30 ) ) );
+      mLines << ( QgsMultiPolyline() << ( QgsPolyline() << QgsPoint( 20, 20 ) << QgsPoint( 25, 25 ) << QgsPoint( 30, 30 ) )
+                  << ( QgsPolyline() << QgsPoint( 19.7, 9.8 ) << QgsPoint( 22, 8 ) ) );
+
+      // random lines on the right of these ones, so that the segment grid has many cells
+      QgsTestRandom random( 1 );
+      for ( int i = 0; i < 60; ++i )
+      {
+        QgsPolyline pl;
+        for ( int p = 0; p < 3; ++p )
+          pl << QgsPoint( random.nextCoordinate( 100 ) + 100, random.nextCoordinate( 100 ) );
+        mLines << ( QgsMultiPolyline() << pl );
+      }
+
+      mLayer = new QgsVectorLayer( "MultiLineString?crs=epsg:3857", "lines", "memory" );
+      QVERIFY( mLayer->isValid() );
+      QgsFeatureList features;
+      Q_FOREACH ( const QgsMultiPolyline& mpl, mLines )
+      {
+        QgsFeature f( mLayer->dataProvider()->fields() );
+        f.setGeometry( QgsGeometry::fromMultiPolyline( mpl ) );
+        features << f;
+      }
+      QVERIFY( mLayer->dataProvider()->addFeatures( features ) );
+
+      // points on vertices, on segments, at the same distance of two segments, outside
+      // of the lines and random points, enough to be tied on several threads
+      mAdditionalPoints << QgsPoint( 15, 11 ) << QgsPoint( 20, 20 ) << QgsPoint( 15, 10 ) << QgsPoint( 32, 31 )
+      << QgsPoint( 30, 29 ) << QgsPoint( 1000, -500 ) << QgsPoint( -200, 300 ) << QgsPoint( 21, 9 );
+      for ( int i = 0; i < 300; ++i )
+        mAdditionalPoints << QgsPoint( random.nextCoordinate( 100 ) * 2.4 - 10, random.nextCoordinate( 100 ) * 1.2 - 10 );
+    }
+
+    void cleanupTestCase()
+    {
+      delete mLayer;
+      QgsApplication::exitQgis();
+    }
+
+    void sameGraph_data()
+    {
+      QTest::addColumn<double>( "tolerance" );
+
+      QTest::newRow( "no tolerance" ) << 0.0;
+      QTest::newRow( "tolerance" ) << 0.5;
+    }
+
+    void sameGraph() // the graph is the same as with the brute force search of the nearest segments
+    {
+      QFETCH( double, tolerance );
+
+      QgsGraphBuilder referenceBuilder( mLayer->crs(), false, tolerance );
+      QVector< QgsPoint > referenceTiedPoints;
+      _referenceGraph( referenceBuilder, mLines, mAdditionalPoints, referenceTiedPoints );
+      QScopedPointer< QgsGraph > reference( referenceBuilder.graph() );
+
+      QVector< QgsPoint > tiedPoints;
+      QScopedPointer< QgsGraph > graph( buildGraph( tolerance, mAdditionalPoints, tiedPoints ) );
+
+      compareGraphs( graph.data(), reference.data() );
+      QCOMPARE( tiedPoints.size(), referenceTiedPoints.size() );
+      for ( int i = 0; i < tiedPoints.size(); ++i )
+      {
+        QCOMPARE( tiedPoints.at( i ).x(), referenceTiedPoints.at( i ).x() );
+        QCOMPARE( tiedPoints.at( i ).y(), referenceTiedPoints.at( i ).y() );
+      }
+
+      // at the same distance of two segments, the point is tied to the first one
+      if ( tolerance == 0 )
+        QVERIFY( tiedPoints.at( 0 ) == QgsPoint( 15, 10 ) );
+    }
+
+    void nonFinitePoints() // points with a NaN or infinite coordinate are not tied
+    {
+      double nan = std::numeric_limits<double>::quiet_NaN();
+      double inf = std::numeric_limits<double>::infinity();
+      QVector< QgsPoint > additionalPoints;
+      additionalPoints << QgsPoint( nan, 10 ) << QgsPoint( 15, 11 ) << QgsPoint( 10, inf )
+      << QgsPoint( -inf, -inf ) << QgsPoint( nan, nan ) << QgsPoint( 1.0e300, -1.0e300 ) << QgsPoint( 1.0e6, -1.0e6 );
+
+      QVector< QgsPoint > tiedPoints;
+      QScopedPointer< QgsGraph > graph( buildGraph( 0, additionalPoints, tiedPoints ) );
+      QCOMPARE( tiedPoints.size(), additionalPoints.size() );
+      QVERIFY( tiedPoints.at( 0 ) == QgsPoint( 0, 0 ) );
+      QVERIFY( tiedPoints.at( 1 ) == QgsPoint( 15, 10 ) );
+      QVERIFY( tiedPoints.at( 2 ) == QgsPoint( 0, 0 ) );
+      QVERIFY( tiedPoints.at( 3 ) == QgsPoint( 0, 0 ) );
+      QVERIFY( tiedPoints.at( 4 ) == QgsPoint( 0, 0 ) );
+      // the squared distance overflows, as before the segment grid the point is not tied
+      QVERIFY( tiedPoints.at( 5 ) == QgsPoint( 0, 0 ) );
+      // far points are still tied
+      QVERIFY( tiedPoints.at( 6 ) != QgsPoint( 0, 0 ) );
+      QVERIFY( graph->findVertex( tiedPoints.at( 6 ) ) >= 0 );
+
+      // the rest of the graph is the one without these points
+      QVector< QgsPoint > finitePoints;
+      finitePoints << additionalPoints.at( 1 ) << additionalPoints.at( 6 );
+      QgsGraphBuilder referenceBuilder( mLayer->crs(), false, 0 );
+      QVector< QgsPoint > referenceTiedPoints;
+      _referenceGraph( referenceBuilder, mLines, finitePoints, referenceTiedPoints );
+      QScopedPointer< QgsGraph > reference( referenceBuilder.graph() );
+      compareGraphs( graph.data(), reference.data() );
+    }
+
+  private:
+    QgsGraph* buildGraph( double tolerance, const QVector< QgsPoint >& additionalPoints, QVector< QgsPoint >& tiedPoints ) const
+    {
+      QgsLineVectorLayerDirector director( mLayer, -1, QString(), QString(), QString(), 3 );
+      QgsDistanceArcProperter properter;
+      director.addProperter( &properter );
+      QgsGraphBuilder builder( mLayer->crs(), false, tolerance );
+      director.makeGraph( &builder, additionalPoints, tiedPoints );
+      return builder.graph();
+    }
+
+    static void compareGraphs( const QgsGraph* graph, const QgsGraph* reference )
+    {
+      QCOMPARE( graph->vertexCount(), reference->vertexCount() );
+      for ( int i = 0; i < graph->vertexCount(); ++i )
+      {
+        QCOMPARE( graph->vertex( i ).point().x(), reference->vertex( i ).point().x() );
+        QCOMPARE( graph->vertex( i ).point().y(), reference->vertex( i ).point().y() );
+      }
+      QCOMPARE( graph->arcCount(), reference->arcCount() );
+      for ( int i = 0; i < graph->arcCount(); ++i )
+      {
+        QCOMPARE( graph->arc( i ).outVertex(), reference->arc( i ).outVertex() );
+        QCOMPARE( graph->arc( i ).inVertex(), reference->arc( i ).inVertex() );
+        QCOMPARE( graph->arc( i ).properties().size(), 1 );
+        QCOMPARE( graph->arc( i ).property( 0 ).toDouble(), reference->arc( i ).property( 0 ).toDouble() );
+      }
+    }
+
+    QgsVectorLayer* mLayer;
+    QList< QgsMultiPolyline > mLines;
+    QVector< QgsPoint > mAdditionalPoints;
+};
+
+QTEST_MAIN( TestQgsLineVectorLayerDirector )
+#include "testqgslinevectorlayerdirector.moc"
@@ -0,0 +1,215 @@
+/***************************************************************************
+  testqgsninecellfilters.cpp
+  --------------------------------------
+  Date                 : October 2016
+  Copyright            : (C) 2016 by the QGIS project
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "qgis.h"
+#include "qgsapplication.h"
+#include "qgsaspectfilter.h"
+#include "qgsslopefilter.h"
+
+#include <QDir>
+#include <qmath.h>
+
+#include <gdal.h>
+
+static const int DEM_COLS = 41;
+static const int DEM_ROWS = 29;
+static const float DEM_NODATA = -9999;
+
+static QString _tempFile( const QString& name )
+{
+  return QString( "%1/ninecelltest-%2.tif" ).arg( QDir::tempPath(), name );
+}
+
+//! Reads the first band of a raster
+static QVector<float> _readRaster( const QString& fileName )
+{
+  QVector<float> values;
+  GDALDatasetH dataset = GDALOpen( fileName.toUtf8().constData(), GA_ReadOnly );
+  if ( !dataset )
+    return values;
+
+  int cols = GDALGetRasterXSize( dataset );
+  int rows = GDALGetRasterYSize( dataset );
+  values.resize( cols * rows );
+  if ( GDALRasterIO( GDALGetRasterBand( dataset, 1 ), GF_Read, 0, 0, cols, rows, values.data(), cols, rows, GDT_Float32, 0, 0 ) != CE_None )
+    values.clear();
+  GDALClose( dataset );
+  return values;
+}
+
+static QgsNineCellFilter* _createFilter( const QString& type, const QString& inputFile, const QString& outputFile )
+{
+  if ( type == "slope" )
+    return new QgsSlopeFilter( inputFile, outputFile, "GTiff" );
+  return new QgsAspectFilter( inputFile, outputFile, "GTiff" );
+}
+
+//! Slope filter replacing the windows by a constant
+class ConstantSlopeFilter : public QgsSlopeFilter
+{
+  public:
+    ConstantSlopeFilter( const QString& inputFile, const QString& outputFile )
+        : QgsSlopeFilter( inputFile, outputFile, "GTiff" )
+    {}
+
+    float processNineCellWindow( float* x11, float* x21, float* x31,
+                                 float* x12, float* x22, float* x32,
+                                 float* x13, float* x23, float* x33 ) override
+    {
+      Q_UNUSED( x11 );
+      Q_UNUSED( x21 );
+      Q_UNUSED( x31 );
+      Q_UNUSED( x12 );
+      Q_UNUSED( x22 );
+      Q_UNUSED( x32 );
+      Q_UNUSED( x13 );
+      Q_UNUSED( x23 );
+      Q_UNUSED( x33 );
+      return 42;
+    }
+};
+
+class TestQgsNineCellFilters : public QObject
+{
+    Q_OBJECT
+
+  public:
+    TestQgsNineCellFilters() {}
+
+  private:
+    QString mDemFile;
+    QVector<float> mDem;
+
+  private slots:
+
+    void initTestCase()
+    {
+      QgsApplication::init();
+      GDALAllRegister();
+
+      //a small DEM with a few nodata cells, one of them on the last row
+      mDem.resize( DEM_COLS * DEM_ROWS );
+      for ( int row = 0; row < DEM_ROWS; ++row )
+      {
+        for ( int col = 0; col < DEM_COLS; ++col )
+        {
+          mDem[row * DEM_COLS + col] = 100 + 3 * col + 2 * row + 5 * sin( col * 0.3 ) * cos( row * 0.2 );
+        }
+      }
+      mDem[7 * DEM_COLS + 5] = DEM_NODATA;
+      mDem[13 * DEM_COLS + 20] = DEM_NODATA;
+      mDem[( DEM_ROWS - 1 ) * DEM_COLS + 30] = DEM_NODATA;
+
+      mDemFile = _tempFile( "dem" );
+      GDALDatasetH dataset = GDALCreate( GDALGetDriverByName( "GTiff" ), mDemFile.toUtf8().constData(), DEM_COLS, DEM_ROWS, 1, GDT_Float32, nullptr );
+      QVERIFY( dataset );
+      double geoTransform[6] = { 1000, 10, 0, 2000, 0, -10 };
+      GDALSetGeoTransform( dataset, geoTransform );
+      GDALRasterBandH band = GDALGetRasterBand( dataset, 1 );
+      GDALSetRasterNoDataValue( band, DEM_NODATA );
+      QCOMPARE( GDALRasterIO( band, GF_Write, 0, 0, DEM_COLS, DEM_ROWS, mDem.data(), DEM_COLS, DEM_ROWS, GDT_Float32, 0, 0 ), CE_None );
+      GDALClose( dataset );
+    }
+
+    void cleanupTestCase()
+    {
+      QFile::remove( mDemFile );
+    }
+
+    void stripOutput_data()
+    {
+      QTest::addColumn<QString>( "type" );
+
+      QTest::newRow( "slope" ) << "slope";
+      QTest::newRow( "aspect" ) << "aspect";
+    }
+
+    void stripOutput()
+    {
+      QFETCH( QString, type );
+
+      //the whole raster in a single strip, calculated on one thread
+      QString singleFile = _tempFile( type + "-single" );
+      QScopedPointer<QgsNineCellFilter> single( _createFilter( type, mDemFile, singleFile ) );
+      single->setMultiThreaded( false );
+      QCOMPARE( single->processRaster( nullptr ), 0 );
+      QVector<float> expected = _readRaster( singleFile );
+      QCOMPARE( expected.size(), DEM_COLS * DEM_ROWS );
+
+      //first and last rows, with their windows padded with nodata outside of the raster
+      int borderRows[2] = { 0, DEM_ROWS - 1 };
+      for ( int i = 0; i < 2; ++i )
+      {
+        int row = borderRows[i];
+        for ( int col = 0; col < DEM_COLS; ++col )
+        {
+          float window[9];
+          for ( int r = -1; r <= 1; ++r )
+          {
+            for ( int c = -1; c <= 1; ++c )
+            {
+              bool inside = row + r >= 0 && row + r < DEM_ROWS && col + c >= 0 && col + c < DEM_COLS;
+              window[( r + 1 ) * 3 + c + 1] = inside ? mDem[( row + r ) * DEM_COLS + col + c] : DEM_NODATA;
+            }
+          }
+          float value = single->processNineCellWindow( &window[0], &window[1], &window[2], &window[3], &window[4],
+                        &window[5], &window[6], &window[7], &window[8] );
+          QVERIFY( qgsDoubleNear( expected[row * DEM_COLS + col], value, 0.0001 ) );
+        }
+      }
+      QFile::remove( singleFile );
+
+      //strips of one row, of a few rows and of rows not dividing the raster height, on several threads
+      int stripHeights[3] = { 1, 4, 7 };
+      for ( int i = 0; i < 3; ++i )
+      {
+        QString stripFile = _tempFile( type + "-strips" );
+        QScopedPointer<QgsNineCellFilter> strips( _createFilter( type, mDemFile, stripFile ) );
+        strips->setMaxStripHeight( stripHeights[i] );
+        QCOMPARE( strips->maxStripHeight(), stripHeights[i] );
+        QCOMPARE( strips->processRaster( nullptr ), 0 );
+        QVector<float> result = _readRaster( stripFile );
+        QCOMPARE( result.size(), expected.size() );
+        for ( int j = 0; j < expected.size(); ++j )
+        {
+          QCOMPARE( result[j], expected[j] );
+        }
+        QFile::remove( stripFile );
+      }
+    }
+
+    void overriddenWindow()
+    {
+      QScopedPointer<QgsNineCellFilter> slope( _createFilter( "slope", mDemFile, _tempFile( "unused" ) ) );
+      QVERIFY( slope->isMultiThreaded() );
+
+      //the rows of the slope filter call the window of the subclass
+      QString outputFile = _tempFile( "constant" );
+      ConstantSlopeFilter filter( mDemFile, outputFile );
+      filter.setMaxStripHeight( 4 );
+      QCOMPARE( filter.processRaster( nullptr ), 0 );
+      QVector<float> result = _readRaster( outputFile );
+      QCOMPARE( result.size(), DEM_COLS * DEM_ROWS );
+      for ( int i = 0; i < result.size(); ++i )
+      {
+        QCOMPARE( result[i], 42.0f );
+      }
+      QFile::remove( outputFile );
+    }
+};
+
+QTEST_MAIN( TestQgsNineCellFilters )
+#include "testqgsninecellfilters.moc"
@@ -0,0 +1,273 @@
+/***************************************************************************
+  testqgspointsample.cpp
+  --------------------------------------
+  Date                 : October 2016
+  Copyright            : (C) 2016 by the QGIS project
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "qgsapplication.h"
+#include "qgsfeature.h"
+#include "qgsfeatureiterator.h"
+#include "qgsgeometry.h"
+#include "qgspointsample.h"
+#include "qgsvectordataprovider.h"
+#include "qgsvectorfilewriter.h"
+#include "qgsvectorlayer.h"
+
+#include <QDir>
+#include <QHash>
+
+#include <cmath>
+
+//! Even-odd test of a point against all rings of a polygon, holes included
+static bool _pointInPolygon( const QgsPoint& pt, const QgsPolygon& polygon )
+{
+  bool inside = false;
+  Q_FOREACH ( const QgsPolyline& ring, polygon )
+  {
+    for ( int i = 0, j = ring.size() - 1; i < ring.size(); j = i++ )
+    {
+      const QgsPoint& pi = ring.at( i );
+      const QgsPoint& pj = ring.at( j );
+      if (( pi.y() > pt.y() ) != ( pj.y() > pt.y() )
+          && pt.x() < ( pj.x() - pi.x() ) * ( pt.y() - pi.y() ) / ( pj.y() - pi.y() ) + pi.x() )
+      {
+        inside = !inside;
+      }
+    }
+  }
+  return inside;
+}
+
+//! Ring of a circle
+static QgsPolyline _circle( double x, double y, double radius, int nVertices )
+{
+  QgsPolyline ring;
+  for ( int i = 0; i < nVertices; ++i )
+  {
+    double angle = 2 * M_PI * i / nVertices;
+    ring << QgsPoint( x + radius * cos( angle ), y + radius * sin( angle ) );
+  }
+  ring << ring.first();
+  return ring;
+}
+
+//! A sampled point
+struct SamplePoint
+{
+  QgsPoint point;
+  int id;
+  int stationId;
+  QgsFeatureId stratumId;
+};
+
+/** \ingroup UnitTests
+ * This is a unit test for the random points in polygons
+ */
+class TestQgsPointSample : public QObject
+{
+    Q_OBJECT
+
+  public:
+    TestQgsPointSample()
+        : mStrata( nullptr )
+    {}
+
+  private:
+    QgsVectorLayer* mStrata;
+    //! stratum ids by name
+    QHash<QString, QgsFeatureId> mIds;
+
+    //! Samples the strata with a seed and reads the points
+    QList<SamplePoint> sample( unsigned seed )
+    {
+      QString fileName = QDir::tempPath() + "/qgis_pointsample_test.shp";
+      QgsPointSample pointSample( mStrata, fileName, "n", "dist" );
+      pointSample.setSeed( seed );
+      if ( pointSample.createRandomPoints( nullptr ) != 0 )
+      {
+        return QList<SamplePoint>();
+      }
+
+      QList<SamplePoint> points;
+      QgsVectorLayer layer( fileName, "sample", "ogr" );
+      QgsFeatureIterator it = layer.getFeatures();
+      QgsFeature f;
+      while ( it.nextFeature( f ) )
+      {
+        SamplePoint point;
+        point.point = f.constGeometry()->asPoint();
+        point.id = f.attribute( "id" ).toInt();
+        point.stationId = f.attribute( "station_id" ).toInt();
+        point.stratumId = f.attribute( "stratum_id" ).toLongLong();
+        points << point;
+      }
+      QgsVectorFileWriter::deleteShapeFile( fileName );
+      return points;
+    }
+
+    QgsFeature stratum( QgsFeatureId id )
+    {
+      QgsFeature f;
+      mStrata->getFeatures( QgsFeatureRequest( id ) ).nextFeature( f );
+      return f;
+    }
+
+    static QgsMultiPolygon polygons( const QgsFeature& f )
+    {
+      if ( f.constGeometry()->isMultipart() )
+      {
+        return f.constGeometry()->asMultiPolygon();
+      }
+      return QgsMultiPolygon() << f.constGeometry()->asPolygon();
+    }
+
+  private slots:
+    void initTestCase()
+    {
+      QgsApplication::init();
+      QgsApplication::initQgis();
+
+      QStringList names;
+      QList<QgsGeometry*> geometries;
+      QList<int> nPoints;
+      QList<double> minDistances;
+
+      names << "square with hole";
+      geometries << QgsGeometry::fromWkt( "POLYGON((0 0, 10 0, 10 10, 0 10, 0 0),(4 4, 4 6, 6 6, 6 4, 4 4))" );
+      nPoints << 60;
+      minDistances << 0.5;
+
+      names << "concave parts";
+      geometries << QgsGeometry::fromWkt( "MULTIPOLYGON(((40 0, 50 0, 50 4, 44 4, 44 10, 40 10, 40 0)),((52 0, 56 0, 54 6, 52 0)))" );
+      nPoints << 40;
+      minDistances << 1.0;
+
+      // even-odd inside of the two lobes of a bow tie, which cannot be triangulated
+      names << "self intersecting";
+      geometries << QgsGeometry::fromWkt( "POLYGON((20 0, 30 10, 30 0, 20 10, 20 0))" );
+      nPoints << 50;
+      minDistances << 0.0;
+
+      // a ring with too many vertices to be triangulated
+      names << "large ring";
+      geometries << QgsGeometry::fromPolygon( QgsPolygon() << _circle( 70, 5, 5, 2000 ) << _circle( 70, 5, 2, 8 ) );
+      nPoints << 50;
+      minDistances << 0.8;
+
+      mStrata = new QgsVectorLayer( "Polygon?field=name:string&field=n:integer&field=dist:double", "strata", "memory" );
+      QgsFeatureList features;
+      for ( int i = 0; i < names.size(); ++i )
+      {
+        QgsFeature f( mStrata->dataProvider()->fields() );
+        f.setGeometry( geometries.at( i ) );
+        f.setAttribute( "name", names.at( i ) );
+        f.setAttribute( "n", nPoints.at( i ) );
+        f.setAttribute( "dist", minDistances.at( i ) );
+        features << f;
+      }
+      QVERIFY( mStrata->dataProvider()->addFeatures( features ) );
+      for ( int i = 0; i < features.size(); ++i )
+      {
+        mIds.insert( names.at( i ), features.at( i ).id() );
+      }
+    }
+
+    void cleanupTestCase()
+    {
+      delete mStrata;
+      QgsApplication::exitQgis();
+    }
+
+    void sameSeed()
+    {
+      QList<SamplePoint> first = sample( 42 );
+      QList<SamplePoint> second = sample( 42 );
+      QCOMPARE( first.size(), 200 );
+      QCOMPARE( second.size(), first.size() );
+      for ( int i = 0; i < first.size(); ++i )
+      {
+        QVERIFY( first.at( i ).point == second.at( i ).point );
+        QCOMPARE( first.at( i ).stationId, second.at( i ).stationId );
+        QCOMPARE( first.at( i ).stratumId, second.at( i ).stratumId );
+      }
+
+      QList<SamplePoint> other = sample( 43 );
+      QCOMPARE( other.size(), first.size() );
+      QVERIFY( !( other.at( 0 ).point == first.at( 0 ).point ) );
+    }
+
+    void pointsInStrata()
+    {
+      QList<SamplePoint> points = sample( 7 );
+      QCOMPARE( points.size(), 200 );
+      QHash<QgsFeatureId, int> counts;
+      for ( int i = 0; i < points.size(); ++i )
+      {
+        const SamplePoint& point = points.at( i );
+        QCOMPARE( point.id, i + 1 );
+        QVERIFY( mIds.values().contains( point.stratumId ) );
+        QgsFeature f = stratum( point.stratumId );
+        QVERIFY( f.constGeometry() );
+        QgsMultiPolygon parts = polygons( f );
+        bool inside = false;
+        Q_FOREACH ( const QgsPolygon& polygon, parts )
+        {
+          inside = inside || _pointInPolygon( point.point, polygon );
+        }
+        QVERIFY2( inside, QString( "%1 in stratum %2" ).arg( point.point.toString() ).arg( point.stratumId ).toLocal8Bit().constData() );
+        QCOMPARE( point.stationId, ++counts[ point.stratumId ] );
+      }
+
+      QCOMPARE( counts.value( mIds.value( "square with hole" ) ), 60 );
+      QCOMPARE( counts.value( mIds.value( "concave parts" ) ), 40 );
+      QCOMPARE( counts.value( mIds.value( "self intersecting" ) ), 50 );
+      QCOMPARE( counts.value( mIds.value( "large ring" ) ), 50 );
+
+      // both parts of the multipolygon and both lobes of the bow tie are sampled
+      int inTriangle = 0;
+      int inLeftLobe = 0;
+      Q_FOREACH ( const SamplePoint& point, points )
+      {
+        if ( point.stratumId == mIds.value( "concave parts" ) && point.point.x() > 51 )
+        {
+          ++inTriangle;
+        }
+        if ( point.stratumId == mIds.value( "self intersecting" ) && point.point.x() < 25 )
+        {
+          ++inLeftLobe;
+        }
+      }
+      QVERIFY( inTriangle > 0 && inTriangle < 40 );
+      QVERIFY( inLeftLobe > 0 && inLeftLobe < 50 );
+    }
+
+    void minDistance()
+    {
+      QList<SamplePoint> points = sample( 11 );
+      for ( int i = 0; i < points.size(); ++i )
+      {
+        double minDistance = stratum( points.at( i ).stratumId ).attribute( "dist" ).toDouble();
+        for ( int j = i + 1; j < points.size(); ++j )
+        {
+          if ( points.at( j ).stratumId != points.at( i ).stratumId )
+          {
+            continue;
+          }
+          QVERIFY( points.at( i ).point.sqrDist( points.at( j ).point ) >= minDistance * minDistance );
+        }
+      }
+    }
+};
+
+QTEST_MAIN( TestQgsPointSample )
+#include "testqgspointsample.moc"
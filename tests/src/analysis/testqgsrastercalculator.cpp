@@ -25,6 +25,23 @@ Email                : nyall dot dawson at gmail dot com
 Q_DECLARE_METATYPE( QgsRasterCalcNode::Operator )
 
 
+// no data value of the source matrices, different from the result no data value
+static const double SOURCE_NODATA = 255.5;
+// enough cells for the kernel loops to run past any vector width
+static const int KERNEL_COLS = 3;
+static const int KERNEL_ROWS = 5;
+
+//! Returns a new array with every cell set to value, except every period-th cell starting at first, which is no data
+static double* kernelTestData( double value, int first, int period )
+{
+  double* d = new double[KERNEL_COLS * KERNEL_ROWS];
+  for ( int i = 0; i < KERNEL_COLS * KERNEL_ROWS; ++i )
+  {
+    d[i] = i % period == first ? SOURCE_NODATA : value;
+  }
+  return d;
+}
+
 class TestQgsRasterCalculator : public QObject
 {
     Q_OBJECT
@@ -52,11 +69,17 @@ class TestQgsRasterCalculator : public QObject
     void dualOpMatrixNumber(); // test dual op run on matrix and number
     void dualOpMatrixMatrix(); // test dual op run on matrix and matrix
 
+    void singleOpMatrixKernels_data();
+    void singleOpMatrixKernels(); // test every single op on a matrix with no data cells
+    void dualOpMatrixKernels_data();
+    void dualOpMatrixKernels(); // test every dual op on numbers and matrices with no data cells
+
     void rasterRefOp();
     void dualOpRasterRaster(); //test dual op on raster ref and raster ref
 
     void calcWithLayers();
     void calcWithReprojectedLayers();
+    void calcInStrips(); //test that a low memory limit gives the same result
 
   private:
 
@@ -350,6 +373,102 @@ void TestQgsRasterCalculator::dualOpMatrixMatrix()
   QCOMPARE( result.data()[5], -9999.0 );
 }
 
+void TestQgsRasterCalculator::singleOpMatrixKernels_data()
+{
+  singleOp_data();
+}
+
+void TestQgsRasterCalculator::singleOpMatrixKernels()
+{
+  QFETCH( QgsRasterCalcNode::Operator, op );
+  QFETCH( double, value );
+  QFETCH( double, expected );
+
+  const int nEntries = KERNEL_COLS * KERNEL_ROWS;
+  QgsRasterMatrix m( KERNEL_COLS, KERNEL_ROWS, kernelTestData( value, 1, 4 ), SOURCE_NODATA );
+  QgsRasterCalcNode node( op, new QgsRasterCalcNode( &m ), 0 );
+
+  QgsRasterMatrix result;
+  result.setNodataValue( -9999 );
+  QMap<QString, QgsRasterBlock*> rasterData;
+
+  QVERIFY( node.calculate( rasterData, result ) );
+  QCOMPARE( result.nColumns(), KERNEL_COLS );
+  QCOMPARE( result.nRows(), KERNEL_ROWS );
+  for ( int i = 0; i < nEntries; ++i )
+  {
+    if ( i % 4 == 1 )
+      QCOMPARE( result.data()[i], -9999.0 );
+    else
+      QVERIFY( qgsDoubleNear( result.data()[i], expected, 0.0000000001 ) );
+  }
+}
+
+void TestQgsRasterCalculator::dualOpMatrixKernels_data()
+{
+  dualOp_data();
+}
+
+void TestQgsRasterCalculator::dualOpMatrixKernels()
+{
+  QFETCH( QgsRasterCalcNode::Operator, op );
+  QFETCH( double, left );
+  QFETCH( double, right );
+  QFETCH( double, expected );
+
+  const int nEntries = KERNEL_COLS * KERNEL_ROWS;
+  QMap<QString, QgsRasterBlock*> rasterData;
+  QgsRasterMatrix result;
+  result.setNodataValue( -9999 );
+
+  QgsRasterMatrix leftMatrix( KERNEL_COLS, KERNEL_ROWS, kernelTestData( left, 1, 4 ), SOURCE_NODATA );
+  QgsRasterMatrix rightMatrix( KERNEL_COLS, KERNEL_ROWS, kernelTestData( right, 2, 5 ), SOURCE_NODATA );
+
+  // number op matrix
+  QgsRasterCalcNode numberMatrix( op, new QgsRasterCalcNode( left ), new QgsRasterCalcNode( &rightMatrix ) );
+  QVERIFY( numberMatrix.calculate( rasterData, result ) );
+  QCOMPARE( result.nColumns(), KERNEL_COLS );
+  QCOMPARE( result.nRows(), KERNEL_ROWS );
+  for ( int i = 0; i < nEntries; ++i )
+  {
+    QCOMPARE( result.data()[i], i % 5 == 2 ? -9999.0 : expected );
+  }
+
+  // matrix op number
+  QgsRasterCalcNode matrixNumber( op, new QgsRasterCalcNode( &leftMatrix ), new QgsRasterCalcNode( right ) );
+  QVERIFY( matrixNumber.calculate( rasterData, result ) );
+  QCOMPARE( result.nColumns(), KERNEL_COLS );
+  QCOMPARE( result.nRows(), KERNEL_ROWS );
+  for ( int i = 0; i < nEntries; ++i )
+  {
+    QCOMPARE( result.data()[i], i % 4 == 1 ? -9999.0 : expected );
+  }
+
+  // matrix op matrix, no data in either operand gives no data
+  QgsRasterCalcNode matrixMatrix( op, new QgsRasterCalcNode( &leftMatrix ), new QgsRasterCalcNode( &rightMatrix ) );
+  QVERIFY( matrixMatrix.calculate( rasterData, result ) );
+  QCOMPARE( result.nColumns(), KERNEL_COLS );
+  QCOMPARE( result.nRows(), KERNEL_ROWS );
+  for ( int i = 0; i < nEntries; ++i )
+  {
+    QCOMPARE( result.data()[i], i % 4 == 1 || i % 5 == 2 ? -9999.0 : expected );
+  }
+
+  // a no data number gives no data everywhere
+  QgsRasterCalcNode noDataMatrix( op, new QgsRasterCalcNode( -9999 ), new QgsRasterCalcNode( &rightMatrix ) );
+  QVERIFY( noDataMatrix.calculate( rasterData, result ) );
+  for ( int i = 0; i < nEntries; ++i )
+  {
+    QCOMPARE( result.data()[i], -9999.0 );
+  }
+  QgsRasterCalcNode matrixNoData( op, new QgsRasterCalcNode( &leftMatrix ), new QgsRasterCalcNode( -9999 ) );
+  QVERIFY( matrixNoData.calculate( rasterData, result ) );
+  for ( int i = 0; i < nEntries; ++i )
+  {
+    QCOMPARE( result.data()[i], -9999.0 );
+  }
+}
+
 void TestQgsRasterCalculator::rasterRefOp()
 {
   // test single op run on raster ref
@@ -529,5 +648,109 @@ void TestQgsRasterCalculator::calcWithReprojectedLayers()
   delete block;
 }
 
+void TestQgsRasterCalculator::calcInStrips()
+{
+  QgsRasterCalculatorEntry entry1;
+  entry1.bandNumber = 1;
+  entry1.raster = mpLandsatRasterLayer;
+  entry1.ref = "landsat@1";
+
+  QgsRasterCalculatorEntry entry2;
+  entry2.bandNumber = 2;
+  entry2.raster = mpLandsatRasterLayer;
+  entry2.ref = "landsat@2";
+
+  QgsRasterCalculatorEntry entry3;
+  entry3.bandNumber = 2;
+  entry3.raster = mpLandsatRasterLayer4326;
+  entry3.ref = "landsat_4326@2";
+
+  QVector<QgsRasterCalculatorEntry> entries;
+  entries << entry1 << entry2 << entry3;
+
+  QgsCoordinateReferenceSystem crs;
+  crs.createFromId( 32633, QgsCoordinateReferenceSystem::EpsgCrsId );
+  QgsRectangle extent( 783235, 3348110, 783350, 3347960 );
+
+  // the input bands at the output resolution, read without the calculator
+  QgsRasterBlock* band1 = mpLandsatRasterLayer->dataProvider()->block( 1, extent, 200, 300 );
+  QgsRasterBlock* band2 = mpLandsatRasterLayer->dataProvider()->block( 2, extent, 200, 300 );
+
+  QTemporaryFile tmpFile;
+  tmpFile.open(); // fileName is no avialable until open
+  QString tmpName = tmpFile.fileName();
+  tmpFile.close();
+
+  QTemporaryFile tmpFile2;
+  tmpFile2.open();
+  QString tmpName2 = tmpFile2.fileName();
+  tmpFile2.close();
+
+  // with the default limit the output is a single strip, with a 1 MB limit it is calculated in many small strips
+  int memoryLimits[2] = { 256, 1 };
+  for ( int i = 0; i < 2; ++i )
+  {
+    QgsRasterCalculator rc( QString( "\"landsat@1\" * 2 - \"landsat@2\"" ),
+                            tmpName,
+                            "GTiff",
+                            extent, crs, 200, 300, entries );
+    rc.setMemoryLimit( memoryLimits[i] );
+    QCOMPARE( rc.memoryLimit(), memoryLimits[i] );
+    QCOMPARE( rc.processCalculation(), 0 );
+
+    QgsRasterLayer* result = new QgsRasterLayer( tmpName, "result" );
+    QgsRasterBlock* block = result->dataProvider()->block( 1, extent, 200, 300 );
+    for ( int row = 0; row < 300; ++row )
+    {
+      for ( int col = 0; col < 200; ++col )
+      {
+        if ( band1->isNoData( row, col ) || band2->isNoData( row, col ) )
+        {
+          QVERIFY( block->isNoData( row, col ) );
+        }
+        else
+        {
+          QCOMPARE( block->value( row, col ), band1->value( row, col ) * 2 - band2->value( row, col ) );
+        }
+      }
+    }
+    delete block;
+    delete result;
+  }
+  delete band1;
+  delete band2;
+
+  // reprojected inputs are read for each strip
+  QgsRasterCalculator rc( QString( "\"landsat@1\" * 2 - \"landsat_4326@2\"" ),
+                          tmpName,
+                          "GTiff",
+                          extent, crs, 200, 300, entries );
+  QCOMPARE( rc.processCalculation(), 0 );
+
+  QgsRasterCalculator rc2( QString( "\"landsat@1\" * 2 - \"landsat_4326@2\"" ),
+                           tmpName2,
+                           "GTiff",
+                           extent, crs, 200, 300, entries );
+  rc2.setMemoryLimit( 1 );
+  QCOMPARE( rc2.processCalculation(), 0 );
+
+  QgsRasterLayer* result = new QgsRasterLayer( tmpName, "result" );
+  QgsRasterLayer* result2 = new QgsRasterLayer( tmpName2, "result2" );
+  QgsRasterBlock* block = result->dataProvider()->block( 1, extent, 200, 300 );
+  QgsRasterBlock* block2 = result2->dataProvider()->block( 1, extent, 200, 300 );
+  for ( int row = 0; row < 300; ++row )
+  {
+    for ( int col = 0; col < 200; ++col )
+    {
+      QCOMPARE( block2->value( row, col ), block->value( row, col ) );
+    }
+  }
+
+  delete block;
+  delete block2;
+  delete result;
+  delete result2;
+}
+
 QTEST_MAIN( TestQgsRasterCalculator )
 #include "testqgsrastercalculator.moc"
@@ -39,6 +39,7 @@ class TestQgsZonalStatistics : public QObject
     void cleanup() {}
 
     void testStatistics();
+    void testOtherStatistics();
 
   private:
     QgsVectorLayer* mVectorLayer;
@@ -136,5 +137,50 @@ void TestQgsZonalStatistics::testStatistics()
   QCOMPARE( f.attribute( "myqgis2_me" ).toDouble(), 0.833333333333333 );
 }
 
+void TestQgsZonalStatistics::testOtherStatistics()
+{
+  QgsZonalStatistics zs( mVectorLayer, mRasterPath, "", 1,
+                         QgsZonalStatistics::Median | QgsZonalStatistics::StDev | QgsZonalStatistics::Minority | QgsZonalStatistics::Majority | QgsZonalStatistics::Variety );
+  zs.calculateStatistics( nullptr );
+
+  QgsFeature f;
+  QgsFeatureRequest request;
+  request.setFilterFid( 0 );
+  bool fetched = mVectorLayer->getFeatures( request ).nextFeature( f );
+  QVERIFY( fetched );
+  QCOMPARE( f.attribute( "median" ).toDouble(), 1.0 );
+  QCOMPARE( f.attribute( "stdev" ).toDouble(), 0.471404520791032 );
+  QCOMPARE( f.attribute( "minority" ).toDouble(), 0.0 );
+  QCOMPARE( f.attribute( "majority" ).toDouble(), 1.0 );
+  QCOMPARE( f.attribute( "variety" ).toInt(), 2 );
+
+  request.setFilterFid( 1 );
+  fetched = mVectorLayer->getFeatures( request ).nextFeature( f );
+  QVERIFY( fetched );
+  QCOMPARE( f.attribute( "median" ).toDouble(), 1.0 );
+  QCOMPARE( f.attribute( "stdev" ).toDouble(), 0.496903994999953 );
+  QCOMPARE( f.attribute( "minority" ).toDouble(), 0.0 );
+  QCOMPARE( f.attribute( "majority" ).toDouble(), 1.0 );
+  QCOMPARE( f.attribute( "variety" ).toInt(), 2 );
+
+  request.setFilterFid( 2 );
+  fetched = mVectorLayer->getFeatures( request ).nextFeature( f );
+  QVERIFY( fetched );
+  QCOMPARE( f.attribute( "median" ).toDouble(), 1.0 );
+  QCOMPARE( f.attribute( "stdev" ).toDouble(), 0.372677996249965 );
+  QCOMPARE( f.attribute( "minority" ).toDouble(), 0.0 );
+  QCOMPARE( f.attribute( "majority" ).toDouble(), 1.0 );
+  QCOMPARE( f.attribute( "variety" ).toInt(), 2 );
+
+  // variety alone does not need minority or majority to count the distinct values
+  QgsZonalStatistics zsv( mVectorLayer, mRasterPath, "v_", 1, QgsZonalStatistics::Variety );
+  zsv.calculateStatistics( nullptr );
+
+  request.setFilterFid( 0 );
+  fetched = mVectorLayer->getFeatures( request ).nextFeature( f );
+  QVERIFY( fetched );
+  QCOMPARE( f.attribute( "v_variety" ).toInt(), 2 );
+}
+
 QTEST_MAIN( TestQgsZonalStatistics )
 #include "testqgszonalstatistics.moc"
@@ -0,0 +1,48 @@
+/***************************************************************************
+  qgstestrandom.h
+  --------------------------------------
+  Date                 : October 2016
+  Copyright            : (C) 2016 by the QGIS project
+****************************************************************************
+*                                                                          *
+*   This program is free software; you can redistribute it and/or modify   *
+*   it under the terms of the GNU General Public License as published by   *
+*   the Free Software Foundation; either version 2 of the License, or      *
+*   (at your option) any later version.                                    *
+*                                                                          *
+***************************************************************************/
+
+#ifndef QGSTESTRANDOM_H
+#define QGSTESTRANDOM_H
+
+#include <QtGlobal>
+
+/** \ingroup UnitTests
+ * Linear congruential generator of the unit tests, which gives the same
+ * pseudo random sequence from a seed on all platforms
+ */
+class QgsTestRandom
+{
+  public:
+    explicit QgsTestRandom( quint32 seed )
+        : mSeed( seed )
+    {}
+
+    //! Returns a pseudo random integer in [0, n)
+    int nextInt( int n )
+    {
+      mSeed = mSeed * 1103515245u + 12345u;
+      return static_cast< int >(( mSeed >> 8 ) % static_cast< quint32 >( n ) );
+    }
+
+    //! Returns a pseudo random coordinate in [0, max), with three decimals
+    double nextCoordinate( int max )
+    {
+      return nextInt( max * 1000 ) / 1000.0;
+    }
+
+  private:
+    quint32 mSeed;
+};
+
+#endif // QGSTESTRANDOM_H
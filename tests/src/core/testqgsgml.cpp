@@ -75,6 +75,7 @@ class TestQgsGML : public QObject
     void testPartialFeature();
     void testThroughOGRGeometry();
     void testThroughOGRGeometry_urn_EPSG_4326();
+    void testPipelined();
 };
 
 const QString data1( "<myns:FeatureCollection "
@@ -1102,5 +1103,75 @@ void TestQgsGML::testThroughOGRGeometry_urn_EPSG_4326()
   delete features[0].first;
 }
 
+void TestQgsGML::testPipelined()
+{
+  // Enough features for several batches, mixing geometry types, axis
+  // inversion, attributes and a geometry handled through OGR
+  QString data( "<myns:FeatureCollection "
+                "xmlns:myns='http://myns' "
+                "xmlns:gml='http://www.opengis.net/gml'>" );
+  for ( int i = 0; i < 1000; i++ )
+  {
+    data += QString( "<gml:featureMember>"
+                     "<myns:mytypename gml:id='mytypename.%1'>"
+                     "<myns:intfield>%1</myns:intfield>"
+                     "<myns:strfield>foo &amp; &lt;bar&gt; %1</myns:strfield>" ).arg( i );
+    if ( i % 4 == 0 )
+      data += QString( "<myns:mygeom><gml:Point srsName='urn:ogc:def:crs:EPSG::4326'><gml:pos>%1 2</gml:pos></gml:Point></myns:mygeom>" ).arg( i );
+    else if ( i % 4 == 1 )
+      data += QString( "<myns:mygeom><gml:MultiSurface><gml:surfaceMember><gml:Polygon><gml:exterior><gml:LinearRing>"
+                       "<gml:posList>%1 2 %1 3 %2 3 %1 2</gml:posList>"
+                       "</gml:LinearRing></gml:exterior></gml:Polygon></gml:surfaceMember></gml:MultiSurface></myns:mygeom>" ).arg( i ).arg( i + 1 );
+    else if ( i % 4 == 2 )
+      data += QString( "<myns:mygeom><gml:CompositeSurface><gml:surfaceMember><gml:Polygon><gml:exterior><gml:LinearRing>"
+                       "<gml:posList>%1 2 %1 3 %2 3 %1 2</gml:posList>"
+                       "</gml:LinearRing></gml:exterior></gml:Polygon></gml:surfaceMember></gml:CompositeSurface></myns:mygeom>" ).arg( i ).arg( i + 1 );
+    data += "</myns:mytypename></gml:featureMember>";
+  }
+  data += "</myns:FeatureCollection>";
+  const QByteArray ba( data.toUtf8() );
+
+  QgsFields fields;
+  fields.append( QgsField( "intfield", QVariant::Int, "int" ) );
+  fields.append( QgsField( "strfield", QVariant::String, "string" ) );
+
+  QgsGmlStreamingParser sequentialParser( "mytypename", "mygeom", fields );
+  QCOMPARE( sequentialParser.processData( ba, true ), true );
+  QVector<QgsGmlStreamingParser::QgsGmlFeaturePtrGmlIdPair> expected = sequentialParser.getAndStealReadyFeatures();
+  QCOMPARE( expected.size(), 1000 );
+
+  QgsGmlStreamingParser pipelinedParser( "mytypename", "mygeom", fields );
+  pipelinedParser.setPipelined( true, 4 );
+  QVERIFY( pipelinedParser.isPipelined() );
+  // Feed the data in small chunks, so that features straddle several calls
+  QVector<QgsGmlStreamingParser::QgsGmlFeaturePtrGmlIdPair> features;
+  for ( int offset = 0; offset < ba.size(); offset += 4096 )
+  {
+    QCOMPARE( pipelinedParser.processData( ba.mid( offset, 4096 ), offset + 4096 >= ba.size() ), true );
+    features += pipelinedParser.getAndStealReadyFeatures();
+  }
+  features += pipelinedParser.getAndStealReadyFeatures();
+  QCOMPARE( features.size(), expected.size() );
+  QCOMPARE( pipelinedParser.wkbType(), sequentialParser.wkbType() );
+  QCOMPARE( pipelinedParser.getEPSGCode(), 4326 );
+  // axis order of urn:ogc:def:crs:EPSG::4326 is honoured by the worker threads
+  QVERIFY( features[0].first->constGeometry() != nullptr );
+  QCOMPARE( features[0].first->constGeometry()->asPoint(), QgsPoint( 2, 0 ) );
+
+  for ( int i = 0; i < features.size(); i++ )
+  {
+    QCOMPARE( features[i].second, expected[i].second );
+    QCOMPARE( features[i].first->id(), expected[i].first->id() );
+    QCOMPARE( features[i].first->attributes(), expected[i].first->attributes() );
+    QCOMPARE( features[i].first->constGeometry() != nullptr, expected[i].first->constGeometry() != nullptr );
+    if ( expected[i].first->constGeometry() )
+    {
+      QCOMPARE( features[i].first->constGeometry()->exportToWkt(), expected[i].first->constGeometry()->exportToWkt() );
+    }
+    delete features[i].first;
+    delete expected[i].first;
+  }
+}
+
 QTEST_MAIN( TestQgsGML )
 #include "testqgsgml.moc"
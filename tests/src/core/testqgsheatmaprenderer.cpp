@@ -0,0 +1,180 @@
+/***************************************************************************
+  testqgsheatmaprenderer.cpp
+  --------------------------------------
+  Date                 : October 2016
+  Copyright            : (C) 2016 by the QGIS project
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QObject>
+#include <QImage>
+#include <QScopedPointer>
+
+#include "qgsapplication.h"
+#include "qgsfeature.h"
+#include "qgsgeometry.h"
+#include "qgsheatmaprenderer.h"
+#include "qgsmaplayerregistry.h"
+#include "qgsmaprenderersequentialjob.h"
+#include "qgsmapsettings.h"
+#include "qgstestrandom.h"
+#include "qgsvectordataprovider.h"
+#include "qgsvectorlayer.h"
+
+//! Heatmap renderer with a radius of 10 pixels on maps of 1 map unit per pixel
+static QgsHeatmapRenderer* _heatmapRenderer( double densityCacheMargin )
+{
+  QgsHeatmapRenderer* renderer = new QgsHeatmapRenderer();
+  renderer->setRadius( 10 );
+  renderer->setRadiusUnit( QgsSymbolV2::MapUnit );
+  renderer->setRenderQuality( 1 );
+  renderer->setWeightExpression( "weight" );
+  renderer->setDensityCacheMargin( densityCacheMargin );
+  return renderer;
+}
+
+/** \ingroup UnitTests
+ * This is a unit test for the density cache of the heatmap renderer
+ */
+class TestQgsHeatmapRenderer : public QObject
+{
+    Q_OBJECT
+
+  public:
+    TestQgsHeatmapRenderer()
+        : mLayer( nullptr )
+    {}
+
+  private:
+    QgsVectorLayer* mLayer;
+    //! features of the points of the same cell
+    QgsFeatureIds mStackedIds;
+
+    //! Renders a 100 x 100 pixels extent of the layer with a renderer, which is cloned
+    QImage render( const QgsFeatureRendererV2* renderer, double xMinimum, double yMinimum )
+    {
+      mLayer->setRendererV2( renderer->clone() );
+
+      QgsMapSettings settings;
+      settings.setLayers( QStringList() << mLayer->id() );
+      settings.setOutputSize( QSize( 100, 100 ) );
+      settings.setExtent( QgsRectangle( xMinimum, yMinimum, xMinimum + 100, yMinimum + 100 ) );
+
+      QgsMapRendererSequentialJob job( settings );
+      job.start();
+      job.waitForFinished();
+      return job.renderedImage();
+    }
+
+    //! Renders an extent with a new renderer, which does not share densities
+    QImage renderUncached( double xMinimum, double yMinimum )
+    {
+      QScopedPointer<QgsHeatmapRenderer> renderer( _heatmapRenderer( 0 ) );
+      return render( renderer.data(), xMinimum, yMinimum );
+    }
+
+  private slots:
+    void initTestCase()
+    {
+      QgsApplication::init();
+      QgsApplication::initQgis();
+
+      // points around the rendered tiles, with a few in the same cells
+      mLayer = new QgsVectorLayer( "Point?field=weight:double", "points", "memory" );
+      QgsFeatureList features;
+      QgsTestRandom random( 11 );
+      for ( int i = 0; i < 600; ++i )
+      {
+        QgsFeature f( mLayer->dataProvider()->fields() );
+        double x = random.nextCoordinate( 400 ) - 100;
+        double y = random.nextCoordinate( 400 ) * 0.75 - 100;
+        f.setGeometry( QgsGeometry::fromPoint( i % 50 == 0 ? QgsPoint( 50.2, 50.7 ) : QgsPoint( x, y ) ) );
+        f.setAttribute( 0, 1 + i % 5 );
+        features << f;
+      }
+      QVERIFY( mLayer->dataProvider()->addFeatures( features ) );
+      for ( int i = 0; i < features.size(); i += 50 )
+      {
+        mStackedIds << features.at( i ).id();
+      }
+      QgsMapLayerRegistry::instance()->addMapLayers( QList<QgsMapLayer*>() << mLayer );
+    }
+
+    void cleanupTestCase()
+    {
+      QgsApplication::exitQgis();
+    }
+
+    void repaint_data()
+    {
+      QTest::addColumn<double>( "margin" );
+
+      QTest::newRow( "no margin" ) << 0.0;
+      QTest::newRow( "margin" ) << 1.0;
+    }
+
+    void repaint()
+    {
+      QFETCH( double, margin );
+
+      QScopedPointer<QgsHeatmapRenderer> cached( _heatmapRenderer( margin ) );
+      QImage first = render( cached.data(), 0, 0 );
+      QImage repainted = render( cached.data(), 0, 0 );
+      QVERIFY( repainted == first );
+      QVERIFY( renderUncached( 0, 0 ) == first );
+    }
+
+    void neighbouringTiles()
+    {
+      QScopedPointer<QgsHeatmapRenderer> cached( _heatmapRenderer( 1 ) );
+      render( cached.data(), 0, 0 );
+
+      // tiles within the margin of the first one reuse its grid
+      const double tiles[][2] = { { 100, 0 }, { -100, 0 }, { 0, 100 }, { 100, -100 }, { -50, 30 } };
+      for ( unsigned int i = 0; i < sizeof( tiles ) / sizeof( tiles[0] ); ++i )
+      {
+        QImage tile = render( cached.data(), tiles[i][0], tiles[i][1] );
+        QVERIFY2( tile == renderUncached( tiles[i][0], tiles[i][1] ), QString( "tile %1" ).arg( i ).toLocal8Bit().constData() );
+      }
+    }
+
+    void editedWeight()
+    {
+      QScopedPointer<QgsHeatmapRenderer> cached( _heatmapRenderer( 1 ) );
+      QImage before = render( cached.data(), 0, 0 );
+
+      // the points of the cell within the tile get a larger weight
+      QgsChangedAttributesMap changes;
+      Q_FOREACH ( QgsFeatureId id, mStackedIds )
+      {
+        changes[ id ].insert( 0, 20.0 );
+      }
+      QVERIFY( mLayer->dataProvider()->changeAttributeValues( changes ) );
+
+      QImage after = render( cached.data(), 0, 0 );
+      QVERIFY( after != before );
+      QVERIFY( after == renderUncached( 0, 0 ) );
+
+      // the neighbouring tiles reuse the margin of the grid accumulated again
+      QVERIFY( render( cached.data(), 100, 0 ) == renderUncached( 100, 0 ) );
+      QVERIFY( render( cached.data(), 0, 0 ) == after );
+
+      changes.clear();
+      Q_FOREACH ( QgsFeatureId id, mStackedIds )
+      {
+        changes[ id ].insert( 0, 1.0 );
+      }
+      QVERIFY( mLayer->dataProvider()->changeAttributeValues( changes ) );
+      QVERIFY( render( cached.data(), 0, 0 ) == before );
+    }
+};
+
+QTEST_MAIN( TestQgsHeatmapRenderer )
+#include "testqgsheatmaprenderer.moc"
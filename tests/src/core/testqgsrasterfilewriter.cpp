@@ -34,6 +34,47 @@
 #include "qgsrasterprojector.h"
 #include <qgsapplication.h>
 
+//! Maximum width and height of the parts read from the pipe, smaller than the test rasters
+static const int PART_SIZE = 32;
+
+//! Straight (not premultiplied) test color of a source value, transparent, opaque or half transparent
+static QRgb _testColor( int value )
+{
+  int alpha = value % 3 == 0 ? 0 : ( value % 3 == 1 ? 255 : 128 );
+  return qRgba( value, 255 - value, ( value * 7 ) % 256, alpha );
+}
+
+static QRgb _premultiplied( QRgb color )
+{
+  int alpha = qAlpha( color );
+  return qRgba( ( qRed( color ) * alpha + 127 ) / 255, ( qGreen( color ) * alpha + 127 ) / 255,
+                ( qBlue( color ) * alpha + 127 ) / 255, alpha );
+}
+
+/** Renders the first band of its input to premultiplied colors, alpha 0 included */
+class TestColorInterface : public QgsRasterInterface
+{
+  public:
+    TestColorInterface()
+        : QgsRasterInterface( nullptr )
+    {}
+
+    QgsRasterInterface* clone() const override { return new TestColorInterface(); }
+    QGis::DataType dataType( int ) const override { return QGis::ARGB32_Premultiplied; }
+    int bandCount() const override { return 1; }
+
+    QgsRasterBlock* block( int, const QgsRectangle& extent, int width, int height ) override
+    {
+      QgsRasterBlock* block = new QgsRasterBlock( QGis::ARGB32_Premultiplied, width, height );
+      QScopedPointer<QgsRasterBlock> input( mInput->block( 1, extent, width, height ) );
+      for ( qgssize i = 0; i < ( qgssize )width * height; ++i )
+      {
+        block->setColor( i, _premultiplied( _testColor( static_cast< int >( input->value( i ) ) ) ) );
+      }
+      return block;
+    }
+};
+
 /** \ingroup UnitTests
  * This is a unit test for the QgsRasterFileWriter class.
  */
@@ -47,8 +88,18 @@ class TestQgsRasterFileWriter: public QObject
     void cleanup() {} // will be called after every testfunction.
 
     void writeTest();
+    void writeDataParts_data();
+    void writeDataParts(); // a raster written in several parts is the same as its source
+    void writeImageParts_data();
+    void writeImageParts(); // premultiplied colors written in several parts, alpha 0 included
   private:
     bool writeTest( const QString& rasterName );
+    //! Returns the name of an output file or directory which does not exist yet
+    QString outputName( const QString& name, bool tiled );
+    //! Removes an output file or a directory of part files
+    void removeOutput( const QString& outputName, bool tiled );
+    //! Opens the written raster, the VRT in tiled mode
+    QgsRasterLayer* openOutput( const QString& outputName, bool tiled );
     void log( const QString& msg );
     void logError( const QString& msg );
     QString mTestDataDir;
@@ -178,6 +229,183 @@ bool TestQgsRasterFileWriter::writeTest( const QString& theRasterName )
   return ok;
 }
 
+QString TestQgsRasterFileWriter::outputName( const QString& name, bool tiled )
+{
+  QString outputName = QDir::tempPath() + "/rasterfilewriter-" + name + ( tiled ? "-tiled" : ".tif" );
+  removeOutput( outputName, tiled );
+  return outputName;
+}
+
+void TestQgsRasterFileWriter::removeOutput( const QString& outputName, bool tiled )
+{
+  if ( !tiled )
+  {
+    QFile::remove( outputName );
+    return;
+  }
+  QDir dir( outputName );
+  Q_FOREACH ( const QString& fileName, dir.entryList( QDir::Files ) )
+  {
+    dir.remove( fileName );
+  }
+  QDir().rmdir( outputName );
+}
+
+QgsRasterLayer* TestQgsRasterFileWriter::openOutput( const QString& outputName, bool tiled )
+{
+  QString fileName = outputName;
+  if ( tiled )
+  {
+    fileName = outputName + '/' + QFileInfo( outputName ).fileName() + ".vrt";
+  }
+  return new QgsRasterLayer( fileName, "output" );
+}
+
+void TestQgsRasterFileWriter::writeDataParts_data()
+{
+  QTest::addColumn<QString>( "rasterName" );
+  QTest::addColumn<bool>( "tiled" );
+
+  QTest::newRow( "byte" ) << "landsat.tif" << false;
+  QTest::newRow( "byte tiled" ) << "landsat.tif" << true;
+  QTest::newRow( "float32" ) << "landsat-f32-b1.tif" << false;
+  QTest::newRow( "int16 tiled" ) << "landsat-int16-b1.tif" << true;
+}
+
+void TestQgsRasterFileWriter::writeDataParts()
+{
+  QFETCH( QString, rasterName );
+  QFETCH( bool, tiled );
+
+  QgsRasterLayer source( mTestDataDir + rasterName, "source" );
+  QVERIFY( source.isValid() );
+  QgsRasterDataProvider* provider = source.dataProvider();
+  int cols = provider->xSize();
+  int rows = provider->ySize();
+  QVERIFY( cols > PART_SIZE );
+  QVERIFY( rows > PART_SIZE );
+
+  QString output = outputName( QFileInfo( rasterName ).completeBaseName(), tiled );
+  QgsRasterFileWriter fileWriter( output );
+  fileWriter.setTiledMode( tiled );
+  fileWriter.setMaxTileWidth( PART_SIZE );
+  fileWriter.setMaxTileHeight( PART_SIZE );
+  QgsRasterPipe pipe;
+  QVERIFY( pipe.set( provider->clone() ) );
+  QCOMPARE( fileWriter.writeRaster( &pipe, cols, rows, provider->extent(), provider->crs() ), QgsRasterFileWriter::NoError );
+  if ( tiled )
+  {
+    //a VRT and several part files
+    QVERIFY( QDir( output ).entryList( QStringList() << "*.tif", QDir::Files ).size() > 1 );
+  }
+
+  {
+    QScopedPointer<QgsRasterLayer> written( openOutput( output, tiled ) );
+    QVERIFY( written->isValid() );
+    QgsRasterDataProvider* writtenProvider = written->dataProvider();
+    QCOMPARE( writtenProvider->xSize(), cols );
+    QCOMPARE( writtenProvider->ySize(), rows );
+    QCOMPARE( writtenProvider->bandCount(), provider->bandCount() );
+    for ( int band = 1; band <= provider->bandCount(); ++band )
+    {
+      QCOMPARE( writtenProvider->dataType( band ), provider->dataType( band ) );
+      QScopedPointer<QgsRasterBlock> expected( provider->block( band, provider->extent(), cols, rows ) );
+      QScopedPointer<QgsRasterBlock> block( writtenProvider->block( band, provider->extent(), cols, rows ) );
+      for ( qgssize i = 0; i < ( qgssize )cols * rows; ++i )
+      {
+        QCOMPARE( block->isNoData( i ), expected->isNoData( i ) );
+        QCOMPARE( block->value( i ), expected->value( i ) );
+      }
+    }
+  }
+  removeOutput( output, tiled );
+}
+
+void TestQgsRasterFileWriter::writeImageParts_data()
+{
+  QTest::addColumn<bool>( "tiled" );
+
+  QTest::newRow( "single file" ) << false;
+  QTest::newRow( "tiled" ) << true;
+}
+
+void TestQgsRasterFileWriter::writeImageParts()
+{
+  QFETCH( bool, tiled );
+
+  QgsRasterLayer source( mTestDataDir + "landsat.tif", "source" );
+  QVERIFY( source.isValid() );
+  QgsRasterDataProvider* provider = source.dataProvider();
+  int cols = provider->xSize();
+  int rows = provider->ySize();
+
+  QString output = outputName( "image", tiled );
+  QgsRasterFileWriter fileWriter( output );
+  fileWriter.setTiledMode( tiled );
+  fileWriter.setMaxTileWidth( PART_SIZE );
+  fileWriter.setMaxTileHeight( PART_SIZE );
+  QgsRasterPipe pipe;
+  QVERIFY( pipe.set( provider->clone() ) );
+  QVERIFY( pipe.insert( 1, new TestColorInterface() ) );
+  QCOMPARE( fileWriter.writeRaster( &pipe, cols, rows, provider->extent(), provider->crs() ), QgsRasterFileWriter::NoError );
+  if ( tiled )
+  {
+    //a VRT and several part files
+    QVERIFY( QDir( output ).entryList( QStringList() << "*.tif", QDir::Files ).size() > 1 );
+  }
+
+  {
+    QScopedPointer<QgsRasterLayer> written( openOutput( output, tiled ) );
+    QVERIFY( written->isValid() );
+    QgsRasterDataProvider* writtenProvider = written->dataProvider();
+    QCOMPARE( writtenProvider->xSize(), cols );
+    QCOMPARE( writtenProvider->ySize(), rows );
+    QCOMPARE( writtenProvider->bandCount(), 4 );
+
+    QScopedPointer<QgsRasterBlock> values( provider->block( 1, provider->extent(), cols, rows ) );
+    QList<QgsRasterBlock*> channels;
+    for ( int band = 1; band <= 4; ++band )
+    {
+      QCOMPARE( writtenProvider->dataType( band ), QGis::Byte );
+      channels << writtenProvider->block( band, provider->extent(), cols, rows );
+    }
+
+    int transparent = 0;
+    int translucent = 0;
+    for ( qgssize i = 0; i < ( qgssize )cols * rows; ++i )
+    {
+      QRgb expected = _testColor( static_cast< int >( values->value( i ) ) );
+      int red = static_cast< int >( channels.at( 0 )->value( i ) );
+      int green = static_cast< int >( channels.at( 1 )->value( i ) );
+      int blue = static_cast< int >( channels.at( 2 )->value( i ) );
+      int alpha = static_cast< int >( channels.at( 3 )->value( i ) );
+      QCOMPARE( alpha, qAlpha( expected ) );
+      if ( alpha == 0 )
+      {
+        //premultiplied colors are lost, but not divided by zero
+        QCOMPARE( red, 0 );
+        QCOMPARE( green, 0 );
+        QCOMPARE( blue, 0 );
+        ++transparent;
+      }
+      else
+      {
+        //rounding of the premultiplied colors
+        int tolerance = alpha == 255 ? 0 : 2;
+        QVERIFY( qAbs( red - qRed( expected ) ) <= tolerance );
+        QVERIFY( qAbs( green - qGreen( expected ) ) <= tolerance );
+        QVERIFY( qAbs( blue - qBlue( expected ) ) <= tolerance );
+        if ( alpha < 255 )
+          ++translucent;
+      }
+    }
+    qDeleteAll( channels );
+    QVERIFY( transparent > 0 );
+    QVERIFY( translucent > 0 );
+  }
+  removeOutput( output, tiled );
+}
+
 void TestQgsRasterFileWriter::log( const QString& msg )
 {
   mReport += msg + "<br>";
@@ -84,6 +84,7 @@ class TestQgsRasterLayer : public QObject
     void landsatBasic875Qml();
     void checkDimensions();
     void checkStats();
+    void checkSampledStats();
     void checkScaleOffset();
     void buildExternalOverviews();
     void registry();
@@ -404,6 +405,28 @@ void TestQgsRasterLayer::checkStats()
   mReport += "<p>Passed</p>";
 }
 
+void TestQgsRasterLayer::checkSampledStats()
+{
+  mReport += "<h2>Check Sampled Stats</h2>\n";
+  // Sum is not supported by GDAL statistics, generic statistics are used
+  QgsRasterBandStats myStatistics = mpRasterLayer->dataProvider()->bandStatistics( 1, QgsRasterBandStats::All );
+  QCOMPARE( myStatistics.elementCount, static_cast< qgssize >( 100 ) );
+  QVERIFY( myStatistics.minimumValue == 0 );
+  QVERIFY( myStatistics.maximumValue == 9 );
+  QVERIFY( qgsDoubleNear( myStatistics.mean, 4.5 ) );
+  QVERIFY( qgsDoubleNear( myStatistics.sum, 450 ) );
+  QVERIFY( qgsDoubleNear( myStatistics.stdDev, 2.88675134594813, 0.0000000001 ) );
+  // exact statistics
+  QCOMPARE( myStatistics.meanError, 0.0 );
+
+  QgsRasterBandStats mySampledStatistics = mpRasterLayer->dataProvider()->bandStatistics( 1, QgsRasterBandStats::All, QgsRectangle(), 25 );
+  mReport += QString( "sampled mean = %1 +- %2<br>\n" ).arg( mySampledStatistics.mean ).arg( mySampledStatistics.meanError );
+  QCOMPARE( mySampledStatistics.elementCount, static_cast< qgssize >( 25 ) );
+  QVERIFY( mySampledStatistics.meanError > 0 );
+  QVERIFY( qAbs( mySampledStatistics.mean - 4.5 ) <= mySampledStatistics.meanError );
+  mReport += "<p>Passed</p>";
+}
+
 // test scale_factor and offset - uses netcdf file which may not be supported
 // see http://hub.qgis.org/issues/8417
 void TestQgsRasterLayer::checkScaleOffset()
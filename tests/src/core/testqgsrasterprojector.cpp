@@ -0,0 +1,263 @@
+/***************************************************************************
+     testqgsrasterprojector.cpp
+     --------------------------------------
+    Date                 : October 2016
+    Copyright            : (C) 2016 by the QGIS project
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest/QtTest>
+#include <QObject>
+
+//qgis includes...
+#include "qgsapplication.h"
+#include "qgscoordinatereferencesystem.h"
+#include "qgscoordinatetransform.h"
+#include "qgsrasterblock.h"
+#include "qgsrasterdataprovider.h"
+#include "qgsrasterlayer.h"
+#include "qgsrasterprojector.h"
+
+#include <cmath>
+
+//! Size of the destination blocks, large enough to be mapped on several threads
+static const int DEST_SIZE = 512;
+
+/** \ingroup UnitTests
+ * This is a unit test for the cache of approximation matrices of the raster projector
+ */
+class TestQgsRasterProjector : public QObject
+{
+    Q_OBJECT
+
+  public:
+    TestQgsRasterProjector()
+        : mLayer( nullptr )
+    {}
+
+  private slots:
+    void initTestCase();// will be called before the first testfunction is executed.
+    void cleanupTestCase();// will be called after the last testfunction was executed.
+
+    void referenceBlock_data();
+    void referenceBlock(); // blocks hold the source cells under the centers of the destination cells
+    void cachedBlocks(); // blocks calculated with a cached matrix are the same as without
+    void cacheKey(); // a different datum transform or precision does not reuse the matrix
+
+  private:
+    //! Returns the extent of the layer in a CRS
+    QgsRectangle destExtent( const QgsCoordinateReferenceSystem& destCrs ) const;
+    //! Checks that two blocks have the same size, values and no data
+    static void compareBlocks( QgsRasterBlock* block1, QgsRasterBlock* block2 );
+
+    QgsRasterLayer* mLayer;
+};
+
+void TestQgsRasterProjector::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+
+  QString landsatFileName = QString( TEST_DATA_DIR ) + "/landsat.tif";
+  mLayer = new QgsRasterLayer( landsatFileName, "landsat" );
+  QVERIFY( mLayer->isValid() );
+}
+
+void TestQgsRasterProjector::cleanupTestCase()
+{
+  delete mLayer;
+  QgsApplication::exitQgis();
+}
+
+QgsRectangle TestQgsRasterProjector::destExtent( const QgsCoordinateReferenceSystem& destCrs ) const
+{
+  QgsCoordinateTransform ct( mLayer->crs(), destCrs );
+  return ct.transformBoundingBox( mLayer->extent() );
+}
+
+void TestQgsRasterProjector::compareBlocks( QgsRasterBlock* block1, QgsRasterBlock* block2 )
+{
+  QVERIFY( block1 );
+  QVERIFY( block2 );
+  QCOMPARE( block1->width(), block2->width() );
+  QCOMPARE( block1->height(), block2->height() );
+  QCOMPARE( block1->dataType(), block2->dataType() );
+  for ( qgssize i = 0; i < ( qgssize )block1->width() * block1->height(); ++i )
+  {
+    QCOMPARE( block1->isNoData( i ), block2->isNoData( i ) );
+    if ( !block1->isNoData( i ) )
+    {
+      QCOMPARE( block1->value( i ), block2->value( i ) );
+    }
+  }
+}
+
+void TestQgsRasterProjector::referenceBlock_data()
+{
+  QTest::addColumn<int>( "precision" );
+
+  QTest::newRow( "approximate" ) << static_cast< int >( QgsRasterProjector::Approximate );
+  QTest::newRow( "exact" ) << static_cast< int >( QgsRasterProjector::Exact );
+}
+
+void TestQgsRasterProjector::referenceBlock()
+{
+  QFETCH( int, precision );
+
+  QgsCoordinateReferenceSystem destCrs;
+  destCrs.createFromId( 4326, QgsCoordinateReferenceSystem::EpsgCrsId );
+  QgsRectangle extent = destExtent( destCrs );
+
+  QgsRasterProjector::clearGridCache();
+
+  QgsRasterProjector projector;
+  projector.setInput( mLayer->dataProvider() );
+  projector.setCrs( mLayer->crs(), destCrs );
+  projector.setPrecision( static_cast< QgsRasterProjector::Precision >( precision ) );
+  QScopedPointer<QgsRasterBlock> block( projector.block( 1, extent, DEST_SIZE, DEST_SIZE ) );
+  QVERIFY( block );
+  QCOMPARE( block->width(), DEST_SIZE );
+  QCOMPARE( block->height(), DEST_SIZE );
+
+  //the destination cells are smaller than the source ones, which are read at their own resolution
+  QgsRectangle srcExtent = mLayer->extent();
+  int srcCols = mLayer->width();
+  int srcRows = mLayer->height();
+  QVERIFY( srcCols < DEST_SIZE && srcRows < DEST_SIZE );
+  QScopedPointer<QgsRasterBlock> source( mLayer->dataProvider()->block( 1, srcExtent, srcCols, srcRows ) );
+  double srcXRes = srcExtent.width() / srcCols;
+  double srcYRes = srcExtent.height() / srcRows;
+
+  //cells whose center is projected near the edge of a source cell may be taken from either side of it,
+  //the approximation may move the centers by up to a destination cell
+  double margin = precision == QgsRasterProjector::Exact ? 1e-6 : static_cast< double >( qMax( srcCols, srcRows ) ) / DEST_SIZE;
+
+  QgsCoordinateTransform inverseCt( destCrs, mLayer->crs() );
+  int checked = 0;
+  for ( int row = 0; row < DEST_SIZE; ++row )
+  {
+    for ( int col = 0; col < DEST_SIZE; ++col )
+    {
+      double x = extent.xMinimum() + ( col + 0.5 ) * extent.width() / DEST_SIZE;
+      double y = extent.yMaximum() - ( row + 0.5 ) * extent.height() / DEST_SIZE;
+      QgsPoint srcPoint = inverseCt.transform( x, y );
+      double srcCol = ( srcPoint.x() - srcExtent.xMinimum() ) / srcXRes;
+      double srcRow = ( srcExtent.yMaximum() - srcPoint.y() ) / srcYRes;
+      if ( qAbs( srcCol - qRound( srcCol ) ) < margin || qAbs( srcRow - qRound( srcRow ) ) < margin )
+      {
+        continue;
+      }
+
+      ++checked;
+      qgssize destIndex = static_cast< qgssize >( row ) * DEST_SIZE + col;
+      if ( srcCol < 0 || srcCol >= srcCols || srcRow < 0 || srcRow >= srcRows )
+      {
+        QVERIFY( block->isNoData( destIndex ) );
+        continue;
+      }
+
+      qgssize srcIndex = static_cast< qgssize >( floor( srcRow ) ) * srcCols + static_cast< qgssize >( floor( srcCol ) );
+      QCOMPARE( block->isNoData( destIndex ), source->isNoData( srcIndex ) );
+      if ( !source->isNoData( srcIndex ) )
+      {
+        QCOMPARE( block->value( destIndex ), source->value( srcIndex ) );
+      }
+    }
+  }
+  QVERIFY( checked > DEST_SIZE * DEST_SIZE / 100 );
+}
+
+void TestQgsRasterProjector::cachedBlocks()
+{
+  QgsCoordinateReferenceSystem destCrs;
+  destCrs.createFromId( 4326, QgsCoordinateReferenceSystem::EpsgCrsId );
+  QgsRectangle extent = destExtent( destCrs );
+
+  QgsRasterProjector::clearGridCache();
+
+  QgsRasterProjector projector;
+  projector.setInput( mLayer->dataProvider() );
+  projector.setCrs( mLayer->crs(), destCrs );
+
+  //calculates the matrix
+  QScopedPointer<QgsRasterBlock> uncached( projector.block( 1, extent, DEST_SIZE, DEST_SIZE ) );
+  QVERIFY( QgsRasterProjector::isGridCached( projector.gridCacheKey() ) );
+  QCOMPARE( uncached->width(), DEST_SIZE );
+  QCOMPARE( uncached->height(), DEST_SIZE );
+  int valid = 0;
+  for ( qgssize i = 0; i < ( qgssize )DEST_SIZE * DEST_SIZE; ++i )
+  {
+    if ( !uncached->isNoData( i ) )
+      ++valid;
+  }
+  QVERIFY( valid > 0 );
+
+  //same projector, cached matrix
+  QScopedPointer<QgsRasterBlock> cached( projector.block( 1, extent, DEST_SIZE, DEST_SIZE ) );
+  compareBlocks( uncached.data(), cached.data() );
+
+  //new projector, matrix cached by the first one
+  QgsRasterProjector projector2;
+  projector2.setInput( mLayer->dataProvider() );
+  projector2.setCrs( mLayer->crs(), destCrs );
+  QScopedPointer<QgsRasterBlock> cached2( projector2.block( 1, extent, DEST_SIZE, DEST_SIZE ) );
+  compareBlocks( uncached.data(), cached2.data() );
+
+  //matrix calculated again
+  QgsRasterProjector::clearGridCache();
+  QVERIFY( !QgsRasterProjector::isGridCached( projector.gridCacheKey() ) );
+  QScopedPointer<QgsRasterBlock> recalculated( projector.block( 1, extent, DEST_SIZE, DEST_SIZE ) );
+  compareBlocks( uncached.data(), recalculated.data() );
+}
+
+void TestQgsRasterProjector::cacheKey()
+{
+  //ED50 has datum transforms from WGS 84
+  QgsCoordinateReferenceSystem destCrs;
+  destCrs.createFromId( 4230, QgsCoordinateReferenceSystem::EpsgCrsId );
+  QList< QList< int > > transforms = QgsCoordinateTransform::datumTransformations( mLayer->crs(), destCrs );
+  QVERIFY( !transforms.isEmpty() );
+  QCOMPARE( transforms.at( 0 ).size(), 2 );
+  QgsRectangle extent = destExtent( destCrs );
+
+  QgsRasterProjector::clearGridCache();
+
+  QgsRasterProjector projector;
+  projector.setInput( mLayer->dataProvider() );
+  projector.setCrs( mLayer->crs(), destCrs );
+  QScopedPointer<QgsRasterBlock> block( projector.block( 1, extent, DEST_SIZE, DEST_SIZE ) );
+  QString defaultKey = projector.gridCacheKey();
+  QVERIFY( QgsRasterProjector::isGridCached( defaultKey ) );
+
+  //datum transform
+  projector.setCrs( mLayer->crs(), destCrs, transforms.at( 0 ).at( 0 ), transforms.at( 0 ).at( 1 ) );
+  QString datumKey = projector.gridCacheKey();
+  QVERIFY( datumKey != defaultKey );
+  QVERIFY( !QgsRasterProjector::isGridCached( datumKey ) );
+  block.reset( projector.block( 1, extent, DEST_SIZE, DEST_SIZE ) );
+  QCOMPARE( projector.gridCacheKey(), datumKey );
+  QVERIFY( QgsRasterProjector::isGridCached( datumKey ) );
+
+  //precision
+  projector.setCrs( mLayer->crs(), destCrs );
+  projector.setPrecision( QgsRasterProjector::Exact );
+  QString exactKey = projector.gridCacheKey();
+  QVERIFY( exactKey != defaultKey );
+  QVERIFY( exactKey != datumKey );
+  QVERIFY( !QgsRasterProjector::isGridCached( exactKey ) );
+  block.reset( projector.block( 1, extent, DEST_SIZE, DEST_SIZE ) );
+  QVERIFY( QgsRasterProjector::isGridCached( exactKey ) );
+
+  //back to the defaults, the first matrix is still there
+  projector.setPrecision( QgsRasterProjector::Approximate );
+  QCOMPARE( projector.gridCacheKey(), defaultKey );
+  QVERIFY( QgsRasterProjector::isGridCached( defaultKey ) );
+}
+
+QTEST_MAIN( TestQgsRasterProjector )
+#include "testqgsrasterprojector.moc"
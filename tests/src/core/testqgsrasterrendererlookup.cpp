@@ -0,0 +1,225 @@
+/***************************************************************************
+     testqgsrasterrendererlookup.cpp
+     --------------------------------------
+    Date                 : October 2016
+    Copyright            : (C) 2016 by the QGIS project
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest/QtTest>
+#include <QObject>
+
+//qgis includes...
+#include "qgsapplication.h"
+#include "qgscolorrampshader.h"
+#include "qgscontrastenhancement.h"
+#include "qgsmultibandcolorrenderer.h"
+#include "qgsrasterblock.h"
+#include "qgsrasterinterface.h"
+#include "qgsrastershader.h"
+#include "qgssinglebandgrayrenderer.h"
+#include "qgssinglebandpseudocolorrenderer.h"
+
+static const int BLOCK_SIZE = 8;
+
+Q_DECLARE_METATYPE( QGis::DataType )
+
+/** Raster input returning the same values for any extent, as blocks of a given data type*/
+class TestLookupRasterInput : public QgsRasterInterface
+{
+  public:
+    TestLookupRasterInput( QGis::DataType type, const QList< QVector<double> >& bands, double noDataValue )
+        : QgsRasterInterface( nullptr )
+        , mType( type )
+        , mBands( bands )
+        , mNoDataValue( noDataValue )
+    {}
+
+    QgsRasterInterface* clone() const override { return new TestLookupRasterInput( mType, mBands, mNoDataValue ); }
+    QGis::DataType dataType( int ) const override { return mType; }
+    int bandCount() const override { return mBands.size(); }
+
+    QgsRasterBlock* block( int bandNo, const QgsRectangle&, int width, int height ) override
+    {
+      QgsRasterBlock* block = new QgsRasterBlock( mType, width, height, mNoDataValue );
+      const QVector<double>& values = mBands.at( bandNo - 1 );
+      for ( qgssize i = 0; i < ( qgssize )width * height; ++i )
+      {
+        block->setValue( i, values.at( i ) );
+      }
+      return block;
+    }
+
+  private:
+    QGis::DataType mType;
+    QList< QVector<double> > mBands;
+    double mNoDataValue;
+};
+
+/** \ingroup UnitTests
+ * Checks that the renderers give the same colors for integer blocks, which are mapped through lookup tables,
+ * as for the same values in float blocks, which are not.
+ */
+class TestQgsRasterRendererLookup: public QObject
+{
+    Q_OBJECT
+  private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void lookupTableOutput_data();
+    void lookupTableOutput();
+
+  private:
+    //! Smallest value of the test blocks of a data type, negative for Int16
+    static double baseValue( QGis::DataType type );
+    static QgsRasterRenderer* createRenderer( const QString& renderer, QgsRasterInterface* input, QGis::DataType type );
+};
+
+void TestQgsRasterRendererLookup::initTestCase()
+{
+  QgsApplication::init();
+  QgsApplication::initQgis();
+}
+
+void TestQgsRasterRendererLookup::cleanupTestCase()
+{
+  QgsApplication::exitQgis();
+}
+
+double TestQgsRasterRendererLookup::baseValue( QGis::DataType type )
+{
+  switch ( type )
+  {
+    case QGis::UInt16:
+      return 1000;
+    case QGis::Int16:
+      return -30;
+    default:
+      return 10;
+  }
+}
+
+QgsRasterRenderer* TestQgsRasterRendererLookup::createRenderer( const QString& renderer, QgsRasterInterface* input, QGis::DataType type )
+{
+  double base = baseValue( type );
+  if ( renderer == "pseudocolor" )
+  {
+    QgsColorRampShader* function = new QgsColorRampShader( base, base + 40 );
+    function->setColorRampType( QgsColorRampShader::INTERPOLATED );
+    QList<QgsColorRampShader::ColorRampItem> items;
+    items << QgsColorRampShader::ColorRampItem( base, QColor( 255, 0, 0 ) )
+    << QgsColorRampShader::ColorRampItem( base + 20, QColor( 0, 255, 0, 128 ) )
+    << QgsColorRampShader::ColorRampItem( base + 40, QColor( 0, 0, 255 ) );
+    function->setColorRampItemList( items );
+    QgsRasterShader* shader = new QgsRasterShader( base, base + 40 );
+    shader->setRasterShaderFunction( function );
+    return new QgsSingleBandPseudoColorRenderer( input, 1, shader );
+  }
+
+  bool stretch = renderer.endsWith( "stretch" );
+  if ( renderer.startsWith( "gray" ) )
+  {
+    QgsSingleBandGrayRenderer* gray = new QgsSingleBandGrayRenderer( input, 1 );
+    if ( stretch )
+    {
+      QgsContrastEnhancement* ce = new QgsContrastEnhancement( type );
+      ce->setContrastEnhancementAlgorithm( QgsContrastEnhancement::StretchToMinimumMaximum, false );
+      ce->setMinimumValue( base + 3, false );
+      ce->setMaximumValue( base + 30 );
+      gray->setContrastEnhancement( ce );
+    }
+    return gray;
+  }
+
+  QgsMultiBandColorRenderer* multiBand = new QgsMultiBandColorRenderer( input, 1, 2, 3 );
+  if ( stretch )
+  {
+    QgsContrastEnhancement* red = new QgsContrastEnhancement( type );
+    red->setContrastEnhancementAlgorithm( QgsContrastEnhancement::StretchToMinimumMaximum, false );
+    red->setMinimumValue( base + 3, false );
+    red->setMaximumValue( base + 30 );
+    multiBand->setRedContrastEnhancement( red );
+    //values out of the clip range are not displayable
+    QgsContrastEnhancement* blue = new QgsContrastEnhancement( type );
+    blue->setContrastEnhancementAlgorithm( QgsContrastEnhancement::ClipToMinimumMaximum, false );
+    blue->setMinimumValue( base + 10, false );
+    blue->setMaximumValue( base + 35 );
+    multiBand->setBlueContrastEnhancement( blue );
+  }
+  return multiBand;
+}
+
+void TestQgsRasterRendererLookup::lookupTableOutput_data()
+{
+  QTest::addColumn<QString>( "renderer" );
+  QTest::addColumn<QGis::DataType>( "type" );
+
+  QStringList renderers;
+  renderers << "pseudocolor" << "gray" << "gray stretch" << "multiband" << "multiband stretch";
+  Q_FOREACH ( const QString& renderer, renderers )
+  {
+    QTest::newRow( QString( "%1 Byte" ).arg( renderer ).toLocal8Bit().constData() ) << renderer << QGis::Byte;
+    QTest::newRow( QString( "%1 UInt16" ).arg( renderer ).toLocal8Bit().constData() ) << renderer << QGis::UInt16;
+    QTest::newRow( QString( "%1 Int16" ).arg( renderer ).toLocal8Bit().constData() ) << renderer << QGis::Int16;
+  }
+}
+
+void TestQgsRasterRendererLookup::lookupTableOutput()
+{
+  QFETCH( QString, renderer );
+  QFETCH( QGis::DataType, type );
+
+  //41 different values in 64 pixels, so that the integer blocks are mapped through a table,
+  //with no data values in each band
+  double base = baseValue( type );
+  double noDataValue = base + 5;
+  QList< QVector<double> > bands;
+  for ( int band = 0; band < 3; ++band )
+  {
+    QVector<double> values( BLOCK_SIZE * BLOCK_SIZE );
+    for ( int i = 0; i < values.size(); ++i )
+    {
+      values[i] = base + ( i * 7 + band * 13 ) % 41;
+    }
+    bands << values;
+  }
+
+  TestLookupRasterInput integerInput( type, bands, noDataValue );
+  TestLookupRasterInput floatInput( QGis::Float32, bands, noDataValue );
+  QScopedPointer<QgsRasterRenderer> integerRenderer( createRenderer( renderer, &integerInput, type ) );
+  QScopedPointer<QgsRasterRenderer> floatRenderer( createRenderer( renderer, &floatInput, type ) );
+
+  QgsRectangle extent( 0, 0, BLOCK_SIZE, BLOCK_SIZE );
+  QScopedPointer<QgsRasterBlock> integerBlock( integerRenderer->block( 1, extent, BLOCK_SIZE, BLOCK_SIZE ) );
+  QScopedPointer<QgsRasterBlock> floatBlock( floatRenderer->block( 1, extent, BLOCK_SIZE, BLOCK_SIZE ) );
+  QCOMPARE( integerBlock->width(), BLOCK_SIZE );
+  QCOMPARE( floatBlock->width(), BLOCK_SIZE );
+
+  int noDataPixels = 0;
+  int coloredPixels = 0;
+  for ( qgssize i = 0; i < ( qgssize )BLOCK_SIZE * BLOCK_SIZE; ++i )
+  {
+    QCOMPARE( integerBlock->color( i ), floatBlock->color( i ) );
+    if ( bands.at( 0 ).at( i ) == noDataValue )
+    {
+      QCOMPARE( integerBlock->color( i ), QgsRasterRenderer::NODATA_COLOR );
+      ++noDataPixels;
+    }
+    else if ( integerBlock->color( i ) != QgsRasterRenderer::NODATA_COLOR )
+    {
+      ++coloredPixels;
+    }
+  }
+  QVERIFY( noDataPixels > 0 );
+  //negative Int16 values are valid values, not no data
+  QVERIFY( coloredPixels > 0 );
+}
+
+QTEST_MAIN( TestQgsRasterRendererLookup )
+#include "testqgsrasterrendererlookup.moc"
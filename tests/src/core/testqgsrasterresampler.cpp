@@ -0,0 +1,251 @@
+/***************************************************************************
+     testqgsrasterresampler.cpp
+     --------------------------------------
+    Date                 : October 2016
+    Copyright            : (C) 2016 by the QGIS project
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include <QtTest/QtTest>
+#include <QObject>
+#include <QImage>
+
+//qgis includes...
+#include "qgsbilinearrasterresampler.h"
+#include "qgscubicrasterresampler.h"
+#include "qgslanczosrasterresampler.h"
+
+//! Maximum difference of a channel from the expected value, in color levels
+static const int TOLERANCE = 1;
+
+static QgsRasterResampler* _createResampler( const QString& type )
+{
+  if ( type == "bilinear" )
+    return new QgsBilinearRasterResampler();
+  if ( type == "cubic" )
+    return new QgsCubicRasterResampler();
+  return new QgsLanczosRasterResampler();
+}
+
+//! Source coordinate of the center of a destination pixel
+static double _srcCoordinate( int dstIndex, int srcSize, int dstSize )
+{
+  return ( dstIndex + 0.5 ) * srcSize / dstSize - 0.5;
+}
+
+/** \ingroup UnitTests
+ * This is a unit test for the bilinear, cubic and lanczos raster resamplers
+ */
+class TestQgsRasterResampler : public QObject
+{
+    Q_OBJECT
+
+  private slots:
+    void constantImage_data();
+    void constantImage(); // a constant image stays constant, up and down
+    void linearRamp_data();
+    void linearRamp(); // linear ramps are reproduced inside the image when upsampling
+    void sourcePixels_data();
+    void sourcePixels(); // the kernels interpolate, destination pixels centered on source pixels keep their value
+    void premultiplied_data();
+    void premultiplied(); // negative lobes do not give components larger than alpha
+    void averageDownsampling(); // bilinear downsampling averages the covered pixels
+};
+
+static void _addResamplerRows()
+{
+  QTest::addColumn<QString>( "type" );
+  QTest::addColumn<int>( "radius" );
+
+  QTest::newRow( "bilinear" ) << "bilinear" << 1;
+  QTest::newRow( "cubic" ) << "cubic" << 2;
+  QTest::newRow( "lanczos" ) << "lanczos" << 3;
+}
+
+void TestQgsRasterResampler::constantImage_data()
+{
+  _addResamplerRows();
+}
+
+void TestQgsRasterResampler::constantImage()
+{
+  QFETCH( QString, type );
+
+  QImage src( 16, 12, QImage::Format_ARGB32_Premultiplied );
+  src.fill( qRgba( 40, 80, 120, 200 ) );
+  QScopedPointer<QgsRasterResampler> resampler( _createResampler( type ) );
+
+  QSize sizes[2] = { QSize( 40, 30 ), QSize( 5, 4 ) };
+  for ( int s = 0; s < 2; ++s )
+  {
+    QImage dst( sizes[s], QImage::Format_ARGB32_Premultiplied );
+    resampler->resample( src, dst );
+    QCOMPARE( dst.size(), sizes[s] );
+    for ( int y = 0; y < dst.height(); ++y )
+    {
+      for ( int x = 0; x < dst.width(); ++x )
+      {
+        QCOMPARE( dst.pixel( x, y ), qRgba( 40, 80, 120, 200 ) );
+      }
+    }
+  }
+}
+
+void TestQgsRasterResampler::linearRamp_data()
+{
+  _addResamplerRows();
+}
+
+void TestQgsRasterResampler::linearRamp()
+{
+  QFETCH( QString, type );
+  QFETCH( int, radius );
+
+  //red increases along x, green along y
+  QImage src( 16, 12, QImage::Format_ARGB32_Premultiplied );
+  for ( int y = 0; y < src.height(); ++y )
+  {
+    for ( int x = 0; x < src.width(); ++x )
+    {
+      src.setPixel( x, y, qRgba( 8 * x + 20, 10 * y + 30, 100, 255 ) );
+    }
+  }
+
+  QScopedPointer<QgsRasterResampler> resampler( _createResampler( type ) );
+  QImage dst( 40, 30, QImage::Format_ARGB32_Premultiplied );
+  resampler->resample( src, dst );
+
+  int checked = 0;
+  for ( int y = 0; y < dst.height(); ++y )
+  {
+    double srcY = _srcCoordinate( y, src.height(), dst.height() );
+    if ( srcY < radius || srcY > src.height() - 1 - radius )
+      continue;
+    for ( int x = 0; x < dst.width(); ++x )
+    {
+      double srcX = _srcCoordinate( x, src.width(), dst.width() );
+      if ( srcX < radius || srcX > src.width() - 1 - radius )
+        continue;
+      QRgb px = dst.pixel( x, y );
+      QVERIFY( qAbs( qRed( px ) - ( 8 * srcX + 20 ) ) <= TOLERANCE + 0.5 );
+      QVERIFY( qAbs( qGreen( px ) - ( 10 * srcY + 30 ) ) <= TOLERANCE + 0.5 );
+      QVERIFY( qAbs( qBlue( px ) - 100 ) <= TOLERANCE );
+      QCOMPARE( qAlpha( px ), 255 );
+      ++checked;
+    }
+  }
+  QVERIFY( checked > 0 );
+}
+
+void TestQgsRasterResampler::sourcePixels_data()
+{
+  _addResamplerRows();
+}
+
+void TestQgsRasterResampler::sourcePixels()
+{
+  QFETCH( QString, type );
+
+  QImage src( 5, 4, QImage::Format_ARGB32_Premultiplied );
+  for ( int y = 0; y < src.height(); ++y )
+  {
+    for ( int x = 0; x < src.width(); ++x )
+    {
+      int value = ( x * 37 + y * 53 ) % 200 + 20;
+      src.setPixel( x, y, qRgba( value, 255 - value, value / 2, 255 ) );
+    }
+  }
+
+  //upsampled 3 times, the destination pixel 3 * i + 1 is centered on the source pixel i
+  QScopedPointer<QgsRasterResampler> resampler( _createResampler( type ) );
+  QImage dst( 15, 12, QImage::Format_ARGB32_Premultiplied );
+  resampler->resample( src, dst );
+  for ( int y = 0; y < src.height(); ++y )
+  {
+    for ( int x = 0; x < src.width(); ++x )
+    {
+      QRgb expected = src.pixel( x, y );
+      QRgb px = dst.pixel( 3 * x + 1, 3 * y + 1 );
+      QVERIFY( qAbs( qRed( px ) - qRed( expected ) ) <= TOLERANCE );
+      QVERIFY( qAbs( qGreen( px ) - qGreen( expected ) ) <= TOLERANCE );
+      QVERIFY( qAbs( qBlue( px ) - qBlue( expected ) ) <= TOLERANCE );
+      QCOMPARE( qAlpha( px ), 255 );
+    }
+  }
+}
+
+void TestQgsRasterResampler::premultiplied_data()
+{
+  _addResamplerRows();
+}
+
+void TestQgsRasterResampler::premultiplied()
+{
+  QFETCH( QString, type );
+
+  //sharp edge between opaque white and transparent pixels
+  QImage src( 8, 8, QImage::Format_ARGB32_Premultiplied );
+  src.fill( qRgba( 0, 0, 0, 0 ) );
+  for ( int y = 0; y < src.height(); ++y )
+  {
+    for ( int x = 0; x < src.width() / 2; ++x )
+    {
+      src.setPixel( x, y, qRgba( 255, 255, 255, 255 ) );
+    }
+  }
+
+  QScopedPointer<QgsRasterResampler> resampler( _createResampler( type ) );
+  QImage dst( 24, 20, QImage::Format_ARGB32_Premultiplied );
+  resampler->resample( src, dst );
+  for ( int y = 0; y < dst.height(); ++y )
+  {
+    for ( int x = 0; x < dst.width(); ++x )
+    {
+      QRgb px = dst.pixel( x, y );
+      QVERIFY( qRed( px ) <= qAlpha( px ) );
+      QVERIFY( qGreen( px ) <= qAlpha( px ) );
+      QVERIFY( qBlue( px ) <= qAlpha( px ) );
+    }
+  }
+  //far from the edge, the colors are unchanged
+  QCOMPARE( dst.pixel( 0, 10 ), qRgba( 255, 255, 255, 255 ) );
+  QCOMPARE( dst.pixel( 23, 10 ), qRgba( 0, 0, 0, 0 ) );
+}
+
+void TestQgsRasterResampler::averageDownsampling()
+{
+  //columns alternating between 0 and 200
+  QImage src( 16, 4, QImage::Format_ARGB32_Premultiplied );
+  for ( int y = 0; y < src.height(); ++y )
+  {
+    for ( int x = 0; x < src.width(); ++x )
+    {
+      int value = x % 2 ? 200 : 0;
+      src.setPixel( x, y, qRgba( value, value, value, 255 ) );
+    }
+  }
+
+  QgsBilinearRasterResampler resampler;
+  QImage dst( 8, 4, QImage::Format_ARGB32_Premultiplied );
+  resampler.resample( src, dst );
+  //the first and last columns also average pixels repeated at the image edge
+  for ( int y = 0; y < dst.height(); ++y )
+  {
+    for ( int x = 1; x < dst.width() - 1; ++x )
+    {
+      QRgb px = dst.pixel( x, y );
+      QVERIFY( qAbs( qRed( px ) - 100 ) <= TOLERANCE );
+      QVERIFY( qAbs( qGreen( px ) - 100 ) <= TOLERANCE );
+      QVERIFY( qAbs( qBlue( px ) - 100 ) <= TOLERANCE );
+      QCOMPARE( qAlpha( px ), 255 );
+    }
+  }
+}
+
+QTEST_MAIN( TestQgsRasterResampler )
+#include "testqgsrasterresampler.moc"
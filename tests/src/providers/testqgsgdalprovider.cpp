@@ -27,9 +27,13 @@
 #include <qgis.h>
 #include <qgsapplication.h>
 #include <qgsproviderregistry.h>
+#include <qgsrasterblock.h>
 #include <qgsrasterdataprovider.h>
 #include <qgsrectangle.h>
 
+#include <gdal.h>
+#include <cpl_string.h>
+
 /** \ingroup UnitTests
  * This is a unit test for the gdal provider
  */
@@ -48,6 +52,7 @@ class TestQgsGdalProvider : public QObject
     void noData();
     void invalidNoDataInSourceIgnored();
     void isRepresentableValue();
+    void blockReads(); //test block aligned, cached reads
 
   private:
     QString mTestDataDir;
@@ -196,5 +201,78 @@ void TestQgsGdalProvider::isRepresentableValue()
   QCOMPARE( QgsRaster::isRepresentableValue( std::numeric_limits<double>::max(), QGis::Float64 ), true );
 }
 
+//! Compare a block read by the provider with GDALRasterIO of the same window
+static void compareWithRasterIO( QgsRasterDataProvider* rp, GDALDatasetH dataset, int xOff, int yOff, int width, int height, int bufWidth, int bufHeight )
+{
+  // the test raster has a geotransform of 1 unit per cell, with its origin in the top left corner
+  int rasterHeight = GDALGetRasterYSize( dataset );
+  QgsRectangle extent( xOff, rasterHeight - yOff - height, xOff + width, rasterHeight - yOff );
+  QgsRasterBlock* block = rp->block( 1, extent, bufWidth, bufHeight );
+  QVERIFY( block->isValid() );
+
+  QVector<qint16> expected( bufWidth * bufHeight );
+  QCOMPARE( GDALRasterIO( GDALGetRasterBand( dataset, 1 ), GF_Read, xOff, yOff, width, height,
+                          expected.data(), bufWidth, bufHeight, GDT_Int16, 0, 0 ), CE_None );
+  for ( int row = 0; row < bufHeight; row++ )
+  {
+    for ( int col = 0; col < bufWidth; col++ )
+    {
+      QCOMPARE( block->value( row, col ), static_cast<double>( expected[row * bufWidth + col] ) );
+    }
+  }
+  delete block;
+}
+
+void TestQgsGdalProvider::blockReads()
+{
+  // tiled raster of 6 x 2 read units (128 x 128 tiles are merged into 128 x 512 units)
+  int width = 700;
+  int height = 600;
+  QString raster = QDir::tempPath() + "/qgis_test_block_reads.tif";
+  char **options = nullptr;
+  options = CSLSetNameValue( options, "TILED", "YES" );
+  options = CSLSetNameValue( options, "BLOCKXSIZE", "128" );
+  options = CSLSetNameValue( options, "BLOCKYSIZE", "128" );
+  GDALDatasetH dataset = GDALCreate( GDALGetDriverByName( "GTiff" ), raster.toUtf8().constData(), width, height, 1, GDT_Int16, options );
+  CSLDestroy( options );
+  QVERIFY( dataset );
+  double geoTransform[6] = { 0, 1, 0, static_cast<double>( height ), 0, -1 };
+  GDALSetGeoTransform( dataset, geoTransform );
+  QVector<qint16> values( width * height );
+  for ( int i = 0; i < values.size(); i++ )
+  {
+    values[i] = static_cast<qint16>(( i * 7919 ) % 65536 - 32768 );
+  }
+  QCOMPARE( GDALRasterIO( GDALGetRasterBand( dataset, 1 ), GF_Write, 0, 0, width, height, values.data(), width, height, GDT_Int16, 0, 0 ), CE_None );
+  GDALClose( dataset );
+
+  QgsDataProvider* provider = QgsProviderRegistry::instance()->provider( "gdal", raster );
+  QVERIFY( provider->isValid() );
+  QgsRasterDataProvider* rp = dynamic_cast< QgsRasterDataProvider* >( provider );
+  QVERIFY( rp );
+  dataset = GDALOpen( raster.toUtf8().constData(), GA_ReadOnly );
+  QVERIFY( dataset );
+
+  // units missing from the cache are read in parallel, the second read comes from the cache
+  compareWithRasterIO( rp, dataset, 0, 0, width, height, width, height );
+  compareWithRasterIO( rp, dataset, 0, 0, width, height, width, height );
+  // window crossing unit borders
+  compareWithRasterIO( rp, dataset, 100, 50, 400, 500, 400, 500 );
+  // decimated reads sample the nearest cells
+  compareWithRasterIO( rp, dataset, 0, 0, width, height, width / 2, height / 2 );
+  compareWithRasterIO( rp, dataset, 30, 20, 600, 550, 257, 311 );
+
+  // clones share the read datasets, which must remain usable once a clone is deleted
+  QgsRasterDataProvider* clone = dynamic_cast< QgsRasterDataProvider* >( rp->clone() );
+  QVERIFY( clone );
+  compareWithRasterIO( clone, dataset, 0, 0, width, height, 333, 222 );
+  delete clone;
+  compareWithRasterIO( rp, dataset, 0, 0, width, height, 111, 99 );
+
+  GDALClose( dataset );
+  delete provider;
+  QFile::remove( raster );
+}
+
 QTEST_MAIN( TestQgsGdalProvider )
 #include "testqgsgdalprovider.moc"
@@ -12,10 +12,12 @@
  *   (at your option) any later version.                                   *
  *                                                                         *
  ***************************************************************************/
+#include <QDir>
 #include <QFile>
 #include <QObject>
 #include <QtTest/QtTest>
 #include <qgswmsprovider.h>
+#include <qgstilecache.h>
 #include <qgsapplication.h>
 
 /** \ingroup UnitTests
@@ -75,6 +77,93 @@ class TestQgsWmsProvider: public QObject
       QCOMPARE( provider.getLegendGraphicUrl(), QString( "http://localhost:8380/mapserv?" ) );
     }
 
+    void tileCache()
+    {
+      QgsTileCache::clear();
+      // 64x64 ARGB32 tiles are 16 KB each
+      QgsTileCache::setMaxCost( 40 );
+      QImage tile( 64, 64, QImage::Format_ARGB32 );
+      tile.fill( 0 );
+
+      QgsTileCache::insertTile( QUrl( "http://localhost/tile?TILEROW=0&TILECOL=0" ), tile );
+      QgsTileCache::insertTile( QUrl( "http://localhost/tile?TILEROW=0&TILECOL=1" ), tile );
+      QCOMPARE( QgsTileCache::count(), 2 );
+
+      // touch the first tile, so that the second one is the least recently used
+      QImage image;
+      QVERIFY( QgsTileCache::tile( QUrl( "http://localhost/tile?TILEROW=0&TILECOL=0" ), image ) );
+      QCOMPARE( image.size(), QSize( 64, 64 ) );
+
+      QgsTileCache::insertTile( QUrl( "http://localhost/tile?TILEROW=0&TILECOL=2" ), tile );
+      QCOMPARE( QgsTileCache::count(), 2 );
+      QVERIFY( QgsTileCache::totalCost() <= 40 );
+      QVERIFY( QgsTileCache::contains( QUrl( "http://localhost/tile?TILEROW=0&TILECOL=0" ) ) );
+      QVERIFY( !QgsTileCache::contains( QUrl( "http://localhost/tile?TILEROW=0&TILECOL=1" ) ) );
+      QVERIFY( !QgsTileCache::tile( QUrl( "http://localhost/tile?TILEROW=0&TILECOL=1" ), image ) );
+
+      QgsTileCache::clear();
+      QgsTileCache::setMaxCost( 64 * 1024 );
+    }
+
+    void tileCacheExpiry()
+    {
+      QgsTileCache::clear();
+      QImage tile( 16, 16, QImage::Format_ARGB32 );
+      tile.fill( 0 );
+      QUrl expired( "http://localhost/tile?TILEROW=1&TILECOL=0" );
+      QUrl valid( "http://localhost/tile?TILEROW=1&TILECOL=1" );
+      QUrl otherLayer( "http://localhost/other?TILEROW=1&TILECOL=1" );
+
+      QgsTileCache::insertTile( expired, tile, QDateTime::currentDateTime().addSecs( -1 ), "layer" );
+      QgsTileCache::insertTile( valid, tile, QDateTime::currentDateTime().addSecs( 3600 ), "layer" );
+      QgsTileCache::insertTile( otherLayer, tile, QDateTime(), "other" );
+
+      QImage image;
+      QVERIFY( !QgsTileCache::contains( expired ) );
+      QVERIFY( !QgsTileCache::tile( expired, image ) );
+      QVERIFY( QgsTileCache::tile( valid, image ) );
+      QVERIFY( QgsTileCache::tile( otherLayer, image ) );
+
+      // reloading a layer drops its tiles only
+      QgsTileCache::removeLayerTiles( "layer" );
+      QVERIFY( !QgsTileCache::contains( valid ) );
+      QVERIFY( QgsTileCache::contains( otherLayer ) );
+
+      QgsTileCache::clear();
+    }
+
+    void tilePrefetch()
+    {
+      // local stand-in for a tile server
+      QList<QNetworkRequest> requests;
+      for ( int col = 0; col < 3; col++ )
+      {
+        QImage tile( 16, 16, QImage::Format_ARGB32 );
+        tile.fill( qRgb( col * 100, 0, 0 ) );
+        QString fileName = QDir::tempPath() + QString( "/qgis_test_prefetch_tile_0_%1.png" ).arg( col );
+        QVERIFY( tile.save( fileName ) );
+        requests << QNetworkRequest( QUrl::fromLocalFile( fileName ) );
+      }
+
+      QgsTileCache::clear();
+      QgsWmsTilePrefetcher::instance()->prefetch( requests );
+      for ( int i = 0; i < 100 && QgsTileCache::count() < 3; i++ )
+      {
+        QTest::qWait( 50 );
+      }
+      QCOMPARE( QgsTileCache::count(), 3 );
+
+      QImage image;
+      QVERIFY( QgsTileCache::tile( requests[2].url(), image ) );
+      QCOMPARE( QColor( image.pixel( 8, 8 ) ).red(), 200 );
+      QgsTileCache::clear();
+
+      Q_FOREACH ( const QNetworkRequest& request, requests )
+      {
+        QFile::remove( request.url().toLocalFile() );
+      }
+    }
+
   private:
     QgsWmsCapabilities* mCapabilities;
 };
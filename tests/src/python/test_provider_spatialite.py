@@ -19,7 +19,7 @@ import sys
 import shutil
 import tempfile
 
-from qgis.core import QgsVectorLayer, QgsPoint, QgsFeature
+from qgis.core import QgsVectorLayer, QgsPoint, QgsFeature, QgsFeatureRequest, QgsRectangle
 
 from qgis.testing import start_app, unittest
 from utilities import unitTestDataPath
@@ -118,6 +118,18 @@ class TestQgsSpatialiteProvider(unittest.TestCase, ProviderTestCase):
         sql += "VALUES (2, 'toto', GeomFromText('POLYGON((0 0,1 0,1 1,0 1,0 0))', 4326))"
         cur.execute(sql)
 
+        # table with a R*Tree spatial index
+        sql = "CREATE TABLE test_rtree (id INTEGER NOT NULL PRIMARY KEY, name TEXT NOT NULL)"
+        cur.execute(sql)
+        sql = "SELECT AddGeometryColumn('test_rtree', 'geometry', 4326, 'POINT', 'XY')"
+        cur.execute(sql)
+        for i in range(10):
+            sql = "INSERT INTO test_rtree (id, name, geometry) "
+            sql += "VALUES (%d, 'p%d', GeomFromText('POINT(%d %d)', 4326))" % (i + 1, i, i, i)
+            cur.execute(sql)
+        sql = "SELECT CreateSpatialIndex('test_rtree', 'geometry')"
+        cur.execute(sql)
+
         cur.execute("COMMIT")
         con.close()
 
@@ -221,6 +233,30 @@ class TestQgsSpatialiteProvider(unittest.TestCase, ProviderTestCase):
         fields = [f.name() for f in l.dataProvider().fields()]
         self.assertTrue('Geometry' not in fields)
 
+    def test_rtree_requests(self):
+        """Test repeated rectangle and id requests, which reuse cached statements"""
+        l = QgsVectorLayer("dbname=%s table=test_rtree (geometry)" % self.dbname, "test_rtree", "spatialite")
+        self.assertTrue(l.isValid())
+
+        for i in range(3):
+            request = QgsFeatureRequest().setFilterRect(QgsRectangle(1.5, 1.5, 4.5, 4.5))
+            self.assertEqual(set(f['name'] for f in l.getFeatures(request)), set(['p2', 'p3', 'p4']))
+            request = QgsFeatureRequest().setFilterRect(QgsRectangle(6.5, 6.5, 20, 20))
+            self.assertEqual(set(f['name'] for f in l.getFeatures(request)), set(['p7', 'p8', 'p9']))
+
+        request = QgsFeatureRequest().setFilterRect(QgsRectangle(1.5, 1.5, 4.5, 4.5)).setFlags(QgsFeatureRequest.ExactIntersect)
+        self.assertEqual(set(f['name'] for f in l.getFeatures(request)), set(['p2', 'p3', 'p4']))
+
+        request = QgsFeatureRequest().setFilterRect(QgsRectangle(-1, -1, 20, 20)).setLimit(4)
+        self.assertEqual(len([f for f in l.getFeatures(request)]), 4)
+
+        # id lists of different sizes share padded statements
+        fids = [f.id() for f in l.getFeatures()]
+        for n in [1, 2, 3, 5, 7]:
+            request = QgsFeatureRequest().setFilterFids(fids[:n])
+            self.assertEqual(set(f.id() for f in l.getFeatures(request)), set(fids[:n]))
+        self.assertEqual([f.id() for f in l.getFeatures(QgsFeatureRequest(fids[4]))], [fids[4]])
+
     def test_invalid_iterator(self):
         """ Test invalid iterator """
         corrupt_dbname = self.dbname + '.corrupt'